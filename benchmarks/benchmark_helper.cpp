@@ -0,0 +1,75 @@
+
+
+#include <cmath>
+
+#include "benchmark_helper.h"
+
+using namespace realm;
+
+namespace
+{
+
+// Position of all benchmark scenes, a real UTM coordinate
+const double kEasting = 603976.0;
+const double kNorthing = 5791569.0;
+
+} // namespace
+
+camera::Pinhole realm::createBenchmarkCamera(int width, int height, double altitude)
+{
+  double f = static_cast<double>(width);
+  camera::Pinhole cam(f, f, width/2.0, height/2.0, static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+
+  cv::Mat pose = cv::Mat::zeros(3, 4, CV_64F);
+  pose.at<double>(0, 1) = 1.0;
+  pose.at<double>(1, 0) = 1.0;
+  pose.at<double>(2, 2) = -1.0;
+  pose.at<double>(0, 3) = kEasting;
+  pose.at<double>(1, 3) = kNorthing;
+  pose.at<double>(2, 3) = altitude;
+  cam.setPose(pose);
+
+  return cam;
+}
+
+cv::Mat realm::createBenchmarkImage(const cv::Size2i &size)
+{
+  cv::Mat img(size, CV_8UC4);
+  for (int r = 0; r < size.height; ++r)
+    for (int c = 0; c < size.width; ++c)
+      img.at<cv::Vec4b>(r, c) = cv::Vec4b(static_cast<uchar>(c % 256), static_cast<uchar>(r % 256), static_cast<uchar>((r+c) % 256), 255);
+  return img;
+}
+
+CvGridMap::Ptr realm::createBenchmarkMap(const cv::Rect2d &roi, double resolution, float angle)
+{
+  auto map = std::make_shared<CvGridMap>(roi, resolution);
+  cv::Size2i size = map->size();
+
+  cv::Mat elevation(size, CV_32F);
+  for (int r = 0; r < size.height; ++r)
+    for (int c = 0; c < size.width; ++c)
+      elevation.at<float>(r, c) = 100.0f + 2.0f*std::sin(0.01f*static_cast<float>(r)) + 2.0f*std::cos(0.01f*static_cast<float>(c));
+
+  map->add("color_rgb", createBenchmarkImage(size));
+  map->add("elevation", elevation);
+  map->add("elevation_angle", cv::Mat(size, CV_32F, cv::Scalar(angle)));
+  map->add("num_observations", cv::Mat(size, CV_16UC1, cv::Scalar(1)));
+  map->add("elevated", cv::Mat(size, CV_8UC1, cv::Scalar(255)));
+  return map;
+}
+
+cv::Mat realm::createBenchmarkPoints(int nrof_points, double extent)
+{
+  cv::Mat points(nrof_points, 3, CV_64F);
+  cv::RNG rng(42);
+  for (int i = 0; i < nrof_points; ++i)
+  {
+    double x = rng.uniform(-0.5, 0.5) * extent;
+    double y = rng.uniform(-0.5, 0.5) * extent;
+    points.at<double>(i, 0) = kEasting + x;
+    points.at<double>(i, 1) = kNorthing + y;
+    points.at<double>(i, 2) = 100.0 + 2.0*std::sin(0.05*x) + 2.0*std::cos(0.05*y);
+  }
+  return points;
+}
@@ -0,0 +1,51 @@
+
+
+#ifndef OPENREALM_BENCHMARK_HELPER_H
+#define OPENREALM_BENCHMARK_HELPER_H
+
+#include <opencv2/core.hpp>
+
+#include <realm_core/camera.h>
+#include <realm_core/cv_grid_map.h>
+
+namespace realm
+{
+
+/*!
+ * @brief Creates a camera looking straight down on a real UTM coordinate, so single precision kernels have to deal with
+ * the magnitudes of geographic coordinates like in the pipeline
+ * @param width Width of the image in pixels
+ * @param height Height of the image in pixels
+ * @param altitude Altitude of the camera above zero elevation in [m]
+ * @return Camera with pose
+ */
+camera::Pinhole createBenchmarkCamera(int width, int height, double altitude);
+
+/*!
+ * @brief Creates an image with a color gradient, so neither compression nor sampling can take shortcuts
+ * @param size Size of the image
+ * @return Image of type CV_8UC4
+ */
+cv::Mat createBenchmarkImage(const cv::Size2i &size);
+
+/*!
+ * @brief Creates a map with the layers of an observed map of the ortho rectification: color_rgb, elevation,
+ * elevation_angle, num_observations and elevated
+ * @param roi Region of interest in UTM coordinates
+ * @param resolution Resolution in [m/cell]
+ * @param angle Elevation angle of all cells
+ * @return Observed map
+ */
+CvGridMap::Ptr createBenchmarkMap(const cv::Rect2d &roi, double resolution, float angle);
+
+/*!
+ * @brief Creates a point cloud of a smoothly varying surface below the camera created by createBenchmarkCamera
+ * @param nrof_points Number of points
+ * @param extent Edge length of the covered square in [m]
+ * @return Points row-wise as (x, y, z) of type CV_64F
+ */
+cv::Mat createBenchmarkPoints(int nrof_points, double extent);
+
+} // namespace realm
+
+#endif //OPENREALM_BENCHMARK_HELPER_H
@@ -0,0 +1,84 @@
+
+
+#include <realm_core/cv_grid_map.h>
+#include <realm_core/point_cloud.h>
+#include <realm_core/stereo.h>
+
+#include "benchmark_helper.h"
+
+// google benchmark
+#include <benchmark/benchmark.h>
+
+using namespace realm;
+
+// Arguments of the parallel kernels are the number of threads: 1 runs serially, 0 uses all available cores
+
+static void BM_CvGridMap_Add(benchmark::State &state)
+{
+  // Observed map of one frame (100m x 100m, 0.1m/cell) is merged into a global map of 400m x 400m
+  double resolution = 0.1;
+  auto nrof_threads = static_cast<int>(state.range(0));
+  CvGridMap::Ptr global_map = createBenchmarkMap(cv::Rect2d(603776.0, 5791369.0, 400.0, 400.0), resolution, 45.0f);
+  CvGridMap::Ptr observed_map = createBenchmarkMap(cv::Rect2d(603926.0, 5791519.0, 100.0, 100.0), resolution, 60.0f);
+
+  for (auto _ : state)
+    global_map->add(*observed_map, REALM_OVERWRITE_ZERO, false, nullptr, nrof_threads);
+
+  state.SetItemsProcessed(state.iterations() * observed_map->size().area());
+}
+BENCHMARK(BM_CvGridMap_Add)->Arg(1)->Arg(0)->Unit(benchmark::kMillisecond);
+
+static void BM_CvGridMap_GetOverlap(benchmark::State &state)
+{
+  // Overlap of the observed map of one frame with the global map, deep copies of both regions
+  double resolution = 0.1;
+  CvGridMap::Ptr global_map = createBenchmarkMap(cv::Rect2d(603776.0, 5791369.0, 400.0, 400.0), resolution, 45.0f);
+  CvGridMap::Ptr observed_map = createBenchmarkMap(cv::Rect2d(603926.0, 5791519.0, 100.0, 100.0), resolution, 60.0f);
+
+  for (auto _ : state)
+  {
+    CvGridMap::Overlap overlap = global_map->getOverlap(*observed_map);
+    benchmark::DoNotOptimize(overlap);
+  }
+
+  state.SetItemsProcessed(state.iterations() * observed_map->size().area());
+}
+BENCHMARK(BM_CvGridMap_GetOverlap)->Unit(benchmark::kMillisecond);
+
+static void BM_ComputeDepthMapFromPointCloud(benchmark::State &state)
+{
+  // One million points of the dense cloud are projected into the resized image of 2000 x 1500 pixels
+  auto nrof_threads = static_cast<int>(state.range(0));
+  auto cam = std::make_shared<camera::Pinhole>(createBenchmarkCamera(2000, 1500, 120.0));
+  cv::Mat points = createBenchmarkPoints(1000000, 100.0);
+
+  for (auto _ : state)
+  {
+    cv::Mat depthmap = stereo::computeDepthMapFromPointCloud(cam, points, nullptr, nrof_threads);
+    benchmark::DoNotOptimize(depthmap.data);
+  }
+
+  state.SetItemsProcessed(state.iterations() * points.rows);
+}
+BENCHMARK(BM_ComputeDepthMapFromPointCloud)->Arg(1)->Arg(0)->Unit(benchmark::kMillisecond);
+
+static void BM_ComputeDepthMapFromPointCloudTyped(benchmark::State &state)
+{
+  // Same as the matrix version, but the point cloud is read from the typed storage
+  auto nrof_threads = static_cast<int>(state.range(0));
+  auto cam = std::make_shared<camera::Pinhole>(createBenchmarkCamera(2000, 1500, 120.0));
+  cv::Mat points = createBenchmarkPoints(1000000, 100.0);
+  std::vector<uint32_t> point_ids(static_cast<size_t>(points.rows));
+  for (size_t i = 0; i < point_ids.size(); ++i)
+    point_ids[i] = static_cast<uint32_t>(i);
+  PointCloud cloud(point_ids, points);
+
+  for (auto _ : state)
+  {
+    cv::Mat depthmap = stereo::computeDepthMapFromPointCloud(cam, cloud, nullptr, nrof_threads);
+    benchmark::DoNotOptimize(depthmap.data);
+  }
+
+  state.SetItemsProcessed(state.iterations() * cloud.size());
+}
+BENCHMARK(BM_ComputeDepthMapFromPointCloudTyped)->Arg(1)->Arg(0)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,217 @@
+
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <realm_core/loguru.h>
+#include <realm_io/utilities.h>
+#include <realm_stages/pipeline_replay.h>
+#include <realm_stages/stage_settings.h>
+#include <realm_stages/stage_settings_factory.h>
+#include <realm_stages/surface_generation.h>
+#include <realm_stages/ortho_rectification.h>
+#include <realm_stages/mosaicing.h>
+#include <realm_stages/tileing.h>
+
+#include "synthetic_frame_source.h"
+
+using namespace realm;
+
+// Stress test of a single stage with synthetic frames at increasing rates, e.g.
+//   realm_load mosaicing mosaicing/stage_settings.yaml /tmp/load --sweep 1,2,4,8 --frames 200
+// Every rate is run with a fresh stage. Frames are added at the pace of their timestamps, so once the stage saturates
+// its queue fills up and frames are dropped, which shows as fps_out falling behind the rate and growing latencies.
+// Instead of a settings file 'default' runs the stage with its default settings, e.g. for the training of PGO builds.
+
+namespace
+{
+
+void printUsage()
+{
+  std::cerr << "Usage: realm_load <stage> <stage_settings.yaml|default> <output_dir> [options]\n"
+            << "  <stage>              surface_generation, ortho_rectification, mosaicing or tileing\n"
+            << "  --frames <n>         Number of frames per rate (default 100)\n"
+            << "  --sweep <r1,r2,...>  Rates of the frames in [Hz] to be run one after another (default 1)\n"
+            << "  --size <w>x<h>       Size of the images (default 1200x800)\n"
+            << "  --overlap <ratio>    Overlap of neighbouring footprints (default 0.7)\n"
+            << "  --altitude <m>       Altitude above ground (default 100)\n"
+            << "  --gsd <m>            Resolution of the maps, 0 for the footprint of a pixel (default 0)\n"
+            << "  --depth              Add depth maps, so the surface generation computes the elevation\n"
+            << "  --threads <n>        Threads of the stage, 0 uses all cores (default)\n"
+            << "  --timeout <s>        Maximum time to wait for the stage to drain (default 600)" << std::endl;
+}
+
+std::vector<double> parseRates(const std::string &str)
+{
+  std::vector<double> rates;
+  std::stringstream ss(str);
+  std::string token;
+  while (std::getline(ss, token, ','))
+    rates.push_back(std::stod(token));
+  return rates;
+}
+
+cv::Size2i parseSize(const std::string &str)
+{
+  size_t pos = str.find('x');
+  if (pos == std::string::npos)
+    throw(std::invalid_argument("Error parsing image size: Expected <width>x<height>, got '" + str + "'"));
+  return cv::Size2i(std::stoi(str.substr(0, pos)), std::stoi(str.substr(pos + 1)));
+}
+
+StageSettings::Ptr createDefaultSettings(const std::string &name)
+{
+  StageSettings::Ptr settings;
+  if (name == "surface_generation")
+    settings = std::make_shared<SurfaceGenerationSettings>();
+  else if (name == "ortho_rectification")
+    settings = std::make_shared<OrthoRectificationSettings>();
+  else if (name == "mosaicing")
+    settings = std::make_shared<MosaicingSettings>();
+  else if (name == "tileing")
+    settings = std::make_shared<TileingSettings>();
+  else
+    throw(std::invalid_argument("Error creating settings: Unknown stage '" + name + "'"));
+  settings->set("type", name);
+  return settings;
+}
+
+StageBase::Ptr createStage(const std::string &name, const std::string &settings_file)
+{
+  // Stage loops run fast, so the pace of the frames alone determines the load
+  const double rate = 100.0;
+  StageSettings::Ptr settings = (settings_file == "default" ? createDefaultSettings(name)
+                                                            : StageSettingsFactory::load(name, settings_file));
+  if (name == "surface_generation")
+    return std::make_shared<stages::SurfaceGeneration>(settings, rate);
+  if (name == "ortho_rectification")
+    return std::make_shared<stages::OrthoRectification>(settings, rate);
+  if (name == "mosaicing")
+    return std::make_shared<stages::Mosaicing>(settings, rate);
+  if (name == "tileing")
+    return std::make_shared<stages::Tileing>(settings, rate);
+  throw(std::invalid_argument("Error creating stage: Unknown stage '" + name + "'"));
+}
+
+// Frames are filled up to the input of the stage
+SyntheticFrameLevel getFrameLevel(const std::string &name)
+{
+  if (name == "surface_generation")
+    return SyntheticFrameLevel::RAW;
+  if (name == "ortho_rectification")
+    return SyntheticFrameLevel::SURFACE;
+  return SyntheticFrameLevel::ORTHO;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  if (argc < 4)
+  {
+    printUsage();
+    return EXIT_FAILURE;
+  }
+
+  std::string stage_name = argv[1];
+  std::string settings_file = argv[2];
+  std::string output_dir = argv[3];
+  uint32_t nrof_frames = 100;
+  std::vector<double> rates{1.0};
+  SyntheticFrameSettings frame_settings;
+  int nrof_threads = 0;
+  double timeout = 600.0;
+
+  try
+  {
+    for (int i = 4; i < argc; ++i)
+    {
+      std::string arg = argv[i];
+      bool has_value = (i + 1 < argc);
+      if (arg == "--frames" && has_value)
+        nrof_frames = static_cast<uint32_t>(std::stoul(argv[++i]));
+      else if (arg == "--sweep" && has_value)
+        rates = parseRates(argv[++i]);
+      else if (arg == "--size" && has_value)
+        frame_settings.image_size = parseSize(argv[++i]);
+      else if (arg == "--overlap" && has_value)
+        frame_settings.overlap = std::stod(argv[++i]);
+      else if (arg == "--altitude" && has_value)
+        frame_settings.altitude = std::stod(argv[++i]);
+      else if (arg == "--gsd" && has_value)
+        frame_settings.gsd = std::stod(argv[++i]);
+      else if (arg == "--depth")
+        frame_settings.with_depthmap = true;
+      else if (arg == "--threads" && has_value)
+        nrof_threads = std::stoi(argv[++i]);
+      else if (arg == "--timeout" && has_value)
+        timeout = std::stod(argv[++i]);
+      else
+      {
+        printUsage();
+        return EXIT_FAILURE;
+      }
+    }
+    if (rates.empty())
+      throw(std::invalid_argument("Error parsing rates: No rate given for the sweep"));
+
+    if (!io::dirExists(output_dir))
+      io::createDir(output_dir);
+
+    frame_settings.level = getFrameLevel(stage_name);
+
+    std::vector<std::pair<double, stages::PipelineReplay::Report>> results;
+    for (double rate : rates)
+    {
+      frame_settings.rate = rate;
+      auto frame_source = std::make_shared<SyntheticFrameSource>(frame_settings, nrof_frames);
+      LOG_F(INFO, "Adding %u synthetic frames at %.2f Hz to stage [%s]...", nrof_frames, rate, stage_name.c_str());
+
+      std::string directory = output_dir + "/" + std::to_string(results.size());
+      if (!io::dirExists(directory))
+        io::createDir(directory);
+
+      auto thread_pool = std::make_shared<ThreadPool>(nrof_threads);
+      stages::PipelineReplay replay({createStage(stage_name, settings_file)}, directory, thread_pool);
+      replay.setPace(stages::PipelineReplay::Pace::REAL_TIME, 1.0);
+      replay.setDrainTime(2.0, timeout);
+
+      stages::PipelineReplay::Report report = replay.run([frame_source]() { return frame_source->next(); });
+      stages::PipelineReplay::printReport(report);
+      results.emplace_back(rate, report);
+    }
+
+    // Throughput and latency curve of the stage over the rates
+    std::cout << "\n" << std::left << std::setw(10) << "rate [Hz]"
+              << std::right << std::setw(10) << "fps_out" << std::setw(10) << "dropped"
+              << std::setw(12) << "queue p99" << std::setw(12) << "proc p50" << std::setw(12) << "proc p99"
+              << std::setw(12) << "age p99" << "\n";
+    std::cout << std::fixed << std::setprecision(2);
+    bool is_drained = true;
+    for (const auto &result : results)
+    {
+      const stages::PipelineReplay::Report &report = result.second;
+      is_drained = is_drained && report.is_drained;
+      if (report.stages.empty())
+        continue;
+      const stages::PipelineReplay::StageReport &stage = report.stages.front();
+      std::cout << std::left << std::setw(10) << result.first
+                << std::right << std::setw(10) << stage.fps_out << std::setw(10) << stage.statistics.frames_dropped
+                << std::setw(12) << stage.statistics.queue_latency.p99
+                << std::setw(12) << stage.statistics.process_latency.p50
+                << std::setw(12) << stage.statistics.process_latency.p99
+                << std::setw(12) << stage.statistics.frame_age.p99 << "\n";
+    }
+    std::cout << "Latencies in [ms]" << std::endl;
+    return is_drained ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  catch (std::exception &e)
+  {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,93 @@
+
+
+#include <thread>
+
+#include <realm_ortho/dsm.h>
+#include <realm_ortho/gdal_warper.h>
+#include <realm_ortho/map_tiler.h>
+#include <realm_ortho/rectification.h>
+
+#include "benchmark_helper.h"
+
+// google benchmark
+#include <benchmark/benchmark.h>
+
+using namespace realm;
+
+// Arguments of the parallel kernels are the number of threads: 1 runs serially, 0 uses all available cores
+
+static void BM_BackprojectFromGrid(benchmark::State &state)
+{
+  // Resized image of 2000 x 1500 pixels taken from 120m above the surface is rectified with 0.1m/cell. The image
+  // columns are aligned with the y-axis of the world frame, so the footprint is 90m x 120m.
+  auto nrof_threads = static_cast<int>(state.range(0));
+  camera::Pinhole cam = createBenchmarkCamera(2000, 1500, 220.0);
+  cv::Mat img = createBenchmarkImage(cv::Size2i(2000, 1500));
+
+  double GSD = 0.1;
+  CvGridMap::Ptr surface_map = createBenchmarkMap(cv::Rect2d(603976.0 - 45.0, 5791569.0 - 60.0, 90.0, 120.0), GSD, 0.0f);
+  cv::Mat surface = (*surface_map)["elevation"];
+
+  for (auto _ : state)
+  {
+    CvGridMap::Ptr map = ortho::backprojectFromGrid(img, cam, surface, surface_map->roi(), GSD, true, false, nrof_threads);
+    benchmark::DoNotOptimize(map);
+  }
+
+  state.SetItemsProcessed(state.iterations() * surface_map->size().area());
+}
+BENCHMARK(BM_BackprojectFromGrid)->Arg(1)->Arg(0)->Unit(benchmark::kMillisecond);
+
+static void BM_DigitalSurfaceModel_ComputeElevation(benchmark::State &state)
+{
+  // Dense cloud of 200k points covering 100m x 100m. The model is created from scratch, so the time includes building
+  // the spatial index, estimating the resolution and interpolating the elevation of every cell.
+  auto nrof_threads = static_cast<int>(state.range(0));
+  cv::Mat points = createBenchmarkPoints(200000, 100.0);
+  cv::Rect2d roi(603976.0 - 50.0, 5791569.0 - 50.0, 100.0, 100.0);
+
+  for (auto _ : state)
+  {
+    ortho::DigitalSurfaceModel dsm(roi, points, ortho::DigitalSurfaceModel::SurfaceNormalMode::NONE, 5, nrof_threads);
+    benchmark::DoNotOptimize(dsm.getSurfaceGrid());
+  }
+
+  state.SetItemsProcessed(state.iterations() * points.rows);
+}
+BENCHMARK(BM_DigitalSurfaceModel_ComputeElevation)->Arg(1)->Arg(0)->Unit(benchmark::kMillisecond);
+
+static void BM_GdalWarper_WarpRaster(benchmark::State &state)
+{
+  // Observed map of 100m x 100m with 0.1m/cell is warped from UTM into web mercator like in the tileing stage
+  auto nrof_threads = static_cast<int>(state.range(0));
+  CvGridMap::Ptr map = createBenchmarkMap(cv::Rect2d(603926.0, 5791519.0, 100.0, 100.0), 0.1, 45.0f);
+
+  gis::GdalWarper warper;
+  warper.setTargetEPSG(3857);
+  warper.setNrofThreads(nrof_threads > 0 ? nrof_threads : static_cast<int>(std::thread::hardware_concurrency()));
+
+  for (auto _ : state)
+  {
+    CvGridMap::Ptr map_3857 = warper.warpRaster(*map, 32);
+    benchmark::DoNotOptimize(map_3857);
+  }
+
+  state.SetItemsProcessed(state.iterations() * map->size().area());
+}
+BENCHMARK(BM_GdalWarper_WarpRaster)->Arg(1)->Arg(0)->Unit(benchmark::kMillisecond);
+
+static void BM_MapTiler_CreateTiles(benchmark::State &state)
+{
+  // Map of 2000 x 2000 cells in web mercator is sliced into the tiles of the maximum zoom level
+  CvGridMap::Ptr map = createBenchmarkMap(cv::Rect2d(1113194.0, 6800000.0, 300.0, 300.0), 0.15, 45.0f);
+  MapTiler tiler(false);
+
+  for (auto _ : state)
+  {
+    std::map<int, MapTiler::TiledMap> tiles = tiler.createTiles(map);
+    benchmark::DoNotOptimize(tiles);
+  }
+
+  state.SetItemsProcessed(state.iterations() * map->size().area());
+}
+BENCHMARK(BM_MapTiler_CreateTiles)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,279 @@
+
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <realm_core/camera_settings_factory.h>
+#include <realm_core/loguru.h>
+#include <realm_io/dataset_reader.h>
+#include <realm_io/frame_snapshot.h>
+#include <realm_io/realm_import.h>
+#include <realm_io/utilities.h>
+#include <realm_stages/pipeline_replay.h>
+#include <realm_stages/quality_controller.h>
+#include <realm_stages/stage_settings_factory.h>
+#include <realm_stages/surface_generation.h>
+#include <realm_stages/ortho_rectification.h>
+#include <realm_stages/mosaicing.h>
+#include <realm_stages/tileing.h>
+
+#ifdef REPLAY_WITH_POSE_ESTIMATION
+#include <realm_stages/pose_estimation.h>
+#include <realm_vslam_base/visual_slam_settings_factory.h>
+#endif
+
+#ifdef REPLAY_WITH_DENSIFICATION
+#include <realm_stages/densification.h>
+#include <realm_densifier_base/densifier_settings_factory.h>
+#endif
+
+using namespace realm;
+
+// Replays a recorded mission through the pipeline in-process and prints the throughput and latency of every stage.
+// The profile directory is structured like the stage packages:
+//   <profile>/camera/calib.yaml
+//   <profile>/<stage>/stage_settings.yaml   for every stage to be run, e.g. <profile>/mosaicing/stage_settings.yaml
+//   <profile>/<stage>/method/<name>.yaml    framework settings of the pose estimation and densification
+// Stages are run in the order of the pipeline, those without settings are left out. Instead of the image directory a
+// frame snapshot can be replayed, e.g. the inputs of the mosaicing captured with --capture, to run --stage mosaicing
+// alone with identical inputs.
+
+namespace
+{
+
+void printUsage()
+{
+  std::cerr << "Usage: realm_replay <profile_dir> <image_dir|snapshot> <output_dir> [options]\n"
+            << "  --trajectory <file>  Recorded trajectory in TUM format, frames get their pose from it\n"
+            << "  --realtime [factor]  Add frames at the pace of their timestamps, optionally accelerated\n"
+            << "  --stage <name>       Only run this stage, e.g. to replay its captured inputs\n"
+            << "  --capture            Write the inputs of every stage to <output_dir>/<stage>/input.frames.bin\n"
+            << "  --threads <n>        Threads shared by the stages, 0 uses all cores (default)\n"
+            << "  --rate <hz>          Rate of the stage loops (default 100)\n"
+            << "  --adaptive-quality   Degrade the quality of the stages under load instead of dropping frames\n"
+            << "  --timeout <s>        Maximum time to wait for the pipeline to drain (default 600)" << std::endl;
+}
+
+std::string getMethodSettings(const std::string &directory)
+{
+  std::vector<std::string> files = io::getFileList(directory + "/method", ".yaml");
+  if (files.empty())
+    throw(std::invalid_argument("Error loading replay profile: No method settings in " + directory + "/method"));
+  return files.front();
+}
+
+std::vector<StageBase::Ptr> createStages(const std::string &profile_dir, const std::string &stage_only, double rate)
+{
+  std::vector<StageBase::Ptr> stages;
+  auto has_stage = [&](const std::string &name)
+  {
+    return (stage_only.empty() || stage_only == name) && io::fileExists(profile_dir + "/" + name + "/stage_settings.yaml");
+  };
+  auto load_stage = [&](const std::string &name) { return StageSettingsFactory::load(name, profile_dir + "/" + name + "/stage_settings.yaml"); };
+
+#ifdef REPLAY_WITH_POSE_ESTIMATION
+  if (has_stage("pose_estimation"))
+  {
+    std::string directory = profile_dir + "/pose_estimation";
+    stages.push_back(std::make_shared<stages::PoseEstimation>(
+        load_stage("pose_estimation"),
+        VisualSlamSettingsFactory::load(getMethodSettings(directory), directory + "/method"),
+        CameraSettingsFactory::load(profile_dir + "/camera/calib.yaml"),
+        nullptr,
+        rate));
+  }
+#endif
+
+#ifdef REPLAY_WITH_DENSIFICATION
+  if (has_stage("densification"))
+  {
+    std::string directory = profile_dir + "/densification";
+    stages.push_back(std::make_shared<stages::Densification>(
+        load_stage("densification"),
+        DensifierSettingsFactory::load(getMethodSettings(directory), directory + "/method"),
+        rate));
+  }
+#endif
+
+  if (has_stage("surface_generation"))
+    stages.push_back(std::make_shared<stages::SurfaceGeneration>(load_stage("surface_generation"), rate));
+  if (has_stage("ortho_rectification"))
+    stages.push_back(std::make_shared<stages::OrthoRectification>(load_stage("ortho_rectification"), rate));
+  if (has_stage("mosaicing"))
+    stages.push_back(std::make_shared<stages::Mosaicing>(load_stage("mosaicing"), rate));
+  if (has_stage("tileing"))
+    stages.push_back(std::make_shared<stages::Tileing>(load_stage("tileing"), rate));
+
+  return stages;
+}
+
+stages::QualityController::Ptr createQualityController(const std::string &profile_dir, const std::vector<StageBase::Ptr> &stages)
+{
+  auto controller = std::make_shared<stages::QualityController>();
+  for (const auto &stage : stages)
+  {
+    std::string name = stage->getStageName();
+    std::string directory = profile_dir + "/" + name;
+    controller->watch(stage);
+
+    // Lowest quality coarsens the ortho to twice the GSD and reduces the work of the densifier and the DSM
+    if (name == "ortho_rectification")
+      controller->addKnob({stage, "gsd_factor", 1.0, 2.0, false});
+    if (name == "surface_generation")
+    {
+      int knn_max_iter = (*StageSettingsFactory::load(name, directory + "/stage_settings.yaml"))["knn_max_iter"].toInt();
+      controller->addKnob({stage, "knn_max_iter", double(knn_max_iter), double(std::max(knn_max_iter / 4, 1)), true});
+    }
+#ifdef REPLAY_WITH_DENSIFICATION
+    if (name == "densification")
+    {
+      DensifierSettings::Ptr settings = DensifierSettingsFactory::load(getMethodSettings(directory), directory + "/method");
+      if (settings->has("nrof_planes") && settings->has("scale"))
+      {
+        int nrof_planes = (*settings)["nrof_planes"].toInt();
+        double scale = (*settings)["scale"].toDouble();
+        controller->addKnob({stage, "nrof_planes", double(nrof_planes), double(std::max(nrof_planes / 2, 1)), true});
+        controller->addKnob({stage, "scale", scale, scale * 0.5, false});
+      }
+    }
+#endif
+  }
+  return controller;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  if (argc < 4)
+  {
+    printUsage();
+    return EXIT_FAILURE;
+  }
+
+  std::string profile_dir = argv[1];
+  std::string input = argv[2];
+  std::string output_dir = argv[3];
+  std::string trajectory_file;
+  std::string stage_only;
+  bool do_capture = false;
+  bool use_adaptive_quality = false;
+  auto pace = stages::PipelineReplay::Pace::MAX_SPEED;
+  double speedup = 1.0;
+  int nrof_threads = 0;
+  double rate = 100.0;
+  double timeout = 600.0;
+
+  for (int i = 4; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    bool has_value = (i + 1 < argc);
+    if (arg == "--trajectory" && has_value)
+      trajectory_file = argv[++i];
+    else if (arg == "--realtime")
+    {
+      pace = stages::PipelineReplay::Pace::REAL_TIME;
+      if (has_value && argv[i + 1][0] != '-')
+        speedup = std::stod(argv[++i]);
+    }
+    else if (arg == "--stage" && has_value)
+      stage_only = argv[++i];
+    else if (arg == "--capture")
+      do_capture = true;
+    else if (arg == "--adaptive-quality")
+      use_adaptive_quality = true;
+    else if (arg == "--threads" && has_value)
+      nrof_threads = std::stoi(argv[++i]);
+    else if (arg == "--rate" && has_value)
+      rate = std::stod(argv[++i]);
+    else if (arg == "--timeout" && has_value)
+      timeout = std::stod(argv[++i]);
+    else
+    {
+      printUsage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  try
+  {
+    if (!io::dirExists(output_dir))
+      io::createDir(output_dir);
+
+    std::vector<StageBase::Ptr> pipeline = createStages(profile_dir, stage_only, rate);
+    if (pipeline.empty())
+      throw(std::invalid_argument("Error loading replay profile: No stage settings found in " + profile_dir));
+
+    auto thread_pool = std::make_shared<ThreadPool>(nrof_threads);
+    stages::PipelineReplay replay(pipeline, output_dir, thread_pool);
+    replay.setPace(pace, speedup);
+    replay.setDrainTime(2.0, timeout);
+    if (!trajectory_file.empty())
+      replay.setTrajectory(io::loadTrajectoryFromTxtTUM(trajectory_file));
+
+    // Stages only create their directory if they write output, so it is created here for the capture
+    if (do_capture)
+    {
+      for (auto &stage : pipeline)
+      {
+        std::string directory = output_dir + "/" + stage->getStageName();
+        if (!io::dirExists(directory))
+          io::createDir(directory);
+        stage->setInputCapture(std::make_shared<io::FrameSnapshotWriter>(directory + "/input.frames.bin"));
+      }
+    }
+
+    stages::PipelineReplay::FrameSource source;
+    std::shared_ptr<io::FrameSnapshotReader> snapshot_reader;
+    std::shared_ptr<io::Exiv2DatasetReader> dataset_reader;
+    if (io::fileExists(input) && !io::dirExists(input))
+    {
+      LOG_F(INFO, "Replaying snapshot '%s' through %lu stages...", input.c_str(), pipeline.size());
+      snapshot_reader = std::make_shared<io::FrameSnapshotReader>(input);
+      source = [snapshot_reader]() { return snapshot_reader->next(); };
+    }
+    else
+    {
+      auto cam = std::make_shared<camera::Pinhole>(io::loadCameraFromYaml(profile_dir + "/camera/calib.yaml"));
+      dataset_reader = std::make_shared<io::Exiv2DatasetReader>(io::getFileList(input), "", cam);
+      LOG_F(INFO, "Replaying %lu images through %lu stages...", dataset_reader->size(), pipeline.size());
+      source = [dataset_reader]() -> Frame::Ptr
+      {
+        // Images, that can not be opened, are skipped instead of ending the replay
+        while (dataset_reader->hasNext())
+        {
+          Frame::Ptr frame = dataset_reader->next();
+          if (frame)
+            return frame;
+        }
+        return nullptr;
+      };
+    }
+
+    stages::QualityController::Ptr quality_controller;
+    if (use_adaptive_quality)
+    {
+      quality_controller = createQualityController(profile_dir, pipeline);
+      quality_controller->start(std::chrono::seconds(2));
+    }
+
+    stages::PipelineReplay::Report report = replay.run(source);
+    if (quality_controller)
+    {
+      quality_controller->stop();
+      LOG_F(INFO, "Quality level at the end of the replay: %i", quality_controller->getLevel());
+    }
+
+    stages::PipelineReplay::printReport(report);
+    return report.is_drained ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  catch (std::exception &e)
+  {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,40 @@
+
+
+#include <realm_stages/mosaicing.h>
+#include <realm_stages/stage_settings.h>
+
+#include "benchmark_helper.h"
+
+// google benchmark
+#include <benchmark/benchmark.h>
+
+using namespace realm;
+
+static void BM_Mosaicing_Blend(benchmark::State &state)
+{
+  // Observed map of one frame (100m x 100m, 0.1m/cell) is blended in place into the global map of 400m x 400m. The
+  // argument is the number of threads: 1 runs serially, 0 uses all available cores.
+  auto settings = std::make_shared<MosaicingSettings>();
+  settings->set("log_to_file", 0);
+  settings->set("nrof_threads", static_cast<int>(state.range(0)));
+  stages::Mosaicing mosaicing(settings, 10.0);
+
+  double resolution = 0.1;
+  CvGridMap::Ptr global_map = createBenchmarkMap(cv::Rect2d(603776.0, 5791369.0, 400.0, 400.0), resolution, 45.0f);
+  CvGridMap::Ptr observed_map = createBenchmarkMap(cv::Rect2d(603926.0, 5791519.0, 100.0, 100.0), resolution, 60.0f);
+
+  for (auto _ : state)
+  {
+    // Reset the angles of the global map, so every iteration takes the observed data like the first one
+    state.PauseTiming();
+    CvGridMap::Overlap overlap = global_map->getOverlapView(*observed_map);
+    (*overlap.first)["elevation_angle"].setTo(45.0f);
+    state.ResumeTiming();
+
+    CvGridMap blended = mosaicing.blend(&overlap);
+    benchmark::DoNotOptimize(blended);
+  }
+
+  state.SetItemsProcessed(state.iterations() * observed_map->size().area());
+}
+BENCHMARK(BM_Mosaicing_Blend)->Arg(1)->Arg(0)->Unit(benchmark::kMillisecond);
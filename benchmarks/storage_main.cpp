@@ -0,0 +1,299 @@
+
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <realm_core/latency_histogram.h>
+#include <realm_core/loguru.h>
+#include <realm_io/gdal_continuous_writer.h>
+#include <realm_io/gis_export.h>
+#include <realm_io/utilities.h>
+#include <realm_ortho/tile_cache.h>
+
+#include "benchmark_helper.h"
+
+using namespace realm;
+
+// Storage throughput of the tile cache and the GeoTIFF export on a chosen directory, e.g. to qualify the media of an
+// onboard computer:
+//   realm_storage /mnt/ssd/bench --tiles 16 --cycles 10 --gtiff-size 8192
+// Tiles are written, flushed and reloaded in cycles. GeoTIFFs are exported in full with every profile and updated
+// incrementally in blocks. Throughput is computed from the uncompressed data, so compression shows as faster writes.
+
+namespace
+{
+
+// Tiles of the web mercator grid around the same position as the other benchmark scenes
+const int kZoomLevel = 18;
+const int kTileX = 140123;
+const int kTileY = 86571;
+const int kTileSize = 256;
+
+const double kEasting = 603976.0;
+const double kNorthing = 5791569.0;
+const uint8_t kZone = 32;
+
+struct Result
+{
+  std::string name;
+  double bytes{};      // Uncompressed data written or read
+  double items{};      // Tiles or files
+  double duration{};   // [s]
+  LatencyHistogram latency;
+};
+
+void printUsage()
+{
+  std::cerr << "Usage: realm_storage <output_dir> [options]\n"
+            << "  --tiles <n>          Tiles per side of the square written per cycle (default 16)\n"
+            << "  --cycles <n>         Write, flush and reload cycles of the tile cache (default 10)\n"
+            << "  --writers <n>        Writer threads of the tile cache, 0 uses all cores (default 2)\n"
+            << "  --mbtiles            Write the tiles into MBTiles instead of a directory tree\n"
+            << "  --spill <dir>        Spill flushed tiles uncompressed into this directory\n"
+            << "  --gtiff-size <n>     Edge length of the exported GeoTIFFs in pixels (default 8192)\n"
+            << "  --gtiff-block <n>    Edge length of the incremental GeoTIFF updates in pixels (default 1024)\n"
+            << "  --repeat <n>         Repetitions of every GeoTIFF export (default 3)\n"
+            << "  --overviews          Build internal overviews of the GeoTIFFs" << std::endl;
+}
+
+double getSeconds(const std::chrono::steady_clock::time_point &t_start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+}
+
+double computeByteSize(const CvGridMap &map)
+{
+  double bytes = 0.0;
+  for (const auto &layer_name : map.getAllLayerNames())
+  {
+    const cv::Mat &data = map[layer_name];
+    bytes += static_cast<double>(data.total() * data.elemSize());
+  }
+  return bytes;
+}
+
+std::vector<Tile::Ptr> createTiles(int nrof_tiles, int cycle)
+{
+  // Every cycle has different data, so nothing is deduplicated on the way to the device
+  cv::Mat color = createBenchmarkImage(cv::Size2i(kTileSize, kTileSize)) + cv::Scalar(cycle, cycle, cycle, 0);
+  cv::Mat elevation(kTileSize, kTileSize, CV_32F);
+  cv::randu(elevation, 100.0f, 110.0f);
+
+  std::vector<Tile::Ptr> tiles;
+  for (int x = 0; x < nrof_tiles; ++x)
+    for (int y = 0; y < nrof_tiles; ++y)
+    {
+      CvGridMap map(cv::Rect2d(0.0, 0.0, kTileSize - 1, kTileSize - 1), 1.0);
+      map.add("color_rgb", color.clone());
+      map.add("elevation", elevation.clone());
+      tiles.push_back(std::make_shared<Tile>(kZoomLevel, kTileX + x, kTileY + y, map));
+    }
+  return tiles;
+}
+
+void runTileCache(const std::string &directory, int nrof_tiles, int nrof_cycles, int nrof_writers, bool use_mbtiles,
+                  const std::string &dir_spill, std::vector<Result> &results)
+{
+  Result write{"tile write"};
+  Result reload{"tile reload"};
+
+  TileCache cache("storage", 100, directory, false, nrof_writers);
+  cache.setMbtilesStorage(use_mbtiles);
+  if (!dir_spill.empty())
+    cache.setSpillDirectory(dir_spill);
+
+  cv::Rect2i roi_idx(kTileX, kTileY, nrof_tiles, nrof_tiles);
+  for (int cycle = 0; cycle < nrof_cycles; ++cycle)
+  {
+    std::vector<Tile::Ptr> tiles = createTiles(nrof_tiles, cycle);
+    double bytes = 0.0;
+    for (const auto &tile : tiles)
+      bytes += computeByteSize(*tile->data());
+
+    // Written tiles are released, so the following reads have to load them from the device
+    cache.add(kZoomLevel, tiles, roi_idx);
+    auto t_write = std::chrono::steady_clock::now();
+    cache.flushAll();
+    double duration = getSeconds(t_write);
+    write.bytes += bytes;
+    write.items += tiles.size();
+    write.duration += duration;
+    write.latency.add(duration * 1e3 / tiles.size());
+
+    auto t_reload = std::chrono::steady_clock::now();
+    for (int x = 0; x < nrof_tiles; ++x)
+      for (int y = 0; y < nrof_tiles; ++y)
+      {
+        auto t_tile = std::chrono::steady_clock::now();
+        Tile::Ptr tile = cache.get(kTileX + x, kTileY + y, kZoomLevel);
+        if (tile == nullptr)
+          throw(std::runtime_error("Error reloading tile: Tile missing in the cache"));
+        tile->unlock();
+        reload.latency.add(getSeconds(t_tile) * 1e3);
+      }
+    reload.duration += getSeconds(t_reload);
+    reload.bytes += bytes;
+    reload.items += tiles.size();
+  }
+  results.push_back(write);
+  results.push_back(reload);
+}
+
+void runGeoTIFF(const std::string &directory, int size, int block_size, int nrof_repeats, bool do_build_overviews,
+                std::vector<Result> &results)
+{
+  const double resolution = 0.1;
+  cv::Rect2d roi(kEasting, kNorthing, (size - 1) * resolution, (size - 1) * resolution);
+  CvGridMap::Ptr map = createBenchmarkMap(roi, resolution, 90.0f);
+  CvGridMap map_color = map->getSubmap({"color_rgb"});
+  double bytes = computeByteSize(map_color);
+
+  const std::vector<std::pair<io::GDALProfile, std::string>> profiles{
+      {io::GDALProfile::COG, "gtiff full COG"},
+      {io::GDALProfile::COG_DEFLATE, "gtiff full COG_DEFLATE"},
+      {io::GDALProfile::COG_UNCOMPRESSED, "gtiff full COG_UNCOMPRESSED"}
+  };
+  for (const auto &profile : profiles)
+  {
+    Result full{profile.second};
+    for (int i = 0; i < nrof_repeats; ++i)
+    {
+      auto t_start = std::chrono::steady_clock::now();
+      io::saveGeoTIFF(map_color, kZone, directory + "/full.tif", do_build_overviews, false, profile.first);
+      double duration = getSeconds(t_start);
+      full.bytes += bytes;
+      full.items += 1;
+      full.duration += duration;
+      full.latency.add(duration * 1e3);
+    }
+    results.push_back(full);
+  }
+
+  // Blocks are written in place into the open file without the worker thread, so only the storage is measured
+  Result incremental{"gtiff incremental COG"};
+  for (int i = 0; i < nrof_repeats; ++i)
+  {
+    std::string filename = directory + "/incremental_" + std::to_string(i) + ".tif";
+    io::GDALContinuousWriter writer("storage", 100, false);
+    for (int r = 0; r + block_size <= size; r += block_size)
+      for (int c = 0; c + block_size <= size; c += block_size)
+      {
+        auto update = std::make_shared<CvGridMap>(map_color.getSubmap({"color_rgb"}, cv::Rect2i(c, r, block_size, block_size)));
+
+        auto t_start = std::chrono::steady_clock::now();
+        writer.requestUpdateGeoTIFF(update, kZone, filename, do_build_overviews);
+        writer.writePending();
+        double duration = getSeconds(t_start);
+        incremental.bytes += computeByteSize(*update);
+        incremental.items += 1;
+        incremental.duration += duration;
+        incremental.latency.add(duration * 1e3);
+      }
+    auto t_close = std::chrono::steady_clock::now();
+    writer.closeUpdateDatasets();
+    incremental.duration += getSeconds(t_close);
+  }
+  results.push_back(incremental);
+}
+
+void printResults(const std::vector<Result> &results)
+{
+  std::cout << "\n" << std::left << std::setw(30) << "benchmark"
+            << std::right << std::setw(12) << "MB/s" << std::setw(12) << "items/s"
+            << std::setw(12) << "p50 [ms]" << std::setw(12) << "p99 [ms]" << std::setw(12) << "max [ms]" << "\n";
+  std::cout << std::fixed << std::setprecision(2);
+  for (const auto &result : results)
+  {
+    LatencyPercentiles latency = result.latency.getPercentiles();
+    double duration = std::max(result.duration, 1e-9);
+    std::cout << std::left << std::setw(30) << result.name
+              << std::right << std::setw(12) << result.bytes / duration / 1e6
+              << std::setw(12) << result.items / duration
+              << std::setw(12) << latency.p50 << std::setw(12) << latency.p99 << std::setw(12) << latency.max << "\n";
+  }
+  std::cout << "Latencies of the tile write are per tile of a flush, all others per item" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  if (argc < 2)
+  {
+    printUsage();
+    return EXIT_FAILURE;
+  }
+
+  std::string output_dir = argv[1];
+  int nrof_tiles = 16;
+  int nrof_cycles = 10;
+  int nrof_writers = 2;
+  bool use_mbtiles = false;
+  std::string dir_spill;
+  int gtiff_size = 8192;
+  int gtiff_block = 1024;
+  int nrof_repeats = 3;
+  bool do_build_overviews = false;
+
+  try
+  {
+    for (int i = 2; i < argc; ++i)
+    {
+      std::string arg = argv[i];
+      bool has_value = (i + 1 < argc);
+      if (arg == "--tiles" && has_value)
+        nrof_tiles = std::stoi(argv[++i]);
+      else if (arg == "--cycles" && has_value)
+        nrof_cycles = std::stoi(argv[++i]);
+      else if (arg == "--writers" && has_value)
+        nrof_writers = std::stoi(argv[++i]);
+      else if (arg == "--mbtiles")
+        use_mbtiles = true;
+      else if (arg == "--spill" && has_value)
+        dir_spill = argv[++i];
+      else if (arg == "--gtiff-size" && has_value)
+        gtiff_size = std::stoi(argv[++i]);
+      else if (arg == "--gtiff-block" && has_value)
+        gtiff_block = std::stoi(argv[++i]);
+      else if (arg == "--repeat" && has_value)
+        nrof_repeats = std::stoi(argv[++i]);
+      else if (arg == "--overviews")
+        do_build_overviews = true;
+      else
+      {
+        printUsage();
+        return EXIT_FAILURE;
+      }
+    }
+    if (nrof_tiles <= 0 || nrof_cycles <= 0 || nrof_repeats <= 0)
+      throw(std::invalid_argument("Error parsing arguments: Number of tiles, cycles and repetitions must be positive"));
+    if (gtiff_block <= 1 || gtiff_block > gtiff_size)
+      throw(std::invalid_argument("Error parsing arguments: GeoTIFF block must be larger than 1 and fit into the GeoTIFF"));
+
+    std::string dir_tiles = output_dir + "/tiles";
+    std::string dir_gtiff = output_dir + "/gtiff";
+    for (const auto &directory : {output_dir, dir_tiles, dir_gtiff})
+      if (!io::dirExists(directory))
+        io::createDir(directory);
+
+    std::vector<Result> results;
+    LOG_F(INFO, "Writing and reloading %i x %i tiles in %i cycles...", nrof_tiles, nrof_tiles, nrof_cycles);
+    runTileCache(dir_tiles, nrof_tiles, nrof_cycles, nrof_writers, use_mbtiles, dir_spill, results);
+
+    LOG_F(INFO, "Exporting GeoTIFFs of %i x %i pixels...", gtiff_size, gtiff_size);
+    runGeoTIFF(dir_gtiff, gtiff_size, gtiff_block, nrof_repeats, do_build_overviews, results);
+
+    printResults(results);
+    return EXIT_SUCCESS;
+  }
+  catch (std::exception &e)
+  {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}
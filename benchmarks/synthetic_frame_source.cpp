@@ -0,0 +1,192 @@
+
+
+#include <cmath>
+#include <stdexcept>
+
+#include <opencv2/imgproc.hpp>
+
+#include <realm_core/depthmap.h>
+#include <realm_core/timer.h>
+
+#include "benchmark_helper.h"
+#include "synthetic_frame_source.h"
+
+using namespace realm;
+
+namespace
+{
+
+// Start of the lawnmower pattern, same position as the other benchmark scenes
+const double kEasting = 603976.0;
+const double kNorthing = 5791569.0;
+
+// Elevation of the ground, which varies smoothly by a few meters around it
+const double kGroundElevation = 100.0;
+
+double computeGroundElevation(double easting, double northing)
+{
+  double x = easting - kEasting;
+  double y = northing - kNorthing;
+  return kGroundElevation + 2.0*std::sin(0.05*x) + 2.0*std::cos(0.05*y);
+}
+
+// Camera x-axis points north, y-axis east and z-axis down
+cv::Mat createOrientation()
+{
+  cv::Mat orientation = cv::Mat::zeros(3, 3, CV_64F);
+  orientation.at<double>(0, 1) = 1.0;
+  orientation.at<double>(1, 0) = 1.0;
+  orientation.at<double>(2, 2) = -1.0;
+  return orientation;
+}
+
+} // namespace
+
+SyntheticFrameSource::SyntheticFrameSource(const SyntheticFrameSettings &settings, uint32_t nrof_frames)
+: m_settings(settings),
+  m_nrof_frames(nrof_frames),
+  m_frame_id(0),
+  m_timestamp_first(0),
+  m_focal_length(static_cast<double>(settings.image_size.width))
+{
+  if (m_settings.image_size.width <= 0 || m_settings.image_size.height <= 0)
+    throw(std::invalid_argument("Error creating synthetic frames: Image size must be positive."));
+  if (m_settings.altitude <= 0.0)
+    throw(std::invalid_argument("Error creating synthetic frames: Altitude must be positive."));
+  if (m_settings.overlap < 0.0 || m_settings.overlap >= 1.0)
+    throw(std::invalid_argument("Error creating synthetic frames: Overlap must be in [0, 1)."));
+  if (m_settings.rate <= 0.0)
+    throw(std::invalid_argument("Error creating synthetic frames: Rate must be positive."));
+
+  m_footprint_north = m_settings.altitude * m_settings.image_size.width / m_focal_length;
+  m_footprint_east = m_settings.altitude * m_settings.image_size.height / m_focal_length;
+  m_gsd = (m_settings.gsd > 0.0 ? m_settings.gsd : m_footprint_north / m_settings.image_size.width);
+
+  cv::Mat img_bgra = createBenchmarkImage(m_settings.image_size);
+  cv::cvtColor(img_bgra, m_img, cv::COLOR_BGRA2BGR);
+
+  CvGridMap footprint(cv::Rect2d(0.0, 0.0, m_footprint_east, m_footprint_north), m_gsd);
+  m_color = createBenchmarkImage(footprint.size());
+}
+
+Frame::Ptr SyntheticFrameSource::next()
+{
+  if (m_frame_id >= m_nrof_frames)
+    return nullptr;
+
+  uint32_t frame_id = m_frame_id++;
+  cv::Point2d position = computePosition(frame_id);
+  double altitude = kGroundElevation + m_settings.altitude;
+
+  auto cam = std::make_shared<camera::Pinhole>(m_focal_length, m_focal_length,
+                                               m_settings.image_size.width / 2.0, m_settings.image_size.height / 2.0,
+                                               static_cast<uint32_t>(m_settings.image_size.width),
+                                               static_cast<uint32_t>(m_settings.image_size.height));
+
+  // Timestamps in nanoseconds at the configured rate, so real-time pace adds the frames at it. They start with the
+  // first frame, so the age of the frames published by the stages is their latency.
+  if (frame_id == 0)
+    m_timestamp_first = static_cast<uint64_t>(Timer::getCurrentTimeNanoseconds());
+  auto timestamp = m_timestamp_first + static_cast<uint64_t>(static_cast<double>(frame_id) / m_settings.rate * 1e9);
+
+  auto frame = std::make_shared<Frame>("synthetic", frame_id, timestamp, m_img.clone(),
+                                       UTMPose(position.x, position.y, altitude, 0.0, 32, 'U'), cam, createOrientation());
+
+  // Poses are exact, like those of a replayed trajectory
+  frame->setVisualPose(frame->getDefaultPose());
+  frame->initGeoreference(cv::Mat::eye(4, 4, CV_64F));
+  frame->setKeyframe(true);
+
+  if (m_settings.with_depthmap)
+    frame->setDepthmap(createDepthmap(*cam));
+
+  if (m_settings.level == SyntheticFrameLevel::RAW)
+    return frame;
+
+  cv::Rect2d roi(position.x - m_footprint_east / 2.0, position.y - m_footprint_north / 2.0, m_footprint_east, m_footprint_north);
+  frame->setSurfaceAssumption(SurfaceAssumption::ELEVATION);
+  frame->setSurfaceModel(createSurfaceModel(roi));
+
+  if (m_settings.level == SyntheticFrameLevel::ORTHO)
+  {
+    // Snapping the roi to the resolution may change the size of the grid by a cell
+    auto orthophoto = std::make_shared<CvGridMap>(roi, m_gsd);
+    cv::Mat color;
+    if (m_color.size() == orthophoto->size())
+      color = m_color.clone();
+    else
+      cv::resize(m_color, color, orthophoto->size(), 0, 0, cv::INTER_NEAREST);
+    orthophoto->add("color_rgb", color);
+    frame->setOrthophoto(orthophoto);
+  }
+  return frame;
+}
+
+double SyntheticFrameSource::getGSD() const
+{
+  return m_gsd;
+}
+
+cv::Point2d SyntheticFrameSource::computePosition(uint32_t frame_id) const
+{
+  double step_east = (1.0 - m_settings.overlap) * m_footprint_east;
+  double step_north = (1.0 - m_settings.overlap) * m_footprint_north;
+  if (m_settings.frames_per_line <= 0)
+    return cv::Point2d(kEasting + frame_id * step_east, kNorthing);
+
+  // Every other line is flown back, so the last frame of a line overlaps with the first of the next one across track
+  auto frames_per_line = static_cast<uint32_t>(m_settings.frames_per_line);
+  uint32_t line = frame_id / frames_per_line;
+  uint32_t idx = frame_id % frames_per_line;
+  if (line % 2 == 1)
+    idx = frames_per_line - 1 - idx;
+  return cv::Point2d(kEasting + idx * step_east, kNorthing + line * step_north);
+}
+
+CvGridMap::Ptr SyntheticFrameSource::createSurfaceModel(const cv::Rect2d &roi) const
+{
+  auto surface_model = std::make_shared<CvGridMap>(roi, m_gsd);
+  cv::Rect2d roi_fitted = surface_model->roi();
+  cv::Size2i size = surface_model->size();
+
+  cv::Mat elevation(size, CV_32F);
+  for (int r = 0; r < size.height; ++r)
+  {
+    auto elevation_row = elevation.ptr<float>(r);
+    double northing = roi_fitted.y + roi_fitted.height - r * m_gsd;
+    for (int c = 0; c < size.width; ++c)
+      elevation_row[c] = static_cast<float>(computeGroundElevation(roi_fitted.x + c * m_gsd, northing));
+  }
+  surface_model->add("elevation", elevation);
+
+  // Layers of the rectification, which the mosaicing blends by
+  if (m_settings.level == SyntheticFrameLevel::ORTHO)
+  {
+    surface_model->add("elevation_angle", cv::Mat(size, CV_32F, cv::Scalar(80.0f)));
+    surface_model->add("elevated", cv::Mat(size, CV_8UC1, cv::Scalar(255)));
+    surface_model->add("num_observations", cv::Mat(size, CV_16UC1, cv::Scalar(1)));
+  }
+  return surface_model;
+}
+
+Depthmap::Ptr SyntheticFrameSource::createDepthmap(const camera::Pinhole &cam) const
+{
+  cv::Mat pose = cam.pose();
+  double t[3]{pose.at<double>(0, 3), pose.at<double>(1, 3), pose.at<double>(2, 3)};
+
+  // Rays are intersected with the mean ground elevation, the depth is then corrected by the elevation at that point
+  cv::Mat depth(m_settings.image_size, CV_32F);
+  for (int r = 0; r < depth.rows; ++r)
+  {
+    auto depth_row = depth.ptr<float>(r);
+    double y_n = (r - cam.cy()) / cam.fy();
+    for (int c = 0; c < depth.cols; ++c)
+    {
+      double x_n = (c - cam.cx()) / cam.fx();
+      double easting = t[0] + m_settings.altitude * y_n;
+      double northing = t[1] + m_settings.altitude * x_n;
+      depth_row[c] = static_cast<float>(t[2] - computeGroundElevation(easting, northing));
+    }
+  }
+  return std::make_shared<Depthmap>(depth, cam);
+}
@@ -0,0 +1,114 @@
+#ifndef OPENREALM_SYNTHETIC_FRAME_SOURCE_H
+#define OPENREALM_SYNTHETIC_FRAME_SOURCE_H
+
+#include <cstdint>
+
+#include <opencv2/core.hpp>
+
+#include <realm_core/camera.h>
+#include <realm_core/cv_grid_map.h>
+#include <realm_core/frame.h>
+
+namespace realm
+{
+
+/*!
+ * @brief Processing level up to which synthetic frames are filled, so they can be added to the stage consuming it
+ */
+enum class SyntheticFrameLevel
+{
+  RAW,      // Image and pose, optionally a depth map, e.g. for the surface generation
+  SURFACE,  // Additionally the surface model with elevation, e.g. for the ortho rectification
+  ORTHO     // Additionally the orthophoto and the observed layers of the surface model, e.g. for mosaicing and tileing
+};
+
+/*!
+ * @brief Settings of the synthetic frames, defaults resemble a small mapping drone
+ */
+struct SyntheticFrameSettings
+{
+  cv::Size2i image_size{1200, 800};                // Size of the images in pixels
+  double altitude{100.0};                          // [m] Altitude of the camera above ground
+  double overlap{0.7};                             // Overlap of neighbouring footprints along and across the track
+  int frames_per_line{20};                         // Frames until the next line of the lawnmower pattern, 0 for one line
+  double rate{1.0};                                // [Hz] Rate of the frame timestamps
+  double gsd{0.0};                                 // [m/cell] Resolution of the maps, 0 for the footprint of a pixel
+  SyntheticFrameLevel level{SyntheticFrameLevel::ORTHO};
+  bool with_depthmap{false};                       // Flag to add a depth map, so the elevation surface is computed
+};
+
+/*!
+ * @brief Source of synthetic frames for stress tests of the stages. The camera looks straight down and flies a
+ * lawnmower pattern above a smoothly varying surface on a real UTM coordinate, so consecutive footprints overlap as
+ * configured. Frames are timestamped at the configured rate, so a stages::PipelineReplay with real-time pace adds them
+ * at that rate and the saturation of a stage can be found by increasing it. All frames have the same size and layers,
+ * so the time to generate them is constant and small compared to the processing.
+ */
+class SyntheticFrameSource
+{
+  public:
+    /*!
+     * @brief Constructor prepares the data shared by all frames
+     * @param settings Settings of the frames
+     * @param nrof_frames Number of frames, after which the source is finished
+     */
+    SyntheticFrameSource(const SyntheticFrameSettings &settings, uint32_t nrof_frames);
+
+    /*!
+     * @brief Creates the next frame
+     * @return Next frame, nullptr if all frames were created
+     */
+    Frame::Ptr next();
+
+    /*!
+     * @brief Getter for the resolution of the maps of the frames
+     * @return Resolution in [m/cell]
+     */
+    double getGSD() const;
+
+  private:
+
+    SyntheticFrameSettings m_settings;
+
+    uint32_t m_nrof_frames;
+    uint32_t m_frame_id;
+
+    //! [ns] Time the first frame was created at
+    uint64_t m_timestamp_first;
+
+    double m_focal_length;
+    double m_gsd;
+
+    //! Extent of a footprint on the ground in [m], the image width spans north and its height east
+    double m_footprint_east;
+    double m_footprint_north;
+
+    //! Data shared by all frames, cloned for every frame
+    cv::Mat m_img;
+    cv::Mat m_color;
+
+    /*!
+     * @brief Computes the position of the camera above ground of a frame in the lawnmower pattern
+     * @param frame_id Id of the frame
+     * @return Easting and northing in UTM
+     */
+    cv::Point2d computePosition(uint32_t frame_id) const;
+
+    /*!
+     * @brief Creates the surface model of the footprint of a frame with the layers up to the configured level
+     * @param roi Footprint of the frame
+     * @return Surface model
+     */
+    CvGridMap::Ptr createSurfaceModel(const cv::Rect2d &roi) const;
+
+    /*!
+     * @brief Creates the depth map of a frame from the surface below it
+     * @param cam Camera of the frame with pose
+     * @return Depth map
+     */
+    Depthmap::Ptr createDepthmap(const camera::Pinhole &cam) const;
+};
+
+} // namespace realm
+
+#endif //OPENREALM_SYNTHETIC_FRAME_SOURCE_H
@@ -0,0 +1,74 @@
+# Profile-guided optimisation of the hot libraries. A release is built in two passes into the same build directory,
+# because GCC finds the profiles by the paths of the object files:
+#   1) PGO_MODE=GENERATE: instrumented build, the target pgo_train runs the training and writes to PGO_PROFILE_DIR
+#   2) PGO_MODE=USE:      rebuild optimised with the collected profiles and link time optimisation
+# tools/build_pgo.sh runs both passes.
+
+include(CheckCXXCompilerFlag)
+include(CheckIPOSupported)
+
+if(NOT PGO_MODE MATCHES "^(GENERATE|USE)$")
+    message(FATAL_ERROR "Unknown PGO_MODE '${PGO_MODE}', use OFF, GENERATE or USE.")
+endif()
+
+if(CMAKE_CXX_COMPILER_ID STREQUAL "GNU")
+    set(PGO_IS_CLANG OFF)
+elseif(CMAKE_CXX_COMPILER_ID MATCHES "Clang")
+    set(PGO_IS_CLANG ON)
+else()
+    message(FATAL_ERROR "Profile-guided optimisation requires GCC or Clang, found ${CMAKE_CXX_COMPILER_ID}.")
+endif()
+
+# Clang writes raw profiles, which are merged into this file by the training
+set(PGO_PROFILE_DATA "${PGO_PROFILE_DIR}/realm.profdata")
+
+set(PGO_COMPILE_FLAGS "")
+set(PGO_LINK_FLAGS "")
+
+if(PGO_MODE STREQUAL "GENERATE")
+    file(MAKE_DIRECTORY ${PGO_PROFILE_DIR})
+    list(APPEND PGO_COMPILE_FLAGS "-fprofile-generate=${PGO_PROFILE_DIR}")
+    list(APPEND PGO_LINK_FLAGS "-fprofile-generate=${PGO_PROFILE_DIR}")
+
+    # Stages and their thread pools update the counters concurrently
+    check_cxx_compiler_flag(-fprofile-update=atomic HAS_PROFILE_UPDATE_ATOMIC)
+    if(HAS_PROFILE_UPDATE_ATOMIC)
+        list(APPEND PGO_COMPILE_FLAGS "-fprofile-update=atomic")
+    endif()
+else()
+    if(PGO_IS_CLANG)
+        if(NOT EXISTS ${PGO_PROFILE_DATA})
+            message(FATAL_ERROR "PGO profile ${PGO_PROFILE_DATA} not found, build and run pgo_train with PGO_MODE=GENERATE first.")
+        endif()
+        list(APPEND PGO_COMPILE_FLAGS "-fprofile-use=${PGO_PROFILE_DATA}" "-Wno-profile-instr-unprofiled")
+    else()
+        if(NOT EXISTS ${PGO_PROFILE_DIR})
+            message(FATAL_ERROR "PGO profiles in ${PGO_PROFILE_DIR} not found, build and run pgo_train with PGO_MODE=GENERATE first.")
+        endif()
+
+        # Code not reached by the training is optimised as usual instead of for size
+        list(APPEND PGO_COMPILE_FLAGS "-fprofile-use=${PGO_PROFILE_DIR}" "-fprofile-correction" "-Wno-missing-profile")
+        check_cxx_compiler_flag(-fprofile-partial-training HAS_PROFILE_PARTIAL_TRAINING)
+        if(HAS_PROFILE_PARTIAL_TRAINING)
+            list(APPEND PGO_COMPILE_FLAGS "-fprofile-partial-training")
+        endif()
+    endif()
+
+    check_ipo_supported(RESULT PGO_WITH_LTO OUTPUT PGO_LTO_ERROR LANGUAGES CXX)
+    if(NOT PGO_WITH_LTO)
+        message(WARNING "Link time optimisation not supported, PGO build without it: ${PGO_LTO_ERROR}")
+    endif()
+endif()
+
+message(STATUS "Profile-guided optimisation: ${PGO_MODE}, profiles in ${PGO_PROFILE_DIR}")
+
+# Adds the flags of the current pass to a library. Instrumentation is linked public, so executables using the library
+# get the profiling runtime.
+function(realm_enable_pgo _target)
+    target_compile_options(${_target} PRIVATE ${PGO_COMPILE_FLAGS})
+    if(PGO_MODE STREQUAL "GENERATE")
+        target_link_options(${_target} PUBLIC ${PGO_LINK_FLAGS})
+    elseif(PGO_WITH_LTO)
+        set_property(TARGET ${_target} PROPERTY INTERPROCEDURAL_OPTIMIZATION TRUE)
+    endif()
+endfunction()
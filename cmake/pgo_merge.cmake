@@ -0,0 +1,15 @@
+# Merges the raw profiles written by an instrumented Clang build, run in script mode by the target pgo_train:
+#   cmake -DLLVM_PROFDATA=<exe> -DPGO_PROFILE_DIR=<dir> -DPGO_PROFILE_DATA=<file> -P pgo_merge.cmake
+
+file(GLOB PGO_RAW_PROFILES "${PGO_PROFILE_DIR}/*.profraw")
+if(NOT PGO_RAW_PROFILES)
+    message(FATAL_ERROR "No raw profiles in ${PGO_PROFILE_DIR}, did the training run?")
+endif()
+
+execute_process(
+    COMMAND ${LLVM_PROFDATA} merge -output=${PGO_PROFILE_DATA} ${PGO_RAW_PROFILES}
+    RESULT_VARIABLE PGO_MERGE_RESULT
+    )
+if(NOT PGO_MERGE_RESULT EQUAL 0)
+    message(FATAL_ERROR "Merging the raw profiles failed: ${PGO_MERGE_RESULT}")
+endif()
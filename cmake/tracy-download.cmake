@@ -0,0 +1,20 @@
+# adapted after googletest-download.cmake
+cmake_minimum_required(VERSION 3.5 FATAL_ERROR)
+
+project(tracy-download NONE)
+
+include(ExternalProject)
+
+ExternalProject_Add(
+  tracy
+  SOURCE_DIR "@TRACY_DOWNLOAD_ROOT@/tracy-src"
+  BINARY_DIR "@TRACY_DOWNLOAD_ROOT@/tracy-build"
+  GIT_REPOSITORY
+    https://github.com/wolfpld/tracy.git
+  GIT_TAG
+    v0.9.1
+  CONFIGURE_COMMAND ""
+  BUILD_COMMAND ""
+  INSTALL_COMMAND ""
+  TEST_COMMAND ""
+  )
@@ -0,0 +1,36 @@
+# the following code to fetch the tracy client
+# follows the one of googletest, see googletest.cmake
+# download and unpack tracy at configure time
+
+macro(fetch_tracy _download_module_path _download_root)
+    set(TRACY_DOWNLOAD_ROOT ${_download_root})
+    configure_file(
+        ${_download_module_path}/tracy-download.cmake
+        ${_download_root}/CMakeLists.txt
+        @ONLY
+        )
+    unset(TRACY_DOWNLOAD_ROOT)
+
+    execute_process(
+        COMMAND
+            "${CMAKE_COMMAND}" -G "${CMAKE_GENERATOR}" .
+        WORKING_DIRECTORY
+            ${_download_root}
+        )
+    execute_process(
+        COMMAND
+            "${CMAKE_COMMAND}" --build .
+        WORKING_DIRECTORY
+            ${_download_root}
+        )
+
+    # release builds in the field are only profiled while the profiler is connected
+    set(TRACY_ENABLE ON CACHE BOOL "" FORCE)
+    set(TRACY_ON_DEMAND ON CACHE BOOL "" FORCE)
+
+    # adds the target: TracyClient
+    add_subdirectory(
+        ${_download_root}/tracy-src
+        ${_download_root}/tracy-build
+        )
+endmacro()
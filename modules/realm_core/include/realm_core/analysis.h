@@ -20,6 +20,18 @@ namespace analysis
  */
 cv::Mat convertToColorMapFromCVC1(const cv::Mat &img, const cv::Mat &mask, cv::ColormapTypes flag);
 
+/*!
+ * @brief Converts a single channel mat to a RGB color map with a fixed value range instead of normalizing it, so
+ * regions of a larger map can be colored separately and still match. Values outside of the range are clamped.
+ * @param img CV_32FC1, CV_64FC1 or CV_16UC1 mat
+ * @param mask Mask of valid pixels, invalid ones are black. Can be empty
+ * @param range_min Value mapped to the lowest color
+ * @param range_max Value mapped to the highest color
+ * @param flag Color layout
+ * @return Colormap of input mat
+ */
+cv::Mat convertToColorMapFromCVC1(const cv::Mat &img, const cv::Mat &mask, double range_min, double range_max, cv::ColormapTypes flag);
+
 /*!
  * @brief Converts a three channel floating point mat to a RGB color map
  * @param img CV_32FC3 or CV_64FC3 floating point mat
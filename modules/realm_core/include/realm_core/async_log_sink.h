@@ -0,0 +1,116 @@
+
+
+#ifndef PROJECT_ASYNC_LOG_SINK_H
+#define PROJECT_ASYNC_LOG_SINK_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <realm_core/loguru.h>
+#include <realm_core/spsc_ring_buffer.h>
+
+namespace realm
+{
+
+/*!
+ * @brief Log file written by a background thread instead of the logging thread. Loguru calls its sinks synchronously
+ * while holding its global lock, so a slow file system, e.g. an SD card, stalls every thread that logs. This sink only
+ * formats the message and pushes it into a bounded lock-free queue, the background thread writes it to the file.
+ * Loguru serializes all calls of a sink, so the queue has exactly one producer at a time. If the writer can not keep
+ * up, the oldest messages are dropped and the number of dropped messages is written to the file instead.
+ */
+class AsyncLogSink
+{
+  public:
+    using Ptr = std::shared_ptr<AsyncLogSink>;
+    using ConstPtr = std::shared_ptr<const AsyncLogSink>;
+
+  public:
+    /*!
+     * @brief Constructor opens the file and registers the sink at loguru
+     * @param filepath Absolute path of the log file, messages are appended if it exists
+     * @param verbosity Maximum verbosity of messages written to the file
+     * @param capacity Maximum number of messages waiting to be written
+     */
+    AsyncLogSink(const std::string &filepath, loguru::Verbosity verbosity, size_t capacity = 4096);
+
+    /*!
+     * @brief Destructor removes the sink from loguru and writes all remaining messages
+     */
+    ~AsyncLogSink();
+
+    AsyncLogSink(const AsyncLogSink &) = delete;
+    AsyncLogSink& operator=(const AsyncLogSink &) = delete;
+
+    /*!
+     * @brief Blocks until all messages logged before were either written or dropped and flushes the file
+     */
+    void flush();
+
+    /*!
+     * @brief Getter for the number of messages written to the file
+     * @return Number of written messages
+     */
+    uint64_t getNrofWritten() const;
+
+    /*!
+     * @brief Getter for the number of messages dropped, because the queue was full
+     * @return Number of dropped messages
+     */
+    uint64_t getNrofDropped() const;
+
+  private:
+
+    //! Path of the file, also used as id of the sink at loguru
+    std::string m_filepath;
+
+    FILE* m_file;
+
+    //! Formatted messages waiting to be written
+    SpscRingBuffer<std::string> m_queue;
+
+    std::atomic<uint64_t> m_nrof_pushed;
+    std::atomic<uint64_t> m_nrof_written;
+    std::atomic<uint64_t> m_nrof_dropped;
+
+    //! Number of dropped messages already reported in the file, only accessed by the writer
+    uint64_t m_nrof_dropped_reported;
+
+    std::atomic<bool> m_is_finish_requested;
+
+    //! Wakes the writer, notified without holding the mutex to keep the logging threads from blocking
+    std::mutex m_mutex_wakeup;
+    std::condition_variable m_condition_wakeup;
+
+    std::thread m_thread;
+
+    /*!
+     * @brief Writes the queued messages until finish was requested and the queue is empty. Runs in its own thread.
+     */
+    void run();
+
+    /*!
+     * @brief Writes all queued messages to the file
+     * @return True if at least one message was written
+     */
+    bool writeQueued();
+
+    /*!
+     * @brief Callback of loguru for every message, formats the message and pushes it into the queue
+     */
+    static void logCallback(void* user_data, const loguru::Message &message);
+
+    /*!
+     * @brief Callback of loguru for flushing, wakes the writer
+     */
+    static void flushCallback(void* user_data);
+};
+
+} // namespace realm
+
+#endif //PROJECT_ASYNC_LOG_SINK_H
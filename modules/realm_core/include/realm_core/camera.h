@@ -3,10 +3,15 @@
 #ifndef PROJECT_CAMERA_H
 #define PROJECT_CAMERA_H
 
+#include <array>
+#include <cstddef>
 #include <memory>
 #include <iostream>
 
 #include <opencv2/core/mat.hpp>
+#include <opencv2/core/matx.hpp>
+
+#include <realm_core/mat_pool.h>
 
 namespace realm
 {
@@ -245,9 +250,10 @@ class Pinhole
     /*!
      * @brief Function to undistort an image with this camera model
      * @param img Image to be undistorted
+     * @param mat_pool Optional pool the undistorted image is allocated from, default allocator if nullptr
      * @return Undistorted image
      */
-    cv::Mat undistort(const cv::Mat &img, int interpolation) const;
+    cv::Mat undistort(const cv::Mat &img, int interpolation, MatPool* mat_pool = nullptr) const;
 
     /*!
      * @brief Function for computation of the distorted image boundaries, therefore
@@ -293,7 +299,54 @@ class Pinhole
      */
     cv::Mat projectPointToWorld(double x, double y, double depth) const;
 
+    /*!
+     * @brief Allocation-free variant of computeImageBounds2D. Undistorted bounds are computed once with the intrinsics.
+     * @param bounds Output; Image boundaries in the order of computeImageBounds2D
+     */
+    void computeImageBounds2D(std::array<cv::Vec2d, 4> &bounds) const;
+
+    /*!
+     * @brief Allocation-free variant of projectImageBoundsToPlane, e.g. for footprints computed every frame. Computed in
+     *        double precision, so float results of UTM coordinates lose precision only in the output.
+     * @param pt One point of the plane
+     * @param n A normal vector of the plane
+     * @param points Output; Image boundaries intersected with the plane in the order of computeImageBounds2D
+     */
+    template <typename T>
+    void projectImageBoundsToPlane(const cv::Vec<T, 3> &pt, const cv::Vec<T, 3> &n, std::array<cv::Vec<T, 3>, 4> &points) const;
+
+    /*!
+     * @brief Batched, allocation-free variant of projectPointToWorld for contiguous arrays of pixels, e.g. the rows of a
+     *        depth map. The pose is read once for all points.
+     * @param pixels Pixels structured as (x, y) for every point, 2*n values
+     * @param depths Depth of every pixel, n values
+     * @param n Number of points
+     * @param points Output; World points structured as (x, y, z) for every pixel, 3*n values. NaN for depths <= 0
+     */
+    template <typename T>
+    void projectPointsToWorld(const T* pixels, const T* depths, size_t n, T* points) const;
+
   protected:
+    /*!
+     * @brief Fixed point undistortion maps (CV_16SC2 and CV_16UC1) of one set of intrinsics. They are immutable once
+     *        computed, so all cameras with the same intrinsics, e.g. all frames of one camera, share a single instance.
+     */
+    struct UndistortionMaps
+    {
+      cv::Mat map1;
+      cv::Mat map2;
+    };
+
+    /*!
+     * @brief Returns the undistortion maps for the given intrinsics. They are computed only if no other camera with the
+     *        same intrinsics holds them at the moment.
+     * @param K Calibration matrix
+     * @param dist_coeffs Lens distortion coefficients (k1, k2, p1, p2, k3)
+     * @param size Image size
+     * @return Shared, immutable undistortion maps
+     */
+    static std::shared_ptr<const UndistortionMaps> getUndistortionMaps(const cv::Mat &K, const cv::Mat &dist_coeffs, const cv::Size &size);
+
     // With distortion map
     bool m_do_undistort;
 
@@ -302,8 +355,7 @@ class Pinhole
 
     // Distortion parameters
     cv::Mat m_dist_coeffs;
-    cv::Mat m_undistortion_map1;
-    cv::Mat m_undistortion_map2;
+    std::shared_ptr<const UndistortionMaps> m_undistortion_maps;
 
     // Exterior parameters
     cv::Mat m_t; // t
@@ -312,6 +364,14 @@ class Pinhole
     // Image parameters
     uint32_t m_width;
     uint32_t m_height;
+
+    // Undistorted image boundaries, see computeImageBounds2D
+    std::array<cv::Vec2d, 4> m_img_bounds;
+
+    /*!
+     * @brief Computes the undistorted image boundaries, must be called whenever the intrinsics change
+     */
+    void updateImageBounds();
 };
 
 } // namespace camera
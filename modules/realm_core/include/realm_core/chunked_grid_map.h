@@ -0,0 +1,278 @@
+
+
+#ifndef OPENREALM_CHUNKED_GRID_MAP_H
+#define OPENREALM_CHUNKED_GRID_MAP_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+#include <memory>
+#include <string>
+
+#include <opencv2/core.hpp>
+
+#include <realm_core/cv_grid_map.h>
+
+namespace realm
+{
+
+/*!
+ * @brief Grid map for large, incrementally growing areas. In contrast to the CvGridMap, the data is not stored in one
+ * monolithic matrix per layer, but in square chunks of fixed size, which are allocated on demand. All chunks are
+ * aligned to one global grid with its origin in the world frame origin, so adding new data never reallocates or copies
+ * existing chunks. Adding a submap therefore only costs proportional to the submap's footprint.
+ * Data is put in and taken out of the chunked map in form of CvGridMaps.
+ * The map is thread-safe. Data is locked per chunk, so regions can be extracted, e.g. for publishing or saving, while
+ * new data is added to other regions. Every add increments the revision of the map and marks the chunks it touched, so
+ * regions changed since an earlier revision can be copied instead of the whole map.
+ */
+class ChunkedGridMap
+{
+  public:
+    using Ptr = std::shared_ptr<ChunkedGridMap>;
+    using ConstPtr = std::shared_ptr<const ChunkedGridMap>;
+
+  public:
+    /*!
+     * @brief Constructor of an empty chunked grid map.
+     * @param resolution Resolution as [m/cell] of all data added to the map
+     * @param chunk_size Number of cells of the chunks in both dimensions
+     */
+    explicit ChunkedGridMap(double resolution, int chunk_size = 256);
+
+    /*!
+     * @brief Destructor removes all chunks that were spilled to disk
+     */
+    ~ChunkedGridMap();
+
+    ChunkedGridMap(const ChunkedGridMap &other) = delete;
+    ChunkedGridMap& operator=(const ChunkedGridMap &other) = delete;
+
+    /*!
+     * @brief Adds a submap to the chunked map. Chunks that are touched by the submap are allocated if not existing yet.
+     * Layers not existing yet are created.
+     * @param submap Grid map to be added, resolution must match
+     * @param flag_overlap_handle Merge flag, e.g. REALM_OVERWRITE_ALL or REALM_OVERWRITE_ZERO
+     */
+    void add(const CvGridMap &submap, int flag_overlap_handle);
+
+    /*!
+     * @brief Extracts a region of interest from the chunked map as deep copy. Regions without chunks are filled with
+     * NaN for floating point layers and zero for all other layers. Spilled chunks are read from disk, but stay spilled.
+     * @param layer_names Names of the layers of the submap
+     * @param roi Region of interest in the world frame
+     * @return CvGridMap of the region of interest with desired layers
+     */
+    CvGridMap getSubmap(const std::vector<std::string> &layer_names, const cv::Rect2d &roi) const;
+
+    /*!
+     * @brief Assembles the whole chunked map to one CvGridMap. Beware: This is proportional to the covered area.
+     * @param layer_names Names of the layers to be assembled
+     * @return CvGridMap of the bounding box of all added data
+     */
+    CvGridMap getGridMap(const std::vector<std::string> &layer_names) const;
+
+    /*!
+     * @brief Assembles the whole chunked map with all layers to one CvGridMap.
+     * @return CvGridMap of the bounding box of all added data
+     */
+    CvGridMap getGridMap() const;
+
+    /*!
+     * @brief Checks if a layer with given name was added to the map
+     * @param layer_name Name of the layer
+     * @return true if existing
+     */
+    bool exists(const std::string &layer_name) const;
+
+    /*!
+     * @brief Checks if any data was added to the map
+     * @return true if no submap was added so far
+     */
+    bool empty() const;
+
+    /*!
+     * @brief Getter for the names of all layers
+     * @return Vector of layer names
+     */
+    std::vector<std::string> getAllLayerNames() const;
+
+    /*!
+     * @brief Getter for the region of interest of all data added so far
+     * @return Bounding box of all submaps added in the world frame
+     */
+    cv::Rect2d roi() const;
+
+    /*!
+     * @brief Getter for the resolution
+     * @return Resolution of the grid
+     */
+    double resolution() const;
+
+    /*!
+     * @brief Getter for the size of the chunks
+     * @return Number of cells of a chunk in each dimension
+     */
+    int getChunkSize() const;
+
+    /*!
+     * @brief Getter for the number of allocated chunks
+     * @return Number of chunks
+     */
+    size_t getNumberOfChunks() const;
+
+    /*!
+     * @brief Computes the memory held by all allocated chunks, spilled chunks are not counted
+     * @return Size of the chunk data in bytes
+     */
+    size_t getByteSize() const;
+
+    /*!
+     * @brief Sets the directory for chunks spilled to disk, see spill(...). Can not be changed once chunks were spilled.
+     * @param directory Absolute path to an existing directory
+     */
+    void setSpillDirectory(const std::string &directory);
+
+    /*!
+     * @brief Writes all chunks outside a region of interest to the spill directory and releases their memory. Spilled
+     * chunks are transparently loaded again, once new data is added to them. This bounds the memory of long missions,
+     * in which only the region around the current position is updated.
+     * @param roi_keep Region in the world frame, which chunks are kept in memory
+     * @return Number of bytes released
+     * @throws std::runtime_error if no spill directory is set or writing fails
+     */
+    size_t spill(const cv::Rect2d &roi_keep);
+
+    /*!
+     * @brief Getter for the number of chunks currently spilled to disk
+     * @return Number of spilled chunks
+     */
+    size_t getNumberOfSpilledChunks() const;
+
+    /*!
+     * @brief Getter for the revision of the map, which is incremented by every add
+     * @return Revision of the last add, 0 if no data was added
+     */
+    uint64_t getRevision() const;
+
+    /*!
+     * @brief Computes the regions of all chunks, that were changed after a given revision. Spilled chunks are included.
+     * @param revision Revision of the map, e.g. of the last time it was copied
+     * @return Regions of the changed chunks in the world frame, clipped to the roi of the map
+     */
+    std::vector<cv::Rect2d> getChangedRegions(uint64_t revision) const;
+
+  private:
+
+    //! Description of a layer, data is contained in chunks
+    struct LayerInfo
+    {
+      std::string name;
+      int type;
+      int interpolation;
+    };
+
+    //! Chunk with one matrix per layer and the revision of its last change
+    struct Chunk
+    {
+      std::vector<cv::Mat> layers;
+      uint64_t revision = 0;
+
+      //! Locks the data of the layers, the layer container itself is only changed under the exclusive map lock
+      mutable std::mutex mutex;
+    };
+
+    //! Index of a chunk as (col, row) in the global chunk grid
+    using ChunkIdx = std::pair<int, int>;
+
+    //! Resolution as [m/cell]
+    double m_resolution;
+
+    //! Number of cells of the chunks in each dimension
+    int m_chunk_size;
+
+    //! Bounding box of all data added in global cell indices
+    cv::Rect2i m_bounds;
+
+    //! Description of all layers, order is equal to the data inside the chunks
+    std::vector<LayerInfo> m_layers;
+
+    //! All allocated chunks with one matrix per layer. Matrices are allocated for each layer on first write
+    std::map<ChunkIdx, Chunk> m_chunks;
+
+    //! Directory for chunks spilled to disk, empty if spilling is not configured
+    std::string m_spill_directory;
+
+    //! All chunks that were written to the spill directory and are not in memory, with the revision of their last change
+    std::map<ChunkIdx, uint64_t> m_chunks_spilled;
+
+    //! Revision of the last add
+    uint64_t m_revision;
+
+    //! Guards layers, bounds and the chunk containers. Readers and the writing of chunk data share it, creating layers
+    //! and chunks or spilling requires it exclusively
+    mutable std::shared_timed_mutex m_mutex_chunks;
+
+    //! Serializes all modifications, so chunks are not removed by a spill while data is written to them
+    std::mutex m_mutex_write;
+
+    /*!
+     * @brief Computes the range of chunk indices touched by a region of global cell indices
+     * @param bounds Region of global cell indices
+     * @return Rectangle of chunk indices as (col, row)
+     */
+    cv::Rect2i computeChunkRange(const cv::Rect2i &bounds) const;
+
+    /*!
+     * @brief Creates the file name of a spilled chunk
+     */
+    std::string createSpillFilename(const ChunkIdx &idx) const;
+
+    /*!
+     * @brief Writes the layers of a chunk to the spill directory in a raw binary format
+     */
+    void writeChunk(const ChunkIdx &idx, const std::vector<cv::Mat> &chunk) const;
+
+    /*!
+     * @brief Reads the layers of a spilled chunk from the spill directory
+     */
+    std::vector<cv::Mat> readChunk(const ChunkIdx &idx) const;
+
+    /*!
+     * @brief Converts global cell indices to a region in the world frame, inverse of computeGlobalIndices(...)
+     * @param bounds Region of global cell indices
+     * @return Region of interest in the world frame
+     */
+    cv::Rect2d computeWorldRoi(const cv::Rect2i &bounds) const;
+
+    /*!
+     * @brief Computes the global cell indices of a grid map. Column indices increase to the east, row indices increase
+     * to the south, so the data can be copied to the chunks without flipping.
+     * @param map Grid map with roi and resolution
+     * @return Rectangle of global cell indices
+     */
+    cv::Rect2i computeGlobalIndices(const CvGridMap &map) const;
+
+    /*!
+     * @brief Finds the index of a layer in the layer container
+     * @param layer_name Name of the layer
+     * @return Index in m_layers, -1 if not existing
+     */
+    int findLayerIdx(const std::string &layer_name) const;
+
+    /*!
+     * @brief Creates a matrix of given size and type, filled with NaN for floating point and zero for all other types
+     */
+    static cv::Mat createEmptyData(const cv::Size2i &size, int type);
+
+    /*!
+     * @brief Floor division for negative indices, e.g. floorDiv(-1, 256) = -1
+     */
+    static int floorDiv(int value, int divisor);
+};
+
+} // namespace realm
+
+#endif //OPENREALM_CHUNKED_GRID_MAP_H
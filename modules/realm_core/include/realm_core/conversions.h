@@ -3,6 +3,8 @@
 #ifndef PROJECT_GIS_CONVERSIONS_H
 #define PROJECT_GIS_CONVERSIONS_H
 
+#include <vector>
+
 #include <gdal/ogr_spatialref.h>
 
 #include <realm_core/utm32.h>
@@ -27,6 +29,31 @@ UTMPose convertToUTM(const WGSPose &wgs);
  */
 WGSPose convertToWGS84(const UTMPose &utm);
 
+/*!
+ * @brief Converter for many poses in WGS84 to UTM coordinate frame. Poses of the same zone are transformed together,
+ * which is much faster than converting them one by one.
+ * @param wgs Poses in WGS84 coordinate frame
+ * @return Poses in UTM coordinate frame, in the same order
+ */
+std::vector<UTMPose> convertToUTM(const std::vector<WGSPose> &wgs);
+
+/*!
+ * @brief Converter for many poses in UTM to WGS84 coordinate frame. Poses of the same zone are transformed together,
+ * which is much faster than converting them one by one.
+ * @param utm Poses in UTM coordinate frame
+ * @return Poses in WGS84 coordinate frame, in the same order
+ */
+std::vector<WGSPose> convertToWGS84(const std::vector<UTMPose> &utm);
+
+/*!
+ * @brief Converter for raw coordinate arrays from UTM to WGS84 in place, e.g. for the corners of many tiles
+ * @param zone UTM zone of all coordinates
+ * @param n Number of coordinates
+ * @param x Input easting, output longitude
+ * @param y Input northing, output latitude
+ */
+void convertToWGS84(uint8_t zone, size_t n, double* x, double* y);
+
 /*!
  * @brief GDAL 3 changes axis order: https://github.com/OSGeo/gdal/blob/master/gdal/MIGRATION_GUIDE.TXT
  * @param oSRS Spatial reference to be patched depending on the installed GDAL version
@@ -0,0 +1,32 @@
+
+
+#ifndef PROJECT_CPU_DISPATCH_H
+#define PROJECT_CPU_DISPATCH_H
+
+/*!
+ * @brief Marks a hot kernel for the dispatch by CPU features at runtime. The compiler emits a clone of the function for
+ * AVX-512, AVX2 and the baseline of the build together with a resolver, which selects the best clone for the CPU once
+ * when the library is loaded. Kernels should therefore be plain loops over a row or a batch without dependencies
+ * between the iterations, so the clones only differ in the width they are vectorized with. Kernels must not be inline.
+ *
+ * Cloning is enabled with the CMake option WITH_CPU_DISPATCH for x86-64 Linux builds. On aarch64 NEON is part of the
+ * baseline, so a single function is compiled just like on all other platforms.
+ */
+#if defined(REALM_WITH_CPU_DISPATCH) && !defined(__CUDACC__)
+  #define REALM_CPU_DISPATCH __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+  #define REALM_CPU_DISPATCH
+#endif
+
+namespace realm
+{
+
+/*!
+ * @brief Getter for the target of the kernel clones the resolver selects on this CPU, e.g. for logging
+ * @return "avx512f", "avx2", "neon" or "baseline"
+ */
+const char* getCpuDispatchTarget();
+
+} // namespace realm
+
+#endif //PROJECT_CPU_DISPATCH_H
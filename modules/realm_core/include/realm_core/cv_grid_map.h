@@ -5,10 +5,13 @@
 
 #include <vector>
 #include <memory>
+#include <string>
 
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include <realm_core/thread_pool.h>
+
 namespace realm
 {
 
@@ -43,6 +46,42 @@ class CvGridMap
         int interpolation;
     };
 
+    /*!
+     * @brief Interned handle of a layer name. Names are resolved to a process wide integer once, when the handle is
+     * created, so access through the handle does not compare strings. Handles are meant to be created once and reused,
+     * e.g. as static constants in the per-frame path. They are valid for every map, not only the one they were used on.
+     */
+    class LayerId
+    {
+      public:
+        /*!
+         * @brief Constructor resolves the name, names seen for the first time get the next free id. Thread safe.
+         * @param layer_name Name of the layer, e.g. "elevation"
+         */
+        explicit LayerId(const std::string &layer_name);
+
+        /*!
+         * @brief Getter for the interned id, ids are dense and start at zero
+         * @return Id of the layer name
+         */
+        uint32_t value() const;
+
+        /*!
+         * @brief Getter for the name the handle was created for
+         * @return Name of the layer
+         */
+        const std::string& name() const;
+
+        bool operator==(const LayerId &other) const;
+        bool operator!=(const LayerId &other) const;
+
+      private:
+        uint32_t m_value;
+
+        //! Points into the registry of names, which never shrinks
+        const std::string* m_name;
+    };
+
   public:
     /*!
      * @brief Default constructor
@@ -78,18 +117,60 @@ class CvGridMap
     /*!
      * @brief Adds a layer with name and data to the appropriate container with specified interpolation for that layer
      * @param layer_name name of the layer, e.g. "elevation"
-     * @param layer_data data of the layer: float, double, CV8UC as data mat is supported
+     * @param layer_data data of the layer: float, double, CV8UC as data mat is supported. With OpenCV 4 also half
+     *        precision float (CV_16F), which halves the memory of layers that do not need full precision
      * @param interpolation interpolation flag for opencv, e.g. CV_INTER_LINEAR
      * @return
      */
     void add(const std::string &layer_name, const cv::Mat &layer_data, int interpolation = cv::InterpolationFlags::INTER_LINEAR);
 
     /*!
-     * @brief Adds a submap to the existing grid map
+     * @brief Adds a submap to the existing grid map. All layers are merged in one pass over the rows, which can be
+     * split across threads.
      * Note: size do not have to match up
      * @param submap
+     * @param flag_overlap_handle Merge flag, e.g. REALM_OVERWRITE_ALL or REALM_OVERWRITE_ZERO
+     * @param do_extend Flag to extend this map to include the submap
+     * @param thread_pool Shared thread pool of the pipeline, can be nullptr
+     * @param nrof_threads Number of threads, <= 0 uses all available, 1 runs serially
+     */
+    void add(const CvGridMap &submap, int flag_overlap_handle, bool do_extend = true,
+             const ThreadPool::Ptr &thread_pool = nullptr, int nrof_threads = 1);
+
+    /*!
+     * @brief Adds a layer by taking over its data instead of sharing it with the caller
+     * @param layer layer consisting of a name and data, left empty afterwards
+     * @param is_data_empty Flag to allow adding empty matrices and later set the content
+     */
+    void add(Layer &&layer, bool is_data_empty = false);
+
+    /*!
+     * @brief Adds a layer by taking over its data instead of sharing it with the caller
+     * @param layer_name name of the layer, e.g. "elevation"
+     * @param layer_data data of the layer, left empty afterwards
+     * @param interpolation interpolation flag for opencv, e.g. CV_INTER_LINEAR
      */
-    void add(const CvGridMap &submap, int flag_overlap_handle, bool do_extend = true);
+    void add(const std::string &layer_name, cv::Mat &&layer_data, int interpolation = cv::InterpolationFlags::INTER_LINEAR);
+
+    /*!
+     * @brief Adds a submap, that is not needed by the caller anymore. If it has the same geometry as this map, the
+     * layers are adopted without copying wherever there is nothing to merge, e.g. for new layers or with
+     * REALM_OVERWRITE_ALL. Existing layers are then replaced instead of written into. Otherwise it behaves like the
+     * copying add. The submap is left without layers.
+     * @param submap Submap to be moved into this map
+     * @param flag_overlap_handle Merge flag, e.g. REALM_OVERWRITE_ALL or REALM_OVERWRITE_ZERO
+     * @param do_extend Flag to extend this map to include the submap
+     */
+    void add(CvGridMap &&submap, int flag_overlap_handle, bool do_extend = true);
+
+    /*!
+     * @brief Adds all layers of a map with the same geometry without copying any data. Like getSubmapView, the layers
+     * are matrix headers into the other map, so writing to them modifies it. Meant to combine maps for reading, e.g.
+     * orthophoto and surface model of a frame. Existing layers are replaced. If the geometry differs, the layers are
+     * copied like add(map, REALM_OVERWRITE_ALL, false).
+     * @param map Map to be added, typically of the same roi and resolution
+     */
+    void addView(const CvGridMap &map);
 
     /*!
      * @brief Removes a layer from the grid
@@ -140,6 +221,45 @@ class CvGridMap
      */
     void changeResolution(const cv::Size2i &size);
 
+    /*!
+     * @brief Enables a pyramid of overviews, each level with half the resolution of the one below. Overviews are kept
+     * lazily: Regions changed by add(...) or extendToInclude(...) are only marked, and propagated upwards when an
+     * overview is requested. Cells of an overview are centred on multiples of its resolution and are the weighted mean
+     * of the 3x3 cells below them, ignoring NaN or all zero cells. Layers with nearest neighbour interpolation are
+     * subsampled instead. Changing geometry or resolution drops all overviews, they are then rebuilt on request.
+     * @param nrof_levels Number of overviews, 0 disables them
+     */
+    void setNumberOfOverviews(int nrof_levels);
+
+    /*!
+     * @brief Getter for the number of overviews
+     * @return Number of overviews, 0 if disabled
+     */
+    int getNumberOfOverviews() const;
+
+    /*!
+     * @brief Getter for an overview of all layers. Changed regions are propagated up to the desired level first.
+     * The reference stays valid until the overviews are dropped or the map is extended.
+     * @param level Level of the overview with resolution * 2^level, 0 returns this map
+     * @return Overview of the desired level
+     * @throws out_of_range if the level is not maintained
+     */
+    const CvGridMap& getOverview(int level);
+
+    /*!
+     * @brief Finds the coarsest overview, that is still at least as fine as a desired resolution
+     * @param resolution Desired resolution in [m/cell]
+     * @return Level of the overview, 0 if no overview is coarse enough
+     */
+    int findOverviewLevel(double resolution) const;
+
+    /*!
+     * @brief Marks a region of the overviews as outdated. Only needed after writing to layers directly, e.g. through
+     * operator[] or a view, all other modifiers of the map do this on their own.
+     * @param roi Region of interest in the world frame, that was changed
+     */
+    void invalidateOverviews(const cv::Rect2d &roi);
+
     /*!
      * @brief Iterates through container to find layer by name and returns true if found
      * @param layer_name name of the desired layer
@@ -147,6 +267,13 @@ class CvGridMap
      */
     bool exists(const std::string &layer_name) const;
 
+    /*!
+     * @brief Checks if a layer exists by its interned handle in constant time
+     * @param layer_id Handle of the desired layer
+     * @return true if found, false if not existend
+     */
+    bool exists(const LayerId &layer_id) const;
+
     /*!
      * @brief opencv style function to check wether the object has already been "used" (got data) before or not
      * @return true if setGeometry was called at least once
@@ -176,6 +303,22 @@ class CvGridMap
      */
     const cv::Mat& get(const std::string &layer_name) const;
 
+    /*!
+     * @brief Returns the data of a layer by its interned handle in constant time, exception when non existend
+     * @param layer_id Handle of the desired layer
+     * @return data matrix of the desired layer: float, double, CV8UC as data mat is supported
+     * @throws out_of_range if layer does not exist
+     */
+    cv::Mat& get(const LayerId &layer_id);
+
+    /*!
+     * @brief Returns the data of a layer by its interned handle in constant time, exception when non existend
+     * @param layer_id Handle of the desired layer
+     * @return data matrix of the desired layer: float, double, CV8UC as data mat is supported
+     * @throws out_of_range if layer does not exist
+     */
+    const cv::Mat& get(const LayerId &layer_id) const;
+
     /*!
      * @brief Overloaded [] operator for fast accessing layer data elements, e.g. map["color"].at<cv::Vec3b>(r, c).
      * Be careful: if you use as assignment like map["color"] = cv::Mat(...) the size of the mat can not be cross checked
@@ -194,6 +337,22 @@ class CvGridMap
      */
     const cv::Mat& operator[](const std::string& layer_name) const;
 
+    /*!
+     * @brief Overloaded [] operator for accessing layer data by its interned handle, e.g. map[layer_color]
+     * @param layer_id Handle of the desired layer
+     * @return data matrix of the desired layer: float, double, CV8UC as data mat is supported
+     * @throws out_of_range if layer does not exist
+     */
+    cv::Mat& operator[](const LayerId &layer_id);
+
+    /*!
+     * @brief Overloaded [] operator for accessing layer data by its interned handle, e.g. map[layer_color]
+     * @param layer_id Handle of the desired layer
+     * @return data matrix of the desired layer: float, double, CV8UC as data mat is supported
+     * @throws out_of_range if layer does not exist
+     */
+    const cv::Mat& operator[](const LayerId &layer_id) const;
+
     /*!
      * @brief Function to grab a whole layer including name and interpolation flag
      * @param layer_name Name of the layer to be grabbed
@@ -222,6 +381,16 @@ class CvGridMap
      */
     CvGridMap getSubmap(const std::vector<std::string> &layer_names, const cv::Rect2d &roi) const;
 
+    /*!
+     * @brief Extracts a floating point region of interest from specified layers without copying the data. The layers of
+     * the returned submap are matrix headers into the layers of this map, so writing to the submap modifies this map.
+     * The view is only valid as long as this map is not extended or its layers are not reassigned.
+     * @param layer_names names of the desired layers of the submap
+     * @param roi floating point region of interest to be extracted
+     * @return view of roi with desired layers
+     */
+    CvGridMap getSubmapView(const std::vector<std::string> &layer_names, const cv::Rect2d &roi) const;
+
     /*!
      * @brief Extracts a index-based region of interest from specified layers
      * @param layer_names names of the desired layers of the submap
@@ -237,6 +406,15 @@ class CvGridMap
      */
     Overlap getOverlap(const CvGridMap &other_map) const;
 
+    /*!
+     * @brief Extracts the overlapping region of two CvGridMaps without copying the data. Both submaps of the overlap are
+     * matrix headers into the layers of their parent maps, so e.g. blending can be performed in place. The views are
+     * only valid as long as the parent maps are not extended or their layers are not reassigned.
+     * @param other_map Other grid map to be compared with
+     * @return Overlapping region as views into this and the other map
+     */
+    Overlap getOverlapView(const CvGridMap &other_map) const;
+
     /*!
      * @brief Accessing 2d index in the grid at a position in the world frame
      * @param pos 2d world position, typically in utm32-coordinates for aerial mapping
@@ -283,12 +461,49 @@ class CvGridMap
      */
     cv::Size2i size() const;
 
+    /*!
+     * @brief Computes the memory held by the data of all layers and overviews. Layers sharing data with other maps,
+     * e.g. after a shallow copy, are counted for every map.
+     * @return Size of the layer data in bytes
+     */
+    size_t getByteSize() const;
+
     /*!
      * @brief Getter for the current roi of the grid
      * @return roi of the grid
      */
     cv::Rect2d roi() const;
 
+    /*!
+     * @brief Merges the data of one matrix into another according to the merge flag. REALM_OVERWRITE_ZERO is done
+     * element wise in place, without creating masks.
+     * @param from Input matrix, that is merged into the destination
+     * @param to Output; Destination matrix, must be of same size and type as input
+     * @param flag_merge_handling Merge flag, e.g. REALM_OVERWRITE_ALL or REALM_OVERWRITE_ZERO
+     * @throws invalid_argument if size or type of the matrices do not match for REALM_OVERWRITE_ZERO
+     */
+    static void mergeMatrices(const cv::Mat &from, cv::Mat &to, int flag_merge_handling);
+
+    /*!
+     * @brief Creates the data of an empty layer, which is NaN for floating point types (including CV_16F) and zero in
+     * all channels otherwise
+     * @param size Size of the matrix
+     * @param type OpenCV matrix type, e.g. CV_32F, ...
+     * @return Empty matrix data
+     */
+    static cv::Mat createEmptyData(const cv::Size2i &size, int type);
+
+    /*!
+     * @brief Resizes layer data like cv::resize, but also for half precision data (CV_16F), which cv::resize does not
+     * support. It is then interpolated in single precision and converted back. If dst already has the desired size and
+     * type, e.g. a region of a larger matrix, it is written in place.
+     * @param src Input matrix
+     * @param dst Output; Resized matrix of the same type as the input
+     * @param size Desired size of the output
+     * @param interpolation OpenCV interpolation flag, e.g. cv::INTER_LINEAR
+     */
+    static void resizeData(const cv::Mat &src, cv::Mat &dst, const cv::Size2i &size, int interpolation);
+
 private:
     // resolution therefor [m] / cell
     double m_resolution;
@@ -299,8 +514,20 @@ private:
     // vector of all layers added, currently very dynamic operations
     // like adding and removing layers frequently is not expected
     std::vector<Layer> m_layers;
-
-    void mergeMatrices(const cv::Mat &mat1, cv::Mat &mat2, int flag_merge_handling);
+    // Index of every layer in the container by its interned id plus one, zero if the map has no such layer. Ids are
+    // dense and there are only a few distinct layer names, so the table stays small.
+    std::vector<uint32_t> m_lookup_idx_from_id;
+
+    // Number of overviews maintained, 0 if disabled
+    int m_nrof_overviews;
+    // Overviews from the finest to the coarsest level, created on the first request. Shallow copies of the map share
+    // them like they share the layers.
+    std::vector<CvGridMap::Ptr> m_overviews;
+    // Cell of every overview, on which its first cell is centred, relative to twice the index in the level below
+    std::vector<cv::Point2i> m_overview_offsets;
+    // Changed regions of every level in its own grid, that were not yet propagated to the level above. Index 0 is this
+    // map itself.
+    std::vector<std::vector<cv::Rect2i>> m_overviews_dirty;
 
   /*!
      * @brief Checks the input matrix type and return true if CvGridMap currently supports it.
@@ -316,6 +543,57 @@ private:
      */
     uint32_t findContainerIdx(const std::string &layer_name);
 
+    /*!
+     * @brief Function to find the idx of a layer inside the layer container by its interned handle
+     * @param layer_id Handle of the layer to be found
+     * @return idx of the layer inside vector "layers"
+     * @throws out_of_range if layer does not exist
+     */
+    uint32_t findContainerIdx(const LayerId &layer_id) const;
+
+    /*!
+     * @brief Checks if another map has exactly the same roi, resolution and size, so layers can be exchanged directly
+     * @param other Other grid map to be compared with
+     * @return True if the geometry is equal
+     */
+    bool hasSameGeometry(const CvGridMap &other) const;
+
+    /*!
+     * @brief Rebuilds the lookup of handles to layers, must be called whenever layers are added or removed
+     */
+    void updateLookup();
+
+    /*!
+     * @brief Marks a region of this map as changed for the overviews
+     * @param roi Region of interest in the grid, is clipped to the grid
+     */
+    void markOverviewsDirty(const cv::Rect2i &roi);
+
+    /*!
+     * @brief Drops all overviews and marks the whole map as changed, must be called whenever the geometry is set
+     */
+    void resetOverviews();
+
+    /*!
+     * @brief Extends the existing overviews after this map was extended. Old cells are kept, new ones are empty.
+     * @param shift Number of cells added to the left and top of this map
+     */
+    void extendOverviews(const cv::Point2i &shift);
+
+    /*!
+     * @brief Propagates all changed regions up to an overview level, creating the overviews if necessary
+     * @param level Level up to which the overviews are updated
+     */
+    void updateOverviews(int level);
+
+    /*!
+     * @brief Computes the geometry of the overview of a map, so that its cells are centred on multiples of its resolution
+     * @param fine Map of the level below
+     * @param coarse Output; Layerless map with the geometry of the overview
+     * @param offset Output; Cell of the first overview cell relative to twice its index in the fine map
+     */
+    static void computeOverviewGeometry(const CvGridMap &fine, CvGridMap &coarse, cv::Point2i &offset);
+
     /*!
      * @brief Function to fit the desired roi to a valid number.
      * @param roi_desired Input; Desired region of interest called by "setGeometry(...)"
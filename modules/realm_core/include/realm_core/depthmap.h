@@ -58,9 +58,17 @@ public:
   double getMedianDepth() const;
 
   /*!
-   * @brief Computes the scene depth parameters by creating a vector of depth values, sorting them and extract the
-   * relevant information. Note: Sorting all depth values can take substantial CPU load, which is why this function
-   * must explicitly called - or not.
+   * @brief Getter for a quantile of the depth values of all valid (>0) pixels, e.g. to narrow the depth range of a
+   * refinement to the bulk of a coarse reconstruction. Computed on demand by a partial sort of all valid depths.
+   * @param q Quantile between 0.0 (minimum) and 1.0 (maximum)
+   * @return Depth value at the quantile
+   */
+  double getDepthQuantile(double q) const;
+
+  /*!
+   * @brief Computes the scene depth parameters of all valid (>0) pixels. Minimum and maximum are found in a single pass,
+   * the median by selection instead of sorting, so the update is linear in the number of pixels. All parameters are
+   * 0.0 if the depth map has no valid depth.
    */
   void updateDepthParameters();
 
@@ -12,6 +12,14 @@ enum class SurfaceAssumption
     ELEVATION
 };
 
+enum class TraceEvent
+{
+    ENQUEUED,
+    DEQUEUED,
+    PROCESS_START,
+    PROCESS_END
+};
+
 } // namespace realm
 
 #endif //PROJECT_ENUMS_H
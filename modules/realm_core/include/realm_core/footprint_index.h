@@ -0,0 +1,93 @@
+
+
+#ifndef PROJECT_FOOTPRINT_INDEX_H
+#define PROJECT_FOOTPRINT_INDEX_H
+
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace realm
+{
+
+/*!
+ * @brief Spatial index of the last published image footprints, e.g. to test a new frame for overlap with all of them
+ * instead of only the previous one. Footprints are axis aligned rectangles on the reference plane and registered in
+ * every cell of a uniform grid they touch. A query only visits the footprints in the cells of the queried rectangle,
+ * which are a handful for footprints of similar size, independent of the number of indexed ones. The oldest footprint
+ * is removed once the capacity is reached. Not thread safe, access has to be synchronized by the owner.
+ */
+class FootprintIndex
+{
+  public:
+    /*!
+     * @brief Constructor for an empty index
+     * @param capacity Maximum number of footprints, 0 for unlimited
+     * @param cell_size Edge length of the grid cells in the unit of the footprints. If 0, the larger edge of the first
+     *        added footprint is used, which keeps the number of cells per footprint small.
+     */
+    explicit FootprintIndex(size_t capacity, double cell_size = 0.0);
+
+    /*!
+     * @brief Adds a footprint, the oldest one is removed if the capacity is exceeded
+     * @param roi Footprint on the reference plane
+     */
+    void add(const cv::Rect2d &roi);
+
+    /*!
+     * @brief Computes the maximum overlap of a footprint with the indexed ones
+     * @param roi Footprint on the reference plane
+     * @return Largest part of roi in [%] covered by a single indexed footprint, 0 if there is none
+     */
+    double computeMaxOverlap(const cv::Rect2d &roi) const;
+
+    /*!
+     * @brief Getter for the number of indexed footprints
+     * @return Number of footprints
+     */
+    size_t size() const;
+
+    /*!
+     * @brief Removes all footprints. The cell size derived from the first footprint is derived again.
+     */
+    void clear();
+
+  private:
+
+    //! Maximum number of footprints, 0 for unlimited
+    size_t m_capacity;
+
+    //! Cell size set by the user, 0 to derive it
+    double m_cell_size_init;
+
+    //! Cell size in use
+    double m_cell_size;
+
+    //! Id of the next added footprint, ids are never reused
+    uint64_t m_next_id;
+
+    //! Footprints in order of insertion together with their ids
+    std::deque<std::pair<uint64_t, cv::Rect2d>> m_footprints;
+
+    //! Grid cells with the ids of all footprints touching them
+    std::unordered_map<int64_t, std::vector<uint64_t>> m_cells;
+
+    /*!
+     * @brief Computes the range of grid cells covered by a footprint
+     * @param roi Footprint
+     * @param c0 Output; First column
+     * @param r0 Output; First row
+     * @param c1 Output; Last column (inclusive)
+     * @param r1 Output; Last row (inclusive)
+     */
+    void computeCellRange(const cv::Rect2d &roi, int64_t &c0, int64_t &r0, int64_t &c1, int64_t &r1) const;
+
+    static int64_t computeKey(int64_t c, int64_t r);
+};
+
+} // namespace realm
+
+#endif //PROJECT_FOOTPRINT_INDEX_H
@@ -7,16 +7,20 @@
 #include <memory>
 #include <mutex>
 #include <string>
+#include <vector>
 
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/highgui.hpp>
 
 #include <realm_core/enums.h>
+#include <realm_core/structs.h>
 #include <realm_core/utm32.h>
 #include <realm_core/camera.h>
 #include <realm_core/cv_grid_map.h>
 #include <realm_core/depthmap.h>
+#include <realm_core/georeference.h>
+#include <realm_core/mat_pool.h>
 #include <realm_core/point_cloud.h>
 
 namespace realm
@@ -89,6 +93,15 @@ class Frame
      */
     double getMedianSceneDepth() const;
 
+    /*!
+     * @brief Getter for a quantile of the scene depth of the observed surface points, e.g. to limit the depth range of
+     * the densification to the bulk of the scene instead of outliers. Will be computed by computeSceneDepth(),
+     * linearly interpolated between the observed depths.
+     * @param q Quantile between 0.0 (minimum) and 1.0 (maximum)
+     * @return Depth value of the observed scene at the quantile
+     */
+    double getSceneDepthQuantile(double q) const;
+
     /*!
      * @brief Getter for the depthmap which is usually computed during the densification stage.
      * @return Depthmap of the observed scene. Not necessarily the same size as the image data.
@@ -101,6 +114,14 @@ class Frame
      */
     cv::Mat getDefaultPose() const;
 
+    /*!
+     * @brief Getter for the pool, that the images derived from the raw image are allocated from. Their buffers are
+     *        handed out again to the next frames of the same camera size, once a frame retires. Image loaders should
+     *        decode into it as well, so that even the raw image memory is recycled.
+     * @return Pool of the frame images
+     */
+    static MatPool* getImagePool();
+
     /*!
      * @brief Getter for the undistorted image
      * @return Undistorted image in full resolution
@@ -114,8 +135,10 @@ class Frame
     cv::Mat getImageRaw() const;
 
     /*!
-     * @brief Getter for the surface point cloud
-     * @return Sparse reconstructed point cloud set inside the visual SLAM framework.
+     * @brief Getter for the surface point cloud. The cloud is kept as it was set and the georeference is only applied
+     *        on the first read after it changed, so georeference updates of buffered frames do not touch their clouds.
+     *        The returned cloud must not be modified, it may be shared with the visual SLAM or other readers.
+     * @return Sparse reconstructed point cloud set inside the visual SLAM framework, in the coordinates of the pose
      */
     PointCloud::Ptr getSparseCloud() const;
 
@@ -132,12 +155,25 @@ class Frame
      */
     cv::Mat getVisualPose() const;
 
+    /*!
+     * @brief Getter for the visually computed pose without deep copy. Setters replace the pose instead of writing into
+     *        it, so the returned matrix stays a valid snapshot. It must not be modified.
+     * @return (3x4) camera pose matrix with (R | t)
+     */
+    cv::Mat getVisualPoseView() const;
+
     /*!
      * @brief Getter for geographic pose. Should always be the same as in _camera_model.pose() or getPose()
      * @return (3x4) camera pose matrix with (R | t)
      */
     cv::Mat getGeographicPose() const;
 
+    /*!
+     * @brief Getter for the geographic pose without deep copy, see getVisualPoseView(). It must not be modified.
+     * @return (3x4) camera pose matrix with (R | t)
+     */
+    cv::Mat getGeographicPoseView() const;
+
     /*!
      * @brief Getter for the provided camera orientation. It is assumed to be measured by another source than the visual
      * SLAM.
@@ -145,12 +181,25 @@ class Frame
      */
     cv::Mat getOrientation() const;
 
+    /*!
+     * @brief Getter for the provided camera orientation without deep copy. It is never changed after construction, but
+     *        must not be modified.
+     * @return 3x3 orientation matrix of the camera
+     */
+    cv::Mat getOrientationView() const;
+
     /*!
      * @brief Getter for transformation matrix from visual world to geographic coordinate system.
      * @return (4x4) transformation matrix from visual to geographic world.
      */
     cv::Mat getGeoreference() const;
 
+    /*!
+     * @brief Getter for the georeference without deep copy, see getVisualPoseView(). It must not be modified.
+     * @return (4x4) transformation matrix from visual to geographic world.
+     */
+    cv::Mat getGeoreferenceView() const;
+
     /*!
      * @brief Getter for the surface assumption
      * @return Surface assumption, e.g. PLANAR or ELEVATION
@@ -192,6 +241,12 @@ class Frame
      */
     uint64_t getTimestamp() const;
 
+    /*!
+     * @brief Getter for the factor the working resolution is resized with, check isImageResizeSet() before
+     * @return Image resize factor, 0.0 if not set
+     */
+    double getImageResizeFactor() const;
+
     /*!
      * @brief Getter for resized image width
      * @return Image width resized depending on the image resize factor set
@@ -211,7 +266,8 @@ class Frame
     cv::Size getResizedImageSize() const;
 
     /*!
-     * @brief Getter for the resized, undistorted image
+     * @brief Getter for the resized, undistorted image. It is computed with the first access after the resize factor
+     *        was set and cached afterwards. No deep copy, so it must not be modified.
      * @return Resized, undistorted image depending on the image resize factor set
      */
     cv::Mat getResizedImageUndistorted() const;
@@ -222,6 +278,21 @@ class Frame
      */
     cv::Mat getResizedImageRaw() const;
 
+    /*!
+     * @brief Getter for the resized, distorted raw image without deep copy. Setting a new resize factor allocates a new
+     *        image, so the returned one stays valid. It must not be modified, use getResizedImageRaw() to paint on it.
+     * @return Resized, distorted raw image depending on the image resize factor set
+     */
+    cv::Mat getResizedImageRawView() const;
+
+    /*!
+     * @brief Getter for the resized, distorted image in grayscale, as it is consumed by the visual SLAM. It is converted
+     *        only with the first access after the resize factor was set and cached afterwards. No deep copy, so it
+     *        must not be modified.
+     * @return Resized, distorted grayscale image depending on the image resize factor set
+     */
+    cv::Mat getResizedImageGray() const;
+
     /*!
      * @brief Getter for the resized calibration matrix (pinhole only)
      * @return Resized calibration matrix (pinhole only), that is computed depending on the image resize factor
@@ -229,7 +300,8 @@ class Frame
     cv::Mat getResizedCalibration() const;
 
     /*!
-     * @brief Getter for the resized calibration model
+     * @brief Getter for the resized calibration model. It is created once per resize factor and shared between calls
+     *        as long as the pose does not change, so it must not be modified.
      * @return Resized calibration model, that is computed depending on the image resize factor
      */
     camera::Pinhole::Ptr getResizedCamera() const;
@@ -292,7 +364,7 @@ class Frame
      *        camera model behind it can be usefull to reduce computational costs. Settings this resize factor is
      *        necessary to call getter for functions with "getResized..." name.
      * @param value Resize factor for image size, e.g. 0.1 means the image is resized to 10% of original edge length,
-     *        therefore 1% of the original resolution
+     *        therefore 1% of the original resolution. Setting the current factor again does not resize the image again.
      */
     void setImageResizeFactor(const double &value);
 
@@ -323,6 +395,21 @@ class Frame
      */
     void updateGeoreference(const cv::Mat &T, bool do_update_sparse_cloud = false);
 
+    /*!
+     * @brief Attaches the frame to a shared georeference, e.g. the one of the pose estimation. Later updates of it are
+     * not applied to the frame until resolveGeoreference() is called, so updates stay constant time no matter how many
+     * frames are buffered. The visual pose and sparse cloud must be in the visual world of the georeference.
+     * @param georeference Shared georeference, nullptr to detach the frame
+     */
+    void setSharedGeoreference(const Georeference::Ptr &georeference);
+
+    /*!
+     * @brief Applies the shared georeference to pose and sparse cloud, if it changed since the last call. The first
+     * call behaves like 'initGeoreference(...)', all later ones like 'updateGeoreference(..., true)'.
+     * @return true if the georeference of the frame was changed
+     */
+    bool resolveGeoreference();
+
     /*!
      * @brief Getter to check if this frame is marked as keyframe
      * @return true if yes
@@ -353,6 +440,45 @@ class Frame
    */
     bool hasAccuratePose() const;
 
+    /*!
+     * @brief Records the current time for an event of the frame inside a stage, so the path of the frame through the
+     * pipeline can be traced end-to-end. Repeated events overwrite the previous time.
+     * @param stage Name of the stage
+     * @param event Event that happened to the frame, e.g. it was added to the queue of the stage
+     */
+    void addTraceEvent(const std::string &stage, TraceEvent event);
+
+    /*!
+     * @brief Getter for the trace of the frame through the pipeline
+     * @return One record for every stage the frame has passed, in order of their first event
+     */
+    std::vector<StageTrace> getTrace() const;
+
+    /*!
+     * @brief Computes the memory held by the frame, which are the raw and resized image, the depthmap, the sparse cloud,
+     * the surface model and the orthophoto. Data shared with other objects is counted nevertheless.
+     * @return Size of the data of the frame in bytes
+     */
+    size_t getByteSize() const;
+
+    /*!
+     * @brief Releases the raw and resized image to reduce the memory of the frame, e.g. when the pipeline exceeds its
+     * memory budget. Should only be called once no following stage needs the image anymore.
+     */
+    void releaseImage();
+
+    /*!
+     * @brief Releases the depthmap to reduce the memory of the frame. Should only be called once the depthmap was
+     * used to compute the surface model.
+     */
+    void releaseDepthmap();
+
+    /*!
+     * @brief Releases the sparse cloud to reduce the memory of the frame. Should only be called once the sparse cloud
+     * was used to compute the surface model.
+     */
+    void releaseSparseCloud();
+
   private:
 
     /**###########################
@@ -397,6 +523,11 @@ class Frame
     //! Median scene depth computed from the set surface points. Is computed as soon as at least a sparse cloud was set
     double m_med_depth;
 
+    //! Scene depths of the surface points the minimum, maximum and median were computed from. Sorted with the first
+    //! quantile requested, guarded by m_mutex_sparse_points
+    mutable std::vector<double> m_scene_depths;
+    mutable bool m_is_scene_depth_sorted;
+
     Depthmap::Ptr m_depthmap;
 
     /**###################################################
@@ -420,12 +551,29 @@ class Frame
     //! Resized image, resize factor defined through image resize factor, only grabbable if factor was set
     cv::Mat m_img_resized;
 
+    //! Grayscale copy of the resized image, computed on first access
+    mutable cv::Mat m_img_resized_gray;
+
+    //! Undistorted resized image, computed on first access
+    mutable cv::Mat m_img_resized_undistorted;
+
+    //! Camera model resized with the image resize factor, created on first access and replaced on pose changes.
+    //! Guarded by the camera mutex.
+    mutable camera::Pinhole::Ptr m_camera_resized;
+
     //! Reconstructed 3D sparse cloud containing data (cv::Mat with row(i) = x, y, z, r, g, b, nx, ny, nz), point ids as
     //! well as a unique context identifier. The Ids refer to the ids that are assigned inside the visual SLAM, so points
     //! are uniquely identified inside a context. The context id is typically required, because after a reset SLAM systems
     //! may also reset the point ids. So to be able to unqiuely identify a point the context id can be used.
+    //! The cloud is never modified, all transformations are accumulated in m_sparse_cloud_transformation instead.
     PointCloud::Ptr m_sparse_cloud;
 
+    //! Transformation (4x4) applied to the sparse cloud on read, e.g. the georeference. Empty if there is none.
+    cv::Mat m_sparse_cloud_transformation;
+
+    //! Sparse cloud with the transformation applied, created on first read and reset when the transformation changes
+    mutable PointCloud::Ptr m_sparse_cloud_transformed;
+
     //! Digital surface model of the observed scene represented by a 2.5D grid map. Layers contained:
     //! Essential:
     //! ["elevation"]: Containing the elevation data per grid cell
@@ -440,13 +588,13 @@ class Frame
     //! Camera model of the frame that performs all the projection work. Currently only pinhole supported
     camera::Pinhole::Ptr m_camera_model;
 
-    //! 4x4 transformation from world to geographic UTM frame
+    //! 4x4 transformation from world to geographic UTM frame, guarded by m_mutex_T_w2g. Replaced, never modified.
     cv::Mat m_transformation_w2g;
 
-    //! 3x4 camera motion matrix in the local world frame
+    //! 3x4 camera motion matrix in the local world frame, guarded by m_mutex_cam. Replaced, never modified.
     cv::Mat m_motion_c2w;
 
-    //! 3x4 camera motion in the geographic frame
+    //! 3x4 camera motion in the geographic frame, guarded by m_mutex_cam. Replaced, never modified.
     cv::Mat m_motion_c2g;
 
     //! Mutex for img resized
@@ -467,6 +615,19 @@ class Frame
     //! Mutex for transformation from world to geographic coordinate frame
     mutable std::mutex m_mutex_T_w2g;
 
+    //! Shared georeference and the epoch of it last applied to the frame, 0 if never, guarded by m_mutex_georeference
+    Georeference::Ptr m_georeference;
+    uint64_t m_georeference_epoch;
+
+    //! Mutex for the shared georeference, serializes its resolution
+    std::mutex m_mutex_georeference;
+
+    //! Timestamps of the frame passing through the stages of the pipeline
+    std::vector<StageTrace> m_trace;
+
+    //! Mutex for the trace
+    mutable std::mutex m_mutex_trace;
+
     /*!
      * @brief Private function to compute scene depth using the previously set sparse cloud. Can obviously only be
      *        computed if sparse cloud was generated by e.g. visual SLAM or stereo reconstruction. Be careful to
@@ -490,7 +651,8 @@ class Frame
     void setGeographicPose(const cv::Mat &pose);
 
     /*!
-    * @brief: Uses the provided 4x4 matrix to transform the sparse cloud into a new coordinate system
+    * @brief: Uses the provided 4x4 matrix to transform the sparse cloud into a new coordinate system. Only the
+    * transformation applied on read is updated, the points are not touched.
     * @param T 4x4 transformation matrix
     */
     void applyTransformationToSparseCloud(const cv::Mat &T);
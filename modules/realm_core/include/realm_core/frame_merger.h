@@ -0,0 +1,128 @@
+
+
+#ifndef PROJECT_FRAME_MERGER_H
+#define PROJECT_FRAME_MERGER_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <realm_core/frame.h>
+
+namespace realm
+{
+
+/*!
+ * @brief Merges the frames of several cameras, e.g. of a multi camera rig with one processing chain per camera, into
+ * one stream in order of their timestamps. A frame is held back until every camera seen so far delivered a frame at
+ * least as recent, so no older frame of a slower chain can follow it. If a camera falls silent, frames are released
+ * once they were held for the maximum delay. Frames of every camera are expected in order of their timestamps.
+ * Frames arriving after a more recent one was already released are passed on immediately and counted as late. With a
+ * single camera, every frame is released immediately. Thread safe, the release function is called while holding the
+ * lock, so frames are released in order and by one thread at a time, e.g. as the single producer of a ring buffer.
+ */
+class FrameMerger
+{
+  public:
+    using Ptr = std::shared_ptr<FrameMerger>;
+    using ConstPtr = std::shared_ptr<const FrameMerger>;
+
+    //! Called for every frame in order of the timestamps
+    using ReleaseFunc = std::function<void(const Frame::Ptr &)>;
+
+  public:
+    /*!
+     * @brief Constructor
+     * @param max_delay Maximum time in [ms] a frame is held back waiting for the other cameras
+     * @param release Function, that receives the merged frames
+     */
+    FrameMerger(int64_t max_delay, const ReleaseFunc &release);
+
+    /*!
+     * @brief Adds a frame and releases all frames, that are ready afterwards
+     * @param frame Frame of any camera
+     */
+    void add(const Frame::Ptr &frame);
+
+    /*!
+     * @brief Releases the frames, that were held back for the maximum delay. Should be called periodically, so frames
+     * waiting for a camera that fell silent are released even if no other frame arrives.
+     */
+    void update();
+
+    /*!
+     * @brief Releases all frames held back, e.g. when the pipeline finishes
+     */
+    void flush();
+
+    /*!
+     * @brief Drops all frames held back and forgets the cameras seen so far
+     */
+    void clear();
+
+    /*!
+     * @brief Getter for the number of frames held back
+     * @return Number of frames
+     */
+    size_t size() const;
+
+    /*!
+     * @brief Getter for the number of cameras seen so far
+     * @return Number of cameras
+     */
+    size_t getNrofCameras() const;
+
+    /*!
+     * @brief Getter for the number of frames, that arrived after a more recent frame was released
+     * @return Number of late frames
+     */
+    uint64_t getNrofLate() const;
+
+  private:
+
+    struct Entry
+    {
+        Frame::Ptr frame;
+        long t_arrival;
+
+        bool operator>(const Entry &other) const
+        {
+          return frame->getTimestamp() > other.frame->getTimestamp();
+        }
+    };
+
+    int64_t m_max_delay;
+    ReleaseFunc m_release;
+
+    mutable std::mutex m_mutex;
+
+    //! Frames held back, the oldest timestamp on top
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> m_queue;
+
+    //! Timestamp of the most recent frame of every camera
+    std::unordered_map<std::string, uint64_t> m_watermarks;
+
+    bool m_has_released;
+    uint64_t m_timestamp_released;
+    uint64_t m_nrof_late;
+
+    /*!
+     * @brief Releases the frames on top of the queue, as long as they are ready. Expects the lock to be held.
+     * @param t_now Current time in [ms]
+     */
+    void releaseReady(long t_now);
+
+    /*!
+     * @brief Releases the frame on top of the queue. Expects the lock to be held.
+     */
+    void releaseTop();
+};
+
+} // namespace realm
+
+#endif //PROJECT_FRAME_MERGER_H
@@ -0,0 +1,70 @@
+
+
+#ifndef PROJECT_GEOREFERENCE_H
+#define PROJECT_GEOREFERENCE_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include <opencv2/core.hpp>
+
+namespace realm
+{
+
+/*!
+ * @brief Versioned transformation from the visual world to the geographic frame, shared by the georeferencer and all
+ * frames estimated in the same visual world. Updates only replace the transformation and increase the epoch, so they
+ * are constant time regardless of the number of frames referencing it. Frames compare the epoch they were resolved
+ * with and apply the transformation on demand, see Frame::resolveGeoreference. Thread safe.
+ */
+class Georeference
+{
+  public:
+    using Ptr = std::shared_ptr<Georeference>;
+    using ConstPtr = std::shared_ptr<const Georeference>;
+
+  public:
+    /*!
+     * @brief Constructor for an uninitialized georeference with epoch 0
+     */
+    Georeference();
+
+    /*!
+     * @brief Replaces the transformation and increases the epoch
+     * @param T_w2g 4x4 homogenous transformation matrix from the world to the geographic frame, copied
+     * @return Epoch of the new transformation
+     */
+    uint64_t update(const cv::Mat &T_w2g);
+
+    /*!
+     * @brief Getter for the current transformation
+     * @param epoch Optional output for the epoch of the returned transformation
+     * @return 4x4 transformation from the world to the geographic frame, nullptr if not initialized. Never modified.
+     */
+    std::shared_ptr<const cv::Mat> getTransformation(uint64_t* epoch = nullptr) const;
+
+    /*!
+     * @brief Getter for the epoch, which is increased with every update
+     * @return Epoch of the current transformation, 0 if it was never updated
+     */
+    uint64_t getEpoch() const;
+
+    /*!
+     * @brief Getter to check if a transformation is set
+     * @return true if yes
+     */
+    bool isInitialized() const;
+
+  private:
+
+    //! Transformation and epoch are only replaced together, guarded by m_mutex
+    std::shared_ptr<const cv::Mat> m_T_w2g;
+    uint64_t m_epoch;
+
+    mutable std::mutex m_mutex;
+};
+
+} // namespace realm
+
+#endif //PROJECT_GEOREFERENCE_H
@@ -0,0 +1,109 @@
+
+
+#ifndef PROJECT_LATENCY_HISTOGRAM_H
+#define PROJECT_LATENCY_HISTOGRAM_H
+
+#include <cstdint>
+#include <vector>
+
+namespace realm
+{
+
+/*!
+ * @brief Percentiles of a latency distribution in milliseconds, e.g. for the statistics of a stage
+ */
+struct LatencyPercentiles
+{
+  double p50;
+  double p90;
+  double p99;
+  double p999;
+  double max;
+  uint64_t count;
+};
+
+/*!
+ * @brief Histogram for latencies with a bounded relative error, similar to HDR histograms. Values are recorded in
+ * microseconds into buckets of exponentially growing width, each split into a fixed number of linear sub buckets. This
+ * results in a relative error of about 3% over the full range from microseconds to hours at constant memory and
+ * constant time per recorded value. Not thread safe, access has to be synchronized by the owner.
+ */
+class LatencyHistogram
+{
+  public:
+    /*!
+     * @brief Constructor for an empty histogram
+     */
+    LatencyHistogram();
+
+    /*!
+     * @brief Records a single latency
+     * @param value_ms Latency in milliseconds, negative values are recorded as zero
+     */
+    void add(double value_ms);
+
+    /*!
+     * @brief Computes a percentile of all recorded latencies
+     * @param percentile Percentile in the range of [0, 100], e.g. 99.9
+     * @return Latency in milliseconds below which the given percentage of values lies, 0.0 if nothing was recorded
+     */
+    double getPercentile(double percentile) const;
+
+    /*!
+     * @brief Summary of the most common percentiles for service level objectives
+     * @return p50, p90, p99, p99.9, max and number of recorded values
+     */
+    LatencyPercentiles getPercentiles() const;
+
+    /*!
+     * @brief Getter for the maximum recorded latency
+     * @return Maximum latency in milliseconds
+     */
+    double getMax() const;
+
+    /*!
+     * @brief Getter for the number of recorded latencies
+     * @return Number of values
+     */
+    uint64_t getCount() const;
+
+    /*!
+     * @brief Removes all recorded values
+     */
+    void reset();
+
+  private:
+
+    //! Number of bits for the linear sub buckets, 2^5 = 32 sub buckets result in about 3% relative error
+    static constexpr int kSubBucketBits = 5;
+
+    //! Maximum value in microseconds is 2^kMaxValueBits, larger values are saturated (~12 days)
+    static constexpr int kMaxValueBits = 40;
+
+    //! Number of recorded values for every bucket
+    std::vector<uint64_t> m_counts;
+
+    //! Total number of recorded values
+    uint64_t m_count;
+
+    //! Maximum recorded value in microseconds
+    uint64_t m_max;
+
+    /*!
+     * @brief Computes the bucket index for a value
+     * @param value Value in microseconds
+     * @return Index of the bucket
+     */
+    static size_t computeIndex(uint64_t value);
+
+    /*!
+     * @brief Computes the value in the middle of a bucket, which is used to represent all its values
+     * @param idx Index of the bucket
+     * @return Value in microseconds
+     */
+    static uint64_t computeValue(size_t idx);
+};
+
+} // namespace realm
+
+#endif //PROJECT_LATENCY_HISTOGRAM_H
@@ -0,0 +1,25 @@
+
+
+#ifndef PROJECT_LOG_MACROS_H
+#define PROJECT_LOG_MACROS_H
+
+#include <realm_core/loguru.h>
+
+// Per-frame messages are only compiled in, if their verbosity is not above this level. Set e.g. to -1 (WARNING) to
+// remove all per-frame INFO messages from the hot paths.
+#ifndef REALM_LOG_FRAME_VERBOSITY
+#define REALM_LOG_FRAME_VERBOSITY 9
+#endif
+
+/*!
+ * @brief Logging of messages that are emitted for every frame. Identical to LOG_F, but removed at compile time if the
+ * verbosity is above REALM_LOG_FRAME_VERBOSITY, including the formatting of the arguments.
+ */
+#define LOG_FRAME_F(verbosity_name, ...)                                                \
+  do                                                                                    \
+  {                                                                                     \
+    if (loguru::Verbosity_ ## verbosity_name <= REALM_LOG_FRAME_VERBOSITY)              \
+      LOG_F(verbosity_name, __VA_ARGS__);                                               \
+  } while (false)
+
+#endif //PROJECT_LOG_MACROS_H
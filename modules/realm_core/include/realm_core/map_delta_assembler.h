@@ -0,0 +1,79 @@
+
+
+#ifndef PROJECT_MAP_DELTA_ASSEMBLER_H
+#define PROJECT_MAP_DELTA_ASSEMBLER_H
+
+#include <cstdint>
+#include <memory>
+
+#include <realm_core/cv_grid_map.h>
+
+namespace realm
+{
+
+/*!
+ * @brief Reconstructs a global map on the receiving side of a delta publishing, where only the changed region of
+ * every update is transported together with a version number incremented per update. Deltas contain the final values
+ * of their region, so they overwrite the assembled map. Occasional full maps reset it, e.g. for late subscribers or
+ * after an update got lost. Not thread safe, access has to be synchronized by the owner.
+ */
+class MapDeltaAssembler
+{
+  public:
+    using Ptr = std::shared_ptr<MapDeltaAssembler>;
+    using ConstPtr = std::shared_ptr<const MapDeltaAssembler>;
+
+  public:
+    MapDeltaAssembler();
+
+    /*!
+     * @brief Replaces the assembled map with a full map, it is consistent afterwards. Full maps older than the
+     * assembled one are ignored.
+     * @param map Full global map, data is copied
+     * @param version Version of the full map, which includes the delta with the same version
+     */
+    void applyFull(const CvGridMap &map, uint64_t version);
+
+    /*!
+     * @brief Adds a delta to the assembled map. Deltas already included in the map are ignored. If a delta is missing
+     * in between, the delta is added anyway, but the map is inconsistent until the next full map.
+     * @param delta Changed region of the global map
+     * @param version Version of the delta
+     * @return False, if the map is inconsistent afterwards
+     */
+    bool applyDelta(const CvGridMap &delta, uint64_t version);
+
+    /*!
+     * @brief Getter for the assembled map
+     * @return Assembled map, nullptr if nothing was applied yet
+     */
+    CvGridMap::ConstPtr getMap() const;
+
+    /*!
+     * @brief Getter for the version of the last applied delta or full map
+     * @return Version, 0 if nothing was applied yet
+     */
+    uint64_t getVersion() const;
+
+    /*!
+     * @brief Getter for the consistency of the assembled map, i.e. whether all deltas since the last full map or since
+     * the first delta were applied
+     * @return True if no delta was missed
+     */
+    bool isConsistent() const;
+
+  private:
+
+    //! Assembled global map
+    CvGridMap::Ptr m_map;
+
+    //! Version of the last applied update
+    uint64_t m_version;
+
+    //! Flag, that no delta was missed
+    bool m_is_consistent;
+};
+
+} // namespace realm
+
+#endif //PROJECT_MAP_DELTA_ASSEMBLER_H
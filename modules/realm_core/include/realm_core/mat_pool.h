@@ -0,0 +1,144 @@
+
+
+#ifndef PROJECT_MAT_POOL_H
+#define PROJECT_MAT_POOL_H
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace realm
+{
+
+/*!
+ * @brief Allocator for cv::Mat, that keeps the buffers of released matrices and hands them out again for matrices of
+ * the same byte size. Stages allocate the same full size temporaries for every frame, e.g. masks and the layers of the
+ * rectified map, so after the first frames no memory has to be requested from the system anymore and no new pages
+ * have to be touched. Buffers are returned to the pool, when the last matrix referencing them is released, no matter
+ * in which thread. Pools are identified by name and live as long as the process, because matrices allocated from them
+ * are handed on to other stages and may outlive their creator, like the allocators of OpenCV itself.
+ */
+class MatPool : public cv::MatAllocator
+{
+  public:
+#if CV_VERSION_MAJOR >= 4
+    using AccessFlags = cv::AccessFlag;
+#else
+    using AccessFlags = int;
+#endif
+
+    //! Memory the buffers of the pool are allocated in
+    enum class Memory
+    {
+        //! Regular host memory
+        PAGEABLE,
+        //! Page-locked host memory, that is mapped into the address space of the GPU. Transfers are done by DMA and
+        //! can run asynchronously, on integrated GPUs (e.g. Jetson) kernels access it directly without any copy.
+        //! Requires CUDA.
+        PINNED
+    };
+
+  public:
+    /*!
+     * @brief Getter for a pool by name, it is created on the first call. Thread safe.
+     * @param name Unique name of the pool, typically the name of the stage using it
+     * @return Pool, that is never destroyed
+     */
+    static MatPool* get(const std::string &name);
+
+    MatPool(const MatPool &) = delete;
+    MatPool& operator=(const MatPool &) = delete;
+
+    /*!
+     * @brief Creates a matrix with uninitialized data from the pool
+     * @param size Size of the matrix
+     * @param type OpenCV type of the matrix, e.g. CV_32F
+     * @return Matrix, whose buffer is returned to the pool when it is released
+     */
+    cv::Mat create(const cv::Size2i &size, int type) const;
+
+    /*!
+     * @brief Creates a matrix from the pool initialized with zeros
+     * @param size Size of the matrix
+     * @param type OpenCV type of the matrix, e.g. CV_32F
+     * @return Matrix, whose buffer is returned to the pool when it is released
+     */
+    cv::Mat zeros(const cv::Size2i &size, int type) const;
+
+    /*!
+     * @brief Setter for the maximum memory kept for reuse. Buffers released beyond it are freed. Default is 256 MB.
+     * @param bytes Maximum memory of the cached buffers in bytes
+     */
+    void setMaxCachedBytes(size_t bytes);
+
+    /*!
+     * @brief Getter for the memory currently kept for reuse
+     * @return Memory of the cached buffers in bytes
+     */
+    size_t getCachedBytes() const;
+
+    /*!
+     * @brief Getter for the number of allocations, that were served from cached buffers
+     * @return Number of reused buffers
+     */
+    size_t getNrofReused() const;
+
+    /*!
+     * @brief Frees all cached buffers, matrices still in use are not affected
+     */
+    void clear();
+
+    /*!
+     * @brief Setter for the memory of newly allocated buffers, default is pageable. Cached buffers are freed, matrices
+     * still in use keep their memory and are freed on release. Note: On some integrated GPUs (e.g. Jetson Nano and TX2)
+     * pinned memory is not cached by the CPU, so it should only be used for data mostly accessed by the GPU.
+     * @param memory Memory of the buffers
+     * @return True if the memory is used, false if it is not available, e.g. built without CUDA or no device present
+     */
+    bool setMemory(Memory memory);
+
+    /*!
+     * @brief Getter for the memory of newly allocated buffers
+     * @return Memory of the buffers
+     */
+    Memory getMemory() const;
+
+    /*!
+     * @brief Getter for the pointer, under which the GPU can access the data of a matrix without copying it
+     * @param mat Matrix allocated from any pool
+     * @return Device pointer of the first element, nullptr if the matrix is not in pinned memory
+     */
+    static void* getDevicePointer(const cv::Mat &mat);
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data0, size_t* step, AccessFlags flags,
+                           cv::UMatUsageFlags usage_flags) const override;
+    bool allocate(cv::UMatData* data, AccessFlags access_flags, cv::UMatUsageFlags usage_flags) const override;
+    void deallocate(cv::UMatData* data) const override;
+
+  private:
+    explicit MatPool(size_t max_cached_bytes);
+
+    //! Maximum memory of the cached buffers in bytes
+    size_t m_max_cached_bytes;
+
+    //! Memory of the cached buffers in bytes
+    mutable size_t m_cached_bytes;
+
+    //! Number of allocations served from the cache
+    mutable size_t m_nrof_reused;
+
+    //! Memory of new buffers, all cached buffers are in this memory as well
+    Memory m_memory;
+
+    //! Released buffers by their size in bytes
+    mutable std::unordered_map<size_t, std::vector<uchar*>> m_buffers;
+
+    mutable std::mutex m_mutex;
+};
+
+} // namespace realm
+
+#endif //PROJECT_MAT_POOL_H
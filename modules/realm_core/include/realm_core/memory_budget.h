@@ -0,0 +1,75 @@
+
+
+#ifndef PROJECT_MEMORY_BUDGET_H
+#define PROJECT_MEMORY_BUDGET_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace realm
+{
+
+/*!
+ * @brief Pipeline wide budget for the memory held by the stages. Every stage reports the memory of its data, e.g.
+ * buffered frames and maps. If the sum exceeds the limit, stages degrade gracefully by releasing optional data, so long
+ * missions can be completed on hardware with fixed memory. The budget is meant to be shared by all stages of a
+ * pipeline and can be accessed from all threads.
+ */
+class MemoryBudget
+{
+  public:
+    using Ptr = std::shared_ptr<MemoryBudget>;
+    using ConstPtr = std::shared_ptr<const MemoryBudget>;
+
+  public:
+    /*!
+     * @brief Constructor
+     * @param limit Maximum memory of all consumers in bytes, must be greater zero
+     */
+    explicit MemoryBudget(size_t limit);
+
+    /*!
+     * @brief Updates the memory currently held by a consumer
+     * @param consumer Unique name of the consumer, e.g. the stage name
+     * @param bytes Memory held by the consumer in bytes
+     */
+    void update(const std::string &consumer, size_t bytes);
+
+    /*!
+     * @brief Getter for the sum of the memory of all consumers
+     * @return Memory in bytes
+     */
+    size_t getUsage() const;
+
+    /*!
+     * @brief Getter for the memory limit
+     * @return Limit in bytes
+     */
+    size_t getLimit() const;
+
+    /*!
+     * @brief Checks if the consumers hold more memory than the limit
+     * @return True if the budget is exceeded and optional data should be released
+     */
+    bool isExceeded() const;
+
+  private:
+
+    //! Maximum memory of all consumers in bytes
+    size_t m_limit;
+
+    //! Sum of the memory of all consumers in bytes
+    size_t m_usage;
+
+    //! Memory of every consumer in bytes
+    std::map<std::string, size_t> m_consumers;
+
+    //! Mutex for the memory of the consumers
+    mutable std::mutex m_mutex_consumers;
+};
+
+} // namespace realm
+
+#endif //PROJECT_MEMORY_BUDGET_H
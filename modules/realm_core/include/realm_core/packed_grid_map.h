@@ -0,0 +1,150 @@
+
+
+#ifndef OPENREALM_PACKED_GRID_MAP_H
+#define OPENREALM_PACKED_GRID_MAP_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include <realm_core/cv_grid_map.h>
+#include <realm_core/thread_pool.h>
+
+namespace realm
+{
+
+/*!
+ * @brief Grid map for the global mosaic, that stores all blended layers of a cell in one fixed record instead of one
+ * matrix per layer. Blending reads and writes every layer of a cell at once, which then touches a single cache line
+ * instead of five separate arrays. Only the layers of the record are kept: color_rgb (CV_8UC4), elevation (CV_32F),
+ * elevation_angle (CV_32F), num_observations (CV_16UC1) and elevated (CV_8UC1). Geometry follows the CvGridMap, data
+ * is put in and taken out in form of CvGridMaps.
+ */
+class PackedGridMap
+{
+  public:
+    using Ptr = std::shared_ptr<PackedGridMap>;
+    using ConstPtr = std::shared_ptr<const PackedGridMap>;
+
+    //! Record of one cell, padded to 16 bytes so cells never straddle cache lines
+    struct Cell
+    {
+      float elevation;
+      float elevation_angle;
+      cv::Vec4b color_rgb;
+      uint16_t num_observations;
+      uint8_t elevated;
+      uint8_t padding;
+    };
+
+  public:
+    /*!
+     * @brief Constructor of an empty packed map, the geometry is set by the first map added
+     */
+    PackedGridMap();
+
+    /*!
+     * @brief Adds a map like CvGridMap::add with REALM_OVERWRITE_ZERO and blends it in the same pass: Where both maps
+     * have data, the cell which was observed under the steeper elevation angle is kept and the number of observations
+     * is incremented. The packed map is extended to include the input.
+     * @param map Map with at least color_rgb, elevation, elevation_angle and num_observations, resolution must match
+     * @param thread_pool Shared thread pool of the pipeline, can be nullptr
+     * @param nrof_threads Number of threads, <= 0 uses all available, 1 runs serially
+     * @throws invalid_argument if layers are missing, of unexpected type or the resolution does not match
+     */
+    void blend(const CvGridMap &map, const ThreadPool::Ptr &thread_pool = nullptr, int nrof_threads = 1);
+
+    /*!
+     * @brief Extracts a region of interest as deep copy in the layout of the CvGridMap
+     * @param layer_names Names of the layers, must be part of the record
+     * @param roi Region of interest in the world frame, must be inside the map
+     * @return CvGridMap of the region of interest with desired layers
+     */
+    CvGridMap getSubmap(const std::vector<std::string> &layer_names, const cv::Rect2d &roi) const;
+
+    /*!
+     * @brief Unpacks the whole map into the layout of the CvGridMap
+     * @param layer_names Names of the layers, must be part of the record
+     * @return CvGridMap with desired layers
+     */
+    CvGridMap getGridMap(const std::vector<std::string> &layer_names) const;
+
+    /*!
+     * @brief Unpacks the whole map with all layers of the record
+     * @return CvGridMap with all layers
+     */
+    CvGridMap getGridMap() const;
+
+    /*!
+     * @brief Getter for the names of the layers in the record
+     * @return Names of all layers of a cell
+     */
+    static const std::vector<std::string>& getLayerNames();
+
+    /*!
+     * @brief Typed access to the cells of a row
+     * @param r Row of the grid
+     * @return Pointer to the first cell of the row
+     */
+    Cell* ptr(int r);
+    const Cell* ptr(int r) const;
+
+    /*!
+     * @brief Typed access to a single cell
+     * @param r Row of the grid
+     * @param c Column of the grid
+     * @return Reference to the cell
+     */
+    Cell& at(int r, int c);
+    const Cell& at(int r, int c) const;
+
+    bool empty() const;
+    double resolution() const;
+    cv::Size2i size() const;
+    cv::Rect2d roi() const;
+
+    /*!
+     * @brief Computes the memory held by the cells
+     * @return Size of the data in bytes
+     */
+    size_t getByteSize() const;
+
+  private:
+
+    //! Layerless grid map, only used for the geometry
+    CvGridMap m_geometry;
+
+    //! Cells stored as matrix of type CV_8UC(sizeof(Cell))
+    cv::Mat m_cells;
+
+    //! Interpolation flags of the layers, taken from the first map added
+    std::map<std::string, int> m_interpolations;
+
+    /*!
+     * @brief Extends the grid to include a region of interest, new cells are empty
+     * @param roi Region of interest in the world frame
+     */
+    void extendToInclude(const cv::Rect2d &roi);
+
+    /*!
+     * @brief Creates a matrix of empty cells, that have NaN elevation and angle and zero otherwise
+     * @param size Size of the matrix
+     * @return Matrix of empty cells
+     */
+    static cv::Mat createEmptyCells(const cv::Size2i &size);
+
+    /*!
+     * @brief Unpacks a region of cells into the layout of the CvGridMap
+     * @param layer_names Names of the layers to be unpacked
+     * @param roi_idx Region of interest in the grid
+     * @param map Output; Map with the geometry of the region, layers are added to it
+     */
+    void unpack(const std::vector<std::string> &layer_names, const cv::Rect2i &roi_idx, CvGridMap &map) const;
+};
+
+} // namespace realm
+
+#endif //OPENREALM_PACKED_GRID_MAP_H
@@ -3,6 +3,12 @@
 #ifndef PROJECT_PLANE_FITTER_H
 #define PROJECT_PLANE_FITTER_H
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
 #include <realm_core/structs.h>
 
 namespace realm
@@ -54,6 +60,171 @@ class PlaneFitter
     PlaneFitter::Point computeExactPlaneCentroid(const std::vector<PlaneFitter::Point> &points);
 };
 
+/*!
+ * @brief Allocation-free least squares plane fit for many small neighbourhoods, e.g. one per grid cell. Points are
+ * accumulated into their first and second moments, the plane normal is the eigenvector of the smallest eigenvalue of
+ * the 3x3 covariance and computed in closed form. Moments are accumulated relative to the first point, so single
+ * precision is sufficient also for geographic coordinates of large magnitude.
+ * @tparam T float or double
+ */
+template <typename T>
+class PlaneFitAccumulator
+{
+  public:
+    PlaneFitAccumulator()
+    {
+      reset();
+    }
+
+    /*!
+     * @brief Removes all points, so the accumulator can be reused for the next neighbourhood
+     */
+    void reset()
+    {
+      m_n = 0;
+      std::fill(m_origin, m_origin + 3, T(0));
+      std::fill(m_sum, m_sum + 3, T(0));
+      std::fill(m_sum_sq, m_sum_sq + 6, T(0));
+    }
+
+    /*!
+     * @brief Adds a point to the fit
+     */
+    void add(T x, T y, T z)
+    {
+      if (m_n == 0)
+      {
+        m_origin[0] = x;
+        m_origin[1] = y;
+        m_origin[2] = z;
+      }
+      T dx = x - m_origin[0];
+      T dy = y - m_origin[1];
+      T dz = z - m_origin[2];
+      m_sum[0] += dx;
+      m_sum[1] += dy;
+      m_sum[2] += dz;
+      m_sum_sq[0] += dx*dx;
+      m_sum_sq[1] += dx*dy;
+      m_sum_sq[2] += dx*dz;
+      m_sum_sq[3] += dy*dy;
+      m_sum_sq[4] += dy*dz;
+      m_sum_sq[5] += dz*dz;
+      m_n++;
+    }
+
+    /*!
+     * @brief Getter for the number of points added
+     */
+    size_t size() const
+    {
+      return m_n;
+    }
+
+    /*!
+     * @brief Computes the plane with the least squared orthogonal distances to the points. For three points the exact
+     * solution is found.
+     * @param normal Output; Unit normal of the plane, sign is arbitrary
+     * @param centroid Output; Centroid of the points, only written if not nullptr
+     * @return False if less than three points were added or the points do not span a plane, e.g. are on a line
+     */
+    bool estimate(T* normal, T* centroid = nullptr) const
+    {
+      if (m_n < 3)
+        return false;
+
+      auto n = static_cast<T>(m_n);
+      T mean[3]{m_sum[0] / n, m_sum[1] / n, m_sum[2] / n};
+      if (centroid)
+        for (int i = 0; i < 3; ++i)
+          centroid[i] = m_origin[i] + mean[i];
+
+      // Covariance, symmetric with a00 a01 a02 / a11 a12 / a22
+      T a00 = m_sum_sq[0] / n - mean[0]*mean[0];
+      T a01 = m_sum_sq[1] / n - mean[0]*mean[1];
+      T a02 = m_sum_sq[2] / n - mean[0]*mean[2];
+      T a11 = m_sum_sq[3] / n - mean[1]*mean[1];
+      T a12 = m_sum_sq[4] / n - mean[1]*mean[2];
+      T a22 = m_sum_sq[5] / n - mean[2]*mean[2];
+
+      // Eigenvalues of a symmetric 3x3 matrix by the trigonometric solution of its characteristic polynomial
+      const T kEps = std::sqrt(std::numeric_limits<T>::epsilon());
+      T q = (a00 + a11 + a22) / T(3);
+      T p1 = a01*a01 + a02*a02 + a12*a12;
+      T p2 = (a00-q)*(a00-q) + (a11-q)*(a11-q) + (a22-q)*(a22-q) + T(2)*p1;
+      T p = std::sqrt(p2 / T(6));
+      if (p <= kEps * std::abs(q) || p <= std::numeric_limits<T>::min())
+        return false;
+
+      T b00 = (a00-q) / p, b11 = (a11-q) / p, b22 = (a22-q) / p;
+      T b01 = a01 / p, b02 = a02 / p, b12 = a12 / p;
+      T det_b = b00*(b11*b22 - b12*b12) - b01*(b01*b22 - b12*b02) + b02*(b01*b12 - b11*b02);
+      T r = std::max(T(-1), std::min(T(1), det_b / T(2)));
+      T phi = std::acos(r) / T(3);
+      const T kTwoPiThird = T(2.0943951023931954923);
+      T eig_max = q + T(2)*p*std::cos(phi);
+      T eig_min = q + T(2)*p*std::cos(phi + kTwoPiThird);
+      T eig_mid = T(3)*q - eig_max - eig_min;
+
+      // Smallest eigenvalue is not unique, if all points are on a line
+      if (eig_mid - eig_min <= kEps * eig_max)
+        return false;
+
+      // Eigenvector is orthogonal to the rows of (A - eig_min*I). Largest cross product of two rows is the most stable
+      T r0[3]{a00 - eig_min, a01, a02};
+      T r1[3]{a01, a11 - eig_min, a12};
+      T r2[3]{a02, a12, a22 - eig_min};
+      T c01[3], c02[3], c12[3];
+      cross(r0, r1, c01);
+      cross(r0, r2, c02);
+      cross(r1, r2, c12);
+      T d01 = dot(c01, c01), d02 = dot(c02, c02), d12 = dot(c12, c12);
+
+      const T* best = c01;
+      T d_best = d01;
+      if (d02 > d_best)
+      {
+        best = c02;
+        d_best = d02;
+      }
+      if (d12 > d_best)
+      {
+        best = c12;
+        d_best = d12;
+      }
+      if (d_best <= std::numeric_limits<T>::min())
+        return false;
+
+      T length = std::sqrt(d_best);
+      for (int i = 0; i < 3; ++i)
+        normal[i] = best[i] / length;
+      return true;
+    }
+
+  private:
+
+    size_t m_n;
+
+    //! First point added, moments are relative to it
+    T m_origin[3];
+
+    //! Sum of x, y, z and of xx, xy, xz, yy, yz, zz
+    T m_sum[3];
+    T m_sum_sq[6];
+
+    static void cross(const T* a, const T* b, T* c)
+    {
+      c[0] = a[1]*b[2] - a[2]*b[1];
+      c[1] = a[2]*b[0] - a[0]*b[2];
+      c[2] = a[0]*b[1] - a[1]*b[0];
+    }
+
+    static T dot(const T* a, const T* b)
+    {
+      return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+    }
+};
+
 } // namespace realm
 
 #endif //PROJECT_PLANE_FITTER_H
@@ -3,30 +3,135 @@
 
 #include <opencv2/core.hpp>
 #include <memory>
+#include <vector>
 
 namespace realm
 {
 
+/*!
+ * @brief Point cloud stored as structure of arrays: ids, positions, colors and normals are kept in separate typed
+ *        containers. Positions are single precision relative to a double precision origin, so even UTM coordinates
+ *        keep sub-millimeter accuracy for points within a few kilometers of it. Colors are optional and packed as
+ *        three bytes in the channel order they were provided in, normals are optional as well. The cloud can be used
+ *        directly as dataset of a nanoflann k-d tree, no copy of the points is needed.
+ */
 class PointCloud
 {
 public:
   using Ptr = std::shared_ptr<PointCloud>;
+  using ConstPtr = std::shared_ptr<const PointCloud>;
+
+  //! Coordinate type of the nanoflann dataset interface
+  using coord_t = double;
 
 public:
   PointCloud();
+
+  /*!
+   * @brief Constructor of an empty point cloud with given origin for the positions
+   * @param origin Origin of the positions in the world frame
+   */
+  explicit PointCloud(const cv::Point3d &origin);
+
+  /*!
+   * @brief Constructor from point data structured as row(i) = (x, y, z[, c0, c1, c2[, nx, ny, nz]]). The first point
+   *        is used as origin of the positions.
+   * @param point_ids Unique ids of the points, one per row
+   * @param data Point data with 3, 6 or 9 columns of type CV_64F
+   */
   PointCloud(const std::vector<uint32_t> &point_ids, const cv::Mat &data);
 
-  bool empty();
+  bool empty() const;
+
+  int size() const;
+
+  /*!
+   * @brief Reserves memory for a number of points
+   * @param n Number of points
+   * @param with_colors Flag if colors are added to the points
+   * @param with_normals Flag if normals are added to the points
+   */
+  void reserve(size_t n, bool with_colors, bool with_normals);
+
+  /*!
+   * @brief Adds a point. Colors and normals must be given either for all points or for none.
+   * @param id Unique id of the point
+   * @param pt Position of the point in the world frame
+   * @param color Optional color of the point
+   * @param normal Optional normal of the point
+   */
+  void push_back(uint32_t id, const cv::Point3d &pt, const cv::Vec3b *color = nullptr, const cv::Point3f *normal = nullptr);
+
+  /*!
+   * @brief Getter for the origin of the positions
+   * @return Origin in the world frame
+   */
+  const cv::Point3d& getOrigin() const;
+
+  /*!
+   * @brief Getter for a single position in the world frame
+   * @param i Index of the point
+   * @return Position in double precision
+   */
+  cv::Point3d getPoint(size_t i) const;
+
+  /*!
+   * @brief Getter for all positions relative to the origin, no copy
+   * @return Positions in single precision
+   */
+  const std::vector<cv::Point3f>& getPositions() const;
+
+  /*!
+   * @brief Getter for the packed colors, empty if the cloud has none, no copy
+   * @return Colors of the points
+   */
+  const std::vector<cv::Vec3b>& getColors() const;
+
+  /*!
+   * @brief Getter for the normals, empty if the cloud has none, no copy
+   * @return Normals of the points
+   */
+  const std::vector<cv::Point3f>& getNormals() const;
+
+  bool hasColors() const;
+
+  bool hasNormals() const;
+
+  const std::vector<uint32_t>& getPointIds() const;
+
+  /*!
+   * @brief Applies a transformation to all points, e.g. the georeference. Normals are rotated and renormalized, so a
+   *        scaled rotation is allowed.
+   * @param T (3x4) or (4x4) transformation of type CV_64F
+   */
+  void transform(const cv::Mat &T);
+
+  /*!
+   * @brief Converts the cloud into the matrix layout row(i) = (x, y, z[, c0, c1, c2[, nx, ny, nz]]) of type CV_64F
+   *        for consumers, that still need it. Missing colors are zero, when normals are present.
+   * @return Deep copy of the point data
+   */
+  cv::Mat toMat() const;
 
-  cv::Mat& data();
+  size_t getByteSize() const;
 
-  int size();
+  // Dataset interface of nanoflann, queries are in the world frame
+  size_t kdtree_get_point_count() const;
+  coord_t kdtree_get_pt(size_t idx, int dim) const;
+  coord_t kdtree_distance(const coord_t *p1, size_t idx_p2, size_t size) const;
 
-  std::vector<uint32_t> getPointIds();
+  template <class BBOX>
+  bool kdtree_get_bbox(BBOX &/*bb*/) const
+  {
+    return false;
+  }
 
 private:
+  cv::Point3d m_origin;
   std::vector<uint32_t> m_point_ids;
-  cv::Mat m_data;
+  std::vector<cv::Point3f> m_positions;
+  std::vector<cv::Vec3b> m_colors;
+  std::vector<cv::Point3f> m_normals;
 
 };
 
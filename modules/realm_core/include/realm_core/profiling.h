@@ -0,0 +1,113 @@
+
+
+#ifndef PROJECT_PROFILING_H
+#define PROJECT_PROFILING_H
+
+#include <cstdint>
+#include <mutex>
+
+namespace realm
+{
+
+/*!
+ * @brief RAII zone of the Tracy profiler, e.g.
+ *
+ *   {
+ *     ProfilingZone zone("Blending");
+ *     blend(&overlap);
+ *   }
+ *
+ * Zones are only compiled in with the CMake option PROFILING_ENABLED, otherwise they are empty and cost nothing. The
+ * client only records while a profiler is connected, so instrumented release builds can be run in the field. With
+ * PROFILING_PERF_COUNTERS the cycles, instructions and cache misses of the calling thread within the zone are read
+ * from perf_event and attached to the zone as text.
+ */
+class ProfilingZone
+{
+  public:
+    /*!
+     * @brief Begins the zone
+     * @param name Name of the zone, copied on construction, so it may be a temporary string
+     */
+    explicit ProfilingZone(const char* name);
+
+    /*!
+     * @brief Ends the zone
+     */
+    ~ProfilingZone();
+
+    /*!
+     * @brief Ends the zone before the end of the scope. Further calls have no effect.
+     */
+    void end();
+
+    ProfilingZone(const ProfilingZone &other) = delete;
+    ProfilingZone& operator=(const ProfilingZone &other) = delete;
+
+#ifdef REALM_WITH_PROFILING
+    //! Number of hardware counters read for every zone
+    static constexpr int kNrofCounters = 4;
+
+  private:
+
+    //! Context of the zone in the profiler, see TracyCZoneCtx
+    uint32_t m_id;
+    int m_is_active;
+
+    //! Flag if the zone was not ended yet
+    bool m_is_open;
+
+    //! Counter values at the beginning of the zone, only valid if m_has_counters is set
+    uint64_t m_counters[kNrofCounters];
+    bool m_has_counters;
+#endif
+};
+
+/*!
+ * @brief Sets the name of the calling thread in the profiler
+ * @param name Name of the thread, e.g. "Stage [mosaicing]"
+ */
+void setProfilingThreadName(const char* name);
+
+/*!
+ * @brief Locks a mutex and records the time waiting for it as a zone of the profiler. Uncontended locks are taken
+ * without a zone, so only contention shows up. Without profiling the mutex is simply locked.
+ * @param mutex Mutex to be locked
+ * @param name Name of the zone, e.g. "Wait m_mutex_cache"
+ */
+template <typename Mutex>
+void lockProfiled(Mutex &mutex, const char* name)
+{
+#ifdef REALM_WITH_PROFILING
+  if (mutex.try_lock())
+    return;
+  ProfilingZone zone(name);
+#else
+  (void)name;
+#endif
+  mutex.lock();
+}
+
+/*!
+ * @brief Like lockProfiled, but the mutex is owned by the returned lock
+ * @param mutex Mutex to be locked
+ * @param name Name of the zone, e.g. "Wait m_mutex_cache"
+ * @return Lock owning the mutex
+ */
+template <typename Mutex>
+std::unique_lock<Mutex> uniqueLockProfiled(Mutex &mutex, const char* name)
+{
+  lockProfiled(mutex, name);
+  return std::unique_lock<Mutex>(mutex, std::adopt_lock);
+}
+
+#ifndef REALM_WITH_PROFILING
+inline ProfilingZone::ProfilingZone(const char*) {}
+inline ProfilingZone::~ProfilingZone() {}
+inline void ProfilingZone::end() {}
+inline void setProfilingThreadName(const char*) {}
+#endif
+
+} // namespace realm
+
+#endif //PROJECT_PROFILING_H
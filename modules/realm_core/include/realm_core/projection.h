@@ -0,0 +1,293 @@
+
+
+#ifndef PROJECT_GIS_PROJECTION_H
+#define PROJECT_GIS_PROJECTION_H
+
+#include <cmath>
+#include <cstddef>
+
+/*!
+ * @brief Closed-form projections between WGS84, UTM and Web Mercator (EPSG:3857) without PROJ. UTM is computed with
+ * the Krueger series to sixth order in the third flattening as given by Karney, "Transverse Mercator with an accuracy
+ * of a few nanometers", J. Geodesy 85 (2011), which is accurate to well below a millimeter inside the UTM zones. All
+ * functions are free of state and allocations, so they can be called from any thread. The array variants process
+ * every point independently, which lets the compiler vectorize the loops when a vector math library is available.
+ * Angles are in [deg], coordinates in [m]. Zones are not computed here, see gis::convertToUTM for the exceptions.
+ */
+
+namespace realm
+{
+namespace gis
+{
+namespace projection
+{
+
+//! Semi-major axis and flattening of the WGS84 ellipsoid
+constexpr double wgs84_a = 6378137.0;
+constexpr double wgs84_f = 1.0 / 298.257223563;
+
+//! Squared first eccentricity, the eccentricity itself is not constexpr because of the square root
+constexpr double wgs84_e2 = wgs84_f * (2.0 - wgs84_f);
+constexpr double wgs84_e = 0.0818191908426214957;
+
+//! Third flattening
+constexpr double wgs84_n = wgs84_f / (2.0 - wgs84_f);
+
+//! Scale on the central meridian, false easting and false northing on the southern hemisphere of UTM
+constexpr double utm_k0 = 0.9996;
+constexpr double utm_false_easting = 500000.0;
+constexpr double utm_false_northing_south = 10000000.0;
+
+constexpr double deg_to_rad = M_PI / 180.0;
+constexpr double rad_to_deg = 180.0 / M_PI;
+
+/*!
+ * @brief Radius of the rectifying sphere, scaled by k0, so the conformal sphere coordinates are in [m] of UTM
+ */
+constexpr double computeRectifyingRadius(double n)
+{
+  return utm_k0 * wgs84_a / (1.0 + n) * (1.0 + n*n/4.0 + n*n*n*n/64.0 + n*n*n*n*n*n/256.0);
+}
+
+/*!
+ * @brief Coefficient alpha_j of the series from the conformal sphere to the transverse Mercator plane
+ * @param j Order of the coefficient in [1, 6]
+ */
+constexpr double computeAlpha(int j, double n)
+{
+  switch (j)
+  {
+    case 1: return n*(1.0/2 + n*(-2.0/3 + n*(5.0/16 + n*(41.0/180 + n*(-127.0/288 + n*(7891.0/37800))))));
+    case 2: return n*n*(13.0/48 + n*(-3.0/5 + n*(557.0/1440 + n*(281.0/630 + n*(-1983433.0/1935360)))));
+    case 3: return n*n*n*(61.0/240 + n*(-103.0/140 + n*(15061.0/26880 + n*(167603.0/181440))));
+    case 4: return n*n*n*n*(49561.0/161280 + n*(-179.0/168 + n*(6601661.0/7257600)));
+    case 5: return n*n*n*n*n*(34729.0/80640 + n*(-3418889.0/1995840));
+    case 6: return n*n*n*n*n*n*(212378941.0/319334400);
+    default: return 0.0;
+  }
+}
+
+/*!
+ * @brief Coefficient beta_j of the series from the transverse Mercator plane to the conformal sphere
+ * @param j Order of the coefficient in [1, 6]
+ */
+constexpr double computeBeta(int j, double n)
+{
+  switch (j)
+  {
+    case 1: return n*(1.0/2 + n*(-2.0/3 + n*(37.0/96 + n*(-1.0/360 + n*(-81.0/512 + n*(96199.0/604800))))));
+    case 2: return n*n*(1.0/48 + n*(1.0/15 + n*(-437.0/1440 + n*(46.0/105 + n*(-1118711.0/3870720)))));
+    case 3: return n*n*n*(17.0/480 + n*(-37.0/840 + n*(-209.0/4480 + n*(5569.0/90720))));
+    case 4: return n*n*n*n*(4397.0/161280 + n*(-11.0/504 + n*(-830251.0/7257600)));
+    case 5: return n*n*n*n*n*(4583.0/161280 + n*(-108847.0/3991680));
+    case 6: return n*n*n*n*n*n*(20648693.0/638668800);
+    default: return 0.0;
+  }
+}
+
+constexpr double utm_radius = computeRectifyingRadius(wgs84_n);
+
+constexpr double utm_alpha[6] = {computeAlpha(1, wgs84_n), computeAlpha(2, wgs84_n), computeAlpha(3, wgs84_n),
+                                 computeAlpha(4, wgs84_n), computeAlpha(5, wgs84_n), computeAlpha(6, wgs84_n)};
+
+constexpr double utm_beta[6] = {computeBeta(1, wgs84_n), computeBeta(2, wgs84_n), computeBeta(3, wgs84_n),
+                                computeBeta(4, wgs84_n), computeBeta(5, wgs84_n), computeBeta(6, wgs84_n)};
+
+/*!
+ * @brief Longitude of the central meridian of a UTM zone
+ * @param zone UTM zone in [1, 60]
+ * @return Central meridian in [deg]
+ */
+constexpr double computeCentralMeridian(int zone)
+{
+  return zone * 6.0 - 183.0;
+}
+
+/*!
+ * @brief Tangent of the conformal latitude from the tangent of the geodetic latitude
+ */
+inline double computeTauPrime(double tau)
+{
+  double sigma = std::sinh(wgs84_e * std::atanh(wgs84_e * tau / std::sqrt(1.0 + tau*tau)));
+  return tau * std::sqrt(1.0 + sigma*sigma) - sigma * std::sqrt(1.0 + tau*tau);
+}
+
+/*!
+ * @brief Tangent of the geodetic latitude from the tangent of the conformal latitude. The inverse has no closed form
+ * and is solved with Newton's method, which converges to double precision in two steps. A fixed number of steps keeps
+ * the loops over point arrays free of branches.
+ */
+inline double computeTau(double tau_prime)
+{
+  double tau = tau_prime;
+  for (int i = 0; i < 3; ++i)
+  {
+    double tau_prime_i = computeTauPrime(tau);
+    double dtau = (tau_prime - tau_prime_i) / std::sqrt(1.0 + tau_prime_i*tau_prime_i)
+                  * (1.0 + (1.0 - wgs84_e2) * tau*tau) / ((1.0 - wgs84_e2) * std::sqrt(1.0 + tau*tau));
+    tau += dtau;
+  }
+  return tau;
+}
+
+/*!
+ * @brief Projects a geodetic position into a UTM zone
+ * @param lat Latitude in [deg]
+ * @param lon Longitude in [deg]
+ * @param zone UTM zone
+ * @param is_northern Flag for the northern hemisphere, southern positions are shifted by the false northing
+ * @param easting Output; Easting in [m]
+ * @param northing Output; Northing in [m]
+ */
+inline void projectToUTM(double lat, double lon, int zone, bool is_northern, double &easting, double &northing)
+{
+  double lambda = (lon - computeCentralMeridian(zone)) * deg_to_rad;
+  double tau_prime = computeTauPrime(std::tan(lat * deg_to_rad));
+
+  double cos_lambda = std::cos(lambda);
+  double xi_prime = std::atan2(tau_prime, cos_lambda);
+  double eta_prime = std::asinh(std::sin(lambda) / std::sqrt(tau_prime*tau_prime + cos_lambda*cos_lambda));
+
+  double xi = xi_prime;
+  double eta = eta_prime;
+  for (int j = 1; j <= 6; ++j)
+  {
+    xi += utm_alpha[j - 1] * std::sin(2.0*j*xi_prime) * std::cosh(2.0*j*eta_prime);
+    eta += utm_alpha[j - 1] * std::cos(2.0*j*xi_prime) * std::sinh(2.0*j*eta_prime);
+  }
+
+  easting = utm_false_easting + utm_radius * eta;
+  northing = utm_radius * xi + (is_northern ? 0.0 : utm_false_northing_south);
+}
+
+/*!
+ * @brief Computes the geodetic position of a UTM coordinate
+ * @param easting Easting in [m]
+ * @param northing Northing in [m]
+ * @param zone UTM zone
+ * @param is_northern Flag for the northern hemisphere, southern coordinates include the false northing
+ * @param lat Output; Latitude in [deg]
+ * @param lon Output; Longitude in [deg]
+ */
+inline void projectFromUTM(double easting, double northing, int zone, bool is_northern, double &lat, double &lon)
+{
+  double xi = (northing - (is_northern ? 0.0 : utm_false_northing_south)) / utm_radius;
+  double eta = (easting - utm_false_easting) / utm_radius;
+
+  double xi_prime = xi;
+  double eta_prime = eta;
+  for (int j = 1; j <= 6; ++j)
+  {
+    xi_prime -= utm_beta[j - 1] * std::sin(2.0*j*xi) * std::cosh(2.0*j*eta);
+    eta_prime -= utm_beta[j - 1] * std::cos(2.0*j*xi) * std::sinh(2.0*j*eta);
+  }
+
+  double sinh_eta_prime = std::sinh(eta_prime);
+  double cos_xi_prime = std::cos(xi_prime);
+  double tau_prime = std::sin(xi_prime) / std::sqrt(sinh_eta_prime*sinh_eta_prime + cos_xi_prime*cos_xi_prime);
+
+  lat = std::atan(computeTau(tau_prime)) * rad_to_deg;
+  lon = std::atan2(sinh_eta_prime, cos_xi_prime) * rad_to_deg + computeCentralMeridian(zone);
+}
+
+/*!
+ * @brief Projects a geodetic position into Web Mercator (EPSG:3857), which treats the ellipsoid as a sphere
+ * @param lat Latitude in [deg]
+ * @param lon Longitude in [deg]
+ * @param x Output; Easting in [m]
+ * @param y Output; Northing in [m]
+ */
+inline void projectToWebMercator(double lat, double lon, double &x, double &y)
+{
+  x = wgs84_a * lon * deg_to_rad;
+  y = wgs84_a * std::asinh(std::tan(lat * deg_to_rad));
+}
+
+/*!
+ * @brief Computes the geodetic position of a Web Mercator (EPSG:3857) coordinate
+ * @param x Easting in [m]
+ * @param y Northing in [m]
+ * @param lat Output; Latitude in [deg]
+ * @param lon Output; Longitude in [deg]
+ */
+inline void projectFromWebMercator(double x, double y, double &lat, double &lon)
+{
+  lat = std::atan(std::sinh(y / wgs84_a)) * rad_to_deg;
+  lon = x / wgs84_a * rad_to_deg;
+}
+
+/*!
+ * @brief Projects UTM coordinates of one zone into Web Mercator (EPSG:3857) in place
+ * @param n Number of coordinates
+ * @param zone UTM zone of all coordinates
+ * @param is_northern Flag for the northern hemisphere
+ * @param x Input easting in UTM, output easting in Web Mercator
+ * @param y Input northing in UTM, output northing in Web Mercator
+ */
+inline void projectUTMToWebMercator(size_t n, int zone, bool is_northern, double* x, double* y)
+{
+  for (size_t i = 0; i < n; ++i)
+  {
+    double lat, lon;
+    projectFromUTM(x[i], y[i], zone, is_northern, lat, lon);
+    projectToWebMercator(lat, lon, x[i], y[i]);
+  }
+}
+
+/*!
+ * @brief Projects Web Mercator (EPSG:3857) coordinates into one UTM zone in place
+ * @param n Number of coordinates
+ * @param zone UTM zone of all coordinates
+ * @param is_northern Flag for the northern hemisphere
+ * @param x Input easting in Web Mercator, output easting in UTM
+ * @param y Input northing in Web Mercator, output northing in UTM
+ */
+inline void projectWebMercatorToUTM(size_t n, int zone, bool is_northern, double* x, double* y)
+{
+  for (size_t i = 0; i < n; ++i)
+  {
+    double lat, lon;
+    projectFromWebMercator(x[i], y[i], lat, lon);
+    projectToUTM(lat, lon, zone, is_northern, x[i], y[i]);
+  }
+}
+
+/*!
+ * @brief Projects geodetic positions into one UTM zone
+ * @param n Number of positions
+ * @param lat Latitudes in [deg]
+ * @param lon Longitudes in [deg]
+ * @param zone UTM zone of all positions
+ * @param is_northern Flag for the northern hemisphere
+ * @param easting Output; Eastings in [m]
+ * @param northing Output; Northings in [m]
+ */
+inline void projectToUTM(size_t n, const double* lat, const double* lon, int zone, bool is_northern,
+                         double* easting, double* northing)
+{
+  for (size_t i = 0; i < n; ++i)
+    projectToUTM(lat[i], lon[i], zone, is_northern, easting[i], northing[i]);
+}
+
+/*!
+ * @brief Computes the geodetic positions of UTM coordinates of one zone
+ * @param n Number of coordinates
+ * @param easting Eastings in [m]
+ * @param northing Northings in [m]
+ * @param zone UTM zone of all coordinates
+ * @param is_northern Flag for the northern hemisphere
+ * @param lat Output; Latitudes in [deg]
+ * @param lon Output; Longitudes in [deg]
+ */
+inline void projectFromUTM(size_t n, const double* easting, const double* northing, int zone, bool is_northern,
+                           double* lat, double* lon)
+{
+  for (size_t i = 0; i < n; ++i)
+    projectFromUTM(easting[i], northing[i], zone, is_northern, lat[i], lon[i]);
+}
+
+} // namespace projection
+} // namespace gis
+} // namespace realm
+
+#endif //PROJECT_GIS_PROJECTION_H
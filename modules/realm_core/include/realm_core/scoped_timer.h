@@ -0,0 +1,191 @@
+
+
+#ifndef PROJECT_SCOPED_TIMER_H
+#define PROJECT_SCOPED_TIMER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <realm_core/profiling.h>
+#include <realm_core/spsc_ring_buffer.h>
+
+namespace realm
+{
+
+/*!
+ * @brief Single timed operation as it is kept in memory until flushed to disk
+ */
+struct TimingRecord
+{
+  //! Name of the operation, must point to a string with static storage duration, e.g. a literal
+  const char* name;
+  //! Start of the operation in microseconds since epoch
+  uint64_t t_start;
+  //! Duration of the operation in microseconds
+  uint64_t duration;
+};
+
+/*!
+ * @brief Process wide recorder for the timings of processing steps, e.g. blending in the mosaicing stage. Every thread
+ * records into its own lock-free ring buffer, so timing a scope on the hot path costs two clock reads and a copy of
+ * a few bytes, but no formatting or I/O. The buffers are flushed periodically into a binary file, which can be
+ * analyzed with tools/analyze/analyze_timing.py. If the buffer of a thread is not flushed in time, the oldest records
+ * are dropped. Recording is disabled until an output file was opened.
+ *
+ * The file starts with the magic "RTIM" and a uint32 version, followed by records of fixed size in host byte order:
+ * char thread[32], char name[32], uint64 t_start [us], uint64 duration [us]. Strings are zero padded and truncated.
+ */
+class TimingRecorder
+{
+  public:
+    //! Version of the binary file format
+    static constexpr uint32_t kFileVersion = 1;
+
+    //! Maximum number of unflushed records for every thread
+    static constexpr size_t kBufferCapacity = 4096;
+
+    //! Size of the string fields in the binary file format
+    static constexpr size_t kNameLength = 32;
+
+  public:
+    /*!
+     * @brief Getter for the process wide instance
+     * @return Recorder shared by all threads
+     */
+    static TimingRecorder& instance();
+
+    /*!
+     * @brief Opens the binary output file and enables recording. Calling it again with the same path has no effect, so
+     * every stage of a pipeline may open the file in the common output directory.
+     * @param filepath Absolute path to the output file, typically with .bin suffix
+     */
+    void open(const std::string &filepath);
+
+    /*!
+     * @brief Flushes all remaining records, closes the output file and disables recording
+     */
+    void close();
+
+    /*!
+     * @brief Getter for the state of the recorder
+     * @return True if timings are currently recorded
+     */
+    bool isEnabled() const;
+
+    /*!
+     * @brief Sets the name of the calling thread, which is written together with all its records. Threads without a
+     * name are identified by their registration order.
+     * @param name Name of the thread, e.g. "Stage [mosaicing]"
+     */
+    void setThreadName(const std::string &name);
+
+    /*!
+     * @brief Records a single timing for the calling thread. Lock-free except for the first call of every thread.
+     * @param name Name of the operation, must point to a string with static storage duration, e.g. a literal
+     * @param t_start Start of the operation in microseconds since epoch
+     * @param t_end End of the operation in microseconds since epoch
+     */
+    void record(const char* name, uint64_t t_start, uint64_t t_end);
+
+    /*!
+     * @brief Writes all records currently in the thread buffers to the output file. Can be called from any thread.
+     * @return Number of written records
+     */
+    size_t flush();
+
+    /*!
+     * @brief Takes all records currently in the thread buffers without writing them, e.g. for tests.
+     * @return Pairs of thread name and record
+     */
+    std::vector<std::pair<std::string, TimingRecord>> drain();
+
+  private:
+
+    /*!
+     * @brief Records of a single thread. Produced by the owning thread, consumed while holding m_mutex_buffers.
+     */
+    struct ThreadBuffer
+    {
+      explicit ThreadBuffer(const std::string &thread_name);
+
+      //! Name of the thread, only changed while holding m_mutex_buffers
+      std::string thread_name;
+
+      //! Pending records
+      SpscRingBuffer<TimingRecord> records;
+    };
+
+    TimingRecorder();
+
+    /*!
+     * @brief Getter for the buffer of the calling thread, which is created on first use
+     * @return Buffer of the calling thread
+     */
+    ThreadBuffer* getThreadBuffer();
+
+    //! Flag to enable recording, set while an output file is opened
+    std::atomic<bool> m_is_enabled;
+
+    //! Path of the currently opened output file
+    std::string m_filepath;
+
+    //! Mutex for the list of buffers, the output file and the consumer side of all buffers
+    std::mutex m_mutex_buffers;
+
+    //! Buffers of all threads that ever recorded, kept alive beyond the lifetime of the threads
+    std::vector<std::unique_ptr<ThreadBuffer>> m_buffers;
+};
+
+/*!
+ * @brief RAII helper to time a scope, e.g.
+ *
+ *   {
+ *     ScopedTimer timer("Blending");
+ *     blend(&overlap);
+ *   }
+ *
+ * The timing is recorded into the TimingRecorder on destruction or on an explicit call of stop(), if the result of
+ * the timed operation is needed beyond its scope. If recording is disabled, the clock is not read at all. Builds with
+ * profiling enabled additionally open a zone of the same name, see ProfilingZone.
+ */
+class ScopedTimer
+{
+  public:
+    /*!
+     * @brief Starts the timer
+     * @param name Name of the operation, must point to a string with static storage duration, e.g. a literal
+     */
+    explicit ScopedTimer(const char* name);
+
+    /*!
+     * @brief Stops the timer and records the timing
+     */
+    ~ScopedTimer();
+
+    /*!
+     * @brief Stops the timer before the end of the scope and records the timing. Further calls have no effect.
+     */
+    void stop();
+
+    ScopedTimer(const ScopedTimer &other) = delete;
+    ScopedTimer& operator=(const ScopedTimer &other) = delete;
+
+  private:
+
+    //! Name of the timed operation
+    const char* m_name;
+
+    //! Start of the operation in microseconds since epoch
+    uint64_t m_t_start;
+
+    //! Zone of the profiler covering the timed operation
+    ProfilingZone m_zone;
+};
+
+} // namespace realm
+
+#endif //PROJECT_SCOPED_TIMER_H
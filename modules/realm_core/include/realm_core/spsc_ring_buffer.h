@@ -0,0 +1,200 @@
+
+
+#ifndef PROJECT_SPSC_RING_BUFFER_H
+#define PROJECT_SPSC_RING_BUFFER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <stdexcept>
+
+namespace realm
+{
+
+/*!
+ * @brief Bounded lock-free ring buffer for exactly one producer and one consumer thread, e.g. the communication thread
+ * adding frames and the processing thread of a stage. If the buffer is full, the producer drops the oldest element, so
+ * pushing never waits for the consumer. Producer and consumer both claim elements at the read position through a
+ * compare and swap, therefore every element is either popped or dropped exactly once.
+ */
+template <typename T>
+class SpscRingBuffer
+{
+  public:
+    using Ptr = std::shared_ptr<SpscRingBuffer<T>>;
+    using ConstPtr = std::shared_ptr<const SpscRingBuffer<T>>;
+
+  public:
+    /*!
+     * @brief Constructor
+     * @param capacity Maximum number of elements in the buffer, must be greater zero
+     */
+    explicit SpscRingBuffer(size_t capacity)
+        : m_capacity(capacity),
+          m_slots(capacity + 1),
+          m_read_idx(0),
+          m_write_idx(0)
+    {
+      if (m_capacity == 0)
+        throw(std::invalid_argument("Error: Capacity of ring buffer must be greater zero!"));
+      for (auto &slot : m_slots)
+      {
+        slot.priority = 0.0;
+        slot.is_full.store(false, std::memory_order_relaxed);
+      }
+    }
+
+    SpscRingBuffer(const SpscRingBuffer &) = delete;
+    SpscRingBuffer& operator=(const SpscRingBuffer &) = delete;
+
+    /*!
+     * @brief Adds an element to the end of the buffer. May only be called by the producer thread. If the buffer is full,
+     * the priority of the new element is compared to the oldest element. The one with the lower priority is dropped,
+     * with equal priorities it is the oldest. Therefore all elements having the same priority results in a plain
+     * drop-oldest buffer.
+     * @param value Element to be added
+     * @param priority Priority of the element when the buffer is full, higher values are kept
+     * @return false if the buffer was full and either the oldest or the new element was dropped, true otherwise
+     */
+    bool push(const T &value, double priority = 0.0)
+    {
+      uint64_t write_idx = m_write_idx.load(std::memory_order_relaxed);
+
+      // Priorities are only accessed by the producer, so comparing against the oldest element needs no claim. If the
+      // consumer takes it in the meantime, the new element is dropped although there would be space.
+      uint64_t read_idx = m_read_idx.load(std::memory_order_acquire);
+      if (write_idx - read_idx >= m_capacity && priority < m_slots[read_idx % m_slots.size()].priority)
+        return false;
+
+      // There is one more slot than elements, so the new element is written before the oldest one is dropped and the
+      // buffer never appears empty to the consumer in between. The slot might still be read by the consumer, which
+      // claimed it right before. This only takes until the element is moved out.
+      Slot &slot = m_slots[write_idx % m_slots.size()];
+      while (slot.is_full.load(std::memory_order_acquire))
+        std::this_thread::yield();
+
+      slot.value = value;
+      slot.priority = priority;
+      slot.is_full.store(true, std::memory_order_release);
+      m_write_idx.store(write_idx + 1, std::memory_order_release);
+
+      // Buffer overfull: Claim the oldest element. If the consumer claims it first, there is space again anyway
+      read_idx = m_read_idx.load(std::memory_order_acquire);
+      if (write_idx + 1 - read_idx > m_capacity
+          && m_read_idx.compare_exchange_strong(read_idx, read_idx + 1, std::memory_order_acq_rel))
+      {
+        T dropped;
+        take(read_idx, dropped);
+        return false;
+      }
+      return true;
+    }
+
+    /*!
+     * @brief Takes the oldest element out of the buffer. May only be called by the consumer thread.
+     * @param value Output; Oldest element, only set if buffer was not empty
+     * @return true if an element was taken, false if the buffer was empty
+     */
+    bool pop(T &value)
+    {
+      uint64_t read_idx = m_read_idx.load(std::memory_order_acquire);
+      while (read_idx != m_write_idx.load(std::memory_order_acquire))
+      {
+        // On failure the read index was moved by a drop of the producer and is reloaded
+        if (m_read_idx.compare_exchange_weak(read_idx, read_idx + 1, std::memory_order_acq_rel))
+        {
+          take(read_idx, value);
+          return true;
+        }
+      }
+      return false;
+    }
+
+    /*!
+     * @brief Removes all elements. May only be called by the consumer thread.
+     */
+    void clear()
+    {
+      T value;
+      while (pop(value)) {}
+    }
+
+    /*!
+     * @brief Checks if the buffer is empty. Exact if called by the consumer thread, a snapshot otherwise.
+     * @return true if no element is in the buffer
+     */
+    bool empty() const
+    {
+      return size() == 0;
+    }
+
+    /*!
+     * @brief Number of elements in the buffer. Exact if called by the consumer thread, a snapshot otherwise.
+     * @return Number of elements
+     */
+    size_t size() const
+    {
+      uint64_t read_idx = m_read_idx.load(std::memory_order_acquire);
+      uint64_t write_idx = m_write_idx.load(std::memory_order_acquire);
+      // Might be one above capacity for the moment a new element was added and the oldest was not dropped yet
+      size_t size = static_cast<size_t>(write_idx > read_idx ? write_idx - read_idx : 0);
+      return std::min(size, m_capacity);
+    }
+
+    /*!
+     * @brief Getter for the maximum number of elements
+     * @return Capacity of the buffer
+     */
+    size_t capacity() const
+    {
+      return m_capacity;
+    }
+
+  private:
+
+    //! Storage of one element. The flag is set after the element was written and reset after it was moved out. The
+    //! priority is only written and read by the producer
+    struct Slot
+    {
+      T value;
+      double priority;
+      std::atomic<bool> is_full;
+    };
+
+    //! Maximum number of elements
+    size_t m_capacity;
+
+    //! Storage of all elements with one spare slot
+    std::vector<Slot> m_slots;
+
+    //! Index of the oldest element, is increased by the consumer on pop and by the producer on a drop
+    std::atomic<uint64_t> m_read_idx;
+
+    //! Index of the next element to be written, only increased by the producer
+    std::atomic<uint64_t> m_write_idx;
+
+    /*!
+     * @brief Moves an element out of the slot of a claimed index and releases the slot for the producer
+     * @param idx Claimed index
+     * @param value Output; Element of the slot
+     */
+    void take(uint64_t idx, T &value)
+    {
+      Slot &slot = m_slots[idx % m_slots.size()];
+
+      // Elements are written before the write index is increased, so the slot is expected to be full already
+      while (!slot.is_full.load(std::memory_order_acquire))
+        std::this_thread::yield();
+
+      value = std::move(slot.value);
+      slot.value = T();
+      slot.is_full.store(false, std::memory_order_release);
+    }
+};
+
+} // namespace realm
+
+#endif //PROJECT_SPSC_RING_BUFFER_H
@@ -8,6 +8,8 @@
 #include <realm_core/frame.h>
 #include <realm_core/camera.h>
 #include <realm_core/depthmap.h>
+#include <realm_core/point_cloud.h>
+#include <realm_core/thread_pool.h>
 
 namespace realm
 {
@@ -31,24 +33,88 @@ void remap(const Frame::Ptr &frame,
  * @brief Function for computation of world points from depth map. Depth must be normalised to min/max depth.
  * @param cam Camera model, e.g. pinhole for projection of points. Must contain R, t and K
  * @param depthmap Depth map computed with a stereo reconstruction framework of choice, normalised to min/max depth
+ * @param thread_pool Shared thread pool to reproject bands of rows on, can be nullptr
+ * @param nrof_threads Number of threads, <= 0 uses all available, 1 runs serially in the calling thread
  * @return 3-channel double precision matrix (CV_64FC3) with world point coordinates at each element
  */
-cv::Mat reprojectDepthMap(const camera::Pinhole::ConstPtr &cam, const cv::Mat &depthmap);
+cv::Mat reprojectDepthMap(const camera::Pinhole::ConstPtr &cam,
+                          const cv::Mat &depthmap,
+                          const ThreadPool::Ptr &thread_pool = nullptr,
+                          int nrof_threads = 1);
 
 /*!
- * @brief Function for computation of depth and depth map from pointcloud and camera model
+ * @brief Function for computation of world points from depth map in single precision, which halves the memory of
+ * dense clouds. World coordinates are usually UTM, which float can not resolve, so points are relative to an origin,
+ * e.g. the camera position or the reference of the pipeline.
+ * @param cam Camera model, e.g. pinhole for projection of points. Must contain R, t and K
+ * @param depthmap Depth map computed with a stereo reconstruction framework of choice, normalised to min/max depth
+ * @param origin Origin in the world frame the points are relative to
+ * @param thread_pool Shared thread pool to reproject bands of rows on, can be nullptr
+ * @param nrof_threads Number of threads, <= 0 uses all available, 1 runs serially in the calling thread
+ * @return 3-channel single precision matrix (CV_32FC3) with world point coordinates minus origin at each element
+ */
+cv::Mat reprojectDepthMapFloat(const camera::Pinhole::ConstPtr &cam,
+                               const cv::Mat &depthmap,
+                               const cv::Point3d &origin,
+                               const ThreadPool::Ptr &thread_pool = nullptr,
+                               int nrof_threads = 1);
+
+/*!
+ * @brief Function for computation of depth and depth map from pointcloud and camera model. If several points project
+ * into the same cell, the nearest one is kept.
  * @param cam Camera model, e.g. pinhole for projection of points. Must contain R, t and K
  * @param points Point cloud structured es mat rowise x, y, z coordinates
- * @return depth map
+ * @param thread_pool Shared thread pool to splat the points on, can be nullptr
+ * @param nrof_threads Number of threads, <= 0 uses all available, 1 runs serially in the calling thread
+ * @return depth map, cells without observation are -1
+ */
+cv::Mat computeDepthMapFromPointCloud(const camera::Pinhole::ConstPtr &cam,
+                                      const cv::Mat &points,
+                                      const ThreadPool::Ptr &thread_pool = nullptr,
+                                      int nrof_threads = 1);
+
+/*!
+ * @brief Function for computation of a depth map from a typed point cloud. Positions are read in place, otherwise
+ * identical to the matrix version.
+ * @param cam Camera model, e.g. pinhole for projection of points. Must contain R, t and K
+ * @param points Point cloud, only the positions are used
+ * @param thread_pool Shared thread pool to splat the points on, can be nullptr
+ * @param nrof_threads Number of threads, <= 0 uses all available, 1 runs serially in the calling thread
+ * @return depth map, cells without observation are -1
+ */
+cv::Mat computeDepthMapFromPointCloud(const camera::Pinhole::ConstPtr &cam,
+                                      const PointCloud &points,
+                                      const ThreadPool::Ptr &thread_pool = nullptr,
+                                      int nrof_threads = 1);
+
+/*!
+ * @brief Function for computation of a depth map from the depth map of another camera, e.g. to compare neighbouring
+ * reconstructions. Points are reprojected on the fly, so no dense cloud is created. Cells of the source without depth
+ * are skipped. Otherwise identical to the point cloud version.
+ * @param cam Camera model the depth map is computed for. Must contain R, t and K
+ * @param cam_src Camera model of the source depth map
+ * @param depth_src Source depth map (CV_32F)
+ * @param thread_pool Shared thread pool to splat the points on, can be nullptr
+ * @param nrof_threads Number of threads, <= 0 uses all available, 1 runs serially in the calling thread
+ * @return depth map, cells without observation are -1
  */
-cv::Mat computeDepthMapFromPointCloud(const camera::Pinhole::ConstPtr &cam, const cv::Mat &points);
+cv::Mat computeDepthMapFromDepthMap(const camera::Pinhole::ConstPtr &cam,
+                                    const camera::Pinhole::ConstPtr &cam_src,
+                                    const cv::Mat &depth_src,
+                                    const ThreadPool::Ptr &thread_pool = nullptr,
+                                    int nrof_threads = 1);
 
 /*!
- * @brief Function for computation of normals from an input depth map
+ * @brief Function for computation of normals from an input depth map with central differences. The outermost rows and
+ * columns are copied from their inner neighbours.
  * @param depth Input depth map
+ * @param thread_pool Shared thread pool to compute the rows on, can be nullptr
+ * @param nrof_threads Number of threads, <= 0 uses all available, 1 runs serially in the calling thread
  * @return Normal map with type CV_32FC3
  */
-cv::Mat computeNormalsFromDepthMap(const cv::Mat& depth);
+cv::Mat computeNormalsFromDepthMap(const cv::Mat& depth,
+                                   const ThreadPool::Ptr &thread_pool = nullptr,
+                                   int nrof_threads = 1);
 
 /*!
  * @brief Computes the baseline between two camera poses using simple euclidean distance
@@ -7,6 +7,7 @@
 #include <vector>
 #include <memory>
 #include <cmath>
+#include <string>
 
 #include <opencv2/core/core.hpp>
 
@@ -38,6 +39,19 @@ struct Parameter_t
     std::string help;
 };
 
+/*!
+ * @brief Timestamps of a frame passing through one stage of the pipeline in nanoseconds since epoch. Events the frame
+ * did not reach inside the stage are 0.
+ */
+struct StageTrace
+{
+  std::string stage;
+  uint64_t t_enqueued;
+  uint64_t t_dequeued;
+  uint64_t t_process_start;
+  uint64_t t_process_end;
+};
+
 /*!
  * @brief Basic struct for a face of a mesh
  */
@@ -47,6 +61,19 @@ struct Face
   cv::Vec4b color[3];
 };
 
+/*!
+ * @brief Part of a mesh, that covers one tile of a regular grid in world coordinates. Meshes are updated tile by tile,
+ * so receivers only keep the latest faces of every tile index and replace them with each update. A tile without faces
+ * has no valid data anymore.
+ */
+struct MeshTile
+{
+  int x;
+  int y;
+  cv::Rect2d roi;
+  std::vector<Face> faces;
+};
+
 }
 
 #endif //PROJECT_STRUCTS_H
@@ -0,0 +1,135 @@
+
+
+#ifndef PROJECT_THREAD_POOL_H
+#define PROJECT_THREAD_POOL_H
+
+#include <atomic>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+#include <opencv2/core.hpp>
+
+namespace realm
+{
+
+/*!
+ * @brief Work-stealing thread pool, which is meant to be created once per pipeline and shared by all stages. Stages
+ * keep their own worker thread for the sequential processing of frames, but submit their data-parallel sub-tasks
+ * (e.g. rows of the rectification or cells of the surface model) to the pool. Every pool thread owns a task queue.
+ * Tasks submitted from inside the pool are pushed to the queue of the submitting thread, all others are distributed
+ * round robin. Idle threads steal tasks from the back of the other queues.
+ */
+class ThreadPool
+{
+  public:
+    using Ptr = std::shared_ptr<ThreadPool>;
+    using ConstPtr = std::shared_ptr<const ThreadPool>;
+
+    using Task = std::function<void()>;
+
+  public:
+    /*!
+     * @brief Constructor that directly starts all threads of the pool
+     * @param nrof_threads Number of threads in the pool, <= 0 uses all available cores
+     */
+    explicit ThreadPool(int nrof_threads = 0);
+
+    /*!
+     * @brief Destructor finishes all queued tasks and joins the threads
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool& operator=(const ThreadPool &) = delete;
+
+    /*!
+     * @brief Submits a single task to the pool
+     * @param task Task to be executed
+     * @return Future to wait for the task to finish. Exceptions thrown by the task are rethrown on get()
+     */
+    std::future<void> submit(const Task &task);
+
+    /*!
+     * @brief Data-parallel loop with the same semantics as cv::parallel_for_. The range is split into stripes, which are
+     * processed by the pool and the calling thread. Returns after all stripes are finished. Can be called from inside
+     * a pool task as well, because the caller never blocks on stripes that were not started yet.
+     * @param range Range of the loop, e.g. rows of the grid
+     * @param body Loop body, is called with disjoint sub ranges
+     * @param nstripes Number of stripes the range is split into, <= 0 uses four stripes per thread
+     */
+    void parallelFor(const cv::Range &range, const std::function<void(const cv::Range&)> &body, int nstripes = -1);
+
+    /*!
+     * @brief Getter for the number of threads in the pool
+     * @return Number of threads
+     */
+    int getNrofThreads() const;
+
+  private:
+
+    //! Task queue owned by one thread of the pool
+    struct WorkQueue
+    {
+      std::deque<Task> tasks;
+      std::mutex mutex;
+    };
+
+    //! Flag to signal all threads to finish
+    bool m_stop_requested;
+
+    //! Number of tasks waiting in all queues
+    size_t m_nrof_tasks_queued;
+
+    //! Index of the queue the next task from outside the pool is pushed to
+    std::atomic<size_t> m_next_queue;
+
+    std::vector<std::unique_ptr<WorkQueue>> m_queues;
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex_wakeup;
+    std::condition_variable m_condition_wakeup;
+
+    /*!
+     * @brief Loop of every pool thread. Processes tasks of its own queue first and steals tasks from other queues if
+     * its own queue is empty.
+     * @param idx Index of the thread and therefore its queue
+     */
+    void run(size_t idx);
+
+    /*!
+     * @brief Takes the next task out of the queues, first from the own queue, then from all others
+     * @param idx Index of the own queue
+     * @param task Output; Task to be executed
+     * @return true if a task was found
+     */
+    bool tryPop(size_t idx, Task &task);
+
+    /*!
+     * @brief Pushes a task to a queue and wakes up one thread
+     * @param task Task to be queued
+     */
+    void push(const Task &task);
+};
+
+/*!
+ * @brief Runs a data-parallel loop with the threading policy used throughout the pipeline: Serially if only one thread
+ * is requested, on the shared thread pool if one was provided and with cv::parallel_for_ otherwise.
+ * @param thread_pool Shared thread pool, can be nullptr
+ * @param range Range of the loop
+ * @param body Loop body, is called with disjoint sub ranges
+ * @param nrof_threads Number of threads, <= 0 uses all available, 1 runs serially in the calling thread
+ */
+void parallelFor(const ThreadPool::Ptr &thread_pool,
+                 const cv::Range &range,
+                 const std::function<void(const cv::Range&)> &body,
+                 int nrof_threads);
+
+} // namespace realm
+
+#endif //PROJECT_THREAD_POOL_H
@@ -0,0 +1,61 @@
+
+
+#ifndef PROJECT_THREAD_SCHEDULING_H
+#define PROJECT_THREAD_SCHEDULING_H
+
+#include <string>
+#include <vector>
+
+namespace realm
+{
+
+/*!
+ * @brief Scheduling of a thread by the operating system, e.g. to give latency critical threads like the tracking
+ * dedicated cores and confine threads doing bulk I/O to the others. Default values keep the scheduling the thread
+ * inherited from the process.
+ */
+struct ThreadScheduling
+{
+  //! Cores the thread may run on, empty to allow all cores
+  std::vector<int> cpus;
+
+  //! Nice value in range [-20, 19] of the default policy, lower values get more processing time. Negative values
+  //! require elevated privileges.
+  int nice = 0;
+
+  //! Priority in range [1, 99] of the real time policy SCHED_FIFO, 0 keeps the default policy. Requires elevated
+  //! privileges. The nice value is ignored, if set.
+  int realtime_priority = 0;
+
+  /*!
+   * @brief Checks if anything differs from the scheduling inherited from the process
+   * @return True if the scheduling has to be applied
+   */
+  bool isSet() const;
+
+  /*!
+   * @brief Converts the scheduling to a text for the log, e.g. "cpus=2,3 nice=0 realtime_priority=50"
+   * @return Description of the scheduling
+   */
+  std::string toString() const;
+};
+
+/*!
+ * @brief Parses a list of cores, e.g. "0,2" or "2-5". Ranges and single cores can be mixed, e.g. "0,2-3"
+ * @param list Comma separated cores or ranges of cores, empty for all cores
+ * @return Cores in the order of the list
+ */
+std::vector<int> parseCpuList(const std::string &list);
+
+/*!
+ * @brief Applies the scheduling to the calling thread. Only supported on Linux, elsewhere and if the privileges are
+ * missing the scheduling stays unchanged and a warning is logged, as a pipeline should still run when misconfigured.
+ * @param scheduling Scheduling to be applied
+ * @param thread_name Name of the thread for the log
+ * @return True if every part of the scheduling was applied
+ */
+bool applyToCurrentThread(const ThreadScheduling &scheduling, const std::string &thread_name);
+
+} // namespace realm
+
+#endif //PROJECT_THREAD_SCHEDULING_H
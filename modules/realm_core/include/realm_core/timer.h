@@ -3,12 +3,11 @@
 #ifndef OPENREALM_TIMER_H
 #define OPENREALM_TIMER_H
 
-#include <thread>
 #include <chrono>
 #include <functional>
-#include <atomic>
-#include <mutex>
-#include <condition_variable>
+#include <memory>
+
+#include <realm_core/timer_scheduler.h>
 
 namespace realm {
 
@@ -19,20 +18,18 @@ namespace realm {
         using ConstPtr = std::shared_ptr<const Timer>;
 
     public:
+        /**
+         * Periodically calls a function, starting one period after construction. All timers share the thread of the
+         * TimerScheduler, so the function should return quickly.
+         * @param period Time between two calls
+         * @param func Function to be called
+         */
         explicit Timer(const std::chrono::milliseconds &period, const std::function<void()> &func);
-        ~Timer();
-
 
         /**
-         * Waitfor that allows the timer to be interrupted for quicker shutdowns
-         * @param duration The sleep time between updates
-         * @return True if we need to abort
+         * Stops the timer, blocks while the function is currently called
          */
-        template<class Duration>
-        bool interruptable_wait_for(Duration duration) {
-            std::unique_lock<std::mutex> l(m_stop_mtx);
-            return !m_cond.wait_for(l, duration, [this]() { return !m_in_flight; });
-        }
+        ~Timer();
 
         static long getCurrentTimeSeconds();
         static long getCurrentTimeMilliseconds();
@@ -40,13 +37,7 @@ namespace realm {
         static long getCurrentTimeNanoseconds();
 
     private:
-        std::chrono::milliseconds m_period;
-        std::function<void()> m_func;
-        std::atomic<bool> m_in_flight;
-        std::thread m_thread;
-
-        std::condition_variable m_cond;
-        std::mutex m_stop_mtx;
+        TimerScheduler::TaskId m_task_id;
     };
 
 } // namespace realm
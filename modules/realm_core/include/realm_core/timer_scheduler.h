@@ -0,0 +1,118 @@
+
+
+#ifndef PROJECT_TIMER_SCHEDULER_H
+#define PROJECT_TIMER_SCHEDULER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace realm
+{
+
+/*!
+ * @brief Process wide scheduler running the periodic callbacks of all timers on one thread, so a pipeline with many
+ * stages does not keep one mostly sleeping thread per timer. Due callbacks are kept in a min-heap ordered by their next
+ * execution time, the thread sleeps until the earliest one is due. Callbacks share the thread, so they must be short,
+ * e.g. evaluating statistics. Longer work should be handed to a worker. Callbacks that fall behind are rescheduled
+ * from the current time instead of catching up with several executions in a row.
+ */
+class TimerScheduler
+{
+  public:
+    //! Identifier of a periodic task, never reused during the lifetime of the process
+    using TaskId = uint64_t;
+
+  public:
+    /*!
+     * @brief Getter for the process wide instance, the thread is started on first access
+     * @return Scheduler shared by all timers
+     */
+    static TimerScheduler& instance();
+
+    TimerScheduler(const TimerScheduler &) = delete;
+    TimerScheduler& operator=(const TimerScheduler &) = delete;
+
+    /*!
+     * @brief Adds a periodic task. It is executed for the first time one period after it was added.
+     * @param period Time between two executions
+     * @param func Callback of the task
+     * @return Identifier of the task to remove it
+     */
+    TaskId add(const std::chrono::milliseconds &period, const std::function<void()> &func);
+
+    /*!
+     * @brief Removes a periodic task. If its callback is currently executed, blocks until it returned, so the callback
+     * does not access its owner after the owner was destroyed. Calling it from within the callback does not block.
+     * @param id Identifier of the task, unknown identifiers are ignored
+     */
+    void remove(TaskId id);
+
+    /*!
+     * @brief Getter for the number of tasks currently scheduled
+     * @return Number of tasks
+     */
+    size_t getNrofTasks() const;
+
+  private:
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Task
+    {
+        std::chrono::milliseconds period;
+        std::function<void()> func;
+    };
+
+    struct Entry
+    {
+        Clock::time_point t_due;
+        TaskId id;
+
+        bool operator>(const Entry &other) const
+        {
+          return t_due > other.t_due;
+        }
+    };
+
+    //! Flag to signal the thread to finish
+    bool m_stop_requested;
+
+    TaskId m_id_next;
+
+    //! Task currently executed by the thread, 0 if none
+    TaskId m_id_running;
+
+    std::unordered_map<TaskId, Task> m_tasks;
+
+    //! Next execution of all tasks, the earliest on top. Entries of removed tasks are dropped once they are due.
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> m_queue;
+
+    mutable std::mutex m_mutex;
+
+    //! Signals the thread that tasks were added or it has to finish
+    std::condition_variable m_condition_tasks;
+
+    //! Signals remove() that a callback returned
+    std::condition_variable m_condition_finished;
+
+    std::thread m_thread;
+
+    TimerScheduler();
+    ~TimerScheduler();
+
+    /*!
+     * @brief Loop of the scheduler thread
+     */
+    void run();
+};
+
+} // namespace realm
+
+#endif //PROJECT_TIMER_SCHEDULER_H
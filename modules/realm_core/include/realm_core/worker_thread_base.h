@@ -10,6 +10,9 @@
 #include <condition_variable>
 #include <functional>
 
+#include <realm_core/latency_histogram.h>
+#include <realm_core/thread_scheduling.h>
+
 namespace realm
 {
 
@@ -81,6 +84,22 @@ class WorkerThreadBase
      */
     void notify();
 
+    /*!
+     * @brief Switches the thread to a purely event-driven mode, which should be done before start() is called. Instead
+     * of waking up after the sleep time, the processing thread then waits until notify() is called and the data ready
+     * condition holds, or stop, resume, reset or finish are requested. Therefore derived classes have to register a
+     * data ready condition and call notify() for every new data.
+     * @param is_event_driven true to wait for events only, false to wake up after the sleep time as well
+     */
+    void setEventDriven(bool is_event_driven);
+
+    /*!
+     * @brief Sets the cpu affinity and priority of the processing thread, which should be done before start() is called.
+     * The thread applies it itself once it starts, failures are logged but do not stop the thread.
+     * @param scheduling Scheduling of the processing thread
+     */
+    void setThreadScheduling(const ThreadScheduling &scheduling);
+
   protected:
 
     /*!
@@ -102,6 +121,7 @@ class WorkerThreadBase
      * @brief Stores max/min/avg time to process a task
      */
     Statistics m_process_statistics{};
+    LatencyHistogram m_process_histogram;
     std::mutex m_mutex_statistics{};
 
     std::mutex m_mutex_processing;
@@ -132,6 +152,11 @@ class WorkerThreadBase
      */
     Statistics getProcessingStatistics();
 
+    /*!
+     * @return Returns the histogram of the time the processing step is taking for percentiles
+     */
+    LatencyHistogram getProcessingHistogram();
+
     /*!
      * @brief Name of the thread. Will be used to output current state
      */
@@ -165,6 +190,16 @@ class WorkerThreadBase
     bool m_is_stopped;
     std::mutex m_mutex_is_stopped;
 
+    /*!
+     * @brief Thread management: set true, if the processing thread only wakes up on events and not after sleep time.
+     */
+    bool m_is_event_driven;
+
+    /*!
+     * @brief Scheduling the processing thread applies when it starts
+     */
+    ThreadScheduling m_thread_scheduling;
+
     /*!
      * @brief virtual function for the derived stage to be implemented. Has to reset all neccessary data to allow a
      * fresh new start of the stage.
@@ -202,6 +237,13 @@ class WorkerThreadBase
      */
     bool isStopped();
 
+  private:
+
+    /*!
+     * @brief Calls the reset() of the derived class and clears the reset request afterwards
+     */
+    void executeReset();
+
 };
 
 } // namespace realm
@@ -32,6 +32,27 @@ cv::Mat analysis::convertToColorMapFromCVC1(const cv::Mat &img, const cv::Mat &m
   return map_colored;
 }
 
+cv::Mat analysis::convertToColorMapFromCVC1(const cv::Mat &img, const cv::Mat &mask, double range_min, double range_max, cv::ColormapTypes flag)
+{
+  assert(img.type() == CV_32FC1 || img.type() == CV_64FC1 || img.type() == CV_16UC1);
+
+  double span = range_max - range_min;
+  double scale = (span > 0.0 ? 255.0 / span : 0.0);
+
+  // Conversion saturates, so values outside of the range are clamped
+  cv::Mat map_norm;
+  img.convertTo(map_norm, CV_8UC1, scale, -range_min * scale);
+
+  cv::Mat map_colored;
+  cv::applyColorMap(map_norm, map_colored, flag);
+
+  // Set invalid pixels black
+  if (!mask.empty())
+    map_colored.setTo(cv::Scalar::all(0), mask == 0);
+
+  return map_colored;
+}
+
 cv::Mat analysis::convertToColorMapFromCVC3(const cv::Mat &img, const cv::Mat &mask)
 {
   assert(img.type() == CV_32FC3 || img.type() == CV_64FC3 || img.type() == CV_16UC3);
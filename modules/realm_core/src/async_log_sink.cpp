@@ -0,0 +1,120 @@
+
+
+#include <chrono>
+
+#include <realm_core/async_log_sink.h>
+
+using namespace realm;
+
+AsyncLogSink::AsyncLogSink(const std::string &filepath, loguru::Verbosity verbosity, size_t capacity)
+ : m_filepath(filepath),
+   m_file(nullptr),
+   m_queue(capacity),
+   m_nrof_pushed(0),
+   m_nrof_written(0),
+   m_nrof_dropped(0),
+   m_nrof_dropped_reported(0),
+   m_is_finish_requested(false)
+{
+  m_file = fopen(m_filepath.c_str(), "a");
+  if (m_file == nullptr)
+    throw(std::invalid_argument("Error creating log sink: File '" + m_filepath + "' could not be opened!"));
+
+  m_thread = std::thread(&AsyncLogSink::run, this);
+
+  loguru::add_callback(m_filepath.c_str(), &AsyncLogSink::logCallback, this, verbosity, nullptr, &AsyncLogSink::flushCallback);
+}
+
+AsyncLogSink::~AsyncLogSink()
+{
+  // After removal no message is pushed anymore, so the writer can drain the queue and finish
+  loguru::remove_callback(m_filepath.c_str());
+
+  m_is_finish_requested = true;
+  m_condition_wakeup.notify_one();
+  m_thread.join();
+
+  fclose(m_file);
+}
+
+void AsyncLogSink::flush()
+{
+  uint64_t nrof_pushed = m_nrof_pushed;
+  while (m_nrof_written + m_nrof_dropped < nrof_pushed)
+  {
+    m_condition_wakeup.notify_one();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+uint64_t AsyncLogSink::getNrofWritten() const
+{
+  return m_nrof_written;
+}
+
+uint64_t AsyncLogSink::getNrofDropped() const
+{
+  return m_nrof_dropped;
+}
+
+void AsyncLogSink::run()
+{
+  loguru::set_thread_name("log writer");
+
+  while (true)
+  {
+    // Queue is checked after the finish flag, so messages pushed before the finish request are never lost
+    bool is_finish_requested = m_is_finish_requested;
+    if (writeQueued())
+      fflush(m_file);
+    else if (is_finish_requested)
+      break;
+    else
+    {
+      // Wakeups arrive without the mutex held and may be missed, the timeout bounds the delay of a message
+      std::unique_lock<std::mutex> lock(m_mutex_wakeup);
+      m_condition_wakeup.wait_for(lock, std::chrono::milliseconds(50));
+    }
+  }
+}
+
+bool AsyncLogSink::writeQueued()
+{
+  bool has_written = false;
+
+  std::string line;
+  while (m_queue.pop(line))
+  {
+    uint64_t nrof_dropped = m_nrof_dropped;
+    if (nrof_dropped > m_nrof_dropped_reported)
+    {
+      fprintf(m_file, "[log sink] %lu messages dropped, writing could not keep up\n", nrof_dropped - m_nrof_dropped_reported);
+      m_nrof_dropped_reported = nrof_dropped;
+    }
+
+    fwrite(line.data(), 1, line.size(), m_file);
+    m_nrof_written++;
+    has_written = true;
+  }
+  return has_written;
+}
+
+void AsyncLogSink::logCallback(void* user_data, const loguru::Message &message)
+{
+  auto sink = static_cast<AsyncLogSink*>(user_data);
+
+  // Same format as the file sinks of loguru
+  std::string line;
+  line.reserve(256);
+  line.append(message.preamble).append(message.indentation).append(message.prefix).append(message.message).append("\n");
+
+  sink->m_nrof_pushed++;
+  if (!sink->m_queue.push(line))
+    sink->m_nrof_dropped++;
+  sink->m_condition_wakeup.notify_one();
+}
+
+void AsyncLogSink::flushCallback(void* user_data)
+{
+  static_cast<AsyncLogSink*>(user_data)->m_condition_wakeup.notify_one();
+}
@@ -1,6 +1,11 @@
 
 
 #include <cassert>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <vector>
 
 #include <opencv2/imgproc/imgproc.hpp>
 
@@ -36,6 +41,7 @@ Pinhole::Pinhole(double fx,
   m_K.at<double>(2, 0) = 0;
   m_K.at<double>(2, 1) = 0;
   m_K.at<double>(2, 2) = 1.0;
+  updateImageBounds();
 }
 
 Pinhole::Pinhole(const cv::Mat &K,
@@ -46,6 +52,7 @@ Pinhole::Pinhole(const cv::Mat &K,
       m_width(img_width),
       m_height(img_height)
 {
+  updateImageBounds();
 }
 
 Pinhole::Pinhole(const cv::Mat &K,
@@ -66,13 +73,13 @@ Pinhole::Pinhole(const Pinhole &that)
   m_t(that.m_t.clone()),
   m_K(that.m_K.clone()),
   m_width(that.m_width),
-  m_height(that.m_height)
+  m_height(that.m_height),
+  m_img_bounds(that.m_img_bounds)
 {
   if (m_do_undistort)
   {
     m_dist_coeffs = that.m_dist_coeffs.clone();
-    m_undistortion_map1 = that.m_undistortion_map1.clone();
-    m_undistortion_map2 = that.m_undistortion_map2.clone();
+    m_undistortion_maps = that.m_undistortion_maps;
   }
 }
 
@@ -86,11 +93,11 @@ Pinhole& Pinhole::operator=(const Pinhole &that)
     m_K = that.m_K.clone();
     m_width = that.m_width;
     m_height = that.m_height;
+    m_img_bounds = that.m_img_bounds;
 
     if (m_do_undistort) {
       m_dist_coeffs = that.m_dist_coeffs.clone();
-      m_undistortion_map1 = that.m_undistortion_map1.clone();
-      m_undistortion_map2 = that.m_undistortion_map2.clone();
+      m_undistortion_maps = that.m_undistortion_maps;
     }
   }
   return *this;
@@ -261,15 +268,50 @@ void Pinhole::setDistortionMap(const cv::Mat &dist_coeffs)
 {
   assert(!dist_coeffs.empty() && dist_coeffs.type() == CV_64F);
   m_dist_coeffs = dist_coeffs;
-  cv::initUndistortRectifyMap(m_K,
-                              m_dist_coeffs,
-                              cv::Mat_<double>::eye(3, 3),
-                              m_K,
-                              cv::Size(m_width, m_height),
-                              CV_16SC2,
-                              m_undistortion_map1,
-                              m_undistortion_map2);
+  m_undistortion_maps = getUndistortionMaps(m_K, m_dist_coeffs, cv::Size(m_width, m_height));
   m_do_undistort = true;
+  updateImageBounds();
+}
+
+void Pinhole::updateImageBounds()
+{
+  cv::Mat img_bounds = computeImageBounds2D();
+  for (int i = 0; i < 4; ++i)
+    m_img_bounds[i] = cv::Vec2d(img_bounds.at<double>(i, 0), img_bounds.at<double>(i, 1));
+}
+
+std::shared_ptr<const Pinhole::UndistortionMaps> Pinhole::getUndistortionMaps(const cv::Mat &K, const cv::Mat &dist_coeffs, const cv::Size &size)
+{
+  // Maps are only weakly referenced, so they are released as soon as the last camera using them is destroyed
+  static std::mutex mutex;
+  static std::map<std::vector<double>, std::weak_ptr<const UndistortionMaps>> cache;
+
+  std::vector<double> key{K.at<double>(0, 0), K.at<double>(1, 1), K.at<double>(0, 2), K.at<double>(1, 2),
+                          K.at<double>(0, 1), (double)size.width, (double)size.height};
+  for (size_t i = 0; i < dist_coeffs.total(); ++i)
+    key.push_back(dist_coeffs.at<double>(i));
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = cache.find(key);
+  if (it != cache.end())
+  {
+    if (std::shared_ptr<const UndistortionMaps> maps = it->second.lock())
+      return maps;
+  }
+
+  auto maps = std::make_shared<UndistortionMaps>();
+  cv::initUndistortRectifyMap(K, dist_coeffs, cv::Mat_<double>::eye(3, 3), K, size, CV_16SC2, maps->map1, maps->map2);
+
+  // Drop the entries of intrinsics no camera is using anymore, e.g. old resize factors
+  for (auto it_expired = cache.begin(); it_expired != cache.end(); )
+  {
+    if (it_expired->second.expired())
+      it_expired = cache.erase(it_expired);
+    else
+      ++it_expired;
+  }
+  cache[key] = maps;
+  return maps;
 }
 
 void Pinhole::setPose(const cv::Mat &pose)
@@ -340,27 +382,27 @@ cv::Mat Pinhole::computeImageBounds2D() const
 
 cv::Mat Pinhole::projectImageBoundsToPlane(const cv::Mat &pt, const cv::Mat &n) const
 {
-  assert(!m_R.empty() && !m_t.empty() && !m_K.empty());
-  cv::Mat img_bounds = computeImageBounds2D();
-  cv::Mat plane_points;
-  for (uint i = 0; i < 4; i++)
-  {
-    cv::Mat u = (cv::Mat_<double>(3, 1) << img_bounds.at<double>(i, 0), img_bounds.at<double>(i, 1), 1.0);
-    double s = (pt - m_t).dot(n) / (m_R * m_K.inv() * u).dot(n);
-    cv::Mat p = m_R * (s * m_K.inv() * u) + m_t;
-    cv::Mat world_point = (cv::Mat_<double>(1, 3) << p.at<double>(0), p.at<double>(1), p.at<double>(2));
-    plane_points.push_back(world_point);
-  }
+  std::array<cv::Vec3d, 4> points;
+  projectImageBoundsToPlane(cv::Vec3d(pt.at<double>(0), pt.at<double>(1), pt.at<double>(2)),
+                            cv::Vec3d(n.at<double>(0), n.at<double>(1), n.at<double>(2)), points);
+  cv::Mat plane_points(4, 3, CV_64F);
+  for (int i = 0; i < 4; i++)
+    for (int j = 0; j < 3; j++)
+      plane_points.at<double>(i, j) = points[i][j];
   return plane_points;
 }
 
-cv::Mat Pinhole::undistort(const cv::Mat &src, int interpolation) const
+cv::Mat Pinhole::undistort(const cv::Mat &src, int interpolation, MatPool* mat_pool) const
 {
   // If undistortion is not neccessary, just return input img
   // Elsewise undistort img
   cv::Mat img_undistorted;
   if (m_do_undistort)
-    cv::remap(src, img_undistorted, m_undistortion_map1, m_undistortion_map2, interpolation);
+  {
+    if (mat_pool)
+      img_undistorted = mat_pool->create(src.size(), src.type());
+    cv::remap(src, img_undistorted, m_undistortion_maps->map1, m_undistortion_maps->map2, interpolation);
+  }
   else
     img_undistorted = src;
   return img_undistorted;
@@ -368,11 +410,18 @@ cv::Mat Pinhole::undistort(const cv::Mat &src, int interpolation) const
 
 cv::Rect2d Pinhole::projectImageBoundsToPlaneRoi(const cv::Mat &pt, const cv::Mat &n) const
 {
-  cv::Mat bounds_in_plane = projectImageBoundsToPlane(pt, n);
-  double roi_l, roi_r;
-  double roi_u, roi_d;
-  cv::minMaxLoc(bounds_in_plane.col(0), &roi_l, &roi_r);
-  cv::minMaxLoc(bounds_in_plane.col(1), &roi_d, &roi_u);
+  std::array<cv::Vec3d, 4> bounds_in_plane;
+  projectImageBoundsToPlane(cv::Vec3d(pt.at<double>(0), pt.at<double>(1), pt.at<double>(2)),
+                            cv::Vec3d(n.at<double>(0), n.at<double>(1), n.at<double>(2)), bounds_in_plane);
+  double roi_l = bounds_in_plane[0][0], roi_r = bounds_in_plane[0][0];
+  double roi_d = bounds_in_plane[0][1], roi_u = bounds_in_plane[0][1];
+  for (const auto &p : bounds_in_plane)
+  {
+    roi_l = std::min(roi_l, p[0]);
+    roi_r = std::max(roi_r, p[0]);
+    roi_d = std::min(roi_d, p[1]);
+    roi_u = std::max(roi_u, p[1]);
+  }
   return cv::Rect2d(roi_l, roi_d, roi_r-roi_l, roi_u-roi_d);
 }
 
@@ -388,6 +437,72 @@ cv::Mat Pinhole::projectPointToWorld(double x, double y, double depth) const
   return Tc2w()*point;
 }
 
+void Pinhole::computeImageBounds2D(std::array<cv::Vec2d, 4> &bounds) const
+{
+  bounds = m_img_bounds;
+}
+
+template <typename T>
+void Pinhole::projectImageBoundsToPlane(const cv::Vec<T, 3> &pt, const cv::Vec<T, 3> &n, std::array<cv::Vec<T, 3>, 4> &points) const
+{
+  assert(!m_R.empty() && !m_t.empty() && !m_K.empty());
+  const cv::Matx33d R(m_R.ptr<double>(0)[0], m_R.ptr<double>(0)[1], m_R.ptr<double>(0)[2],
+                      m_R.ptr<double>(1)[0], m_R.ptr<double>(1)[1], m_R.ptr<double>(1)[2],
+                      m_R.ptr<double>(2)[0], m_R.ptr<double>(2)[1], m_R.ptr<double>(2)[2]);
+  const cv::Vec3d t(m_t.at<double>(0), m_t.at<double>(1), m_t.at<double>(2));
+  const cv::Vec3d pt_d(pt[0], pt[1], pt[2]);
+  const cv::Vec3d n_d(n[0], n[1], n[2]);
+  const double fx = m_K.at<double>(0, 0), fy = m_K.at<double>(1, 1);
+  const double cx = m_K.at<double>(0, 2), cy = m_K.at<double>(1, 2);
+  const double skew = m_K.at<double>(0, 1);
+
+  // Ray of every corner is intersected with the plane, same as projectImageBoundsToPlane with K^-1 in closed form
+  double dist_plane = (pt_d - t).dot(n_d);
+  for (size_t i = 0; i < 4; ++i)
+  {
+    double y_n = (m_img_bounds[i][1] - cy) / fy;
+    double x_n = (m_img_bounds[i][0] - cx - skew * y_n) / fx;
+    cv::Vec3d ray = R * cv::Vec3d(x_n, y_n, 1.0);
+    cv::Vec3d p = ray * (dist_plane / ray.dot(n_d)) + t;
+    points[i] = cv::Vec<T, 3>(static_cast<T>(p[0]), static_cast<T>(p[1]), static_cast<T>(p[2]));
+  }
+}
+
+template <typename T>
+void Pinhole::projectPointsToWorld(const T* pixels, const T* depths, size_t n, T* points) const
+{
+  assert(!m_R.empty() && !m_t.empty() && !m_K.empty());
+  const double* R = m_R.ptr<double>(0);
+  const size_t step_R = m_R.step1();
+  const double r00 = R[0], r01 = R[1], r02 = R[2];
+  const double r10 = R[step_R], r11 = R[step_R + 1], r12 = R[step_R + 2];
+  const double r20 = R[2*step_R], r21 = R[2*step_R + 1], r22 = R[2*step_R + 2];
+  const double tx = m_t.at<double>(0), ty = m_t.at<double>(1), tz = m_t.at<double>(2);
+  const double fx_inv = 1.0 / m_K.at<double>(0, 0), fy_inv = 1.0 / m_K.at<double>(1, 1);
+  const double cx = m_K.at<double>(0, 2), cy = m_K.at<double>(1, 2);
+
+  for (size_t i = 0; i < n; ++i)
+  {
+    const double depth = depths[i];
+    T* p = points + 3*i;
+    if (!(depth > 0.0))
+    {
+      p[0] = p[1] = p[2] = std::numeric_limits<T>::quiet_NaN();
+      continue;
+    }
+    const double x = (static_cast<double>(pixels[2*i]) - cx) * depth * fx_inv;
+    const double y = (static_cast<double>(pixels[2*i + 1]) - cy) * depth * fy_inv;
+    p[0] = static_cast<T>(r00*x + r01*y + r02*depth + tx);
+    p[1] = static_cast<T>(r10*x + r11*y + r12*depth + ty);
+    p[2] = static_cast<T>(r20*x + r21*y + r22*depth + tz);
+  }
+}
+
+template void Pinhole::projectImageBoundsToPlane<float>(const cv::Vec3f &, const cv::Vec3f &, std::array<cv::Vec3f, 4> &) const;
+template void Pinhole::projectImageBoundsToPlane<double>(const cv::Vec3d &, const cv::Vec3d &, std::array<cv::Vec3d, 4> &) const;
+template void Pinhole::projectPointsToWorld<float>(const float*, const float*, size_t, float*) const;
+template void Pinhole::projectPointsToWorld<double>(const double*, const double*, size_t, double*) const;
+
 } // namespace camera
 
 } // namespace realm
\ No newline at end of file
@@ -0,0 +1,427 @@
+
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+
+#include <realm_core/chunked_grid_map.h>
+
+using namespace realm;
+
+ChunkedGridMap::ChunkedGridMap(double resolution, int chunk_size)
+    : m_resolution(resolution),
+      m_chunk_size(chunk_size),
+      m_revision(0)
+{
+  if (m_resolution < 10e-6)
+    throw(std::invalid_argument("Error: Resolution is zero!"));
+  if (m_chunk_size <= 0)
+    throw(std::invalid_argument("Error: Chunk size must be greater zero!"));
+}
+
+ChunkedGridMap::~ChunkedGridMap()
+{
+  for (const auto &spilled : m_chunks_spilled)
+    std::remove(createSpillFilename(spilled.first).c_str());
+}
+
+void ChunkedGridMap::add(const CvGridMap &submap, int flag_overlap_handle)
+{
+  if (fabs(m_resolution - submap.resolution()) > std::numeric_limits<double>::epsilon())
+    throw(std::invalid_argument("Error add submap: Resolution mismatch!"));
+
+  cv::Rect2i submap_bounds = computeGlobalIndices(submap);
+  cv::Rect2i chunk_range = computeChunkRange(submap_bounds);
+
+  std::lock_guard<std::mutex> lock_write(m_mutex_write);
+
+  // Layers and chunks are created under the exclusive lock first. The data is then written with only the chunk being
+  // written locked, so other regions can be extracted meanwhile.
+  std::vector<int> layer_indices;
+  std::vector<Chunk*> chunks;
+  {
+    std::unique_lock<std::shared_timed_mutex> lock(m_mutex_chunks);
+
+    for (const auto &layer_name : submap.getAllLayerNames())
+    {
+      int idx = findLayerIdx(layer_name);
+      if (idx < 0)
+      {
+        CvGridMap::Layer layer = submap.getLayer(layer_name);
+        m_layers.push_back(LayerInfo{layer.name, layer.data.type(), layer.interpolation});
+        idx = static_cast<int>(m_layers.size()) - 1;
+      }
+      layer_indices.push_back(idx);
+    }
+
+    m_revision++;
+    for (int chunk_row = chunk_range.y; chunk_row < chunk_range.y + chunk_range.height; ++chunk_row)
+      for (int chunk_col = chunk_range.x; chunk_col < chunk_range.x + chunk_range.width; ++chunk_col)
+      {
+        ChunkIdx chunk_idx(chunk_col, chunk_row);
+        Chunk &chunk = m_chunks[chunk_idx];
+
+        // Chunks spilled to disk are loaded again before being modified
+        auto it_spilled = m_chunks_spilled.find(chunk_idx);
+        if (it_spilled != m_chunks_spilled.end())
+        {
+          chunk.layers = readChunk(chunk_idx);
+          std::remove(createSpillFilename(chunk_idx).c_str());
+          m_chunks_spilled.erase(it_spilled);
+        }
+
+        if (chunk.layers.size() < m_layers.size())
+          chunk.layers.resize(m_layers.size());
+        for (int idx : layer_indices)
+          if (chunk.layers[idx].empty())
+            chunk.layers[idx] = createEmptyData(cv::Size2i(m_chunk_size, m_chunk_size), m_layers[idx].type);
+
+        chunk.revision = m_revision;
+        chunks.push_back(&chunk);
+      }
+
+    if (m_bounds.area() == 0)
+      m_bounds = submap_bounds;
+    else
+      m_bounds |= submap_bounds;
+  }
+
+  std::shared_lock<std::shared_timed_mutex> lock(m_mutex_chunks);
+  auto it_chunk = chunks.begin();
+  for (int chunk_row = chunk_range.y; chunk_row < chunk_range.y + chunk_range.height; ++chunk_row)
+    for (int chunk_col = chunk_range.x; chunk_col < chunk_range.x + chunk_range.width; ++chunk_col)
+    {
+      cv::Rect2i chunk_bounds(chunk_col*m_chunk_size, chunk_row*m_chunk_size, m_chunk_size, m_chunk_size);
+      cv::Rect2i overlap = (chunk_bounds & submap_bounds);
+
+      // Grid region of the overlap inside the chunk and inside the submap
+      cv::Rect2i dst_roi(overlap.x - chunk_bounds.x, overlap.y - chunk_bounds.y, overlap.width, overlap.height);
+      cv::Rect2i src_roi(overlap.x - submap_bounds.x, overlap.y - submap_bounds.y, overlap.width, overlap.height);
+
+      Chunk &chunk = **(it_chunk++);
+      std::lock_guard<std::mutex> lock_chunk(chunk.mutex);
+      for (int idx : layer_indices)
+      {
+        cv::Mat &chunk_data = chunk.layers[idx];
+        cv::Mat src_data_roi = submap[m_layers[idx].name](src_roi);
+        cv::Mat dst_data_roi = chunk_data(dst_roi);
+        CvGridMap::mergeMatrices(src_data_roi, dst_data_roi, flag_overlap_handle);
+        dst_data_roi.copyTo(chunk_data(dst_roi));
+      }
+    }
+}
+
+CvGridMap ChunkedGridMap::getSubmap(const std::vector<std::string> &layer_names, const cv::Rect2d &roi) const
+{
+  CvGridMap submap(roi, m_resolution);
+  cv::Rect2i submap_bounds = computeGlobalIndices(submap);
+  cv::Rect2i chunk_range = computeChunkRange(submap_bounds);
+
+  std::shared_lock<std::shared_timed_mutex> lock(m_mutex_chunks);
+
+  std::vector<int> layer_indices;
+  std::vector<cv::Mat> layer_data;
+  for (const auto &layer_name : layer_names)
+  {
+    int idx = findLayerIdx(layer_name);
+    if (idx < 0)
+      throw std::out_of_range("No layer with name '" + layer_name + "' available.");
+    layer_indices.push_back(idx);
+    layer_data.push_back(createEmptyData(submap.size(), m_layers[idx].type));
+  }
+
+  for (int chunk_row = chunk_range.y; chunk_row < chunk_range.y + chunk_range.height; ++chunk_row)
+    for (int chunk_col = chunk_range.x; chunk_col < chunk_range.x + chunk_range.width; ++chunk_col)
+    {
+      ChunkIdx chunk_idx(chunk_col, chunk_row);
+
+      // Spilled chunks are only read temporarily, as extracting data does not indicate they are needed again
+      std::vector<cv::Mat> chunk_spilled;
+      const std::vector<cv::Mat>* chunk = nullptr;
+      std::unique_lock<std::mutex> lock_chunk;
+      auto it = m_chunks.find(chunk_idx);
+      if (it != m_chunks.end())
+      {
+        lock_chunk = std::unique_lock<std::mutex>(it->second.mutex);
+        chunk = &it->second.layers;
+      }
+      else if (m_chunks_spilled.count(chunk_idx) > 0)
+      {
+        chunk_spilled = readChunk(chunk_idx);
+        chunk = &chunk_spilled;
+      }
+      else
+        continue;
+
+      cv::Rect2i chunk_bounds(chunk_col*m_chunk_size, chunk_row*m_chunk_size, m_chunk_size, m_chunk_size);
+      cv::Rect2i overlap = (chunk_bounds & submap_bounds);
+
+      cv::Rect2i src_roi(overlap.x - chunk_bounds.x, overlap.y - chunk_bounds.y, overlap.width, overlap.height);
+      cv::Rect2i dst_roi(overlap.x - submap_bounds.x, overlap.y - submap_bounds.y, overlap.width, overlap.height);
+
+      for (size_t i = 0; i < layer_indices.size(); ++i)
+      {
+        int idx = layer_indices[i];
+        if (chunk->size() <= idx || (*chunk)[idx].empty())
+          continue;
+        (*chunk)[idx](src_roi).copyTo(layer_data[i](dst_roi));
+      }
+    }
+
+  for (size_t i = 0; i < layer_indices.size(); ++i)
+    submap.add(layer_names[i], layer_data[i], m_layers[layer_indices[i]].interpolation);
+  return submap;
+}
+
+CvGridMap ChunkedGridMap::getGridMap(const std::vector<std::string> &layer_names) const
+{
+  // Map may grow between the two calls, the submap then covers the data of the earlier roi
+  cv::Rect2d roi_map = roi();
+  if (empty())
+    throw(std::runtime_error("Error: Chunked grid map is empty!"));
+  return getSubmap(layer_names, roi_map);
+}
+
+CvGridMap ChunkedGridMap::getGridMap() const
+{
+  return getGridMap(getAllLayerNames());
+}
+
+bool ChunkedGridMap::exists(const std::string &layer_name) const
+{
+  std::shared_lock<std::shared_timed_mutex> lock(m_mutex_chunks);
+  return findLayerIdx(layer_name) >= 0;
+}
+
+bool ChunkedGridMap::empty() const
+{
+  std::shared_lock<std::shared_timed_mutex> lock(m_mutex_chunks);
+  return m_chunks.empty() && m_chunks_spilled.empty();
+}
+
+std::vector<std::string> ChunkedGridMap::getAllLayerNames() const
+{
+  std::shared_lock<std::shared_timed_mutex> lock(m_mutex_chunks);
+  std::vector<std::string> layer_names;
+  for (const auto &layer : m_layers)
+    layer_names.push_back(layer.name);
+  return layer_names;
+}
+
+cv::Rect2d ChunkedGridMap::roi() const
+{
+  std::shared_lock<std::shared_timed_mutex> lock(m_mutex_chunks);
+  return computeWorldRoi(m_bounds);
+}
+
+double ChunkedGridMap::resolution() const
+{
+  return m_resolution;
+}
+
+int ChunkedGridMap::getChunkSize() const
+{
+  return m_chunk_size;
+}
+
+size_t ChunkedGridMap::getNumberOfChunks() const
+{
+  std::shared_lock<std::shared_timed_mutex> lock(m_mutex_chunks);
+  return m_chunks.size() + m_chunks_spilled.size();
+}
+
+size_t ChunkedGridMap::getByteSize() const
+{
+  std::shared_lock<std::shared_timed_mutex> lock(m_mutex_chunks);
+  size_t bytes = 0;
+  for (const auto &chunk : m_chunks)
+    for (const cv::Mat &data : chunk.second.layers)
+      bytes += data.total() * data.elemSize();
+  return bytes;
+}
+
+void ChunkedGridMap::setSpillDirectory(const std::string &directory)
+{
+  std::lock_guard<std::mutex> lock_write(m_mutex_write);
+  std::unique_lock<std::shared_timed_mutex> lock(m_mutex_chunks);
+  if (!m_chunks_spilled.empty() && directory != m_spill_directory)
+    throw(std::runtime_error("Error: Spill directory can not be changed while chunks are spilled!"));
+  m_spill_directory = directory;
+}
+
+size_t ChunkedGridMap::spill(const cv::Rect2d &roi_keep)
+{
+  if (m_spill_directory.empty())
+    throw(std::runtime_error("Error: No directory set to spill chunks of the grid map!"));
+
+  cv::Rect2i chunk_range_keep = computeChunkRange(computeGlobalIndices(CvGridMap(roi_keep, m_resolution)));
+
+  std::lock_guard<std::mutex> lock_write(m_mutex_write);
+  std::unique_lock<std::shared_timed_mutex> lock(m_mutex_chunks);
+
+  size_t bytes = 0;
+  for (auto it = m_chunks.begin(); it != m_chunks.end(); )
+  {
+    if (chunk_range_keep.contains(cv::Point2i(it->first.first, it->first.second)))
+    {
+      it++;
+      continue;
+    }
+
+    writeChunk(it->first, it->second.layers);
+    for (const cv::Mat &data : it->second.layers)
+      bytes += data.total() * data.elemSize();
+
+    m_chunks_spilled[it->first] = it->second.revision;
+    it = m_chunks.erase(it);
+  }
+  return bytes;
+}
+
+size_t ChunkedGridMap::getNumberOfSpilledChunks() const
+{
+  std::shared_lock<std::shared_timed_mutex> lock(m_mutex_chunks);
+  return m_chunks_spilled.size();
+}
+
+uint64_t ChunkedGridMap::getRevision() const
+{
+  std::shared_lock<std::shared_timed_mutex> lock(m_mutex_chunks);
+  return m_revision;
+}
+
+std::vector<cv::Rect2d> ChunkedGridMap::getChangedRegions(uint64_t revision) const
+{
+  std::shared_lock<std::shared_timed_mutex> lock(m_mutex_chunks);
+
+  std::vector<cv::Rect2d> regions;
+  auto add_region = [&](const ChunkIdx &idx)
+  {
+    cv::Rect2i chunk_bounds(idx.first*m_chunk_size, idx.second*m_chunk_size, m_chunk_size, m_chunk_size);
+    regions.push_back(computeWorldRoi(chunk_bounds & m_bounds));
+  };
+
+  for (const auto &chunk : m_chunks)
+    if (chunk.second.revision > revision)
+      add_region(chunk.first);
+  for (const auto &spilled : m_chunks_spilled)
+    if (spilled.second > revision)
+      add_region(spilled.first);
+  return regions;
+}
+
+cv::Rect2i ChunkedGridMap::computeChunkRange(const cv::Rect2i &bounds) const
+{
+  int chunk_col_min = floorDiv(bounds.x, m_chunk_size);
+  int chunk_col_max = floorDiv(bounds.x + bounds.width - 1, m_chunk_size);
+  int chunk_row_min = floorDiv(bounds.y, m_chunk_size);
+  int chunk_row_max = floorDiv(bounds.y + bounds.height - 1, m_chunk_size);
+  return cv::Rect2i(chunk_col_min, chunk_row_min, chunk_col_max - chunk_col_min + 1, chunk_row_max - chunk_row_min + 1);
+}
+
+std::string ChunkedGridMap::createSpillFilename(const ChunkIdx &idx) const
+{
+  return m_spill_directory + "/chunk_" + std::to_string(idx.first) + "_" + std::to_string(idx.second) + ".bin";
+}
+
+void ChunkedGridMap::writeChunk(const ChunkIdx &idx, const std::vector<cv::Mat> &chunk) const
+{
+  std::string filename = createSpillFilename(idx);
+  std::ofstream file(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file.is_open())
+    throw(std::runtime_error("Error: Could not open file '" + filename + "' to spill chunk."));
+
+  // Layers are stored as rows, cols and type followed by the raw data. Layers without data have zero rows and cols.
+  auto nrof_layers = static_cast<int32_t>(chunk.size());
+  file.write(reinterpret_cast<const char*>(&nrof_layers), sizeof(nrof_layers));
+  for (const cv::Mat &data : chunk)
+  {
+    int32_t header[3] = {data.rows, data.cols, data.type()};
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    if (data.empty())
+      continue;
+
+    cv::Mat data_continuous = (data.isContinuous() ? data : data.clone());
+    file.write(reinterpret_cast<const char*>(data_continuous.data), data_continuous.total() * data_continuous.elemSize());
+  }
+
+  if (!file.good())
+    throw(std::runtime_error("Error: Writing to file '" + filename + "' failed while spilling chunk."));
+}
+
+std::vector<cv::Mat> ChunkedGridMap::readChunk(const ChunkIdx &idx) const
+{
+  std::string filename = createSpillFilename(idx);
+  std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+  if (!file.is_open())
+    throw(std::runtime_error("Error: Could not open spilled chunk '" + filename + "'."));
+
+  int32_t nrof_layers = 0;
+  file.read(reinterpret_cast<char*>(&nrof_layers), sizeof(nrof_layers));
+
+  std::vector<cv::Mat> chunk(static_cast<size_t>(nrof_layers));
+  for (cv::Mat &data : chunk)
+  {
+    int32_t header[3];
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (header[0] == 0 || header[1] == 0)
+      continue;
+
+    data = cv::Mat(header[0], header[1], header[2]);
+    file.read(reinterpret_cast<char*>(data.data), data.total() * data.elemSize());
+  }
+
+  if (!file.good())
+    throw(std::runtime_error("Error: Reading spilled chunk '" + filename + "' failed."));
+  return chunk;
+}
+
+cv::Rect2d ChunkedGridMap::computeWorldRoi(const cv::Rect2i &bounds) const
+{
+  double x = static_cast<double>(bounds.x) * m_resolution;
+  double y_top = -static_cast<double>(bounds.y) * m_resolution;
+  double width = static_cast<double>(bounds.width - 1) * m_resolution;
+  double height = static_cast<double>(bounds.height - 1) * m_resolution;
+  return cv::Rect2d(x, y_top - height, width, height);
+}
+
+cv::Rect2i ChunkedGridMap::computeGlobalIndices(const CvGridMap &map) const
+{
+  // CvGridMaps are fitted to multiples of the resolution, so the world position of the upper left cell maps to an
+  // integer index in the global grid
+  cv::Rect2d roi = map.roi();
+  cv::Size2i size = map.size();
+  auto col = static_cast<int>(std::round(roi.x / m_resolution));
+  auto row = static_cast<int>(std::round(-(roi.y + roi.height) / m_resolution));
+  return cv::Rect2i(col, row, size.width, size.height);
+}
+
+int ChunkedGridMap::findLayerIdx(const std::string &layer_name) const
+{
+  for (size_t i = 0; i < m_layers.size(); ++i)
+    if (m_layers[i].name == layer_name)
+      return static_cast<int>(i);
+  return -1;
+}
+
+cv::Mat ChunkedGridMap::createEmptyData(const cv::Size2i &size, int type)
+{
+  switch(type & CV_MAT_DEPTH_MASK)
+  {
+    case CV_32F:
+      return cv::Mat(size, type, cv::Scalar::all(std::numeric_limits<float>::quiet_NaN()));
+    case CV_64F:
+      return cv::Mat(size, type, cv::Scalar::all(std::numeric_limits<double>::quiet_NaN()));
+    default:
+      return cv::Mat::zeros(size, type);
+  }
+}
+
+int ChunkedGridMap::floorDiv(int value, int divisor)
+{
+  int quotient = value / divisor;
+  if ((value % divisor != 0) && ((value < 0) != (divisor < 0)))
+    quotient--;
+  return quotient;
+}
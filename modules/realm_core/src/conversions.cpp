@@ -1,82 +1,163 @@
 
 
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+
 #include <realm_core/conversions.h>
 
 using namespace realm;
 
-UTMPose gis::convertToUTM(const WGSPose &wgs)
+namespace
 {
-  // TODO: Check if utm conversions are valid everywhere (not limited to utm32)
-  // Compute zone
-  double lon_tmp = (wgs.longitude+180)-int((wgs.longitude+180)/360)*360-180;
-  auto zone = static_cast<int>(1 + (wgs.longitude+180.0)/6.0);
-  if(wgs.latitude >= 56.0 && wgs.latitude < 64.0 && lon_tmp >= 3.0 && lon_tmp < 12.0)
-    zone = 32;
-  if(wgs.latitude >= 72.0 && wgs.latitude < 84.0)
+
+//! OGR transformations are allocated by GDAL and have to be released by it
+struct TransformationDeleter
+{
+  void operator()(OGRCoordinateTransformation* coord_trans) const
   {
-    if(      lon_tmp >= 0.0  && lon_tmp <  9.0 ) zone = 31;
-    else if( lon_tmp >= 9.0  && lon_tmp < 21.0 ) zone = 33;
-    else if( lon_tmp >= 21.0 && lon_tmp < 33.0 ) zone = 35;
-    else if( lon_tmp >= 33.0 && lon_tmp < 42.0 ) zone = 37;
+    OCTDestroyCoordinateTransformation(reinterpret_cast<OGRCoordinateTransformationH>(coord_trans));
   }
+};
 
-  // Compute band
-  char band = UTMBand(wgs.latitude, wgs.longitude);
-  int is_northern = (wgs.latitude < 0.0 ? 0 : 1);
+using TransformationPtr = std::unique_ptr<OGRCoordinateTransformation, TransformationDeleter>;
+
+/*!
+ * @brief Returns the transformation between WGS84 and a UTM zone. Creating a transformation sets up PROJ, which is
+ * far more expensive than transforming points, so they are cached per thread. OGR transformations must not be shared
+ * between threads.
+ */
+OGRCoordinateTransformation* getTransformation(int zone, bool is_northern, bool is_to_utm)
+{
+  thread_local std::map<std::tuple<int, bool, bool>, TransformationPtr> cache;
+
+  std::tuple<int, bool, bool> key(zone, is_northern, is_to_utm);
+  auto it = cache.find(key);
+  if (it != cache.end())
+    return it->second.get();
 
   OGRSpatialReference ogr_wgs;
   gis::initAxisMappingStrategy(&ogr_wgs);
-
   ogr_wgs.SetWellKnownGeogCS("WGS84");
 
   OGRSpatialReference ogr_utm;
   gis::initAxisMappingStrategy(&ogr_utm);
-
   ogr_utm.SetWellKnownGeogCS("WGS84");
   ogr_utm.SetUTM(zone, is_northern);
 
-  OGRCoordinateTransformation* coord_trans = OGRCreateCoordinateTransformation(&ogr_wgs, &ogr_utm);
-
-  double x = wgs.longitude;
-  double y = wgs.latitude;
-  bool result = coord_trans->Transform(1, &x, &y);
+  TransformationPtr coord_trans(is_to_utm ? OGRCreateCoordinateTransformation(&ogr_wgs, &ogr_utm)
+                                          : OGRCreateCoordinateTransformation(&ogr_utm, &ogr_wgs));
+  if (!coord_trans)
+    throw(std::runtime_error("Error creating coordinate transformation for UTM zone " + std::to_string(zone)));
 
-  // Underlying library is C malloc, have to clean up the resulting pointer to avoid a leak
-  delete coord_trans;
+  return cache.emplace(key, std::move(coord_trans)).first->second.get();
+}
 
-  if (!result) {
-    throw(std::runtime_error("Error converting utm coordinates to wgs84: Transformation failed"));
+int computeZone(const WGSPose &wgs)
+{
+  // TODO: Check if utm conversions are valid everywhere (not limited to utm32)
+  double lon_tmp = (wgs.longitude+180)-int((wgs.longitude+180)/360)*360-180;
+  auto zone = static_cast<int>(1 + (wgs.longitude+180.0)/6.0);
+  if(wgs.latitude >= 56.0 && wgs.latitude < 64.0 && lon_tmp >= 3.0 && lon_tmp < 12.0)
+    zone = 32;
+  if(wgs.latitude >= 72.0 && wgs.latitude < 84.0)
+  {
+    if(      lon_tmp >= 0.0  && lon_tmp <  9.0 ) zone = 31;
+    else if( lon_tmp >= 9.0  && lon_tmp < 21.0 ) zone = 33;
+    else if( lon_tmp >= 21.0 && lon_tmp < 33.0 ) zone = 35;
+    else if( lon_tmp >= 33.0 && lon_tmp < 42.0 ) zone = 37;
   }
+  return zone;
+}
 
-  return UTMPose(x, y, wgs.altitude, wgs.heading, (uint8_t)zone, band);
+} // namespace
+
+UTMPose gis::convertToUTM(const WGSPose &wgs)
+{
+  return convertToUTM(std::vector<WGSPose>{wgs}).front();
 }
 
 WGSPose gis::convertToWGS84(const UTMPose &utm)
 {
-  OGRSpatialReference ogr_utm;
-  gis::initAxisMappingStrategy(&ogr_utm);
+  return convertToWGS84(std::vector<UTMPose>{utm}).front();
+}
 
-  ogr_utm.SetWellKnownGeogCS("WGS84");
-  ogr_utm.SetUTM(utm.zone, TRUE);
+std::vector<UTMPose> gis::convertToUTM(const std::vector<WGSPose> &wgs)
+{
+  // Poses are grouped by zone and hemisphere, so every group is converted with a single call
+  std::map<std::pair<int, bool>, std::vector<size_t>> groups;
+  for (size_t i = 0; i < wgs.size(); ++i)
+    groups[std::make_pair(computeZone(wgs[i]), wgs[i].latitude >= 0.0)].push_back(i);
 
-  OGRSpatialReference ogr_wgs;
-  gis::initAxisMappingStrategy(&ogr_wgs);
-  ogr_wgs.SetWellKnownGeogCS("WGS84");
+  std::vector<UTMPose> utm(wgs.size());
+  for (const auto &group : groups)
+  {
+    int zone = group.first.first;
+    const std::vector<size_t> &indices = group.second;
+
+    std::vector<double> x(indices.size());
+    std::vector<double> y(indices.size());
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+      x[i] = wgs[indices[i]].longitude;
+      y[i] = wgs[indices[i]].latitude;
+    }
+
+    OGRCoordinateTransformation* coord_trans = getTransformation(zone, group.first.second, true);
+    if (!coord_trans->Transform(static_cast<int>(indices.size()), x.data(), y.data()))
+      throw(std::runtime_error("Error converting wgs84 coordinates to utm: Transformation failed"));
+
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+      const WGSPose &pose = wgs[indices[i]];
+      char band = UTMBand(pose.latitude, pose.longitude);
+      utm[indices[i]] = UTMPose(x[i], y[i], pose.altitude, pose.heading, static_cast<uint8_t>(zone), band);
+    }
+  }
+  return utm;
+}
 
-  OGRCoordinateTransformation* coord_trans = OGRCreateCoordinateTransformation(&ogr_utm, &ogr_wgs);
+std::vector<WGSPose> gis::convertToWGS84(const std::vector<UTMPose> &utm)
+{
+  // Poses are grouped by zone, so every group is converted with a single call
+  std::map<int, std::vector<size_t>> groups;
+  for (size_t i = 0; i < utm.size(); ++i)
+    groups[utm[i].zone].push_back(i);
 
-  double x = utm.easting;
-  double y = utm.northing;
-  bool result = coord_trans->Transform(1, &x, &y);
+  std::vector<WGSPose> wgs(utm.size(), WGSPose{0.0, 0.0, 0.0, 0.0});
+  for (const auto &group : groups)
+  {
+    const std::vector<size_t> &indices = group.second;
+
+    std::vector<double> x(indices.size());
+    std::vector<double> y(indices.size());
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+      x[i] = utm[indices[i]].easting;
+      y[i] = utm[indices[i]].northing;
+    }
+
+    convertToWGS84(static_cast<uint8_t>(group.first), indices.size(), x.data(), y.data());
+
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+      const UTMPose &pose = utm[indices[i]];
+      wgs[indices[i]] = WGSPose{y[i], x[i], pose.altitude, pose.heading};
+    }
+  }
+  return wgs;
+}
 
-  // Underlying library is C malloc, have to clean up the resulting pointer to avoid a leak
-  delete coord_trans;
+void gis::convertToWGS84(uint8_t zone, size_t n, double* x, double* y)
+{
+  if (n == 0)
+    return;
 
-  if (!result) {
+  // Same as the single pose conversion, UTM coordinates are interpreted as northern hemisphere
+  OGRCoordinateTransformation* coord_trans = getTransformation(zone, true, false);
+  if (!coord_trans->Transform(static_cast<int>(n), x, y))
     throw(std::runtime_error("Error converting utm coordinates to wgs84: Transformation failed"));
-  }
-
-  return WGSPose{y, x, utm.altitude, utm.heading};
 }
 
 void gis::initAxisMappingStrategy(OGRSpatialReference *oSRS)
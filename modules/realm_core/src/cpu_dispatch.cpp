@@ -0,0 +1,20 @@
+
+
+#include <realm_core/cpu_dispatch.h>
+
+const char* realm::getCpuDispatchTarget()
+{
+#if defined(REALM_WITH_CPU_DISPATCH)
+  // Same priorities as the resolver of the clones
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return "avx512f";
+  if (__builtin_cpu_supports("avx2"))
+    return "avx2";
+  return "baseline";
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+  return "neon";
+#else
+  return "baseline";
+#endif
+}
@@ -3,19 +3,284 @@
 #include <iostream>
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
 
 #include <realm_core/loguru.h>
 #include <realm_core/cv_grid_map.h>
 
 using namespace realm;
 
+namespace
+{
+
+// Registry of all layer names, that were ever interned. Names are kept in a deque, so references stay valid when it
+// grows.
+std::mutex g_mutex_layer_ids;
+std::unordered_map<std::string, uint32_t> g_layer_ids;
+std::deque<std::string> g_layer_names;
+
+// Dirty regions of a level are merged into their bounding box, once there are more than this
+const size_t g_max_nrof_dirty_regions = 16;
+
+inline int floorDiv(int64_t a, int64_t b)
+{
+  return static_cast<int>(std::floor(static_cast<double>(a) / static_cast<double>(b)));
+}
+
+inline int ceilDiv(int64_t a, int64_t b)
+{
+  return static_cast<int>(std::ceil(static_cast<double>(a) / static_cast<double>(b)));
+}
+
+// Empty cells are NaN for floating point layers and zero in all channels otherwise, like in CvGridMap::add(...)
+template<typename T>
+inline bool isCellValid(const T* cell, int channels)
+{
+  for (int i = 0; i < channels; ++i)
+    if (cell[i] != 0)
+      return true;
+  return false;
+}
+
+inline bool isCellValid(const float* cell, int channels)
+{
+  return !std::isnan(cell[0]);
+}
+
+inline bool isCellValid(const double* cell, int channels)
+{
+  return !std::isnan(cell[0]);
+}
+
+#ifdef CV_16F
+inline bool isCellValid(const cv::float16_t* cell, int channels)
+{
+  return !std::isnan(static_cast<float>(cell[0]));
+}
+#endif
+
+template<typename T>
+inline T getEmptyValue()
+{
+  return (std::numeric_limits<T>::has_quiet_NaN ? std::numeric_limits<T>::quiet_NaN() : T(0));
+}
+
+#ifdef CV_16F
+template<>
+inline cv::float16_t getEmptyValue<cv::float16_t>()
+{
+  return cv::float16_t(std::numeric_limits<float>::quiet_NaN());
+}
+#endif
+
+// Overview cell (r, c) is centred on the fine cell (2r + offset.y, 2c + offset.x). Its value is the mean of the valid
+// cells of the 3x3 neighbourhood below, weighted with a tent kernel. Cells outside of the fine grid count as empty.
+template<typename T>
+void downsampleCells(const cv::Mat &fine, const cv::Point2i &offset, const cv::Rect2i &roi, bool is_nearest, cv::Mat &coarse)
+{
+  const int channels = fine.channels();
+  const T empty = getEmptyValue<T>();
+  std::vector<double> sum(static_cast<size_t>(channels));
+
+  for (int r = roi.y; r < roi.y + roi.height; ++r)
+    for (int c = roi.x; c < roi.x + roi.width; ++c)
+    {
+      T* dst = coarse.ptr<T>(r) + c * channels;
+      int r_fine = 2 * r + offset.y;
+      int c_fine = 2 * c + offset.x;
+
+      if (is_nearest)
+      {
+        bool is_inside = (r_fine >= 0 && r_fine < fine.rows && c_fine >= 0 && c_fine < fine.cols);
+        const T* src = (is_inside ? fine.ptr<T>(r_fine) + c_fine * channels : nullptr);
+        for (int i = 0; i < channels; ++i)
+          dst[i] = (is_inside ? src[i] : empty);
+        continue;
+      }
+
+      std::fill(sum.begin(), sum.end(), 0.0);
+      double weight_sum = 0.0;
+      for (int dr = -1; dr <= 1; ++dr)
+        for (int dc = -1; dc <= 1; ++dc)
+        {
+          int rr = r_fine + dr;
+          int cc = c_fine + dc;
+          if (rr < 0 || rr >= fine.rows || cc < 0 || cc >= fine.cols)
+            continue;
+
+          const T* src = fine.ptr<T>(rr) + cc * channels;
+          if (!isCellValid(src, channels))
+            continue;
+
+          double weight = (2 - std::abs(dr)) * (2 - std::abs(dc));
+          for (int i = 0; i < channels; ++i)
+            sum[i] += weight * src[i];
+          weight_sum += weight;
+        }
+
+      for (int i = 0; i < channels; ++i)
+        dst[i] = (weight_sum > 0.0 ? cv::saturate_cast<T>(sum[i] / weight_sum) : empty);
+    }
+}
+
+void downsampleLayer(const cv::Mat &fine, const cv::Point2i &offset, const cv::Rect2i &roi, bool is_nearest, cv::Mat &coarse)
+{
+  switch(fine.depth())
+  {
+    case CV_8U:
+      downsampleCells<uint8_t>(fine, offset, roi, is_nearest, coarse);
+      break;
+    case CV_16U:
+      downsampleCells<uint16_t>(fine, offset, roi, is_nearest, coarse);
+      break;
+    case CV_32F:
+      downsampleCells<float>(fine, offset, roi, is_nearest, coarse);
+      break;
+    case CV_64F:
+      downsampleCells<double>(fine, offset, roi, is_nearest, coarse);
+      break;
+#ifdef CV_16F
+    case CV_16F:
+      downsampleCells<cv::float16_t>(fine, offset, roi, is_nearest, coarse);
+      break;
+#endif
+    default:
+      throw(std::invalid_argument("Error computing overview: Matrix type is not supported."));
+  }
+}
+
+// Overview cells whose 3x3 neighbourhood intersects a region of the fine grid
+cv::Rect2i computeOverviewRoi(const cv::Rect2i &roi_fine, const cv::Point2i &offset, const cv::Size2i &size_coarse)
+{
+  int c0 = ceilDiv(roi_fine.x - offset.x - 1, 2);
+  int r0 = ceilDiv(roi_fine.y - offset.y - 1, 2);
+  int c1 = floorDiv(roi_fine.x + roi_fine.width - offset.x, 2);
+  int r1 = floorDiv(roi_fine.y + roi_fine.height - offset.y, 2);
+  return cv::Rect2i(c0, r0, c1 - c0 + 1, r1 - r0 + 1) & cv::Rect2i(0, 0, size_coarse.width, size_coarse.height);
+}
+
+// Element wise REALM_OVERWRITE_ZERO, single channel floating point data is empty where NaN, everything else where zero
+template<typename T>
+void mergeElementsZero(const T* from, T* to, int n, bool is_nan_empty)
+{
+  if (is_nan_empty)
+  {
+    for (int i = 0; i < n; ++i)
+      if (to[i] != to[i] && from[i] == from[i])
+        to[i] = from[i];
+  }
+  else
+  {
+    for (int i = 0; i < n; ++i)
+      if (to[i] == 0 && from[i] > 0)
+        to[i] = from[i];
+  }
+}
+
+// Merges a range of rows of two matrices of equal size and type in place, so disjoint ranges can run concurrently
+void mergeRows(const cv::Mat &from, cv::Mat &to, int flag_merge_handling, const cv::Range &rows)
+{
+  const int n = from.cols * from.channels();
+#ifdef CV_16F
+  const bool is_nan_empty = (to.type() == CV_32F || to.type() == CV_64F || to.type() == CV_16F);
+#else
+  const bool is_nan_empty = (to.type() == CV_32F || to.type() == CV_64F);
+#endif
+  for (int r = rows.start; r < rows.end; ++r)
+  {
+    if (flag_merge_handling == REALM_OVERWRITE_ALL)
+    {
+      std::memcpy(to.ptr(r), from.ptr(r), from.cols * from.elemSize());
+      continue;
+    }
+    switch(to.depth())
+    {
+      case CV_8U:
+        mergeElementsZero(from.ptr<uint8_t>(r), to.ptr<uint8_t>(r), n, is_nan_empty);
+        break;
+      case CV_16U:
+        mergeElementsZero(from.ptr<uint16_t>(r), to.ptr<uint16_t>(r), n, is_nan_empty);
+        break;
+      case CV_32F:
+        mergeElementsZero(from.ptr<float>(r), to.ptr<float>(r), n, is_nan_empty);
+        break;
+      case CV_64F:
+        mergeElementsZero(from.ptr<double>(r), to.ptr<double>(r), n, is_nan_empty);
+        break;
+#ifdef CV_16F
+      case CV_16F:
+        mergeElementsZero(from.ptr<cv::float16_t>(r), to.ptr<cv::float16_t>(r), n, is_nan_empty);
+        break;
+#endif
+      default:
+        throw(std::invalid_argument("Error merging matrices: Matrix type is not supported."));
+    }
+  }
+}
+
+void addDirtyRegion(std::vector<cv::Rect2i> &regions, const cv::Rect2i &roi)
+{
+  if (roi.area() <= 0)
+    return;
+  regions.push_back(roi);
+  if (regions.size() > g_max_nrof_dirty_regions)
+  {
+    cv::Rect2i bounding_box = regions.front();
+    for (const auto &region : regions)
+      bounding_box |= region;
+    regions.assign(1, bounding_box);
+  }
+}
+
+} // namespace
+
+CvGridMap::LayerId::LayerId(const std::string &layer_name)
+{
+  std::lock_guard<std::mutex> lock(g_mutex_layer_ids);
+  auto it = g_layer_ids.find(layer_name);
+  if (it == g_layer_ids.end())
+  {
+    it = g_layer_ids.emplace(layer_name, static_cast<uint32_t>(g_layer_names.size())).first;
+    g_layer_names.push_back(layer_name);
+  }
+  m_value = it->second;
+  m_name = &g_layer_names[m_value];
+}
+
+uint32_t CvGridMap::LayerId::value() const
+{
+  return m_value;
+}
+
+const std::string& CvGridMap::LayerId::name() const
+{
+  return *m_name;
+}
+
+bool CvGridMap::LayerId::operator==(const LayerId &other) const
+{
+  return m_value == other.m_value;
+}
+
+bool CvGridMap::LayerId::operator!=(const LayerId &other) const
+{
+  return m_value != other.m_value;
+}
+
 CvGridMap::CvGridMap()
-    : m_resolution(1.0)
+    : m_resolution(1.0),
+      m_nrof_overviews(0)
 {
 }
 
 CvGridMap::CvGridMap(const cv::Rect2d &roi, double resolution)
-    : m_resolution(resolution)
+    : m_resolution(resolution),
+      m_nrof_overviews(0)
 {
   setGeometry(roi, m_resolution);
 }
@@ -26,6 +291,7 @@ CvGridMap CvGridMap::clone() const
   copy.setGeometry(m_roi, m_resolution);
   for (const auto &layer : m_layers)
     copy.add(layer.name, layer.data.clone(), layer.interpolation);
+  copy.setNumberOfOverviews(m_nrof_overviews);
   return std::move(copy);
 }
 
@@ -50,11 +316,15 @@ void CvGridMap::add(const Layer &layer, bool is_data_empty)
 
   // Add data if layer already exists, push to container if not
   if (!exists(layer.name))
+  {
     m_layers.push_back(layer);
+    updateLookup();
+  }
   else
   {
     m_layers[findContainerIdx(layer.name)] = layer;
   }
+  markOverviewsDirty(cv::Rect2i(0, 0, m_size.width, m_size.height));
 }
 
 void CvGridMap::add(const std::string &layer_name, const cv::Mat &layer_data, int interpolation)
@@ -62,7 +332,8 @@ void CvGridMap::add(const std::string &layer_name, const cv::Mat &layer_data, in
   add(Layer{layer_name, layer_data, interpolation});
 }
 
-void CvGridMap::add(const CvGridMap &submap, int flag_overlap_handle, bool do_extend)
+void CvGridMap::add(const CvGridMap &submap, int flag_overlap_handle, bool do_extend,
+                    const ThreadPool::Ptr &thread_pool, int nrof_threads)
 {
   if (fabs(resolution() - submap.resolution()) > std::numeric_limits<double>::epsilon())
     throw(std::invalid_argument("Error add submap: Resolution mismatch!"));
@@ -95,6 +366,10 @@ void CvGridMap::add(const CvGridMap &submap, int flag_overlap_handle, bool do_ex
   cv::Rect2i src_roi(submap.atIndexROI(copy_roi));
   cv::Rect2i dst_roi(this->atIndexROI(copy_roi));
 
+  // Layers are prepared first, so all of them can be merged in a single pass over the rows afterwards
+  std::vector<std::pair<cv::Mat, cv::Mat>> merges;
+  merges.reserve(submap.m_layers.size());
+
   // iterate through submap
   for (const auto &submap_layer : submap.m_layers)
   {
@@ -132,10 +407,83 @@ void CvGridMap::add(const CvGridMap &submap, int flag_overlap_handle, bool do_ex
       continue;
     }
 
-    // Now is finally the turn to calculate overlap result and copy it to src grid map
-    mergeMatrices(src_data_roi, dst_data_roi, flag_overlap_handle);
-    dst_data_roi.copyTo(m_layers[idx_layer].data(dst_roi));
+    if (src_data_roi.type() != dst_data_roi.type())
+    {
+      LOG_F(WARNING, "Layer '%s' could not be merged. Matrix types mismatched!", submap_layer.name.c_str());
+      continue;
+    }
+
+    // dst_data_roi is a header into the layer, so merging writes directly into this grid map
+    merges.emplace_back(src_data_roi, dst_data_roi);
   }
+
+  // Now is finally the turn to calculate overlap result. Every row of every layer is independent.
+  parallelFor(thread_pool, cv::Range(0, dst_roi.height), [&](const cv::Range &range)
+  {
+    for (auto &merge : merges)
+      mergeRows(merge.first, merge.second, flag_overlap_handle, range);
+  }, nrof_threads);
+
+  markOverviewsDirty(dst_roi);
+}
+
+void CvGridMap::add(Layer &&layer, bool is_data_empty)
+{
+  if (!is_data_empty && (layer.data.size().width != m_size.width || layer.data.size().height != m_size.height))
+    throw(std::invalid_argument("Error: Adding Layer failed. Size of data does not match grid map size."));
+  if (!isMatrixTypeValid(layer.data.type()))
+    throw(std::invalid_argument("Error: Adding Layer failed. Matrix type is not supported."));
+
+  if (!exists(layer.name))
+  {
+    m_layers.push_back(std::move(layer));
+    updateLookup();
+  }
+  else
+  {
+    m_layers[findContainerIdx(layer.name)] = std::move(layer);
+  }
+  markOverviewsDirty(cv::Rect2i(0, 0, m_size.width, m_size.height));
+}
+
+void CvGridMap::add(const std::string &layer_name, cv::Mat &&layer_data, int interpolation)
+{
+  add(Layer{layer_name, std::move(layer_data), interpolation});
+}
+
+void CvGridMap::add(CvGridMap &&submap, int flag_overlap_handle, bool do_extend)
+{
+  if (!hasSameGeometry(submap))
+  {
+    add(static_cast<const CvGridMap&>(submap), flag_overlap_handle, do_extend);
+  }
+  else
+  {
+    for (auto &submap_layer : submap.m_layers)
+    {
+      // Layers are only merged if this map has data for them, otherwise the buffers are taken over
+      if (!exists(submap_layer.name) || get(submap_layer.name).empty() || flag_overlap_handle == REALM_OVERWRITE_ALL)
+        add(std::move(submap_layer));
+      else
+        mergeMatrices(submap_layer.data, m_layers[findContainerIdx(submap_layer.name)].data, flag_overlap_handle);
+    }
+    markOverviewsDirty(cv::Rect2i(0, 0, m_size.width, m_size.height));
+  }
+
+  submap.m_layers.clear();
+  submap.updateLookup();
+}
+
+void CvGridMap::addView(const CvGridMap &map)
+{
+  if (!hasSameGeometry(map))
+  {
+    add(map, REALM_OVERWRITE_ALL, false);
+    return;
+  }
+
+  for (const auto &layer : map.m_layers)
+    add(layer, layer.data.empty());
 }
 
 void CvGridMap::remove(const std::string &layer_name)
@@ -146,6 +494,7 @@ void CvGridMap::remove(const std::string &layer_name)
     if (it->name == layer_name)
     {
       m_layers.erase(it);
+      updateLookup();
       break;
     }
     it++;
@@ -173,6 +522,11 @@ bool CvGridMap::exists(const std::string &layer_name) const
   return false;
 }
 
+bool CvGridMap::exists(const LayerId &layer_id) const
+{
+  return layer_id.value() < m_lookup_idx_from_id.size() && m_lookup_idx_from_id[layer_id.value()] > 0;
+}
+
 bool CvGridMap::containsRoi(const cv::Rect2d &roi) const
 {
   return fabs((m_roi & roi).area() - roi.area()) < 10e-6;
@@ -198,6 +552,16 @@ const cv::Mat& CvGridMap::get(const std::string& layer_name) const
   throw std::out_of_range("No layer with name '" + layer_name + "' available.");
 }
 
+cv::Mat& CvGridMap::get(const LayerId &layer_id)
+{
+  return m_layers[findContainerIdx(layer_id)].data;
+}
+
+const cv::Mat& CvGridMap::get(const LayerId &layer_id) const
+{
+  return m_layers[findContainerIdx(layer_id)].data;
+}
+
 CvGridMap::Layer CvGridMap::getLayer(const std::string& layer_name) const
 {
   for (const auto& layer : m_layers)
@@ -228,14 +592,33 @@ CvGridMap CvGridMap::getSubmap(const std::vector<std::string> &layer_names) cons
 
 CvGridMap CvGridMap::getSubmap(const std::vector<std::string> &layer_names, const cv::Rect2d &roi) const
 {
-  CvGridMap submap;
-  submap.setGeometry(roi, m_resolution);
-  CvGridMap::Overlap overlap = getOverlap(submap);
+  // Deep copy only the desired layers instead of the full overlap
+  CvGridMap submap = getSubmapView(layer_names, roi);
+  for (auto &layer : submap.m_layers)
+    layer.data = layer.data.clone();
+  return submap;
+}
 
-  if (overlap.first != nullptr && overlap.second != nullptr)
-    return overlap.first->getSubmap(layer_names);
-  else
+CvGridMap CvGridMap::getSubmapView(const std::vector<std::string> &layer_names, const cv::Rect2d &roi) const
+{
+  // Fit the roi to the grid first
+  CvGridMap roi_map;
+  roi_map.setGeometry(roi, m_resolution);
+
+  cv::Rect2d overlap_roi = (m_roi & roi_map.m_roi);
+  if (overlap_roi.area() < 10e-6)
     throw(std::out_of_range("Error extracting submap: No overlap!"));
+
+  cv::Rect2i grid_roi(atIndexROI(overlap_roi));
+
+  CvGridMap view;
+  view.setGeometry(overlap_roi, m_resolution);
+  for (const auto &layer_name : layer_names)
+  {
+    Layer layer = getLayer(layer_name);
+    view.add(layer.name, layer.data(grid_roi), layer.interpolation);
+  }
+  return view;
 }
 
 CvGridMap CvGridMap::getSubmap(const std::vector<std::string> &layer_names, const cv::Rect2i &roi) const
@@ -286,6 +669,32 @@ CvGridMap::Overlap CvGridMap::getOverlap(const CvGridMap &other_map) const
   return std::make_pair(map_ref, map_added);
 }
 
+CvGridMap::Overlap CvGridMap::getOverlapView(const CvGridMap &other_map) const
+{
+  cv::Rect2d overlap_roi = (m_roi & other_map.m_roi);
+
+  // Check if overlap exists
+  if (overlap_roi.area() < 10e-6)
+    return Overlap{nullptr, nullptr};
+
+  // getting matrix roi from both other and this map
+  cv::Rect2i this_grid_roi(this->atIndexROI(overlap_roi));
+  cv::Rect2i other_grid_roi(other_map.atIndexROI(overlap_roi));
+
+  // Same as getOverlap(...), but only matrix headers are created
+  auto map_ref = std::make_shared<CvGridMap>();
+  map_ref->setGeometry(overlap_roi, m_resolution);
+  for (const auto &layer : m_layers)
+    map_ref->add(layer.name, layer.data(this_grid_roi), layer.interpolation);
+
+  auto map_added = std::make_shared<CvGridMap>();
+  map_added->setGeometry(overlap_roi, m_resolution);
+  for (const auto &layer : other_map.m_layers)
+    map_added->add(layer.name, layer.data(other_grid_roi), layer.interpolation);
+
+  return std::make_pair(map_ref, map_added);
+}
+
 cv::Mat& CvGridMap::operator[](const std::string& layer_name)
 {
   return get(layer_name);
@@ -296,6 +705,16 @@ const cv::Mat& CvGridMap::operator[](const std::string& layer_name) const
   return get(layer_name);
 }
 
+cv::Mat& CvGridMap::operator[](const LayerId &layer_id)
+{
+  return get(layer_id);
+}
+
+const cv::Mat& CvGridMap::operator[](const LayerId &layer_id) const
+{
+  return get(layer_id);
+}
+
 void CvGridMap::setGeometry(const cv::Rect2d &roi, double resolution)
 {
   if (roi.width < 10e-6 || roi.height < 10e-6)
@@ -310,6 +729,7 @@ void CvGridMap::setGeometry(const cv::Rect2d &roi, double resolution)
   // Release all current data
   for (auto &layer : m_layers)
     layer.data.release();
+  resetOverviews();
 }
 
 void CvGridMap::setLayerInterpolation(const std::string& layer_name, int interpolation)
@@ -357,10 +777,16 @@ void CvGridMap::extendToInclude(const cv::Rect2d &roi)
         case CV_64F:
           cv::copyMakeBorder(layer.data, layer.data, size_y_top, size_y_bottom, size_x_left, size_x_right, cv::BORDER_CONSTANT, std::numeric_limits<double>::quiet_NaN());
           break;
+#ifdef CV_16F
+        case CV_16F:
+          cv::copyMakeBorder(layer.data, layer.data, size_y_top, size_y_bottom, size_x_left, size_x_right, cv::BORDER_CONSTANT, std::numeric_limits<float>::quiet_NaN());
+          break;
+#endif
         default:
           cv::copyMakeBorder(layer.data, layer.data, size_y_top, size_y_bottom, size_x_left, size_x_right, cv::BORDER_CONSTANT,0);
       }
     }
+  extendOverviews(cv::Point2i(size_x_left, size_y_top));
 }
 
 void CvGridMap::changeResolution(double resolution)
@@ -369,7 +795,8 @@ void CvGridMap::changeResolution(double resolution)
   fitGeometryToResolution(m_roi, m_roi, m_size);
   for (auto &layer : m_layers)
     if (!layer.data.empty() && (layer.data.cols != m_size.width || layer.data.rows != m_size.height))
-      cv::resize(layer.data, layer.data, m_size, layer.interpolation);
+      resizeData(layer.data, layer.data, m_size, layer.interpolation);
+  resetOverviews();
 }
 
 void CvGridMap::changeResolution(const cv::Size2i &size)
@@ -387,7 +814,54 @@ void CvGridMap::changeResolution(const cv::Size2i &size)
   fitGeometryToResolution(m_roi, m_roi, m_size);
   for (auto &layer : m_layers)
     if (!layer.data.empty() && (layer.data.cols != m_size.width || layer.data.rows != m_size.height))
-      cv::resize(layer.data, layer.data, m_size, layer.interpolation);
+      resizeData(layer.data, layer.data, m_size, layer.interpolation);
+  resetOverviews();
+}
+
+void CvGridMap::setNumberOfOverviews(int nrof_levels)
+{
+  if (nrof_levels < 0)
+    throw(std::invalid_argument("Error setting overviews: Number of levels must not be negative."));
+  if (nrof_levels == m_nrof_overviews)
+    return;
+
+  m_nrof_overviews = nrof_levels;
+  resetOverviews();
+}
+
+int CvGridMap::getNumberOfOverviews() const
+{
+  return m_nrof_overviews;
+}
+
+const CvGridMap& CvGridMap::getOverview(int level)
+{
+  if (level < 0 || level > m_nrof_overviews)
+    throw(std::out_of_range("Error accessing overview: Level " + std::to_string(level) + " is not maintained."));
+  if (level == 0)
+    return *this;
+
+  updateOverviews(level);
+  return *m_overviews[level - 1];
+}
+
+int CvGridMap::findOverviewLevel(double resolution) const
+{
+  int level = 0;
+  while (level < m_nrof_overviews && m_resolution * std::pow(2.0, level + 1) <= resolution + 10e-6)
+    level++;
+  return level;
+}
+
+void CvGridMap::invalidateOverviews(const cv::Rect2d &roi)
+{
+  cv::Rect2d overlap_roi = (m_roi & roi);
+  if (m_nrof_overviews == 0 || overlap_roi.area() < 10e-6)
+    return;
+
+  // The roi is not necessarily fitted to the grid, so the cells on its border are included as well
+  cv::Rect2i roi_idx = atIndexROI(overlap_roi);
+  markOverviewsDirty(cv::Rect2i(roi_idx.x - 1, roi_idx.y - 1, roi_idx.width + 2, roi_idx.height + 2));
 }
 
 cv::Point2i CvGridMap::atIndex(const cv::Point2d &pos) const
@@ -451,6 +925,10 @@ cv::Point3d CvGridMap::atPosition3d(const int &r, const int &c, const std::strin
     pos.z = static_cast<double>(layer_data.at<float>(r, c));
   else if (layer_data.type() == CV_64F)
     pos.z = layer_data.at<double>(r, c);
+#ifdef CV_16F
+  else if (layer_data.type() == CV_16F)
+    pos.z = static_cast<double>(static_cast<float>(layer_data.at<cv::float16_t>(r, c)));
+#endif
   else
     throw(std::out_of_range("Error accessing 3d position in CvGridMap: z-coordinate data type not supported."));
   return pos;
@@ -466,6 +944,16 @@ cv::Size2i CvGridMap::size() const
   return m_size;
 }
 
+size_t CvGridMap::getByteSize() const
+{
+  size_t bytes = 0;
+  for (const auto &layer : m_layers)
+    bytes += layer.data.total() * layer.data.elemSize();
+  for (const auto &overview : m_overviews)
+    bytes += overview->getByteSize();
+  return bytes;
+}
+
 cv::Rect2d CvGridMap::roi() const
 {
   return m_roi;
@@ -479,16 +967,45 @@ void CvGridMap::mergeMatrices(const cv::Mat &from, cv::Mat &to, int flag_merge_h
       to = from;
       break;
     case REALM_OVERWRITE_ZERO:
-      cv::Mat mask;
-      if (to.type() == CV_32F || to.type() == CV_64F)
-        mask = (to != to) & (from == from);
-      else
-        mask = (to == 0) & (from > 0);
-      from.copyTo(to, mask);
+      if (from.size() != to.size() || from.type() != to.type())
+        throw(std::invalid_argument("Error merging matrices: Size or type mismatch!"));
+      mergeRows(from, to, flag_merge_handling, cv::Range(0, to.rows));
       break;
   }
 }
 
+cv::Mat CvGridMap::createEmptyData(const cv::Size2i &size, int type)
+{
+  switch(type & CV_MAT_DEPTH_MASK)
+  {
+    case CV_32F:
+      return cv::Mat(size, type, cv::Scalar::all(std::numeric_limits<float>::quiet_NaN()));
+    case CV_64F:
+      return cv::Mat(size, type, cv::Scalar::all(std::numeric_limits<double>::quiet_NaN()));
+#ifdef CV_16F
+    case CV_16F:
+      return cv::Mat(size, type, cv::Scalar::all(std::numeric_limits<float>::quiet_NaN()));
+#endif
+    default:
+      return cv::Mat::zeros(size, type);
+  }
+}
+
+void CvGridMap::resizeData(const cv::Mat &src, cv::Mat &dst, const cv::Size2i &size, int interpolation)
+{
+#ifdef CV_16F
+  if (src.depth() == CV_16F)
+  {
+    cv::Mat src_float;
+    src.convertTo(src_float, CV_32F);
+    cv::resize(src_float, src_float, size, 0.0, 0.0, interpolation);
+    src_float.convertTo(dst, src.type());
+    return;
+  }
+#endif
+  cv::resize(src, dst, size, 0.0, 0.0, interpolation);
+}
+
 bool CvGridMap::isMatrixTypeValid(int type)
 {
   switch(type & CV_MAT_DEPTH_MASK)
@@ -497,6 +1014,10 @@ bool CvGridMap::isMatrixTypeValid(int type)
       return true;
     case CV_64F:
       return true;
+#ifdef CV_16F
+    case CV_16F:
+      return true;
+#endif
     case CV_8U:
       return true;
     case CV_16U:
@@ -514,6 +1035,168 @@ uint32_t CvGridMap::findContainerIdx(const std::string &layer_name)
   throw(std::out_of_range("Error: Index for layer not found!"));
 }
 
+uint32_t CvGridMap::findContainerIdx(const LayerId &layer_id) const
+{
+  if (!exists(layer_id))
+    throw std::out_of_range("No layer with name '" + layer_id.name() + "' available.");
+  return m_lookup_idx_from_id[layer_id.value()] - 1;
+}
+
+bool CvGridMap::hasSameGeometry(const CvGridMap &other) const
+{
+  return m_size == other.m_size
+      && fabs(m_resolution - other.m_resolution) < std::numeric_limits<double>::epsilon()
+      && fabs(m_roi.x - other.m_roi.x) < 10e-6 && fabs(m_roi.y - other.m_roi.y) < 10e-6
+      && fabs(m_roi.width - other.m_roi.width) < 10e-6 && fabs(m_roi.height - other.m_roi.height) < 10e-6;
+}
+
+void CvGridMap::updateLookup()
+{
+  m_lookup_idx_from_id.clear();
+  for (uint32_t i = 0; i < m_layers.size(); ++i)
+  {
+    uint32_t id = LayerId(m_layers[i].name).value();
+    if (id >= m_lookup_idx_from_id.size())
+      m_lookup_idx_from_id.resize(id + 1, 0);
+    m_lookup_idx_from_id[id] = i + 1;
+  }
+}
+
+void CvGridMap::markOverviewsDirty(const cv::Rect2i &roi)
+{
+  if (m_nrof_overviews == 0)
+    return;
+  addDirtyRegion(m_overviews_dirty[0], roi & cv::Rect2i(0, 0, m_size.width, m_size.height));
+}
+
+void CvGridMap::resetOverviews()
+{
+  m_overviews.clear();
+  m_overview_offsets.clear();
+  m_overviews_dirty.assign(static_cast<size_t>(m_nrof_overviews), std::vector<cv::Rect2i>());
+  markOverviewsDirty(cv::Rect2i(0, 0, m_size.width, m_size.height));
+}
+
+void CvGridMap::extendOverviews(const cv::Point2i &shift)
+{
+  if (m_nrof_overviews == 0)
+    return;
+
+  for (auto &roi : m_overviews_dirty[0])
+    roi += shift;
+
+  // Overviews are centred on a fixed grid in the world frame, so old cells keep their values and are only moved. New
+  // cells are derived from empty cells of the level below and are therefore empty as well.
+  for (size_t i = 0; i < m_overviews.size(); ++i)
+  {
+    const CvGridMap &fine = (i == 0 ? *this : *m_overviews[i - 1]);
+    const CvGridMap &previous = *m_overviews[i];
+
+    auto overview = std::make_shared<CvGridMap>();
+    computeOverviewGeometry(fine, *overview, m_overview_offsets[i]);
+
+    cv::Point2i shift_overview(
+        static_cast<int>(std::round((previous.m_roi.x - overview->m_roi.x) / overview->m_resolution)),
+        static_cast<int>(std::round((overview->m_roi.y + overview->m_roi.height - previous.m_roi.y - previous.m_roi.height) / overview->m_resolution)));
+    cv::Rect2i roi_previous(shift_overview, previous.m_size);
+
+    for (const auto &layer : previous.m_layers)
+    {
+      cv::Mat data = createEmptyData(overview->m_size, layer.data.type());
+      layer.data.copyTo(data(roi_previous));
+      overview->m_layers.push_back(Layer{layer.name, data, layer.interpolation});
+    }
+    overview->updateLookup();
+
+    if (i + 1 < m_overviews_dirty.size())
+      for (auto &roi : m_overviews_dirty[i + 1])
+        roi += shift_overview;
+
+    // Views on the previous overview must not be affected, so it is replaced instead of extended in place
+    m_overviews[i] = overview;
+  }
+}
+
+void CvGridMap::updateOverviews(int level)
+{
+  // Overviews are created on the first request, then they are completely marked as changed by resetOverviews()
+  if (m_overviews.empty())
+  {
+    m_overviews.resize(static_cast<size_t>(m_nrof_overviews));
+    m_overview_offsets.resize(static_cast<size_t>(m_nrof_overviews));
+    for (int i = 0; i < m_nrof_overviews; ++i)
+    {
+      m_overviews[i] = std::make_shared<CvGridMap>();
+      computeOverviewGeometry((i == 0 ? *this : *m_overviews[i - 1]), *m_overviews[i], m_overview_offsets[i]);
+    }
+  }
+
+  for (int i = 0; i < level; ++i)
+  {
+    const CvGridMap &fine = (i == 0 ? *this : *m_overviews[i - 1]);
+    CvGridMap &coarse = *m_overviews[i];
+
+    // Layers follow the level below. Layers that are new to this level have to be computed completely.
+    std::vector<Layer> layers;
+    for (const auto &layer : fine.m_layers)
+    {
+      if (layer.data.empty())
+        continue;
+      if (coarse.exists(layer.name) && coarse[layer.name].type() == layer.data.type())
+      {
+        layers.push_back(coarse.getLayer(layer.name));
+        layers.back().interpolation = layer.interpolation;
+        continue;
+      }
+      layers.push_back(Layer{layer.name, createEmptyData(coarse.m_size, layer.data.type()), layer.interpolation});
+      m_overviews_dirty[i].assign(1, cv::Rect2i(0, 0, fine.m_size.width, fine.m_size.height));
+    }
+    coarse.m_layers = layers;
+    coarse.updateLookup();
+
+    for (const auto &roi_fine : m_overviews_dirty[i])
+    {
+      cv::Rect2i roi = computeOverviewRoi(roi_fine, m_overview_offsets[i], coarse.m_size);
+      if (roi.area() <= 0)
+        continue;
+
+      for (size_t j = 0; j < coarse.m_layers.size(); ++j)
+      {
+        const Layer &layer = fine.getLayer(coarse.m_layers[j].name);
+        downsampleLayer(layer.data, m_overview_offsets[i], roi, layer.interpolation == cv::INTER_NEAREST, coarse.m_layers[j].data);
+      }
+
+      if (i + 1 < m_nrof_overviews)
+        addDirtyRegion(m_overviews_dirty[i + 1], roi);
+    }
+    m_overviews_dirty[i].clear();
+  }
+}
+
+void CvGridMap::computeOverviewGeometry(const CvGridMap &fine, CvGridMap &coarse, cv::Point2i &offset)
+{
+  // Cell indices of the upper left cell in the world grid of the fine level, from which the overview grid follows
+  auto left = static_cast<int64_t>(std::llround(fine.m_roi.x / fine.m_resolution));
+  auto top = static_cast<int64_t>(std::llround((fine.m_roi.y + fine.m_roi.height) / fine.m_resolution));
+  int left_coarse = floorDiv(left, 2);
+  int top_coarse = ceilDiv(top, 2);
+  offset.x = static_cast<int>(2 * static_cast<int64_t>(left_coarse) - left);
+  offset.y = static_cast<int>(top - 2 * static_cast<int64_t>(top_coarse));
+
+  // Overview cell i covers the fine cells 2i + offset - 1 to 2i + offset + 1, so the last one has to reach the border
+  int cols = std::max(ceilDiv(fine.m_size.width - 2 - offset.x, 2) + 1, 1);
+  int rows = std::max(ceilDiv(fine.m_size.height - 2 - offset.y, 2) + 1, 1);
+
+  coarse.m_resolution = 2.0 * fine.m_resolution;
+  coarse.m_size = cv::Size2i(cols, rows);
+  coarse.m_roi.x = left_coarse * coarse.m_resolution;
+  coarse.m_roi.width = (cols - 1) * coarse.m_resolution;
+  coarse.m_roi.height = (rows - 1) * coarse.m_resolution;
+  coarse.m_roi.y = top_coarse * coarse.m_resolution - coarse.m_roi.height;
+  coarse.m_layers.clear();
+  coarse.updateLookup();
+}
+
 void CvGridMap::fitGeometryToResolution(const cv::Rect2d &roi_desired, cv::Rect2d &roi_set, cv::Size2i &size_set)
 {
   // We round the geometry of our region of interest to fit exactly into our resolution. So position x,y and dimensions
@@ -1,9 +1,32 @@
 
 
+#include <algorithm>
+#include <cmath>
+
 #include <realm_core/depthmap.h>
 
 using namespace realm;
 
+namespace
+{
+
+// Collects all valid (>0) depths of a CV_32F depth map
+std::vector<float> collectValidDepths(const cv::Mat &data)
+{
+  std::vector<float> depths;
+  depths.reserve(data.total());
+  for (int r = 0; r < data.rows; ++r)
+  {
+    auto row = data.ptr<float>(r);
+    for (int c = 0; c < data.cols; ++c)
+      if (row[c] > 0.0f)
+        depths.push_back(row[c]);
+  }
+  return depths;
+}
+
+} // namespace
+
 Depthmap::Depthmap(const cv::Mat &data, const camera::Pinhole &cam)
  : m_data(data),
    m_cam(std::make_shared<camera::Pinhole>(cam))
@@ -36,6 +59,20 @@ double Depthmap::getMedianDepth() const
   return m_med_depth;
 }
 
+double Depthmap::getDepthQuantile(double q) const
+{
+  if (q < 0.0 || q > 1.0)
+    throw(std::invalid_argument("Error: Quantile of depth must be between 0.0 and 1.0!"));
+
+  std::vector<float> depths = collectValidDepths(m_data);
+  if (depths.empty())
+    throw(std::runtime_error("Error: Depth map has no valid depth!"));
+
+  auto idx = static_cast<size_t>(std::round(q * static_cast<double>(depths.size() - 1)));
+  std::nth_element(depths.begin(), depths.begin() + idx, depths.end());
+  return depths[idx];
+}
+
 cv::Mat& Depthmap::data()
 {
   return m_data;
@@ -43,24 +80,22 @@ cv::Mat& Depthmap::data()
 
 void Depthmap::updateDepthParameters()
 {
-  // First grab min and max values
-  cv::Mat mask = (m_data > 0);
-  cv::minMaxLoc(m_data, &m_min_depth, &m_max_depth, nullptr, nullptr, mask);
-
-  std::vector<float> array;
-  if (m_data.isContinuous()) {
-    array.assign((float*)m_data.data, (float*)m_data.data + m_data.total() * m_data.channels());
-  } else {
-    for (int i = 0; i < m_data.rows; ++i) {
-      array.insert(array.end(), m_data.ptr<float>(i), m_data.ptr<float>(i) + m_data.cols * m_data.channels());
-    }
+  // Invalid depth values are set to -1.0, they are skipped while collecting
+  std::vector<float> depths = collectValidDepths(m_data);
+  if (depths.empty())
+  {
+    m_min_depth = 0.0;
+    m_max_depth = 0.0;
+    m_med_depth = 0.0;
+    return;
   }
 
-  // Invalid depth values are set to -1.0
-  std::vector<float> array_masked;
-  std::copy_if(array.begin(), array.end(), back_inserter(array_masked),[](float n){ return  n > 0.0;});
+  // Selection instead of sorting, so the update stays linear in the number of pixels
+  auto it_minmax = std::minmax_element(depths.begin(), depths.end());
+  m_min_depth = *it_minmax.first;
+  m_max_depth = *it_minmax.second;
 
-  // Find median by sorting the array and get middle value
-  std::sort(array.begin(), array.end());
-  m_med_depth = array[array.size() / 2];
+  auto it_median = depths.begin() + static_cast<std::ptrdiff_t>(depths.size() / 2);
+  std::nth_element(depths.begin(), it_median, depths.end());
+  m_med_depth = *it_median;
 }
\ No newline at end of file
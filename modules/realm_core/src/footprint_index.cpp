@@ -0,0 +1,115 @@
+
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include <realm_core/footprint_index.h>
+
+using namespace realm;
+
+FootprintIndex::FootprintIndex(size_t capacity, double cell_size)
+    : m_capacity(capacity),
+      m_cell_size_init(cell_size),
+      m_cell_size(cell_size),
+      m_next_id(0)
+{
+  if (cell_size < 0.0)
+    throw(std::invalid_argument("Error creating footprint index: Cell size must not be negative."));
+}
+
+void FootprintIndex::add(const cv::Rect2d &roi)
+{
+  if (roi.area() <= 0.0)
+    return;
+
+  if (m_cell_size <= 0.0)
+    m_cell_size = std::max(roi.width, roi.height);
+
+  uint64_t id = m_next_id++;
+  m_footprints.emplace_back(id, roi);
+
+  int64_t c0, r0, c1, r1;
+  computeCellRange(roi, c0, r0, c1, r1);
+  for (int64_t r = r0; r <= r1; ++r)
+    for (int64_t c = c0; c <= c1; ++c)
+      m_cells[computeKey(c, r)].push_back(id);
+
+  if (m_capacity > 0 && m_footprints.size() > m_capacity)
+  {
+    // The oldest footprint is always the first entry in each of its cells, as ids are inserted in increasing order
+    const std::pair<uint64_t, cv::Rect2d> &oldest = m_footprints.front();
+    computeCellRange(oldest.second, c0, r0, c1, r1);
+    for (int64_t r = r0; r <= r1; ++r)
+      for (int64_t c = c0; c <= c1; ++c)
+      {
+        auto it = m_cells.find(computeKey(c, r));
+        if (it == m_cells.end())
+          continue;
+        std::vector<uint64_t> &ids = it->second;
+        ids.erase(std::remove(ids.begin(), ids.end(), oldest.first), ids.end());
+        if (ids.empty())
+          m_cells.erase(it);
+      }
+    m_footprints.pop_front();
+  }
+}
+
+double FootprintIndex::computeMaxOverlap(const cv::Rect2d &roi) const
+{
+  if (m_footprints.empty() || roi.area() <= 0.0)
+    return 0.0;
+
+  // Ids map to the footprints by their offset to the oldest one
+  uint64_t id_front = m_footprints.front().first;
+
+  double area_max = 0.0;
+  std::vector<uint64_t> visited;
+
+  int64_t c0, r0, c1, r1;
+  computeCellRange(roi, c0, r0, c1, r1);
+  for (int64_t r = r0; r <= r1; ++r)
+    for (int64_t c = c0; c <= c1; ++c)
+    {
+      auto it = m_cells.find(computeKey(c, r));
+      if (it == m_cells.end())
+        continue;
+      for (uint64_t id : it->second)
+      {
+        // Footprints spanning several cells are only intersected once
+        if (std::find(visited.begin(), visited.end(), id) != visited.end())
+          continue;
+        visited.push_back(id);
+
+        const cv::Rect2d &footprint = m_footprints[id - id_front].second;
+        area_max = std::max(area_max, (roi & footprint).area());
+      }
+    }
+  return area_max / roi.area() * 100.0;
+}
+
+size_t FootprintIndex::size() const
+{
+  return m_footprints.size();
+}
+
+void FootprintIndex::clear()
+{
+  m_footprints.clear();
+  m_cells.clear();
+  m_cell_size = m_cell_size_init;
+}
+
+void FootprintIndex::computeCellRange(const cv::Rect2d &roi, int64_t &c0, int64_t &r0, int64_t &c1, int64_t &r1) const
+{
+  c0 = static_cast<int64_t>(std::floor(roi.x / m_cell_size));
+  r0 = static_cast<int64_t>(std::floor(roi.y / m_cell_size));
+  c1 = static_cast<int64_t>(std::floor((roi.x + roi.width) / m_cell_size));
+  r1 = static_cast<int64_t>(std::floor((roi.y + roi.height) / m_cell_size));
+}
+
+int64_t FootprintIndex::computeKey(int64_t c, int64_t r)
+{
+  // Cells are well within 32 bit for any realistic flight, so both indices are packed into one key
+  return (r << 32) ^ (c & 0xFFFFFFFF);
+}
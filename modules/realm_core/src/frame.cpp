@@ -1,7 +1,10 @@
 
 
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 #include <realm_core/frame.h>
+#include <realm_core/timer.h>
 
 namespace realm
 {
@@ -28,13 +31,16 @@ Frame::Frame(const std::string &camera_id,
       m_img(img),
       m_utm(utm),
       m_camera_model(cam),
-      m_orientation(orientation.empty() ? cv::Mat::eye(3, 3, CV_64F) : orientation),
+      m_orientation(orientation.empty() ? cv::Mat::eye(3, 3, CV_64F) : orientation.clone()),
       m_img_resize_factor(0.0),
       m_min_depth(0.0),
       m_max_depth(0.0),
       m_med_depth(0.0),
+      m_is_scene_depth_sorted(false),
       m_depthmap(nullptr),
-      m_sparse_cloud(nullptr)
+      m_sparse_cloud(nullptr),
+      m_georeference(nullptr),
+      m_georeference_epoch(0)
 {
   if (m_camera_id.empty())
     throw(std::invalid_argument("Error creating frame: Camera Id not provided!"));
@@ -48,6 +54,12 @@ Frame::Frame(const std::string &camera_id,
 
 // GETTER
 
+MatPool* Frame::getImagePool()
+{
+  static MatPool* pool = MatPool::get("frame");
+  return pool;
+}
+
 std::string Frame::getCameraId() const
 {
   return m_camera_id;
@@ -100,6 +112,27 @@ double Frame::getMedianSceneDepth() const
     throw(std::runtime_error("Error: Depth was not computed!"));
 }
 
+double Frame::getSceneDepthQuantile(double q) const
+{
+  if (q < 0.0 || q > 1.0)
+    throw(std::invalid_argument("Error: Quantile of scene depth must be between 0.0 and 1.0!"));
+  if (!isDepthComputed())
+    throw(std::runtime_error("Error: Depth was not computed!"));
+
+  std::lock_guard<std::mutex> lock(m_mutex_sparse_points);
+  if (!m_is_scene_depth_sorted)
+  {
+    std::sort(m_scene_depths.begin(), m_scene_depths.end());
+    m_is_scene_depth_sorted = true;
+  }
+
+  double idx = q * static_cast<double>(m_scene_depths.size() - 1);
+  auto idx_lower = static_cast<size_t>(std::floor(idx));
+  size_t idx_upper = std::min(idx_lower + 1, m_scene_depths.size() - 1);
+  double w = idx - static_cast<double>(idx_lower);
+  return (1.0 - w) * m_scene_depths[idx_lower] + w * m_scene_depths[idx_upper];
+}
+
 Depthmap::Ptr Frame::getDepthmap() const
 {
   return m_depthmap;
@@ -123,7 +156,7 @@ cv::Mat Frame::getImageUndistorted() const
   cv::Mat img_undistorted;
 
   if(m_camera_model->hasDistortion())
-    img_undistorted = m_camera_model->undistort(m_img, cv::InterpolationFlags::INTER_LINEAR);
+    img_undistorted = m_camera_model->undistort(m_img, cv::InterpolationFlags::INTER_LINEAR, getImagePool());
   else
     img_undistorted = m_img;
   return std::move(img_undistorted);
@@ -154,29 +187,59 @@ cv::Mat Frame::getResizedImageUndistorted() const
 {
   // - Resized image will be calculated and set with first
   // access to avoid multiple costly resizing procedures
-  // - Check also if resize factor has not changed in the
-  // meantime
+  // - Undistorted image is cached as well until the resize
+  // factor changes
   // - No deep copy
-  if (isImageResizeSet())
-  {
-    camera::Pinhole cam_resized = m_camera_model->resize(m_img_resize_factor);
-    return cam_resized.undistort(m_img_resized, cv::InterpolationFlags::INTER_LINEAR);
-  }
-  else
+  if (!isImageResizeSet())
     throw(std::invalid_argument("Error: Image resize factor not set!"));
+
+  // Undistortion maps are held by the resized camera, which has its own lock
+  camera::Pinhole::Ptr cam_resized = getResizedCamera();
+
+  std::lock_guard<std::mutex> lock(m_mutex_img_resized);
+  if (m_img_resized_undistorted.empty())
+    m_img_resized_undistorted = cam_resized->undistort(m_img_resized, cv::InterpolationFlags::INTER_LINEAR, getImagePool());
+  return m_img_resized_undistorted;
 }
 
 cv::Mat Frame::getResizedImageRaw() const
 {
   // deep copy, as it might be painted or modified
-  return m_img_resized.clone();
+  return getResizedImageRawView().clone();
+}
+
+cv::Mat Frame::getResizedImageRawView() const
+{
+  // - No deep copy
+  std::lock_guard<std::mutex> lock(m_mutex_img_resized);
+  return m_img_resized;
+}
+
+cv::Mat Frame::getResizedImageGray() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex_img_resized);
+  if (!m_is_img_resizing_set)
+    throw(std::invalid_argument("Error: Image resize factor not set!"));
+
+  if (m_img_resized_gray.empty())
+  {
+    if (m_img_resized.channels() == 3 || m_img_resized.channels() == 4)
+      m_img_resized_gray = getImagePool()->create(m_img_resized.size(), CV_MAKETYPE(m_img_resized.depth(), 1));
+
+    if (m_img_resized.channels() == 3)
+      cv::cvtColor(m_img_resized, m_img_resized_gray, cv::COLOR_BGR2GRAY);
+    else if (m_img_resized.channels() == 4)
+      cv::cvtColor(m_img_resized, m_img_resized_gray, cv::COLOR_BGRA2GRAY);
+    else
+      m_img_resized_gray = m_img_resized;
+  }
+  return m_img_resized_gray;
 }
 
 cv::Mat Frame::getResizedCalibration() const
 {
-  std::lock_guard<std::mutex> lock(m_mutex_cam);
   if (isImageResizeSet())
-    return m_camera_model->resize(m_img_resize_factor).K();
+    return getResizedCamera()->K();
   else
     throw(std::runtime_error("Error resizing camera: Image resizing was not set!"));
 }
@@ -184,7 +247,16 @@ cv::Mat Frame::getResizedCalibration() const
 PointCloud::Ptr Frame::getSparseCloud() const
 {
   std::lock_guard<std::mutex> lock(m_mutex_sparse_points);
-  return m_sparse_cloud;
+  if (!m_sparse_cloud || m_sparse_cloud_transformation.empty())
+    return m_sparse_cloud;
+
+  if (!m_sparse_cloud_transformed)
+  {
+    auto sparse_cloud = std::make_shared<PointCloud>(*m_sparse_cloud);
+    sparse_cloud->transform(m_sparse_cloud_transformation);
+    m_sparse_cloud_transformed = sparse_cloud;
+  }
+  return m_sparse_cloud_transformed;
 }
 
 void Frame::setDepthmap(const Depthmap::Ptr &depthmap)
@@ -212,17 +284,35 @@ cv::Mat Frame::getPose() const
 
 cv::Mat Frame::getVisualPose() const
 {
-  return m_motion_c2w.clone();
+  return getVisualPoseView().clone();
+}
+
+cv::Mat Frame::getVisualPoseView() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex_cam);
+  return m_motion_c2w;
 }
 
 cv::Mat Frame::getGeographicPose() const
 {
-  return m_motion_c2g.clone();
+  return getGeographicPoseView().clone();
+}
+
+cv::Mat Frame::getGeographicPoseView() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex_cam);
+  return m_motion_c2g;
 }
 
 cv::Mat Frame::getGeoreference() const
 {
-  return m_transformation_w2g.clone();
+  return getGeoreferenceView().clone();
+}
+
+cv::Mat Frame::getGeoreferenceView() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex_T_w2g);
+  return m_transformation_w2g;
 }
 
 SurfaceAssumption Frame::getSurfaceAssumption() const
@@ -260,22 +350,51 @@ uint64_t Frame::getTimestamp() const
   return m_timestamp;
 }
 
+double Frame::getImageResizeFactor() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex_img_resized);
+  return m_img_resize_factor;
+}
+
 camera::Pinhole::Ptr Frame::getResizedCamera() const
 {
   assert(m_is_img_resizing_set);
-  return std::make_shared<camera::Pinhole>(m_camera_model->resize(m_img_resize_factor));
+  std::lock_guard<std::mutex> lock(m_mutex_cam);
+
+  // Resizing computes the undistortion maps, so the resized camera is only created once per resize factor. A camera
+  // that was handed out is never modified. If the pose changed since, a copy with the current pose replaces it.
+  if (m_camera_resized == nullptr)
+  {
+    m_camera_resized = std::make_shared<camera::Pinhole>(m_camera_model->resize(m_img_resize_factor));
+  }
+  else
+  {
+    cv::Mat pose = m_camera_model->pose();
+    cv::Mat pose_resized = m_camera_resized->pose();
+    if (!pose.empty() && (pose_resized.empty() || cv::norm(pose, pose_resized, cv::NORM_INF) > 0.0))
+    {
+      auto cam_resized = std::make_shared<camera::Pinhole>(*m_camera_resized);
+      cam_resized->setPose(pose);
+      m_camera_resized = cam_resized;
+    }
+  }
+  return m_camera_resized;
 }
 
 // SETTER
 
 void Frame::setVisualPose(const cv::Mat &pose)
 {
-  m_motion_c2w = pose;
+  // Copied once on write, so views handed out before stay unchanged and getters do not have to copy
+  {
+    std::lock_guard<std::mutex> lock(m_mutex_cam);
+    m_motion_c2w = pose.clone();
+  }
 
   // If frame is already georeferenced, then set camera pose as geographic pose. Otherwise use visual pose
   if (m_is_georeferenced)
   {
-    cv::Mat M_c2g = applyTransformationToVisualPose(m_transformation_w2g);
+    cv::Mat M_c2g = applyTransformationToVisualPose(getGeoreferenceView());
     setGeographicPose(M_c2g);
   }
   else
@@ -293,7 +412,7 @@ void Frame::setGeographicPose(const cv::Mat &pose)
   {
     std::lock_guard<std::mutex> lock(m_mutex_cam);
     m_camera_model->setPose(pose);
-    m_motion_c2g = pose;
+    m_motion_c2g = pose.clone();
     setPoseAccurate(true);
   }
 }
@@ -315,8 +434,11 @@ void Frame::setSparseCloud(const PointCloud::Ptr &sparse_cloud, bool in_visual_c
 
   m_mutex_sparse_points.lock();
   m_sparse_cloud = sparse_cloud;
+  m_sparse_cloud_transformation.release();
+  m_sparse_cloud_transformed = nullptr;
   m_mutex_sparse_points.unlock();
 
+  // The cloud is shared as it is, the georeference is only applied on read
   m_mutex_flags.lock();
   if (in_visual_coordinates && m_is_georeferenced)
   {
@@ -365,10 +487,25 @@ void Frame::setSurfaceAssumption(SurfaceAssumption assumption)
 
 void Frame::setImageResizeFactor(const double &value)
 {
-  std::lock_guard<std::mutex> lock(m_mutex_img_resized);
-  m_img_resize_factor = value;
-  cv::resize(m_img, m_img_resized, cv::Size(), m_img_resize_factor, m_img_resize_factor);
-  m_is_img_resizing_set = true;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex_img_resized);
+    if (m_is_img_resizing_set && m_img_resize_factor == value && !m_img_resized.empty())
+      return;
+
+    m_img_resize_factor = value;
+
+    // Output is allocated upfront with the size cv::resize would compute, so the buffer comes from the pool
+    cv::Size2i size_resized(cv::saturate_cast<int>(m_img.cols*m_img_resize_factor),
+                            cv::saturate_cast<int>(m_img.rows*m_img_resize_factor));
+    m_img_resized = getImagePool()->create(size_resized, m_img.type());
+    cv::resize(m_img, m_img_resized, cv::Size(), m_img_resize_factor, m_img_resize_factor);
+    m_img_resized_gray.release();
+    m_img_resized_undistorted.release();
+    m_is_img_resizing_set = true;
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex_cam);
+  m_camera_resized = nullptr;
 }
 
 
@@ -378,10 +515,40 @@ void Frame::initGeoreference(const cv::Mat &T)
 {
   assert(!T.empty());
 
-  m_transformation_w2g = cv::Mat::eye(4, 4, CV_64F);
+  {
+    std::lock_guard<std::mutex> lock(m_mutex_T_w2g);
+    m_transformation_w2g = cv::Mat::eye(4, 4, CV_64F);
+  }
   updateGeoreference(T, true);
 }
 
+void Frame::setSharedGeoreference(const Georeference::Ptr &georeference)
+{
+  std::lock_guard<std::mutex> lock(m_mutex_georeference);
+  m_georeference = georeference;
+  m_georeference_epoch = 0;
+}
+
+bool Frame::resolveGeoreference()
+{
+  std::lock_guard<std::mutex> lock(m_mutex_georeference);
+  if (!m_georeference)
+    return false;
+
+  uint64_t epoch;
+  std::shared_ptr<const cv::Mat> T_w2g = m_georeference->getTransformation(&epoch);
+  if (epoch == m_georeference_epoch || T_w2g == nullptr)
+    return false;
+
+  // Sparse cloud is still in the visual world on the first resolution, later only the difference is applied
+  if (m_georeference_epoch == 0)
+    initGeoreference(*T_w2g);
+  else
+    updateGeoreference(*T_w2g, true);
+  m_georeference_epoch = epoch;
+  return true;
+}
+
 bool Frame::isKeyframe() const
 {
   std::lock_guard<std::mutex> lock(m_mutex_flags);
@@ -412,6 +579,99 @@ bool Frame::hasAccuratePose() const
   return m_has_accurate_pose;
 }
 
+void Frame::addTraceEvent(const std::string &stage, TraceEvent event)
+{
+  auto t = static_cast<uint64_t>(Timer::getCurrentTimeNanoseconds());
+
+  std::lock_guard<std::mutex> lock(m_mutex_trace);
+  auto it = std::find_if(m_trace.rbegin(), m_trace.rend(), [&](const StageTrace &trace){ return trace.stage == stage; });
+  StageTrace *trace;
+  if (it != m_trace.rend())
+    trace = &(*it);
+  else
+  {
+    m_trace.push_back(StageTrace{stage, 0, 0, 0, 0});
+    trace = &m_trace.back();
+  }
+
+  switch (event)
+  {
+    case TraceEvent::ENQUEUED:
+      trace->t_enqueued = t;
+      break;
+    case TraceEvent::DEQUEUED:
+      trace->t_dequeued = t;
+      break;
+    case TraceEvent::PROCESS_START:
+      trace->t_process_start = t;
+      break;
+    case TraceEvent::PROCESS_END:
+      trace->t_process_end = t;
+      break;
+  }
+}
+
+std::vector<StageTrace> Frame::getTrace() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex_trace);
+  return m_trace;
+}
+
+size_t Frame::getByteSize() const
+{
+  size_t bytes = m_img.total() * m_img.elemSize();
+  {
+    std::lock_guard<std::mutex> lock(m_mutex_img_resized);
+    bytes += m_img_resized.total() * m_img_resized.elemSize();
+    if (m_img_resized_gray.data != m_img_resized.data)
+      bytes += m_img_resized_gray.total() * m_img_resized_gray.elemSize();
+    if (m_img_resized_undistorted.data != m_img_resized.data)
+      bytes += m_img_resized_undistorted.total() * m_img_resized_undistorted.elemSize();
+  }
+
+  if (m_depthmap)
+    bytes += m_depthmap->data().total() * m_depthmap->data().elemSize();
+
+  {
+    // Not read through getSparseCloud, which would create the transformed cloud
+    std::lock_guard<std::mutex> lock(m_mutex_sparse_points);
+    if (m_sparse_cloud)
+      bytes += m_sparse_cloud->getByteSize();
+    if (m_sparse_cloud_transformed)
+      bytes += m_sparse_cloud_transformed->getByteSize();
+  }
+
+  if (CvGridMap::Ptr surface_model = getSurfaceModel())
+    bytes += surface_model->getByteSize();
+
+  if (CvGridMap::Ptr orthophoto = getOrthophoto())
+    bytes += orthophoto->getByteSize();
+
+  return bytes;
+}
+
+void Frame::releaseImage()
+{
+  m_img.release();
+  std::lock_guard<std::mutex> lock(m_mutex_img_resized);
+  m_img_resized.release();
+  m_img_resized_gray.release();
+  m_img_resized_undistorted.release();
+}
+
+void Frame::releaseDepthmap()
+{
+  m_depthmap = nullptr;
+}
+
+void Frame::releaseSparseCloud()
+{
+  std::lock_guard<std::mutex> lock(m_mutex_sparse_points);
+  m_sparse_cloud = nullptr;
+  m_sparse_cloud_transformation.release();
+  m_sparse_cloud_transformed = nullptr;
+}
+
 std::string Frame::print()
 {
   std::lock_guard<std::mutex> lock(m_mutex_flags);
@@ -429,7 +689,7 @@ std::string Frame::print()
     sprintf(buffer + strlen(buffer), "Pose: Exists [%i x %i]\n", pose.rows, pose.cols);
   std::lock_guard<std::mutex> lock2(m_mutex_sparse_points);
   if (!m_sparse_cloud->empty())
-    sprintf(buffer + strlen(buffer), "Mappoints: %i\n", m_sparse_cloud->data().rows);
+    sprintf(buffer + strlen(buffer), "Mappoints: %i\n", m_sparse_cloud->size());
 
   return std::string(buffer);
 }
@@ -445,25 +705,24 @@ void Frame::computeSceneDepth(int max_nrof_points)
    * w=depth=(r31,r32,r33,t_z)*(x,y,z,1)
    */
 
+  std::lock_guard<std::mutex> lock(m_mutex_sparse_points);
   if (!m_sparse_cloud || m_sparse_cloud->empty())
     return;
 
-  std::lock_guard<std::mutex> lock(m_mutex_sparse_points);
-
   // The user can limit the number of points on which the depth is computed. The increment for the iteration later on
   // is changed accordingly.
   int n = 0;
   int inc = 1;
 
-  cv::Mat sparse_data = m_sparse_cloud->data();
-  if (max_nrof_points == 0 || sparse_data.rows < max_nrof_points)
+  int nrof_points = m_sparse_cloud->size();
+  if (max_nrof_points == 0 || nrof_points < max_nrof_points)
   {
-    n = sparse_data.rows;
+    n = nrof_points;
   }
   else
   {
     n = max_nrof_points;
-    inc = sparse_data.rows * (max_nrof_points / sparse_data.rows);
+    inc = nrof_points * (max_nrof_points / nrof_points);
 
     // Just to make sure we don't run into an infinite loop
     if (inc <= 0)
@@ -482,18 +741,42 @@ void Frame::computeSceneDepth(int max_nrof_points)
   cv::Mat R_wc2 = T_w2c.row(2).colRange(0, 3).t();
   double z_wc = T_w2c.at<double>(2, 3);
 
+  // Positions are relative to the origin of the cloud, so its depth is added once
+  const cv::Point3d &origin = m_sparse_cloud->getOrigin();
+  double r[3]{R_wc2.at<double>(0), R_wc2.at<double>(1), R_wc2.at<double>(2)};
+
+  // Transformation of the cloud applied on read is folded into the depth axis, d = r*(A*p + b) + z = (A^T*r)*p + r*b + z
+  if (!m_sparse_cloud_transformation.empty())
+  {
+    const cv::Mat &T = m_sparse_cloud_transformation;
+    double r_T[3];
+    for (int c = 0; c < 3; ++c)
+      r_T[c] = r[0]*T.at<double>(0, c) + r[1]*T.at<double>(1, c) + r[2]*T.at<double>(2, c);
+    z_wc += r[0]*T.at<double>(0, 3) + r[1]*T.at<double>(1, 3) + r[2]*T.at<double>(2, 3);
+    std::copy(r_T, r_T + 3, r);
+  }
+  double depth_origin = r[0]*origin.x + r[1]*origin.y + r[2]*origin.z + z_wc;
+
+  const std::vector<cv::Point3f> &positions = m_sparse_cloud->getPositions();
   for (int i = 0; i < n; i += inc)
   {
-    cv::Mat pt = sparse_data.row(i).colRange(0, 3).t();
+    const cv::Point3f &pt = positions[i];
 
     // Depth calculation
-    double depth = R_wc2.dot(pt) + z_wc;
+    double depth = r[0]*pt.x + r[1]*pt.y + r[2]*pt.z + depth_origin;
     depths.push_back(depth);
   }
-  sort(depths.begin(), depths.end());
-  m_min_depth = depths[0];
-  m_max_depth = depths[depths.size() - 1];
-  m_med_depth = depths[(depths.size() - 1) / 2];
+  // Selection instead of sorting, the depths are only sorted if a quantile is requested
+  auto it_minmax = std::minmax_element(depths.begin(), depths.end());
+  m_min_depth = *it_minmax.first;
+  m_max_depth = *it_minmax.second;
+
+  auto it_median = depths.begin() + static_cast<std::ptrdiff_t>((depths.size() - 1) / 2);
+  std::nth_element(depths.begin(), it_median, depths.end());
+  m_med_depth = *it_median;
+
+  m_scene_depths = std::move(depths);
+  m_is_scene_depth_sorted = false;
   m_is_depth_computed = true;
 }
 
@@ -504,9 +787,10 @@ void Frame::updateGeoreference(const cv::Mat &T, bool do_update_sparse_cloud)
   setGeographicPose(M_c2g);
 
   // In case we want to update the surface points as well, we have to compute the difference of old and new transformation.
-  if (do_update_sparse_cloud && !m_transformation_w2g.empty())
+  cv::Mat T_w2g = getGeoreferenceView();
+  if (do_update_sparse_cloud && !T_w2g.empty())
   {
-    cv::Mat T_diff = computeGeoreferenceDifference(m_transformation_w2g, T);
+    cv::Mat T_diff = computeGeoreferenceDifference(T_w2g, T);
     applyTransformationToSparseCloud(T_diff);
   }
 
@@ -521,30 +805,35 @@ cv::Mat Frame::getOrientation() const
   return m_orientation.clone();
 }
 
+cv::Mat Frame::getOrientationView() const
+{
+  // - No deep copy, set once on construction
+  return m_orientation;
+}
+
 void Frame::applyTransformationToSparseCloud(const cv::Mat &T)
 {
+  std::lock_guard<std::mutex> lock(m_mutex_sparse_points);
   if (m_sparse_cloud && !m_sparse_cloud->empty())
   {
-    cv::Mat sparse_data = m_sparse_cloud->data();
-    m_mutex_sparse_points.lock();
-    for (uint32_t i = 0; i < sparse_data.rows; ++i)
-    {
-      cv::Mat pt = sparse_data.row(i).colRange(0, 3).t();
-      pt.push_back(1.0);
-      cv::Mat pt_hom = T * pt;
-      pt_hom.pop_back();
-      sparse_data.row(i) = pt_hom.t();
-    }
-    m_mutex_sparse_points.unlock();
+    // Transformations are accumulated, the points are only transformed on the next read
+    cv::Mat T_4x4 = cv::Mat::eye(4, 4, CV_64F);
+    T.rowRange(0, 3).copyTo(T_4x4.rowRange(0, 3));
+    if (m_sparse_cloud_transformation.empty())
+      m_sparse_cloud_transformation = T_4x4;
+    else
+      m_sparse_cloud_transformation = T_4x4 * m_sparse_cloud_transformation;
+    m_sparse_cloud_transformed = nullptr;
   }
 }
 
 cv::Mat Frame::applyTransformationToVisualPose(const cv::Mat &T)
 {
-  if (!m_motion_c2w.empty())
+  cv::Mat M_c2w = getVisualPoseView();
+  if (!M_c2w.empty())
   {
     cv::Mat T_c2w = cv::Mat::eye(4, 4, CV_64F);
-    m_motion_c2w.copyTo(T_c2w.rowRange(0, 3).colRange(0, 4));
+    M_c2w.copyTo(T_c2w.rowRange(0, 3).colRange(0, 4));
 
     cv::Mat T_c2g = T * T_c2w;
     cv::Mat M_c2g = T_c2g.rowRange(0, 3).colRange(0, 4);
@@ -0,0 +1,118 @@
+
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <realm_core/frame_merger.h>
+#include <realm_core/profiling.h>
+#include <realm_core/timer.h>
+
+using namespace realm;
+
+FrameMerger::FrameMerger(int64_t max_delay, const ReleaseFunc &release)
+ : m_max_delay(max_delay),
+   m_release(release),
+   m_has_released(false),
+   m_timestamp_released(0),
+   m_nrof_late(0)
+{
+  if (!m_release)
+    throw(std::invalid_argument("Error creating frame merger: Release function is not set!"));
+}
+
+void FrameMerger::add(const Frame::Ptr &frame)
+{
+  long t_now = Timer::getCurrentTimeMilliseconds();
+  auto lock = uniqueLockProfiled(m_mutex, "Wait FrameMerger::m_mutex");
+
+  uint64_t &watermark = m_watermarks[frame->getCameraId()];
+  watermark = std::max(watermark, frame->getTimestamp());
+
+  // Order can not be restored anymore, so waiting would only delay it further
+  if (m_has_released && frame->getTimestamp() < m_timestamp_released)
+  {
+    m_nrof_late++;
+    m_release(frame);
+  }
+  else
+    m_queue.push(Entry{frame, t_now});
+
+  releaseReady(t_now);
+}
+
+void FrameMerger::update()
+{
+  long t_now = Timer::getCurrentTimeMilliseconds();
+  auto lock = uniqueLockProfiled(m_mutex, "Wait FrameMerger::m_mutex");
+  releaseReady(t_now);
+}
+
+void FrameMerger::flush()
+{
+  auto lock = uniqueLockProfiled(m_mutex, "Wait FrameMerger::m_mutex");
+  while (!m_queue.empty())
+    releaseTop();
+}
+
+void FrameMerger::clear()
+{
+  auto lock = uniqueLockProfiled(m_mutex, "Wait FrameMerger::m_mutex");
+  m_queue = decltype(m_queue)();
+  m_watermarks.clear();
+  m_has_released = false;
+  m_timestamp_released = 0;
+}
+
+size_t FrameMerger::size() const
+{
+  auto lock = uniqueLockProfiled(m_mutex, "Wait FrameMerger::m_mutex");
+  return m_queue.size();
+}
+
+size_t FrameMerger::getNrofCameras() const
+{
+  auto lock = uniqueLockProfiled(m_mutex, "Wait FrameMerger::m_mutex");
+  return m_watermarks.size();
+}
+
+uint64_t FrameMerger::getNrofLate() const
+{
+  auto lock = uniqueLockProfiled(m_mutex, "Wait FrameMerger::m_mutex");
+  return m_nrof_late;
+}
+
+void FrameMerger::releaseReady(long t_now)
+{
+  while (!m_queue.empty())
+  {
+    const Entry &top = m_queue.top();
+
+    // Ready, if no camera can deliver an older frame anymore or it waited long enough for the silent ones
+    bool is_ready = (t_now - top.t_arrival >= m_max_delay);
+    if (!is_ready)
+    {
+      uint64_t timestamp = top.frame->getTimestamp();
+      is_ready = true;
+      for (const auto &watermark : m_watermarks)
+        if (watermark.second < timestamp)
+        {
+          is_ready = false;
+          break;
+        }
+    }
+
+    if (!is_ready)
+      break;
+    releaseTop();
+  }
+}
+
+void FrameMerger::releaseTop()
+{
+  Frame::Ptr frame = m_queue.top().frame;
+  m_queue.pop();
+
+  m_has_released = true;
+  m_timestamp_released = std::max(m_timestamp_released, frame->getTimestamp());
+  m_release(frame);
+}
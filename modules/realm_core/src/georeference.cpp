@@ -0,0 +1,45 @@
+
+
+#include <stdexcept>
+
+#include <realm_core/georeference.h>
+
+using namespace realm;
+
+Georeference::Georeference()
+    : m_epoch(0)
+{
+}
+
+uint64_t Georeference::update(const cv::Mat &T_w2g)
+{
+  if (T_w2g.empty())
+    throw(std::invalid_argument("Error updating georeference: Transformation is empty!"));
+
+  // Copied outside of the lock, readers only wait for the pointer swap
+  auto T = std::make_shared<const cv::Mat>(T_w2g.clone());
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_T_w2g = std::move(T);
+  return ++m_epoch;
+}
+
+std::shared_ptr<const cv::Mat> Georeference::getTransformation(uint64_t* epoch) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (epoch != nullptr)
+    *epoch = m_epoch;
+  return m_T_w2g;
+}
+
+uint64_t Georeference::getEpoch() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_epoch;
+}
+
+bool Georeference::isInitialized() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_T_w2g != nullptr;
+}
@@ -0,0 +1,103 @@
+
+
+#include <algorithm>
+#include <cmath>
+
+#include <realm_core/latency_histogram.h>
+
+using namespace realm;
+
+constexpr int LatencyHistogram::kSubBucketBits;
+constexpr int LatencyHistogram::kMaxValueBits;
+
+LatencyHistogram::LatencyHistogram()
+    : m_counts(computeIndex((uint64_t(1) << kMaxValueBits) - 1) + 1, 0),
+      m_count(0),
+      m_max(0)
+{
+}
+
+void LatencyHistogram::add(double value_ms)
+{
+  uint64_t value = 0;
+  if (value_ms > 0.0)
+    value = static_cast<uint64_t>(std::min(value_ms * 1000.0, static_cast<double>((uint64_t(1) << kMaxValueBits) - 1)));
+
+  m_counts[computeIndex(value)]++;
+  m_count++;
+  m_max = std::max(m_max, value);
+}
+
+double LatencyHistogram::getPercentile(double percentile) const
+{
+  if (m_count == 0)
+    return 0.0;
+
+  percentile = std::min(std::max(percentile, 0.0), 100.0);
+  auto rank = static_cast<uint64_t>(std::ceil(percentile / 100.0 * static_cast<double>(m_count)));
+  rank = std::max(rank, uint64_t(1));
+
+  uint64_t counted = 0;
+  for (size_t i = 0; i < m_counts.size(); ++i)
+  {
+    counted += m_counts[i];
+    if (counted >= rank)
+      return static_cast<double>(std::min(computeValue(i), m_max)) / 1000.0;
+  }
+  return getMax();
+}
+
+LatencyPercentiles LatencyHistogram::getPercentiles() const
+{
+  return LatencyPercentiles{getPercentile(50.0), getPercentile(90.0), getPercentile(99.0), getPercentile(99.9),
+                            getMax(), m_count};
+}
+
+double LatencyHistogram::getMax() const
+{
+  return static_cast<double>(m_max) / 1000.0;
+}
+
+uint64_t LatencyHistogram::getCount() const
+{
+  return m_count;
+}
+
+void LatencyHistogram::reset()
+{
+  std::fill(m_counts.begin(), m_counts.end(), 0);
+  m_count = 0;
+  m_max = 0;
+}
+
+size_t LatencyHistogram::computeIndex(uint64_t value)
+{
+  const uint64_t nrof_sub_buckets = uint64_t(1) << kSubBucketBits;
+
+  // Small values are recorded exactly
+  if (value < nrof_sub_buckets)
+    return static_cast<size_t>(value);
+
+  // Bucket is given by the highest bit, the sub bucket by the following kSubBucketBits - 1 bits
+  int msb = 0;
+  while ((value >> (msb + 1)) != 0)
+    msb++;
+  int shift = msb - kSubBucketBits + 1;
+  uint64_t sub_bucket = (value >> shift) - nrof_sub_buckets / 2;
+
+  return static_cast<size_t>(nrof_sub_buckets + (shift - 1) * (nrof_sub_buckets / 2) + sub_bucket);
+}
+
+uint64_t LatencyHistogram::computeValue(size_t idx)
+{
+  const uint64_t nrof_sub_buckets = uint64_t(1) << kSubBucketBits;
+  if (idx < nrof_sub_buckets)
+    return idx;
+
+  uint64_t offset = idx - nrof_sub_buckets;
+  int shift = static_cast<int>(offset / (nrof_sub_buckets / 2)) + 1;
+  uint64_t sub_bucket = offset % (nrof_sub_buckets / 2) + nrof_sub_buckets / 2;
+
+  // Middle of the value range [sub_bucket << shift, (sub_bucket + 1) << shift)
+  return (sub_bucket << shift) + (uint64_t(1) << (shift - 1));
+}
@@ -0,0 +1,58 @@
+
+
+#include <realm_core/map_delta_assembler.h>
+
+using namespace realm;
+
+MapDeltaAssembler::MapDeltaAssembler()
+    : m_map(nullptr),
+      m_version(0),
+      m_is_consistent(false)
+{
+}
+
+void MapDeltaAssembler::applyFull(const CvGridMap &map, uint64_t version)
+{
+  if (m_map && version < m_version)
+    return;
+
+  m_map = std::make_shared<CvGridMap>(map.clone());
+  m_version = version;
+  m_is_consistent = true;
+}
+
+bool MapDeltaAssembler::applyDelta(const CvGridMap &delta, uint64_t version)
+{
+  if (m_map && version <= m_version)
+    return m_is_consistent;
+
+  if (!m_map)
+  {
+    // First update starts the map. It is only complete, if it is the first one of the publisher.
+    m_map = std::make_shared<CvGridMap>(delta.clone());
+    m_is_consistent = (version == 1);
+  }
+  else
+  {
+    m_map->add(delta, REALM_OVERWRITE_ALL, true);
+    m_is_consistent = (m_is_consistent && version == m_version + 1);
+  }
+
+  m_version = version;
+  return m_is_consistent;
+}
+
+CvGridMap::ConstPtr MapDeltaAssembler::getMap() const
+{
+  return m_map;
+}
+
+uint64_t MapDeltaAssembler::getVersion() const
+{
+  return m_version;
+}
+
+bool MapDeltaAssembler::isConsistent() const
+{
+  return m_is_consistent;
+}
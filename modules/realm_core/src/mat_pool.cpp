@@ -0,0 +1,249 @@
+
+
+#include <map>
+
+#ifdef REALM_CORE_WITH_CUDA
+#include <cuda_runtime.h>
+#endif
+
+#include <realm_core/mat_pool.h>
+
+using namespace realm;
+
+namespace
+{
+
+// Pools are intentionally never destroyed, matrices may still be released during static destruction
+std::mutex g_mutex_pools;
+std::map<std::string, MatPool*>* g_pools = new std::map<std::string, MatPool*>();
+
+bool isPinnedMemoryAvailable()
+{
+#ifdef REALM_CORE_WITH_CUDA
+  static const bool is_available = []
+  {
+    int nrof_devices = 0;
+    return cudaGetDeviceCount(&nrof_devices) == cudaSuccess && nrof_devices > 0;
+  }();
+  return is_available;
+#else
+  return false;
+#endif
+}
+
+uchar* allocateBuffer(size_t bytes, MatPool::Memory &memory)
+{
+#ifdef REALM_CORE_WITH_CUDA
+  if (memory == MatPool::Memory::PINNED)
+  {
+    // Portable, so the buffer is pinned for all devices and contexts of the process
+    void* data = nullptr;
+    if (cudaHostAlloc(&data, bytes, cudaHostAllocMapped | cudaHostAllocPortable) == cudaSuccess)
+      return static_cast<uchar*>(data);
+
+    // Page-locked memory is limited, after that the buffers are allocated regularly
+    cudaGetLastError();
+  }
+#endif
+  memory = MatPool::Memory::PAGEABLE;
+  return static_cast<uchar*>(cv::fastMalloc(bytes));
+}
+
+void freeBuffer(uchar* data, MatPool::Memory memory)
+{
+#ifdef REALM_CORE_WITH_CUDA
+  if (memory == MatPool::Memory::PINNED)
+  {
+    cudaFreeHost(data);
+    return;
+  }
+#endif
+  cv::fastFree(data);
+}
+
+} // namespace
+
+MatPool::MatPool(size_t max_cached_bytes)
+    : m_max_cached_bytes(max_cached_bytes),
+      m_cached_bytes(0),
+      m_nrof_reused(0),
+      m_memory(Memory::PAGEABLE)
+{
+}
+
+MatPool* MatPool::get(const std::string &name)
+{
+  std::lock_guard<std::mutex> lock(g_mutex_pools);
+  auto it = g_pools->find(name);
+  if (it == g_pools->end())
+    it = g_pools->emplace(name, new MatPool(256*1024*1024)).first;
+  return it->second;
+}
+
+cv::Mat MatPool::create(const cv::Size2i &size, int type) const
+{
+  cv::Mat mat;
+  mat.allocator = const_cast<MatPool*>(this);
+  mat.create(size, type);
+  return mat;
+}
+
+cv::Mat MatPool::zeros(const cv::Size2i &size, int type) const
+{
+  cv::Mat mat = create(size, type);
+  mat.setTo(cv::Scalar::all(0));
+  return mat;
+}
+
+void MatPool::setMaxCachedBytes(size_t bytes)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_max_cached_bytes = bytes;
+}
+
+size_t MatPool::getCachedBytes() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_cached_bytes;
+}
+
+size_t MatPool::getNrofReused() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_nrof_reused;
+}
+
+void MatPool::clear()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (auto &buffers : m_buffers)
+    for (uchar* buffer : buffers.second)
+      freeBuffer(buffer, m_memory);
+  m_buffers.clear();
+  m_cached_bytes = 0;
+}
+
+bool MatPool::setMemory(Memory memory)
+{
+  if (memory == Memory::PINNED && !isPinnedMemoryAvailable())
+    return false;
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (memory == m_memory)
+    return true;
+
+  // Cached buffers must all be in the memory of new allocations, as they are handed out by size only
+  for (auto &buffers : m_buffers)
+    for (uchar* buffer : buffers.second)
+      freeBuffer(buffer, m_memory);
+  m_buffers.clear();
+  m_cached_bytes = 0;
+  m_memory = memory;
+  return true;
+}
+
+MatPool::Memory MatPool::getMemory() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_memory;
+}
+
+void* MatPool::getDevicePointer(const cv::Mat &mat)
+{
+#ifdef REALM_CORE_WITH_CUDA
+  if (mat.u == nullptr || dynamic_cast<const MatPool*>(mat.u->currAllocator) == nullptr
+      || static_cast<Memory>(mat.u->allocatorFlags_) != Memory::PINNED)
+    return nullptr;
+
+  void* data = nullptr;
+  if (cudaHostGetDevicePointer(&data, mat.u->origdata, 0) != cudaSuccess)
+  {
+    cudaGetLastError();
+    return nullptr;
+  }
+  return static_cast<uchar*>(data) + (mat.data - mat.u->origdata);
+#else
+  return nullptr;
+#endif
+}
+
+cv::UMatData* MatPool::allocate(int dims, const int* sizes, int type, void* data0, size_t* step, AccessFlags flags,
+                                cv::UMatUsageFlags usage_flags) const
+{
+  // Steps are computed exactly like in the standard allocator of OpenCV
+  size_t total = CV_ELEM_SIZE(type);
+  for (int i = dims - 1; i >= 0; --i)
+  {
+    if (step)
+    {
+      if (data0 && step[i] != CV_AUTOSTEP)
+      {
+        CV_Assert(total <= step[i]);
+        total = step[i];
+      }
+      else
+        step[i] = total;
+    }
+    total *= sizes[i];
+  }
+
+  uchar* data = static_cast<uchar*>(data0);
+  Memory memory;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    memory = m_memory;
+    auto it = m_buffers.find(total);
+    if (data == nullptr && it != m_buffers.end() && !it->second.empty())
+    {
+      data = it->second.back();
+      it->second.pop_back();
+      m_cached_bytes -= total;
+      m_nrof_reused++;
+    }
+  }
+  if (data == nullptr)
+    data = allocateBuffer(total, memory);
+  else if (data0)
+    memory = Memory::PAGEABLE;
+
+  // Memory of the buffer is kept with it, so it is freed correctly even if the memory of the pool changed meanwhile
+  auto u = new cv::UMatData(this);
+  u->data = u->origdata = data;
+  u->size = total;
+  u->allocatorFlags_ = static_cast<int>(memory);
+  if (data0)
+    u->flags |= cv::UMatData::USER_ALLOCATED;
+  return u;
+}
+
+bool MatPool::allocate(cv::UMatData* data, AccessFlags access_flags, cv::UMatUsageFlags usage_flags) const
+{
+  return data != nullptr;
+}
+
+void MatPool::deallocate(cv::UMatData* data) const
+{
+  if (data == nullptr)
+    return;
+
+  CV_Assert(data->urefcount == 0);
+  CV_Assert(data->refcount == 0);
+  if (!(data->flags & cv::UMatData::USER_ALLOCATED))
+  {
+    auto memory = static_cast<Memory>(data->allocatorFlags_);
+    bool is_cached = false;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (memory == m_memory && m_cached_bytes + data->size <= m_max_cached_bytes)
+      {
+        m_buffers[data->size].push_back(data->origdata);
+        m_cached_bytes += data->size;
+        is_cached = true;
+      }
+    }
+    if (!is_cached)
+      freeBuffer(data->origdata, memory);
+    data->origdata = nullptr;
+  }
+  delete data;
+}
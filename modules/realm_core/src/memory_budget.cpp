@@ -0,0 +1,39 @@
+
+
+#include <stdexcept>
+
+#include <realm_core/memory_budget.h>
+
+using namespace realm;
+
+MemoryBudget::MemoryBudget(size_t limit)
+    : m_limit(limit),
+      m_usage(0)
+{
+  if (m_limit == 0)
+    throw(std::invalid_argument("Error: Memory budget must be greater zero!"));
+}
+
+void MemoryBudget::update(const std::string &consumer, size_t bytes)
+{
+  std::lock_guard<std::mutex> lock(m_mutex_consumers);
+  size_t &bytes_prev = m_consumers[consumer];
+  m_usage = m_usage - bytes_prev + bytes;
+  bytes_prev = bytes;
+}
+
+size_t MemoryBudget::getUsage() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex_consumers);
+  return m_usage;
+}
+
+size_t MemoryBudget::getLimit() const
+{
+  return m_limit;
+}
+
+bool MemoryBudget::isExceeded() const
+{
+  return getUsage() > m_limit;
+}
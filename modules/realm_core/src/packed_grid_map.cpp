@@ -0,0 +1,266 @@
+
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include <realm_core/loguru.h>
+#include <realm_core/packed_grid_map.h>
+
+using namespace realm;
+
+static_assert(sizeof(PackedGridMap::Cell) == 16, "Cells of the packed grid map must be 16 bytes.");
+
+PackedGridMap::PackedGridMap()
+{
+  for (const auto &layer_name : getLayerNames())
+    m_interpolations[layer_name] = cv::INTER_LINEAR;
+}
+
+void PackedGridMap::blend(const CvGridMap &map, const ThreadPool::Ptr &thread_pool, int nrof_threads)
+{
+  const cv::Mat &src_color = map["color_rgb"];
+  const cv::Mat &src_elevation = map["elevation"];
+  const cv::Mat &src_angle = map["elevation_angle"];
+  const cv::Mat &src_nobs = map["num_observations"];
+  cv::Mat src_elevated;
+  if (map.exists("elevated"))
+    src_elevated = map["elevated"];
+
+  if (src_color.type() != CV_8UC4 || src_elevation.type() != CV_32F || src_angle.type() != CV_32F
+      || src_nobs.type() != CV_16UC1 || (!src_elevated.empty() && src_elevated.type() != CV_8UC1))
+    throw(std::invalid_argument("Error blending: Unexpected layer types!"));
+
+  if (m_cells.empty())
+  {
+    // Interpolation is meta information of the layers, which is restored when unpacking
+    for (const auto &layer_name : getLayerNames())
+      if (map.exists(layer_name))
+        m_interpolations[layer_name] = map.getLayer(layer_name).interpolation;
+
+    m_geometry.setGeometry(map.roi(), map.resolution());
+    m_cells = createEmptyCells(m_geometry.size());
+  }
+  else
+  {
+    if (fabs(m_geometry.resolution() - map.resolution()) > std::numeric_limits<double>::epsilon())
+      throw(std::invalid_argument("Error blending: Resolution mismatch!"));
+    if (!m_geometry.containsRoi(map.roi()))
+      extendToInclude(map.roi());
+  }
+
+  cv::Rect2i roi_idx = m_geometry.atIndexROI(map.roi());
+  if (roi_idx.width != src_color.cols || roi_idx.height != src_color.rows)
+  {
+    LOG_F(WARNING, "Map could not be blended. Matrix dimensions mismatched!");
+    return;
+  }
+
+  // Every cell is first merged like REALM_OVERWRITE_ZERO field by field, then new data is taken if it was observed
+  // under a steeper elevation angle, exactly like the blending of separate layers. Rows are independent.
+  auto blend_rows = [&](const cv::Range &range)
+  {
+    for (int r = range.start; r < range.end; ++r)
+    {
+      Cell* ref_row = ptr(roi_idx.y + r) + roi_idx.x;
+      auto src_color_row = src_color.ptr<cv::Vec4b>(r);
+      auto src_elevation_row = src_elevation.ptr<float>(r);
+      auto src_angle_row = src_angle.ptr<float>(r);
+      auto src_nobs_row = src_nobs.ptr<uint16_t>(r);
+      auto src_elevated_row = (src_elevated.empty() ? nullptr : src_elevated.ptr<uchar>(r));
+
+      for (int c = 0; c < src_color.cols; ++c)
+      {
+        Cell &ref = ref_row[c];
+
+        if (std::isnan(ref.elevation))
+          ref.elevation = src_elevation_row[c];
+        if (std::isnan(ref.elevation_angle))
+          ref.elevation_angle = src_angle_row[c];
+        for (int i = 0; i < 4; ++i)
+          if (ref.color_rgb[i] == 0)
+            ref.color_rgb[i] = src_color_row[c][i];
+        if (ref.num_observations == 0)
+          ref.num_observations = src_nobs_row[c];
+        if (src_elevated_row != nullptr && ref.elevated == 0)
+          ref.elevated = src_elevated_row[c];
+
+        float angle_ref = ref.elevation_angle;
+        if (std::isnan(angle_ref))
+          angle_ref = 0.0f;
+
+        if (src_angle_row[c] > angle_ref)
+        {
+          ref.color_rgb = src_color_row[c];
+          ref.elevation = src_elevation_row[c];
+          ref.elevation_angle = src_angle_row[c];
+          ref.num_observations = cv::saturate_cast<uint16_t>(ref.num_observations + 1);
+        }
+        else
+          ref.elevation_angle = angle_ref;
+      }
+    }
+  };
+
+  parallelFor(thread_pool, cv::Range(0, src_color.rows), blend_rows, nrof_threads);
+}
+
+CvGridMap PackedGridMap::getSubmap(const std::vector<std::string> &layer_names, const cv::Rect2d &roi) const
+{
+  CvGridMap submap;
+  submap.setGeometry(roi, m_geometry.resolution());
+
+  cv::Rect2i roi_idx = m_geometry.atIndexROI(submap.roi());
+  if ((roi_idx & cv::Rect2i(0, 0, m_cells.cols, m_cells.rows)) != roi_idx)
+    throw(std::out_of_range("Error extracting submap: Region of interest is not inside the map."));
+
+  unpack(layer_names, roi_idx, submap);
+  return submap;
+}
+
+CvGridMap PackedGridMap::getGridMap(const std::vector<std::string> &layer_names) const
+{
+  CvGridMap map;
+  if (m_cells.empty())
+    return map;
+
+  map.setGeometry(m_geometry.roi(), m_geometry.resolution());
+  unpack(layer_names, cv::Rect2i(0, 0, m_cells.cols, m_cells.rows), map);
+  return map;
+}
+
+CvGridMap PackedGridMap::getGridMap() const
+{
+  return getGridMap(getLayerNames());
+}
+
+const std::vector<std::string>& PackedGridMap::getLayerNames()
+{
+  static const std::vector<std::string> layer_names{"color_rgb", "elevation", "elevation_angle", "num_observations", "elevated"};
+  return layer_names;
+}
+
+PackedGridMap::Cell* PackedGridMap::ptr(int r)
+{
+  return reinterpret_cast<Cell*>(m_cells.ptr(r));
+}
+
+const PackedGridMap::Cell* PackedGridMap::ptr(int r) const
+{
+  return reinterpret_cast<const Cell*>(m_cells.ptr(r));
+}
+
+PackedGridMap::Cell& PackedGridMap::at(int r, int c)
+{
+  return ptr(r)[c];
+}
+
+const PackedGridMap::Cell& PackedGridMap::at(int r, int c) const
+{
+  return ptr(r)[c];
+}
+
+bool PackedGridMap::empty() const
+{
+  return m_cells.empty();
+}
+
+double PackedGridMap::resolution() const
+{
+  return m_geometry.resolution();
+}
+
+cv::Size2i PackedGridMap::size() const
+{
+  return m_geometry.size();
+}
+
+cv::Rect2d PackedGridMap::roi() const
+{
+  return m_geometry.roi();
+}
+
+size_t PackedGridMap::getByteSize() const
+{
+  return m_cells.total() * m_cells.elemSize();
+}
+
+void PackedGridMap::extendToInclude(const cv::Rect2d &roi)
+{
+  cv::Rect2d roi_prev = m_geometry.roi();
+  m_geometry.extendToInclude(roi);
+
+  cv::Mat cells = createEmptyCells(m_geometry.size());
+  m_cells.copyTo(cells(m_geometry.atIndexROI(roi_prev)));
+  m_cells = cells;
+}
+
+cv::Mat PackedGridMap::createEmptyCells(const cv::Size2i &size)
+{
+  Cell cell_empty{};
+  cell_empty.elevation = std::numeric_limits<float>::quiet_NaN();
+  cell_empty.elevation_angle = std::numeric_limits<float>::quiet_NaN();
+
+  cv::Mat cells(size, CV_8UC(sizeof(Cell)));
+  for (int r = 0; r < cells.rows; ++r)
+  {
+    auto row = reinterpret_cast<Cell*>(cells.ptr(r));
+    std::fill(row, row + cells.cols, cell_empty);
+  }
+  return cells;
+}
+
+void PackedGridMap::unpack(const std::vector<std::string> &layer_names, const cv::Rect2i &roi_idx, CvGridMap &map) const
+{
+  for (const auto &layer_name : layer_names)
+  {
+    cv::Mat data;
+    if (layer_name == "color_rgb")
+      data.create(roi_idx.size(), CV_8UC4);
+    else if (layer_name == "elevation" || layer_name == "elevation_angle")
+      data.create(roi_idx.size(), CV_32F);
+    else if (layer_name == "num_observations")
+      data.create(roi_idx.size(), CV_16UC1);
+    else if (layer_name == "elevated")
+      data.create(roi_idx.size(), CV_8UC1);
+    else
+      throw(std::out_of_range("No layer with name '" + layer_name + "' available."));
+
+    for (int r = 0; r < roi_idx.height; ++r)
+    {
+      const Cell* row = ptr(roi_idx.y + r) + roi_idx.x;
+      if (layer_name == "color_rgb")
+      {
+        auto dst = data.ptr<cv::Vec4b>(r);
+        for (int c = 0; c < roi_idx.width; ++c)
+          dst[c] = row[c].color_rgb;
+      }
+      else if (layer_name == "elevation")
+      {
+        auto dst = data.ptr<float>(r);
+        for (int c = 0; c < roi_idx.width; ++c)
+          dst[c] = row[c].elevation;
+      }
+      else if (layer_name == "elevation_angle")
+      {
+        auto dst = data.ptr<float>(r);
+        for (int c = 0; c < roi_idx.width; ++c)
+          dst[c] = row[c].elevation_angle;
+      }
+      else if (layer_name == "num_observations")
+      {
+        auto dst = data.ptr<uint16_t>(r);
+        for (int c = 0; c < roi_idx.width; ++c)
+          dst[c] = row[c].num_observations;
+      }
+      else
+      {
+        auto dst = data.ptr<uchar>(r);
+        for (int c = 0; c < roi_idx.width; ++c)
+          dst[c] = row[c].elevated;
+      }
+    }
+    map.add(layer_name, data, m_interpolations.at(layer_name));
+  }
+}
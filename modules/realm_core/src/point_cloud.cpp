@@ -1,37 +1,229 @@
 #include <realm_core/point_cloud.h>
 
+#include <cmath>
+
 using namespace realm;
 
 PointCloud::PointCloud()
+ :  m_origin(0.0, 0.0, 0.0)
+{
+}
+
+PointCloud::PointCloud(const cv::Point3d &origin)
+ :  m_origin(origin)
 {
 }
 
 PointCloud::PointCloud(const std::vector<uint32_t> &point_ids, const cv::Mat &data)
- :  m_point_ids(point_ids),
-    m_data(data)
+ :  m_origin(0.0, 0.0, 0.0)
 {
-  if (data.rows != m_point_ids.size())
+  if (data.rows != static_cast<int>(point_ids.size()))
     throw(std::invalid_argument("Error creating sparse cloud: Data - ID mismatch!"));
+  if (data.empty())
+    return;
+  if (data.type() != CV_64F || data.cols < 3)
+    throw(std::invalid_argument("Error creating sparse cloud: Data must be of type CV_64F with at least 3 columns!"));
+
+  bool with_colors = (data.cols >= 6);
+  bool with_normals = (data.cols >= 9);
+
+  m_origin = cv::Point3d(data.at<double>(0, 0), data.at<double>(0, 1), data.at<double>(0, 2));
+  reserve(point_ids.size(), with_colors, with_normals);
+
+  for (int i = 0; i < data.rows; ++i)
+  {
+    auto row = data.ptr<double>(i);
+    cv::Vec3b color;
+    cv::Point3f normal;
+    if (with_colors)
+      color = cv::Vec3b(cv::saturate_cast<uchar>(row[3]), cv::saturate_cast<uchar>(row[4]), cv::saturate_cast<uchar>(row[5]));
+    if (with_normals)
+      normal = cv::Point3f(static_cast<float>(row[6]), static_cast<float>(row[7]), static_cast<float>(row[8]));
+    push_back(point_ids[i], cv::Point3d(row[0], row[1], row[2]), with_colors ? &color : nullptr, with_normals ? &normal : nullptr);
+  }
+}
+
+bool PointCloud::empty() const
+{
+  return m_positions.empty();
+}
+
+int PointCloud::size() const
+{
+  return static_cast<int>(m_positions.size());
+}
+
+void PointCloud::reserve(size_t n, bool with_colors, bool with_normals)
+{
+  m_point_ids.reserve(n);
+  m_positions.reserve(n);
+  if (with_colors)
+    m_colors.reserve(n);
+  if (with_normals)
+    m_normals.reserve(n);
+}
+
+void PointCloud::push_back(uint32_t id, const cv::Point3d &pt, const cv::Vec3b *color, const cv::Point3f *normal)
+{
+  // The first point decides, whether the cloud has colors and normals
+  bool expects_color = (m_positions.empty() ? color != nullptr : hasColors());
+  bool expects_normal = (m_positions.empty() ? normal != nullptr : hasNormals());
+  if ((color != nullptr) != expects_color)
+    throw(std::invalid_argument("Error adding point: Colors must be provided for all points or none!"));
+  if ((normal != nullptr) != expects_normal)
+    throw(std::invalid_argument("Error adding point: Normals must be provided for all points or none!"));
+
+  m_point_ids.push_back(id);
+  m_positions.emplace_back(static_cast<float>(pt.x - m_origin.x),
+                           static_cast<float>(pt.y - m_origin.y),
+                           static_cast<float>(pt.z - m_origin.z));
+  if (color)
+    m_colors.push_back(*color);
+  if (normal)
+    m_normals.push_back(*normal);
+}
+
+const cv::Point3d& PointCloud::getOrigin() const
+{
+  return m_origin;
 }
 
-bool PointCloud::empty()
+cv::Point3d PointCloud::getPoint(size_t i) const
 {
-  if (m_data.empty() || m_data.rows == 0)
-    return true;
-  return false;
+  const cv::Point3f &pt = m_positions[i];
+  return cv::Point3d(m_origin.x + pt.x, m_origin.y + pt.y, m_origin.z + pt.z);
 }
 
-cv::Mat& PointCloud::data()
+const std::vector<cv::Point3f>& PointCloud::getPositions() const
 {
-  return m_data;
+  return m_positions;
 }
 
-std::vector<uint32_t> PointCloud::getPointIds()
+const std::vector<cv::Vec3b>& PointCloud::getColors() const
+{
+  return m_colors;
+}
+
+const std::vector<cv::Point3f>& PointCloud::getNormals() const
+{
+  return m_normals;
+}
+
+bool PointCloud::hasColors() const
+{
+  return !m_colors.empty();
+}
+
+bool PointCloud::hasNormals() const
+{
+  return !m_normals.empty();
+}
+
+const std::vector<uint32_t>& PointCloud::getPointIds() const
 {
   return m_point_ids;
 }
 
-int PointCloud::size()
+void PointCloud::transform(const cv::Mat &T)
+{
+  if (T.type() != CV_64F || T.cols != 4 || T.rows < 3)
+    throw(std::invalid_argument("Error transforming point cloud: Transformation must be (3x4) or (4x4) of type CV_64F!"));
+
+  double R[3][3];
+  double t[3];
+  for (int r = 0; r < 3; ++r)
+  {
+    for (int c = 0; c < 3; ++c)
+      R[r][c] = T.at<double>(r, c);
+    t[r] = T.at<double>(r, 3);
+  }
+
+  // T*(o + p) = (R*o + t) + R*p, so the origin takes the translation and the relative positions only the rotation.
+  // This keeps them small and therefore precise in single precision.
+  cv::Point3d o = m_origin;
+  m_origin = cv::Point3d(R[0][0]*o.x + R[0][1]*o.y + R[0][2]*o.z + t[0],
+                         R[1][0]*o.x + R[1][1]*o.y + R[1][2]*o.z + t[1],
+                         R[2][0]*o.x + R[2][1]*o.y + R[2][2]*o.z + t[2]);
+
+  for (auto &pt : m_positions)
+  {
+    double x = pt.x, y = pt.y, z = pt.z;
+    pt.x = static_cast<float>(R[0][0]*x + R[0][1]*y + R[0][2]*z);
+    pt.y = static_cast<float>(R[1][0]*x + R[1][1]*y + R[1][2]*z);
+    pt.z = static_cast<float>(R[2][0]*x + R[2][1]*y + R[2][2]*z);
+  }
+
+  for (auto &n : m_normals)
+  {
+    double x = n.x, y = n.y, z = n.z;
+    cv::Point3d n_rot(R[0][0]*x + R[0][1]*y + R[0][2]*z,
+                      R[1][0]*x + R[1][1]*y + R[1][2]*z,
+                      R[2][0]*x + R[2][1]*y + R[2][2]*z);
+    double norm = cv::norm(n_rot);
+    if (norm > 0.0)
+      n_rot /= norm;
+    n = cv::Point3f(n_rot);
+  }
+}
+
+cv::Mat PointCloud::toMat() const
 {
-  return m_data.rows;
-}
\ No newline at end of file
+  int cols = (hasNormals() ? 9 : (hasColors() ? 6 : 3));
+  cv::Mat data = cv::Mat::zeros(size(), cols, CV_64F);
+  for (int i = 0; i < data.rows; ++i)
+  {
+    auto row = data.ptr<double>(i);
+    cv::Point3d pt = getPoint(i);
+    row[0] = pt.x;
+    row[1] = pt.y;
+    row[2] = pt.z;
+    if (hasColors())
+    {
+      row[3] = m_colors[i][0];
+      row[4] = m_colors[i][1];
+      row[5] = m_colors[i][2];
+    }
+    if (hasNormals())
+    {
+      row[6] = m_normals[i].x;
+      row[7] = m_normals[i].y;
+      row[8] = m_normals[i].z;
+    }
+  }
+  return data;
+}
+
+size_t PointCloud::getByteSize() const
+{
+  return m_point_ids.size() * sizeof(uint32_t)
+         + m_positions.size() * sizeof(cv::Point3f)
+         + m_colors.size() * sizeof(cv::Vec3b)
+         + m_normals.size() * sizeof(cv::Point3f);
+}
+
+size_t PointCloud::kdtree_get_point_count() const
+{
+  return m_positions.size();
+}
+
+PointCloud::coord_t PointCloud::kdtree_get_pt(size_t idx, int dim) const
+{
+  const cv::Point3f &pt = m_positions[idx];
+  if (dim == 0)
+    return m_origin.x + pt.x;
+  else if (dim == 1)
+    return m_origin.y + pt.y;
+  else
+    return m_origin.z + pt.z;
+}
+
+PointCloud::coord_t PointCloud::kdtree_distance(const coord_t *p1, size_t idx_p2, size_t size) const
+{
+  coord_t dist = 0.0;
+  for (size_t dim = 0; dim < size; ++dim)
+  {
+    coord_t d = p1[dim] - kdtree_get_pt(idx_p2, static_cast<int>(dim));
+    dist += d*d;
+  }
+  return dist;
+}
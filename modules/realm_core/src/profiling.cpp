@@ -0,0 +1,164 @@
+
+
+#include <realm_core/profiling.h>
+
+#ifdef REALM_WITH_PROFILING
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <tracy/Tracy.hpp>
+#include <tracy/TracyC.h>
+
+#ifdef REALM_WITH_PERF_COUNTERS
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <realm_core/loguru.h>
+#endif
+
+using namespace realm;
+
+constexpr int ProfilingZone::kNrofCounters;
+
+namespace
+{
+
+#ifdef REALM_WITH_PERF_COUNTERS
+// Counters in the order they are read, the first one leads the group
+const uint64_t g_counter_configs[ProfilingZone::kNrofCounters] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_REFERENCES,
+    PERF_COUNT_HW_CACHE_MISSES
+};
+
+/*!
+ * @brief Hardware counters of the owning thread, which are opened on first use and read together as a group
+ */
+class PerfCounterGroup
+{
+  public:
+    ~PerfCounterGroup()
+    {
+      for (int fd : m_fds)
+        if (fd >= 0)
+          close(fd);
+    }
+
+    bool read(uint64_t* values)
+    {
+      if (!m_is_opened)
+        open();
+      if (m_fds[0] < 0)
+        return false;
+
+      // Layout of PERF_FORMAT_GROUP: number of counters, followed by their values
+      uint64_t buffer[1 + ProfilingZone::kNrofCounters];
+      if (::read(m_fds[0], buffer, sizeof(buffer)) != static_cast<ssize_t>(sizeof(buffer)))
+        return false;
+      std::memcpy(values, buffer + 1, sizeof(uint64_t) * ProfilingZone::kNrofCounters);
+      return true;
+    }
+
+  private:
+    bool m_is_opened = false;
+    int m_fds[ProfilingZone::kNrofCounters] = {-1, -1, -1, -1};
+
+    void open()
+    {
+      m_is_opened = true;
+      for (int i = 0; i < ProfilingZone::kNrofCounters; ++i)
+      {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = g_counter_configs[i];
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        // Counting the calling thread on any cpu
+        int group_fd = (i == 0 ? -1 : m_fds[0]);
+        m_fds[i] = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0));
+        if (m_fds[i] < 0)
+        {
+          LOG_F(WARNING, "Opening hardware counters for profiling failed: %s. Check /proc/sys/kernel/perf_event_paranoid.",
+                strerror(errno));
+          for (int j = 0; j < i; ++j)
+          {
+            close(m_fds[j]);
+            m_fds[j] = -1;
+          }
+          return;
+        }
+      }
+    }
+};
+
+thread_local PerfCounterGroup g_perf_counters;
+#endif
+
+} // namespace
+
+ProfilingZone::ProfilingZone(const char* name)
+: m_is_open(true),
+  m_has_counters(false)
+{
+  uint64_t srcloc = ___tracy_alloc_srcloc_name(0, "", 0, "", 0, name, strlen(name));
+  TracyCZoneCtx ctx = ___tracy_emit_zone_begin_alloc(srcloc, 1);
+  m_id = ctx.id;
+  m_is_active = ctx.active;
+
+#ifdef REALM_WITH_PERF_COUNTERS
+  if (m_is_active)
+    m_has_counters = g_perf_counters.read(m_counters);
+#endif
+}
+
+ProfilingZone::~ProfilingZone()
+{
+  end();
+}
+
+void ProfilingZone::end()
+{
+  if (!m_is_open)
+    return;
+
+  TracyCZoneCtx ctx;
+  ctx.id = m_id;
+  ctx.active = m_is_active;
+
+#ifdef REALM_WITH_PERF_COUNTERS
+  uint64_t counters[kNrofCounters];
+  if (m_has_counters && g_perf_counters.read(counters))
+  {
+    uint64_t cycles = counters[0] - m_counters[0];
+    uint64_t instructions = counters[1] - m_counters[1];
+    char text[160];
+    int length = snprintf(text, sizeof(text), "cycles: %llu, instructions: %llu (IPC %.2f), cache misses: %llu of %llu",
+                          static_cast<unsigned long long>(cycles),
+                          static_cast<unsigned long long>(instructions),
+                          cycles > 0 ? static_cast<double>(instructions) / static_cast<double>(cycles) : 0.0,
+                          static_cast<unsigned long long>(counters[3] - m_counters[3]),
+                          static_cast<unsigned long long>(counters[2] - m_counters[2]));
+    if (length > 0)
+      ___tracy_emit_zone_text(ctx, text, std::min(static_cast<size_t>(length), sizeof(text) - 1));
+  }
+#endif
+
+  ___tracy_emit_zone_end(ctx);
+  m_is_open = false;
+}
+
+void realm::setProfilingThreadName(const char* name)
+{
+  tracy::SetThreadName(name);
+}
+
+#endif
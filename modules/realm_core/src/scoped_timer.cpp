@@ -0,0 +1,176 @@
+
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <realm_core/loguru.h>
+#include <realm_core/timer.h>
+
+#include <realm_core/scoped_timer.h>
+
+using namespace realm;
+
+constexpr uint32_t TimingRecorder::kFileVersion;
+constexpr size_t TimingRecorder::kBufferCapacity;
+constexpr size_t TimingRecorder::kNameLength;
+
+namespace
+{
+
+void writeString(std::ofstream &file, const std::string &str, size_t length)
+{
+  std::vector<char> buffer(length, '\0');
+  std::memcpy(buffer.data(), str.c_str(), std::min(str.size(), length));
+  file.write(buffer.data(), static_cast<std::streamsize>(length));
+}
+
+} // namespace
+
+TimingRecorder::ThreadBuffer::ThreadBuffer(const std::string &thread_name)
+    : thread_name(thread_name),
+      records(kBufferCapacity)
+{
+}
+
+TimingRecorder::TimingRecorder()
+    : m_is_enabled(false)
+{
+}
+
+TimingRecorder& TimingRecorder::instance()
+{
+  static TimingRecorder recorder;
+  return recorder;
+}
+
+void TimingRecorder::open(const std::string &filepath)
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex_buffers);
+    if (m_is_enabled && m_filepath == filepath)
+      return;
+  }
+
+  close();
+
+  std::unique_lock<std::mutex> lock(m_mutex_buffers);
+  std::ofstream file(filepath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file.is_open())
+    throw(std::runtime_error("Error: Could not open timing file '" + filepath + "' for writing."));
+
+  file.write("RTIM", 4);
+  file.write(reinterpret_cast<const char*>(&kFileVersion), sizeof(kFileVersion));
+
+  m_filepath = filepath;
+  m_is_enabled = true;
+  LOG_F(INFO, "Recording timings to: %s", m_filepath.c_str());
+}
+
+void TimingRecorder::close()
+{
+  if (!m_is_enabled)
+    return;
+
+  flush();
+
+  std::unique_lock<std::mutex> lock(m_mutex_buffers);
+  m_is_enabled = false;
+  m_filepath.clear();
+}
+
+bool TimingRecorder::isEnabled() const
+{
+  return m_is_enabled;
+}
+
+void TimingRecorder::setThreadName(const std::string &name)
+{
+  ThreadBuffer* buffer = getThreadBuffer();
+  std::unique_lock<std::mutex> lock(m_mutex_buffers);
+  buffer->thread_name = name;
+}
+
+void TimingRecorder::record(const char* name, uint64_t t_start, uint64_t t_end)
+{
+  if (!m_is_enabled)
+    return;
+
+  getThreadBuffer()->records.push(TimingRecord{name, t_start, (t_end > t_start ? t_end - t_start : 0)});
+}
+
+size_t TimingRecorder::flush()
+{
+  std::unique_lock<std::mutex> lock(m_mutex_buffers);
+  if (m_filepath.empty())
+    return 0;
+
+  std::ofstream file(m_filepath.c_str(), std::ios::out | std::ios::binary | std::ios::app);
+  if (!file.is_open())
+  {
+    LOG_F(WARNING, "Could not open timing file '%s' for writing.", m_filepath.c_str());
+    return 0;
+  }
+
+  size_t nrof_records = 0;
+  TimingRecord record;
+  for (const auto &buffer : m_buffers)
+  {
+    while (buffer->records.pop(record))
+    {
+      writeString(file, buffer->thread_name, kNameLength);
+      writeString(file, record.name, kNameLength);
+      file.write(reinterpret_cast<const char*>(&record.t_start), sizeof(record.t_start));
+      file.write(reinterpret_cast<const char*>(&record.duration), sizeof(record.duration));
+      nrof_records++;
+    }
+  }
+  return nrof_records;
+}
+
+std::vector<std::pair<std::string, TimingRecord>> TimingRecorder::drain()
+{
+  std::unique_lock<std::mutex> lock(m_mutex_buffers);
+
+  std::vector<std::pair<std::string, TimingRecord>> records;
+  TimingRecord record;
+  for (const auto &buffer : m_buffers)
+    while (buffer->records.pop(record))
+      records.emplace_back(buffer->thread_name, record);
+  return records;
+}
+
+TimingRecorder::ThreadBuffer* TimingRecorder::getThreadBuffer()
+{
+  // Buffers are never destroyed before the recorder, so the pointer stays valid for the lifetime of the thread
+  thread_local ThreadBuffer* buffer = nullptr;
+  if (buffer == nullptr)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex_buffers);
+    m_buffers.emplace_back(new ThreadBuffer("thread_" + std::to_string(m_buffers.size())));
+    buffer = m_buffers.back().get();
+  }
+  return buffer;
+}
+
+ScopedTimer::ScopedTimer(const char* name)
+    : m_name(name),
+      m_t_start(TimingRecorder::instance().isEnabled() ? static_cast<uint64_t>(Timer::getCurrentTimeMicroseconds()) : 0),
+      m_zone(name)
+{
+}
+
+ScopedTimer::~ScopedTimer()
+{
+  stop();
+}
+
+void ScopedTimer::stop()
+{
+  m_zone.end();
+  if (m_t_start == 0)
+    return;
+  TimingRecorder::instance().record(m_name, m_t_start, static_cast<uint64_t>(Timer::getCurrentTimeMicroseconds()));
+  m_t_start = 0;
+}
@@ -3,6 +3,11 @@
 #include <opencv2/calib3d.hpp>
 #include <opencv2/imgproc/imgproc_c.h>
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <realm_core/cpu_dispatch.h>
 #include <realm_core/stereo.h>
 
 void realm::stereo::computeRectification(const Frame::Ptr &frame_left,
@@ -17,16 +22,16 @@ void realm::stereo::computeRectification(const Frame::Ptr &frame_left,
   // inner calib
   cv::Mat K_l = frame_left->getResizedCalibration();
   cv::Mat K_r = frame_right->getResizedCalibration();
-  // distortion
-  cv::Mat D_l = frame_left->getCamera()->distCoeffs();
-  cv::Mat D_r = frame_right->getCamera()->distCoeffs();
+  // distortion, images are already undistorted
+  cv::Mat D_l = cv::Mat::zeros(5, 1, CV_64F);
+  cv::Mat D_r = cv::Mat::zeros(5, 1, CV_64F);
   // exterior calib
-  cv::Mat T_l_w2c = frame_left->getCamera()->Tw2c();
-  cv::Mat T_r_c2w = frame_right->getCamera()->Tc2w();
-  cv::Mat T_lr = T_l_w2c*T_r_c2w;
-  // Now calculate transformation between the cameras
-  // Formula: R = R_1^T * R_2
-  //          t = R_1^T * t_2 - R_1^T*t_1
+  cv::Mat T_l_c2w = frame_left->getCamera()->Tc2w();
+  cv::Mat T_r_w2c = frame_right->getCamera()->Tw2c();
+  cv::Mat T_lr = T_r_w2c*T_l_c2w;
+  // Now calculate transformation from the left into the right camera, as expected by the rectification
+  // Formula: R = R_2^T * R_1
+  //          t = R_2^T * t_1 - R_2^T*t_2
   cv::Mat R = T_lr.rowRange(0, 3).colRange(0, 3);
   cv::Mat t = T_lr.rowRange(0, 3).col(3);
   // Compute rectification parameters
@@ -43,8 +48,8 @@ void realm::stereo::remap(const Frame::Ptr &frame,
 {
   // inner calib
   cv::Mat K = frame->getResizedCalibration();
-  // distortion
-  cv::Mat D = frame->getCamera()->distCoeffs();
+  // distortion, image is already undistorted
+  cv::Mat D = cv::Mat::zeros(5, 1, CV_64F);
   // remapping
   cv::Mat map11, map12;
   initUndistortRectifyMap(K, D, R, P, frame->getResizedImageSize(), CV_16SC2, map11, map12);
@@ -55,32 +60,31 @@ void realm::stereo::remap(const Frame::Ptr &frame,
   cv::remap(img, img_remapped, map11, map12, cv::INTER_LINEAR);
 }
 
-cv::Mat realm::stereo::reprojectDepthMap(const camera::Pinhole::ConstPtr &cam,
-                                         const cv::Mat &depthmap)
+namespace
 {
-  // Chosen formula for reprojection follows the linear projection model:
-  // x = K*(R|t)*X
-  // R^T*K^-1*x-R^T*t = X
-  // If pose is defined as "camera to world", then this formula simplifies to
-  // R*K^-1*x+t=X
-
-  if (depthmap.rows != cam->height() || depthmap.cols != cam->width())
-    throw(std::invalid_argument("Error: Reprojecting depth map failed. Dimension mismatch!"));
-  if (depthmap.type() != CV_32F)
-    throw(std::invalid_argument("Error: Reprojecting depth map failed. Matrix has wrong type. It is expected to have type CV_32F."));
 
-  // Implementation is chosen to be raw array, because it saves round about 30% computation time
+/*!
+ * @brief Computes the rays R * K^-1 * (c, r, 1) of all pixels of a camera, split into a part per column and a part per
+ * row. The ray of a pixel is the sum of both, so every pixel only needs one addition per coordinate.
+ * @param cam Camera model, must contain R, t and K
+ * @param rays_col Output; Ray part of every column including the principal axis
+ * @param rays_row Output; Ray part of every row, which is only its vertical offset
+ */
+template<typename T>
+void computeRays(const realm::camera::Pinhole::ConstPtr &cam,
+                 std::vector<cv::Vec<T, 3>> &rays_col,
+                 std::vector<cv::Vec<T, 3>> &rays_row)
+{
   double fx = cam->fx();
   double fy = cam->fy();
   double cx = cam->cx();
   double cy = cam->cy();
   cv::Mat R_c2w = cam->R();
-  cv::Mat t_c2w = cam->t();
 
   if (fabs(fx) < 10e-6 || fabs(fy) < 10-6 || fabs(cx) < 10e-6 || fabs(cy) < 10e-6)
     throw(std::invalid_argument("Error: Reprojecting depth map failed. Camera model invalid!"));
 
-  if (R_c2w.empty() || t_c2w.empty())
+  if (R_c2w.empty() || cam->t().empty())
     throw(std::invalid_argument("Error: Reprojecting depth map failed. Pose matrix is empty!"));
 
   // Array preparation
@@ -89,50 +93,158 @@ cv::Mat realm::stereo::reprojectDepthMap(const camera::Pinhole::ConstPtr &cam,
     for (uint8_t c = 0; c < 3; ++c)
       ar_R_c2w[r][c] = R_c2w.at<double>(r, c);
 
-  double ar_t_c2w[3];
-  for (uint8_t r = 0; r < 3; ++r)
-      ar_t_c2w[r] = t_c2w.at<double>(r);
+  rays_col.resize(static_cast<size_t>(cam->width()));
+  for (size_t c = 0; c < rays_col.size(); ++c)
+  {
+    double u = (static_cast<double>(c) - cx)/fx;
+    for (int i = 0; i < 3; ++i)
+      rays_col[c][i] = static_cast<T>(ar_R_c2w[i][0]*u + ar_R_c2w[i][2]);
+  }
+  rays_row.resize(static_cast<size_t>(cam->height()));
+  for (size_t r = 0; r < rays_row.size(); ++r)
+  {
+    double v = (static_cast<double>(r) - cy)/fy;
+    for (int i = 0; i < 3; ++i)
+      rays_row[r][i] = static_cast<T>(ar_R_c2w[i][1]*v);
+  }
+}
 
-  // Iteration
-  cv::Mat img3d(depthmap.rows, depthmap.cols, CV_64FC3);
-  for (int r = 0; r < depthmap.rows; ++r)
-    for (int c = 0; c < depthmap.cols; ++c)
-    {
-      cv::Vec3d pt(0, 0, 0);
+/*!
+ * @brief Reprojects a depth map into a 3D image, shared by the double and float variant. Points are computed as
+ * depth * R * K^-1 * (c, r, 1) + t - origin with the precomputed rays of computeRays().
+ * @param origin Origin subtracted from all points, so float coordinates keep their precision far from zero
+ */
+template<typename T>
+cv::Mat reprojectDepthMapImpl(const realm::camera::Pinhole::ConstPtr &cam,
+                              const cv::Mat &depthmap,
+                              const cv::Point3d &origin,
+                              const realm::ThreadPool::Ptr &thread_pool,
+                              int nrof_threads)
+{
+  // Chosen formula for reprojection follows the linear projection model:
+  // x = K*(R|t)*X
+  // R^T*K^-1*x-R^T*t = X
+  // If pose is defined as "camera to world", then this formula simplifies to
+  // R*K^-1*x+t=X
+
+  if (depthmap.rows != cam->height() || depthmap.cols != cam->width())
+    throw(std::invalid_argument("Error: Reprojecting depth map failed. Dimension mismatch!"));
+  if (depthmap.type() != CV_32F)
+    throw(std::invalid_argument("Error: Reprojecting depth map failed. Matrix has wrong type. It is expected to have type CV_32F."));
 
-      auto depth = static_cast<double>(depthmap.at<float>(r, c));
+  std::vector<cv::Vec<T, 3>> rays_col;
+  std::vector<cv::Vec<T, 3>> rays_row;
+  computeRays<T>(cam, rays_col, rays_row);
 
-      if (depth > 0)
-      {
-        // K^-1*(dc,dr,d)
-        double u = (c - cx)*depth/fx;
-        double v = (r - cy)*depth/fy;
+  cv::Mat t_c2w = cam->t();
+  T ar_t[3]{static_cast<T>(t_c2w.at<double>(0) - origin.x),
+            static_cast<T>(t_c2w.at<double>(1) - origin.y),
+            static_cast<T>(t_c2w.at<double>(2) - origin.z)};
+
+  // Rows are independent of each other, every band writes only its own rows
+  cv::Mat img3d(depthmap.rows, depthmap.cols, CV_MAKETYPE(cv::DataType<T>::depth, 3));
+  realm::parallelFor(thread_pool, cv::Range(0, depthmap.rows), [&](const cv::Range &range)
+  {
+    for (int r = range.start; r < range.end; ++r)
+    {
+      auto depth_row = depthmap.ptr<float>(r);
+      auto img3d_row = img3d.ptr<cv::Vec<T, 3>>(r);
+      const cv::Vec<T, 3> &ray_row = rays_row[r];
 
-        pt[0] = ar_R_c2w[0][0]*u + ar_R_c2w[0][1]*v + ar_R_c2w[0][2]*depth + ar_t_c2w[0];
-        pt[1] = ar_R_c2w[1][0]*u + ar_R_c2w[1][1]*v + ar_R_c2w[1][2]*depth + ar_t_c2w[1];
-        pt[2] = ar_R_c2w[2][0]*u + ar_R_c2w[2][1]*v + ar_R_c2w[2][2]*depth + ar_t_c2w[2];
+      for (int c = 0; c < depthmap.cols; ++c)
+      {
+        auto depth = static_cast<T>(depth_row[c]);
+        if (depth > 0)
+        {
+          const cv::Vec<T, 3> &ray_col = rays_col[c];
+          img3d_row[c][0] = depth*(ray_col[0] + ray_row[0]) + ar_t[0];
+          img3d_row[c][1] = depth*(ray_col[1] + ray_row[1]) + ar_t[1];
+          img3d_row[c][2] = depth*(ray_col[2] + ray_row[2]) + ar_t[2];
+        }
+        else
+          img3d_row[c] = cv::Vec<T, 3>(0, 0, 0);
       }
-      img3d.at<cv::Vec3d>(r, c) = pt;
     }
+  }, nrof_threads);
   return img3d;
 }
 
-cv::Mat realm::stereo::computeDepthMapFromPointCloud(const camera::Pinhole::ConstPtr &cam, const cv::Mat &points)
+} // namespace
+
+cv::Mat realm::stereo::reprojectDepthMap(const camera::Pinhole::ConstPtr &cam,
+                                         const cv::Mat &depthmap,
+                                         const ThreadPool::Ptr &thread_pool,
+                                         int nrof_threads)
+{
+  return reprojectDepthMapImpl<double>(cam, depthmap, cv::Point3d(0.0, 0.0, 0.0), thread_pool, nrof_threads);
+}
+
+cv::Mat realm::stereo::reprojectDepthMapFloat(const camera::Pinhole::ConstPtr &cam,
+                                              const cv::Mat &depthmap,
+                                              const cv::Point3d &origin,
+                                              const ThreadPool::Ptr &thread_pool,
+                                              int nrof_threads)
+{
+  return reprojectDepthMapImpl<float>(cam, depthmap, origin, thread_pool, nrof_threads);
+}
+
+namespace
+{
+
+// Number of points that are read and projected at once, before they are splatted
+const int g_splat_batch_size = 256;
+
+/*!
+ * @brief Projects a batch of points into the image, see splatPointsToDepthMap. The points are independent of each
+ * other, so every clone of the kernel is vectorized with the register width of its target.
+ * @param nrof_points Number of points in the batch
+ * @param points Points in the world frame as consecutive (x, y, z)
+ * @param cells Output; Index of the cell every point falls into, -1 if it is behind the camera or outside the image
+ * @param depths Output; Depth of every point
+ */
+REALM_CPU_DISPATCH
+void projectPointsBatch(int nrof_points, const double* points, const double (&P)[3][4], const double (&R_w2c)[3],
+                        double zwc, int width, int height, int* cells, float* depths)
+{
+  for (int i = 0; i < nrof_points; ++i)
+  {
+    const double* pt = points + 3*i;
+
+    // Depth calculation, points behind the camera can not be observed
+    double depth = R_w2c[0]*pt[0] + R_w2c[1]*pt[1] + R_w2c[2]*pt[2] + zwc;
+
+    // Projection to image with x = P * X. Truncated coordinates are inside the image for (-1, width) and (-1, height)
+    double w = P[2][0]*pt[0] + P[2][1]*pt[1] + P[2][2]*pt[2] + P[2][3]*1.0;
+    double u = (P[0][0]*pt[0] + P[0][1]*pt[1] + P[0][2]*pt[2] + P[0][3]*1.0)/w;
+    double v = (P[1][0]*pt[0] + P[1][1]*pt[1] + P[1][2]*pt[2] + P[1][3]*1.0)/w;
+
+    bool is_visible = (depth > 0 && u > -1.0 && u < width && v > -1.0 && v < height);
+    cells[i] = (is_visible ? static_cast<int>(v)*width + static_cast<int>(u) : -1);
+    depths[i] = static_cast<float>(depth);
+  }
+}
+
+/*!
+ * @brief Splats points into a depth map, shared by the point cloud layouts. Points are read through an accessor, so
+ * no layout has to be converted first.
+ * @param get_point Accessor with signature bool(int i, double &x, double &y, double &z) in the world frame, returns
+ *        false for points to be skipped
+ */
+template<typename PointAccessor>
+cv::Mat splatPointsToDepthMap(const realm::camera::Pinhole::ConstPtr &cam,
+                              int nrof_points,
+                              const PointAccessor &get_point,
+                              const realm::ThreadPool::Ptr &thread_pool,
+                              int nrof_threads)
 {
   /*
    * Depth computation according to [Hartley2004] "Multiple View Geometry in Computer Vision", S.162 for normalized
    * camera matrix
    */
 
-  if (points.type() != CV_64F)
-    throw(std::invalid_argument("Error: Computing depth map from point cloud failed. Point matrix type should be CV_64F!"));
-
   // Prepare depthmap dimensions
-  uint32_t width = cam->width();
-  uint32_t height = cam->height();
-
-  // Prepare output data
-  cv::Mat depth_map = cv::Mat(height, width, CV_32F, -1.0);
+  auto width = static_cast<int>(cam->width());
+  auto height = static_cast<int>(cam->height());
 
   // Prepare extrinsics
   cv::Mat T_w2c = cam->Tw2c();
@@ -146,47 +258,169 @@ cv::Mat realm::stereo::computeDepthMapFromPointCloud(const camera::Pinhole::Cons
                  P_cv.at<double>(1, 0), P_cv.at<double>(1, 1), P_cv.at<double>(1, 2), P_cv.at<double>(1, 3),
                  P_cv.at<double>(2, 0), P_cv.at<double>(2, 1), P_cv.at<double>(2, 2), P_cv.at<double>(2, 3)};
 
-  for (int i = 0; i < points.rows; ++i)
+  // Points are splatted in chunks, each into its own z-buffer. Only the nearest point of a cell is kept, so merging
+  // the buffers with a minimum gives the same result independent of the order of the points and the number of chunks.
+  const int min_nrof_points_per_chunk = 16384;
+  if (nrof_threads <= 0)
+    nrof_threads = (thread_pool != nullptr ? thread_pool->getNrofThreads() + 1 : cv::getNumThreads());
+  int nrof_chunks = std::max(1, std::min(nrof_threads, nrof_points / min_nrof_points_per_chunk));
+
+  const float depth_empty = std::numeric_limits<float>::max();
+  std::vector<cv::Mat> zbuffers(static_cast<size_t>(nrof_chunks));
+
+  realm::parallelFor(thread_pool, cv::Range(0, nrof_chunks), [&](const cv::Range &range)
   {
-    auto pixel = points.ptr<double>(i);
-    double pt_x = pixel[0];
-    double pt_y = pixel[1];
-    double pt_z = pixel[2];
+    for (int k = range.start; k < range.end; ++k)
+    {
+      cv::Mat zbuffer(height, width, CV_32F, depth_empty);
 
-    // Depth calculation
-    double depth = R_w2c[0]*pt_x + R_w2c[1]*pt_y + R_w2c[2]*pt_z + zwc;
+      int idx_begin = static_cast<int>(static_cast<int64_t>(nrof_points) * k / nrof_chunks);
+      int idx_end = static_cast<int>(static_cast<int64_t>(nrof_points) * (k + 1) / nrof_chunks);
 
-    // Projection to image with x = P * X
-    double w =        P[2][0]*pt_x + P[2][1]*pt_y + P[2][2]*pt_z + P[2][3]*1.0;
-    auto   u = (int)((P[0][0]*pt_x + P[0][1]*pt_y + P[0][2]*pt_z + P[0][3]*1.0)/w);
-    auto   v = (int)((P[1][0]*pt_x + P[1][1]*pt_y + P[1][2]*pt_z + P[1][3]*1.0)/w);
+      // Points are read and projected in batches, only the update of the z-buffer is done per point
+      double points[3*g_splat_batch_size];
+      int cells[g_splat_batch_size];
+      float depths[g_splat_batch_size];
+      auto zbuffer_data = zbuffer.ptr<float>();
 
-    if (u >= 0 && u < width && v >= 0 && v < height)
-    {
-      if (depth > 0)
-        depth_map.at<float>(v, u) = static_cast<float>(depth);
-      else
-        depth_map.at<float>(v, u) = -1.0f;
+      for (int i = idx_begin; i < idx_end; )
+      {
+        int nrof_batch = 0;
+        for (; i < idx_end && nrof_batch < g_splat_batch_size; ++i)
+          if (get_point(i, points[3*nrof_batch], points[3*nrof_batch + 1], points[3*nrof_batch + 2]))
+            nrof_batch++;
+
+        projectPointsBatch(nrof_batch, points, P, R_w2c, zwc, width, height, cells, depths);
+
+        for (int j = 0; j < nrof_batch; ++j)
+          if (cells[j] >= 0)
+            zbuffer_data[cells[j]] = std::min(zbuffer_data[cells[j]], depths[j]);
+      }
+      zbuffers[k] = zbuffer;
     }
-  }
+  }, nrof_chunks);
+
+  cv::Mat depth_map = zbuffers[0];
+  for (size_t k = 1; k < zbuffers.size(); ++k)
+    cv::min(depth_map, zbuffers[k], depth_map);
+  depth_map.setTo(-1.0f, depth_map == depth_empty);
+
   return depth_map;
 }
 
-cv::Mat realm::stereo::computeNormalsFromDepthMap(const cv::Mat& depth)
+} // namespace
+
+cv::Mat realm::stereo::computeDepthMapFromPointCloud(const camera::Pinhole::ConstPtr &cam,
+                                                     const cv::Mat &points,
+                                                     const ThreadPool::Ptr &thread_pool,
+                                                     int nrof_threads)
+{
+  if (points.type() != CV_64F)
+    throw(std::invalid_argument("Error: Computing depth map from point cloud failed. Point matrix type should be CV_64F!"));
+
+  auto get_point = [&](int i, double &x, double &y, double &z)
+  {
+    auto pt = points.ptr<double>(i);
+    x = pt[0];
+    y = pt[1];
+    z = pt[2];
+    return true;
+  };
+  return splatPointsToDepthMap(cam, points.rows, get_point, thread_pool, nrof_threads);
+}
+
+cv::Mat realm::stereo::computeDepthMapFromPointCloud(const camera::Pinhole::ConstPtr &cam,
+                                                     const PointCloud &points,
+                                                     const ThreadPool::Ptr &thread_pool,
+                                                     int nrof_threads)
+{
+  // Positions are read in place, only the origin of the cloud is added
+  const cv::Point3d &origin = points.getOrigin();
+  const std::vector<cv::Point3f> &positions = points.getPositions();
+  auto get_point = [&](int i, double &x, double &y, double &z)
+  {
+    const cv::Point3f &pt = positions[i];
+    x = origin.x + pt.x;
+    y = origin.y + pt.y;
+    z = origin.z + pt.z;
+    return true;
+  };
+  return splatPointsToDepthMap(cam, points.size(), get_point, thread_pool, nrof_threads);
+}
+
+cv::Mat realm::stereo::computeDepthMapFromDepthMap(const camera::Pinhole::ConstPtr &cam,
+                                                   const camera::Pinhole::ConstPtr &cam_src,
+                                                   const cv::Mat &depth_src,
+                                                   const ThreadPool::Ptr &thread_pool,
+                                                   int nrof_threads)
 {
-  // We have to shrink the normal mat by two, because otherwise we would run into border issues as the Kernel as size 3x3
-  cv::Mat normals(depth.rows-2, depth.cols-2, CV_32FC3);
+  if (depth_src.rows != cam_src->height() || depth_src.cols != cam_src->width())
+    throw(std::invalid_argument("Error: Computing depth map from depth map failed. Dimension mismatch!"));
+  if (depth_src.type() != CV_32F)
+    throw(std::invalid_argument("Error: Computing depth map from depth map failed. Depth map type should be CV_32F!"));
 
-  for(int r = 1; r < depth.rows-1; ++r)
-    for(int c = 1; c < depth.cols-1; ++c)
+  std::vector<cv::Vec3d> rays_col;
+  std::vector<cv::Vec3d> rays_row;
+  computeRays<double>(cam_src, rays_col, rays_row);
+  cv::Mat t_c2w = cam_src->t();
+  cv::Vec3d t(t_c2w.at<double>(0), t_c2w.at<double>(1), t_c2w.at<double>(2));
+
+  // Points are reprojected on the fly while splatting, cells without depth are skipped instead of splatting a dummy
+  const int cols = depth_src.cols;
+  auto get_point = [&](int i, double &x, double &y, double &z)
+  {
+    int r = i / cols;
+    int c = i - r * cols;
+    double depth = depth_src.ptr<float>(r)[c];
+    if (!(depth > 0))
+      return false;
+    cv::Vec3d pt = depth * (rays_col[c] + rays_row[r]) + t;
+    x = pt[0];
+    y = pt[1];
+    z = pt[2];
+    return true;
+  };
+  return splatPointsToDepthMap(cam, depth_src.rows * depth_src.cols, get_point, thread_pool, nrof_threads);
+}
+
+cv::Mat realm::stereo::computeNormalsFromDepthMap(const cv::Mat& depth,
+                                                  const ThreadPool::Ptr &thread_pool,
+                                                  int nrof_threads)
+{
+  if (depth.type() != CV_32F)
+    throw(std::invalid_argument("Error: Computing normals failed. Depth map type should be CV_32F!"));
+  if (depth.rows < 3 || depth.cols < 3)
+    throw(std::invalid_argument("Error: Computing normals failed. Depth map must be at least 3x3!"));
+
+  int rows = depth.rows;
+  int cols = depth.cols;
+
+  // The 3x3 kernel is only evaluated inside, the border is reflected from the neighbouring row and column afterwards
+  cv::Mat normals(rows, cols, CV_32FC3);
+
+  parallelFor(thread_pool, cv::Range(1, rows-1), [&](const cv::Range &range)
+  {
+    for (int r = range.start; r < range.end; ++r)
     {
-      float dzdx = (depth.at<float>(r, c+1) - depth.at<float>(r, c-1)) / 2.0f;
-      float dzdy = (depth.at<float>(r+1, c) - depth.at<float>(r-1, c)) / 2.0f;
+      auto d_top = depth.ptr<float>(r-1);
+      auto d_mid = depth.ptr<float>(r);
+      auto d_bot = depth.ptr<float>(r+1);
+      auto n = normals.ptr<cv::Vec3f>(r);
 
-      cv::Vec3f d(-dzdx, -dzdy, 1.0f);
-      normals.at<cv::Vec3f>(r-1, c-1) = d / cv::norm(d);
+      for (int c = 1; c < cols-1; ++c)
+      {
+        float dzdx = (d_mid[c+1] - d_mid[c-1]) * 0.5f;
+        float dzdy = (d_bot[c] - d_top[c]) * 0.5f;
+        float norm_inv = 1.0f / std::sqrt(dzdx*dzdx + dzdy*dzdy + 1.0f);
+        n[c] = cv::Vec3f(-dzdx*norm_inv, -dzdy*norm_inv, norm_inv);
+      }
+      n[0] = n[1];
+      n[cols-1] = n[cols-2];
     }
-  cv::copyMakeBorder(normals, normals, 1, 1, 1, 1, cv::BORDER_REFLECT);
+  }, nrof_threads);
+
+  normals.row(1).copyTo(normals.row(0));
+  normals.row(rows-2).copyTo(normals.row(rows-1));
   return normals;
 }
 
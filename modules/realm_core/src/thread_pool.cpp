@@ -0,0 +1,204 @@
+
+
+#include <algorithm>
+
+#include <realm_core/thread_pool.h>
+
+using namespace realm;
+
+namespace
+{
+
+// Identifies the pool and queue of the current thread, so tasks submitted from inside the pool stay local
+thread_local const ThreadPool *t_pool = nullptr;
+thread_local size_t t_queue_idx = 0;
+
+} // namespace
+
+ThreadPool::ThreadPool(int nrof_threads)
+    : m_stop_requested(false),
+      m_nrof_tasks_queued(0),
+      m_next_queue(0)
+{
+  if (nrof_threads <= 0)
+    nrof_threads = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+
+  for (int i = 0; i < nrof_threads; ++i)
+    m_queues.emplace_back(new WorkQueue);
+  for (int i = 0; i < nrof_threads; ++i)
+    m_threads.emplace_back(&ThreadPool::run, this, static_cast<size_t>(i));
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex_wakeup);
+    m_stop_requested = true;
+  }
+  m_condition_wakeup.notify_all();
+
+  for (auto &thread : m_threads)
+    thread.join();
+}
+
+std::future<void> ThreadPool::submit(const Task &task)
+{
+  auto packaged_task = std::make_shared<std::packaged_task<void()>>(task);
+  std::future<void> future = packaged_task->get_future();
+  push([packaged_task]{ (*packaged_task)(); });
+  return future;
+}
+
+void ThreadPool::parallelFor(const cv::Range &range, const std::function<void(const cv::Range&)> &body, int nstripes)
+{
+  int length = range.end - range.start;
+  if (length <= 0)
+    return;
+
+  if (nstripes <= 0)
+    nstripes = 4 * getNrofThreads();
+  nstripes = std::min(nstripes, length);
+
+  if (nstripes == 1)
+  {
+    body(range);
+    return;
+  }
+
+  // Stripes are claimed through a shared counter by the calling thread and all helper tasks. Helpers that start after
+  // all stripes were claimed return immediately, so the caller only waits for stripes that are actually processed.
+  struct LoopState
+  {
+    std::atomic<int> next_stripe{0};
+    int nrof_finished{0};
+    std::exception_ptr exception{nullptr};
+    std::mutex mutex;
+    std::condition_variable condition;
+  };
+  auto state = std::make_shared<LoopState>();
+
+  auto process_stripes = [state, range, length, nstripes, body]()
+  {
+    int stripe;
+    while ((stripe = state->next_stripe++) < nstripes)
+    {
+      std::exception_ptr exception = nullptr;
+      try
+      {
+        cv::Range sub_range(range.start + static_cast<int>(static_cast<int64_t>(length) * stripe / nstripes),
+                            range.start + static_cast<int>(static_cast<int64_t>(length) * (stripe + 1) / nstripes));
+        body(sub_range);
+      }
+      catch (...)
+      {
+        exception = std::current_exception();
+      }
+
+      std::unique_lock<std::mutex> lock(state->mutex);
+      if (exception && !state->exception)
+        state->exception = exception;
+      if (++state->nrof_finished == nstripes)
+        state->condition.notify_all();
+    }
+  };
+
+  int nrof_helpers = std::min(nstripes - 1, getNrofThreads());
+  for (int i = 0; i < nrof_helpers; ++i)
+    push(process_stripes);
+
+  process_stripes();
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->condition.wait(lock, [&]{ return state->nrof_finished == nstripes; });
+
+  if (state->exception)
+    std::rethrow_exception(state->exception);
+}
+
+int ThreadPool::getNrofThreads() const
+{
+  return static_cast<int>(m_threads.size());
+}
+
+void ThreadPool::run(size_t idx)
+{
+  t_pool = this;
+  t_queue_idx = idx;
+
+  Task task;
+  while (true)
+  {
+    if (tryPop(idx, task))
+    {
+      task();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex_wakeup);
+    m_condition_wakeup.wait(lock, [&]{ return m_stop_requested || m_nrof_tasks_queued > 0; });
+    if (m_stop_requested && m_nrof_tasks_queued == 0)
+      break;
+  }
+}
+
+bool ThreadPool::tryPop(size_t idx, Task &task)
+{
+  // Own queue is processed in submission order, other queues are stolen from the back
+  for (size_t i = 0; i < m_queues.size(); ++i)
+  {
+    WorkQueue &queue = *m_queues[(idx + i) % m_queues.size()];
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty())
+      continue;
+
+    if (i == 0)
+    {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+    }
+    else
+    {
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+    }
+    lock.unlock();
+
+    std::unique_lock<std::mutex> lock_wakeup(m_mutex_wakeup);
+    m_nrof_tasks_queued--;
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::push(const Task &task)
+{
+  size_t idx;
+  if (t_pool == this)
+    idx = t_queue_idx;
+  else
+    idx = m_next_queue++ % m_queues.size();
+
+  // Counter is increased first, so it never drops below the number of tasks inside the queues
+  {
+    std::unique_lock<std::mutex> lock(m_mutex_wakeup);
+    m_nrof_tasks_queued++;
+  }
+  {
+    std::unique_lock<std::mutex> lock(m_queues[idx]->mutex);
+    m_queues[idx]->tasks.push_back(task);
+  }
+  m_condition_wakeup.notify_one();
+}
+
+void realm::parallelFor(const ThreadPool::Ptr &thread_pool,
+                        const cv::Range &range,
+                        const std::function<void(const cv::Range&)> &body,
+                        int nrof_threads)
+{
+  if (nrof_threads == 1)
+    body(range);
+  else if (thread_pool != nullptr)
+    thread_pool->parallelFor(range, body, (nrof_threads > 0 ? nrof_threads : -1));
+  else
+    cv::parallel_for_(range, body, (nrof_threads > 0 ? nrof_threads : -1));
+}
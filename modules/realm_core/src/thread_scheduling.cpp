@@ -0,0 +1,131 @@
+
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sstream>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <realm_core/loguru.h>
+#include <realm_core/thread_scheduling.h>
+
+using namespace realm;
+
+bool ThreadScheduling::isSet() const
+{
+  return !cpus.empty() || nice != 0 || realtime_priority != 0;
+}
+
+std::string ThreadScheduling::toString() const
+{
+  std::stringstream ss;
+  ss << "cpus=";
+  for (size_t i = 0; i < cpus.size(); ++i)
+    ss << (i > 0 ? "," : "") << cpus[i];
+  if (cpus.empty())
+    ss << "all";
+  ss << " nice=" << nice << " realtime_priority=" << realtime_priority;
+  return ss.str();
+}
+
+//! Parses a single core, throws if the text is not entirely a number
+static int parseCpu(const std::string &text)
+{
+  size_t n;
+  int cpu = std::stoi(text, &n);
+  if (n != text.size())
+    throw(std::invalid_argument(text));
+  return cpu;
+}
+
+std::vector<int> realm::parseCpuList(const std::string &list)
+{
+  std::vector<int> cpus;
+  std::stringstream ss(list);
+  std::string item;
+  while (std::getline(ss, item, ','))
+  {
+    if (item.empty())
+      continue;
+
+    int first, last;
+    size_t pos_dash = item.find('-');
+    try
+    {
+      first = parseCpu(item.substr(0, pos_dash));
+      last = (pos_dash == std::string::npos ? first : parseCpu(item.substr(pos_dash + 1)));
+    }
+    catch (const std::logic_error &)
+    {
+      throw(std::invalid_argument("Error parsing cpu list: '" + list + "' is not a list of cores!"));
+    }
+
+    if (first < 0 || last < first)
+      throw(std::invalid_argument("Error parsing cpu list: Range '" + item + "' is invalid!"));
+
+    for (int cpu = first; cpu <= last; ++cpu)
+      cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+bool realm::applyToCurrentThread(const ThreadScheduling &scheduling, const std::string &thread_name)
+{
+  if (!scheduling.isSet())
+    return true;
+
+#ifdef __linux__
+  bool is_applied = true;
+
+  if (!scheduling.cpus.empty())
+  {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (int cpu : scheduling.cpus)
+      CPU_SET(cpu, &cpu_set);
+
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpu_set);
+    if (err != 0)
+    {
+      LOG_F(WARNING, "Thread '%s': Setting cpu affinity failed: %s", thread_name.c_str(), strerror(err));
+      is_applied = false;
+    }
+  }
+
+  if (scheduling.realtime_priority > 0)
+  {
+    sched_param param{};
+    param.sched_priority = scheduling.realtime_priority;
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err != 0)
+    {
+      LOG_F(WARNING, "Thread '%s': Setting real time priority failed: %s", thread_name.c_str(), strerror(err));
+      is_applied = false;
+    }
+  }
+  else if (scheduling.nice != 0)
+  {
+    // On Linux the nice value is an attribute of the thread, not of the whole process
+    auto tid = static_cast<id_t>(syscall(SYS_gettid));
+    if (setpriority(PRIO_PROCESS, tid, scheduling.nice) != 0)
+    {
+      LOG_F(WARNING, "Thread '%s': Setting nice value failed: %s", thread_name.c_str(), strerror(errno));
+      is_applied = false;
+    }
+  }
+
+  if (is_applied)
+    LOG_F(INFO, "Thread '%s': Scheduling set to %s", thread_name.c_str(), scheduling.toString().c_str());
+  return is_applied;
+#else
+  LOG_F(WARNING, "Thread '%s': Scheduling is only supported on Linux and stays unchanged.", thread_name.c_str());
+  return false;
+#endif
+}
@@ -5,35 +5,15 @@
 using namespace realm;
 
 Timer::Timer(const std::chrono::milliseconds &period, const std::function<void()> &func)
-    : m_period(period),
-      m_func(func),
-      m_in_flight(true)
+    : m_task_id(TimerScheduler::instance().add(period, func))
 {
-  // Lambda implementation for threading
-  m_thread = std::thread([this]
-  {
-    while (m_in_flight)
-    {
-      this->interruptable_wait_for(m_period);
-      if (m_in_flight)
-      {
-        m_func();
-      }
-    }
-  });
 }
 
 Timer::~Timer()
 {
-  {
-    std::lock_guard<std::mutex> l(m_stop_mtx);
-      m_in_flight = false;
-  }
-  m_cond.notify_one();
-  m_thread.join();
+  TimerScheduler::instance().remove(m_task_id);
 }
 
-
 long Timer::getCurrentTimeSeconds()
 {
   using namespace std::chrono;
@@ -0,0 +1,94 @@
+
+
+#include <realm_core/timer_scheduler.h>
+
+using namespace realm;
+
+TimerScheduler& TimerScheduler::instance()
+{
+  static TimerScheduler scheduler;
+  return scheduler;
+}
+
+TimerScheduler::TimerScheduler()
+ : m_stop_requested(false),
+   m_id_next(1),
+   m_id_running(0)
+{
+  m_thread = std::thread([this]{ run(); });
+}
+
+TimerScheduler::~TimerScheduler()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop_requested = true;
+  }
+  m_condition_tasks.notify_one();
+  m_thread.join();
+}
+
+TimerScheduler::TaskId TimerScheduler::add(const std::chrono::milliseconds &period, const std::function<void()> &func)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  TaskId id = m_id_next++;
+  m_tasks[id] = Task{period, func};
+  m_queue.push(Entry{Clock::now() + period, id});
+
+  // The new task might be due before the one the thread is currently waiting for
+  m_condition_tasks.notify_one();
+  return id;
+}
+
+void TimerScheduler::remove(TaskId id)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_tasks.erase(id);
+
+  if (std::this_thread::get_id() != m_thread.get_id())
+    m_condition_finished.wait(lock, [this, id]{ return m_id_running != id; });
+}
+
+size_t TimerScheduler::getNrofTasks() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_tasks.size();
+}
+
+void TimerScheduler::run()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_stop_requested)
+  {
+    if (m_queue.empty())
+    {
+      m_condition_tasks.wait(lock);
+      continue;
+    }
+
+    Entry entry = m_queue.top();
+    if (entry.t_due > Clock::now())
+    {
+      m_condition_tasks.wait_until(lock, entry.t_due);
+      continue;
+    }
+    m_queue.pop();
+
+    auto it = m_tasks.find(entry.id);
+    if (it == m_tasks.end())
+      continue;
+
+    // Callback is copied, as the task may be removed while it is executed without the lock
+    std::function<void()> func = it->second.func;
+    m_id_running = entry.id;
+    lock.unlock();
+    func();
+    lock.lock();
+    m_id_running = 0;
+    m_condition_finished.notify_all();
+
+    it = m_tasks.find(entry.id);
+    if (it != m_tasks.end())
+      m_queue.push(Entry{std::max(entry.t_due + it->second.period, Clock::now()), entry.id});
+  }
+}
@@ -5,6 +5,9 @@
 
 #include <functional>
 
+#include <realm_core/profiling.h>
+#include <realm_core/scoped_timer.h>
+#include <realm_core/timer.h>
 #include <realm_core/worker_thread_base.h>
 
 using namespace realm;
@@ -16,6 +19,7 @@ WorkerThreadBase::WorkerThreadBase(const std::string &thread_name, int64_t sleep
   m_reset_requested(false),
   m_stop_requested(false),
   m_is_stopped(false),
+  m_is_event_driven(false),
   m_verbose(verbose),
   m_data_ready_functor([=]{ return isFinishRequested(); })
 {
@@ -39,15 +43,26 @@ void WorkerThreadBase::run()
 {
   // To have better readability in the log file we set the thread name
   loguru::set_thread_name(m_thread_name.c_str());
+  TimingRecorder::instance().setThreadName(m_thread_name);
+  setProfilingThreadName(m_thread_name.c_str());
+  applyToCurrentThread(m_thread_scheduling, m_thread_name);
 
   LOG_IF_F(INFO, m_verbose, "Thread '%s' starting loop...", m_thread_name.c_str());
   bool is_first_run = true;
 
   while (!isFinishRequested())
   {
-    std::unique_lock<std::mutex> lock(m_mutex_processing);
+    // Lock is only held while waiting, so notify() never blocks on the processing
     if (!is_first_run)
-      m_condition_processing.wait_for(lock, std::chrono::milliseconds(m_sleep_time), m_data_ready_functor);
+    {
+      std::unique_lock<std::mutex> lock(m_mutex_processing);
+      if (m_is_event_driven)
+        m_condition_processing.wait(lock, [&]{
+          return m_data_ready_functor() || isStopRequested() || isResetRequested() || isFinishRequested();
+        });
+      else
+        m_condition_processing.wait_for(lock, std::chrono::milliseconds(m_sleep_time), m_data_ready_functor);
+    }
     else
       is_first_run = false;
 
@@ -58,30 +73,31 @@ void WorkerThreadBase::run()
       while (isStopped() && !isFinishRequested())
       {
         if (isResetRequested())
+          executeReset();
+
+        if (m_is_event_driven)
         {
-          reset();
-          LOG_IF_F(INFO, m_verbose, "Thread '%s' reset!", m_thread_name.c_str());
+          std::unique_lock<std::mutex> lock(m_mutex_processing);
+          m_condition_processing.wait(lock, [&]{ return !isStopped() || isResetRequested() || isFinishRequested(); });
         }
-        std::this_thread::sleep_for(std::chrono::milliseconds(m_sleep_time));
+        else
+          std::this_thread::sleep_for(std::chrono::milliseconds(m_sleep_time));
       }
       LOG_IF_F(INFO, m_verbose, "Thread '%s' resumed to loop!", m_thread_name.c_str());
     }
 
     // Check if reset was requested and execute if necessary
     if (isResetRequested())
-    {
-      reset();
-      LOG_IF_F(INFO, m_verbose, "Thread '%s' reset!", m_thread_name.c_str());
-    }
+      executeReset();
 
     // Calls to derived classes implementation of process()
     long t = getCurrentTimeMilliseconds();
+    auto t_start = static_cast<uint64_t>(Timer::getCurrentTimeMicroseconds());
+    ProfilingZone zone_process("Process");
     if (process())
     {
-      LOG_IF_F(INFO,
-               m_verbose,
-               "Timing [Total]: %lu ms",
-               getCurrentTimeMilliseconds() - t);
+      zone_process.end();
+      TimingRecorder::instance().record("Total", t_start, static_cast<uint64_t>(Timer::getCurrentTimeMicroseconds()));
 
       // Only Update statistics for processing if we did work
       std::unique_lock<std::mutex> stat_lock(m_mutex_statistics);
@@ -95,39 +111,75 @@ void WorkerThreadBase::run()
       }
       m_process_statistics.count++;
       m_process_statistics.avg = m_process_statistics.avg + ((double)timing - m_process_statistics.avg) / (double)m_process_statistics.count;
+      m_process_histogram.add((double)timing);
     }
 
   }
+
+  // Write the remaining timings of this thread, the file stays open for other threads
+  TimingRecorder::instance().flush();
   LOG_IF_F(INFO, m_verbose, "Thread '%s' finished!", m_thread_name.c_str());
 }
 
 void WorkerThreadBase::resume()
 {
-  std::unique_lock<std::mutex> lock(m_mutex_is_stopped);
-  if (m_is_stopped)
-    m_is_stopped = false;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex_is_stopped);
+    if (m_is_stopped)
+      m_is_stopped = false;
+  }
+  notify();
 }
 
 void WorkerThreadBase::requestStop()
 {
-  std::unique_lock<std::mutex> lock(m_mutex_stop_requested);
-  m_stop_requested = true;
-  LOG_IF_F(INFO, m_verbose, "Thread '%s' received stop request...", m_thread_name.c_str());
+  {
+    std::unique_lock<std::mutex> lock(m_mutex_stop_requested);
+    m_stop_requested = true;
+    LOG_IF_F(INFO, m_verbose, "Thread '%s' received stop request...", m_thread_name.c_str());
+  }
+  notify();
 }
 
 void WorkerThreadBase::requestReset()
 {
-  std::unique_lock<std::mutex> lock(m_mutex_reset_requested);
-  m_reset_requested = true;
-  LOG_IF_F(INFO, m_verbose, "Thread '%s' received reset request...", m_thread_name.c_str());
+  {
+    std::unique_lock<std::mutex> lock(m_mutex_reset_requested);
+    m_reset_requested = true;
+    LOG_IF_F(INFO, m_verbose, "Thread '%s' received reset request...", m_thread_name.c_str());
+  }
+  notify();
 }
 
 void WorkerThreadBase::requestFinish()
 {
-  std::unique_lock<std::mutex> lock(m_mutex_finish_requested);
-  m_finish_requested = true;
-  LOG_IF_F(INFO, m_verbose, "Thread '%s' received finish request...", m_thread_name.c_str());
-  finishCallback();
+  {
+    std::unique_lock<std::mutex> lock(m_mutex_finish_requested);
+    m_finish_requested = true;
+    LOG_IF_F(INFO, m_verbose, "Thread '%s' received finish request...", m_thread_name.c_str());
+    finishCallback();
+  }
+  notify();
+}
+
+void WorkerThreadBase::setEventDriven(bool is_event_driven)
+{
+  m_is_event_driven = is_event_driven;
+}
+
+void WorkerThreadBase::setThreadScheduling(const ThreadScheduling &scheduling)
+{
+  m_thread_scheduling = scheduling;
+}
+
+void WorkerThreadBase::executeReset()
+{
+  reset();
+
+  // Derived stages may have cleared the flag already, e.g. to distinguish internal from requested resets
+  std::unique_lock<std::mutex> lock(m_mutex_reset_requested);
+  m_reset_requested = false;
+  LOG_IF_F(INFO, m_verbose, "Thread '%s' reset!", m_thread_name.c_str());
 }
 
 bool WorkerThreadBase::isStopRequested()
@@ -163,6 +215,11 @@ bool WorkerThreadBase::isStopped()
 
 void WorkerThreadBase::notify()
 {
+  // Taking the lock once ensures the processing thread is either waiting already or evaluates its wake up condition
+  // after the change of the caller. Otherwise the notification could get lost in between.
+  {
+    std::unique_lock<std::mutex> lock(m_mutex_processing);
+  }
   m_condition_processing.notify_one();
 }
 
@@ -171,6 +228,11 @@ Statistics WorkerThreadBase::getProcessingStatistics() {
   return m_process_statistics;
 }
 
+LatencyHistogram WorkerThreadBase::getProcessingHistogram() {
+  std::unique_lock<std::mutex> lock(m_mutex_statistics);
+  return m_process_histogram;
+}
+
 long WorkerThreadBase::getCurrentTimeMilliseconds()
 {
   using namespace std::chrono;
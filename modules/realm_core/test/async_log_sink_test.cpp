@@ -0,0 +1,60 @@
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include <realm_core/async_log_sink.h>
+#include <realm_core/log_macros.h>
+
+// gtest
+#include <gtest/gtest.h>
+
+using namespace realm;
+
+TEST(AsyncLogSink, WritesMessages)
+{
+  // Here we log through loguru into the asynchronous sink. After flushing, every message must be in the file, which
+  // is written in the same format as the file sinks of loguru.
+  std::string filepath = ::testing::TempDir() + "async_log_sink_test.log";
+  std::remove(filepath.c_str());
+
+  {
+    AsyncLogSink sink(filepath, loguru::Verbosity_MAX);
+    for (int i = 0; i < 100; ++i)
+      LOG_F(INFO, "Message #%i", i);
+    LOG_FRAME_F(INFO, "Frame message");
+    sink.flush();
+
+    EXPECT_EQ(sink.getNrofWritten() + sink.getNrofDropped(), 101u);
+    EXPECT_EQ(sink.getNrofDropped(), 0u);
+  }
+
+  std::ifstream file(filepath);
+  std::string line;
+  int nrof_messages = 0;
+  bool has_frame_message = false;
+  while (std::getline(file, line))
+  {
+    if (line.find("Message #") != std::string::npos)
+      nrof_messages++;
+    if (line.find("Frame message") != std::string::npos)
+      has_frame_message = true;
+  }
+  EXPECT_EQ(nrof_messages, 100);
+  EXPECT_TRUE(has_frame_message);
+}
+
+TEST(AsyncLogSink, CountsDroppedMessages)
+{
+  // For this test the queue only holds a single message. Messages the writer could not keep up with are dropped, but
+  // every message is either written or counted as dropped.
+  std::string filepath = ::testing::TempDir() + "async_log_sink_test_dropped.log";
+  std::remove(filepath.c_str());
+
+  AsyncLogSink sink(filepath, loguru::Verbosity_MAX, 1);
+  for (int i = 0; i < 1000; ++i)
+    LOG_F(INFO, "Message #%i", i);
+  sink.flush();
+
+  EXPECT_EQ(sink.getNrofWritten() + sink.getNrofDropped(), 1000u);
+  EXPECT_GE(sink.getNrofWritten(), 1u);
+}
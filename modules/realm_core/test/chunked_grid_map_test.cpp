@@ -0,0 +1,210 @@
+
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <realm_core/chunked_grid_map.h>
+
+// gtest
+#include <gtest/gtest.h>
+
+using namespace realm;
+
+TEST(ChunkedGridMap, EqualsMonolithicMap)
+{
+  // For this test we add several overlapping submaps once to a classic CvGridMap, which is extended with every submap,
+  // and once to a chunked grid map with a small chunk size. The submaps are spread across negative and positive
+  // coordinates, so chunk boundaries and negative chunk indices are tested as well. Both results must be identical.
+  double res = 0.5;
+  ChunkedGridMap chunked(res, 16);
+
+  CvGridMap::Ptr monolithic;
+  std::vector<cv::Rect2d> rois{cv::Rect2d(-10.0, -5.0, 20.0, 12.0),
+                               cv::Rect2d(3.0, 2.0, 15.0, 30.0),
+                               cv::Rect2d(-25.0, 10.0, 8.0, 4.0)};
+
+  for (size_t i = 0; i < rois.size(); ++i)
+  {
+    CvGridMap submap(rois[i], res);
+    cv::Mat data_float(submap.size(), CV_32F);
+    cv::Mat data_char(submap.size(), CV_8UC1);
+    for (int r = 0; r < data_float.rows; ++r)
+      for (int c = 0; c < data_float.cols; ++c)
+      {
+        data_float.at<float>(r, c) = static_cast<float>(i*1000 + r*data_float.cols + c);
+        data_char.at<uchar>(r, c) = static_cast<uchar>((r + c) % 2 == 0 ? 0 : i + 1);
+      }
+    submap.add("layer_float", data_float);
+    submap.add("layer_char", data_char);
+
+    chunked.add(submap, REALM_OVERWRITE_ZERO);
+    if (monolithic == nullptr)
+      monolithic = std::make_shared<CvGridMap>(submap.clone());
+    else
+      monolithic->add(submap, REALM_OVERWRITE_ZERO, true);
+  }
+
+  EXPECT_GT(chunked.getNumberOfChunks(), 1);
+  EXPECT_TRUE(chunked.exists("layer_float"));
+  EXPECT_FALSE(chunked.exists("layer_double"));
+
+  cv::Rect2d roi_chunked = chunked.roi();
+  cv::Rect2d roi_monolithic = monolithic->roi();
+  EXPECT_NEAR(roi_chunked.x, roi_monolithic.x, 10e-6);
+  EXPECT_NEAR(roi_chunked.y, roi_monolithic.y, 10e-6);
+  EXPECT_NEAR(roi_chunked.width, roi_monolithic.width, 10e-6);
+  EXPECT_NEAR(roi_chunked.height, roi_monolithic.height, 10e-6);
+
+  CvGridMap assembled = chunked.getGridMap();
+  ASSERT_EQ(assembled.size(), monolithic->size());
+
+  // Cells not covered by any submap are NaN in the chunked map, but were filled by the border extension in the
+  // monolithic map. Therefore only cells with a valid chunked value are compared.
+  const cv::Mat &float_chunked = assembled["layer_float"];
+  const cv::Mat &float_monolithic = (*monolithic)["layer_float"];
+  for (int r = 0; r < float_chunked.rows; ++r)
+    for (int c = 0; c < float_chunked.cols; ++c)
+      if (!std::isnan(float_chunked.at<float>(r, c)))
+        EXPECT_FLOAT_EQ(float_chunked.at<float>(r, c), float_monolithic.at<float>(r, c));
+
+  cv::Mat diff_char = (assembled["layer_char"] != (*monolithic)["layer_char"]);
+  EXPECT_EQ(cv::countNonZero(diff_char), 0);
+}
+
+TEST(ChunkedGridMap, SubmapOutsideData)
+{
+  // Extracting a region without any data must not fail, but return empty data
+  ChunkedGridMap chunked(1.0, 8);
+  CvGridMap submap(cv::Rect2d(0.0, 0.0, 10.0, 10.0), 1.0);
+  submap.add("layer_float", cv::Mat(submap.size(), CV_32F, 2.0));
+  chunked.add(submap, REALM_OVERWRITE_ALL);
+
+  CvGridMap extracted = chunked.getSubmap({"layer_float"}, cv::Rect2d(5.0, 5.0, 20.0, 20.0));
+  EXPECT_FLOAT_EQ(extracted["layer_float"].at<float>(extracted.size().height - 1, 0), 2.0f);
+  EXPECT_TRUE(std::isnan(extracted["layer_float"].at<float>(0, extracted.size().width - 1)));
+  EXPECT_THROW(chunked.getSubmap({"layer_char"}, cv::Rect2d(5.0, 5.0, 20.0, 20.0)), std::out_of_range);
+}
+
+TEST(ChunkedGridMap, ByteSize)
+{
+  // Only allocated chunks hold memory, but every allocated chunk holds all its 8 x 8 cells for every layer
+  ChunkedGridMap chunked(1.0, 8);
+  EXPECT_EQ(chunked.getByteSize(), 0u);
+
+  CvGridMap submap(cv::Rect2d(0.0, 0.0, 9.0, 9.0), 1.0);
+  submap.add("layer_float", cv::Mat(submap.size(), CV_32F, 2.0));
+  chunked.add(submap, REALM_OVERWRITE_ALL);
+  EXPECT_EQ(chunked.getByteSize(), chunked.getNumberOfChunks()*8u*8u*sizeof(float));
+}
+
+TEST(ChunkedGridMap, Spill)
+{
+  // Chunks outside the region of interest are written to disk and their memory is released. Extracting data reads them
+  // temporarily, while adding new data loads them back into memory.
+  ChunkedGridMap chunked(1.0, 8);
+  EXPECT_THROW(chunked.spill(cv::Rect2d(0.0, 0.0, 1.0, 1.0)), std::runtime_error);
+  chunked.setSpillDirectory(".");
+
+  CvGridMap submap_near(cv::Rect2d(0.0, 0.0, 7.0, 7.0), 1.0);
+  submap_near.add("layer_float", cv::Mat(submap_near.size(), CV_32F, 1.0));
+  CvGridMap submap_far(cv::Rect2d(100.0, 100.0, 7.0, 7.0), 1.0);
+  submap_far.add("layer_float", cv::Mat(submap_far.size(), CV_32F, 2.0));
+  chunked.add(submap_near, REALM_OVERWRITE_ALL);
+  chunked.add(submap_far, REALM_OVERWRITE_ALL);
+
+  size_t nrof_chunks = chunked.getNumberOfChunks();
+  size_t bytes = chunked.getByteSize();
+  size_t bytes_released = chunked.spill(submap_near.roi());
+  EXPECT_GT(bytes_released, 0u);
+  EXPECT_EQ(chunked.getByteSize(), bytes - bytes_released);
+  EXPECT_EQ(chunked.getNumberOfChunks(), nrof_chunks);
+  EXPECT_GT(chunked.getNumberOfSpilledChunks(), 0u);
+
+  CvGridMap extracted = chunked.getSubmap({"layer_float"}, submap_far.roi());
+  EXPECT_FLOAT_EQ(extracted["layer_float"].at<float>(3, 3), 2.0f);
+  EXPECT_EQ(chunked.getByteSize(), bytes - bytes_released);
+
+  chunked.add(submap_far, REALM_OVERWRITE_ZERO);
+  EXPECT_EQ(chunked.getNumberOfSpilledChunks(), 0u);
+  EXPECT_EQ(chunked.getByteSize(), bytes);
+  EXPECT_FLOAT_EQ(chunked.getSubmap({"layer_float"}, submap_far.roi())["layer_float"].at<float>(3, 3), 2.0f);
+}
+
+TEST(ChunkedGridMap, ChangedRegions)
+{
+  // Every add marks the chunks it touched with a new revision. Only chunks changed after a revision are reported, also
+  // if they were spilled to disk in the meantime. Regions are clipped to the data of the map.
+  ChunkedGridMap chunked(1.0, 8);
+  EXPECT_EQ(chunked.getRevision(), 0u);
+  chunked.setSpillDirectory(".");
+
+  // Both submaps cover exactly one chunk each
+  CvGridMap submap_near(cv::Rect2d(0.0, 1.0, 7.0, 7.0), 1.0);
+  submap_near.add("layer_float", cv::Mat(submap_near.size(), CV_32F, 1.0));
+  CvGridMap submap_far(cv::Rect2d(96.0, 97.0, 3.0, 3.0), 1.0);
+  submap_far.add("layer_float", cv::Mat(submap_far.size(), CV_32F, 2.0));
+
+  chunked.add(submap_near, REALM_OVERWRITE_ALL);
+  uint64_t revision_near = chunked.getRevision();
+  chunked.add(submap_far, REALM_OVERWRITE_ALL);
+  EXPECT_EQ(chunked.getRevision(), revision_near + 1);
+  EXPECT_EQ(chunked.getChangedRegions(0).size(), 2u);
+
+  std::vector<cv::Rect2d> regions = chunked.getChangedRegions(revision_near);
+  ASSERT_EQ(regions.size(), 1u);
+  EXPECT_NEAR(regions[0].x, 96.0, 10e-6);
+  EXPECT_NEAR(regions[0].y, 97.0, 10e-6);
+  EXPECT_NEAR(regions[0].width, 3.0, 10e-6);
+  EXPECT_NEAR(regions[0].height, 3.0, 10e-6);
+
+  chunked.spill(submap_near.roi());
+  EXPECT_EQ(chunked.getChangedRegions(revision_near).size(), 1u);
+  EXPECT_TRUE(chunked.getChangedRegions(chunked.getRevision()).empty());
+}
+
+TEST(ChunkedGridMap, ConcurrentExtraction)
+{
+  // Here we extract regions of the map, while another thread keeps overwriting one of its chunks. Data is locked per
+  // chunk, so every extraction must see the chunk either before or after an add, but never partially written.
+  ChunkedGridMap chunked(1.0, 8);
+  CvGridMap submap_static(cv::Rect2d(-8.0, 1.0, 7.0, 7.0), 1.0);
+  submap_static.add("layer_float", cv::Mat(submap_static.size(), CV_32F, -1.0));
+  chunked.add(submap_static, REALM_OVERWRITE_ALL);
+
+  CvGridMap submap_dynamic(cv::Rect2d(0.0, 1.0, 7.0, 7.0), 1.0);
+  submap_dynamic.add("layer_float", cv::Mat(submap_dynamic.size(), CV_32F, 0.0));
+  chunked.add(submap_dynamic, REALM_OVERWRITE_ALL);
+
+  std::atomic<bool> is_finished(false);
+  std::thread writer([&]()
+  {
+    for (int i = 1; i <= 500; ++i)
+    {
+      submap_dynamic["layer_float"].setTo(static_cast<float>(i));
+      chunked.add(submap_dynamic, REALM_OVERWRITE_ALL);
+    }
+    is_finished = true;
+  });
+
+  // Failures only end the loop, as the writer has to be joined in any case
+  double value_last = 0.0;
+  bool is_consistent = true;
+  while (!is_finished && is_consistent)
+  {
+    CvGridMap extracted = chunked.getSubmap({"layer_float"}, cv::Rect2d(-8.0, 1.0, 15.0, 7.0));
+    const cv::Mat &data = extracted["layer_float"];
+
+    double value_min, value_max;
+    cv::minMaxLoc(data.colRange(8, 16), &value_min, &value_max);
+    is_consistent = (value_min == value_max && value_min >= value_last);
+    value_last = value_min;
+
+    cv::minMaxLoc(data.colRange(0, 8), &value_min, &value_max);
+    is_consistent = (is_consistent && value_min == -1.0 && value_max == -1.0);
+  }
+  writer.join();
+
+  EXPECT_TRUE(is_consistent);
+
+  EXPECT_FLOAT_EQ(chunked.getSubmap({"layer_float"}, submap_dynamic.roi())["layer_float"].at<float>(0, 0), 500.0f);
+}
@@ -1,7 +1,10 @@
 
 
 #include <iostream>
+#include <vector>
+
 #include <realm_core/conversions.h>
+#include <realm_core/projection.h>
 
 // gtest
 #include <gtest/gtest.h>
@@ -25,4 +28,83 @@ TEST(Conversion, UTM_WGS)
   EXPECT_NEAR(utm2.heading, utm.heading, 10e-6);
   EXPECT_EQ(utm2.zone, utm.zone);
   EXPECT_EQ(utm2.band, utm.band);
-}
\ No newline at end of file
+}
+TEST(Conversion, UTM_WGS_Batch)
+{
+  // Here we convert poses of two different zones at once and check that the batch conversion matches the conversion
+  // of the single poses, both in values and in order.
+  std::vector<UTMPose> utm{UTMPose(604347, 5792556, 100.0, 23.0, 32, 'U'),
+                           UTMPose(389440, 5819383, 50.0, 10.0, 33, 'U'),
+                           UTMPose(604500, 5792700, 110.0, 24.0, 32, 'U')};
+
+  std::vector<WGSPose> wgs = gis::convertToWGS84(utm);
+  ASSERT_EQ(wgs.size(), utm.size());
+
+  for (size_t i = 0; i < utm.size(); ++i)
+  {
+    WGSPose wgs_single = gis::convertToWGS84(utm[i]);
+    EXPECT_NEAR(wgs[i].latitude, wgs_single.latitude, 10e-9);
+    EXPECT_NEAR(wgs[i].longitude, wgs_single.longitude, 10e-9);
+    EXPECT_NEAR(wgs[i].altitude, utm[i].altitude, 10e-6);
+    EXPECT_NEAR(wgs[i].heading, utm[i].heading, 10e-6);
+  }
+
+  std::vector<UTMPose> utm2 = gis::convertToUTM(wgs);
+  ASSERT_EQ(utm2.size(), utm.size());
+
+  for (size_t i = 0; i < utm.size(); ++i)
+  {
+    EXPECT_NEAR(utm2[i].easting, utm[i].easting, 10e-6);
+    EXPECT_NEAR(utm2[i].northing, utm[i].northing, 10e-6);
+    EXPECT_EQ(utm2[i].zone, utm[i].zone);
+    EXPECT_EQ(utm2[i].band, utm[i].band);
+  }
+}
+
+TEST(Conversion, NativeUTM)
+{
+  // For this test we project positions on both hemispheres with the closed-form series and compare them with the
+  // conversion by GDAL. Then the positions are projected back, which has to reproduce the input.
+  std::vector<WGSPose> wgs{WGSPose{52.273462, 10.529350, 0.0, 0.0},
+                           WGSPose{48.137154, 11.576124, 0.0, 0.0},
+                           WGSPose{-33.868800, 151.209300, 0.0, 0.0},
+                           WGSPose{69.649205, 18.955324, 0.0, 0.0}};
+
+  for (const auto &pose : wgs)
+  {
+    UTMPose utm = gis::convertToUTM(pose);
+    bool is_northern = (pose.latitude >= 0.0);
+
+    double easting, northing;
+    gis::projection::projectToUTM(pose.latitude, pose.longitude, utm.zone, is_northern, easting, northing);
+    EXPECT_NEAR(easting, utm.easting, 10e-3);
+    EXPECT_NEAR(northing, utm.northing, 10e-3);
+
+    double lat, lon;
+    gis::projection::projectFromUTM(easting, northing, utm.zone, is_northern, lat, lon);
+    EXPECT_NEAR(lat, pose.latitude, 10e-9);
+    EXPECT_NEAR(lon, pose.longitude, 10e-9);
+  }
+}
+
+TEST(Conversion, NativeWebMercator)
+{
+  // Here we project a UTM coordinate into Web Mercator in place and compare it with the projection of its WGS84
+  // position. Projecting back has to reproduce the UTM coordinate.
+  UTMPose utm(604347, 5792556, 100.0, 23.0, 32, 'U');
+  WGSPose wgs = gis::convertToWGS84(utm);
+
+  double mx, my;
+  gis::projection::projectToWebMercator(wgs.latitude, wgs.longitude, mx, my);
+  EXPECT_NEAR(mx, 20037508.342789244 * wgs.longitude / 180.0, 10e-6);
+
+  double x = utm.easting;
+  double y = utm.northing;
+  gis::projection::projectUTMToWebMercator(1, utm.zone, true, &x, &y);
+  EXPECT_NEAR(x, mx, 10e-3);
+  EXPECT_NEAR(y, my, 10e-3);
+
+  gis::projection::projectWebMercatorToUTM(1, utm.zone, true, &x, &y);
+  EXPECT_NEAR(x, utm.easting, 10e-6);
+  EXPECT_NEAR(y, utm.northing, 10e-6);
+}
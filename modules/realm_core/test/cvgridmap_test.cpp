@@ -1,6 +1,8 @@
 
 
+#include <cmath>
 #include <iostream>
+#include <limits>
 #include <realm_core/cv_grid_map.h>
 
 // gtest
@@ -257,6 +259,43 @@ TEST(CvGridMap, Overlap)
   EXPECT_DOUBLE_EQ(size1.height, size2.height);
 }
 
+TEST(CvGridMap, OverlapView)
+{
+  // For this test we extract the overlap of two maps as views and write into them. Other than the deep copy of
+  // getOverlap(...), the changes must be visible in the original maps.
+  CvGridMap map1(cv::Rect2d(0, 0, 20, 30), 1.0);
+  map1.add("layer_double", cv::Mat(map1.size(), CV_64F, 3.1415));
+
+  CvGridMap map2(cv::Rect2d(10, 15, 20, 30), 1.0);
+  map2.add("layer_double", cv::Mat(map2.size(), CV_64F, 6.1415));
+
+  CvGridMap::Overlap overlap_copy = map1.getOverlap(map2);
+  CvGridMap::Overlap overlap_view = map1.getOverlapView(map2);
+
+  EXPECT_DOUBLE_EQ(overlap_copy.first->roi().x, overlap_view.first->roi().x);
+  EXPECT_DOUBLE_EQ(overlap_copy.first->roi().y, overlap_view.first->roi().y);
+  EXPECT_EQ(overlap_copy.first->size(), overlap_view.first->size());
+  EXPECT_EQ(overlap_copy.second->size(), overlap_view.second->size());
+
+  // Upper left element of the overlap is at world position (10, 30)
+  (*overlap_view.first)["layer_double"].at<double>(0, 0) = 1.0;
+  (*overlap_view.second)["layer_double"].setTo(2.0);
+  (*overlap_copy.first)["layer_double"].at<double>(1, 1) = 1.0;
+
+  cv::Point2i idx1 = map1.atIndex(cv::Point2d(10.0, 30.0));
+  cv::Point2i idx2 = map2.atIndex(cv::Point2d(10.0, 30.0));
+  EXPECT_DOUBLE_EQ(map1["layer_double"].at<double>(idx1.y, idx1.x), 1.0);
+  EXPECT_DOUBLE_EQ(map1["layer_double"].at<double>(idx1.y + 1, idx1.x + 1), 3.1415);
+  EXPECT_DOUBLE_EQ(map2["layer_double"].at<double>(idx2.y, idx2.x), 2.0);
+  EXPECT_DOUBLE_EQ(map2["layer_double"].at<double>(0, map2.size().width - 1), 6.1415);
+
+  // Submap views behave the same
+  CvGridMap submap_view = map1.getSubmapView({"layer_double"}, cv::Rect2d(10.0, 25.0, 5.0, 5.0));
+  submap_view["layer_double"].setTo(4.0);
+  EXPECT_DOUBLE_EQ(map1["layer_double"].at<double>(idx1.y, idx1.x), 4.0);
+  EXPECT_ANY_THROW(map1.getSubmapView({"layer_double"}, cv::Rect2d(50.0, 50.0, 5.0, 5.0)));
+}
+
 TEST(CvGridMap, LayerManagement)
 {
   CvGridMap map(cv::Rect2d(0, 0, 20, 30), 1.0);
@@ -297,6 +336,102 @@ TEST(CvGridMap, LayerManagement)
   EXPECT_EQ(map.empty(), true);
 }
 
+TEST(CvGridMap, LayerId)
+{
+  // Here we access layers through interned handles. Handles of the same name must be equal, stay valid for copies
+  // and follow the layers when others are removed or added in between.
+  CvGridMap::LayerId id_a("a");
+  CvGridMap::LayerId id_b("b");
+  EXPECT_EQ(id_a, CvGridMap::LayerId("a"));
+  EXPECT_NE(id_a, id_b);
+  EXPECT_EQ(id_b.name(), "b");
+
+  CvGridMap map(cv::Rect2d(0, 0, 20, 30), 1.0);
+  EXPECT_EQ(map.exists(id_a), false);
+  EXPECT_ANY_THROW(map.get(id_a));
+
+  map.add("a", cv::Mat(map.size(), CV_8UC1, 50));
+  map.add("b", cv::Mat(map.size(), CV_8UC1, 100));
+  EXPECT_EQ(map.exists(id_a), true);
+  EXPECT_EQ(map[id_a].at<uchar>(5, 5), 50);
+  EXPECT_EQ(map[id_b].at<uchar>(5, 5), 100);
+
+  // Writing through the handle modifies the layer
+  map[id_b].at<uchar>(5, 5) = 75;
+  EXPECT_EQ(map["b"].at<uchar>(5, 5), 75);
+
+  // Removing the first layer shifts the container, the handle must still find the right one
+  map.remove("a");
+  EXPECT_EQ(map.exists(id_a), false);
+  EXPECT_EQ(map[id_b].at<uchar>(5, 5), 75);
+
+  const CvGridMap copy = map;
+  EXPECT_EQ(copy[id_b].at<uchar>(5, 5), 75);
+  EXPECT_ANY_THROW(copy[id_a]);
+}
+
+TEST(CvGridMap, AddMove)
+{
+  // For this test we move a submap of the same geometry into a map. New layers and overwritten layers must take over
+  // the buffers of the submap, merged layers must keep their own. Afterwards the submap has no layers left.
+  CvGridMap map(cv::Rect2d(0, 0, 20, 30), 1.0);
+  map.add("merged", cv::Mat(map.size(), CV_32F, std::numeric_limits<float>::quiet_NaN()));
+  map["merged"].at<float>(0, 0) = 1.0f;
+
+  CvGridMap submap(map.roi(), map.resolution());
+  submap.add("new", cv::Mat(map.size(), CV_8UC1, 100));
+  submap.add("merged", cv::Mat(map.size(), CV_32F, 2.0f));
+  const uchar* data_new = submap["new"].data;
+  const uchar* data_merged = map["merged"].data;
+
+  map.add(std::move(submap), REALM_OVERWRITE_ZERO, false);
+
+  EXPECT_EQ(map["new"].data, data_new);
+  EXPECT_EQ(map["merged"].data, data_merged);
+  EXPECT_FLOAT_EQ(map["merged"].at<float>(0, 0), 1.0f);
+  EXPECT_FLOAT_EQ(map["merged"].at<float>(5, 5), 2.0f);
+  EXPECT_EQ(submap.empty(), true);
+
+  // Submaps with different geometry are copied
+  CvGridMap submap_other(cv::Rect2d(10, 10, 5, 5), 1.0);
+  submap_other.add("new", cv::Mat(submap_other.size(), CV_8UC1, 200));
+  map.add(std::move(submap_other), REALM_OVERWRITE_ALL, false);
+  cv::Point2i idx = map.atIndex(cv::Point2d(12, 12));
+  EXPECT_EQ(map["new"].at<uchar>(idx.y, idx.x), 200);
+  EXPECT_EQ(map["new"].at<uchar>(0, 0), 100);
+}
+
+TEST(CvGridMap, AddView)
+{
+  // Here we combine two maps of the same geometry without copying. Both layers must reference the data of their
+  // original maps.
+  CvGridMap orthophoto(cv::Rect2d(0, 0, 20, 30), 1.0);
+  orthophoto.add("color_rgb", cv::Mat(orthophoto.size(), CV_8UC4, cv::Scalar(1, 2, 3, 255)));
+  CvGridMap surface_model(orthophoto.roi(), orthophoto.resolution());
+  surface_model.add("elevation", cv::Mat(orthophoto.size(), CV_32F, 5.0f));
+
+  CvGridMap map(orthophoto.roi(), orthophoto.resolution());
+  map.addView(surface_model);
+  map.addView(orthophoto);
+
+  EXPECT_EQ(map["color_rgb"].data, orthophoto["color_rgb"].data);
+  EXPECT_EQ(map["elevation"].data, surface_model["elevation"].data);
+}
+
+TEST(CvGridMap, ByteSize)
+{
+  // The memory of a map is the sum of the data of all its layers
+  CvGridMap map(cv::Rect2d(5, 10, 20, 25), 2.0);
+  EXPECT_EQ(map.getByteSize(), 0u);
+
+  map.add("layer_double", cv::Mat(map.size(), CV_64F, 3.1415));
+  map.add("layer_char", cv::Mat(map.size(), CV_8UC3, cv::Scalar(125, 125, 125)));
+  EXPECT_EQ(map.getByteSize(), 11u*14u*8u + 11u*14u*3u);
+
+  map.remove("layer_double");
+  EXPECT_EQ(map.getByteSize(), 11u*14u*3u);
+}
+
 TEST(CvGridMap, Clone)
 {
   CvGridMap map(cv::Rect2d(0, 0, 20, 30), 1.0);
@@ -358,4 +493,156 @@ TEST(CvGridMap, ChangeResolution)
   EXPECT_NEAR(map.resolution(), 1.0, 10e-3);
   EXPECT_EQ(map.size().width, 21);
   EXPECT_EQ(map.size().height, 31);
-}
\ No newline at end of file
+}
+
+#ifdef CV_16F
+TEST(CvGridMap, HalfPrecision)
+{
+  // Here we check that half precision layers are handled like single precision ones, so empty cells are NaN when the
+  // map is extended and only they are overwritten while merging. Resizing keeps the layer in half precision.
+  CvGridMap map1(cv::Rect2d(0, 0, 10, 10), 1.0);
+  map1.add("elevation", cv::Mat(map1.size(), CV_16F, cv::Scalar(1.0)));
+
+  CvGridMap map2(cv::Rect2d(5, 5, 10, 10), 1.0);
+  map2.add("elevation", cv::Mat(map2.size(), CV_16F, cv::Scalar(2.0)));
+
+  map1.add(map2, REALM_OVERWRITE_ZERO, true);
+
+  EXPECT_EQ(map1["elevation"].type(), CV_16F);
+  EXPECT_EQ(map1.size().width, 16);
+  EXPECT_EQ(map1.size().height, 16);
+  EXPECT_TRUE(std::isnan(map1.atPosition3d(0, 0, "elevation").z));
+  EXPECT_DOUBLE_EQ(map1.atPosition3d(0, 15, "elevation").z, 2.0);
+  EXPECT_DOUBLE_EQ(map1.atPosition3d(15, 0, "elevation").z, 1.0);
+  EXPECT_DOUBLE_EQ(map1.atPosition3d(5, 5, "elevation").z, 1.0);
+
+  map1.changeResolution(0.5);
+
+  EXPECT_EQ(map1["elevation"].type(), CV_16F);
+  EXPECT_EQ(map1["elevation"].size(), map1.size());
+  EXPECT_DOUBLE_EQ(map1.atPosition3d(30, 0, "elevation").z, 1.0);
+}
+#endif
+TEST(CvGridMap, Overviews)
+{
+  // For this test we enable two overviews and check their geometry and content. Then the map is changed once inside
+  // and once outside of its bounds. The incrementally maintained overviews must be equal to overviews, that are
+  // computed from scratch on a clone of the map.
+  CvGridMap map(cv::Rect2d(0, 0, 9, 9), 1.0);
+  cv::Mat nearest(map.size(), CV_16UC1);
+  for (int r = 0; r < nearest.rows; ++r)
+    for (int c = 0; c < nearest.cols; ++c)
+      nearest.at<uint16_t>(r, c) = static_cast<uint16_t>(r * 10 + c + 1);
+  map.add("elevation", cv::Mat(map.size(), CV_32F, 2.0f));
+  map.add("color", cv::Mat(map.size(), CV_8UC1, 10));
+  map.add("nearest", nearest, cv::INTER_NEAREST);
+  map.setNumberOfOverviews(2);
+
+  EXPECT_EQ(map.getNumberOfOverviews(), 2);
+  EXPECT_EQ(map.findOverviewLevel(0.5), 0);
+  EXPECT_EQ(map.findOverviewLevel(3.0), 1);
+  EXPECT_EQ(map.findOverviewLevel(10.0), 2);
+  EXPECT_ANY_THROW(map.getOverview(3));
+
+  // Cells of the overview are centred on multiples of its resolution, the first row on fine row -1
+  const CvGridMap &overview = map.getOverview(1);
+  EXPECT_NEAR(overview.resolution(), 2.0, 10e-6);
+  EXPECT_NEAR(overview.roi().x, 0.0, 10e-6);
+  EXPECT_NEAR(overview.roi().y + overview.roi().height, 10.0, 10e-6);
+  EXPECT_EQ(overview.size(), cv::Size2i(5, 6));
+  EXPECT_EQ(cv::countNonZero(overview["elevation"] != 2.0f), 0);
+  EXPECT_EQ(cv::countNonZero(overview["color"] != 10), 0);
+  EXPECT_EQ(overview["nearest"].at<uint16_t>(0, 0), 0);
+  EXPECT_EQ(overview["nearest"].at<uint16_t>(1, 2), nearest.at<uint16_t>(1, 4));
+
+  auto expect_equal_overviews = [](CvGridMap &map)
+  {
+    CvGridMap reference = map.clone();
+    for (int level = 1; level <= map.getNumberOfOverviews(); ++level)
+    {
+      const CvGridMap &a = map.getOverview(level);
+      const CvGridMap &b = reference.getOverview(level);
+      ASSERT_EQ(a.roi(), b.roi());
+      for (const auto &layer_name : a.getAllLayerNames())
+      {
+        cv::Mat is_equal = (a[layer_name] == b[layer_name]);
+        if (a[layer_name].depth() == CV_32F)
+          is_equal |= (a[layer_name] != a[layer_name]) & (b[layer_name] != b[layer_name]);
+        EXPECT_EQ(cv::countNonZero(is_equal == 0), 0) << layer_name << " on level " << level;
+      }
+    }
+  };
+
+  CvGridMap submap(cv::Rect2d(1, 1, 2, 2), 1.0);
+  submap.add("elevation", cv::Mat(submap.size(), CV_32F, 6.0f));
+  submap.add("color", cv::Mat(submap.size(), CV_8UC1, 100));
+  submap.add("nearest", cv::Mat(submap.size(), CV_16UC1, 1000), cv::INTER_NEAREST);
+  map.add(submap, REALM_OVERWRITE_ALL, false);
+  expect_equal_overviews(map);
+  EXPECT_EQ(map.getOverview(1)["elevation"].at<float>(0, 0), 2.0f);
+
+  submap.setGeometry(cv::Rect2d(-7, 12, 3, 3), 1.0);
+  submap.add("elevation", cv::Mat(submap.size(), CV_32F, 4.0f));
+  submap.add("color", cv::Mat(submap.size(), CV_8UC1, 50));
+  submap.add("nearest", cv::Mat(submap.size(), CV_16UC1, 2000), cv::INTER_NEAREST);
+  map.getOverview(2);
+  map.add(submap, REALM_OVERWRITE_ALL, true);
+  expect_equal_overviews(map);
+
+  // Cells between both regions are empty, the overviews must not fill them
+  cv::Point2i idx = map.getOverview(1).atIndex(cv::Point2d(-6.0, 4.0));
+  EXPECT_TRUE(std::isnan(map.getOverview(1)["elevation"].at<float>(idx.y, idx.x)));
+}
+
+TEST(CvGridMap, AddParallel)
+{
+  // Here we add the same submap with several layers of different types once serially and once on a thread pool. Both
+  // must be equal to the masked copies REALM_OVERWRITE_ZERO is defined by: Empty cells are NaN for single channel
+  // floating point layers and zero for every channel of all other layers.
+  CvGridMap map(cv::Rect2d(0, 0, 39, 29), 1.0);
+  cv::Mat data_float(map.size(), CV_32F);
+  cv::Mat data_color(map.size(), CV_8UC4);
+  cv::Mat data_nobs(map.size(), CV_16UC1);
+  for (int r = 0; r < map.size().height; ++r)
+    for (int c = 0; c < map.size().width; ++c)
+    {
+      data_float.at<float>(r, c) = ((r + c) % 3 == 0 ? std::numeric_limits<float>::quiet_NaN() : static_cast<float>(r));
+      data_color.at<cv::Vec4b>(r, c) = cv::Vec4b(static_cast<uchar>(c % 2 == 0 ? 0 : c), 10, 0, static_cast<uchar>(r % 2 == 0 ? 0 : 255));
+      data_nobs.at<uint16_t>(r, c) = static_cast<uint16_t>(c % 4 == 0 ? 0 : c);
+    }
+  map.add("float", data_float);
+  map.add("color", data_color);
+  map.add("nobs", data_nobs);
+
+  CvGridMap submap(cv::Rect2d(5, 5, 30, 20), 1.0);
+  submap.add("float", cv::Mat(submap.size(), CV_32F, 7.0f));
+  submap.add("color", cv::Mat(submap.size(), CV_8UC4, cv::Scalar(20, 20, 20, 200)));
+  submap.add("nobs", cv::Mat(submap.size(), CV_16UC1, 3));
+
+  CvGridMap expected = map.clone();
+  cv::Rect2i roi = expected.atIndexROI(submap.roi());
+  for (const auto &layer_name : submap.getAllLayerNames())
+  {
+    cv::Mat to = expected[layer_name](roi);
+    const cv::Mat &from = submap[layer_name];
+    cv::Mat mask = (to.type() == CV_32F ? (to != to) & (from == from) : (to == 0) & (from > 0));
+    from.copyTo(to, mask);
+  }
+
+  auto thread_pool = std::make_shared<ThreadPool>(4);
+  CvGridMap map_serial = map.clone();
+  CvGridMap map_parallel = map.clone();
+  map_serial.add(submap, REALM_OVERWRITE_ZERO, false);
+  map_parallel.add(submap, REALM_OVERWRITE_ZERO, false, thread_pool, 4);
+
+  for (const auto &layer_name : expected.getAllLayerNames())
+    for (const CvGridMap *result : {&map_serial, &map_parallel})
+    {
+      cv::Mat a = (*result)[layer_name].reshape(1);
+      cv::Mat b = expected[layer_name].reshape(1);
+      cv::Mat is_equal = (a == b);
+      if (a.depth() == CV_32F)
+        is_equal |= (a != a) & (b != b);
+      EXPECT_EQ(cv::countNonZero(is_equal == 0), 0) << layer_name;
+    }
+}
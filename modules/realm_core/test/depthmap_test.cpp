@@ -35,4 +35,43 @@ TEST(Depthmap, DepthParameters)
   EXPECT_NEAR(depthmap.getMedianDepth(), 33.333, 10e-2);
   EXPECT_NEAR(depthmap.getMinDepth(), 11.111, 10e-2);
   EXPECT_NEAR(depthmap.getMaxDepth(), 66.666, 10e-2);
-}
\ No newline at end of file
+}
+
+TEST(Depthmap, DepthQuantile)
+{
+  // Invalid depths must not be considered for the quantiles, so the lower half of the depth map is set to -1
+  cv::Mat data = cv::Mat(1000, 1200, CV_32F, -1.0);
+  for (int r = 0; r < 500; ++r)
+    for (int c = 0; c < 1200; ++c)
+      data.at<float>(r, c) = static_cast<float>(c + 1);
+
+  camera::Pinhole cam = createDummyPinhole();
+
+  Depthmap depthmap(data, cam);
+
+  EXPECT_NEAR(depthmap.getDepthQuantile(0.0), 1.0, 10e-2);
+  EXPECT_NEAR(depthmap.getDepthQuantile(0.5), 600.0, 1.0);
+  EXPECT_NEAR(depthmap.getDepthQuantile(1.0), 1200.0, 10e-2);
+  EXPECT_THROW(depthmap.getDepthQuantile(1.5), std::invalid_argument);
+}
+
+TEST(Depthmap, DepthParametersInvalid)
+{
+  // Here we set most of the depth map invalid. Minimum, maximum and median must only be computed from the valid depths,
+  // and a depth map without any valid depth has all parameters zero.
+  cv::Mat data = cv::Mat(1000, 1200, CV_32F, -1.0);
+  for (int c = 0; c < 1200; ++c)
+    data.at<float>(500, c) = static_cast<float>(c + 1);
+
+  camera::Pinhole cam = createDummyPinhole();
+
+  Depthmap depthmap(data, cam);
+  EXPECT_NEAR(depthmap.getMinDepth(), 1.0, 10e-2);
+  EXPECT_NEAR(depthmap.getMaxDepth(), 1200.0, 10e-2);
+  EXPECT_NEAR(depthmap.getMedianDepth(), 600.0, 1.0);
+
+  Depthmap depthmap_invalid(cv::Mat(1000, 1200, CV_32F, -1.0), cam);
+  EXPECT_EQ(depthmap_invalid.getMinDepth(), 0.0);
+  EXPECT_EQ(depthmap_invalid.getMaxDepth(), 0.0);
+  EXPECT_EQ(depthmap_invalid.getMedianDepth(), 0.0);
+}
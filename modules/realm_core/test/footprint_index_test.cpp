@@ -0,0 +1,58 @@
+
+
+#include <iostream>
+#include <realm_core/footprint_index.h>
+
+// gtest
+#include <gtest/gtest.h>
+
+using namespace realm;
+
+TEST(FootprintIndex, MaxOverlap)
+{
+  // Here we index a strip of 10 footprints with 10 m edge length, each shifted by 5 m to the previous one. A query is
+  // expected to return the overlap with the best matching footprint, not only with the last one.
+  FootprintIndex index(0);
+  EXPECT_DOUBLE_EQ(index.computeMaxOverlap(cv::Rect2d(0.0, 0.0, 10.0, 10.0)), 0.0);
+
+  for (int i = 0; i < 10; ++i)
+    index.add(cv::Rect2d(i*5.0, 0.0, 10.0, 10.0));
+  EXPECT_EQ(index.size(), 10u);
+
+  // Identical to the first footprint, far away from the last one
+  EXPECT_DOUBLE_EQ(index.computeMaxOverlap(cv::Rect2d(0.0, 0.0, 10.0, 10.0)), 100.0);
+
+  // Half covered by the footprint at x = 45 m
+  EXPECT_DOUBLE_EQ(index.computeMaxOverlap(cv::Rect2d(50.0, 0.0, 10.0, 10.0)), 50.0);
+
+  // Quarter covered, footprint is shifted in both directions
+  EXPECT_DOUBLE_EQ(index.computeMaxOverlap(cv::Rect2d(-5.0, -5.0, 10.0, 10.0)), 25.0);
+
+  // Outside of the strip and negative coordinates
+  EXPECT_DOUBLE_EQ(index.computeMaxOverlap(cv::Rect2d(0.0, -30.0, 10.0, 10.0)), 0.0);
+  EXPECT_DOUBLE_EQ(index.computeMaxOverlap(cv::Rect2d(-20.0, 0.0, 10.0, 10.0)), 0.0);
+
+  index.clear();
+  EXPECT_EQ(index.size(), 0u);
+  EXPECT_DOUBLE_EQ(index.computeMaxOverlap(cv::Rect2d(0.0, 0.0, 10.0, 10.0)), 0.0);
+}
+
+TEST(FootprintIndex, Capacity)
+{
+  // Here we limit the index to the last 3 footprints, so older ones must not contribute to the overlap anymore
+  FootprintIndex index(3, 4.0);
+  for (int i = 0; i < 5; ++i)
+    index.add(cv::Rect2d(i*10.0, 0.0, 10.0, 10.0));
+  EXPECT_EQ(index.size(), 3u);
+
+  EXPECT_DOUBLE_EQ(index.computeMaxOverlap(cv::Rect2d(0.0, 0.0, 10.0, 10.0)), 0.0);
+  EXPECT_DOUBLE_EQ(index.computeMaxOverlap(cv::Rect2d(10.0, 0.0, 10.0, 10.0)), 0.0);
+  EXPECT_DOUBLE_EQ(index.computeMaxOverlap(cv::Rect2d(20.0, 0.0, 10.0, 10.0)), 100.0);
+  EXPECT_DOUBLE_EQ(index.computeMaxOverlap(cv::Rect2d(40.0, 0.0, 10.0, 10.0)), 100.0);
+
+  // Empty footprints are ignored
+  index.add(cv::Rect2d(0.0, 0.0, 0.0, 0.0));
+  EXPECT_EQ(index.size(), 3u);
+
+  EXPECT_THROW(FootprintIndex(3, -1.0), std::invalid_argument);
+}
@@ -0,0 +1,82 @@
+#include <chrono>
+#include <thread>
+
+#include <realm_core/frame_merger.h>
+
+#include "test_helper.h"
+
+// gtest
+#include <gtest/gtest.h>
+
+using namespace realm;
+
+namespace
+{
+
+Frame::Ptr createFrame(const std::string &camera_id, uint32_t frame_id, uint64_t timestamp)
+{
+  UTMPose utm(603976, 5791569, 100.0, 45.0, 32, 'U');
+  auto cam = std::make_shared<camera::Pinhole>(createDummyPinhole());
+  return std::make_shared<Frame>(camera_id, frame_id, timestamp, cv::Mat::zeros(10, 12, CV_8UC3), utm, cam, cv::Mat());
+}
+
+} // namespace
+
+TEST(FrameMerger, OrderByTimestamp)
+{
+  // Here we add the frames of two cameras, where the chain of the second one lags behind. Frames are only released,
+  // once both cameras passed their timestamp, so the merged stream is in order of the timestamps.
+  std::vector<uint64_t> released;
+  FrameMerger merger(100000, [&](const Frame::Ptr &frame){ released.push_back(frame->getTimestamp()); });
+
+  // A single camera is not waited for
+  merger.add(createFrame("left", 0, 10));
+  EXPECT_EQ(released.size(), 1u);
+
+  merger.add(createFrame("right", 0, 15));
+  merger.add(createFrame("left", 1, 20));
+  merger.add(createFrame("left", 2, 30));
+  EXPECT_EQ(merger.getNrofCameras(), 2u);
+  EXPECT_EQ(released, std::vector<uint64_t>({10, 15}));
+  EXPECT_EQ(merger.size(), 2u);
+
+  merger.add(createFrame("right", 1, 25));
+  EXPECT_EQ(released, std::vector<uint64_t>({10, 15, 20, 25}));
+
+  merger.flush();
+  EXPECT_EQ(released, std::vector<uint64_t>({10, 15, 20, 25, 30}));
+  EXPECT_EQ(merger.size(), 0u);
+
+  // Frames older than the last released one can not be ordered anymore and are passed on immediately
+  merger.add(createFrame("right", 2, 28));
+  EXPECT_EQ(released.back(), 28u);
+  EXPECT_EQ(merger.getNrofLate(), 1u);
+}
+
+TEST(FrameMerger, SilentCamera)
+{
+  // For this test the second camera stops delivering frames. Frames of the first one are released anyway, once they
+  // were held back for the maximum delay.
+  std::vector<uint64_t> released;
+  FrameMerger merger(10, [&](const Frame::Ptr &frame){ released.push_back(frame->getTimestamp()); });
+
+  merger.add(createFrame("left", 0, 10));
+  merger.add(createFrame("right", 0, 10));
+  merger.add(createFrame("left", 1, 20));
+  EXPECT_EQ(released.size(), 2u);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  merger.add(createFrame("left", 2, 30));
+  EXPECT_EQ(released, std::vector<uint64_t>({10, 10, 20}));
+  EXPECT_EQ(merger.size(), 1u);
+
+  // Without any further frame, the last one is released by the periodic update
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  merger.update();
+  EXPECT_EQ(released, std::vector<uint64_t>({10, 10, 20, 30}));
+  EXPECT_EQ(merger.size(), 0u);
+
+  merger.clear();
+  EXPECT_EQ(merger.size(), 0u);
+  EXPECT_EQ(merger.getNrofCameras(), 0u);
+}
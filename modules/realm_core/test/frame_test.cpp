@@ -61,6 +61,13 @@ TEST(Frame, AddSurfacePoints)
   EXPECT_EQ(frame->getMedianSceneDepth(), frame->getCamera()->t().at<double>(2));
   EXPECT_EQ(frame->getMinSceneDepth(), frame->getCamera()->t().at<double>(2)-50);
   EXPECT_EQ(frame->getMaxSceneDepth(), frame->getCamera()->t().at<double>(2)+130);
+
+  // Quantiles are interpolated between the sorted depths, the extremes are the minimum and maximum
+  EXPECT_DOUBLE_EQ(frame->getSceneDepthQuantile(0.0), frame->getMinSceneDepth());
+  EXPECT_DOUBLE_EQ(frame->getSceneDepthQuantile(0.5), frame->getMedianSceneDepth());
+  EXPECT_DOUBLE_EQ(frame->getSceneDepthQuantile(0.25), frame->getCamera()->t().at<double>(2)-25);
+  EXPECT_DOUBLE_EQ(frame->getSceneDepthQuantile(1.0), frame->getMaxSceneDepth());
+  EXPECT_ANY_THROW(frame->getSceneDepthQuantile(1.5));
 }
 
 TEST(Frame, Georeference)
@@ -166,4 +173,252 @@ TEST(Frame, UpdateGeoreference)
   EXPECT_NEAR(frame->getMinSceneDepth(), 50, 10e-3);
   EXPECT_NEAR(frame->getMaxSceneDepth(), 200, 10e-3);
   EXPECT_NEAR(frame->getMedianSceneDepth(), 100, 10e-3);
-}
\ No newline at end of file
+}
+TEST(Frame, SharedSparseCloud)
+{
+  // The cloud set by the visual SLAM is shared, so georeferencing the frame must not modify it
+  Frame::Ptr frame = createDummyFrame();
+  frame->setVisualPose(createDummyPose());
+
+  std::vector<uint32_t> point_ids{0, 1, 2};
+  cv::Mat surface_points = (cv::Mat_<double>(3, 3) << 0, 32, 0, 15, 50, -1200, 2, 2, 600);
+  auto sparse_cloud = std::make_shared<PointCloud>(point_ids, surface_points);
+  frame->setSparseCloud(sparse_cloud, false);
+
+  cv::Mat T_georeference = cv::Mat::eye(4, 4, CV_64F);
+  T_georeference.at<double>(0, 0) = 1/12.0;
+  T_georeference.at<double>(1, 1) = 1/12.0;
+  T_georeference.at<double>(2, 2) = 1/12.0;
+  T_georeference.at<double>(0, 3) = 603976;
+  T_georeference.at<double>(1, 3) = 5791569;
+  T_georeference.at<double>(2, 3) = 50;
+  frame->initGeoreference(T_georeference);
+
+  cv::Point3d pt_shared = sparse_cloud->getPoint(1);
+  EXPECT_NEAR(pt_shared.x, 15, 10e-3);
+  EXPECT_NEAR(pt_shared.y, 50, 10e-3);
+  EXPECT_NEAR(pt_shared.z, -1200, 10e-3);
+
+  // Reads are in the georeferenced coordinates and the same cloud until the georeference changes
+  PointCloud::Ptr sparse_cloud_geo = frame->getSparseCloud();
+  ASSERT_NE(sparse_cloud_geo, sparse_cloud);
+  EXPECT_EQ(sparse_cloud_geo, frame->getSparseCloud());
+
+  cv::Point3d pt_geo = sparse_cloud_geo->getPoint(1);
+  EXPECT_NEAR(pt_geo.x, 603976 + 15/12.0, 10e-3);
+  EXPECT_NEAR(pt_geo.y, 5791569 + 50/12.0, 10e-3);
+  EXPECT_NEAR(pt_geo.z, 50 - 100, 10e-3);
+
+  T_georeference.at<double>(2, 3) = 100;
+  frame->updateGeoreference(T_georeference, true);
+  EXPECT_NEAR(frame->getSparseCloud()->getPoint(1).z, 100 - 100, 10e-3);
+  EXPECT_NEAR(sparse_cloud->getPoint(1).z, -1200, 10e-3);
+}
+
+TEST(Frame, SharedGeoreference)
+{
+  // Updates of a shared georeference are only applied to the frame when resolved
+  Frame::Ptr frame = createDummyFrame();
+  frame->setVisualPose(createDummyPose());
+
+  std::vector<uint32_t> point_ids{0, 1, 2};
+  cv::Mat surface_points = (cv::Mat_<double>(3, 3) << 0, 32, 0, 15, 50, -1200, 2, 2, 600);
+  frame->setSparseCloud(std::make_shared<PointCloud>(point_ids, surface_points), false);
+
+  auto georeference = std::make_shared<Georeference>();
+  frame->setSharedGeoreference(georeference);
+  EXPECT_FALSE(frame->resolveGeoreference());
+  EXPECT_FALSE(frame->isGeoreferenced());
+
+  cv::Mat T_georeference = cv::Mat::eye(4, 4, CV_64F);
+  T_georeference.at<double>(0, 0) = 1/12.0;
+  T_georeference.at<double>(1, 1) = 1/12.0;
+  T_georeference.at<double>(2, 2) = 1/12.0;
+  T_georeference.at<double>(0, 3) = 603976;
+  T_georeference.at<double>(1, 3) = 5791569;
+  T_georeference.at<double>(2, 3) = 50;
+  EXPECT_EQ(georeference->update(T_georeference), 1);
+
+  EXPECT_TRUE(frame->resolveGeoreference());
+  EXPECT_FALSE(frame->resolveGeoreference());
+  EXPECT_TRUE(frame->isGeoreferenced());
+  EXPECT_NEAR(frame->getMinSceneDepth(), 50, 10e-3);
+  EXPECT_NEAR(frame->getSparseCloud()->getPoint(1).z, 50 - 100, 10e-3);
+
+  T_georeference.at<double>(2, 3) = 100;
+  EXPECT_EQ(georeference->update(T_georeference), 2);
+  EXPECT_NEAR(frame->getGeoreferenceView().at<double>(2, 3), 50, 10e-3);
+
+  // Pose and sparse cloud are moved together, so the scene depth stays the same
+  EXPECT_TRUE(frame->resolveGeoreference());
+  EXPECT_NEAR(frame->getGeoreferenceView().at<double>(2, 3), 100, 10e-3);
+  EXPECT_NEAR(frame->getSparseCloud()->getPoint(1).z, 100 - 100, 10e-3);
+  EXPECT_NEAR(frame->getMinSceneDepth(), 50, 10e-3);
+  EXPECT_NEAR(frame->getMaxSceneDepth(), 200, 10e-3);
+}
+
+TEST(Frame, Trace)
+{
+  // Every stage records events of the frame, which are collected to one record per stage in order of arrival. Events
+  // that are not reached in a stage remain 0.
+  Frame::Ptr frame = createDummyFrame();
+  EXPECT_TRUE(frame->getTrace().empty());
+
+  frame->addTraceEvent("stage_a", TraceEvent::ENQUEUED);
+  frame->addTraceEvent("stage_a", TraceEvent::DEQUEUED);
+  frame->addTraceEvent("stage_a", TraceEvent::PROCESS_START);
+  frame->addTraceEvent("stage_a", TraceEvent::PROCESS_END);
+  frame->addTraceEvent("stage_b", TraceEvent::ENQUEUED);
+
+  std::vector<StageTrace> trace = frame->getTrace();
+  ASSERT_EQ(trace.size(), 2u);
+  EXPECT_EQ(trace[0].stage, "stage_a");
+  EXPECT_GT(trace[0].t_enqueued, 0u);
+  EXPECT_LE(trace[0].t_enqueued, trace[0].t_dequeued);
+  EXPECT_LE(trace[0].t_dequeued, trace[0].t_process_start);
+  EXPECT_LE(trace[0].t_process_start, trace[0].t_process_end);
+  EXPECT_EQ(trace[1].stage, "stage_b");
+  EXPECT_LE(trace[0].t_process_end, trace[1].t_enqueued);
+  EXPECT_EQ(trace[1].t_process_end, 0u);
+}
+
+TEST(Frame, ByteSize)
+{
+  // The memory of a frame is the sum of all its image data and maps. Resizing the image adds the resized copy, releasing
+  // data removes it again.
+  auto cam = std::make_shared<camera::Pinhole>(createDummyPinhole());
+  cv::Mat img = cv::Mat::ones(1000, 1200, CV_8UC3);
+  auto frame = std::make_shared<Frame>("DUMMY_CAM", 0, 0, img, UTMPose(603976, 5791569, 100.0, 45.0, 32, 'U'), cam, cv::Mat());
+  EXPECT_EQ(frame->getByteSize(), 1000u*1200u*3u);
+
+  frame->setImageResizeFactor(0.5);
+  EXPECT_EQ(frame->getByteSize(), 1000u*1200u*3u + 500u*600u*3u);
+
+  auto orthophoto = std::make_shared<CvGridMap>(cv::Rect2d(0, 0, 9, 9), 1.0);
+  orthophoto->add("color_rgb", cv::Mat(orthophoto->size(), CV_8UC4, cv::Scalar(0)));
+  frame->setOrthophoto(orthophoto);
+  EXPECT_EQ(frame->getByteSize(), 1000u*1200u*3u + 500u*600u*3u + 10u*10u*4u);
+
+  // Releasing the images leaves only the orthophoto
+  frame->releaseImage();
+  EXPECT_EQ(frame->getByteSize(), 10u*10u*4u);
+}
+
+TEST(Frame, ResizedImageGray)
+{
+  // The grayscale image for tracking is converted once from the resized image and shared between calls. Setting the
+  // same resize factor again keeps it, a new factor invalidates it.
+  auto cam = std::make_shared<camera::Pinhole>(createDummyPinhole());
+  cv::Mat img(1000, 1200, CV_8UC3, cv::Scalar(10, 20, 30));
+  auto frame = std::make_shared<Frame>("DUMMY_CAM", 0, 0, img, UTMPose(603976, 5791569, 100.0, 45.0, 32, 'U'), cam, cv::Mat());
+  EXPECT_THROW(frame->getResizedImageGray(), std::invalid_argument);
+
+  frame->setImageResizeFactor(0.5);
+  cv::Mat gray = frame->getResizedImageGray();
+  EXPECT_EQ(gray.type(), CV_8UC1);
+  EXPECT_EQ(gray.size(), cv::Size(600, 500));
+  EXPECT_EQ(gray.at<uchar>(100, 100), 22);
+  EXPECT_EQ(frame->getByteSize(), 1000u*1200u*3u + 500u*600u*3u + 500u*600u);
+
+  frame->setImageResizeFactor(0.5);
+  EXPECT_EQ(frame->getResizedImageGray().data, gray.data);
+
+  frame->setImageResizeFactor(0.25);
+  EXPECT_EQ(frame->getResizedImageGray().size(), cv::Size(300, 250));
+}
+
+TEST(Frame, ResizedCameraCache)
+{
+  // The resized camera and undistorted image are only computed once per resize factor. A pose change hands out a new
+  // camera with the current pose, while cameras handed out before stay untouched.
+  auto cam = std::make_shared<camera::Pinhole>(createDummyPinhole());
+  cv::Mat img = cv::Mat::ones(1000, 1200, CV_8UC3);
+  auto frame = std::make_shared<Frame>("DUMMY_CAM", 0, 0, img, UTMPose(603976, 5791569, 100.0, 45.0, 32, 'U'), cam, cv::Mat());
+  frame->setImageResizeFactor(0.5);
+
+  camera::Pinhole::Ptr cam_resized = frame->getResizedCamera();
+  EXPECT_EQ(frame->getResizedCamera(), cam_resized);
+  EXPECT_EQ(frame->getResizedImageUndistorted().data, frame->getResizedImageUndistorted().data);
+  EXPECT_EQ(frame->getResizedCalibration().at<double>(0, 0), 600.0);
+
+  cv::Mat pose = cv::Mat::eye(3, 4, CV_64F);
+  pose.at<double>(0, 3) = 10.0;
+  frame->setVisualPose(pose);
+
+  camera::Pinhole::Ptr cam_moved = frame->getResizedCamera();
+  EXPECT_NE(cam_moved, cam_resized);
+  EXPECT_EQ(cam_moved->t().at<double>(0), 10.0);
+  EXPECT_EQ(cam_moved->width(), 600.0);
+  EXPECT_EQ(frame->getResizedCamera(), cam_moved);
+
+  frame->setImageResizeFactor(0.25);
+  EXPECT_EQ(frame->getResizedCamera()->width(), 300.0);
+  EXPECT_EQ(frame->getResizedImageUndistorted().cols, 300);
+}
+
+TEST(Frame, RecycledImageBuffers)
+{
+  // For this test we create a frame from an image of the frame pool and derive the resized and gray images. Once the
+  // frame retires, the next frame of the same camera size must get the very same buffers instead of fresh memory.
+  MatPool* pool = Frame::getImagePool();
+  pool->clear();
+  auto cam = std::make_shared<camera::Pinhole>(createDummyPinhole());
+  UTMPose utm(603976, 5791569, 100.0, 45.0, 32, 'U');
+
+  auto create_frame = [&](uint32_t frame_id)
+  {
+    cv::Mat img = pool->create(cv::Size2i(1200, 1000), CV_8UC3);
+    img.setTo(cv::Scalar::all(125));
+    auto frame = std::make_shared<Frame>("DUMMY_CAM", frame_id, 1234567890 + frame_id, img, utm, cam, cv::Mat());
+    frame->setImageResizeFactor(0.5);
+    return frame;
+  };
+
+  Frame::Ptr frame = create_frame(0);
+  uchar* data_raw = frame->getImageRaw().data;
+  uchar* data_gray = frame->getResizedImageGray().data;
+  EXPECT_EQ(frame->getResizedImageGray().size(), cv::Size2i(600, 500));
+  EXPECT_EQ(frame->getResizedImageGray().allocator, pool);
+  frame = nullptr;
+  EXPECT_GT(pool->getCachedBytes(), 1200u * 1000u * 3u);
+
+  size_t nrof_reused = pool->getNrofReused();
+  frame = create_frame(1);
+  EXPECT_EQ(frame->getImageRaw().data, data_raw);
+  EXPECT_EQ(frame->getResizedImageGray().data, data_gray);
+  EXPECT_EQ(frame->getResizedImageGray().at<uchar>(30, 30), 125);
+  EXPECT_GE(pool->getNrofReused(), nrof_reused + 3);
+}
+
+TEST(Frame, SharedViews)
+{
+  // Here we check, that the views of poses and images share the data of the frame without copying it. Setting a new
+  // pose or resize factor replaces the data, so views handed out before keep their snapshot.
+  auto cam = std::make_shared<camera::Pinhole>(createDummyPinhole());
+  cv::Mat img(1000, 1200, CV_8UC3, cv::Scalar(10, 20, 30));
+  auto frame = std::make_shared<Frame>("DUMMY_CAM", 0, 0, img, UTMPose(603976, 5791569, 100.0, 45.0, 32, 'U'), cam, cv::Mat());
+  frame->setImageResizeFactor(0.5);
+
+  cv::Mat pose = cv::Mat::eye(3, 4, CV_64F);
+  pose.at<double>(0, 3) = 10.0;
+  frame->setVisualPose(pose);
+  pose.at<double>(0, 3) = 20.0;
+
+  cv::Mat pose_view = frame->getVisualPoseView();
+  EXPECT_EQ(pose_view.at<double>(0, 3), 10.0);
+  EXPECT_EQ(frame->getVisualPoseView().data, pose_view.data);
+  EXPECT_NE(frame->getVisualPose().data, pose_view.data);
+  EXPECT_EQ(frame->getOrientationView().data, frame->getOrientationView().data);
+
+  frame->setVisualPose(pose);
+  EXPECT_EQ(pose_view.at<double>(0, 3), 10.0);
+  EXPECT_EQ(frame->getVisualPoseView().at<double>(0, 3), 20.0);
+
+  cv::Mat img_view = frame->getResizedImageRawView();
+  EXPECT_EQ(frame->getResizedImageRawView().data, img_view.data);
+  EXPECT_NE(frame->getResizedImageRaw().data, img_view.data);
+
+  frame->setImageResizeFactor(0.25);
+  EXPECT_EQ(img_view.size(), cv::Size(600, 500));
+  EXPECT_EQ(frame->getResizedImageRawView().size(), cv::Size(300, 250));
+}
@@ -0,0 +1,38 @@
+#include <iostream>
+#include <realm_core/latency_histogram.h>
+
+// gtest
+#include <gtest/gtest.h>
+
+using namespace realm;
+
+TEST(LatencyHistogram, Percentiles)
+{
+  // Here we record latencies from 1 to 1000 ms, so every percentile is known exactly. Because the histogram only keeps
+  // buckets with a relative width of about 3%, the computed percentiles are only compared within that error.
+  LatencyHistogram histogram;
+  EXPECT_EQ(histogram.getCount(), 0u);
+  EXPECT_DOUBLE_EQ(histogram.getPercentile(50.0), 0.0);
+
+  for (int i = 1; i <= 1000; ++i)
+    histogram.add(static_cast<double>(i));
+
+  LatencyPercentiles percentiles = histogram.getPercentiles();
+  EXPECT_EQ(percentiles.count, 1000u);
+  EXPECT_NEAR(percentiles.p50, 500.0, 500.0*0.035);
+  EXPECT_NEAR(percentiles.p90, 900.0, 900.0*0.035);
+  EXPECT_NEAR(percentiles.p99, 990.0, 990.0*0.035);
+  EXPECT_NEAR(percentiles.p999, 999.0, 999.0*0.035);
+  EXPECT_DOUBLE_EQ(percentiles.max, 1000.0);
+
+  // A single multi-second outlier must show up in the tail, but not in the median
+  histogram.add(5000.0);
+  EXPECT_NEAR(histogram.getPercentile(100.0), 5000.0, 5000.0*0.035);
+  EXPECT_NEAR(histogram.getPercentile(50.0), 500.0, 500.0*0.035);
+
+  // Sub-millisecond values are kept with microsecond resolution
+  histogram.reset();
+  histogram.add(0.0205);
+  EXPECT_NEAR(histogram.getPercentile(50.0), 0.020, 10e-6);
+  EXPECT_EQ(histogram.getCount(), 1u);
+}
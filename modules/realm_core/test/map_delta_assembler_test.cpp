@@ -0,0 +1,67 @@
+#include <realm_core/map_delta_assembler.h>
+
+// gtest
+#include <gtest/gtest.h>
+
+using namespace realm;
+
+namespace
+{
+
+CvGridMap createMap(const cv::Rect2d &roi, uchar value)
+{
+  CvGridMap map(roi, 1.0);
+  map.add("color_rgb", cv::Mat(map.size(), CV_8UC4, cv::Scalar::all(value)));
+  return map;
+}
+
+} // namespace
+
+TEST(MapDeltaAssembler, ReconstructsGlobalMap)
+{
+  // Here we publish a growing global map once completely and once as deltas of the changed regions. The assembled
+  // deltas must equal the global map, a missing delta must be detected and healed by the next full map.
+  CvGridMap global_map = createMap(cv::Rect2d(0.0, 0.0, 20.0, 10.0), 10);
+
+  MapDeltaAssembler assembler;
+  EXPECT_TRUE(assembler.applyDelta(global_map, 1));
+
+  std::vector<CvGridMap> deltas{createMap(cv::Rect2d(15.0, 5.0, 20.0, 10.0), 20),
+                              createMap(cv::Rect2d(-5.0, -5.0, 10.0, 10.0), 30),
+                              createMap(cv::Rect2d(2.0, 2.0, 4.0, 4.0), 40)};
+  for (size_t i = 0; i < deltas.size(); ++i)
+  {
+    global_map.add(deltas[i], REALM_OVERWRITE_ALL, true);
+    EXPECT_TRUE(assembler.applyDelta(deltas[i], i + 2));
+  }
+
+  ASSERT_EQ(assembler.getVersion(), 4u);
+  ASSERT_EQ(assembler.getMap()->roi(), global_map.roi());
+  EXPECT_EQ(cv::norm((*assembler.getMap())["color_rgb"], global_map["color_rgb"], cv::NORM_INF), 0.0);
+
+  // Deltas already applied are ignored, a skipped one makes the map inconsistent
+  EXPECT_TRUE(assembler.applyDelta(deltas[0], 3));
+  EXPECT_FALSE(assembler.applyDelta(deltas[1], 6));
+  EXPECT_FALSE(assembler.isConsistent());
+
+  assembler.applyFull(global_map, 7);
+  EXPECT_TRUE(assembler.isConsistent());
+  EXPECT_TRUE(assembler.applyDelta(deltas[2], 8));
+}
+
+TEST(MapDeltaAssembler, LateSubscriber)
+{
+  // For this test the first delta received is not the first one published, so the map is incomplete until a full map
+  // arrives. Full maps older than the assembled one are ignored.
+  MapDeltaAssembler assembler;
+  EXPECT_EQ(assembler.getMap(), nullptr);
+  EXPECT_FALSE(assembler.applyDelta(createMap(cv::Rect2d(0.0, 0.0, 5.0, 5.0), 1), 5));
+
+  assembler.applyFull(createMap(cv::Rect2d(0.0, 0.0, 50.0, 50.0), 2), 6);
+  EXPECT_TRUE(assembler.isConsistent());
+  EXPECT_EQ(assembler.getMap()->roi(), cv::Rect2d(0.0, 0.0, 50.0, 50.0));
+
+  assembler.applyFull(createMap(cv::Rect2d(0.0, 0.0, 5.0, 5.0), 3), 4);
+  EXPECT_EQ(assembler.getVersion(), 6u);
+  EXPECT_EQ(assembler.getMap()->roi(), cv::Rect2d(0.0, 0.0, 50.0, 50.0));
+}
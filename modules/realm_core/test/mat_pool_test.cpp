@@ -0,0 +1,99 @@
+
+
+#include <iostream>
+#include <realm_core/mat_pool.h>
+
+// gtest
+#include <gtest/gtest.h>
+
+using namespace realm;
+
+TEST(MatPool, Reuse)
+{
+  // For this test we allocate a matrix from the pool and release it again. The next matrix with the same byte size
+  // must get the same buffer, no matter its type, while other sizes are allocated separately.
+  MatPool* pool = MatPool::get("test_reuse");
+  pool->clear();
+  EXPECT_EQ(pool, MatPool::get("test_reuse"));
+
+  uchar* data;
+  {
+    cv::Mat mat = pool->zeros(cv::Size2i(64, 32), CV_32FC1);
+    EXPECT_EQ(cv::countNonZero(mat), 0);
+    EXPECT_EQ(mat.allocator, pool);
+    data = mat.data;
+  }
+  EXPECT_EQ(pool->getCachedBytes(), 64u * 32u * sizeof(float));
+
+  size_t nrof_reused = pool->getNrofReused();
+  cv::Mat same = pool->create(cv::Size2i(64, 32), CV_8UC4);
+  EXPECT_EQ(same.data, data);
+  EXPECT_EQ(pool->getNrofReused(), nrof_reused + 1);
+  EXPECT_EQ(pool->getCachedBytes(), 0u);
+
+  cv::Mat other = pool->create(cv::Size2i(10, 10), CV_8UC1);
+  EXPECT_NE(other.data, data);
+  EXPECT_EQ(pool->getNrofReused(), nrof_reused + 1);
+
+  // Shallow copies keep the buffer alive, it is only returned once the last reference is released
+  cv::Mat copy = same;
+  same.release();
+  EXPECT_EQ(pool->getCachedBytes(), 0u);
+  copy.release();
+  EXPECT_EQ(pool->getCachedBytes(), 64u * 32u * 4u);
+}
+
+TEST(MatPool, Limit)
+{
+  // Here we check, that buffers released beyond the maximum of cached memory are freed instead of kept
+  MatPool* pool = MatPool::get("test_limit");
+  pool->clear();
+  pool->setMaxCachedBytes(1000);
+
+  cv::Mat a = pool->create(cv::Size2i(20, 20), CV_8UC1);
+  cv::Mat b = pool->create(cv::Size2i(30, 30), CV_8UC1);
+  a.release();
+  EXPECT_EQ(pool->getCachedBytes(), 400u);
+  b.release();
+  EXPECT_EQ(pool->getCachedBytes(), 400u);
+
+  pool->clear();
+  EXPECT_EQ(pool->getCachedBytes(), 0u);
+}
+
+TEST(MatPool, PinnedMemory)
+{
+  // Here we switch a pool to pinned memory. Without CUDA the switch is refused and matrices stay in pageable memory,
+  // otherwise new matrices are accessible by the GPU. Switching back frees the cached pinned buffers, while matrices
+  // still in use keep their memory.
+  MatPool* pool = MatPool::get("test_pinned");
+  pool->clear();
+
+  cv::Mat pageable = pool->create(cv::Size2i(16, 16), CV_8UC1);
+  EXPECT_EQ(MatPool::getDevicePointer(pageable), nullptr);
+
+  if (!pool->setMemory(MatPool::Memory::PINNED))
+  {
+    EXPECT_EQ(pool->getMemory(), MatPool::Memory::PAGEABLE);
+    return;
+  }
+  EXPECT_EQ(pool->getMemory(), MatPool::Memory::PINNED);
+
+  // Pageable buffers released after the switch must not be handed out as pinned ones
+  pageable.release();
+  EXPECT_EQ(pool->getCachedBytes(), 0u);
+
+  cv::Mat pinned = pool->create(cv::Size2i(16, 16), CV_8UC1);
+  EXPECT_NE(MatPool::getDevicePointer(pinned), nullptr);
+  EXPECT_NE(MatPool::getDevicePointer(pinned(cv::Rect2i(4, 4, 8, 8))), nullptr);
+
+  cv::Mat cached = pool->create(cv::Size2i(8, 8), CV_8UC1);
+  cached.release();
+  EXPECT_EQ(pool->getCachedBytes(), 64u);
+
+  EXPECT_TRUE(pool->setMemory(MatPool::Memory::PAGEABLE));
+  EXPECT_EQ(pool->getCachedBytes(), 0u);
+  EXPECT_NE(MatPool::getDevicePointer(pinned), nullptr);
+  pinned.release();
+  EXPECT_EQ(pool->getCachedBytes(), 0u);
+}
@@ -0,0 +1,31 @@
+#include <iostream>
+#include <realm_core/memory_budget.h>
+
+// gtest
+#include <gtest/gtest.h>
+
+using namespace realm;
+
+TEST(MemoryBudget, Usage)
+{
+  // Every consumer reports its current memory, which replaces its previous report. The budget is exceeded once the sum
+  // of all consumers is above the limit.
+  EXPECT_THROW(MemoryBudget(0), std::invalid_argument);
+
+  MemoryBudget budget(100);
+  EXPECT_EQ(budget.getLimit(), 100u);
+  EXPECT_FALSE(budget.isExceeded());
+
+  budget.update("mosaicing", 60);
+  budget.update("tileing", 40);
+  EXPECT_EQ(budget.getUsage(), 100u);
+  EXPECT_FALSE(budget.isExceeded());
+
+  budget.update("tileing", 50);
+  EXPECT_EQ(budget.getUsage(), 110u);
+  EXPECT_TRUE(budget.isExceeded());
+
+  budget.update("mosaicing", 10);
+  EXPECT_EQ(budget.getUsage(), 60u);
+  EXPECT_FALSE(budget.isExceeded());
+}
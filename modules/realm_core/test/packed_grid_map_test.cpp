@@ -0,0 +1,133 @@
+
+
+#include <cmath>
+#include <iostream>
+#include <realm_core/packed_grid_map.h>
+
+// gtest
+#include <gtest/gtest.h>
+
+using namespace realm;
+
+static CvGridMap createBlendInput(const cv::Rect2d &roi, double res, float angle, uchar value)
+{
+  CvGridMap map(roi, res);
+  map.add("color_rgb", cv::Mat(map.size(), CV_8UC4, cv::Scalar(value, value, value, 255)));
+  map.add("elevation", cv::Mat(map.size(), CV_32F, cv::Scalar(static_cast<float>(value))));
+  map.add("elevation_angle", cv::Mat(map.size(), CV_32F, cv::Scalar(angle)));
+  map.add("num_observations", cv::Mat(map.size(), CV_16UC1, cv::Scalar(1)));
+  map.add("elevated", cv::Mat(map.size(), CV_8UC1, cv::Scalar(1)));
+  return map;
+}
+
+TEST(PackedGridMap, Blend)
+{
+  // For this test we blend two overlapping maps into the packed map. The second one is observed under a steeper angle,
+  // so it must win in the overlap, where the number of observations is also incremented. Outside of the overlap the
+  // data of the corresponding map is kept and the packed map must have been extended to include both.
+  double res = 1.0;
+  PackedGridMap packed;
+
+  packed.blend(createBlendInput(cv::Rect2d(0.0, 0.0, 9.0, 9.0), res, 45.0f, 10));
+  packed.blend(createBlendInput(cv::Rect2d(5.0, 5.0, 9.0, 9.0), res, 80.0f, 20));
+
+  EXPECT_FALSE(packed.empty());
+  EXPECT_EQ(packed.size(), cv::Size2i(15, 15));
+  EXPECT_EQ(packed.getByteSize(), 15u * 15u * sizeof(PackedGridMap::Cell));
+
+  CvGridMap map = packed.getGridMap();
+  EXPECT_EQ(map.getAllLayerNames().size(), PackedGridMap::getLayerNames().size());
+
+  cv::Point2i idx_first = map.atIndex(cv::Point2d(1.0, 1.0));
+  cv::Point2i idx_overlap = map.atIndex(cv::Point2d(7.0, 7.0));
+  cv::Point2i idx_second = map.atIndex(cv::Point2d(12.0, 12.0));
+  cv::Point2i idx_none = map.atIndex(cv::Point2d(1.0, 12.0));
+
+  EXPECT_EQ(map["elevation"].at<float>(idx_first.y, idx_first.x), 10.0f);
+  EXPECT_EQ(map["elevation_angle"].at<float>(idx_first.y, idx_first.x), 45.0f);
+  EXPECT_EQ(map["num_observations"].at<uint16_t>(idx_first.y, idx_first.x), 1);
+
+  EXPECT_EQ(map["elevation"].at<float>(idx_overlap.y, idx_overlap.x), 20.0f);
+  EXPECT_EQ(map["color_rgb"].at<cv::Vec4b>(idx_overlap.y, idx_overlap.x), cv::Vec4b(20, 20, 20, 255));
+  EXPECT_EQ(map["elevation_angle"].at<float>(idx_overlap.y, idx_overlap.x), 80.0f);
+  EXPECT_EQ(map["num_observations"].at<uint16_t>(idx_overlap.y, idx_overlap.x), 2);
+
+  EXPECT_EQ(map["elevation"].at<float>(idx_second.y, idx_second.x), 20.0f);
+  EXPECT_EQ(map["num_observations"].at<uint16_t>(idx_second.y, idx_second.x), 2);
+
+  EXPECT_TRUE(std::isnan(map["elevation"].at<float>(idx_none.y, idx_none.x)));
+  EXPECT_EQ(map["color_rgb"].at<cv::Vec4b>(idx_none.y, idx_none.x), cv::Vec4b(0, 0, 0, 0));
+  EXPECT_EQ(map["num_observations"].at<uint16_t>(idx_none.y, idx_none.x), 0);
+}
+
+TEST(PackedGridMap, EqualsSeparateLayers)
+{
+  // Here we blend the same maps once into the packed map and once into a CvGridMap with separate layers the way the
+  // mosaicing does it. A shallower angle must not overwrite existing data. Both results must be identical.
+  double res = 0.5;
+  std::vector<CvGridMap> inputs{createBlendInput(cv::Rect2d(0.0, 0.0, 10.0, 10.0), res, 60.0f, 10),
+                                createBlendInput(cv::Rect2d(4.0, 2.0, 10.0, 6.0), res, 30.0f, 20),
+                                createBlendInput(cv::Rect2d(-3.0, 6.0, 6.0, 6.0), res, 75.0f, 30)};
+
+  PackedGridMap packed;
+  CvGridMap::Ptr reference;
+  for (const auto &input : inputs)
+  {
+    packed.blend(input);
+
+    if (reference == nullptr)
+    {
+      reference = std::make_shared<CvGridMap>(input.clone());
+      continue;
+    }
+
+    reference->add(input, REALM_OVERWRITE_ZERO, true);
+    CvGridMap ref = (*reference).getSubmap(PackedGridMap::getLayerNames(), input.roi());
+    cv::Mat &ref_color = ref["color_rgb"];
+    cv::Mat &ref_elevation = ref["elevation"];
+    cv::Mat &ref_angle = ref["elevation_angle"];
+    cv::Mat &ref_nobs = ref["num_observations"];
+    for (int r = 0; r < ref_angle.rows; ++r)
+      for (int c = 0; c < ref_angle.cols; ++c)
+      {
+        float angle_ref = ref_angle.at<float>(r, c);
+        if (std::isnan(angle_ref))
+          angle_ref = 0.0f;
+        if (input["elevation_angle"].at<float>(r, c) > angle_ref)
+        {
+          ref_color.at<cv::Vec4b>(r, c) = input["color_rgb"].at<cv::Vec4b>(r, c);
+          ref_elevation.at<float>(r, c) = input["elevation"].at<float>(r, c);
+          ref_angle.at<float>(r, c) = input["elevation_angle"].at<float>(r, c);
+          ref_nobs.at<uint16_t>(r, c) += 1;
+        }
+        else
+          ref_angle.at<float>(r, c) = angle_ref;
+      }
+    reference->add(ref, REALM_OVERWRITE_ALL, false);
+  }
+
+  ASSERT_EQ(packed.roi(), reference->roi());
+  CvGridMap unpacked = packed.getGridMap();
+  for (const auto &layer_name : PackedGridMap::getLayerNames())
+  {
+    cv::Mat a = unpacked[layer_name];
+    cv::Mat b = (*reference)[layer_name];
+    ASSERT_EQ(a.type(), b.type());
+    if (a.depth() == CV_32F)
+    {
+      // NaN does not compare equal, so it is masked out and checked separately
+      cv::Mat nan_a = (a != a);
+      cv::Mat nan_b = (b != b);
+      EXPECT_EQ(cv::countNonZero(nan_a != nan_b), 0);
+      a.setTo(0.0f, nan_a);
+      b.setTo(0.0f, nan_b);
+    }
+    EXPECT_EQ(cv::norm(a.reshape(1), b.reshape(1), cv::NORM_INF), 0.0) << layer_name;
+  }
+
+  // Submaps are deep copies of the record layers
+  CvGridMap submap = packed.getSubmap({"elevation"}, cv::Rect2d(0.0, 0.0, 2.0, 2.0));
+  EXPECT_TRUE(submap.exists("elevation"));
+  EXPECT_FALSE(submap.exists("color_rgb"));
+  EXPECT_ANY_THROW(packed.getSubmap({"elevation_var"}, cv::Rect2d(0.0, 0.0, 2.0, 2.0)));
+}
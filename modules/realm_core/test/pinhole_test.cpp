@@ -1,8 +1,11 @@
 
 
+#include <cmath>
 #include <iostream>
+#include <vector>
 #include <realm_core/camera.h>
 #include <realm_core/camera_settings_factory.h>
+#include <opencv2/imgproc.hpp>
 
 #include "test_helper.h"
 
@@ -132,6 +135,28 @@ TEST(Pinhole, Resize)
   EXPECT_NEAR(0.5 * cam.height(), cam_resized.height(), 10e-6);
 }
 
+TEST(Pinhole, Undistort)
+{
+  // Copies and independently created cameras with the same intrinsics share their undistortion maps, so all of them
+  // must undistort an image exactly the same way. A resized camera uses its own maps.
+  Pinhole cam = createDummyPinhole();
+  Pinhole copy(cam);
+  Pinhole other = createDummyPinhole();
+
+  cv::Mat img(cam.height(), cam.width(), CV_8UC1);
+  cv::randu(img, cv::Scalar(0), cv::Scalar(255));
+
+  cv::Mat img_undistorted = cam.undistort(img, cv::INTER_LINEAR);
+  EXPECT_EQ(img_undistorted.size(), img.size());
+  EXPECT_EQ(cv::countNonZero(img_undistorted != copy.undistort(img, cv::INTER_LINEAR)), 0);
+  EXPECT_EQ(cv::countNonZero(img_undistorted != other.undistort(img, cv::INTER_LINEAR)), 0);
+
+  Pinhole cam_resized = cam.resize(0.5);
+  cv::Mat img_resized;
+  cv::resize(img, img_resized, cv::Size(), 0.5, 0.5);
+  EXPECT_EQ(cam_resized.undistort(img_resized, cv::INTER_LINEAR).size(), img_resized.size());
+}
+
 TEST(Pinhole, Projections)
 {
   // For this test we project the image boundaries into a reference plane. This checks the validity of 5 different
@@ -167,6 +192,40 @@ TEST(Pinhole, Projections)
   EXPECT_NEAR(p1.at<double>(2), 0.0, 10e-6);
 }
 
+TEST(Pinhole, BatchedProjections)
+{
+  // For this test the batched projections are compared to the single ones, in double and float precision
+  Pinhole cam = createDummyPinhole();
+  cam.setPose(createDummyPose());
+
+  cv::Mat p = (cv::Mat_<double>(3, 1) << 0, 0, 10.0);
+  cv::Mat n = (cv::Mat_<double>(3, 1) << 0, 0, 1.0);
+
+  cv::Mat bounds_in_plane = cam.projectImageBoundsToPlane(p, n);
+  std::array<cv::Vec3d, 4> bounds_batched;
+  cam.projectImageBoundsToPlane(cv::Vec3d(0.0, 0.0, 10.0), cv::Vec3d(0.0, 0.0, 1.0), bounds_batched);
+  std::array<cv::Vec3f, 4> bounds_batched_f;
+  cam.projectImageBoundsToPlane(cv::Vec3f(0.0f, 0.0f, 10.0f), cv::Vec3f(0.0f, 0.0f, 1.0f), bounds_batched_f);
+  for (int i = 0; i < 4; ++i)
+    for (int j = 0; j < 3; ++j)
+    {
+      EXPECT_NEAR(bounds_batched[i][j], bounds_in_plane.at<double>(i, j), 10e-6);
+      EXPECT_NEAR(bounds_batched_f[i][j], bounds_in_plane.at<double>(i, j), 10e-3);
+    }
+
+  std::vector<double> pixels{0.0, 0.0, 100.0, 200.0, 1199.0, 999.0};
+  std::vector<double> depths{1200.0, 500.0, -1.0};
+  std::vector<double> points(9);
+  cam.projectPointsToWorld(pixels.data(), depths.data(), depths.size(), points.data());
+  for (size_t i = 0; i < 2; ++i)
+  {
+    cv::Mat pt = cam.projectPointToWorld(pixels[2*i], pixels[2*i+1], depths[i]);
+    for (int j = 0; j < 3; ++j)
+      EXPECT_NEAR(points[3*i+j], pt.at<double>(j), 10e-6);
+  }
+  EXPECT_TRUE(std::isnan(points[6]) && std::isnan(points[7]) && std::isnan(points[8]));
+}
+
 TEST(Pinhole, Settings)
 {
   auto settings = CameraSettingsFactory::load("calib.yaml");
@@ -54,4 +54,54 @@ TEST(PlaneFitter, BestFit)
   EXPECT_DOUBLE_EQ(plane.pt.z, 0.0);
   EXPECT_DOUBLE_EQ(r, 1.0);
   EXPECT_NEAR(fabs(phi), 0.0, 10e-2);
-}
\ No newline at end of file
+}
+TEST(PlaneFitter, Accumulator)
+{
+  // For this test a noise free, tilted plane is sampled at UTM coordinates. The closed form fit of the accumulator must
+  // find its normal in double and in single precision, which needs the moments to be relative to the first point.
+  // Points on a line do not define a plane and must be rejected.
+  const double nx = 0.3, ny = -0.2;
+  const double nz = sqrt(1.0 - nx*nx - ny*ny);
+
+  PlaneFitAccumulator<double> acc_double;
+  PlaneFitAccumulator<float> acc_float;
+  std::vector<Pf::Point> points;
+  for (int i = 0; i < 5; ++i)
+    for (int j = 0; j < 4; ++j)
+    {
+      double x = 0.3*i + 0.05*j;
+      double y = 0.25*j - 0.02*i;
+      double z = -(nx*x + ny*y) / nz;
+      acc_double.add(603976.0 + x, 5791569.0 + y, 350.0 + z);
+      acc_float.add(static_cast<float>(x), static_cast<float>(y), static_cast<float>(z));
+      points.push_back(Pf::Point{603976.0 + x, 5791569.0 + y, 350.0 + z});
+    }
+  EXPECT_EQ(acc_double.size(), 20u);
+
+  double normal[3], centroid[3];
+  ASSERT_TRUE(acc_double.estimate(normal, centroid));
+  double sign = (normal[2] < 0.0 ? -1.0 : 1.0);
+  EXPECT_NEAR(sign*normal[0], nx, 1e-9);
+  EXPECT_NEAR(sign*normal[1], ny, 1e-9);
+  EXPECT_NEAR(sign*normal[2], nz, 1e-9);
+
+  PlaneFitter plane_fitter;
+  Pf::Plane plane = plane_fitter.estimate(points);
+  EXPECT_NEAR(centroid[0], plane.pt.x, 1e-6);
+  EXPECT_NEAR(centroid[1], plane.pt.y, 1e-6);
+  EXPECT_NEAR(centroid[2], plane.pt.z, 1e-6);
+
+  float normal_float[3];
+  ASSERT_TRUE(acc_float.estimate(normal_float));
+  float sign_float = (normal_float[2] < 0.0f ? -1.0f : 1.0f);
+  EXPECT_NEAR(sign_float*normal_float[0], nx, 1e-3);
+  EXPECT_NEAR(sign_float*normal_float[1], ny, 1e-3);
+
+  PlaneFitAccumulator<double> acc_line;
+  for (int i = 0; i < 5; ++i)
+    acc_line.add(1.0*i, 2.0*i, 0.5*i);
+  EXPECT_FALSE(acc_line.estimate(normal));
+  acc_line.reset();
+  EXPECT_EQ(acc_line.size(), 0u);
+  EXPECT_FALSE(acc_line.estimate(normal));
+}
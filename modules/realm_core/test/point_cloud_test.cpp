@@ -0,0 +1,93 @@
+
+
+#include <iostream>
+#include <realm_core/point_cloud.h>
+#include <realm_core/stereo.h>
+
+#include "test_helper.h"
+
+// gtest
+#include <gtest/gtest.h>
+
+using namespace realm;
+
+TEST(PointCloud, Conversion)
+{
+  // For this test we create a cloud from the matrix layout with colors and normals in UTM coordinates. The typed
+  // storage must keep the positions precise despite single precision and convert back to the same matrix.
+  std::vector<uint32_t> point_ids{4, 8, 15};
+  cv::Mat data = (cv::Mat_<double>(3, 9) << 603976.25, 5791569.5, 100.0, 10, 20, 30, 0, 0, 1,
+                                            604012.75, 5791601.25, 95.5, 40, 50, 60, 0, 1, 0,
+                                            603900.5, 5791480.75, 110.25, 70, 80, 90, 1, 0, 0);
+  PointCloud cloud(point_ids, data);
+
+  EXPECT_EQ(cloud.size(), 3);
+  EXPECT_TRUE(cloud.hasColors());
+  EXPECT_TRUE(cloud.hasNormals());
+  EXPECT_EQ(cloud.getPointIds(), point_ids);
+  EXPECT_EQ(cloud.getColors()[1], cv::Vec3b(40, 50, 60));
+  EXPECT_LT(cloud.getByteSize(), data.total() * data.elemSize() / 2);
+
+  cv::Mat data_converted = cloud.toMat();
+  ASSERT_EQ(data_converted.size(), data.size());
+  EXPECT_LT(cv::norm(data_converted, data, cv::NORM_INF), 1e-3);
+
+  // Positions only, empty matrix results in an empty cloud
+  PointCloud cloud_xyz(point_ids, data.colRange(0, 3).clone());
+  EXPECT_FALSE(cloud_xyz.hasColors());
+  EXPECT_EQ(cloud_xyz.toMat().cols, 3);
+  EXPECT_TRUE(PointCloud(std::vector<uint32_t>(), cv::Mat()).empty());
+  EXPECT_ANY_THROW(PointCloud(std::vector<uint32_t>{1}, data));
+}
+
+TEST(PointCloud, Transform)
+{
+  // Here we transform a cloud from visual coordinates into UTM with a scaled rotation, which is what the georeference
+  // does. Positions must match the double precision result, normals are rotated and stay normalized.
+  std::vector<uint32_t> point_ids{0, 1};
+  cv::Mat data = (cv::Mat_<double>(2, 9) << 0.5, 0.25, 1.0, 0, 0, 0, 1, 0, 0,
+                                            -1.5, 2.0, 0.5, 0, 0, 0, 0, 0, 1);
+  PointCloud cloud(point_ids, data);
+
+  double s = 12.5;
+  cv::Mat T = (cv::Mat_<double>(3, 4) << 0, -s, 0, 603976.0,
+                                         s,  0, 0, 5791569.0,
+                                         0,  0, s, 100.0);
+  cloud.transform(T);
+
+  for (int i = 0; i < data.rows; ++i)
+  {
+    cv::Mat pt = T.colRange(0, 3) * data.row(i).colRange(0, 3).t() + T.col(3);
+    cv::Point3d pt_cloud = cloud.getPoint(i);
+    EXPECT_NEAR(pt_cloud.x, pt.at<double>(0), 1e-4);
+    EXPECT_NEAR(pt_cloud.y, pt.at<double>(1), 1e-4);
+    EXPECT_NEAR(pt_cloud.z, pt.at<double>(2), 1e-4);
+  }
+  EXPECT_NEAR(cloud.getNormals()[0].y, 1.0f, 1e-6);
+  EXPECT_NEAR(cloud.getNormals()[1].z, 1.0f, 1e-6);
+}
+
+TEST(PointCloud, DepthMap)
+{
+  // For this test we splat the same points once as matrix and once as typed cloud. Both depth maps must be identical.
+  auto cam = std::make_shared<camera::Pinhole>(createDummyPinhole());
+  cam->setPose(createDummyPose());
+
+  cv::Mat points(500, 3, CV_64F);
+  cv::RNG rng(42);
+  rng.fill(points.col(0), cv::RNG::UNIFORM, -50.0, 50.0);
+  rng.fill(points.col(1), cv::RNG::UNIFORM, -50.0, 50.0);
+  rng.fill(points.col(2), cv::RNG::UNIFORM, 0.0, 20.0);
+  points.col(0) += cam->t().at<double>(0);
+  points.col(1) += cam->t().at<double>(1);
+
+  std::vector<uint32_t> point_ids(500);
+  for (uint32_t i = 0; i < point_ids.size(); ++i)
+    point_ids[i] = i;
+  PointCloud cloud(point_ids, points);
+
+  cv::Mat depthmap_mat = stereo::computeDepthMapFromPointCloud(cam, points);
+  cv::Mat depthmap_cloud = stereo::computeDepthMapFromPointCloud(cam, cloud);
+  EXPECT_GT(cv::countNonZero(depthmap_mat > 0), 0);
+  EXPECT_EQ(cv::countNonZero(cv::abs(depthmap_mat - depthmap_cloud) > 1e-3), 0);
+}
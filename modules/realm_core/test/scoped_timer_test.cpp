@@ -0,0 +1,75 @@
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <realm_core/scoped_timer.h>
+
+// gtest
+#include <gtest/gtest.h>
+
+using namespace realm;
+
+TEST(ScopedTimer, Recording)
+{
+  // Timings are only recorded while an output file is opened. Every thread records into its own buffer, which is
+  // written together with the name of the thread.
+  TimingRecorder &recorder = TimingRecorder::instance();
+  {
+    ScopedTimer timer("Disabled");
+  }
+  EXPECT_TRUE(recorder.drain().empty());
+
+  recorder.open("timing_test.bin");
+  EXPECT_TRUE(recorder.isEnabled());
+  {
+    ScopedTimer timer("Main");
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  std::thread worker([&]
+  {
+    recorder.setThreadName("Worker");
+    for (int i = 0; i < 3; ++i)
+      ScopedTimer timer("Work");
+  });
+  worker.join();
+
+  auto records = recorder.drain();
+  ASSERT_EQ(records.size(), 4u);
+  EXPECT_STREQ(records[0].second.name, "Main");
+  EXPECT_GE(records[0].second.duration, 2000u);
+  EXPECT_EQ(records[1].first, "Worker");
+  EXPECT_STREQ(records[1].second.name, "Work");
+}
+
+TEST(ScopedTimer, BinaryFormat)
+{
+  // The binary file consists of a short header and records of fixed size, which are parsed by the analyze tool
+  TimingRecorder &recorder = TimingRecorder::instance();
+  recorder.open("timing_test.bin");
+  recorder.record("Step", 1000, 1500);
+  recorder.record("Step", 2000, 2250);
+  EXPECT_EQ(recorder.flush(), 2u);
+  recorder.close();
+  EXPECT_FALSE(recorder.isEnabled());
+
+  std::ifstream file("timing_test.bin", std::ios::binary);
+  char magic[4];
+  uint32_t version;
+  file.read(magic, 4);
+  file.read(reinterpret_cast<char*>(&version), sizeof(version));
+  EXPECT_EQ(std::string(magic, 4), "RTIM");
+  EXPECT_EQ(version, TimingRecorder::kFileVersion);
+
+  char thread[32], name[32];
+  uint64_t t_start, duration;
+  file.read(thread, 32);
+  file.read(name, 32);
+  file.read(reinterpret_cast<char*>(&t_start), sizeof(t_start));
+  file.read(reinterpret_cast<char*>(&duration), sizeof(duration));
+  EXPECT_STREQ(name, "Step");
+  EXPECT_EQ(t_start, 1000u);
+  EXPECT_EQ(duration, 500u);
+
+  // Exactly one more record of 80 bytes must follow
+  file.seekg(0, std::ios::end);
+  EXPECT_EQ(static_cast<size_t>(file.tellg()), 8u + 2u*80u);
+}
@@ -0,0 +1,99 @@
+#include <iostream>
+#include <thread>
+#include <realm_core/spsc_ring_buffer.h>
+
+// gtest
+#include <gtest/gtest.h>
+
+using namespace realm;
+
+TEST(SpscRingBuffer, DropOldest)
+{
+  // Stages buffer incoming frames up to their queue size. If the processing can not keep up, the oldest frame is
+  // dropped, which is signaled to the producer through the return value of push.
+  EXPECT_THROW(SpscRingBuffer<int>(0), std::invalid_argument);
+
+  SpscRingBuffer<int> buffer(3);
+  EXPECT_TRUE(buffer.empty());
+  EXPECT_EQ(buffer.capacity(), 3u);
+
+  for (int i = 0; i < 3; ++i)
+    EXPECT_TRUE(buffer.push(i));
+  EXPECT_FALSE(buffer.push(3));
+  EXPECT_FALSE(buffer.push(4));
+  EXPECT_EQ(buffer.size(), 3u);
+
+  int value;
+  for (int i = 2; i < 5; ++i)
+  {
+    EXPECT_TRUE(buffer.pop(value));
+    EXPECT_EQ(value, i);
+  }
+  EXPECT_FALSE(buffer.pop(value));
+
+  buffer.push(5);
+  buffer.clear();
+  EXPECT_TRUE(buffer.empty());
+}
+
+TEST(SpscRingBuffer, Priority)
+{
+  // With priorities a full buffer drops whichever of the oldest and the new element has the lower priority. Equal
+  // priorities still drop the oldest one.
+  SpscRingBuffer<int> buffer(2);
+  EXPECT_TRUE(buffer.push(0, 1.0));
+  EXPECT_TRUE(buffer.push(1, 0.5));
+
+  // New element has lower priority than the oldest one, so it is rejected
+  EXPECT_FALSE(buffer.push(2, 0.2));
+
+  // New element has higher priority, so the oldest one is dropped
+  EXPECT_FALSE(buffer.push(3, 2.0));
+
+  // Equal priority to the oldest one drops the oldest
+  EXPECT_FALSE(buffer.push(4, 0.5));
+
+  int value;
+  EXPECT_TRUE(buffer.pop(value));
+  EXPECT_EQ(value, 3);
+  EXPECT_TRUE(buffer.pop(value));
+  EXPECT_EQ(value, 4);
+  EXPECT_FALSE(buffer.pop(value));
+}
+
+TEST(SpscRingBuffer, ProducerConsumer)
+{
+  // Here one thread pushes a sequence of numbers as fast as possible, while the main thread pops them. Popped elements
+  // must be strictly increasing and every element must be either popped or dropped exactly once. The smallest possible
+  // buffer makes producer and consumer compete for the same element all the time.
+  for (size_t capacity : {1, 4})
+  {
+    SpscRingBuffer<std::shared_ptr<int>> buffer(capacity);
+    const int nrof_elements = 100000;
+
+    int nrof_dropped = 0;
+    std::thread producer([&]
+    {
+      for (int i = 0; i < nrof_elements; ++i)
+        if (!buffer.push(std::make_shared<int>(i)))
+          nrof_dropped++;
+    });
+
+    int nrof_popped = 0;
+    int last = -1;
+    std::shared_ptr<int> value;
+    while (last < nrof_elements - 1)
+    {
+      if (buffer.pop(value))
+      {
+        EXPECT_GT(*value, last);
+        last = *value;
+        nrof_popped++;
+      }
+    }
+    producer.join();
+
+    EXPECT_TRUE(buffer.empty());
+    EXPECT_EQ(nrof_popped + nrof_dropped, nrof_elements);
+  }
+}
@@ -48,6 +48,33 @@ TEST(Stereo, ReprojectDepthMap)
   EXPECT_DOUBLE_EQ(center[2], 0.0);
 }
 
+TEST(Stereo, ReprojectDepthMapFloat)
+{
+  // Here we reproject the same depth map in double precision serially and in single precision relative to the camera
+  // position on a thread pool. Both must describe the same points, invalid depths are reprojected to the origin.
+  auto cam = std::make_shared<Pinhole>(createDummyPinhole());
+  cam->setPose(createDummyPose());
+
+  cv::Mat depthmap(cam->height(), cam->width(), CV_32F);
+  for (int r = 0; r < depthmap.rows; ++r)
+    for (int c = 0; c < depthmap.cols; ++c)
+      depthmap.at<float>(r, c) = 1200.0 + 600.0 - static_cast<float>(c);
+  depthmap.at<float>(10, 10) = -1.0;
+
+  auto thread_pool = std::make_shared<ThreadPool>(4);
+  cv::Point3d origin(500.0, 600.0, 1200.0);
+  cv::Mat img3d = stereo::reprojectDepthMap(cam, depthmap);
+  cv::Mat img3d_float = stereo::reprojectDepthMapFloat(cam, depthmap, origin, thread_pool, 0);
+  ASSERT_EQ(img3d_float.type(), CV_32FC3);
+
+  cv::Mat img3d_relative = img3d - cv::Scalar(origin.x, origin.y, origin.z);
+  cv::Mat img3d_converted;
+  img3d_float.convertTo(img3d_converted, CV_64FC3);
+  img3d_relative.at<cv::Vec3d>(10, 10) = cv::Vec3d(0.0, 0.0, 0.0);
+  EXPECT_LT(cv::norm(img3d_converted, img3d_relative, cv::NORM_INF), 1e-3);
+  EXPECT_EQ(img3d_float.at<cv::Vec3f>(10, 10), cv::Vec3f(0.0f, 0.0f, 0.0f));
+}
+
 TEST(Stereo, DepthMapFromPointCloud)
 {
   // This test is basically the same as the one prior, just in reverse direction. At first we create the point cloud,
@@ -74,6 +101,74 @@ TEST(Stereo, DepthMapFromPointCloud)
   EXPECT_FLOAT_EQ(depthmap.at<float>(depthmap.rows-1, 0), 1800.0);
 }
 
+TEST(Stereo, DepthMapFromPointCloudNearestWins)
+{
+  // Two points on the same viewing ray project into the same cell. The nearer one has to be kept, even though the
+  // other one comes later in the point cloud.
+  auto cam = std::make_shared<Pinhole>(createDummyPinhole());
+  cam->setPose(createDummyPose());
+  auto cam_resized = std::make_shared<Pinhole>(cam->resize(0.1));
+
+  // Point halfway between the camera center at (500, 600, 1200) and the point of depth 1800 of the prior test
+  cv::Mat points = (cv::Mat_<double>(2, 3) <<
+          125.0, 150.0, 300.0,
+          -250.0, -300.0, -600.0);
+
+  cv::Mat depthmap = stereo::computeDepthMapFromPointCloud(cam_resized, points);
+
+  EXPECT_FLOAT_EQ(depthmap.at<float>(0, 0), 900.0);
+  EXPECT_FLOAT_EQ(depthmap.at<float>(0, 1), -1.0);
+}
+
+TEST(Stereo, DepthMapFromPointCloudParallel)
+{
+  // A dense point cloud is splatted serially and on a thread pool. As only the nearest point per cell is kept, both
+  // depth maps have to be identical.
+  auto cam = std::make_shared<Pinhole>(createDummyPinhole());
+  cam->setPose(createDummyPose());
+
+  cv::Mat depthmap(cam->height(), cam->width(), CV_32F);
+  for (int r = 0; r < depthmap.rows; ++r)
+    for (int c = 0; c < depthmap.cols; ++c)
+      depthmap.at<float>(r, c) = 1200.0 + 600.0 - static_cast<float>(c);
+
+  cv::Mat img3d = stereo::reprojectDepthMap(cam, depthmap);
+  cv::Mat points = img3d.reshape(1, static_cast<int>(img3d.total()));
+
+  auto thread_pool = std::make_shared<ThreadPool>(4);
+  cv::Mat depthmap_serial = stereo::computeDepthMapFromPointCloud(cam, points);
+  cv::Mat depthmap_parallel = stereo::computeDepthMapFromPointCloud(cam, points, thread_pool, 0);
+
+  EXPECT_EQ(cv::countNonZero(depthmap_serial != depthmap_parallel), 0);
+  EXPECT_GT(cv::countNonZero(depthmap_serial > 0), 0);
+}
+
+TEST(Stereo, DepthMapFromDepthMap)
+{
+  // Here we project a depth map into a resized camera once through its dense cloud and once directly. Cells without
+  // depth are left out of the cloud, so both have to be identical.
+  auto cam = std::make_shared<Pinhole>(createDummyPinhole());
+  cam->setPose(createDummyPose());
+  auto cam_resized = std::make_shared<Pinhole>(cam->resize(0.5));
+
+  cv::Mat depthmap(cam->height(), cam->width(), CV_32F);
+  for (int r = 0; r < depthmap.rows; ++r)
+    for (int c = 0; c < depthmap.cols; ++c)
+      depthmap.at<float>(r, c) = 1200.0 + 600.0 - static_cast<float>(c);
+  depthmap.colRange(0, 10).setTo(-1.0);
+
+  cv::Mat img3d = stereo::reprojectDepthMap(cam, depthmap);
+  cv::Mat points = img3d.colRange(10, img3d.cols).clone().reshape(1, static_cast<int>(img3d.rows * (img3d.cols - 10)));
+
+  auto thread_pool = std::make_shared<ThreadPool>(4);
+  cv::Mat depthmap_cloud = stereo::computeDepthMapFromPointCloud(cam_resized, points);
+  cv::Mat depthmap_direct = stereo::computeDepthMapFromDepthMap(cam_resized, cam, depthmap, thread_pool, 0);
+
+  ASSERT_EQ(depthmap_direct.size(), depthmap_cloud.size());
+  EXPECT_LT(cv::norm(depthmap_direct, depthmap_cloud, cv::NORM_INF), 1e-2);
+  EXPECT_GT(cv::countNonZero(depthmap_direct > 0), 0);
+}
+
 TEST(Stereo, NormalsFromDepthMap)
 {
   // For this test we create an artificial camera and depthmap and compute the normals for all pixels
@@ -118,4 +213,19 @@ TEST(Stereo, BaselineFromPose)
   double baseline = stereo::computeBaselineFromPose(p1, p2);
 
   EXPECT_NEAR(baseline, 749.266, 0.01);
-}
\ No newline at end of file
+}
+
+TEST(Stereo, NormalsFromDepthMapParallel)
+{
+  // Normals computed row-parallel on a thread pool must equal the serial result, including the reflected border
+  cv::Mat depthmap(100, 120, CV_32F);
+  cv::randu(depthmap, cv::Scalar(500.0), cv::Scalar(1500.0));
+
+  auto thread_pool = std::make_shared<ThreadPool>(4);
+  cv::Mat normals_serial = stereo::computeNormalsFromDepthMap(depthmap);
+  cv::Mat normals_parallel = stereo::computeNormalsFromDepthMap(depthmap, thread_pool, 0);
+
+  EXPECT_EQ(normals_serial.size(), depthmap.size());
+  EXPECT_EQ(cv::norm(normals_serial, normals_parallel, cv::NORM_INF), 0.0);
+  EXPECT_EQ(normals_serial.at<cv::Vec3f>(0, 0), normals_serial.at<cv::Vec3f>(1, 1));
+}
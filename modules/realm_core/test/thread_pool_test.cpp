@@ -0,0 +1,63 @@
+#include <iostream>
+#include <realm_core/thread_pool.h>
+
+// gtest
+#include <gtest/gtest.h>
+
+using namespace realm;
+
+TEST(ThreadPool, Submit)
+{
+  // Here we submit a number of independent tasks to the pool and wait for their futures. Every task writes to its own
+  // element, so after all futures returned every element must have been written exactly once.
+  ThreadPool pool(4);
+  EXPECT_EQ(pool.getNrofThreads(), 4);
+
+  std::vector<int> results(100, 0);
+  std::vector<std::future<void>> futures;
+  for (size_t i = 0; i < results.size(); ++i)
+    futures.push_back(pool.submit([&results, i]{ results[i] += static_cast<int>(i); }));
+  for (auto &future : futures)
+    future.get();
+
+  for (size_t i = 0; i < results.size(); ++i)
+    EXPECT_EQ(results[i], static_cast<int>(i));
+
+  // Exceptions inside a task are forwarded to the future
+  std::future<void> future = pool.submit([]{ throw(std::runtime_error("Error: Test")); });
+  EXPECT_THROW(future.get(), std::runtime_error);
+}
+
+TEST(ThreadPool, NestedParallelFor)
+{
+  // Data-parallel loops are split into stripes that must cover the range exactly once. Loops are also started from
+  // inside the pool, e.g. a stage task which splits its rows once more. With more outer stripes than threads all pool
+  // threads are busy with an inner loop at the same time, which must not dead lock.
+  ThreadPool pool(2);
+
+  cv::Mat counter = cv::Mat::zeros(37, 53, CV_32S);
+  pool.parallelFor(cv::Range(0, counter.rows), [&](const cv::Range &range_rows)
+  {
+    for (int r = range_rows.start; r < range_rows.end; ++r)
+      pool.parallelFor(cv::Range(0, counter.cols), [&](const cv::Range &range_cols)
+      {
+        for (int c = range_cols.start; c < range_cols.end; ++c)
+          counter.at<int>(r, c)++;
+      });
+  }, 8);
+
+  EXPECT_EQ(cv::countNonZero(counter != 1), 0);
+
+  // Helper with the pipeline threading policy produces the same result with and without pool
+  cv::Mat counter_cv = cv::Mat::zeros(37, 53, CV_32S);
+  parallelFor(nullptr, cv::Range(0, counter_cv.rows), [&](const cv::Range &range)
+  {
+    for (int r = range.start; r < range.end; ++r)
+      for (int c = 0; c < counter_cv.cols; ++c)
+        counter_cv.at<int>(r, c)++;
+  }, 0);
+  EXPECT_EQ(cv::countNonZero(counter_cv != 1), 0);
+
+  EXPECT_THROW(pool.parallelFor(cv::Range(0, 10), [](const cv::Range &){ throw(std::runtime_error("Error: Test")); }),
+               std::runtime_error);
+}
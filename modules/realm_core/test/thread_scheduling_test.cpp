@@ -0,0 +1,58 @@
+#include <stdexcept>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include <realm_core/thread_scheduling.h>
+
+// gtest
+#include <gtest/gtest.h>
+
+using namespace realm;
+
+TEST(ThreadScheduling, ParseCpuList)
+{
+  // Here we test parsing of the cpu lists as they are given in the stage settings. Single cores and ranges can be
+  // mixed, anything else has to be rejected.
+  EXPECT_TRUE(parseCpuList("").empty());
+  EXPECT_EQ(parseCpuList("3"), std::vector<int>({3}));
+  EXPECT_EQ(parseCpuList("0,2"), std::vector<int>({0, 2}));
+  EXPECT_EQ(parseCpuList("2-5"), std::vector<int>({2, 3, 4, 5}));
+  EXPECT_EQ(parseCpuList("0,2-3"), std::vector<int>({0, 2, 3}));
+
+  EXPECT_THROW(parseCpuList("a"), std::invalid_argument);
+  EXPECT_THROW(parseCpuList("1x"), std::invalid_argument);
+  EXPECT_THROW(parseCpuList("5-2"), std::invalid_argument);
+  EXPECT_THROW(parseCpuList("-1"), std::invalid_argument);
+}
+
+TEST(ThreadScheduling, Apply)
+{
+  // For this test the affinity of a thread is restricted to the first core. Nice values and real time priorities
+  // depend on the privileges of the test, so they are not checked here.
+  ThreadScheduling scheduling;
+  EXPECT_FALSE(scheduling.isSet());
+  EXPECT_TRUE(applyToCurrentThread(scheduling, "test"));
+
+  scheduling.cpus = {0};
+  EXPECT_TRUE(scheduling.isSet());
+  EXPECT_EQ(scheduling.toString(), "cpus=0 nice=0 realtime_priority=0");
+
+#ifdef __linux__
+  bool is_applied = false;
+  bool is_restricted = false;
+  std::thread thread([&]
+  {
+    is_applied = applyToCurrentThread(scheduling, "test");
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    sched_getaffinity(0, sizeof(cpu_set_t), &cpu_set);
+    is_restricted = (CPU_COUNT(&cpu_set) == 1 && CPU_ISSET(0, &cpu_set));
+  });
+  thread.join();
+  EXPECT_TRUE(is_applied);
+  EXPECT_TRUE(is_restricted);
+#endif
+}
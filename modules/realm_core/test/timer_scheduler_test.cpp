@@ -0,0 +1,80 @@
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include <realm_core/timer.h>
+#include <realm_core/timer_scheduler.h>
+
+// gtest
+#include <gtest/gtest.h>
+
+using namespace realm;
+
+TEST(TimerScheduler, SharedThread)
+{
+  // Here we test, that all timers are executed periodically by the one thread of the scheduler. Intervals are chosen
+  // generously, so the test does not depend on exact timing.
+  std::atomic<int> counter_a{0};
+  std::atomic<int> counter_b{0};
+  std::thread::id id_a, id_b;
+
+  size_t nrof_tasks = TimerScheduler::instance().getNrofTasks();
+  {
+    Timer timer_a(std::chrono::milliseconds(20), [&]{ id_a = std::this_thread::get_id(); counter_a++; });
+    Timer timer_b(std::chrono::milliseconds(50), [&]{ id_b = std::this_thread::get_id(); counter_b++; });
+    EXPECT_EQ(TimerScheduler::instance().getNrofTasks(), nrof_tasks + 2);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  }
+  EXPECT_EQ(TimerScheduler::instance().getNrofTasks(), nrof_tasks);
+
+  EXPECT_GT(counter_a, 10);
+  EXPECT_GT(counter_b, 4);
+  EXPECT_GT(counter_a, counter_b);
+  EXPECT_EQ(id_a, id_b);
+  EXPECT_NE(id_a, std::this_thread::get_id());
+
+  // Callbacks must not be executed anymore once the timer was destroyed
+  int counter_a_final = counter_a;
+  int counter_b_final = counter_b;
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_EQ(counter_a, counter_a_final);
+  EXPECT_EQ(counter_b, counter_b_final);
+}
+
+TEST(TimerScheduler, RemoveWhileRunning)
+{
+  // For this test a callback is removed while it is executed. Removing it has to wait until the callback returned, so
+  // its owner can be safely destroyed afterwards. Removing a task from within its own callback must not block.
+  std::atomic<bool> is_running{false};
+  std::atomic<bool> has_returned{false};
+  TimerScheduler::TaskId id = TimerScheduler::instance().add(std::chrono::milliseconds(10), [&]
+  {
+    is_running = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    has_returned = true;
+  });
+
+  while (!is_running)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  TimerScheduler::instance().remove(id);
+  EXPECT_TRUE(has_returned);
+
+  std::atomic<int> counter{0};
+  TimerScheduler::TaskId id_self = 0;
+  std::mutex mutex;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    id_self = TimerScheduler::instance().add(std::chrono::milliseconds(10), [&]
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      counter++;
+      TimerScheduler::instance().remove(id_self);
+    });
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_EQ(counter, 1);
+
+  // Unknown identifiers are ignored
+  TimerScheduler::instance().remove(id_self);
+}
@@ -88,4 +88,38 @@ TEST(WorkerThread, Async)
 TEST(WorkerThread, InvalidConstruction)
 {
   EXPECT_ANY_THROW(auto worker = std::make_shared<DummyWorker>(0););
-}
\ No newline at end of file
+}
+TEST(WorkerThread, EventDriven)
+{
+  // In event-driven mode the worker must not wake up after its sleep time, but only for new data or requests from the
+  // outside. The sleep time is therefore chosen short, so polling would visibly increment the counter. Requests on the
+  // other hand have to be handled right away, even though the worker is waiting without timeout.
+  auto worker = std::make_shared<DummyWorker>(10);
+  worker->setEventDriven(true);
+  worker->registerAsyncConditionFunctor([=]{ return (worker->counter < 5 && worker->counter > 1); });
+  worker->start();
+
+  // Only the first run is processed without any event
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_EQ(worker->counter, 1);
+
+  worker->counter = 2;
+  worker->notify();
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(worker->counter, 5);
+
+  // Stop and reset wake up the worker as well
+  worker->requestStop();
+  worker->requestReset();
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(worker->counter, 0);
+
+  // Resuming processes once, afterwards the worker waits again
+  worker->resume();
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_EQ(worker->counter, 1);
+
+  // Finish must return without an additional notify
+  worker->requestFinish();
+  worker->join();
+}
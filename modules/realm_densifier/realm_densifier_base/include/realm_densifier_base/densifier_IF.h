@@ -5,7 +5,10 @@
 
 #include <iostream>
 #include <memory>
+#include <string>
 #include <deque>
+#include <exception>
+#include <future>
 
 #include <opencv2/core.hpp>
 
@@ -31,6 +34,35 @@ class DensifierIF
      */
     virtual Depthmap::Ptr densify(const std::deque<Frame::Ptr> &frames, uint8_t ref_idx) = 0;
 
+    /*!
+     * @brief Starts the densification of multiple frames, e.g. on one of several devices. Results of consecutive calls
+     * may become available out of order, callers that need them in order have to collect them in order. By default the
+     * densification runs synchronously inside the call.
+     * @param frames vector of frames used for SFM, see densify()
+     * @param ref_idx index of vector element that should be used as reference
+     * @return Future of the depth map, rethrows exceptions of the densification
+     */
+    virtual std::future<Depthmap::Ptr> densifyAsync(const std::deque<Frame::Ptr> &frames, uint8_t ref_idx)
+    {
+      std::promise<Depthmap::Ptr> depthmap;
+      try
+      {
+        depthmap.set_value(densify(frames, ref_idx));
+      }
+      catch (...)
+      {
+        depthmap.set_exception(std::current_exception());
+      }
+      return depthmap.get_future();
+    }
+
+    /*!
+     * @brief Getter for the number of densifications that are processed concurrently by densifyAsync(). Submitting
+     * more than that only queues them up.
+     * @return Number of concurrent densifications, 1 for synchronous implementations
+     */
+    virtual int getNrofConcurrentJobs() { return 1; }
+
     /*!
      * @brief Getter for nrof frames for SFM
      * @return number of frames to be used for densification, for stereo implementations usually two
@@ -47,6 +79,15 @@ class DensifierIF
      * @brief Function to print densifier settings to the log. Must be implemented by the derived class.
      */
     virtual void printSettingsToLog() = 0;
+
+    /*!
+     * @brief Changes a parameter of the densifier at runtime, e.g. to trade quality for processing time. It may be called
+     * from any thread, implementations apply the change before the next densification.
+     * @param name Name of the parameter
+     * @param val Value of the parameter
+     * @return True if the parameter is supported and was changed
+     */
+    virtual bool changeParam(const std::string &name, const std::string &val) { return false; }
   private:
 
 };
@@ -8,9 +8,11 @@
 #include <realm_densifier_base/densifier_IF.h>
 #include <realm_densifier_base/densifier_settings.h>
 #include <realm_densifier_base/densifier_dummy.h>
+#include <realm_densifier_base/semi_global_matching.h>
 
 #ifdef USE_CUDA
   #include <realm_densifier_base/plane_sweep.h>
+  #include <realm_densifier_base/plane_sweep_multi_device.h>
 #endif
 
 namespace realm
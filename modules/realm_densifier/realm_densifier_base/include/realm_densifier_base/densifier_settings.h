@@ -49,6 +49,7 @@ class PlaneSweepSettings : public DensifierSettings
       add("enable_out_best_cost", Parameter_t<int>{0, ""});
       add("enable_out_cost_vol", Parameter_t<int>{0, ""});
       add("enable_out_uniq_ratio", Parameter_t<int>{0, ""});
+      add("use_streaming_costs", Parameter_t<int>{1, "Flag to keep only the running best and second best cost and depth per pixel instead of the full cost volume. Overrides enable_out_cost_vol"});
       add("scale", Parameter_t<double>{1.0, ""});
       add("nrof_planes", Parameter_t<int>{0, ""});
       add("match_window_size_x", Parameter_t<int>{0, ""});
@@ -57,6 +58,32 @@ class PlaneSweepSettings : public DensifierSettings
       add("plane_gen_mode", Parameter_t<int>{0, ""});
       add("match_cost", Parameter_t<int>{0, ""});
       add("subpx_interp_mode", Parameter_t<int>{0, ""});
+      add("depth_range_quantile", Parameter_t<double>{0.0, "Quantile of the sparse scene depths below and above which planes are not swept, e.g. 0.02. Set 0.0 to sweep from minimum to maximum depth"});
+      add("depth_range_margin", Parameter_t<double>{0.1, "Relative margin added to both ends of the depth range from quantiles"});
+      add("nrof_planes_min", Parameter_t<int>{0, "Minimum number of planes, if the number is reduced proportional to the narrowed depth range. Set 0 to always sweep nrof_planes"});
+      add("coarse_scale", Parameter_t<double>{0.0, "Scale of a coarse pass over the full depth range relative to 'scale', e.g. 0.25. The full resolution pass then only sweeps the depth band found. Set 0.0 to disable"});
+      add("coarse_nrof_planes", Parameter_t<int>{0, "Number of planes of the coarse pass. Set 0 to use the number of the full range"});
+      add("refine_depth_quantile", Parameter_t<double>{0.02, "Quantile of the coarse depths below and above which the full resolution pass does not sweep"});
+      add("refine_depth_margin", Parameter_t<double>{0.05, "Relative margin added to both ends of the depth band of the coarse pass"});
+      add("devices", Parameter_t<std::string>{"", "Comma separated ids of the GPUs to sweep on, e.g. \"0,1\". Keyframes are distributed round-robin with one plane sweep per device. Leave empty to use the current device only"});
+    }
+};
+
+class SemiGlobalMatchingSettings : public DensifierSettings
+{
+  public:
+    SemiGlobalMatchingSettings()
+    {
+      add("nrof_disparities", Parameter_t<int>{128, "Maximum number of disparities to search, rounded up to a multiple of 16"});
+      add("block_size", Parameter_t<int>{5, "Size of the matched blocks in [px], must be odd"});
+      add("p1", Parameter_t<int>{0, "Penalty for disparity changes of one between neighbours. Set 0 for 8*block_size^2"});
+      add("p2", Parameter_t<int>{0, "Penalty for disparity changes larger than one between neighbours. Set 0 for 32*block_size^2"});
+      add("uniqueness_ratio", Parameter_t<int>{10, "Margin in [%] by which the best cost must win over the second best"});
+      add("speckle_window_size", Parameter_t<int>{100, "Maximum size of disparity speckles to be removed. Set 0 to disable"});
+      add("speckle_range", Parameter_t<int>{2, "Maximum disparity variation within a connected component"});
+      add("disp12_max_diff", Parameter_t<int>{1, "Maximum difference in [px] of the left-right disparity check. Set -1 to disable"});
+      add("mode", Parameter_t<int>{2, "0 - SGBM 5 directions, 1 - Full 8 directions, 2 - SGBM 3-way parallel, 3 - HH4"});
+      add("depth_range_margin", Parameter_t<double>{0.1, "Relative margin added to both ends of the sparse scene depth to limit the disparity range"});
     }
 };
 
@@ -6,6 +6,8 @@
 #include <fstream>
 #include <iostream>
 #include <cstdint>
+#include <map>
+#include <mutex>
 
 #include <opencv2/highgui.hpp>
 #include <eigen3/Eigen/Eigen>
@@ -35,8 +37,16 @@ class PlaneSweep : public DensifierIF
         bool enable_out_best_cost;
         bool enable_out_cost_vol;
         bool enable_out_uniq_ratio;
+        bool use_streaming_costs;
         int nrof_planes;
+        int nrof_planes_min;
+        double depth_range_quantile;
+        double depth_range_margin;
         double scale;
+        double coarse_scale;
+        int coarse_nrof_planes;
+        double refine_depth_quantile;
+        double refine_depth_margin;
         cv::Size match_window_size;
         PSL::PlaneSweepOcclusionMode occlusion_mode;
         PSL::PlaneSweepPlaneGenerationMode plane_gen_mode;
@@ -55,7 +65,8 @@ class PlaneSweep : public DensifierIF
     /*!
      * @brief Essential function for densification of input frame vector based on the plane sweep library. For reference
      *        idx the dense depth map will be calculated and returned as CV_32F opencv matrix. Depth values are not
-     *        encoded, but directly written into the pixel positions.
+     *        encoded, but directly written into the pixel positions. Consecutive calls usually share all but one
+     *        frame, so images are only uploaded once while they are part of the input and released afterwards.
      * @param frames Vector of frames to be densified. Must have at least two frames.
      * @param ref_idx Idx of reference frame inside the "@param frames vector".
      * @return Densified depth map of the observed scene for reference frame frames[ref_idx]
@@ -79,6 +90,16 @@ class PlaneSweep : public DensifierIF
      */
     void printSettingsToLog() override;
 
+    /*!
+     * @brief Changes the quality of the plane sweep at runtime. Supported are "nrof_planes" and "scale", the scale the
+     * images are downscaled by on upload. Changing the scale releases all images from the device, so they are uploaded
+     * again with the next densification.
+     * @param name Name of the parameter
+     * @param val Value of the parameter
+     * @return True if the parameter is supported and was changed
+     */
+    bool changeParam(const std::string &name, const std::string &val) override;
+
   private:
 
     //! Number of frames for SFM
@@ -90,6 +111,78 @@ class PlaneSweep : public DensifierIF
     //! Struct of the plane sweep settings
     Settings m_settings;
 
+    //! Guards the changes requested by changeParam, the settings themselves are only accessed by densify()
+    std::mutex m_mutex_changes;
+
+    //! Number of planes requested by changeParam, 0 if unchanged
+    int m_nrof_planes_requested;
+
+    //! Scale requested by changeParam, 0.0 if unchanged
+    double m_scale_requested;
+
+    /*!
+     * @brief Image uploaded to the device together with the pose it was uploaded with
+     */
+    struct UploadedImage
+    {
+      int id_psl;
+      cv::Mat T_w2c;
+    };
+
+    //! Plane sweep handle, which is kept alive between calls so images stay on the device while in the sliding window
+    PSL::CudaPlaneSweep m_cps;
+
+    //! Images currently on the device, identified by the id of their frame
+    std::map<uint32_t, UploadedImage> m_images_uploaded;
+
+    //! Plane sweep handle of the coarse pass, images are downscaled by PSL on upload
+    PSL::CudaPlaneSweep m_cps_coarse;
+
+    //! Images currently on the device for the coarse pass
+    std::map<uint32_t, UploadedImage> m_images_uploaded_coarse;
+
+    /*!
+     * @brief Sets all settings independent of the input frames for a plane sweep handle
+     * @param cps Plane sweep handle to be configured
+     * @param scale Scale applied by PSL to the images on upload
+     */
+    void configureHandle(PSL::CudaPlaneSweep &cps, double scale);
+
+    /*!
+     * @brief Applies the changes requested by changeParam to the settings and the plane sweep handles
+     */
+    void applyRequestedChanges();
+
+    /*!
+     * @brief Sweeps the reference frame of a window within a depth range. Images that left the window are released
+     * from the handle, new ones are uploaded.
+     * @param cps Plane sweep handle
+     * @param images_uploaded Images currently uploaded to the handle
+     * @param frames Window of frames to be densified
+     * @param ref_idx Idx of reference frame inside the window
+     * @param min_depth Nearest depth to sweep
+     * @param max_depth Farthest depth to sweep
+     * @param nrof_planes Number of planes to sweep
+     * @return Depth map in the scale of the handle, empty if the sweep failed
+     */
+    cv::Mat sweep(PSL::CudaPlaneSweep &cps,
+                  std::map<uint32_t, UploadedImage> &images_uploaded,
+                  const std::deque<Frame::Ptr> &frames,
+                  uint8_t ref_idx,
+                  float min_depth,
+                  float max_depth,
+                  int nrof_planes);
+
+    /*!
+     * @brief Uploads the image of a frame to the device, if it is not already uploaded with the same pose. Images of
+     * frames are re-uploaded once their pose changes, e.g. after an update of the georeference.
+     * @param cps Plane sweep handle to upload to
+     * @param images_uploaded Images currently uploaded to the handle
+     * @param frame Frame to be densified
+     * @return Id of the image inside the plane sweep handle
+     */
+    int uploadImage(PSL::CudaPlaneSweep &cps, std::map<uint32_t, UploadedImage> &images_uploaded, const Frame::Ptr &frame);
+
     /*!
      * @brief Function to fix the input image type to a PSL conform type. Depends on the arguments se (use rgb or not)
      * @param img Input image to be converted
@@ -97,6 +190,28 @@ class PlaneSweep : public DensifierIF
      */
     cv::Mat fixImageType(const cv::Mat &img);
 
+    /*!
+     * @brief Computes the depth range and number of planes to sweep for a reference frame. By default it is the full
+     * range of the sparse cloud. If a quantile is set, outliers of the sparse cloud are cut off and the range is
+     * concentrated on the bulk of the scene. The number of planes is then reduced in proportion to the inverse depth
+     * range, so the spacing between the planes stays the same as for the full range.
+     * @param frame Reference frame with computed scene depth
+     * @param min_depth Output; Nearest depth to sweep
+     * @param max_depth Output; Farthest depth to sweep
+     * @param nrof_planes Output; Number of planes to sweep
+     */
+    void computeDepthRange(const Frame::Ptr &frame, float &min_depth, float &max_depth, int &nrof_planes) const;
+
+    /*!
+     * @brief Narrows the depth range to the band, in which the coarse pass reconstructed the scene. The number of
+     * planes is reduced in proportion to the inverse depth range, so the spacing between the planes is kept.
+     * @param depthmap_coarse Depth map of the coarse pass
+     * @param min_depth Input and output; Nearest depth to sweep
+     * @param max_depth Input and output; Farthest depth to sweep
+     * @param nrof_planes Input and output; Number of planes to sweep
+     */
+    void refineDepthRange(const Depthmap &depthmap_coarse, float &min_depth, float &max_depth, int &nrof_planes) const;
+
     /*!
      * @brief Converter for PSL library depth map to OpenCV matrix type
      * @param depthmap PSL depth map type
@@ -0,0 +1,132 @@
+
+
+#ifndef PROJECT_PLANE_SWEEP_MULTI_DEVICE_H
+#define PROJECT_PLANE_SWEEP_MULTI_DEVICE_H
+
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <realm_core/thread_pool.h>
+#include <realm_densifier_base/densifier_IF.h>
+#include <realm_densifier_base/densifier_settings.h>
+#include <realm_densifier_base/plane_sweep.h>
+
+namespace realm
+{
+namespace densifier
+{
+
+/*!
+ * @brief Plane sweep on several GPUs. Every device has its own plane sweep with its own handles and uploaded images,
+ * which is created and used exclusively by one worker thread bound to the device. Keyframes are dispatched round-robin
+ * over the devices, so consecutive sweeps run concurrently. Images shared between consecutive windows are therefore
+ * only reused on a device, if the window is wider than the number of devices.
+ */
+class MultiDevicePlaneSweep : public DensifierIF
+{
+  public:
+
+    /*!
+     * @brief Constructor creating one plane sweep for every device listed in the settings parameter "devices"
+     * @param settings Plane sweep settings, see "densifier_settings.h"
+     */
+    explicit MultiDevicePlaneSweep(const DensifierSettings::Ptr &settings);
+
+    /*!
+     * @brief Destructor waits for all pending sweeps and releases the plane sweeps on their devices
+     */
+    ~MultiDevicePlaneSweep();
+
+    MultiDevicePlaneSweep(const MultiDevicePlaneSweep &) = delete;
+    MultiDevicePlaneSweep& operator=(const MultiDevicePlaneSweep &) = delete;
+
+    /*!
+     * @brief Densifies the frames on the next device and waits for the result
+     * @param frames Vector of frames to be densified, see PlaneSweep::densify()
+     * @param ref_idx Idx of reference frame inside the "@param frames vector"
+     * @return Densified depth map of the observed scene for reference frame frames[ref_idx]
+     */
+    Depthmap::Ptr densify(const std::deque<Frame::Ptr> &frames, uint8_t ref_idx) override;
+
+    /*!
+     * @brief Queues the densification of the frames on the next device in round-robin order. Sweeps on different
+     * devices run concurrently, sweeps on the same device in the order they were queued.
+     * @param frames Vector of frames to be densified, see PlaneSweep::densify()
+     * @param ref_idx Idx of reference frame inside the "@param frames vector"
+     * @return Future of the depth map
+     */
+    std::future<Depthmap::Ptr> densifyAsync(const std::deque<Frame::Ptr> &frames, uint8_t ref_idx) override;
+
+    /*!
+     * @brief Getter for the number of sweeps processed concurrently
+     * @return Number of devices
+     */
+    int getNrofConcurrentJobs() override;
+
+    /*!
+     * @brief Getter for number of input frames for densification
+     * @return Number of frames that "densify" needs inside the frame vector
+     */
+    uint8_t getNrofInputFrames() override;
+
+    /*!
+     * @brief Getter for the resize factor of the densified images
+     * @return Resize factor
+     */
+    double getResizeFactor() override;
+
+    /*!
+     * @brief Prints the devices and the plane sweep settings to the log file for documentation.
+     */
+    void printSettingsToLog() override;
+
+    /*!
+     * @brief Changes a parameter of the plane sweeps on all devices, see PlaneSweep::changeParam()
+     * @param name Name of the parameter
+     * @param val Value of the parameter
+     * @return True if the parameter is supported and was changed
+     */
+    bool changeParam(const std::string &name, const std::string &val) override;
+
+  private:
+
+    /*!
+     * @brief Plane sweep on one device together with the worker thread bound to it
+     */
+    struct Device
+    {
+      int id;
+      ThreadPool::Ptr worker;
+      std::unique_ptr<PlaneSweep> plane_sweep;
+    };
+
+    //! Number of frames for SFM
+    uint8_t m_nrof_frames;
+
+    //! Resize factor for input images
+    double m_resizing;
+
+    //! Devices in the order sweeps are dispatched to
+    std::vector<Device> m_devices;
+
+    //! Guards the device the next sweep is dispatched to
+    std::mutex m_mutex_dispatch;
+
+    //! Index of the device the next sweep is dispatched to
+    size_t m_next_device;
+
+    /*!
+     * @brief Parses a comma separated list of device ids, e.g. "0,1"
+     * @param devices List of device ids
+     * @return Device ids, empty if the list is empty
+     */
+    static std::vector<int> parseDeviceIds(const std::string &devices);
+};
+
+} // namespace densifier
+} // namespace realm
+
+#endif //PROJECT_PLANE_SWEEP_MULTI_DEVICE_H
@@ -0,0 +1,97 @@
+
+
+#ifndef PROJECT_SEMI_GLOBAL_MATCHING_H
+#define PROJECT_SEMI_GLOBAL_MATCHING_H
+
+#include <opencv2/calib3d.hpp>
+
+#include <realm_core/frame.h>
+#include <realm_core/stereo.h>
+#include <realm_densifier_base/densifier_IF.h>
+#include <realm_densifier_base/densifier_settings.h>
+
+namespace realm
+{
+namespace densifier
+{
+
+/*!
+ * @brief CPU densifier for platforms without CUDA. The reference frame and its neighbour are rectified to a stereo
+ *        pair and matched with OpenCV's semi-global block matching, which aggregates the costs multi-threaded and with
+ *        SIMD instructions. The disparities are triangulated and projected back into the unrectified reference camera.
+ */
+class SemiGlobalMatching : public DensifierIF
+{
+  public:
+    struct Settings
+    {
+      int nrof_disparities;
+      int block_size;
+      int p1;
+      int p2;
+      int uniqueness_ratio;
+      int speckle_window_size;
+      int speckle_range;
+      int disp12_max_diff;
+      int mode;
+      double depth_range_margin;
+    };
+
+  public:
+    /*!
+     * @brief Explicit one argument constructor for densifier factory
+     * @param settings Settings file with type: SGM and parameters as defined in "densifier_settings.h"
+     */
+    explicit SemiGlobalMatching(const DensifierSettings::Ptr &settings);
+
+    /*!
+     * @brief Densification of the reference frame with the other frame of the input as stereo partner. The range of
+     *        disparities is limited to the one of the sparse scene depth, if available.
+     * @param frames Deque of exactly two frames to be densified
+     * @param ref_idx Index of the reference frame inside param frames
+     * @return Depth map for reference frames[ref_idx], nullptr if the pair could not be matched
+     */
+    Depthmap::Ptr densify(const std::deque<Frame::Ptr> &frames, uint8_t ref_idx) override;
+
+    /*!
+     * @brief Overriden getter for number of input frames. SGM is a two view method
+     * @return Size of frame input vector
+     */
+    uint8_t getNrofInputFrames() override;
+
+    /*!
+     * @brief Overriden getter for resize factor of the framework. Will typically be set in the settings file.
+     * @return Resize factor for input images
+     */
+    double getResizeFactor() override;
+
+    /*!
+     * @brief Overriden base function to print settings to log.
+     */
+    void printSettingsToLog() override;
+
+  private:
+
+    //! Resize factor for input images
+    double m_resizing;
+
+    //! Struct of the matching settings
+    Settings m_settings;
+
+    //! Matcher, is reused between calls with updated disparity range
+    cv::Ptr<cv::StereoSGBM> m_matcher;
+
+    /*!
+     * @brief Computes the range of disparities to search from the sparse scene depth of the reference frame
+     * @param frame Reference frame with computed scene depth
+     * @param fb Product of rectified focal length and baseline
+     * @param min_disparity Output; Minimum disparity to search
+     * @param nrof_disparities Output; Number of disparities to search, multiple of 16
+     */
+    void computeDisparityRange(const Frame::Ptr &frame, double fb, int &min_disparity, int &nrof_disparities) const;
+};
+
+} // namespace densifier
+} // namespace realm
+
+#endif //PROJECT_SEMI_GLOBAL_MATCHING_H
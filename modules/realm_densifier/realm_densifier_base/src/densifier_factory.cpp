@@ -8,9 +8,15 @@ DensifierIF::Ptr densifier::DensifierFactory::create(const DensifierSettings::Pt
 {
   if ((*settings)["type"].toString() == "DUMMY")
     return std::make_shared<densifier::Dummy>(settings);
+  if ((*settings)["type"].toString() == "SGM")
+    return std::make_shared<densifier::SemiGlobalMatching>(settings);
 #ifdef USE_CUDA
   if ((*settings)["type"].toString() == "PSL")
+  {
+    if (!(*settings)["devices"].toString().empty())
+      return std::make_shared<densifier::MultiDevicePlaneSweep>(settings);
     return std::make_shared<densifier::PlaneSweep>(settings);
+  }
 #endif
   throw std::invalid_argument("Error: Densifier framework '" + (*settings)["type"].toString() + "' not found");
 }
\ No newline at end of file
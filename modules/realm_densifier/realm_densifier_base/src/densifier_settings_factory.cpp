@@ -11,6 +11,8 @@ DensifierSettings::Ptr DensifierSettingsFactory::load(const std::string &filepat
     return loadDefault<DensifierDummySettings>(filepath, directory);
   if (method == "PSL")
     return loadDefault<PlaneSweepSettings>(filepath, directory);
+  if (method == "SGM")
+    return loadDefault<SemiGlobalMatchingSettings>(filepath, directory);
 //if (method == "YOUR_IMPLEMENTATION")
 //  return loadDefault<YOUR_IMPLEMENTATION_SETTINGS>(settings, directory, filename);
   throw (std::invalid_argument("Error: Loading densifier settings failed. Method '" + method + "' not recognized"));
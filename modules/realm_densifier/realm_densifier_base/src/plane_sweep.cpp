@@ -1,5 +1,8 @@
 
 
+#include <algorithm>
+#include <cmath>
+
 #include <realm_densifier_base/plane_sweep.h>
 
 #include <psl/exception.h>
@@ -8,7 +11,10 @@ using namespace realm;
 using namespace densifier;
 
 PlaneSweep::PlaneSweep(const DensifierSettings::Ptr &settings)
-: m_nrof_frames((uint8_t)(*settings)["n_cams"].toInt()), m_resizing((*settings)["resizing"].toDouble())
+: m_nrof_frames((uint8_t)(*settings)["n_cams"].toInt()),
+  m_resizing((*settings)["resizing"].toDouble()),
+  m_nrof_planes_requested(0),
+  m_scale_requested(0.0)
 {
   assert(m_nrof_frames > 1);
   settings->print();
@@ -18,7 +24,11 @@ PlaneSweep::PlaneSweep(const DensifierSettings::Ptr &settings)
   m_settings.enable_out_best_cost     = (*settings)["enable_out_best_cost"].toInt() > 0;
   m_settings.enable_out_cost_vol      = (*settings)["enable_out_cost_vol"].toInt() > 0;
   m_settings.enable_out_uniq_ratio    = (*settings)["enable_out_uniq_ratio"].toInt() > 0;
+  m_settings.use_streaming_costs      = (*settings)["use_streaming_costs"].toInt() > 0;
   m_settings.nrof_planes              =  (*settings)["nrof_planes"].toInt();
+  m_settings.nrof_planes_min          =  (*settings)["nrof_planes_min"].toInt();
+  m_settings.depth_range_quantile     =  (*settings)["depth_range_quantile"].toDouble();
+  m_settings.depth_range_margin       =  (*settings)["depth_range_margin"].toDouble();
   m_settings.scale                    =  (*settings)["scale"].toDouble();
   m_settings.match_window_size.width  =  (*settings)["match_window_size_x"].toInt();
   m_settings.match_window_size.height =  (*settings)["match_window_size_y"].toInt();
@@ -26,55 +36,112 @@ PlaneSweep::PlaneSweep(const DensifierSettings::Ptr &settings)
   m_settings.plane_gen_mode           = (PSL::PlaneSweepPlaneGenerationMode) (*settings)["plane_gen_mode"].toInt();
   m_settings.match_cost               = (PSL::PlaneSweepMatchingCosts)       (*settings)["match_cost"].toInt();
   m_settings.subpx_interp_mode        = (PSL::PlaneSweepSubPixelInterpMode)  (*settings)["subpx_interp_mode"].toInt();
-}
 
-Depthmap::Ptr PlaneSweep::densify(const std::deque<Frame::Ptr> &frames, uint8_t ref_idx)
-{
-  assert(frames.size() == m_nrof_frames);
+  m_settings.coarse_scale             =  (*settings)["coarse_scale"].toDouble();
+  m_settings.coarse_nrof_planes       =  (*settings)["coarse_nrof_planes"].toInt();
+  m_settings.refine_depth_quantile    =  (*settings)["refine_depth_quantile"].toDouble();
+  m_settings.refine_depth_margin      =  (*settings)["refine_depth_margin"].toDouble();
 
-  // Get min and max scene depth for reference frame (middle frame)
-  Frame::Ptr frame_ref = frames[ref_idx];
-  auto min_depth = (float) frame_ref->getMinSceneDepth();
-  auto max_depth = (float) frame_ref->getMaxSceneDepth();
+  if (m_settings.coarse_scale < 0.0 || m_settings.coarse_scale >= 1.0)
+    throw(std::invalid_argument("Error: Coarse scale of plane sweep must be in [0.0, 1.0)."));
+
+  if (m_settings.use_streaming_costs && m_settings.enable_out_cost_vol)
+    LOG_F(WARNING, "Streaming costs are enabled, cost volume output is ignored.");
 
-  PSL::CudaPlaneSweep cps;
-  cps.setScale(m_settings.scale);
+  // Settings independent of the input frames are only set once for the persistent handles
+  configureHandle(m_cps, m_settings.scale);
+  if (m_settings.coarse_scale > 0.0)
+    configureHandle(m_cps_coarse, m_settings.scale * m_settings.coarse_scale);
+}
+
+void PlaneSweep::configureHandle(PSL::CudaPlaneSweep &cps, double scale)
+{
+  cps.setScale(scale);
   cps.setMatchWindowSize(m_settings.match_window_size.width, m_settings.match_window_size.height);
-  cps.setNumPlanes(m_settings.nrof_planes);
   cps.setOcclusionMode(m_settings.occlusion_mode);
   cps.setPlaneGenerationMode(m_settings.plane_gen_mode);
   cps.setMatchingCosts(m_settings.match_cost);
   cps.setSubPixelInterpolationMode(m_settings.subpx_interp_mode);
   cps.enableOutputBestCosts(m_settings.enable_out_best_cost);
   cps.enableOuputUniquenessRatio(m_settings.enable_out_uniq_ratio);
-  cps.enableOutputCostVolume(m_settings.enable_out_cost_vol);
-  cps.setZRange(min_depth, max_depth);
 
-  if (m_settings.enable_out_best_cost)
-    cps.enableOutputBestDepth();
+  // Without the cost volume only the running best and second best cost and depth are kept per pixel while sweeping,
+  // so device memory does not grow with the number of planes
+  cps.enableOutputCostVolume(m_settings.enable_out_cost_vol && !m_settings.use_streaming_costs);
+
+  // Best depth is always read back as result
+  cps.enableOutputBestDepth();
+
   if (m_settings.enable_color_match)
     cps.enableColorMatching();
   if (m_settings.enable_color_match)
     cps.enableSubPixel();
+}
 
-  // Create psl cameras for densification and feed to plane sweep handle
-  int ref_id_psl = 0;
-  for (uint32_t i = 0; i < frames.size(); ++i)
+Depthmap::Ptr PlaneSweep::densify(const std::deque<Frame::Ptr> &frames, uint8_t ref_idx)
+{
+  assert(frames.size() == m_nrof_frames);
+  applyRequestedChanges();
+
+  // Get min and max scene depth for reference frame (middle frame)
+  Frame::Ptr frame_ref = frames[ref_idx];
+  float min_depth, max_depth;
+  int nrof_planes;
+  computeDepthRange(frame_ref, min_depth, max_depth, nrof_planes);
+
+  // The coarse pass sweeps the full depth range at low resolution. The full resolution pass is then restricted to the
+  // depth band, in which the coarse reconstruction found the scene.
+  if (m_settings.coarse_scale > 0.0)
   {
-    // Get frame from container and prepare
-    Frame::Ptr frame = frames[i];
-    frame->setImageResizeFactor(m_resizing);
+    int nrof_planes_coarse = (m_settings.coarse_nrof_planes > 0 ? m_settings.coarse_nrof_planes : nrof_planes);
+    cv::Mat depth_coarse = sweep(m_cps_coarse, m_images_uploaded_coarse, frames, ref_idx, min_depth, max_depth, nrof_planes_coarse);
+    if (!depth_coarse.empty() && cv::countNonZero(depth_coarse > 0) > 0)
+    {
+      camera::Pinhole::Ptr cam_resized = frame_ref->getResizedCamera();
+      Depthmap depthmap_coarse(depth_coarse, cam_resized->resize((uint32_t)depth_coarse.cols, (uint32_t)depth_coarse.rows));
+      refineDepthRange(depthmap_coarse, min_depth, max_depth, nrof_planes);
+    }
+  }
 
-    // Use resized image grayscale
-    cv::Mat img = frame->getResizedImageUndistorted();
-    cv::Mat img_valid = fixImageType(img);
-    //cv::cvtColor(img, img, CV_BGR2GRAY);
+  cv::Mat depth = sweep(m_cps, m_images_uploaded, frames, ref_idx, min_depth, max_depth, nrof_planes);
+  if (depth.empty())
+    return nullptr;
 
-    // Convert to PSL style camera
-    PSL::CameraMatrix<double> cam = convertToPslCamera(frames[i]->getResizedCamera());
+  return std::make_shared<Depthmap>(depth, *frame_ref->getResizedCamera());
+}
 
-    // Feed image to plane sweep handle and safe id
-    int id = cps.addImage(img_valid, cam);
+cv::Mat PlaneSweep::sweep(PSL::CudaPlaneSweep &cps,
+                          std::map<uint32_t, UploadedImage> &images_uploaded,
+                          const std::deque<Frame::Ptr> &frames,
+                          uint8_t ref_idx,
+                          float min_depth,
+                          float max_depth,
+                          int nrof_planes)
+{
+  cps.setNumPlanes(nrof_planes);
+  cps.setZRange(min_depth, max_depth);
+
+  // Images of frames that left the sliding window are released from the device
+  for (auto it = images_uploaded.begin(); it != images_uploaded.end();)
+  {
+    bool is_in_window = std::any_of(frames.begin(), frames.end(),
+        [&](const Frame::Ptr &frame){ return frame->getFrameId() == it->first; });
+    if (is_in_window)
+    {
+      ++it;
+    }
+    else
+    {
+      cps.deleteImage(it->second.id_psl);
+      it = images_uploaded.erase(it);
+    }
+  }
+
+  // Feed all images of the window to the plane sweep handle, only new ones are uploaded
+  int ref_id_psl = 0;
+  for (uint32_t i = 0; i < frames.size(); ++i)
+  {
+    int id = uploadImage(cps, images_uploaded, frames[i]);
 
     // Reference idx will be used to identify reference frame
     if (i == ref_idx)
@@ -89,13 +156,96 @@ Depthmap::Ptr PlaneSweep::densify(const std::deque<Frame::Ptr> &frames, uint8_t
   catch (const PSL::Exception &e)
   {
     LOG_F(WARNING, "Densification failed due to exception: %s", e.what());
-    return nullptr;
+    return cv::Mat();
   }
 
   // Get depthmap
   PSL::DepthMap<float, double> depth_map_psl = cps.getBestDepth();
+  return convertToCvMat(depth_map_psl);
+}
 
-  return std::make_shared<Depthmap>(convertToCvMat(depth_map_psl), *frame_ref->getResizedCamera());
+int PlaneSweep::uploadImage(PSL::CudaPlaneSweep &cps, std::map<uint32_t, UploadedImage> &images_uploaded, const Frame::Ptr &frame)
+{
+  frame->setImageResizeFactor(m_resizing);
+  camera::Pinhole::Ptr cam_resized = frame->getResizedCamera();
+  cv::Mat T_w2c = cam_resized->Tw2c();
+
+  auto it_uploaded = images_uploaded.find(frame->getFrameId());
+  if (it_uploaded != images_uploaded.end())
+  {
+    if (cv::norm(it_uploaded->second.T_w2c, T_w2c, cv::NORM_INF) == 0.0)
+      return it_uploaded->second.id_psl;
+
+    // Pose has changed since the upload, the image is uploaded again with the current camera
+    cps.deleteImage(it_uploaded->second.id_psl);
+    images_uploaded.erase(it_uploaded);
+  }
+
+  // Use resized image grayscale
+  cv::Mat img = frame->getResizedImageUndistorted();
+  cv::Mat img_valid = fixImageType(img);
+
+  // Convert to PSL style camera
+  PSL::CameraMatrix<double> cam = convertToPslCamera(cam_resized);
+
+  int id = cps.addImage(img_valid, cam);
+  images_uploaded[frame->getFrameId()] = UploadedImage{id, T_w2c.clone()};
+  return id;
+}
+
+bool PlaneSweep::changeParam(const std::string &name, const std::string &val)
+{
+  std::lock_guard<std::mutex> lock(m_mutex_changes);
+  try
+  {
+    if (name == "nrof_planes")
+      m_nrof_planes_requested = std::max(std::stoi(val), 1);
+    else if (name == "scale")
+      m_scale_requested = std::min(std::max(std::stod(val), 0.01), 1.0);
+    else
+      return false;
+  }
+  catch (const std::logic_error &)
+  {
+    return false;
+  }
+  return true;
+}
+
+void PlaneSweep::applyRequestedChanges()
+{
+  std::lock_guard<std::mutex> lock(m_mutex_changes);
+  if (m_nrof_planes_requested > 0)
+  {
+    m_settings.nrof_planes = m_nrof_planes_requested;
+    m_settings.nrof_planes_min = std::min(m_settings.nrof_planes_min, m_settings.nrof_planes);
+    m_nrof_planes_requested = 0;
+    LOG_F(INFO, "Number of planes changed to %i", m_settings.nrof_planes);
+  }
+
+  if (m_scale_requested > 0.0)
+  {
+    if (std::fabs(m_scale_requested - m_settings.scale) > 1e-6)
+    {
+      m_settings.scale = m_scale_requested;
+
+      // Images on the device were downscaled with the previous scale
+      for (const auto &image : m_images_uploaded)
+        m_cps.deleteImage(image.second.id_psl);
+      m_images_uploaded.clear();
+      m_cps.setScale(m_settings.scale);
+
+      if (m_settings.coarse_scale > 0.0)
+      {
+        for (const auto &image : m_images_uploaded_coarse)
+          m_cps_coarse.deleteImage(image.second.id_psl);
+        m_images_uploaded_coarse.clear();
+        m_cps_coarse.setScale(m_settings.scale * m_settings.coarse_scale);
+      }
+      LOG_F(INFO, "Scale changed to %2.2f", m_settings.scale);
+    }
+    m_scale_requested = 0.0;
+  }
 }
 
 uint8_t PlaneSweep::getNrofInputFrames()
@@ -117,6 +267,60 @@ cv::Mat PlaneSweep::convertToCvMat(PSL::DepthMap<float, double> &depth_map_psl)
   return depths_mat.clone();
 }
 
+void PlaneSweep::computeDepthRange(const Frame::Ptr &frame, float &min_depth, float &max_depth, int &nrof_planes) const
+{
+  double depth_min = frame->getMinSceneDepth();
+  double depth_max = frame->getMaxSceneDepth();
+
+  min_depth = (float) depth_min;
+  max_depth = (float) depth_max;
+  nrof_planes = m_settings.nrof_planes;
+
+  if (m_settings.depth_range_quantile <= 0.0 || depth_min <= 0.0 || depth_max <= depth_min)
+    return;
+
+  double q = std::min(m_settings.depth_range_quantile, 0.5);
+  double depth_near = std::max(frame->getSceneDepthQuantile(q) * (1.0 - m_settings.depth_range_margin), depth_min);
+  double depth_far = std::min(frame->getSceneDepthQuantile(1.0 - q) * (1.0 + m_settings.depth_range_margin), depth_max);
+  if (depth_far <= depth_near)
+    return;
+
+  min_depth = (float) depth_near;
+  max_depth = (float) depth_far;
+
+  // Planes are spread in inverse depth (disparity), so the ratio of the inverse ranges keeps their spacing
+  if (m_settings.nrof_planes_min > 0)
+  {
+    double ratio = (1.0 / depth_near - 1.0 / depth_far) / (1.0 / depth_min - 1.0 / depth_max);
+    nrof_planes = static_cast<int>(std::ceil(ratio * m_settings.nrof_planes));
+    nrof_planes = std::max(std::min(nrof_planes, m_settings.nrof_planes), m_settings.nrof_planes_min);
+  }
+
+  LOG_F(INFO, "Sweeping %i planes in depth range [%4.2f, %4.2f] of scene depth [%4.2f, %4.2f]",
+        nrof_planes, depth_near, depth_far, depth_min, depth_max);
+}
+
+void PlaneSweep::refineDepthRange(const Depthmap &depthmap_coarse, float &min_depth, float &max_depth, int &nrof_planes) const
+{
+  double q = std::min(m_settings.refine_depth_quantile, 0.5);
+  double depth_near = std::max(depthmap_coarse.getDepthQuantile(q) * (1.0 - m_settings.refine_depth_margin), (double) min_depth);
+  double depth_far = std::min(depthmap_coarse.getDepthQuantile(1.0 - q) * (1.0 + m_settings.refine_depth_margin), (double) max_depth);
+  if (depth_far <= depth_near)
+    return;
+
+  // Same spacing of the planes in inverse depth as for the coarse range
+  double ratio = (1.0 / depth_near - 1.0 / depth_far) / (1.0 / min_depth - 1.0 / max_depth);
+  int nrof_planes_refined = static_cast<int>(std::ceil(ratio * nrof_planes));
+  nrof_planes_refined = std::max(std::min(nrof_planes_refined, nrof_planes), std::max(m_settings.nrof_planes_min, 2));
+
+  LOG_F(INFO, "Refining with %i planes in depth range [%4.2f, %4.2f] of coarse range [%4.2f, %4.2f]",
+        nrof_planes_refined, depth_near, depth_far, min_depth, max_depth);
+
+  min_depth = (float) depth_near;
+  max_depth = (float) depth_far;
+  nrof_planes = nrof_planes_refined;
+}
+
 cv::Mat PlaneSweep::fixImageType(const cv::Mat &img)
 {
   cv::Mat img_fixed;
@@ -175,8 +379,16 @@ void PlaneSweep::printSettingsToLog()
   LOG_F(INFO, "- enable_out_best_cost: %i", m_settings.enable_out_best_cost);
   LOG_F(INFO, "- enable_out_cost_vol: %i", m_settings.enable_out_cost_vol);
   LOG_F(INFO, "- enable_out_uniq_ratio: %i", m_settings.enable_out_uniq_ratio);
+  LOG_F(INFO, "- use_streaming_costs: %i", m_settings.use_streaming_costs);
   LOG_F(INFO, "- nrof_planes: %i", m_settings.nrof_planes);
+  LOG_F(INFO, "- nrof_planes_min: %i", m_settings.nrof_planes_min);
+  LOG_F(INFO, "- depth_range_quantile: %2.3f", m_settings.depth_range_quantile);
+  LOG_F(INFO, "- depth_range_margin: %2.2f", m_settings.depth_range_margin);
   LOG_F(INFO, "- scale: %2.2f", m_settings.scale);
+  LOG_F(INFO, "- coarse_scale: %2.2f", m_settings.coarse_scale);
+  LOG_F(INFO, "- coarse_nrof_planes: %i", m_settings.coarse_nrof_planes);
+  LOG_F(INFO, "- refine_depth_quantile: %2.3f", m_settings.refine_depth_quantile);
+  LOG_F(INFO, "- refine_depth_margin: %2.2f", m_settings.refine_depth_margin);
   LOG_F(INFO, "- match_window_size_width: %i", m_settings.match_window_size.width);
   LOG_F(INFO, "- match_window_size_height: %i", m_settings.match_window_size.height);
   LOG_F(INFO, "- occlusion_mode: %i", static_cast<int>(m_settings.occlusion_mode));
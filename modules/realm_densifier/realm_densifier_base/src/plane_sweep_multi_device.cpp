@@ -0,0 +1,146 @@
+
+
+#include <sstream>
+#include <stdexcept>
+
+#include <cuda_runtime.h>
+
+#include <realm_densifier_base/plane_sweep_multi_device.h>
+
+using namespace realm;
+using namespace densifier;
+
+namespace
+{
+
+// Device selection of the CUDA runtime is per host thread, so it is set by the worker of the device before any PSL call
+void bindToDevice(int device_id)
+{
+  cudaError_t error = cudaSetDevice(device_id);
+  if (error != cudaSuccess)
+    throw(std::runtime_error("Error: Selecting CUDA device " + std::to_string(device_id) + " failed: " + cudaGetErrorString(error)));
+}
+
+} // namespace
+
+MultiDevicePlaneSweep::MultiDevicePlaneSweep(const DensifierSettings::Ptr &settings)
+: m_nrof_frames((uint8_t)(*settings)["n_cams"].toInt()),
+  m_resizing((*settings)["resizing"].toDouble()),
+  m_next_device(0)
+{
+  std::vector<int> device_ids = parseDeviceIds((*settings)["devices"].toString());
+  if (device_ids.empty())
+    throw(std::invalid_argument("Error: No devices provided for multi device plane sweep."));
+
+  int nrof_devices_available = 0;
+  if (cudaGetDeviceCount(&nrof_devices_available) != cudaSuccess)
+    nrof_devices_available = 0;
+
+  m_devices.resize(device_ids.size());
+  for (size_t i = 0; i < device_ids.size(); ++i)
+  {
+    if (device_ids[i] < 0 || device_ids[i] >= nrof_devices_available)
+      throw(std::invalid_argument("Error: CUDA device " + std::to_string(device_ids[i]) + " for plane sweep not available."));
+
+    Device &device = m_devices[i];
+    device.id = device_ids[i];
+    device.worker = std::make_shared<ThreadPool>(1);
+
+    // The plane sweep allocates its handles on the device of the thread it is created in
+    device.worker->submit([&device, settings]{
+      bindToDevice(device.id);
+      device.plane_sweep.reset(new PlaneSweep(settings));
+    }).get();
+  }
+}
+
+MultiDevicePlaneSweep::~MultiDevicePlaneSweep()
+{
+  // Queued after all pending sweeps, so the handles are released once the device is idle
+  for (auto &device : m_devices)
+    device.worker->submit([&device]{ device.plane_sweep.reset(); }).wait();
+}
+
+Depthmap::Ptr MultiDevicePlaneSweep::densify(const std::deque<Frame::Ptr> &frames, uint8_t ref_idx)
+{
+  return densifyAsync(frames, ref_idx).get();
+}
+
+std::future<Depthmap::Ptr> MultiDevicePlaneSweep::densifyAsync(const std::deque<Frame::Ptr> &frames, uint8_t ref_idx)
+{
+  Device* device;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex_dispatch);
+    device = &m_devices[m_next_device];
+    m_next_device = (m_next_device + 1) % m_devices.size();
+  }
+
+  auto depthmap = std::make_shared<std::promise<Depthmap::Ptr>>();
+  PlaneSweep* plane_sweep = device->plane_sweep.get();
+  device->worker->submit([plane_sweep, frames, ref_idx, depthmap]{
+    try
+    {
+      depthmap->set_value(plane_sweep->densify(frames, ref_idx));
+    }
+    catch (...)
+    {
+      depthmap->set_exception(std::current_exception());
+    }
+  });
+  return depthmap->get_future();
+}
+
+int MultiDevicePlaneSweep::getNrofConcurrentJobs()
+{
+  return static_cast<int>(m_devices.size());
+}
+
+uint8_t MultiDevicePlaneSweep::getNrofInputFrames()
+{
+  return m_nrof_frames;
+}
+
+double MultiDevicePlaneSweep::getResizeFactor()
+{
+  return m_resizing;
+}
+
+bool MultiDevicePlaneSweep::changeParam(const std::string &name, const std::string &val)
+{
+  bool is_changed = true;
+  for (auto &device : m_devices)
+    is_changed = device.plane_sweep->changeParam(name, val) && is_changed;
+  return is_changed;
+}
+
+void MultiDevicePlaneSweep::printSettingsToLog()
+{
+  std::string devices;
+  for (const auto &device : m_devices)
+    devices += std::to_string(device.id) + " ";
+
+  LOG_F(INFO, "### MultiDevicePlaneSweep settings ###");
+  LOG_F(INFO, "- devices: %s", devices.c_str());
+  m_devices.front().plane_sweep->printSettingsToLog();
+}
+
+std::vector<int> MultiDevicePlaneSweep::parseDeviceIds(const std::string &devices)
+{
+  std::vector<int> device_ids;
+  std::stringstream stream(devices);
+  std::string token;
+  while (std::getline(stream, token, ','))
+  {
+    if (token.find_first_not_of(" \t") == std::string::npos)
+      continue;
+    try
+    {
+      device_ids.push_back(std::stoi(token));
+    }
+    catch (const std::logic_error &)
+    {
+      throw(std::invalid_argument("Error: Invalid CUDA device id '" + token + "' for plane sweep."));
+    }
+  }
+  return device_ids;
+}
@@ -0,0 +1,190 @@
+
+
+#include <algorithm>
+#include <cmath>
+
+#include <realm_densifier_base/semi_global_matching.h>
+
+using namespace realm;
+using namespace densifier;
+
+SemiGlobalMatching::SemiGlobalMatching(const DensifierSettings::Ptr &settings)
+: m_resizing((*settings)["resizing"].toDouble())
+{
+  m_settings.nrof_disparities    = (*settings)["nrof_disparities"].toInt();
+  m_settings.block_size          = (*settings)["block_size"].toInt();
+  m_settings.p1                  = (*settings)["p1"].toInt();
+  m_settings.p2                  = (*settings)["p2"].toInt();
+  m_settings.uniqueness_ratio    = (*settings)["uniqueness_ratio"].toInt();
+  m_settings.speckle_window_size = (*settings)["speckle_window_size"].toInt();
+  m_settings.speckle_range       = (*settings)["speckle_range"].toInt();
+  m_settings.disp12_max_diff     = (*settings)["disp12_max_diff"].toInt();
+  m_settings.mode                = (*settings)["mode"].toInt();
+  m_settings.depth_range_margin  = (*settings)["depth_range_margin"].toDouble();
+
+  if (m_settings.block_size < 1 || m_settings.block_size % 2 == 0)
+    throw(std::invalid_argument("Error: Block size of semi-global matching must be odd and positive."));
+
+  // The matcher only searches multiples of 16 disparities
+  m_settings.nrof_disparities = std::max(16, (m_settings.nrof_disparities + 15) / 16 * 16);
+
+  // Recommended smoothness penalties for grayscale images, if not set explicitly
+  int area = m_settings.block_size * m_settings.block_size;
+  if (m_settings.p1 <= 0)
+    m_settings.p1 = 8 * area;
+  if (m_settings.p2 <= 0)
+    m_settings.p2 = 32 * area;
+
+  m_matcher = cv::StereoSGBM::create(0, m_settings.nrof_disparities, m_settings.block_size,
+                                     m_settings.p1, m_settings.p2, m_settings.disp12_max_diff, 0,
+                                     m_settings.uniqueness_ratio, m_settings.speckle_window_size,
+                                     m_settings.speckle_range, m_settings.mode);
+}
+
+Depthmap::Ptr SemiGlobalMatching::densify(const std::deque<Frame::Ptr> &frames, uint8_t ref_idx)
+{
+  assert(frames.size() == 2);
+
+  Frame::Ptr frame_ref = frames[ref_idx];
+  Frame::Ptr frame_other = frames[ref_idx == 0 ? 1 : 0];
+  frame_ref->setImageResizeFactor(m_resizing);
+  frame_other->setImageResizeFactor(m_resizing);
+
+  cv::Mat R1, P1, R2, P2, Q;
+  stereo::computeRectification(frame_ref, frame_other, R1, P1, R2, P2, Q);
+
+  // With zero disparity rectification both cameras share focal length and principal point, the partner camera is
+  // only shifted along the x- or y-axis of the rectified reference camera
+  double f = P1.at<double>(0, 0);
+  double cx = P1.at<double>(0, 2);
+  double cy = P1.at<double>(1, 2);
+  double tx = P2.at<double>(0, 3) / f;
+  double ty = P2.at<double>(1, 3) / f;
+
+  bool is_vertical = std::abs(ty) > std::abs(tx);
+  double baseline = (is_vertical ? ty : tx);
+  if (std::abs(baseline) < 1e-6)
+  {
+    LOG_F(WARNING, "Densification failed: Baseline between frame #%u and #%u is zero.",
+          frame_ref->getFrameId(), frame_other->getFrameId());
+    return nullptr;
+  }
+
+  cv::Mat img_ref, img_other;
+  stereo::remap(frame_ref, R1, P1, img_ref);
+  stereo::remap(frame_other, R2, P2, img_other);
+
+  // Matching requires horizontal epipolar lines with the reference as left image. Vertical pairs are transposed and
+  // pairs, in which the partner is left of the reference, are mirrored.
+  bool is_mirrored = baseline > 0;
+  if (is_vertical)
+  {
+    cv::transpose(img_ref, img_ref);
+    cv::transpose(img_other, img_other);
+  }
+  if (is_mirrored)
+  {
+    cv::flip(img_ref, img_ref, 1);
+    cv::flip(img_other, img_other, 1);
+  }
+
+  double fb = f * std::abs(baseline);
+
+  int min_disparity, nrof_disparities;
+  computeDisparityRange(frame_ref, fb, min_disparity, nrof_disparities);
+  m_matcher->setMinDisparity(min_disparity);
+  m_matcher->setNumDisparities(nrof_disparities);
+
+  // Disparities are fixed point with 4 fractional bits
+  cv::Mat disparity;
+  m_matcher->compute(img_ref, img_other, disparity);
+
+  if (is_mirrored)
+    cv::flip(disparity, disparity, 1);
+  if (is_vertical)
+    cv::transpose(disparity, disparity);
+
+  // Triangulate the valid disparities in the rectified reference camera and transform them into the world frame
+  camera::Pinhole::Ptr cam_resized = frame_ref->getResizedCamera();
+  cv::Mat T_c2w = cam_resized->Tc2w();
+  cv::Mat R_rect2w = T_c2w.rowRange(0, 3).colRange(0, 3) * R1.t();
+  double R[3][3]{R_rect2w.at<double>(0, 0), R_rect2w.at<double>(0, 1), R_rect2w.at<double>(0, 2),
+                 R_rect2w.at<double>(1, 0), R_rect2w.at<double>(1, 1), R_rect2w.at<double>(1, 2),
+                 R_rect2w.at<double>(2, 0), R_rect2w.at<double>(2, 1), R_rect2w.at<double>(2, 2)};
+  double t[3]{T_c2w.at<double>(0, 3), T_c2w.at<double>(1, 3), T_c2w.at<double>(2, 3)};
+
+  auto disparity_invalid = static_cast<short>(std::max(min_disparity, 1) * 16);
+
+  cv::Mat points(disparity.rows * disparity.cols, 3, CV_64F);
+  int nrof_points = 0;
+  for (int r = 0; r < disparity.rows; ++r)
+  {
+    auto d = disparity.ptr<short>(r);
+    for (int c = 0; c < disparity.cols; ++c)
+    {
+      if (d[c] < disparity_invalid)
+        continue;
+
+      double z = fb * 16.0 / d[c];
+      double x = (c - cx) * z / f;
+      double y = (r - cy) * z / f;
+
+      auto pt = points.ptr<double>(nrof_points++);
+      pt[0] = R[0][0]*x + R[0][1]*y + R[0][2]*z + t[0];
+      pt[1] = R[1][0]*x + R[1][1]*y + R[1][2]*z + t[1];
+      pt[2] = R[2][0]*x + R[2][1]*y + R[2][2]*z + t[2];
+    }
+  }
+
+  if (nrof_points == 0)
+  {
+    LOG_F(WARNING, "Densification failed: No valid disparities for frame #%u.", frame_ref->getFrameId());
+    return nullptr;
+  }
+
+  cv::Mat depthmap = stereo::computeDepthMapFromPointCloud(cam_resized, points.rowRange(0, nrof_points), nullptr, 0);
+  return std::make_shared<Depthmap>(depthmap, *cam_resized);
+}
+
+void SemiGlobalMatching::computeDisparityRange(const Frame::Ptr &frame, double fb, int &min_disparity, int &nrof_disparities) const
+{
+  min_disparity = 0;
+  nrof_disparities = m_settings.nrof_disparities;
+
+  double depth_min = frame->getMinSceneDepth();
+  double depth_max = frame->getMaxSceneDepth();
+  if (depth_min <= 0.0 || depth_max < depth_min)
+    return;
+
+  double disparity_min = fb / (depth_max * (1.0 + m_settings.depth_range_margin));
+  double disparity_max = fb / (depth_min * std::max(1.0 - m_settings.depth_range_margin, 0.1));
+
+  min_disparity = static_cast<int>(std::floor(disparity_min));
+  nrof_disparities = static_cast<int>(std::ceil((disparity_max - min_disparity) / 16.0)) * 16;
+  nrof_disparities = std::min(std::max(nrof_disparities, 16), m_settings.nrof_disparities);
+}
+
+uint8_t SemiGlobalMatching::getNrofInputFrames()
+{
+  return 2;
+}
+
+double SemiGlobalMatching::getResizeFactor()
+{
+  return m_resizing;
+}
+
+void SemiGlobalMatching::printSettingsToLog()
+{
+  LOG_F(INFO, "### Semi-global matching settings ###");
+  LOG_F(INFO, "- nrof_disparities: %i", m_settings.nrof_disparities);
+  LOG_F(INFO, "- block_size: %i", m_settings.block_size);
+  LOG_F(INFO, "- p1: %i", m_settings.p1);
+  LOG_F(INFO, "- p2: %i", m_settings.p2);
+  LOG_F(INFO, "- uniqueness_ratio: %i", m_settings.uniqueness_ratio);
+  LOG_F(INFO, "- speckle_window_size: %i", m_settings.speckle_window_size);
+  LOG_F(INFO, "- speckle_range: %i", m_settings.speckle_range);
+  LOG_F(INFO, "- disp12_max_diff: %i", m_settings.disp12_max_diff);
+  LOG_F(INFO, "- mode: %i", m_settings.mode);
+  LOG_F(INFO, "- depth_range_margin: %4.2f", m_settings.depth_range_margin);
+}
@@ -0,0 +1,82 @@
+
+
+#ifndef PROJECT_CHECKPOINT_STORE_H
+#define PROJECT_CHECKPOINT_STORE_H
+
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace realm
+{
+namespace io
+{
+
+/*!
+ * @brief Directory holding the checkpoints of the stages, so a pipeline can resume after a crash or power cycle instead
+ * of reprocessing everything. Every checkpoint file is written into a temporary file first and renamed once it is
+ * complete. Renaming replaces the file atomically, so a crash while writing leaves the previous version intact. Stages
+ * prefix their files with their name, so several stages can share one directory.
+ */
+class CheckpointStore
+{
+  public:
+    using Ptr = std::shared_ptr<CheckpointStore>;
+    using ConstPtr = std::shared_ptr<const CheckpointStore>;
+
+    //! Writes the data of a checkpoint file to the given path
+    using WriteFunc = std::function<void(const std::string &)>;
+
+  public:
+    /*!
+     * @brief Constructor creates the directory, if it does not exist
+     * @param directory Absolute path of the checkpoint directory
+     */
+    explicit CheckpointStore(const std::string &directory);
+
+    /*!
+     * @brief Writes a checkpoint file atomically
+     * @param name Name of the file inside the directory, e.g. "mosaicing_state.yaml"
+     * @param write Function writing the data to the path it receives, which is a temporary file prefixed with "tmp_"
+     *        next to the final one
+     * @return False if the function did not create the file, e.g. because there was nothing to write. The previous
+     *         version is kept then.
+     * @throws runtime_error if the file could not be renamed, the previous version is kept then
+     */
+    bool write(const std::string &name, const WriteFunc &write) const;
+
+    /*!
+     * @brief Checks if a checkpoint file exists
+     * @param name Name of the file inside the directory
+     * @return True if it exists
+     */
+    bool exists(const std::string &name) const;
+
+    /*!
+     * @brief Removes a checkpoint file, if it exists
+     * @param name Name of the file inside the directory
+     */
+    void remove(const std::string &name) const;
+
+    /*!
+     * @brief Getter for the absolute path of a checkpoint file, e.g. to read it
+     * @param name Name of the file inside the directory
+     * @return Absolute path of the file
+     */
+    std::string getFilepath(const std::string &name) const;
+
+    /*!
+     * @brief Getter for the checkpoint directory
+     * @return Absolute path of the directory
+     */
+    std::string getDirectory() const;
+
+  private:
+
+    std::string m_directory;
+};
+
+} // namespace io
+} // namespace realm
+
+#endif //PROJECT_CHECKPOINT_STORE_H
@@ -34,6 +34,23 @@ void saveImage(const cv::Mat &img,
 void saveImageToBinary(const cv::Mat &data,
                        const std::string &filepath);
 
+/*!
+ * @brief Encodes an image compressed for transport, e.g. previews for ground stations on a low bandwidth link. Images
+ * of 8 bit depth are encoded as jpeg, an alpha channel is dropped. Images of 16 bit depth are encoded as png, all
+ * others are not supported.
+ * @param img Image to be encoded
+ * @param scale Factor the image is resized with before encoding in range (0, 1]
+ * @param quality Jpeg quality in range [0, 100]
+ * @param data Encoded image
+ * @param format Format of the encoded image, either "jpeg" or "png"
+ * @return False, if the image type can not be encoded
+ */
+bool encodeImageCompressed(const cv::Mat &img,
+                           double scale,
+                           int quality,
+                           std::vector<uint8_t> &data,
+                           std::string &format);
+
 void saveDepthMap(const Depthmap::Ptr &img,
                   const std::string &filename,
                   uint32_t id);
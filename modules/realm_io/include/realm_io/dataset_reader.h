@@ -0,0 +1,119 @@
+
+
+#ifndef PROJECT_DATASET_READER_H
+#define PROJECT_DATASET_READER_H
+
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <realm_core/frame.h>
+#include <realm_core/thread_pool.h>
+#include <realm_io/exif_import.h>
+
+namespace realm
+{
+namespace io
+{
+
+/*!
+ * @brief Reader for offline datasets of images with Exif tags, e.g. for reprocessing a recorded mission. Images are
+ * loaded and decoded by a pool of workers ahead of the consumer, so the pipeline does not wait for the disk and the
+ * decoder. Only a fixed number of frames is loaded ahead, which bounds the memory of the reader. Frames are returned
+ * in the order of their timestamps, independent of the order the workers finish them.
+ */
+class Exiv2DatasetReader
+{
+  public:
+    using Ptr = std::shared_ptr<Exiv2DatasetReader>;
+    using ConstPtr = std::shared_ptr<const Exiv2DatasetReader>;
+
+  public:
+    /*!
+     * @brief Constructor reads the timestamps of all images to sort them and starts loading the first frames
+     * @param filepaths Absolute paths of the images, e.g. from io::getFileList
+     * @param camera_id Id of the camera, read from the Exif tags if empty
+     * @param cam Camera model of all images
+     * @param tags Tags to be read for frame information
+     * @param nrof_threads Number of worker threads, <= 0 uses all available cores
+     * @param nrof_prefetch Maximum number of frames loaded ahead of the consumer
+     */
+    Exiv2DatasetReader(const std::vector<std::string> &filepaths,
+                       const std::string &camera_id,
+                       const camera::Pinhole::Ptr &cam,
+                       const Exiv2FrameReader::FrameTags &tags = Exiv2FrameReader::FrameTags(),
+                       int nrof_threads = 0,
+                       size_t nrof_prefetch = 8);
+
+    /*!
+     * @brief Destructor waits for the frames, that are currently loaded
+     */
+    ~Exiv2DatasetReader();
+
+    Exiv2DatasetReader(const Exiv2DatasetReader &) = delete;
+    Exiv2DatasetReader& operator=(const Exiv2DatasetReader &) = delete;
+
+    /*!
+     * @brief Returns the next frame in timestamp order and starts loading the following ones. Blocks if the frame is
+     * not loaded yet. Errors while loading the frame are rethrown.
+     * @return Next frame, nullptr if all frames were returned or the image could not be opened
+     */
+    Frame::Ptr next();
+
+    /*!
+     * @brief Checks if there are frames left
+     * @return True if next() returns another frame
+     */
+    bool hasNext() const;
+
+    /*!
+     * @brief Getter for the number of images in the dataset
+     * @return Number of images
+     */
+    size_t size() const;
+
+    /*!
+     * @brief Getter for the image paths in the order the frames are returned
+     * @return Image paths sorted by timestamp
+     */
+    std::vector<std::string> getFilepaths() const;
+
+  private:
+
+    //! Frame loaded by a worker, the future signals when it is done
+    struct PendingFrame
+    {
+      std::future<void> future;
+      std::shared_ptr<Frame::Ptr> frame;
+    };
+
+    std::string m_camera_id;
+    camera::Pinhole::Ptr m_cam;
+
+    //! Only reads the tags, so it is shared by all workers
+    Exiv2FrameReader m_reader;
+
+    size_t m_nrof_prefetch;
+
+    std::vector<std::string> m_filepaths;
+
+    //! Index of the next image to be loaded
+    size_t m_idx_next_load;
+
+    //! Frames loaded ahead in the order they are returned
+    std::deque<PendingFrame> m_pending;
+
+    ThreadPool::Ptr m_pool;
+
+    /*!
+     * @brief Starts loading frames until the maximum number of frames is loaded ahead
+     */
+    void prefetch();
+};
+
+} // namespace io
+} // namespace realm
+
+#endif //PROJECT_DATASET_READER_H
@@ -117,6 +117,14 @@ public:
    */
   Frame::Ptr loadFrameFromExiv2(const std::string &camera_id, const camera::Pinhole::Ptr &cam, const std::string &filepath);
 
+  /*!
+   * @brief Reads only the timestamp tag of an image without decoding the image data, e.g. to sort a dataset
+   * @param filepath Path to the image with exif tags
+   * @param timestamp Output; Timestamp of the image
+   * @return True if the tag was found
+   */
+  bool loadTimestampFromExiv2(const std::string &filepath, uint64_t* timestamp);
+
 private:
 
   //! Tags to be read from the exiv information
@@ -0,0 +1,117 @@
+
+
+#ifndef PROJECT_EXPORT_SERVICE_H
+#define PROJECT_EXPORT_SERVICE_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace realm
+{
+namespace io
+{
+
+/*!
+ * @brief Asynchronous service for the exports of the stages, e.g. colormaps, PNGs or GeoTIFFs saved every iteration.
+ * Stages put everything they want to save in one iteration into a single job, which only holds deep copies of the
+ * data (snapshots), and submit it. Encoding and writing is done by the worker threads of the service, so saving does
+ * not add latency to the processing. The queue is bounded to limit the memory held by snapshots. The service is meant
+ * to be created once per pipeline and shared by all stages.
+ */
+class ExportService
+{
+  public:
+    using Ptr = std::shared_ptr<ExportService>;
+    using ConstPtr = std::shared_ptr<const ExportService>;
+
+    using Job = std::function<void()>;
+
+  public:
+    /*!
+     * @brief Constructor that directly starts the worker threads
+     * @param nrof_threads Number of worker threads, at least one is started
+     * @param queue_size Maximum number of jobs waiting in the queue
+     * @param do_drop_when_full Flag to drop the oldest waiting job if the queue is full. Otherwise submitting blocks
+     *        until a job is finished, which slows the pipeline down, but never loses data.
+     */
+    explicit ExportService(int nrof_threads = 1, size_t queue_size = 16, bool do_drop_when_full = true);
+
+    /*!
+     * @brief Destructor finishes all queued jobs and joins the threads
+     */
+    ~ExportService();
+
+    ExportService(const ExportService &) = delete;
+    ExportService& operator=(const ExportService &) = delete;
+
+    /*!
+     * @brief Submits a job to the queue. Exceptions thrown by the job are logged and do not stop the service.
+     * @param name Name of the job for logging, e.g. "Mosaicing::saveIter"
+     * @param job Job to be executed, must not reference data that is changed by the caller afterwards
+     * @return false if a job had to be dropped for this one
+     */
+    bool submit(const std::string &name, const Job &job);
+
+    /*!
+     * @brief Blocks until all jobs submitted so far are finished, e.g. before final results are saved
+     */
+    void flush();
+
+    /*!
+     * @brief Getter for the number of jobs waiting or in progress
+     * @return Number of unfinished jobs
+     */
+    size_t getNrofPending() const;
+
+    /*!
+     * @brief Getter for the number of jobs dropped because the queue was full
+     * @return Number of dropped jobs since construction
+     */
+    size_t getNrofDropped() const;
+
+  private:
+
+    //! Flag to signal all threads to finish
+    bool m_stop_requested;
+
+    //! Maximum number of waiting jobs
+    size_t m_queue_size;
+
+    //! Policy when the queue is full
+    bool m_do_drop_when_full;
+
+    //! Number of jobs currently executed by the workers
+    size_t m_nrof_running;
+
+    //! Number of jobs dropped so far
+    size_t m_nrof_dropped;
+
+    //! Waiting jobs with their names in submission order
+    std::deque<std::pair<std::string, Job>> m_jobs;
+
+    mutable std::mutex m_mutex_jobs;
+
+    //! Signals the workers that there are jobs or the service stops
+    std::condition_variable m_condition_jobs;
+
+    //! Signals waiting submitters and flush() that jobs were finished
+    std::condition_variable m_condition_finished;
+
+    std::vector<std::thread> m_threads;
+
+    /*!
+     * @brief Loop of every worker thread
+     */
+    void run();
+};
+
+} // namespace io
+} // namespace realm
+
+#endif //PROJECT_EXPORT_SERVICE_H
@@ -0,0 +1,234 @@
+
+
+#ifndef PROJECT_FRAME_LINK_H
+#define PROJECT_FRAME_LINK_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <realm_core/frame.h>
+#include <realm_io/frame_snapshot.h>
+
+namespace realm
+{
+namespace io
+{
+
+/*!
+ * @brief Sending end of a link between two stages on different hosts, e.g. from the densification on a GPU board to
+ * the mosaicing on a second one. Frames are serialized with everything the pipeline added to them (see serializeFrame)
+ * and sent over TCP to a FrameLinkReceiver. Serialization happens in the calling stage, so the following stages on this
+ * host can not modify the frame meanwhile, sending is done by a worker thread. The connection is established in the
+ * background and reestablished if it breaks, messages are kept queued meanwhile.
+ *
+ * The queue is bounded, if the link can not keep up the oldest message is dropped, same as the queues of the stages.
+ *
+ * Message layout, all values in native byte order, so both hosts must share it:
+ *  - Header: magic "REALMLNK", version, size of the topic and size of the payload
+ *  - Topic, e.g. "output/frame"
+ *  - Payload: serialized frame
+ */
+class FrameLinkSender
+{
+  public:
+    using Ptr = std::shared_ptr<FrameLinkSender>;
+    using ConstPtr = std::shared_ptr<const FrameLinkSender>;
+
+  public:
+    /*!
+     * @brief Constructor that directly starts connecting to the receiver in the background
+     * @param host Address of the receiver, either IPv4 address or host name, e.g. "192.168.1.2"
+     * @param port Port the receiver listens on
+     * @param queue_size Maximum number of messages waiting to be sent
+     * @param compression Encoding of the frame images, see serializeFrame
+     * @param quality Jpeg quality in range [0, 100]
+     */
+    FrameLinkSender(const std::string &host,
+                    uint16_t port,
+                    size_t queue_size = 8,
+                    FrameImageCompression compression = FrameImageCompression::NONE,
+                    int quality = 95);
+
+    /*!
+     * @brief Destructor stops the worker thread and closes the connection. Messages not sent yet are dropped.
+     */
+    ~FrameLinkSender();
+
+    FrameLinkSender(const FrameLinkSender &) = delete;
+    FrameLinkSender& operator=(const FrameLinkSender &) = delete;
+
+    /*!
+     * @brief Serializes a frame and queues it for sending
+     * @param frame Frame to be sent
+     * @param topic Description of the data, passed on to the receive function of the other end
+     * @return False, if the oldest message had to be dropped for this one
+     */
+    bool send(const Frame::Ptr &frame, const std::string &topic);
+
+    /*!
+     * @brief Creates a transport function for StageBase::registerFrameTransport, which sends the frames to the receiver.
+     * The transport function must not be used after this object was destroyed.
+     * @return Transport function
+     */
+    std::function<void(const Frame::Ptr &, const std::string &)> createFrameTransport();
+
+    /*!
+     * @brief Blocks until all messages queued so far are sent or the timeout expired, e.g. before the pipeline finishes
+     * @param timeout Maximum time to wait in [ms]
+     * @return True, if all messages were sent
+     */
+    bool flush(int64_t timeout);
+
+    /*!
+     * @brief Checks if the connection to the receiver is established
+     * @return True if connected
+     */
+    bool isConnected() const;
+
+    /*!
+     * @brief Getter for the number of messages sent
+     * @return Number of messages sent since construction
+     */
+    size_t getNrofSent() const;
+
+    /*!
+     * @brief Getter for the number of messages dropped because the queue was full
+     * @return Number of messages dropped since construction
+     */
+    size_t getNrofDropped() const;
+
+  private:
+
+    std::string m_host;
+    uint16_t m_port;
+
+    size_t m_queue_size;
+
+    FrameImageCompression m_compression;
+    int m_quality;
+
+    //! Flag to signal the worker thread to finish
+    bool m_stop_requested;
+
+    //! Socket of the connection, negative if not connected. Written by the worker only while holding the lock.
+    int m_socket;
+
+    //! True while the worker sends a message, which was already taken from the queue
+    bool m_is_sending;
+
+    size_t m_nrof_sent;
+    size_t m_nrof_dropped;
+
+    //! Serialized messages in the order they were queued
+    std::deque<std::string> m_messages;
+
+    mutable std::mutex m_mutex;
+
+    //! Signals the worker that there are messages or the link stops
+    std::condition_variable m_condition_messages;
+
+    //! Signals flush() that messages were sent
+    std::condition_variable m_condition_sent;
+
+    std::thread m_thread;
+
+    /*!
+     * @brief Loop of the worker thread
+     */
+    void run();
+
+    /*!
+     * @brief Connects to the receiver
+     * @return Socket of the connection, negative if the receiver is not reachable
+     */
+    int connectToReceiver() const;
+};
+
+/*!
+ * @brief Receiving end of a link between two stages on different hosts, see FrameLinkSender. Listens for the
+ * connection of a sender and restores the frames it sends, which are passed on to the receive function, e.g. adding
+ * them to the following stage. Connections are served one at a time, so a restarted sender is served as soon as the
+ * previous connection was closed.
+ */
+class FrameLinkReceiver
+{
+  public:
+    using Ptr = std::shared_ptr<FrameLinkReceiver>;
+    using ConstPtr = std::shared_ptr<const FrameLinkReceiver>;
+
+    //! Called by the receiving thread for every restored frame with the topic of the sender
+    using ReceiveFunc = std::function<void(const Frame::Ptr &, const std::string &)>;
+
+  public:
+    /*!
+     * @brief Constructor that opens the port and directly starts receiving in the background
+     * @param port Port to listen on on all interfaces. If 0, a free port is chosen, see getPort()
+     * @param receive Function receiving the frames
+     */
+    FrameLinkReceiver(uint16_t port, const ReceiveFunc &receive);
+
+    /*!
+     * @brief Destructor closes the connection and the port and stops the receiving thread
+     */
+    ~FrameLinkReceiver();
+
+    FrameLinkReceiver(const FrameLinkReceiver &) = delete;
+    FrameLinkReceiver& operator=(const FrameLinkReceiver &) = delete;
+
+    /*!
+     * @brief Getter for the port the receiver listens on
+     * @return Port number
+     */
+    uint16_t getPort() const;
+
+    /*!
+     * @brief Getter for the number of frames received
+     * @return Number of frames received since construction
+     */
+    size_t getNrofReceived() const;
+
+  private:
+
+    ReceiveFunc m_receive;
+
+    uint16_t m_port;
+
+    //! Flag to signal the receiving thread to finish
+    std::atomic<bool> m_stop_requested;
+
+    std::atomic<size_t> m_nrof_received;
+
+    //! Socket listening for connections
+    int m_socket_listen;
+
+    //! Socket of the current connection, negative if not connected
+    int m_socket;
+
+    //! Guards the socket of the connection, so it can be shut down by the destructor
+    std::mutex m_mutex_socket;
+
+    std::thread m_thread;
+
+    /*!
+     * @brief Loop of the receiving thread
+     */
+    void run();
+
+    /*!
+     * @brief Receives messages from a connection until it is closed
+     * @param socket Socket of the connection
+     */
+    void receiveFrom(int socket);
+};
+
+} // namespace io
+} // namespace realm
+
+#endif //PROJECT_FRAME_LINK_H
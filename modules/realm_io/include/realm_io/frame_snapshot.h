@@ -0,0 +1,134 @@
+
+
+#ifndef PROJECT_FRAME_SNAPSHOT_H
+#define PROJECT_FRAME_SNAPSHOT_H
+
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <realm_core/frame.h>
+
+namespace realm
+{
+namespace io
+{
+
+//! Encoding of the image of a serialized frame
+enum class FrameImageCompression
+{
+  NONE,
+  PNG,
+  JPEG
+};
+
+/*!
+ * @brief Serializes a frame with everything the pipeline added to it, in the same format the snapshots are written,
+ * e.g. to transport it to another process or host. All values are written in native byte order.
+ * @param out Stream the frame is written to
+ * @param frame Frame to be serialized
+ * @param compression Encoding of the image. Lossless png saves bandwidth without changing the results, jpeg saves
+ *        considerably more, but the following stages process a different image. Jpeg falls back to png for images that
+ *        can not be encoded as jpeg, e.g. with 16 bit depth or an alpha channel.
+ * @param quality Jpeg quality in range [0, 100]
+ */
+void serializeFrame(std::ostream &out,
+                    const Frame::Ptr &frame,
+                    FrameImageCompression compression = FrameImageCompression::NONE,
+                    int quality = 95);
+
+/*!
+ * @brief Restores a frame written by serializeFrame with the state it had at that time
+ * @param in Stream the frame is read from
+ * @return Restored frame
+ */
+Frame::Ptr deserializeFrame(std::istream &in);
+
+/*!
+ * @brief Writer for snapshots of frames, e.g. the inputs of a single stage, so the stage can later be run in isolation
+ * with exactly the same data. All frames are appended to one binary file. Besides the image and the tags it contains
+ * everything the pipeline adds to a frame: camera model, poses, georeference, flags, sparse cloud, depth map, surface
+ * model and orthophoto. Matrices are written raw without compression, so loading them costs no more than reading the
+ * file. Writing is thread safe and synchronous, so the frame can not be modified by the following stage meanwhile.
+ */
+class FrameSnapshotWriter
+{
+  public:
+    using Ptr = std::shared_ptr<FrameSnapshotWriter>;
+    using ConstPtr = std::shared_ptr<const FrameSnapshotWriter>;
+
+  public:
+    /*!
+     * @brief Constructor creates the file, an existing one is overwritten
+     * @param filepath Absolute path of the snapshot file, typically with .frames.bin suffix
+     */
+    explicit FrameSnapshotWriter(const std::string &filepath);
+
+    FrameSnapshotWriter(const FrameSnapshotWriter &) = delete;
+    FrameSnapshotWriter& operator=(const FrameSnapshotWriter &) = delete;
+
+    /*!
+     * @brief Appends a frame to the snapshot and flushes it, so the file is valid even if the process is killed
+     * @param frame Frame to be written
+     */
+    void write(const Frame::Ptr &frame);
+
+    /*!
+     * @brief Getter for the number of frames written
+     * @return Number of frames
+     */
+    size_t getNrofFrames() const;
+
+  private:
+
+    mutable std::mutex m_mutex_file;
+
+    std::ofstream m_file;
+
+    size_t m_nrof_frames;
+};
+
+/*!
+ * @brief Reader for frame snapshots written by FrameSnapshotWriter. Frames are restored in the order they were written
+ * with the state they had at that time, e.g. keyframe flags, georeference and the maps of previous stages.
+ */
+class FrameSnapshotReader
+{
+  public:
+    using Ptr = std::shared_ptr<FrameSnapshotReader>;
+    using ConstPtr = std::shared_ptr<const FrameSnapshotReader>;
+
+  public:
+    /*!
+     * @brief Constructor opens the file and checks its header
+     * @param filepath Absolute path of the snapshot file
+     */
+    explicit FrameSnapshotReader(const std::string &filepath);
+
+    FrameSnapshotReader(const FrameSnapshotReader &) = delete;
+    FrameSnapshotReader& operator=(const FrameSnapshotReader &) = delete;
+
+    /*!
+     * @brief Reads the next frame of the snapshot
+     * @return Next frame, nullptr if all frames were read
+     */
+    Frame::Ptr next();
+
+    /*!
+     * @brief Checks if there are frames left
+     * @return True if next() returns another frame
+     */
+    bool hasNext();
+
+  private:
+
+    std::string m_filepath;
+
+    std::ifstream m_file;
+};
+
+} // namespace io
+} // namespace realm
+
+#endif //PROJECT_FRAME_SNAPSHOT_H
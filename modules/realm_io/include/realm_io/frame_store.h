@@ -0,0 +1,148 @@
+
+
+#ifndef PROJECT_FRAME_STORE_H
+#define PROJECT_FRAME_STORE_H
+
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <realm_core/frame.h>
+
+namespace realm
+{
+namespace io
+{
+
+//! Where frames are kept, once they are moved out of memory
+enum class FrameColdStorage
+{
+  MEMORY,
+  FILE
+};
+
+/*!
+ * @brief Store of all frames a stage processed, e.g. for post processing at the end of a mission. Only the most recent
+ * frames are kept resident, older frames are moved to cold storage, so memory stays flat with the length of the
+ * mission. Cold frames are serialized with everything the pipeline added to them (see serializeFrame) and deflated,
+ * which compresses the empty cells of surface models and orthophotos well. They are either kept in memory or spilled
+ * to a binary file. Access is transparent, cold frames are restored on request. Restored frames are not kept, so
+ * iterating over all frames only holds one of them at a time. Thread safe.
+ */
+class FrameStore
+{
+  public:
+    using Ptr = std::shared_ptr<FrameStore>;
+    using ConstPtr = std::shared_ptr<const FrameStore>;
+
+  public:
+    /*!
+     * @brief Constructor
+     * @param nrof_resident Number of most recent frames kept resident
+     * @param cold_storage Where older frames are kept
+     * @param filepath Absolute path of the file cold frames are spilled to, only used for FrameColdStorage::FILE. An
+     *        existing one is overwritten, it is removed with the store.
+     */
+    explicit FrameStore(size_t nrof_resident,
+                        FrameColdStorage cold_storage = FrameColdStorage::MEMORY,
+                        const std::string &filepath = "");
+
+    /*!
+     * @brief Destructor removes the spill file
+     */
+    ~FrameStore();
+
+    FrameStore(const FrameStore &) = delete;
+    FrameStore& operator=(const FrameStore &) = delete;
+
+    /*!
+     * @brief Adds a frame as the most recent one. If more frames are resident than allowed, the oldest resident one is
+     * moved to cold storage, which serializes and compresses it in the calling thread.
+     * @param frame Frame to be added
+     */
+    void add(const Frame::Ptr &frame);
+
+    /*!
+     * @brief Getter for a frame in the order they were added
+     * @param idx Index of the frame in range [0, size())
+     * @return Resident frame or a frame restored from cold storage
+     */
+    Frame::Ptr get(size_t idx) const;
+
+    /*!
+     * @brief Calls a function for all frames in the order they were added. Cold frames are restored one at a time.
+     * @param func Function receiving the frames
+     */
+    void forEach(const std::function<void(const Frame::Ptr &)> &func) const;
+
+    /*!
+     * @brief Getter for the number of frames added
+     * @return Number of frames
+     */
+    size_t size() const;
+
+    /*!
+     * @brief Getter for the number of frames in cold storage
+     * @return Number of cold frames
+     */
+    size_t getNrofCold() const;
+
+    /*!
+     * @brief Getter for the memory used by the store, which is the resident frames and the compressed frames kept in
+     * memory
+     * @return Number of bytes
+     */
+    size_t getByteSize() const;
+
+    /*!
+     * @brief Removes all frames
+     */
+    void clear();
+
+  private:
+
+    //! Frame in cold storage, either with its compressed data or its position in the spill file
+    struct ColdFrame
+    {
+        std::string data;
+        std::streamoff offset;
+        size_t size_compressed;
+        size_t size_raw;
+    };
+
+    size_t m_nrof_resident;
+    FrameColdStorage m_cold_storage;
+    std::string m_filepath;
+
+    mutable std::mutex m_mutex;
+
+    //! Cold frames followed by the resident ones, both from the oldest to the most recent
+    std::vector<ColdFrame> m_frames_cold;
+    std::deque<Frame::Ptr> m_frames_resident;
+
+    //! Spill file, opened for reading and appending. Access is guarded by the lock, as reading moves its position.
+    mutable std::fstream m_file;
+    std::streamoff m_file_size;
+
+    /*!
+     * @brief Serializes, compresses and stores a frame in cold storage. Expects the lock to be held.
+     * @param frame Frame to be moved to cold storage
+     */
+    void moveToColdStorage(const Frame::Ptr &frame);
+
+    /*!
+     * @brief Restores a frame from cold storage. Expects the lock to be held.
+     * @param cold Cold frame to be restored
+     * @return Restored frame
+     */
+    Frame::Ptr restore(const ColdFrame &cold) const;
+};
+
+} // namespace io
+} // namespace realm
+
+#endif //PROJECT_FRAME_STORE_H
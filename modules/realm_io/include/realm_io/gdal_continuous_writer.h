@@ -3,6 +3,9 @@
 #ifndef OPENREALM_GDAL_CONTINUOUS_WRITER_H
 #define OPENREALM_GDAL_CONTINUOUS_WRITER_H
 
+#include <map>
+
+#include <realm_core/thread_pool.h>
 #include <realm_core/worker_thread_base.h>
 #include <realm_io/gis_export.h>
 
@@ -18,8 +21,19 @@ public:
   using Ptr = std::shared_ptr<GDALContinuousWriter>;
 
 public:
-  GDALContinuousWriter(const std::string &thread_name, int64_t sleep_time, bool verbose);
-
+  /*!
+   * @brief Constructor of the writer thread
+   * @param thread_name Name of the thread
+   * @param sleep_time Time in [ms] to sleep between checks for new requests
+   * @param verbose Flag for verbose logging
+   * @param nrof_threads Number of threads writing different files in parallel
+   */
+  GDALContinuousWriter(const std::string &thread_name, int64_t sleep_time, bool verbose, int nrof_threads = 1);
+
+  /*!
+   * @brief Requests to save a GeoTIFF. A pending request for the same file is replaced, as only the latest data is of
+   * interest. Requests for different files are kept.
+   */
   void requestSaveGeoTIFF(const CvGridMap::Ptr &map,
                           const uint8_t &zone,
                           const std::string &filename,
@@ -27,6 +41,36 @@ public:
                           bool do_split_save = false,
                           GDALProfile gdal_profile = GDALProfile::COG);
 
+  /*!
+   * @brief Requests an in place update of a tiled GeoTIFF. The file is opened once and kept open, only the blocks
+   * covered by the update and the corresponding blocks of the internal overviews are written. If the file does not
+   * cover the update, it is recreated with a margin around both, so growing maps only rarely cause a full rewrite.
+   * Other than save requests, updates are never dropped. Pending updates of the same file are merged into one map
+   * covering all of them, in which newer data overwrites older one, so every file is written once per iteration.
+   * @param map_update Single layer map of the region to be updated, e.g. a submap of the global map. All updates of one
+   * file must be aligned to the same grid and have the same resolution.
+   * @param zone UTM zone of the map ROI
+   * @param filename Full name of the image to be updated
+   * @param do_build_overview Flag to build internal overviews when the file is created and update them with the data
+   */
+  void requestUpdateGeoTIFF(const CvGridMap::Ptr &map_update,
+                            const uint8_t &zone,
+                            const std::string &filename,
+                            bool do_build_overview = false);
+
+  /*!
+   * @brief Writes all pending requests in the calling thread and blocks until they are written, e.g. to measure the
+   * storage throughput without the timing of the worker thread. Must only be called while the thread is not running.
+   * @return True if any request was written
+   */
+  bool writePending();
+
+  /*!
+   * @brief Closes all files opened for in place updates, so they are complete on disk. Must only be called while the
+   * thread is not running, otherwise the writer thread closes them when it finishes.
+   */
+  void closeUpdateDatasets();
+
 private:
   struct QueueElement
   {
@@ -37,16 +81,77 @@ private:
     bool do_split_save;
     GDALProfile gdal_profile;
 
+    //! Regions of the map to be written by an update, all other data of the map is undefined
+    std::vector<cv::Rect2d> rois;
+
     using Ptr = std::shared_ptr<QueueElement>;
   };
 
-  int m_queue_size;
+  //! GeoTIFF kept open for in place updates
+  struct UpdateDataset
+  {
+    GDALDataset* dataset;
+    cv::Rect2d roi;
+    double resolution;
+    uint8_t zone;
+    int type;
+    GDALDataType datatype;
+  };
+
+  //! Margin relative to the larger edge, which is added on all sides when a file for updates is recreated
+  double m_update_margin;
 
+  //! Pending requests with at most one per file for saves and updates each. Files are written in order of request.
   std::mutex m_mutex_save_requests;
-  std::deque<QueueElement::Ptr> m_save_requests;
+  std::map<std::string, QueueElement::Ptr> m_save_requests;
+  std::map<std::string, QueueElement::Ptr> m_update_requests;
+  std::deque<std::string> m_save_requests_order;
+  std::deque<std::string> m_update_requests_order;
+
+  //! Open files for in place updates. Entries are only added or removed by the writer thread, while no files are
+  //! written, so every task owns the entry of its file.
+  std::map<std::string, UpdateDataset> m_update_datasets;
+
+  //! Threads writing different files in parallel
+  ThreadPool::Ptr m_pool;
 
   bool process() override;
 
+  /*!
+   * @brief Writes an update request into its file, which is created or recreated if required
+   * @param request Update request
+   * @param dataset Open file of the request, the dataset is empty if there is none yet
+   */
+  void processUpdate(const QueueElement::Ptr &request, UpdateDataset &dataset);
+
+  /*!
+   * @brief Writes all pending requests, files are written in parallel
+   * @return True if any request was written
+   */
+  bool processRequests();
+
+  /*!
+   * @brief Creates the file of an update dataset, that covers the ROI and all data of the previous file, if any
+   * @param dataset Dataset to be recreated, the previous file is closed. Empty if no file exists yet.
+   * @param filename Full name of the file
+   * @param roi ROI that must be covered by the file
+   * @param resolution Resolution of the data
+   * @param meta Meta information of the update
+   * @param type OpenCV type of the data
+   * @param do_build_overview Flag to build internal overviews
+   */
+  void createUpdateDataset(UpdateDataset &dataset, const std::string &filename, const cv::Rect2d &roi, double resolution,
+                           const GDALDatasetMeta &meta, int type, bool do_build_overview);
+
+  /*!
+   * @brief Writes data into the dataset and optionally updates the covered blocks of all overviews
+   * @param dataset Dataset to be written
+   * @param data Data with the type of the dataset
+   * @param roi ROI of the data, must be covered by the dataset
+   * @param do_update_overviews Flag to update the overviews
+   */
+  void writeUpdate(const UpdateDataset &dataset, const cv::Mat &data, const cv::Rect2d &roi, bool do_update_overviews);
+
   void reset() override;
 
   void finishCallback() override;
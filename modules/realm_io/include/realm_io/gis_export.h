@@ -24,7 +24,9 @@ namespace io
 
 enum class GDALProfile
 {
-  COG /// Cloud Optimized GeoTIFF: https://trac.osgeo.org/gdal/wiki/CloudOptimizedGeoTIFF
+  COG,              /// Cloud Optimized GeoTIFF: https://trac.osgeo.org/gdal/wiki/CloudOptimizedGeoTIFF
+  COG_DEFLATE,      /// Same layout as COG, DEFLATE results in smaller files than LZW but is slower
+  COG_UNCOMPRESSED  /// Same layout as COG without compression, e.g. for fast local storage and later conversion
 };
 
 struct GDALDatasetMeta
@@ -44,13 +46,16 @@ struct GDALDatasetMeta
  * @param do_split_save Flag to save all channels separately. The filename is modified in this case to represent the channel
  * information also, e.g. ortho -> ortho_b, ortho_g, ortho_r, ortho_a
  * @param gdal_profile Collection of options that are passed to the GDAL driver
+ * @param nrof_threads Number of threads to compress with, <= 0 uses all available cores. Channels of a split save are
+ * saved in parallel and share them.
  */
 void saveGeoTIFF(const CvGridMap &map,
                  const uint8_t &zone,
                  const std::string &filename,
                  bool do_build_overview = false,
                  bool do_split_save = false,
-                 GDALProfile gdal_profile = GDALProfile::COG);
+                 GDALProfile gdal_profile = GDALProfile::COG,
+                 int nrof_threads = 0);
 
 /*!
  * @brief Internal function to save GeoTIFFs. Usually the user should not be forced to compute the GDALDatasetMeta beforehand.
@@ -66,6 +71,34 @@ void saveGeoTIFFtoFile(const cv::Mat &data,
                        bool do_build_overviews,
                        GDALProfile gdal_profile);
 
+/*!
+ * @brief Internal function to save GeoTIFFs without intermediate copies. The tiled and compressed file is created
+ * directly and written from the given memory, color channels are reordered while writing. Overviews are computed in
+ * memory from the same data and written first, so the file layout follows a Cloud Optimized GeoTIFF.
+ * @param data OpenCV matrix data, can be multi or single layered. Color images are expected in BGR(A) order.
+ * @param meta Meta informations about the dataset
+ * @param filename Full filename of the resulting .tif file
+ * @param do_build_overviews Flag to build internal overviews
+ * @param gdal_profile Collection of options that are passed to the GDAL driver
+ * @param channel Channel of the data to be saved as single band, all channels are saved if negative
+ * @param nrof_threads Number of threads GDAL compresses the blocks with, <= 0 uses all available cores
+ */
+void saveGeoTIFFtoFileDirect(const cv::Mat &data,
+                             const GDALDatasetMeta &meta,
+                             const std::string &filename,
+                             bool do_build_overviews,
+                             GDALProfile gdal_profile,
+                             int channel = -1,
+                             int nrof_threads = 0);
+
+/*!
+ * @brief Computes the factors of the internal overviews of an image, down to a size of one pixel
+ * @param cols Number of columns of the image
+ * @param rows Number of rows of the image
+ * @return Overview factors in increasing order
+ */
+std::vector<int> computeOverviewList(int cols, int rows);
+
 /*!
  * @brief Internal function to translate CvGridMap information to GDAL meta data.
  * @param map CvGridMap which should be saved as GeoTIFF
@@ -89,6 +122,13 @@ GDALDatasetMeta* computeGDALDatasetMeta(const CvGridMap &map, uint8_t zone);
  */
 GDALDataset* generateMemoryDataset(const cv::Mat &data, const GDALDatasetMeta &meta);
 
+/*!
+ * @brief Sets the geo transformation and the UTM projection of a dataset
+ * @param dataset Dataset to be georeferenced
+ * @param meta Meta informations about the dataset
+ */
+void setGDALDatasetGeoinfo(GDALDataset* dataset, const GDALDatasetMeta &meta);
+
 /*!
  * @brief
  * @param gdal_profile
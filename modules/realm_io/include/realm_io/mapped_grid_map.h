@@ -0,0 +1,146 @@
+
+
+#ifndef PROJECT_MAPPED_GRID_MAP_H
+#define PROJECT_MAPPED_GRID_MAP_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include <realm_core/cv_grid_map.h>
+
+namespace realm
+{
+namespace io
+{
+
+/*!
+ * @brief Read-only access to a CvGridMap in a binary container, that is memory mapped instead of read. Opening a file
+ * only parses the header with the geometry and the layer table, layer data is paged in by the OS on first access. The
+ * layer blobs are stored raw and page-aligned, so every layer can be handed out as matrix header into the mapping
+ * without any copy. Typically used by post-processing tools to open huge global maps instantly.
+ *
+ * File layout (.grid.mmap), all values in native byte order:
+ *  - Header: magic "REALMGRD", version, number of layers, ROI, resolution and size of the grid
+ *  - Layer table: name, OpenCV type, interpolation, offset and size in bytes of every layer
+ *  - Layer blobs: continuous rows of every layer, each starting at a page boundary
+ */
+class MappedGridMap
+{
+  public:
+    using Ptr = std::shared_ptr<MappedGridMap>;
+    using ConstPtr = std::shared_ptr<const MappedGridMap>;
+
+    //! Entry of the layer table as stored in the file
+    struct LayerEntry
+    {
+      char name[64];
+      int32_t type;
+      int32_t interpolation;
+      uint64_t offset;
+      uint64_t size;
+    };
+
+  public:
+    /*!
+     * @brief Opens and maps a file written by save()
+     * @param filepath Absolute filepath with .grid.mmap suffix
+     */
+    explicit MappedGridMap(const std::string &filepath);
+
+    /*!
+     * @brief Destructor unmaps the file. Layer views must not be used afterwards.
+     */
+    ~MappedGridMap();
+
+    MappedGridMap(const MappedGridMap &) = delete;
+    MappedGridMap& operator=(const MappedGridMap &) = delete;
+
+    /*!
+     * @brief Saves a CvGridMap in the binary container format, so it can be opened with the constructor. Layer data is
+     * written uncompressed, as compressed blobs could not be mapped.
+     * @param map CvGridMap about to be saved to disk
+     * @param filepath Absolute filepath with .grid.mmap suffix
+     */
+    static void save(const CvGridMap &map, const std::string &filepath);
+
+    /*!
+     * @brief Getter for the region of interest of the map
+     * @return ROI in world coordinates
+     */
+    cv::Rect2d roi() const;
+
+    /*!
+     * @brief Getter for the resolution of the map
+     * @return Resolution in [m/cell]
+     */
+    double resolution() const;
+
+    /*!
+     * @brief Getter for the size of the grid
+     * @return Number of columns and rows
+     */
+    cv::Size size() const;
+
+    /*!
+     * @brief Getter for the names of all layers in the order of the layer table
+     * @return Layer names
+     */
+    std::vector<std::string> getAllLayerNames() const;
+
+    /*!
+     * @brief Checks if a layer exists
+     * @param layer_name Name of the layer
+     * @return True if the layer exists
+     */
+    bool exists(const std::string &layer_name) const;
+
+    /*!
+     * @brief Returns the data of a layer without copying it. The matrix points into the read-only mapping and is only
+     * valid as long as this object exists. Pages are loaded on first access of the matrix, not by this call.
+     * @param layer_name Name of the layer
+     * @return Matrix header of the layer data
+     */
+    cv::Mat getLayerView(const std::string &layer_name) const;
+
+    /*!
+     * @brief Getter for the interpolation flag of a layer
+     * @param layer_name Name of the layer
+     * @return Interpolation flag, e.g. cv::INTER_LINEAR
+     */
+    int getLayerInterpolation(const std::string &layer_name) const;
+
+    /*!
+     * @brief Copies layers into a CvGridMap, which is independent of the mapping
+     * @param layer_names Names of the layers to be copied, all layers if empty
+     * @return Grid map with copies of the layers
+     */
+    CvGridMap::Ptr toCvGridMap(const std::vector<std::string> &layer_names = std::vector<std::string>()) const;
+
+  private:
+
+    //! Start of the mapping and its size in bytes
+    void* m_data;
+    size_t m_size_bytes;
+
+    cv::Rect2d m_roi;
+    double m_resolution;
+    cv::Size m_size;
+
+    std::vector<LayerEntry> m_layers;
+
+    /*!
+     * @brief Finds a layer in the layer table
+     * @param layer_name Name of the layer
+     * @return Entry of the layer, throws if it does not exist
+     */
+    const LayerEntry& findLayer(const std::string &layer_name) const;
+};
+
+} // namespace io
+} // namespace realm
+
+#endif //PROJECT_MAPPED_GRID_MAP_H
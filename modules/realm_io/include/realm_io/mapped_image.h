@@ -0,0 +1,65 @@
+
+
+#ifndef PROJECT_MAPPED_IMAGE_H
+#define PROJECT_MAPPED_IMAGE_H
+
+#include <memory>
+#include <string>
+
+#include <opencv2/core.hpp>
+
+namespace realm
+{
+namespace io
+{
+
+/*!
+ * @brief Access to a matrix in the binary format of io::saveImageToBinary, that is memory mapped instead of read.
+ * Opening a file only parses the header of four ints (cols, rows, element size, type), the data is paged in by the OS
+ * on first access and shared with the page cache, so no copy is kept in the process. Typically used by offline tools
+ * to open large depth maps and surface models.
+ */
+class MappedImage
+{
+  public:
+    using Ptr = std::shared_ptr<MappedImage>;
+    using ConstPtr = std::shared_ptr<const MappedImage>;
+
+  public:
+    /*!
+     * @brief Opens and maps a file written by io::saveImageToBinary
+     * @param filepath Absolute filepath with .bin suffix
+     */
+    explicit MappedImage(const std::string &filepath);
+
+    /*!
+     * @brief Destructor unmaps the file. Views must not be used afterwards.
+     */
+    ~MappedImage();
+
+    MappedImage(const MappedImage &) = delete;
+    MappedImage& operator=(const MappedImage &) = delete;
+
+    /*!
+     * @brief Returns the matrix without copying it. The matrix points into the mapping and is only valid as long as this
+     * object exists. Pages are mapped copy-on-write, so writing to the view only copies the written pages and never
+     * changes the file.
+     * @return Matrix header of the data
+     */
+    cv::Mat getView() const;
+
+  private:
+
+    //! Start of the mapping and its size in bytes
+    void* m_data;
+    size_t m_size_bytes;
+
+    int m_rows;
+    int m_cols;
+    int m_type;
+};
+
+} // namespace io
+} // namespace realm
+
+#endif //PROJECT_MAPPED_IMAGE_H
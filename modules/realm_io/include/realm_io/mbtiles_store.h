@@ -0,0 +1,115 @@
+
+
+#ifndef PROJECT_MBTILES_STORE_H
+#define PROJECT_MBTILES_STORE_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+namespace realm
+{
+namespace io
+{
+
+/*!
+ * @brief Single file tile storage following the MBTiles specification, which is an SQLite database with one row per
+ * tile. Compared to a directory tree of tiles, writes are appended to one file and grouped into transactions of
+ * kBatchSize tiles, so there is no directory creation and only one sync per batch. The file can be served directly
+ * to a ground station. Tile indices are expected in the TMS scheme used throughout OpenREALM, which is also the scheme
+ * of MBTiles. The store can be accessed from all threads, calls are serialized internally.
+ */
+class MbtilesStore
+{
+  public:
+    using Ptr = std::shared_ptr<MbtilesStore>;
+    using ConstPtr = std::shared_ptr<const MbtilesStore>;
+
+    //! Number of written tiles after which the current transaction is committed
+    static constexpr int kBatchSize = 256;
+
+  public:
+    /*!
+     * @brief Opens an existing MBTiles file or creates a new one
+     * @param filepath Absolute path to the file, typically with .mbtiles suffix
+     * @param name Name of the tileset written to the metadata, e.g. the layer name
+     * @param format Format of the tile data written to the metadata, e.g. "png"
+     * @throws std::runtime_error if the database could not be opened or initialized
+     */
+    MbtilesStore(const std::string &filepath, const std::string &name, const std::string &format);
+
+    /*!
+     * @brief Destructor commits all pending writes and closes the database
+     */
+    ~MbtilesStore();
+
+    MbtilesStore(const MbtilesStore &other) = delete;
+    MbtilesStore& operator=(const MbtilesStore &other) = delete;
+
+    /*!
+     * @brief Writes a tile, which replaces existing data for the same index. The write becomes persistent once the
+     * current batch is committed, but is visible to read() immediately.
+     * @param zoom_level Zoom level of the tile
+     * @param tx Tile index in x-direction (TMS)
+     * @param ty Tile index in y-direction (TMS)
+     * @param data Encoded tile data
+     */
+    void write(int zoom_level, int tx, int ty, const std::vector<uint8_t> &data);
+
+    /*!
+     * @brief Reads a tile
+     * @param zoom_level Zoom level of the tile
+     * @param tx Tile index in x-direction (TMS)
+     * @param ty Tile index in y-direction (TMS)
+     * @param data Output; Encoded tile data
+     * @return True if the tile exists
+     */
+    bool read(int zoom_level, int tx, int ty, std::vector<uint8_t> &data);
+
+    /*!
+     * @brief Commits all pending writes to disk
+     */
+    void commit();
+
+  private:
+
+    //! Path to the database file
+    std::string m_filepath;
+
+    //! Mutex for the database connection and the statements
+    std::mutex m_mutex_db;
+
+    //! Connection to the database
+    sqlite3* m_db;
+
+    //! Prepared statement to insert or replace a tile
+    sqlite3_stmt* m_stmt_write;
+
+    //! Prepared statement to select a tile
+    sqlite3_stmt* m_stmt_read;
+
+    //! Number of writes in the current transaction, 0 if no transaction is open
+    int m_nrof_pending;
+
+    /*!
+     * @brief Executes a statement without results
+     * @param sql Statement to execute
+     * @throws std::runtime_error if execution failed
+     */
+    void execute(const std::string &sql);
+
+    /*!
+     * @brief Commits the current transaction if one is open. Must be called with m_mutex_db locked.
+     */
+    void commitPending();
+};
+
+} // namespace io
+} // namespace realm
+
+#endif //PROJECT_MBTILES_STORE_H
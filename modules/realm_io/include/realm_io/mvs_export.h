@@ -13,6 +13,7 @@
 #include <opencv2/core.hpp>
 
 #include <realm_core/frame.h>
+#include <realm_core/thread_pool.h>
 
 
 // D E F I N E S ///////////////////////////////////////////////////
@@ -528,7 +529,19 @@ class MvsExport
 {
 public:
 
-  static void saveFrames(const std::vector<Frame::Ptr> &frames, const std::string &directory);
+  /*!
+   * @brief Saves frames as OpenMVS interface archive "data.mvs", together with their undistorted images. Poses and
+   * points are relative to the GNSS position of the first frame.
+   * @param frames Frames to be saved, all observed by the camera of the first frame
+   * @param directory Directory of the archive and the images
+   * @param thread_pool Shared thread pool to write the images on, can be nullptr
+   * @param nrof_threads Number of images written concurrently, <= 0 uses all available, 1 runs serially in the calling
+   *        thread
+   */
+  static void saveFrames(const std::vector<Frame::Ptr> &frames,
+                         const std::string &directory,
+                         const ThreadPool::Ptr &thread_pool = nullptr,
+                         int nrof_threads = 1);
 
 private:
 
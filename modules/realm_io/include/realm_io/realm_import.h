@@ -8,6 +8,7 @@
 
 #include <realm_core/cv_grid_map.h>
 #include <realm_core/camera_settings_factory.h>
+#include <realm_core/thread_pool.h>
 #include <realm_io/utilities.h>
 
 namespace realm
@@ -37,26 +38,39 @@ cv::Mat  loadGeoreferenceFromYaml(const std::string &filepath);
  *        Interface for directory + filename version
  * @param directory Directory if the file
  * @param filename Name of the file including suffix
+ * @param thread_pool Shared thread pool to parse chunks of large files on, can be nullptr
+ * @param nrof_threads Number of threads, <= 0 uses all available, 1 runs serially in the calling thread
  * @return Key/value pair with timestamp/3x4 pose
  */
 std::unordered_map<uint64_t, cv::Mat> loadTrajectoryFromTxtTUM(const std::string &directory,
-                                                               const std::string &filename);
+                                                               const std::string &filename,
+                                                               const ThreadPool::Ptr &thread_pool = nullptr,
+                                                               int nrof_threads = 1);
 
 /*!
  * @brief Function for loading trajectory file in TUM format. Is provided es key/value pair with timestamp/3x4 mat
- *        Interface for filepath one argument
- * @param directory Directory if the file
- * @param filename Name of the file including suffix
+ *        Interface for filepath one argument. The file is memory mapped and parsed in place, big files in parallel
+ *        chunks of lines. Blank lines and comments starting with '#' are skipped.
+ * @param filepath Absolute path to the file
+ * @param thread_pool Shared thread pool to parse chunks of large files on, can be nullptr
+ * @param nrof_threads Number of threads, <= 0 uses all available, 1 runs serially in the calling thread
  * @return Key/value pair with timestamp/3x4 pose
  */
-std::unordered_map<uint64_t, cv::Mat> loadTrajectoryFromTxtTUM(const std::string &filepath);
+std::unordered_map<uint64_t, cv::Mat> loadTrajectoryFromTxtTUM(const std::string &filepath,
+                                                               const ThreadPool::Ptr &thread_pool = nullptr,
+                                                               int nrof_threads = 1);
 
 /*!
- * @brief Function for loading of surface point cloud from simple txt file with x, y, z format
+ * @brief Function for loading of surface point cloud from simple txt file with x, y, z format. The file is memory
+ *        mapped and parsed like the trajectory, the result is allocated once.
  * @param filepath Absolute filepath of txt
+ * @param thread_pool Shared thread pool to parse chunks of large files on, can be nullptr
+ * @param nrof_threads Number of threads, <= 0 uses all available, 1 runs serially in the calling thread
  * @return Surface points as cv::Mat rowise x,y,z
  */
-cv::Mat loadSurfacePointsFromTxt(const std::string &filepath);
+cv::Mat loadSurfacePointsFromTxt(const std::string &filepath,
+                                 const ThreadPool::Ptr &thread_pool = nullptr,
+                                 int nrof_threads = 1);
 
 /*!
  * @brief
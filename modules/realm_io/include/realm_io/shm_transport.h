@@ -0,0 +1,248 @@
+
+
+#ifndef PROJECT_SHM_TRANSPORT_H
+#define PROJECT_SHM_TRANSPORT_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <opencv2/core.hpp>
+
+#include <realm_core/cv_grid_map.h>
+
+namespace realm
+{
+namespace io
+{
+
+/*!
+ * @brief Transport of images and grid maps to consumers on the same host through POSIX shared memory. The segment
+ * holds a ring of preallocated slots of fixed size. Publishing copies the data once into the next free slot and hands
+ * only a small handle to the notification function, e.g. a ROS publisher of the handle. Consumers open the segment
+ * with a ShmTransportReader and access the data through the handle, no serialisation is involved.
+ *
+ * Slots are overwritten in a round robin, so slow consumers may lose data. Every slot is guarded by a sequence number
+ * (seqlock), which lets readers detect that a slot was overwritten while they accessed it.
+ *
+ * Segment layout, all values in native byte order:
+ *  - Header: magic "REALMSHM", version, number of slots and data size of every slot
+ *  - Slots: slot header with sequence, meta data and layer table, followed by the layer data
+ */
+class ShmTransport
+{
+  public:
+    using Ptr = std::shared_ptr<ShmTransport>;
+    using ConstPtr = std::shared_ptr<const ShmTransport>;
+
+    //! Maximum number of layers of a grid map written into a single slot
+    static constexpr int kMaxLayers = 16;
+
+    //! Reference of a published message, which is passed to consumers instead of the data
+    struct Handle
+    {
+      uint32_t slot;
+      uint64_t sequence;
+    };
+
+    //! Called after the data was written into the segment, e.g. to publish the handle on the given topic
+    using NotifyFunc = std::function<void(const Handle &, const std::string &)>;
+
+    //! Entry of the layer table of a slot
+    struct LayerEntry
+    {
+      char name[64];
+      int32_t type;
+      int32_t interpolation;
+      int32_t rows;
+      int32_t cols;
+      uint64_t offset;
+    };
+
+    //! Header of a slot, followed by the layer data
+    struct SlotHeader
+    {
+      // Odd while the slot is written, otherwise the sequence of the handle of the data
+      std::atomic<uint64_t> sequence;
+
+      uint32_t nrof_layers;
+      uint8_t zone;
+      char band;
+      char topic[64];
+      double roi[4];
+      double resolution;
+      LayerEntry layers[kMaxLayers];
+    };
+
+    //! Header of the segment
+    struct SegmentHeader
+    {
+      char magic[8];
+      uint32_t version;
+      uint32_t nrof_slots;
+      uint64_t slot_size;
+    };
+
+  public:
+    /*!
+     * @brief Creates the shared memory segment and maps it. An existing segment of the same name, e.g. left over by a
+     * crashed process, is reinitialized.
+     * @param name Name of the segment, e.g. "realm_mosaicing". Is prefixed with "/" if necessary.
+     * @param nrof_slots Number of slots of the ring, limits how many messages consumers may fall behind
+     * @param slot_size Size of the data of a single slot in bytes, must hold the largest published message
+     */
+    ShmTransport(const std::string &name, uint32_t nrof_slots, size_t slot_size);
+
+    /*!
+     * @brief Destructor unmaps and removes the segment. Readers that mapped it before keep their mapping.
+     */
+    ~ShmTransport();
+
+    ShmTransport(const ShmTransport &) = delete;
+    ShmTransport& operator=(const ShmTransport &) = delete;
+
+    /*!
+     * @brief Writes an image into the next slot as single layer named "image"
+     * @param img Image to be written
+     * @param topic Description of the data, e.g. "output/rgb"
+     * @param handle Handle of the written data
+     * @return False, if the image does not fit into a slot
+     */
+    bool write(const cv::Mat &img, const std::string &topic, Handle &handle);
+
+    /*!
+     * @brief Writes a grid map with all its layers into the next slot
+     * @param map Grid map to be written
+     * @param zone UTM zone of the map
+     * @param band UTM band of the map
+     * @param topic Description of the data, e.g. "output/update/ortho"
+     * @param handle Handle of the written data
+     * @return False, if the map does not fit into a slot or has too many layers
+     */
+    bool write(const CvGridMap &map, uint8_t zone, char band, const std::string &topic, Handle &handle);
+
+    /*!
+     * @brief Creates a transport function for StageBase::registerImageTransport, which writes images into the segment
+     * and passes the handles on. The transport function must not be used after this object was destroyed.
+     * @param notify Function receiving the handles of the written images
+     * @return Transport function
+     */
+    std::function<void(const cv::Mat &, const std::string &)> createImageTransport(const NotifyFunc &notify);
+
+    /*!
+     * @brief Creates a transport function for StageBase::registerCvGridMapTransport, which writes grid maps into the
+     * segment and passes the handles on. The transport function must not be used after this object was destroyed.
+     * @param notify Function receiving the handles of the written grid maps
+     * @return Transport function
+     */
+    std::function<void(const CvGridMap &, uint8_t, char, const std::string &)> createCvGridMapTransport(const NotifyFunc &notify);
+
+    /*!
+     * @brief Getter for the name of the segment, which is passed to ShmTransportReader
+     * @return Name of the segment
+     */
+    std::string getName() const;
+
+  private:
+
+    std::string m_name;
+
+    //! Start of the mapping and its size in bytes
+    void* m_data;
+    size_t m_size_bytes;
+
+    uint32_t m_nrof_slots;
+    size_t m_slot_size;
+
+    //! Writes from different stages are serialized
+    std::mutex m_mutex_write;
+    uint64_t m_nrof_written;
+
+    /*!
+     * @brief Writes layers into the next slot
+     * @param layers Layers of the message
+     * @param roi Region of interest of the message, empty for images
+     * @param resolution Resolution of the message, 0 for images
+     * @param zone UTM zone of the message
+     * @param band UTM band of the message
+     * @param topic Description of the data
+     * @param handle Handle of the written data
+     * @return False, if the layers do not fit into a slot
+     */
+    bool writeLayers(const std::vector<CvGridMap::Layer> &layers, const cv::Rect2d &roi, double resolution,
+                     uint8_t zone, char band, const std::string &topic, Handle &handle);
+};
+
+/*!
+ * @brief Consumer side of a ShmTransport, usually living in another process. Data is accessed through the handles
+ * passed on by the notification function of the transport.
+ */
+class ShmTransportReader
+{
+  public:
+    using Ptr = std::shared_ptr<ShmTransportReader>;
+    using ConstPtr = std::shared_ptr<const ShmTransportReader>;
+
+  public:
+    /*!
+     * @brief Opens and maps an existing segment read-only
+     * @param name Name of the segment as passed to the ShmTransport
+     */
+    explicit ShmTransportReader(const std::string &name);
+
+    /*!
+     * @brief Destructor unmaps the segment. Views must not be used afterwards.
+     */
+    ~ShmTransportReader();
+
+    ShmTransportReader(const ShmTransportReader &) = delete;
+    ShmTransportReader& operator=(const ShmTransportReader &) = delete;
+
+    /*!
+     * @brief Reads an image written by ShmTransport::write
+     * @param handle Handle of the image
+     * @param img Read image
+     * @param do_copy Flag to copy the image. Otherwise the image is a view into the segment, which may be overwritten
+     * any time. Use isValid() after processing the view to check if its data was still intact.
+     * @return False, if the slot was already overwritten
+     */
+    bool read(const ShmTransport::Handle &handle, cv::Mat &img, bool do_copy = true) const;
+
+    /*!
+     * @brief Reads a grid map written by ShmTransport::write
+     * @param handle Handle of the grid map
+     * @param map Read grid map
+     * @param zone UTM zone of the map
+     * @param band UTM band of the map
+     * @param do_copy Flag to copy the layers. Otherwise the layers are views into the segment, which may be overwritten
+     * any time. Use isValid() after processing the views to check if their data was still intact.
+     * @return False, if the slot was already overwritten
+     */
+    bool read(const ShmTransport::Handle &handle, CvGridMap &map, uint8_t &zone, char &band, bool do_copy = true) const;
+
+    /*!
+     * @brief Checks if the data of a handle is still in the segment
+     * @param handle Handle of the data
+     * @return True, if the slot was not overwritten since the data was written
+     */
+    bool isValid(const ShmTransport::Handle &handle) const;
+
+  private:
+
+    //! Start of the mapping and its size in bytes
+    void* m_data;
+    size_t m_size_bytes;
+
+    uint32_t m_nrof_slots;
+    size_t m_slot_size;
+
+    const ShmTransport::SlotHeader* getSlot(const ShmTransport::Handle &handle) const;
+};
+
+} // namespace io
+} // namespace realm
+
+#endif //PROJECT_SHM_TRANSPORT_H
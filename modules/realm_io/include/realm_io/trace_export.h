@@ -0,0 +1,65 @@
+
+
+#ifndef PROJECT_TRACE_EXPORT_H
+#define PROJECT_TRACE_EXPORT_H
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <realm_core/frame.h>
+#include <realm_core/structs.h>
+
+namespace realm
+{
+namespace io
+{
+
+/*!
+ * @brief Collects the traces of frames passing through the pipeline and writes them in the Chrome trace event format,
+ * which can be opened with chrome://tracing or Perfetto. Every stage is shown as a separate track with one slice for
+ * the time a frame waited in the queue and one for its processing. Flow arrows connect the stages of a frame, so the
+ * critical path of single frames can be followed. The exporter is meant to be shared by all stages of a pipeline.
+ */
+class TraceExporter
+{
+  public:
+    using Ptr = std::shared_ptr<TraceExporter>;
+    using ConstPtr = std::shared_ptr<const TraceExporter>;
+
+  public:
+    /*!
+     * @brief Adds or updates the trace of a frame. Traces of the same frame are replaced, because later stages extend
+     * the trace of the earlier ones.
+     * @param frame Frame with recorded trace events
+     */
+    void add(const Frame::Ptr &frame);
+
+    /*!
+     * @brief Adds or updates the trace of a frame
+     * @param frame_id Id of the frame
+     * @param trace Records of all stages the frame has passed
+     */
+    void add(uint32_t frame_id, const std::vector<StageTrace> &trace);
+
+    /*!
+     * @brief Writes all collected traces to disk
+     * @param filepath Absolute path of the file, typically with .json suffix
+     */
+    void save(const std::string &filepath) const;
+
+  private:
+
+    //! Mutex for the traces, frames are added from all stage threads
+    mutable std::mutex m_mutex_traces;
+
+    //! Traces of all frames, sorted by their id
+    std::map<uint32_t, std::vector<StageTrace>> m_traces;
+};
+
+} // namespace io
+} // namespace realm
+
+#endif //PROJECT_TRACE_EXPORT_H
@@ -0,0 +1,61 @@
+
+
+#include <cstdio>
+#include <stdexcept>
+
+#include <realm_io/checkpoint_store.h>
+#include <realm_io/utilities.h>
+
+using namespace realm;
+
+io::CheckpointStore::CheckpointStore(const std::string &directory)
+ : m_directory(directory)
+{
+  if (m_directory.empty())
+    throw(std::invalid_argument("Error creating checkpoint store: Directory is empty!"));
+  if (!io::dirExists(m_directory))
+    io::createDir(m_directory);
+}
+
+bool io::CheckpointStore::write(const std::string &name, const WriteFunc &write) const
+{
+  std::string filepath = getFilepath(name);
+  // Prefixed instead of suffixed, so writers checking the file extension accept the temporary file
+  std::string filepath_tmp = getFilepath("tmp_" + name);
+
+  // Leftover of a write interrupted by a crash
+  if (io::fileExists(filepath_tmp))
+    io::removeFileOrDirectory(filepath_tmp);
+
+  write(filepath_tmp);
+  if (!io::fileExists(filepath_tmp))
+    return false;
+
+  if (std::rename(filepath_tmp.c_str(), filepath.c_str()) != 0)
+  {
+    io::removeFileOrDirectory(filepath_tmp);
+    throw(std::runtime_error("Error writing checkpoint: Could not replace '" + filepath + "'!"));
+  }
+  return true;
+}
+
+bool io::CheckpointStore::exists(const std::string &name) const
+{
+  return io::fileExists(getFilepath(name));
+}
+
+void io::CheckpointStore::remove(const std::string &name) const
+{
+  if (exists(name))
+    io::removeFileOrDirectory(getFilepath(name));
+}
+
+std::string io::CheckpointStore::getFilepath(const std::string &name) const
+{
+  return m_directory + "/" + name;
+}
+
+std::string io::CheckpointStore::getDirectory() const
+{
+  return m_directory;
+}
@@ -4,6 +4,8 @@
 
 #include <fstream>
 
+#include <opencv2/imgproc.hpp>
+
 namespace realm
 {
 namespace io
@@ -87,6 +89,34 @@ void saveImage(const cv::Mat &img, const std::string &filename)
     throw(std::invalid_argument("Error writing image: Unknown suffix"));
 }
 
+bool encodeImageCompressed(const cv::Mat &img, double scale, int quality, std::vector<uint8_t> &data, std::string &format)
+{
+  if (scale <= 0.0 || scale > 1.0)
+    throw(std::invalid_argument("Error encoding image: Scale must be in range (0, 1]"));
+
+  int depth = img.depth();
+  if (img.empty() || (depth != CV_8U && depth != CV_16U) || img.channels() > 4 || img.channels() == 2)
+    return false;
+
+  // Downscaling before encoding saves bandwidth and encoding time at once
+  cv::Mat img_scaled;
+  if (scale < 1.0)
+    cv::resize(img, img_scaled, cv::Size(), scale, scale, cv::INTER_AREA);
+  else
+    img_scaled = img;
+
+  if (depth == CV_8U)
+  {
+    if (img_scaled.channels() == 4)
+      cv::cvtColor(img_scaled, img_scaled, cv::COLOR_BGRA2BGR);
+    format = "jpeg";
+    return cv::imencode(".jpg", img_scaled, data, {cv::IMWRITE_JPEG_QUALITY, quality});
+  }
+
+  format = "png";
+  return cv::imencode(".png", img_scaled, data);
+}
+
 void saveImageToBinary(const cv::Mat &data, const std::string &filepath)
 {
   int elem_size_in_bytes = (int)data.elemSize();
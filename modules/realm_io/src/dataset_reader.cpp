@@ -0,0 +1,121 @@
+
+
+#include <algorithm>
+#include <mutex>
+#include <numeric>
+
+#include <realm_core/loguru.h>
+#include <realm_io/dataset_reader.h>
+
+using namespace realm;
+
+namespace
+{
+
+// The XMP toolkit of Exiv2 is not thread safe by itself, it has to be initialized with a lock for concurrent reads
+std::mutex g_mutex_xmp;
+
+void lockXmp(void* /*data*/, bool do_lock)
+{
+  if (do_lock)
+    g_mutex_xmp.lock();
+  else
+    g_mutex_xmp.unlock();
+}
+
+} // namespace
+
+io::Exiv2DatasetReader::Exiv2DatasetReader(const std::vector<std::string> &filepaths,
+                                           const std::string &camera_id,
+                                           const camera::Pinhole::Ptr &cam,
+                                           const Exiv2FrameReader::FrameTags &tags,
+                                           int nrof_threads,
+                                           size_t nrof_prefetch)
+    : m_camera_id(camera_id),
+      m_cam(cam),
+      m_reader(tags),
+      m_nrof_prefetch(std::max(nrof_prefetch, static_cast<size_t>(1))),
+      m_idx_next_load(0),
+      m_pool(std::make_shared<ThreadPool>(nrof_threads))
+{
+  Exiv2::XmpParser::initialize(lockXmp, nullptr);
+
+  // Only the tags are read to sort the dataset, which is much cheaper than decoding the images
+  std::vector<uint64_t> timestamps(filepaths.size(), 0);
+  std::vector<uint8_t> has_timestamp(filepaths.size(), 0);
+  m_pool->parallelFor(cv::Range(0, static_cast<int>(filepaths.size())), [&](const cv::Range &range)
+  {
+    for (int i = range.start; i < range.end; ++i)
+      has_timestamp[i] = m_reader.loadTimestampFromExiv2(filepaths[i], &timestamps[i]);
+  });
+
+  std::vector<size_t> order(filepaths.size());
+  std::iota(order.begin(), order.end(), 0);
+
+  // Frames without timestamp are stamped with the time of loading, so the order of the files is the only one known
+  if (std::all_of(has_timestamp.begin(), has_timestamp.end(), [](uint8_t val){ return val > 0; }))
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b){ return timestamps[a] < timestamps[b]; });
+  else
+    LOG_F(WARNING, "Not all images of the dataset have a timestamp. Frames are read in the order of the files.");
+
+  m_filepaths.reserve(filepaths.size());
+  for (size_t idx : order)
+    m_filepaths.push_back(filepaths[idx]);
+
+  prefetch();
+}
+
+io::Exiv2DatasetReader::~Exiv2DatasetReader()
+{
+  // Workers reference the reader, so they have to be finished before it is destroyed
+  for (auto &pending : m_pending)
+    if (pending.future.valid())
+      pending.future.wait();
+}
+
+Frame::Ptr io::Exiv2DatasetReader::next()
+{
+  if (m_pending.empty())
+    return nullptr;
+
+  PendingFrame pending = std::move(m_pending.front());
+  m_pending.pop_front();
+
+  // Slot of the returned frame is free again, so the next one is loaded while the caller processes this one
+  prefetch();
+
+  pending.future.get();
+  return *pending.frame;
+}
+
+bool io::Exiv2DatasetReader::hasNext() const
+{
+  return !m_pending.empty();
+}
+
+size_t io::Exiv2DatasetReader::size() const
+{
+  return m_filepaths.size();
+}
+
+std::vector<std::string> io::Exiv2DatasetReader::getFilepaths() const
+{
+  return m_filepaths;
+}
+
+void io::Exiv2DatasetReader::prefetch()
+{
+  while (m_pending.size() < m_nrof_prefetch && m_idx_next_load < m_filepaths.size())
+  {
+    PendingFrame pending;
+    pending.frame = std::make_shared<Frame::Ptr>(nullptr);
+
+    std::shared_ptr<Frame::Ptr> frame = pending.frame;
+    const std::string &filepath = m_filepaths[m_idx_next_load++];
+    pending.future = m_pool->submit([this, frame, filepath]
+    {
+      *frame = m_reader.loadFrameFromExiv2(m_camera_id, m_cam, filepath);
+    });
+    m_pending.push_back(std::move(pending));
+  }
+}
@@ -16,7 +16,7 @@ void saveExifImage(const Frame::Ptr &frame,
   std::string filename = io::createFilename(directory + "/" + name + "_", id, ".jpg");
   if (use_resized)
     saveExifImage(frame->getTimestamp(),
-                  frame->getResizedImageRaw(),
+                  frame->getResizedImageRawView(),
                   frame->getResizedCamera(),
                   frame->getGnssUtm(),
                   frame->getCameraId(),
@@ -78,21 +78,17 @@ void saveExifImage(uint64_t timestamp,
     exiv2_file->setXmpData(meta.xmp_data);
     exiv2_file->writeMetadata();
 
-    // Workaround for writing exif tags to image. File must be created before opening with exif API
-    FILE * file1 = ::fopen(filename.c_str(),"w");
-    if (file1 != nullptr)
-      ::fclose(file1);
-    else
+    // Image and tags are assembled in memory, so the file is written once without reopening it through the exif API
+    Exiv2::BasicIo &io = exiv2_file->io();
+    FILE* file = ::fopen(filename.c_str(), "wb");
+    if (file == nullptr)
       throw(std::runtime_error("Error creating exif file: Opening '" + filename + "' failed!"));
 
-    Exiv2::FileIo file(filename);
-    if (!file.open())
-    {
-      file.write(exiv2_file->io());
-      file.close();
-    }
-    else
-      throw(std::runtime_error("Error creating exif file: Opening '" + filename + "' failed!"));
+    size_t size = static_cast<size_t>(io.size());
+    size_t size_written = ::fwrite(io.mmap(), 1, size, file);
+    io.munmap();
+    if (::fclose(file) != 0 || size_written != size)
+      throw(std::runtime_error("Error creating exif file: Writing '" + filename + "' failed!"));
   }
   else
     throw(std::runtime_error("Error creating exif image data: Opening failed!"));
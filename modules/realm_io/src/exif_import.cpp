@@ -1,5 +1,9 @@
 
 
+#include <fstream>
+#include <iterator>
+#include <vector>
+
 #include <realm_io/exif_import.h>
 #include <realm_core/timer.h>
 
@@ -55,8 +59,13 @@ Frame::Ptr io::Exiv2FrameReader::loadFrameFromExiv2(const std::string &camera_id
     Exiv2::ExifData &exif_data = exif_img->exifData();
     Exiv2::XmpData &xmp_data = exif_img->xmpData();
 
-    // Read image data
-    cv::Mat img = cv::imread(filepath, cv::IMREAD_COLOR);
+    // Read image data, it is decoded into a buffer of the frame pool to recycle the memory of retired frames
+    std::ifstream file(filepath, std::ios::binary);
+    std::vector<uchar> buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    cv::Mat img;
+    img.allocator = Frame::getImagePool();
+    if (!buffer.empty())
+      cv::imdecode(buffer, cv::IMREAD_COLOR, &img);
 
     /*========== ESSENTIAL KEYS ==========*/
     uint32_t frame_id = io::extractFrameIdFromFilepath(filepath);
@@ -96,6 +105,16 @@ Frame::Ptr io::Exiv2FrameReader::loadFrameFromExiv2(const std::string &camera_id
   return nullptr;
 }
 
+bool io::Exiv2FrameReader::loadTimestampFromExiv2(const std::string &filepath, uint64_t* timestamp)
+{
+  Exiv2ImagePointer exif_img = Exiv2::ImageFactory::open(filepath);
+  if (!exif_img.get())
+    return false;
+
+  exif_img->readMetadata();
+  return readMetaTagTimestamp(exif_img->exifData(), exif_img->xmpData(), timestamp);
+}
+
 bool io::Exiv2FrameReader::readMetaTagCameraId(Exiv2::ExifData &exif_data, Exiv2::XmpData &xmp_data, std::string* camera_id)
 {
   if (isXmpTag(m_frame_tags.camera_id))
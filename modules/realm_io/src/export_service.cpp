@@ -0,0 +1,111 @@
+
+
+#include <algorithm>
+#include <exception>
+
+#include <realm_core/loguru.h>
+#include <realm_io/export_service.h>
+
+using namespace realm;
+
+io::ExportService::ExportService(int nrof_threads, size_t queue_size, bool do_drop_when_full)
+    : m_stop_requested(false),
+      m_queue_size(std::max(queue_size, static_cast<size_t>(1))),
+      m_do_drop_when_full(do_drop_when_full),
+      m_nrof_running(0),
+      m_nrof_dropped(0)
+{
+  nrof_threads = std::max(nrof_threads, 1);
+  for (int i = 0; i < nrof_threads; ++i)
+    m_threads.emplace_back(&ExportService::run, this);
+}
+
+io::ExportService::~ExportService()
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex_jobs);
+    m_stop_requested = true;
+  }
+  m_condition_jobs.notify_all();
+
+  for (auto &thread : m_threads)
+    thread.join();
+}
+
+bool io::ExportService::submit(const std::string &name, const Job &job)
+{
+  bool is_dropped = false;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex_jobs);
+    if (m_jobs.size() >= m_queue_size)
+    {
+      if (m_do_drop_when_full)
+      {
+        LOG_F(WARNING, "Export queue is full, dropping job '%s'.", m_jobs.front().first.c_str());
+        m_jobs.pop_front();
+        m_nrof_dropped++;
+        is_dropped = true;
+      }
+      else
+        m_condition_finished.wait(lock, [&]{ return m_jobs.size() < m_queue_size; });
+    }
+    m_jobs.emplace_back(name, job);
+  }
+  m_condition_jobs.notify_one();
+  return !is_dropped;
+}
+
+void io::ExportService::flush()
+{
+  std::unique_lock<std::mutex> lock(m_mutex_jobs);
+  m_condition_finished.wait(lock, [&]{ return m_jobs.empty() && m_nrof_running == 0; });
+}
+
+size_t io::ExportService::getNrofPending() const
+{
+  std::unique_lock<std::mutex> lock(m_mutex_jobs);
+  return m_jobs.size() + m_nrof_running;
+}
+
+size_t io::ExportService::getNrofDropped() const
+{
+  std::unique_lock<std::mutex> lock(m_mutex_jobs);
+  return m_nrof_dropped;
+}
+
+void io::ExportService::run()
+{
+  while (true)
+  {
+    std::pair<std::string, Job> job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex_jobs);
+      m_condition_jobs.wait(lock, [&]{ return m_stop_requested || !m_jobs.empty(); });
+      if (m_jobs.empty())
+        break;
+      job = std::move(m_jobs.front());
+      m_jobs.pop_front();
+      m_nrof_running++;
+    }
+
+    // A failing export must not take down the pipeline, so errors are only logged
+    try
+    {
+      job.second();
+    }
+    catch (const std::exception &e)
+    {
+      LOG_F(ERROR, "Export job '%s' failed: %s", job.first.c_str(), e.what());
+    }
+    catch (...)
+    {
+      LOG_F(ERROR, "Export job '%s' failed with unknown error.", job.first.c_str());
+    }
+
+    {
+      std::unique_lock<std::mutex> lock(m_mutex_jobs);
+      m_nrof_running--;
+    }
+    m_condition_finished.notify_all();
+  }
+}
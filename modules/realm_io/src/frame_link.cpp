@@ -0,0 +1,412 @@
+
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <realm_core/loguru.h>
+#include <realm_io/frame_link.h>
+
+using namespace realm;
+
+namespace
+{
+
+const char g_magic[8] = {'R', 'E', 'A', 'L', 'M', 'L', 'N', 'K'};
+const uint32_t g_version = 1;
+
+//! Topics are short descriptions, anything longer hints at a corrupted stream
+const uint32_t g_max_topic_size = 1024;
+
+//! Time between two attempts to connect to the receiver in [ms]
+const int64_t g_reconnect_interval = 1000;
+
+struct MessageHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t topic_size;
+  uint64_t payload_size;
+};
+
+bool sendAll(int socket, const char* data, size_t size)
+{
+  while (size > 0)
+  {
+    // No SIGPIPE if the receiver closed the connection, the error is handled by reconnecting
+    ssize_t n = ::send(socket, data, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    data += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+bool receiveAll(int socket, char* data, size_t size)
+{
+  while (size > 0)
+  {
+    ssize_t n = ::recv(socket, data, size, 0);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    data += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+} // namespace
+
+io::FrameLinkSender::FrameLinkSender(const std::string &host,
+                                     uint16_t port,
+                                     size_t queue_size,
+                                     FrameImageCompression compression,
+                                     int quality)
+ : m_host(host),
+   m_port(port),
+   m_queue_size(std::max(queue_size, (size_t)1)),
+   m_compression(compression),
+   m_quality(quality),
+   m_stop_requested(false),
+   m_socket(-1),
+   m_is_sending(false),
+   m_nrof_sent(0),
+   m_nrof_dropped(0)
+{
+  if (m_host.empty())
+    throw(std::invalid_argument("Error creating frame link: Host is empty!"));
+  if (m_quality < 0 || m_quality > 100)
+    throw(std::invalid_argument("Error creating frame link: Quality must be in range [0, 100]!"));
+
+  m_thread = std::thread(&FrameLinkSender::run, this);
+}
+
+io::FrameLinkSender::~FrameLinkSender()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop_requested = true;
+
+    // Unblocks the worker if it is currently sending
+    if (m_socket >= 0)
+      shutdown(m_socket, SHUT_RDWR);
+  }
+  m_condition_messages.notify_all();
+  m_thread.join();
+
+  if (m_socket >= 0)
+    close(m_socket);
+}
+
+bool io::FrameLinkSender::send(const Frame::Ptr &frame, const std::string &topic)
+{
+  std::ostringstream payload_stream(std::ios::binary);
+  serializeFrame(payload_stream, frame, m_compression, m_quality);
+  std::string payload = payload_stream.str();
+
+  MessageHeader header{};
+  std::memcpy(header.magic, g_magic, sizeof(g_magic));
+  header.version = g_version;
+  header.topic_size = static_cast<uint32_t>(topic.size());
+  header.payload_size = payload.size();
+
+  std::string message;
+  message.reserve(sizeof(MessageHeader) + topic.size() + payload.size());
+  message.append(reinterpret_cast<const char*>(&header), sizeof(MessageHeader));
+  message.append(topic);
+  message.append(payload);
+
+  bool is_dropped = false;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_messages.size() >= m_queue_size)
+    {
+      m_messages.pop_front();
+      m_nrof_dropped++;
+      is_dropped = true;
+    }
+    m_messages.push_back(std::move(message));
+  }
+  m_condition_messages.notify_one();
+
+  LOG_IF_F(WARNING, is_dropped, "Frame link to %s:%i can not keep up, dropped the oldest message.", m_host.c_str(), m_port);
+  return !is_dropped;
+}
+
+std::function<void(const Frame::Ptr &, const std::string &)> io::FrameLinkSender::createFrameTransport()
+{
+  return [this](const Frame::Ptr &frame, const std::string &topic)
+  {
+    send(frame, topic);
+  };
+}
+
+bool io::FrameLinkSender::flush(int64_t timeout)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  return m_condition_sent.wait_for(lock, std::chrono::milliseconds(timeout), [this]()
+  {
+    return m_messages.empty() && !m_is_sending;
+  });
+}
+
+bool io::FrameLinkSender::isConnected() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_socket >= 0;
+}
+
+size_t io::FrameLinkSender::getNrofSent() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_nrof_sent;
+}
+
+size_t io::FrameLinkSender::getNrofDropped() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_nrof_dropped;
+}
+
+void io::FrameLinkSender::run()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_stop_requested)
+  {
+    if (m_socket < 0)
+    {
+      // Connecting blocks for up to the reconnect interval, which must not hold back the stages queueing messages
+      lock.unlock();
+      int socket = connectToReceiver();
+      lock.lock();
+
+      if (socket >= 0 && m_stop_requested)
+        close(socket);
+      else if (socket >= 0)
+      {
+        m_socket = socket;
+        LOG_F(INFO, "Frame link connected to %s:%i.", m_host.c_str(), m_port);
+      }
+      else
+        m_condition_messages.wait_for(lock, std::chrono::milliseconds(g_reconnect_interval), [this](){ return m_stop_requested; });
+      continue;
+    }
+
+    m_condition_messages.wait(lock, [this](){ return m_stop_requested || !m_messages.empty(); });
+    if (m_stop_requested)
+      break;
+
+    std::string message = std::move(m_messages.front());
+    m_messages.pop_front();
+    m_is_sending = true;
+    int socket = m_socket;
+
+    lock.unlock();
+    bool is_sent = sendAll(socket, message.data(), message.size());
+    lock.lock();
+
+    m_is_sending = false;
+    if (is_sent)
+      m_nrof_sent++;
+    else
+    {
+      LOG_IF_F(WARNING, !m_stop_requested, "Frame link to %s:%i broke, reconnecting.", m_host.c_str(), m_port);
+      close(m_socket);
+      m_socket = -1;
+
+      // The receiver drops incomplete messages, so it is sent again once reconnected, unless newer ones replaced it
+      if (m_messages.size() < m_queue_size)
+        m_messages.push_front(std::move(message));
+      else
+        m_nrof_dropped++;
+    }
+    m_condition_sent.notify_all();
+  }
+}
+
+int io::FrameLinkSender::connectToReceiver() const
+{
+  addrinfo hints{};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+
+  addrinfo* result = nullptr;
+  if (getaddrinfo(m_host.c_str(), std::to_string(m_port).c_str(), &hints, &result) != 0 || result == nullptr)
+    return -1;
+
+  int socket = ::socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+  if (socket < 0)
+  {
+    freeaddrinfo(result);
+    return -1;
+  }
+
+  // On Linux the send timeout also limits connecting, so an unreachable receiver does not block for minutes
+  timeval timeout{g_reconnect_interval / 1000, (g_reconnect_interval % 1000) * 1000};
+  setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  bool is_connected = (::connect(socket, result->ai_addr, result->ai_addrlen) == 0);
+  freeaddrinfo(result);
+  if (!is_connected)
+  {
+    close(socket);
+    return -1;
+  }
+
+  // Sending itself must not time out, large frames on a slow link can take longer than the interval
+  timeval no_timeout{0, 0};
+  setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, &no_timeout, sizeof(no_timeout));
+
+  // Messages are written at once, so there is nothing to gain from delaying the last segment
+  int flag = 1;
+  setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+  return socket;
+}
+
+io::FrameLinkReceiver::FrameLinkReceiver(uint16_t port, const ReceiveFunc &receive)
+ : m_receive(receive),
+   m_port(port),
+   m_stop_requested(false),
+   m_nrof_received(0),
+   m_socket_listen(-1),
+   m_socket(-1)
+{
+  if (!m_receive)
+    throw(std::invalid_argument("Error creating frame link: Receive function is not set!"));
+
+  m_socket_listen = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (m_socket_listen < 0)
+    throw(std::runtime_error("Error creating frame link: Socket could not be created!"));
+
+  // Restarting the receiver must not fail because the port of the last run is still in TIME_WAIT
+  int flag = 1;
+  setsockopt(m_socket_listen, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+
+  socklen_t address_size = sizeof(address);
+  if (bind(m_socket_listen, reinterpret_cast<sockaddr*>(&address), address_size) != 0
+      || listen(m_socket_listen, 1) != 0
+      || getsockname(m_socket_listen, reinterpret_cast<sockaddr*>(&address), &address_size) != 0)
+  {
+    close(m_socket_listen);
+    throw(std::runtime_error("Error creating frame link: Port " + std::to_string(port) + " could not be opened!"));
+  }
+  m_port = ntohs(address.sin_port);
+
+  m_thread = std::thread(&FrameLinkReceiver::run, this);
+}
+
+io::FrameLinkReceiver::~FrameLinkReceiver()
+{
+  m_stop_requested = true;
+
+  // Shutting the sockets down unblocks the receiving thread in accept or recv
+  shutdown(m_socket_listen, SHUT_RDWR);
+  {
+    std::lock_guard<std::mutex> lock(m_mutex_socket);
+    if (m_socket >= 0)
+      shutdown(m_socket, SHUT_RDWR);
+  }
+  m_thread.join();
+
+  close(m_socket_listen);
+}
+
+uint16_t io::FrameLinkReceiver::getPort() const
+{
+  return m_port;
+}
+
+size_t io::FrameLinkReceiver::getNrofReceived() const
+{
+  return m_nrof_received;
+}
+
+void io::FrameLinkReceiver::run()
+{
+  while (!m_stop_requested)
+  {
+    int socket = accept(m_socket_listen, nullptr, nullptr);
+    if (socket < 0)
+    {
+      if (errno != EINTR && !m_stop_requested)
+      {
+        LOG_F(ERROR, "Frame link on port %i stopped accepting connections: %s", m_port, std::strerror(errno));
+        break;
+      }
+      continue;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex_socket);
+      if (m_stop_requested)
+      {
+        close(socket);
+        break;
+      }
+      m_socket = socket;
+    }
+
+    LOG_F(INFO, "Frame link on port %i connected.", m_port);
+    receiveFrom(socket);
+    LOG_IF_F(INFO, !m_stop_requested, "Frame link on port %i disconnected.", m_port);
+
+    std::lock_guard<std::mutex> lock(m_mutex_socket);
+    close(m_socket);
+    m_socket = -1;
+  }
+}
+
+void io::FrameLinkReceiver::receiveFrom(int socket)
+{
+  while (!m_stop_requested)
+  {
+    MessageHeader header{};
+    if (!receiveAll(socket, reinterpret_cast<char*>(&header), sizeof(MessageHeader)))
+      return;
+
+    if (std::memcmp(header.magic, g_magic, sizeof(g_magic)) != 0 || header.version != g_version
+        || header.topic_size > g_max_topic_size)
+    {
+      LOG_F(ERROR, "Frame link on port %i received an invalid message or one of an unsupported version.", m_port);
+      return;
+    }
+
+    std::string topic(header.topic_size, '\0');
+    std::string payload(header.payload_size, '\0');
+    if (!receiveAll(socket, &topic[0], topic.size()) || !receiveAll(socket, &payload[0], payload.size()))
+      return;
+
+    // A frame that can not be restored or processed is dropped, the following messages are still intact
+    try
+    {
+      std::istringstream payload_stream(payload, std::ios::binary);
+      Frame::Ptr frame = deserializeFrame(payload_stream);
+      m_nrof_received++;
+      m_receive(frame, topic);
+    }
+    catch (const std::exception &e)
+    {
+      LOG_F(ERROR, "Frame link on port %i dropped a frame on '%s': %s", m_port, topic.c_str(), e.what());
+    }
+  }
+}
@@ -0,0 +1,412 @@
+
+
+#include <cstring>
+#include <stdexcept>
+
+#include <opencv2/imgcodecs.hpp>
+
+#include <realm_io/frame_snapshot.h>
+
+using namespace realm;
+
+namespace
+{
+
+// Files start with the magic number followed by the format version. Increase the version if the layout changes.
+const char g_magic[8] = {'R', 'E', 'A', 'L', 'M', 'F', 'R', 'M'};
+const uint32_t g_version = 1;
+
+enum SnapshotFlags : uint32_t
+{
+  IS_KEYFRAME       = 1 << 0,
+  HAS_ACCURATE_POSE = 1 << 1,
+  IS_GEOREFERENCED  = 1 << 2,
+  IS_RESIZE_SET     = 1 << 3,
+  HAS_SPARSE_CLOUD  = 1 << 4,
+  HAS_DEPTHMAP      = 1 << 5,
+  HAS_SURFACE_MODEL = 1 << 6,
+  HAS_ORTHOPHOTO    = 1 << 7,
+  IS_IMAGE_ENCODED  = 1 << 8
+};
+
+template <typename T>
+void writeValue(std::ostream &out, const T &value)
+{
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+T readValue(std::istream &in)
+{
+  T value;
+  if (!in.read(reinterpret_cast<char*>(&value), sizeof(T)))
+    throw(std::runtime_error("Error reading frame snapshot: Unexpected end of file!"));
+  return value;
+}
+
+template <typename T>
+void writeVector(std::ostream &out, const std::vector<T> &data)
+{
+  writeValue<uint64_t>(out, data.size());
+  if (!data.empty())
+    out.write(reinterpret_cast<const char*>(data.data()), data.size()*sizeof(T));
+}
+
+template <typename T>
+std::vector<T> readVector(std::istream &in)
+{
+  std::vector<T> data(readValue<uint64_t>(in));
+  if (!data.empty() && !in.read(reinterpret_cast<char*>(data.data()), data.size()*sizeof(T)))
+    throw(std::runtime_error("Error reading frame snapshot: Unexpected end of file!"));
+  return data;
+}
+
+void writeString(std::ostream &out, const std::string &str)
+{
+  writeValue<uint32_t>(out, static_cast<uint32_t>(str.size()));
+  out.write(str.data(), str.size());
+}
+
+std::string readString(std::istream &in)
+{
+  std::string str(readValue<uint32_t>(in), '\0');
+  if (!str.empty() && !in.read(&str[0], str.size()))
+    throw(std::runtime_error("Error reading frame snapshot: Unexpected end of file!"));
+  return str;
+}
+
+void writeMat(std::ostream &out, const cv::Mat &mat)
+{
+  writeValue<int32_t>(out, mat.rows);
+  writeValue<int32_t>(out, mat.cols);
+  writeValue<int32_t>(out, mat.type());
+
+  // Operating rowise, so even non-continuous matrices are properly written to binary
+  size_t row_size = mat.cols*mat.elemSize();
+  for (int r = 0; r < mat.rows; ++r)
+    out.write(mat.ptr<char>(r), row_size);
+}
+
+cv::Mat readMat(std::istream &in, MatPool* pool = nullptr)
+{
+  auto rows = readValue<int32_t>(in);
+  auto cols = readValue<int32_t>(in);
+  auto type = readValue<int32_t>(in);
+  if (rows == 0 || cols == 0)
+    return cv::Mat();
+
+  cv::Mat mat = (pool ? pool->create(cv::Size2i(cols, rows), type) : cv::Mat(rows, cols, type));
+  if (!in.read(mat.ptr<char>(0), mat.total()*mat.elemSize()))
+    throw(std::runtime_error("Error reading frame snapshot: Unexpected end of file!"));
+  return mat;
+}
+
+bool encodeImage(const cv::Mat &img, io::FrameImageCompression compression, int quality, std::vector<uint8_t> &data)
+{
+  if (compression == io::FrameImageCompression::NONE || img.empty() || img.dims != 2)
+    return false;
+
+  int depth = img.depth();
+  int channels = img.channels();
+  if ((depth != CV_8U && depth != CV_16U) || channels == 2 || channels > 4)
+    return false;
+
+  if (compression == io::FrameImageCompression::JPEG && depth == CV_8U && channels != 4)
+    return cv::imencode(".jpg", img, data, {cv::IMWRITE_JPEG_QUALITY, quality});
+  return cv::imencode(".png", img, data);
+}
+
+cv::Mat decodeImage(const std::vector<uint8_t> &data)
+{
+  cv::Mat img = cv::imdecode(data, cv::IMREAD_UNCHANGED);
+  if (img.empty())
+    throw(std::runtime_error("Error reading frame: Image could not be decoded!"));
+
+  // Images of frames are allocated from the pool of the frames, same as raw ones
+  cv::Mat img_pooled = Frame::getImagePool()->create(img.size(), img.type());
+  img.copyTo(img_pooled);
+  return img_pooled;
+}
+
+void writeCamera(std::ostream &out, const camera::Pinhole &cam)
+{
+  writeValue<uint32_t>(out, cam.width());
+  writeValue<uint32_t>(out, cam.height());
+  writeMat(out, cam.K());
+  writeMat(out, cam.hasDistortion() ? cam.distCoeffs() : cv::Mat());
+  writeMat(out, cam.pose());
+}
+
+camera::Pinhole::Ptr readCamera(std::istream &in)
+{
+  auto width = readValue<uint32_t>(in);
+  auto height = readValue<uint32_t>(in);
+  cv::Mat K = readMat(in);
+  cv::Mat dist_coeffs = readMat(in);
+  cv::Mat pose = readMat(in);
+
+  auto cam = std::make_shared<camera::Pinhole>(K, width, height);
+  if (!dist_coeffs.empty())
+    cam->setDistortionMap(dist_coeffs);
+  if (!pose.empty())
+    cam->setPose(pose);
+  return cam;
+}
+
+void writeCvGridMap(std::ostream &out, const CvGridMap &map)
+{
+  cv::Rect2d roi = map.roi();
+  writeValue(out, roi.x);
+  writeValue(out, roi.y);
+  writeValue(out, roi.width);
+  writeValue(out, roi.height);
+  writeValue(out, map.resolution());
+
+  std::vector<std::string> layer_names = map.getAllLayerNames();
+  writeValue<uint32_t>(out, static_cast<uint32_t>(layer_names.size()));
+  for (const auto &layer_name : layer_names)
+  {
+    CvGridMap::Layer layer = map.getLayer(layer_name);
+    writeString(out, layer_name);
+    writeValue<int32_t>(out, layer.interpolation);
+    writeMat(out, layer.data);
+  }
+}
+
+CvGridMap::Ptr readCvGridMap(std::istream &in)
+{
+  auto x = readValue<double>(in);
+  auto y = readValue<double>(in);
+  auto width = readValue<double>(in);
+  auto height = readValue<double>(in);
+  auto resolution = readValue<double>(in);
+
+  auto map = std::make_shared<CvGridMap>(cv::Rect2d(x, y, width, height), resolution);
+
+  auto nrof_layers = readValue<uint32_t>(in);
+  for (uint32_t i = 0; i < nrof_layers; ++i)
+  {
+    std::string layer_name = readString(in);
+    auto interpolation = readValue<int32_t>(in);
+    map->add(layer_name, readMat(in), interpolation);
+  }
+  return map;
+}
+
+void writePointCloud(std::ostream &out, const PointCloud &cloud)
+{
+  cv::Point3d origin = cloud.getOrigin();
+  writeValue(out, origin.x);
+  writeValue(out, origin.y);
+  writeValue(out, origin.z);
+  writeVector(out, cloud.getPointIds());
+  writeVector(out, cloud.getPositions());
+  writeVector(out, cloud.getColors());
+  writeVector(out, cloud.getNormals());
+}
+
+PointCloud::Ptr readPointCloud(std::istream &in)
+{
+  auto x = readValue<double>(in);
+  auto y = readValue<double>(in);
+  auto z = readValue<double>(in);
+  cv::Point3d origin(x, y, z);
+
+  auto ids = readVector<uint32_t>(in);
+  auto positions = readVector<cv::Point3f>(in);
+  auto colors = readVector<cv::Vec3b>(in);
+  auto normals = readVector<cv::Point3f>(in);
+
+  bool with_colors = !colors.empty();
+  bool with_normals = !normals.empty();
+  if (ids.size() != positions.size() || (with_colors && colors.size() != positions.size())
+      || (with_normals && normals.size() != positions.size()))
+    throw(std::runtime_error("Error reading frame snapshot: Point cloud arrays differ in size!"));
+
+  auto cloud = std::make_shared<PointCloud>(origin);
+  cloud->reserve(positions.size(), with_colors, with_normals);
+  for (size_t i = 0; i < positions.size(); ++i)
+  {
+    const cv::Point3f &pt = positions[i];
+    cloud->push_back(ids[i], cv::Point3d(origin.x + pt.x, origin.y + pt.y, origin.z + pt.z),
+                     with_colors ? &colors[i] : nullptr, with_normals ? &normals[i] : nullptr);
+  }
+  return cloud;
+}
+
+} // namespace
+
+io::FrameSnapshotWriter::FrameSnapshotWriter(const std::string &filepath)
+ : m_file(filepath, std::ios::binary | std::ios::trunc),
+   m_nrof_frames(0)
+{
+  if (!m_file.is_open())
+    throw(std::runtime_error("Error creating frame snapshot: Could not open file '" + filepath + "'!"));
+
+  m_file.write(g_magic, sizeof(g_magic));
+  writeValue(m_file, g_version);
+  m_file.flush();
+}
+
+void io::FrameSnapshotWriter::write(const Frame::Ptr &frame)
+{
+  std::lock_guard<std::mutex> lock(m_mutex_file);
+
+  serializeFrame(m_file, frame);
+
+  m_file.flush();
+  if (!m_file)
+    throw(std::runtime_error("Error writing frame snapshot: Could not write frame #" + std::to_string(frame->getFrameId())));
+  m_nrof_frames++;
+}
+
+size_t io::FrameSnapshotWriter::getNrofFrames() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex_file);
+  return m_nrof_frames;
+}
+
+io::FrameSnapshotReader::FrameSnapshotReader(const std::string &filepath)
+ : m_filepath(filepath),
+   m_file(filepath, std::ios::binary)
+{
+  if (!m_file.is_open())
+    throw(std::runtime_error("Error loading frame snapshot: Could not open file '" + filepath + "'!"));
+
+  char magic[sizeof(g_magic)];
+  if (!m_file.read(magic, sizeof(magic)) || std::memcmp(magic, g_magic, sizeof(g_magic)) != 0)
+    throw(std::runtime_error("Error loading frame snapshot: '" + filepath + "' is no frame snapshot!"));
+  if (readValue<uint32_t>(m_file) != g_version)
+    throw(std::runtime_error("Error loading frame snapshot: Version of '" + filepath + "' is not supported!"));
+}
+
+bool io::FrameSnapshotReader::hasNext()
+{
+  return m_file.peek() != std::ifstream::traits_type::eof();
+}
+
+Frame::Ptr io::FrameSnapshotReader::next()
+{
+  if (!hasNext())
+    return nullptr;
+  return deserializeFrame(m_file);
+}
+
+void io::serializeFrame(std::ostream &out, const Frame::Ptr &frame, FrameImageCompression compression, int quality)
+{
+  PointCloud::Ptr sparse_cloud = frame->getSparseCloud();
+  Depthmap::Ptr depthmap = frame->getDepthmap();
+  CvGridMap::Ptr surface_model = frame->getSurfaceModel();
+  CvGridMap::Ptr orthophoto = frame->getOrthophoto();
+
+  uint32_t flags = 0;
+  if (frame->isKeyframe())
+    flags |= IS_KEYFRAME;
+  if (frame->hasAccuratePose())
+    flags |= HAS_ACCURATE_POSE;
+  if (frame->isGeoreferenced())
+    flags |= IS_GEOREFERENCED;
+  if (frame->isImageResizeSet())
+    flags |= IS_RESIZE_SET;
+  if (sparse_cloud && !sparse_cloud->empty())
+    flags |= HAS_SPARSE_CLOUD;
+  if (depthmap)
+    flags |= HAS_DEPTHMAP;
+  if (surface_model)
+    flags |= HAS_SURFACE_MODEL;
+  if (orthophoto)
+    flags |= HAS_ORTHOPHOTO;
+
+  // Images that can not be encoded are written raw
+  std::vector<uint8_t> img_encoded;
+  if (encodeImage(frame->getImageRaw(), compression, quality, img_encoded))
+    flags |= IS_IMAGE_ENCODED;
+
+  writeString(out, frame->getCameraId());
+  writeValue<uint32_t>(out, frame->getFrameId());
+  writeValue<uint64_t>(out, frame->getTimestamp());
+  writeValue<uint32_t>(out, flags);
+  writeValue<int32_t>(out, static_cast<int32_t>(frame->getSurfaceAssumption()));
+  writeValue<double>(out, frame->getImageResizeFactor());
+
+  UTMPose utm = frame->getGnssUtm();
+  writeValue(out, utm.easting);
+  writeValue(out, utm.northing);
+  writeValue(out, utm.altitude);
+  writeValue(out, utm.heading);
+  writeValue(out, utm.zone);
+  writeValue(out, utm.band);
+
+  writeCamera(out, *frame->getCamera());
+  writeMat(out, frame->getOrientationView());
+  writeMat(out, frame->getVisualPoseView());
+  writeMat(out, frame->getGeoreferenceView());
+  if (flags & IS_IMAGE_ENCODED)
+    writeVector(out, img_encoded);
+  else
+    writeMat(out, frame->getImageRaw());
+
+  if (flags & HAS_SPARSE_CLOUD)
+    writePointCloud(out, *sparse_cloud);
+  if (flags & HAS_DEPTHMAP)
+  {
+    writeCamera(out, *depthmap->getCamera());
+    writeMat(out, depthmap->data());
+  }
+  if (flags & HAS_SURFACE_MODEL)
+    writeCvGridMap(out, *surface_model);
+  if (flags & HAS_ORTHOPHOTO)
+    writeCvGridMap(out, *orthophoto);
+}
+
+Frame::Ptr io::deserializeFrame(std::istream &in)
+{
+  std::string camera_id = readString(in);
+  auto frame_id = readValue<uint32_t>(in);
+  auto timestamp = readValue<uint64_t>(in);
+  auto flags = readValue<uint32_t>(in);
+  auto surface_assumption = static_cast<SurfaceAssumption>(readValue<int32_t>(in));
+  auto resize_factor = readValue<double>(in);
+
+  UTMPose utm;
+  utm.easting = readValue<double>(in);
+  utm.northing = readValue<double>(in);
+  utm.altitude = readValue<double>(in);
+  utm.heading = readValue<double>(in);
+  utm.zone = readValue<decltype(utm.zone)>(in);
+  utm.band = readValue<decltype(utm.band)>(in);
+
+  camera::Pinhole::Ptr cam = readCamera(in);
+  cv::Mat orientation = readMat(in);
+  cv::Mat visual_pose = readMat(in);
+  cv::Mat georeference = readMat(in);
+  cv::Mat img = (flags & IS_IMAGE_ENCODED ? decodeImage(readVector<uint8_t>(in)) : readMat(in, Frame::getImagePool()));
+
+  auto frame = std::make_shared<Frame>(camera_id, frame_id, timestamp, img, utm, cam, orientation);
+
+  // Poses are restored in the order the pipeline sets them, so the geographic pose is recomputed from the visual one
+  if (flags & IS_RESIZE_SET)
+    frame->setImageResizeFactor(resize_factor);
+  if (!visual_pose.empty())
+    frame->setVisualPose(visual_pose);
+  if ((flags & IS_GEOREFERENCED) && !georeference.empty())
+    frame->initGeoreference(georeference);
+  frame->setPoseAccurate(flags & HAS_ACCURATE_POSE);
+  frame->setKeyframe(flags & IS_KEYFRAME);
+  frame->setSurfaceAssumption(surface_assumption);
+
+  // The sparse cloud was written in the coordinates of the frame at that time, so it is not transformed again
+  if (flags & HAS_SPARSE_CLOUD)
+    frame->setSparseCloud(readPointCloud(in), false);
+  if (flags & HAS_DEPTHMAP)
+  {
+    camera::Pinhole::Ptr depthmap_cam = readCamera(in);
+    frame->setDepthmap(std::make_shared<Depthmap>(readMat(in), *depthmap_cam));
+  }
+  if (flags & HAS_SURFACE_MODEL)
+    frame->setSurfaceModel(readCvGridMap(in));
+  if (flags & HAS_ORTHOPHOTO)
+    frame->setOrthophoto(readCvGridMap(in));
+
+  return frame;
+}
@@ -0,0 +1,170 @@
+
+
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+
+#include <cpl_conv.h>
+
+#include <realm_io/frame_snapshot.h>
+#include <realm_io/frame_store.h>
+
+using namespace realm;
+
+namespace
+{
+
+// Fastest deflate level, most of the gain comes from the empty cells of the maps
+const int g_compression_level = 1;
+
+} // namespace
+
+io::FrameStore::FrameStore(size_t nrof_resident, FrameColdStorage cold_storage, const std::string &filepath)
+ : m_nrof_resident(nrof_resident),
+   m_cold_storage(cold_storage),
+   m_filepath(filepath),
+   m_file_size(0)
+{
+  if (m_cold_storage == FrameColdStorage::FILE)
+  {
+    if (m_filepath.empty())
+      throw(std::invalid_argument("Error creating frame store: No file provided for cold storage."));
+
+    m_file.open(m_filepath, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!m_file.is_open())
+      throw(std::runtime_error("Error creating frame store: Could not open file " + m_filepath));
+  }
+}
+
+io::FrameStore::~FrameStore()
+{
+  if (m_file.is_open())
+  {
+    m_file.close();
+    std::remove(m_filepath.c_str());
+  }
+}
+
+void io::FrameStore::add(const Frame::Ptr &frame)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_frames_resident.push_back(frame);
+  while (m_frames_resident.size() > m_nrof_resident)
+  {
+    moveToColdStorage(m_frames_resident.front());
+    m_frames_resident.pop_front();
+  }
+}
+
+Frame::Ptr io::FrameStore::get(size_t idx) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (idx >= m_frames_cold.size() + m_frames_resident.size())
+    throw(std::out_of_range("Error accessing frame store: Index out of range."));
+
+  if (idx < m_frames_cold.size())
+    return restore(m_frames_cold[idx]);
+  return m_frames_resident[idx - m_frames_cold.size()];
+}
+
+void io::FrameStore::forEach(const std::function<void(const Frame::Ptr &)> &func) const
+{
+  // The lock is only held for accessing a frame, so frames can be added meanwhile. They are not part of the iteration.
+  size_t nrof_frames = size();
+  for (size_t i = 0; i < nrof_frames; ++i)
+    func(get(i));
+}
+
+size_t io::FrameStore::size() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_frames_cold.size() + m_frames_resident.size();
+}
+
+size_t io::FrameStore::getNrofCold() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_frames_cold.size();
+}
+
+size_t io::FrameStore::getByteSize() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  size_t bytes = 0;
+  for (const auto &frame : m_frames_resident)
+    bytes += frame->getByteSize();
+  for (const auto &cold : m_frames_cold)
+    bytes += cold.data.size();
+  return bytes;
+}
+
+void io::FrameStore::clear()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_frames_resident.clear();
+  m_frames_cold.clear();
+
+  if (m_file.is_open())
+  {
+    m_file.close();
+    m_file.open(m_filepath, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+    m_file_size = 0;
+  }
+}
+
+void io::FrameStore::moveToColdStorage(const Frame::Ptr &frame)
+{
+  std::ostringstream stream(std::ios::out | std::ios::binary);
+  io::serializeFrame(stream, frame);
+  const std::string raw = stream.str();
+
+  size_t size_compressed = 0;
+  void* compressed = CPLZLibDeflate(raw.data(), raw.size(), g_compression_level, nullptr, 0, &size_compressed);
+  if (compressed == nullptr)
+    throw(std::runtime_error("Error moving frame to cold storage: Compression failed."));
+
+  ColdFrame cold;
+  cold.offset = 0;
+  cold.size_compressed = size_compressed;
+  cold.size_raw = raw.size();
+
+  if (m_cold_storage == FrameColdStorage::MEMORY)
+    cold.data.assign(static_cast<const char*>(compressed), size_compressed);
+  else
+  {
+    cold.offset = m_file_size;
+    m_file.seekp(m_file_size);
+    m_file.write(static_cast<const char*>(compressed), static_cast<std::streamsize>(size_compressed));
+    m_file.flush();
+    m_file_size += static_cast<std::streamoff>(size_compressed);
+  }
+  CPLFree(compressed);
+
+  if (!m_file.good() && m_cold_storage == FrameColdStorage::FILE)
+    throw(std::runtime_error("Error moving frame to cold storage: Writing file " + m_filepath + " failed."));
+
+  m_frames_cold.push_back(std::move(cold));
+}
+
+Frame::Ptr io::FrameStore::restore(const ColdFrame &cold) const
+{
+  std::string compressed;
+  const std::string* data = &cold.data;
+  if (m_cold_storage == FrameColdStorage::FILE)
+  {
+    compressed.resize(cold.size_compressed);
+    m_file.seekg(cold.offset);
+    m_file.read(&compressed[0], static_cast<std::streamsize>(cold.size_compressed));
+    if (!m_file.good())
+      throw(std::runtime_error("Error restoring frame from cold storage: Reading file " + m_filepath + " failed."));
+    data = &compressed;
+  }
+
+  std::string raw(cold.size_raw, '\0');
+  size_t size_raw = 0;
+  if (CPLZLibInflate(data->data(), data->size(), &raw[0], raw.size(), &size_raw) == nullptr || size_raw != cold.size_raw)
+    throw(std::runtime_error("Error restoring frame from cold storage: Decompression failed."));
+
+  std::istringstream stream(raw, std::ios::in | std::ios::binary);
+  return io::deserializeFrame(stream);
+}
@@ -1,12 +1,21 @@
 
 
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+#include <opencv2/imgproc.hpp>
+
+#include <realm_core/loguru.h>
+#include <realm_core/timer.h>
 #include <realm_io/gdal_continuous_writer.h>
 
 using namespace realm;
 
-io::GDALContinuousWriter::GDALContinuousWriter(const std::string &thread_name, int64_t sleep_time, bool verbose)
+io::GDALContinuousWriter::GDALContinuousWriter(const std::string &thread_name, int64_t sleep_time, bool verbose, int nrof_threads)
  : WorkerThreadBase(thread_name, sleep_time, verbose),
-   m_queue_size(1)
+   m_update_margin(0.25),
+   m_pool(std::make_shared<ThreadPool>(std::max(nrof_threads, 1)))
 {
 }
 
@@ -19,48 +28,344 @@ void io::GDALContinuousWriter::requestSaveGeoTIFF(const CvGridMap::Ptr &map,
 {
   // Create new save job
   QueueElement::Ptr queue_element;
-  queue_element.reset(new QueueElement{map, zone, filename, do_build_overview, do_split_save, gdal_profile});
+  queue_element.reset(new QueueElement{map, zone, filename, do_build_overview, do_split_save, gdal_profile, {}});
 
-  // Push it to the processing queue
+  // Push it to the processing queue, a pending job for the same file is outdated
   m_mutex_save_requests.lock();
-  m_save_requests.push_back(queue_element);
-  if (m_save_requests.size() > m_queue_size)
+  if (m_save_requests.find(filename) == m_save_requests.end())
+    m_save_requests_order.push_back(filename);
+  m_save_requests[filename] = queue_element;
+  m_mutex_save_requests.unlock();
+}
+
+void io::GDALContinuousWriter::requestUpdateGeoTIFF(const CvGridMap::Ptr &map_update,
+                                                    const uint8_t &zone,
+                                                    const std::string &filename,
+                                                    bool do_build_overview)
+{
+  cv::Rect2d roi = map_update->roi();
+
+  std::lock_guard<std::mutex> lock(m_mutex_save_requests);
+
+  auto it = m_update_requests.find(filename);
+  if (it == m_update_requests.end())
   {
-    m_save_requests.pop_front();
+    QueueElement::Ptr queue_element;
+    queue_element.reset(new QueueElement{map_update, zone, filename, do_build_overview, false, GDALProfile::COG, {roi}});
+    m_update_requests[filename] = queue_element;
+    m_update_requests_order.push_back(filename);
+    return;
   }
-  m_mutex_save_requests.unlock();
+
+  // Merge with the pending update of the file. The merged map only holds valid data inside the regions of the updates,
+  // which are the only ones written. Regions covered by the new update are obsolete.
+  QueueElement::Ptr &pending = it->second;
+  auto map_merged = std::make_shared<CvGridMap>(pending->map->roi() | roi, map_update->resolution());
+  map_merged->add(*pending->map, REALM_OVERWRITE_ALL, false);
+  map_merged->add(*map_update, REALM_OVERWRITE_ALL, false);
+
+  std::vector<cv::Rect2d> &rois = pending->rois;
+  rois.erase(std::remove_if(rois.begin(), rois.end(), [&](const cv::Rect2d &r){ return (r & roi).area() >= r.area(); }),
+             rois.end());
+  rois.push_back(roi);
+
+  pending->map = map_merged;
+  pending->zone = zone;
+  pending->do_build_overview = pending->do_build_overview || do_build_overview;
 }
 
 bool io::GDALContinuousWriter::process()
 {
+  return processRequests();
+}
+
+bool io::GDALContinuousWriter::writePending()
+{
+  return processRequests();
+}
+
+bool io::GDALContinuousWriter::processRequests()
+{
+  std::vector<QueueElement::Ptr> update_requests;
+  std::vector<QueueElement::Ptr> save_requests;
+
   m_mutex_save_requests.lock();
-  if (!m_save_requests.empty())
+  for (const auto &filename : m_update_requests_order)
+    update_requests.push_back(m_update_requests[filename]);
+  for (const auto &filename : m_save_requests_order)
+    save_requests.push_back(m_save_requests[filename]);
+  m_update_requests.clear();
+  m_update_requests_order.clear();
+  m_save_requests.clear();
+  m_save_requests_order.clear();
+  m_mutex_save_requests.unlock();
+
+  if (update_requests.empty() && save_requests.empty())
+    return false;
+
+  // Entries of all files are created up front, so the tasks never modify the map of open files
+  std::vector<UpdateDataset*> datasets;
+  for (const auto &request : update_requests)
+    datasets.push_back(&m_update_datasets[request->filename]);
+
+  std::vector<std::future<void>> futures;
+  for (size_t i = 0; i < update_requests.size(); ++i)
   {
-    QueueElement::Ptr queue_element = m_save_requests.back();
-    m_save_requests.pop_back();
-    m_mutex_save_requests.unlock();
-
-    io::saveGeoTIFF(
-      *queue_element->map,
-      queue_element->zone,
-      queue_element->filename,
-      queue_element->do_build_overview,
-      queue_element->do_split_save,
-      queue_element->gdal_profile
-    );
-
-    return true;
+    QueueElement::Ptr request = update_requests[i];
+    UpdateDataset* dataset = datasets[i];
+    futures.push_back(m_pool->submit([this, request, dataset]{ processUpdate(request, *dataset); }));
   }
 
-  m_mutex_save_requests.unlock();
-  return false;
+  // Updates and saves may target the same file, so saves only start once all updates are written
+  for (auto &future : futures)
+    future.wait();
+
+  for (const auto &request : save_requests)
+  {
+    futures.push_back(m_pool->submit([request]{
+      io::saveGeoTIFF(
+        *request->map,
+        request->zone,
+        request->filename,
+        request->do_build_overview,
+        request->do_split_save,
+        request->gdal_profile
+      );
+    }));
+  }
+
+  for (auto &future : futures)
+    future.wait();
+
+  // Errors are only rethrown after all files are written, as the tasks must not outlive the requests
+  for (auto &future : futures)
+    future.get();
+
+  return true;
 }
 
-void io::GDALContinuousWriter::reset()
+void io::GDALContinuousWriter::processUpdate(const QueueElement::Ptr &request, UpdateDataset &dataset)
 {
+  long t = Timer::getCurrentTimeMilliseconds();
+
+  const CvGridMap &map = *request->map;
+  std::vector<std::string> layer_names = map.getAllLayerNames();
+  if (layer_names.size() != 1)
+    throw(std::invalid_argument("Error: Updating GeoTIFF from CvGridMap is supported for single layer objects only."));
+
+  cv::Mat img = map[layer_names[0]];
+
+  cv::Mat img_converted;
+  if (img.channels() == 3)
+    cv::cvtColor(img, img_converted, cv::ColorConversionCodes::COLOR_BGR2RGB);
+  else if (img.channels() == 4)
+    cv::cvtColor(img, img_converted, cv::ColorConversionCodes::COLOR_BGRA2RGBA);
+#ifdef CV_16F
+  else if (img.depth() == CV_16F)
+    img.convertTo(img_converted, CV_32F);
+#endif
+  else
+    img_converted = img;
 
+  std::unique_ptr<GDALDatasetMeta> meta(io::computeGDALDatasetMeta(map, request->zone));
+
+  cv::Rect2d roi = map.roi();
+  double resolution = map.resolution();
+
+  // Check if the open file covers the update, otherwise it is recreated
+  bool is_covered = false;
+  if (dataset.dataset != nullptr)
+  {
+    double epsilon = resolution / 2;
+    is_covered = dataset.type == img_converted.type() && dataset.zone == request->zone
+                 && std::abs(dataset.resolution - resolution) < 10e-6
+                 && roi.x > dataset.roi.x - epsilon
+                 && roi.y > dataset.roi.y - epsilon
+                 && roi.x + roi.width < dataset.roi.x + dataset.roi.width + epsilon
+                 && roi.y + roi.height < dataset.roi.y + dataset.roi.height + epsilon;
+  }
+
+  if (!is_covered)
+    createUpdateDataset(dataset, request->filename, roi, resolution, *meta, img_converted.type(), request->do_build_overview);
+
+  // Merged updates are only valid inside their regions
+  cv::Rect2i bounds(0, 0, img_converted.cols, img_converted.rows);
+  for (const auto &roi_update : request->rois)
+  {
+    cv::Rect2i rect = map.atIndexROI(roi_update) & bounds;
+    if (rect.area() > 0)
+      writeUpdate(dataset, img_converted(rect), roi_update, request->do_build_overview);
+  }
+  dataset.dataset->FlushCache();
+
+  LOG_F(INFO, "GeoTIFF updated, t = [%4.2f s], location: %s", (Timer::getCurrentTimeMilliseconds()-t)/1000.0, request->filename.c_str());
+}
+
+void io::GDALContinuousWriter::createUpdateDataset(UpdateDataset &dataset_update,
+                                                  const std::string &filename,
+                                                  const cv::Rect2d &roi,
+                                                  double resolution,
+                                                  const GDALDatasetMeta &meta,
+                                                  int type,
+                                                  bool do_build_overview)
+{
+  GDALAllRegister();
+
+  // Data of the previous file is kept, as long as it is compatible with the update
+  cv::Rect2d roi_file = roi;
+  cv::Rect2d roi_prev;
+  cv::Mat data_prev;
+
+  if (dataset_update.dataset != nullptr)
+  {
+    const UpdateDataset &prev = dataset_update;
+    if (prev.type == type && prev.zone == meta.zone && std::abs(prev.resolution - resolution) < 10e-6)
+    {
+      data_prev = cv::Mat(prev.dataset->GetRasterYSize(), prev.dataset->GetRasterXSize(), type);
+      CPLErr error_code = prev.dataset->RasterIO(GF_Read, 0, 0, data_prev.cols, data_prev.rows, data_prev.data,
+                                                 data_prev.cols, data_prev.rows, prev.datatype, data_prev.channels(),
+                                                 nullptr, data_prev.elemSize(), data_prev.step, data_prev.elemSize1());
+      if (error_code != CE_None)
+        throw(std::runtime_error("Error updating GeoTIFF: Reading previous data failed."));
+
+      roi_prev = prev.roi;
+      roi_file |= prev.roi;
+    }
+    else
+      LOG_F(WARNING, "GeoTIFF update does not match the previous data, it is discarded: %s", filename.c_str());
+
+    GDALClose((GDALDatasetH) prev.dataset);
+    dataset_update.dataset = nullptr;
+  }
+
+  // The margin is a multiple of the resolution, so the file stays aligned to the grid of the updates
+  double margin = std::ceil(std::max(roi_file.width, roi_file.height) * m_update_margin / resolution) * resolution;
+  roi_file = cv::Rect2d(roi_file.x - margin, roi_file.y - margin, roi_file.width + 2*margin, roi_file.height + 2*margin);
+
+  int cols = static_cast<int>(std::round(roi_file.width / resolution)) + 1;
+  int rows = static_cast<int>(std::round(roi_file.height / resolution)) + 1;
+  int channels = CV_MAT_CN(type);
+
+  GDALDatasetMeta meta_file = meta;
+  meta_file.geoinfo[0] = roi_file.x;
+  meta_file.geoinfo[3] = roi_file.y + roi_file.height;
+
+  // Overviews are built in place, there are no source overviews to be copied
+  char** options = getExportOptionsGeoTIFF(GDALProfile::COG);
+  options = CSLSetNameValue(options, "COPY_SRC_OVERVIEWS", nullptr);
+  if (channels == 3 || channels == 4)
+    options = CSLSetNameValue(options, "PHOTOMETRIC", "RGB");
+
+  GDALDriver* driver = GetGDALDriverManager()->GetDriverByName("GTiff");
+  GDALDataset* dataset = driver->Create(filename.c_str(), cols, rows, channels, meta.datatype, options);
+  CSLDestroy(options);
+
+  if (dataset == nullptr)
+    throw(std::runtime_error("Error updating GeoTIFF: Creating file failed."));
+
+  setGDALDatasetGeoinfo(dataset, meta_file);
+  for (int i = 1; i <= channels; ++i)
+    setGDALBandNan(dataset->GetRasterBand(i), cv::Mat(1, 1, type));
+
+  dataset_update = UpdateDataset{dataset, roi_file, resolution, meta.zone, type, meta.datatype};
+
+  if (!data_prev.empty())
+    writeUpdate(dataset_update, data_prev, roi_prev, false);
+
+  if (do_build_overview)
+  {
+    std::vector<int> overview_list = computeOverviewList(cols, rows);
+    if (!overview_list.empty())
+      dataset->BuildOverviews("NEAREST", static_cast<int>(overview_list.size()), overview_list.data(), 0, nullptr, GDALDummyProgress, nullptr);
+  }
+
+  LOG_F(INFO, "Created GeoTIFF for updates with [%i x %i] pixels, location: %s", cols, rows, filename.c_str());
+}
+
+void io::GDALContinuousWriter::writeUpdate(const UpdateDataset &dataset,
+                                           const cv::Mat &data,
+                                           const cv::Rect2d &roi,
+                                           bool do_update_overviews)
+{
+  int col = static_cast<int>(std::round((roi.x - dataset.roi.x) / dataset.resolution));
+  int row = static_cast<int>(std::round((dataset.roi.y + dataset.roi.height - roi.y - roi.height) / dataset.resolution));
+
+  GDALDataset* ds = dataset.dataset;
+  CPLErr error_code = ds->RasterIO(GF_Write, col, row, data.cols, data.rows, data.data, data.cols, data.rows,
+                                   dataset.datatype, data.channels(), nullptr, data.elemSize(), data.step, data.elemSize1());
+  if (error_code != CE_None)
+    throw(std::runtime_error("Error updating GeoTIFF: Unhandled error code."));
+
+  if (!do_update_overviews)
+    return;
+
+  // Every overview is computed from the next finer level, so only a window slightly larger than the update is read
+  // instead of the blocks of the full resolution covered by an overview pixel
+  for (int b = 1; b <= data.channels(); ++b)
+  {
+    GDALRasterBand* band_src = ds->GetRasterBand(b);
+    int x0 = col;
+    int y0 = row;
+    int x1 = col + data.cols;
+    int y1 = row + data.rows;
+
+    for (int i = 0; i < ds->GetRasterBand(b)->GetOverviewCount(); ++i)
+    {
+      GDALRasterBand* band_dst = ds->GetRasterBand(b)->GetOverview(i);
+      double scale_x = static_cast<double>(band_src->GetXSize()) / band_dst->GetXSize();
+      double scale_y = static_cast<double>(band_src->GetYSize()) / band_dst->GetYSize();
+
+      int dx0 = static_cast<int>(std::floor(x0 / scale_x));
+      int dy0 = static_cast<int>(std::floor(y0 / scale_y));
+      int dx1 = std::min(static_cast<int>(std::ceil(x1 / scale_x)), band_dst->GetXSize());
+      int dy1 = std::min(static_cast<int>(std::ceil(y1 / scale_y)), band_dst->GetYSize());
+      if (dx1 <= dx0 || dy1 <= dy0)
+        break;
+
+      int sx0 = static_cast<int>(std::floor(dx0 * scale_x));
+      int sy0 = static_cast<int>(std::floor(dy0 * scale_y));
+      int sx1 = std::min(static_cast<int>(std::ceil(dx1 * scale_x)), band_src->GetXSize());
+      int sy1 = std::min(static_cast<int>(std::ceil(dy1 * scale_y)), band_src->GetYSize());
+
+      cv::Mat block_src(sy1 - sy0, sx1 - sx0, CV_MAKETYPE(data.depth(), 1));
+      error_code = band_src->RasterIO(GF_Read, sx0, sy0, block_src.cols, block_src.rows, block_src.data,
+                                      block_src.cols, block_src.rows, dataset.datatype, 0, 0);
+      if (error_code != CE_None)
+        throw(std::runtime_error("Error updating GeoTIFF overviews: Unhandled error code."));
+
+      cv::Mat block_dst;
+      cv::resize(block_src, block_dst, cv::Size(dx1 - dx0, dy1 - dy0), 0, 0, cv::INTER_NEAREST);
+
+      error_code = band_dst->RasterIO(GF_Write, dx0, dy0, block_dst.cols, block_dst.rows, block_dst.data,
+                                      block_dst.cols, block_dst.rows, dataset.datatype, 0, 0);
+      if (error_code != CE_None)
+        throw(std::runtime_error("Error updating GeoTIFF overviews: Unhandled error code."));
+
+      band_src = band_dst;
+      x0 = dx0;
+      y0 = dy0;
+      x1 = dx1;
+      y1 = dy1;
+    }
+  }
+}
+
+void io::GDALContinuousWriter::closeUpdateDatasets()
+{
+  for (auto &it : m_update_datasets)
+    if (it.second.dataset != nullptr)
+      GDALClose((GDALDatasetH) it.second.dataset);
+  m_update_datasets.clear();
+}
+
+void io::GDALContinuousWriter::reset()
+{
+  closeUpdateDatasets();
 }
 
 void io::GDALContinuousWriter::finishCallback()
 {
-}
\ No newline at end of file
+  // Updates are never dropped, so the pending ones are written before the files are closed
+  processRequests();
+  closeUpdateDatasets();
+}
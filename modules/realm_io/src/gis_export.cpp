@@ -1,5 +1,10 @@
 
 
+#include <algorithm>
+#include <future>
+#include <memory>
+#include <thread>
+
 #include <opencv2/imgproc.hpp>
 
 #include <realm_core/loguru.h>
@@ -13,7 +18,8 @@ void io::saveGeoTIFF(const CvGridMap &map,
                      const std::string &filename,
                      bool do_build_overview,
                      bool do_split_save,
-                     GDALProfile gdal_profile)
+                     GDALProfile gdal_profile,
+                     int nrof_threads)
 {
   long t = Timer::getCurrentTimeMilliseconds();
 
@@ -21,59 +27,168 @@ void io::saveGeoTIFF(const CvGridMap &map,
   if (layer_names.size() > 1)
     throw(std::invalid_argument("Error: Exporting Gtiff from CvGridMap is currently supported for single layer objects only."));
 
+  // Layer memory is written directly, the channel order of OpenCV is resolved while writing
   cv::Mat img = map[map.getAllLayerNames()[0]];
 
-  cv::Mat img_converted;
-  if (img_converted.channels() == 3)
-    cv::cvtColor(img, img_converted, cv::ColorConversionCodes::COLOR_BGR2RGB);
-  else if (img.channels() == 4)
-    cv::cvtColor(img, img_converted, cv::ColorConversionCodes::COLOR_BGRA2RGBA);
-  else
-    img_converted = img;
+#ifdef CV_16F
+  // GeoTIFF has no half precision bands in GDAL, so they are written in single precision
+  if (img.depth() == CV_16F)
+    img.convertTo(img, CV_32F);
+#endif
 
-  GDALDatasetMeta* meta = io::computeGDALDatasetMeta(map, zone);
+  std::unique_ptr<GDALDatasetMeta> meta(io::computeGDALDatasetMeta(map, zone));
 
-  if (!do_split_save || img_converted.channels() == 1)
+  if (!do_split_save || img.channels() == 1)
   {
-    io::saveGeoTIFFtoFile(img_converted, *meta, filename, do_build_overview, gdal_profile);
+    io::saveGeoTIFFtoFileDirect(img, *meta, filename, do_build_overview, gdal_profile, -1, nrof_threads);
 
     LOG_F(INFO, "GeoTIFF saved, t = [%4.2f s], location: %s", (Timer::getCurrentTimeMilliseconds()-t)/1000.0, filename.c_str());
   }
   else
   {
-    cv::Mat img_bands[img_converted.channels()];
-    cv::split(img_converted, img_bands);
+    if (img.channels() > 4)
+      throw(std::invalid_argument("Error: Exporting GeoTIFF split is only supported up to 4 channels."));
 
-    for (int i = 0; i < img_converted.channels(); ++i)
+    // Channels are saved in parallel, so the threads for compression are divided between them
+    if (nrof_threads <= 0)
+      nrof_threads = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+    int nrof_threads_channel = std::max(nrof_threads / img.channels(), 1);
+
+    std::vector<std::future<void>> futures;
+    for (int i = 0; i < img.channels(); ++i)
     {
       std::string filename_split = filename;
+      int channel;
       switch(i)
       {
         case 0:
           filename_split.insert(filename_split.size()-4, "_r");
+          channel = 2;
           break;
         case 1:
           filename_split.insert(filename_split.size()-4, "_g");
+          channel = 1;
           break;
         case 2:
           filename_split.insert(filename_split.size()-4, "_b");
+          channel = 0;
           break;
-        case 3:
+        default:
           filename_split.insert(filename_split.size()-4, "_a");
+          channel = 3;
           break;
-        default:
-          throw(std::invalid_argument("Error: Exporting GeoTIFF split is only supported up to 4 channels."));
       }
 
-      io::saveGeoTIFFtoFile(img_converted, *meta, filename_split, do_build_overview, gdal_profile);
+      // Two channel images are not color images, their channels are exported in order
+      if (img.channels() == 2)
+        channel = i;
+
+      futures.push_back(std::async(std::launch::async, [&, filename_split, channel]{
+        io::saveGeoTIFFtoFileDirect(img, *meta, filename_split, do_build_overview, gdal_profile, channel, nrof_threads_channel);
+      }));
+    }
+
+    // All channels reference the image and the meta data, so they have to be finished before an error is rethrown
+    for (auto &future : futures)
+      future.wait();
+    for (auto &future : futures)
+      future.get();
 
-      LOG_F(INFO, "GeoTIFF saved, t = [%4.2f s], location: %s", (Timer::getCurrentTimeMilliseconds()-t)/1000.0, filename_split.c_str());
+    LOG_F(INFO, "GeoTIFF saved in %i channels, t = [%4.2f s], location: %s", img.channels(), (Timer::getCurrentTimeMilliseconds()-t)/1000.0, filename.c_str());
+  }
+}
 
-      t = Timer::getCurrentTimeMilliseconds();
+void io::saveGeoTIFFtoFileDirect(const cv::Mat &data,
+                                 const GDALDatasetMeta &meta,
+                                 const std::string &filename,
+                                 bool do_build_overviews,
+                                 GDALProfile gdal_profile,
+                                 int channel,
+                                 int nrof_threads)
+{
+  if (channel >= data.channels())
+    throw(std::invalid_argument("Error saving GeoTIFF: Requested channel does not exist."));
+
+  GDALAllRegister();
+
+  // A single channel is written as one band, strided through the interleaved layer memory
+  int nrof_bands = (channel < 0 ? data.channels() : 1);
+  uchar* ptr = (channel < 0 ? data.data : data.data + channel * data.elemSize1());
+
+  // OpenCV stores color images as BGR(A), buffer band i is written to the dataset band band_map[i]
+  std::vector<int> band_map(static_cast<size_t>(nrof_bands));
+  for (int i = 0; i < nrof_bands; ++i)
+    band_map[i] = i + 1;
+  if (nrof_bands == 3 || nrof_bands == 4)
+    std::swap(band_map[0], band_map[2]);
+
+  // The GTiff driver can only create tiled images directly, the COG driver only supports copies. Without a source to
+  // copy overviews from, they are written in place.
+  char** options = getExportOptionsGeoTIFF(gdal_profile);
+  options = CSLSetNameValue(options, "COPY_SRC_OVERVIEWS", nullptr);
+  if (nrof_bands == 3 || nrof_bands == 4)
+    options = CSLSetNameValue(options, "PHOTOMETRIC", "RGB");
+  if (nrof_threads > 0)
+    options = CSLSetNameValue(options, "NUM_THREADS", std::to_string(nrof_threads).c_str());
+
+  GDALDriver* driver = GetGDALDriverManager()->GetDriverByName("GTiff");
+  GDALDataset* dataset = driver->Create(filename.c_str(), data.cols, data.rows, nrof_bands, meta.datatype, options);
+  CSLDestroy(options);
+
+  if (dataset == nullptr)
+    throw(std::runtime_error("Error saving GeoTIFF: Creating file failed."));
+
+  setGDALDatasetGeoinfo(dataset, meta);
+  for (int i = 1; i <= nrof_bands; ++i)
+    setGDALBandNan(dataset->GetRasterBand(i), data);
+
+  if (do_build_overviews)
+  {
+    // Overviews are only allocated here and filled from memory. Each level is computed from the next finer one.
+    std::vector<int> overview_list = computeOverviewList(data.cols, data.rows);
+    if (!overview_list.empty())
+      dataset->BuildOverviews("NONE", static_cast<int>(overview_list.size()), overview_list.data(), 0, nullptr, GDALDummyProgress, nullptr);
+
+    GDALRasterBand* band = dataset->GetRasterBand(1);
+    std::vector<cv::Mat> overviews(static_cast<size_t>(band->GetOverviewCount()));
+    for (int i = 0; i < band->GetOverviewCount(); ++i)
+    {
+      GDALRasterBand* overview = band->GetOverview(i);
+      cv::resize(i == 0 ? data : overviews[i - 1], overviews[i], cv::Size(overview->GetXSize(), overview->GetYSize()), 0, 0, cv::INTER_NEAREST);
+    }
+
+    // Coarsest levels are written first, so their blocks precede the full resolution in the file like in a COG
+    for (int i = band->GetOverviewCount() - 1; i >= 0; --i)
+    {
+      const cv::Mat &overview = overviews[i];
+      uchar* ptr_overview = (channel < 0 ? overview.data : overview.data + channel * overview.elemSize1());
+      for (int b = 0; b < nrof_bands; ++b)
+      {
+        GDALRasterBand* band_overview = dataset->GetRasterBand(band_map[b])->GetOverview(i);
+        CPLErr error_code = band_overview->RasterIO(GF_Write, 0, 0, overview.cols, overview.rows,
+                                                    ptr_overview + b * overview.elemSize1(), overview.cols, overview.rows,
+                                                    meta.datatype, overview.elemSize(), overview.step);
+        if (error_code != CE_None)
+          throw(std::runtime_error("Error saving GeoTIFF overviews: Unhandled error code."));
+      }
+      dataset->FlushCache();
     }
   }
 
-  delete meta;
+  CPLErr error_code = dataset->RasterIO(GF_Write, 0, 0, data.cols, data.rows, ptr, data.cols, data.rows, meta.datatype,
+                                        nrof_bands, band_map.data(), data.elemSize(), data.step, data.elemSize1());
+  if (error_code != CE_None)
+    throw(std::runtime_error("Error saving GeoTIFF: Unhandled error code."));
+
+  GDALClose((GDALDatasetH) dataset);
+}
+
+std::vector<int> io::computeOverviewList(int cols, int rows)
+{
+  std::vector<int> overview_list;
+  for (int factor = 2; factor <= 2048 && std::min(cols, rows) / factor > 0; factor *= 2)
+    overview_list.push_back(factor);
+  return overview_list;
 }
 
 void io::saveGeoTIFFtoFile(const cv::Mat &data,
@@ -140,6 +255,11 @@ io::GDALDatasetMeta* io::computeGDALDatasetMeta(const CvGridMap &map, uint8_t zo
     case CV_64F:
       meta->datatype = GDT_Float64;
       break;
+#ifdef CV_16F
+    case CV_16F:
+      meta->datatype = GDT_Float32;
+      break;
+#endif
     default:
       throw(std::invalid_argument("Error saving GTiff: Image format not recognized!"));
   }
@@ -160,23 +280,13 @@ GDALDataset* io::generateMemoryDataset(const cv::Mat &data, const io::GDALDatase
 {
   GDALDriver* driver = nullptr;
   GDALDataset* dataset = nullptr;
-  OGRSpatialReference oSRS;
-  gis::initAxisMappingStrategy(&oSRS);
-  
+
   char **options = nullptr;
 
   driver = GetGDALDriverManager()->GetDriverByName("MEM");
   dataset = driver->Create("", data.cols, data.rows, data.channels(), meta.datatype, options);
 
-  char *pszSRS_WKT = nullptr;
-  double geoinfo[6] = {meta.geoinfo[0], meta.geoinfo[1], meta.geoinfo[2], meta.geoinfo[3], meta.geoinfo[4], meta.geoinfo[5]};
-
-  dataset->SetGeoTransform(geoinfo);
-  oSRS.SetUTM(meta.zone, TRUE);
-  oSRS.SetWellKnownGeogCS("WGS84");
-  oSRS.exportToWkt(&pszSRS_WKT);
-  dataset->SetProjection(pszSRS_WKT);
-  CPLFree(pszSRS_WKT);
+  setGDALDatasetGeoinfo(dataset, meta);
 
   cv::Mat img_bands[data.channels()];
   cv::split(data, img_bands);
@@ -194,12 +304,30 @@ GDALDataset* io::generateMemoryDataset(const cv::Mat &data, const io::GDALDatase
   return dataset;
 }
 
+void io::setGDALDatasetGeoinfo(GDALDataset* dataset, const io::GDALDatasetMeta &meta)
+{
+  OGRSpatialReference oSRS;
+  gis::initAxisMappingStrategy(&oSRS);
+
+  char *pszSRS_WKT = nullptr;
+  double geoinfo[6] = {meta.geoinfo[0], meta.geoinfo[1], meta.geoinfo[2], meta.geoinfo[3], meta.geoinfo[4], meta.geoinfo[5]};
+
+  dataset->SetGeoTransform(geoinfo);
+  oSRS.SetUTM(meta.zone, TRUE);
+  oSRS.SetWellKnownGeogCS("WGS84");
+  oSRS.exportToWkt(&pszSRS_WKT);
+  dataset->SetProjection(pszSRS_WKT);
+  CPLFree(pszSRS_WKT);
+}
+
 char** io::getExportOptionsGeoTIFF(GDALProfile gdal_profile)
 {
   char** options = nullptr;
   switch(gdal_profile)
   {
     case GDALProfile::COG:
+    case GDALProfile::COG_DEFLATE:
+    case GDALProfile::COG_UNCOMPRESSED:
       options = CSLSetNameValue( options, "INTERLEAVE", "PIXEL" );
       options = CSLSetNameValue( options, "TILED", "YES" );
       options = CSLSetNameValue( options, "BLOCKXSIZE", "256" );
@@ -207,7 +335,11 @@ char** io::getExportOptionsGeoTIFF(GDALProfile gdal_profile)
       options = CSLSetNameValue( options, "PHOTOMETRIC", "MINISBLACK");
       options = CSLSetNameValue( options, "BIGTIFF", "IF_SAFER");
       options = CSLSetNameValue( options, "COPY_SRC_OVERVIEWS", "YES" );
-      options = CSLSetNameValue( options, "COMPRESS", "LZW" );
+      options = CSLSetNameValue( options, "NUM_THREADS", "ALL_CPUS" );
+      if (gdal_profile == GDALProfile::COG)
+        options = CSLSetNameValue( options, "COMPRESS", "LZW" );
+      else if (gdal_profile == GDALProfile::COG_DEFLATE)
+        options = CSLSetNameValue( options, "COMPRESS", "DEFLATE" );
       break;
     default:
       throw(std::invalid_argument("Error: Unknown GDAL export profile."));
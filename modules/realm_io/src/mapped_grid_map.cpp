@@ -0,0 +1,256 @@
+
+
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <realm_io/mapped_grid_map.h>
+
+using namespace realm;
+
+namespace
+{
+
+const char g_magic[8] = {'R', 'E', 'A', 'L', 'M', 'G', 'R', 'D'};
+const uint32_t g_version = 1;
+
+//! Layer blobs start at multiples of this, so they are aligned to pages on all common platforms
+const uint64_t g_alignment = 4096;
+
+struct FileHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t nrof_layers;
+  double roi[4];
+  double resolution;
+  int32_t cols;
+  int32_t rows;
+};
+
+uint64_t alignOffset(uint64_t offset)
+{
+  return (offset + g_alignment - 1) / g_alignment * g_alignment;
+}
+
+bool hasSuffix(const std::string &filepath)
+{
+  const std::string suffix = ".grid.mmap";
+  return filepath.size() >= suffix.size() && filepath.compare(filepath.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+} // namespace
+
+io::MappedGridMap::MappedGridMap(const std::string &filepath)
+ : m_data(nullptr),
+   m_size_bytes(0),
+   m_resolution(0.0)
+{
+  if (!hasSuffix(filepath))
+    throw(std::invalid_argument("Error loading CvGridMap: Unknown suffix"));
+
+  int fd = open(filepath.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw(std::invalid_argument("Error loading CvGridMap: File could not be opened!"));
+
+  struct stat st{};
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(FileHeader))
+  {
+    close(fd);
+    throw(std::runtime_error("Error loading CvGridMap: File is too small to contain a header!"));
+  }
+
+  m_size_bytes = static_cast<size_t>(st.st_size);
+  m_data = mmap(nullptr, m_size_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  // The mapping stays valid after the descriptor is closed
+  close(fd);
+
+  if (m_data == MAP_FAILED)
+  {
+    m_data = nullptr;
+    throw(std::runtime_error("Error loading CvGridMap: Mapping file failed!"));
+  }
+
+  const auto base = static_cast<const uint8_t*>(m_data);
+
+  FileHeader header;
+  std::memcpy(&header, base, sizeof(FileHeader));
+  if (std::memcmp(header.magic, g_magic, sizeof(g_magic)) != 0 || header.version != g_version)
+  {
+    munmap(m_data, m_size_bytes);
+    throw(std::runtime_error("Error loading CvGridMap: File is no mapped grid map or of an unsupported version!"));
+  }
+
+  m_roi = cv::Rect2d(header.roi[0], header.roi[1], header.roi[2], header.roi[3]);
+  m_resolution = header.resolution;
+  m_size = cv::Size(header.cols, header.rows);
+
+  size_t size_table = header.nrof_layers * sizeof(LayerEntry);
+  if (sizeof(FileHeader) + size_table > m_size_bytes)
+  {
+    munmap(m_data, m_size_bytes);
+    throw(std::runtime_error("Error loading CvGridMap: Layer table is truncated!"));
+  }
+
+  m_layers.resize(header.nrof_layers);
+  std::memcpy(m_layers.data(), base + sizeof(FileHeader), size_table);
+
+  // Layers without data have a size of zero, all others cover the complete grid
+  for (auto &layer : m_layers)
+  {
+    layer.name[sizeof(layer.name) - 1] = '\0';
+    uint64_t size_expected = static_cast<uint64_t>(m_size.area()) * CV_ELEM_SIZE(layer.type);
+    if (layer.offset + layer.size > m_size_bytes || (layer.size != 0 && layer.size != size_expected))
+    {
+      munmap(m_data, m_size_bytes);
+      throw(std::runtime_error("Error loading CvGridMap: Layer data is truncated!"));
+    }
+  }
+}
+
+io::MappedGridMap::~MappedGridMap()
+{
+  if (m_data != nullptr)
+    munmap(m_data, m_size_bytes);
+}
+
+void io::MappedGridMap::save(const CvGridMap &map, const std::string &filepath)
+{
+  if (!hasSuffix(filepath))
+    throw(std::invalid_argument("Error saving CvGridMap to binary. Suffix not supported!"));
+
+  std::vector<std::string> layer_names = map.getAllLayerNames();
+  cv::Size size = map.size();
+
+  FileHeader header{};
+  std::memcpy(header.magic, g_magic, sizeof(g_magic));
+  header.version = g_version;
+  header.nrof_layers = static_cast<uint32_t>(layer_names.size());
+  cv::Rect2d roi = map.roi();
+  header.roi[0] = roi.x;
+  header.roi[1] = roi.y;
+  header.roi[2] = roi.width;
+  header.roi[3] = roi.height;
+  header.resolution = map.resolution();
+  header.cols = size.width;
+  header.rows = size.height;
+
+  // The layer table is complete before any data is written, so the offsets are computed up front
+  std::vector<LayerEntry> layers(layer_names.size());
+  uint64_t offset = alignOffset(sizeof(FileHeader) + layers.size() * sizeof(LayerEntry));
+  for (size_t i = 0; i < layer_names.size(); ++i)
+  {
+    if (layer_names[i].size() >= sizeof(LayerEntry::name))
+      throw(std::invalid_argument("Error saving CvGridMap to binary. Layer name is too long!"));
+
+    CvGridMap::Layer layer = map.getLayer(layer_names[i]);
+
+    LayerEntry &entry = layers[i];
+    std::memset(&entry, 0, sizeof(LayerEntry));
+    std::strncpy(entry.name, layer_names[i].c_str(), sizeof(entry.name) - 1);
+    entry.type = layer.data.type();
+    entry.interpolation = layer.interpolation;
+    entry.offset = offset;
+    entry.size = static_cast<uint64_t>(layer.data.total()) * layer.data.elemSize();
+
+    offset = alignOffset(offset + entry.size);
+  }
+
+  FILE* file = fopen(filepath.c_str(), "wb");
+  if (file == nullptr)
+    throw(std::runtime_error("Error saving CvGridMap to binary. File could not be opened!"));
+
+  fwrite(&header, sizeof(FileHeader), 1, file);
+  fwrite(layers.data(), sizeof(LayerEntry), layers.size(), file);
+
+  std::vector<uint8_t> padding(g_alignment, 0);
+  for (size_t i = 0; i < layer_names.size(); ++i)
+  {
+    // Pad up to the page-aligned start of the layer
+    long position = ftell(file);
+    fwrite(padding.data(), 1, static_cast<size_t>(layers[i].offset - position), file);
+
+    // Operating rowise, so even non-continuous matrices are properly written to binary
+    cv::Mat data = map.getLayer(layer_names[i]).data;
+    for (int r = 0; r < data.rows; ++r)
+      fwrite(data.ptr<void>(r), data.elemSize(), data.cols, file);
+  }
+
+  // The file is padded to the end of the last page, so it never ends inside a layer blob
+  long position = ftell(file);
+  fwrite(padding.data(), 1, static_cast<size_t>(offset - position), file);
+
+  if (fclose(file) != 0)
+    throw(std::runtime_error("Error saving CvGridMap to binary. Writing file failed!"));
+}
+
+cv::Rect2d io::MappedGridMap::roi() const
+{
+  return m_roi;
+}
+
+double io::MappedGridMap::resolution() const
+{
+  return m_resolution;
+}
+
+cv::Size io::MappedGridMap::size() const
+{
+  return m_size;
+}
+
+std::vector<std::string> io::MappedGridMap::getAllLayerNames() const
+{
+  std::vector<std::string> layer_names;
+  for (const auto &layer : m_layers)
+    layer_names.emplace_back(layer.name);
+  return layer_names;
+}
+
+bool io::MappedGridMap::exists(const std::string &layer_name) const
+{
+  for (const auto &layer : m_layers)
+    if (layer_name == layer.name)
+      return true;
+  return false;
+}
+
+cv::Mat io::MappedGridMap::getLayerView(const std::string &layer_name) const
+{
+  const LayerEntry &layer = findLayer(layer_name);
+  if (layer.size == 0)
+    return cv::Mat();
+
+  // OpenCV has no read-only matrices, writing to the view would fault, as the pages are mapped read-only
+  auto data = const_cast<uint8_t*>(static_cast<const uint8_t*>(m_data) + layer.offset);
+  return cv::Mat(m_size, layer.type, data);
+}
+
+int io::MappedGridMap::getLayerInterpolation(const std::string &layer_name) const
+{
+  return findLayer(layer_name).interpolation;
+}
+
+CvGridMap::Ptr io::MappedGridMap::toCvGridMap(const std::vector<std::string> &layer_names) const
+{
+  auto map = std::make_shared<CvGridMap>(m_roi, m_resolution);
+  for (const auto &layer_name : (layer_names.empty() ? getAllLayerNames() : layer_names))
+  {
+    cv::Mat data = getLayerView(layer_name);
+    map->add(CvGridMap::Layer{layer_name, data.clone(), getLayerInterpolation(layer_name)}, data.empty());
+  }
+  return map;
+}
+
+const io::MappedGridMap::LayerEntry& io::MappedGridMap::findLayer(const std::string &layer_name) const
+{
+  for (const auto &layer : m_layers)
+    if (layer_name == layer.name)
+      return layer;
+  throw(std::out_of_range("Error: Layer '" + layer_name + "' does not exist in mapped grid map."));
+}
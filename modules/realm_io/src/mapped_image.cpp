@@ -0,0 +1,87 @@
+
+
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <realm_io/mapped_image.h>
+
+using namespace realm;
+
+namespace
+{
+
+//! Header of io::saveImageToBinary: cols, rows, element size in bytes and OpenCV type
+const size_t g_size_header = 4 * sizeof(int);
+
+bool hasSuffix(const std::string &filepath)
+{
+  const std::string suffix = ".bin";
+  return filepath.size() >= suffix.size() && filepath.compare(filepath.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+} // namespace
+
+io::MappedImage::MappedImage(const std::string &filepath)
+ : m_data(nullptr),
+   m_size_bytes(0),
+   m_rows(0),
+   m_cols(0),
+   m_type(0)
+{
+  if (!hasSuffix(filepath))
+    throw(std::invalid_argument("Error loading image: Unknown suffix"));
+
+  int fd = open(filepath.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw(std::invalid_argument("Error loading image: File could not be opened!"));
+
+  struct stat st{};
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < g_size_header)
+  {
+    close(fd);
+    throw(std::runtime_error("Error loading image: File is too small to contain a header!"));
+  }
+
+  // Copy-on-write, so views can be written to without affecting the file. Pages are only copied once written.
+  m_size_bytes = static_cast<size_t>(st.st_size);
+  m_data = mmap(nullptr, m_size_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+  // The mapping stays valid after the descriptor is closed
+  close(fd);
+
+  if (m_data == MAP_FAILED)
+  {
+    m_data = nullptr;
+    throw(std::runtime_error("Error loading image: Mapping file failed!"));
+  }
+
+  const auto header = static_cast<const int*>(m_data);
+  m_cols = header[0];
+  m_rows = header[1];
+  int elem_size_in_bytes = header[2];
+  m_type = header[3];
+
+  if (m_cols < 0 || m_rows < 0 || elem_size_in_bytes != static_cast<int>(CV_ELEM_SIZE(m_type))
+      || g_size_header + static_cast<size_t>(m_cols) * m_rows * elem_size_in_bytes > m_size_bytes)
+  {
+    munmap(m_data, m_size_bytes);
+    m_data = nullptr;
+    throw(std::runtime_error("Error loading image: Elements do not match matrix dimension!"));
+  }
+}
+
+io::MappedImage::~MappedImage()
+{
+  if (m_data != nullptr)
+    munmap(m_data, m_size_bytes);
+}
+
+cv::Mat io::MappedImage::getView() const
+{
+  // The header is 16 bytes, so the data keeps the alignment of the page for all element types
+  return cv::Mat(m_rows, m_cols, m_type, static_cast<uint8_t*>(m_data) + g_size_header);
+}
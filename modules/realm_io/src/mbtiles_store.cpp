@@ -0,0 +1,154 @@
+
+
+#include <stdexcept>
+
+#include <sqlite3.h>
+
+#include <realm_io/mbtiles_store.h>
+
+using namespace realm;
+
+io::MbtilesStore::MbtilesStore(const std::string &filepath, const std::string &name, const std::string &format)
+    : m_filepath(filepath),
+      m_db(nullptr),
+      m_stmt_write(nullptr),
+      m_stmt_read(nullptr),
+      m_nrof_pending(0)
+{
+  if (sqlite3_open(m_filepath.c_str(), &m_db) != SQLITE_OK)
+  {
+    std::string msg = (m_db ? sqlite3_errmsg(m_db) : "out of memory");
+    sqlite3_close(m_db);
+    throw(std::runtime_error("Error: Could not open MBTiles file '" + m_filepath + "': " + msg));
+  }
+
+  try
+  {
+    // Write ahead logging turns committed batches into sequential appends without blocking readers
+    execute("PRAGMA journal_mode=WAL;");
+    execute("PRAGMA synchronous=NORMAL;");
+    execute("CREATE TABLE IF NOT EXISTS metadata (name TEXT, value TEXT);");
+    execute("CREATE UNIQUE INDEX IF NOT EXISTS metadata_index ON metadata (name);");
+    execute("CREATE TABLE IF NOT EXISTS tiles (zoom_level INTEGER, tile_column INTEGER, tile_row INTEGER, tile_data BLOB);");
+    execute("CREATE UNIQUE INDEX IF NOT EXISTS tile_index ON tiles (zoom_level, tile_column, tile_row);");
+
+    sqlite3_stmt* stmt_metadata = nullptr;
+    if (sqlite3_prepare_v2(m_db, "INSERT OR REPLACE INTO metadata (name, value) VALUES (?, ?);", -1, &stmt_metadata, nullptr) != SQLITE_OK)
+      throw(std::runtime_error("Error: Preparing metadata statement failed: " + std::string(sqlite3_errmsg(m_db))));
+
+    std::vector<std::pair<std::string, std::string>> metadata{{"name", name}, {"format", format}, {"type", "overlay"}, {"version", "1.3"}};
+    for (const auto &entry : metadata)
+    {
+      sqlite3_bind_text(stmt_metadata, 1, entry.first.c_str(), -1, SQLITE_TRANSIENT);
+      sqlite3_bind_text(stmt_metadata, 2, entry.second.c_str(), -1, SQLITE_TRANSIENT);
+      int result = sqlite3_step(stmt_metadata);
+      sqlite3_reset(stmt_metadata);
+      if (result != SQLITE_DONE)
+      {
+        sqlite3_finalize(stmt_metadata);
+        throw(std::runtime_error("Error: Writing metadata failed: " + std::string(sqlite3_errmsg(m_db))));
+      }
+    }
+    sqlite3_finalize(stmt_metadata);
+
+    if (sqlite3_prepare_v2(m_db, "INSERT OR REPLACE INTO tiles (zoom_level, tile_column, tile_row, tile_data) VALUES (?, ?, ?, ?);", -1, &m_stmt_write, nullptr) != SQLITE_OK
+        || sqlite3_prepare_v2(m_db, "SELECT tile_data FROM tiles WHERE zoom_level = ? AND tile_column = ? AND tile_row = ?;", -1, &m_stmt_read, nullptr) != SQLITE_OK)
+      throw(std::runtime_error("Error: Preparing tile statements failed: " + std::string(sqlite3_errmsg(m_db))));
+  }
+  catch (...)
+  {
+    sqlite3_finalize(m_stmt_write);
+    sqlite3_finalize(m_stmt_read);
+    sqlite3_close(m_db);
+    throw;
+  }
+}
+
+io::MbtilesStore::~MbtilesStore()
+{
+  std::lock_guard<std::mutex> lock(m_mutex_db);
+  try
+  {
+    commitPending();
+  }
+  catch (const std::exception &)
+  {
+    // Destructor must not throw, pending tiles are lost
+  }
+  sqlite3_finalize(m_stmt_write);
+  sqlite3_finalize(m_stmt_read);
+  sqlite3_close(m_db);
+}
+
+void io::MbtilesStore::write(int zoom_level, int tx, int ty, const std::vector<uint8_t> &data)
+{
+  std::lock_guard<std::mutex> lock(m_mutex_db);
+
+  if (m_nrof_pending == 0)
+    execute("BEGIN TRANSACTION;");
+
+  sqlite3_bind_int(m_stmt_write, 1, zoom_level);
+  sqlite3_bind_int(m_stmt_write, 2, tx);
+  sqlite3_bind_int(m_stmt_write, 3, ty);
+  sqlite3_bind_blob(m_stmt_write, 4, data.data(), static_cast<int>(data.size()), SQLITE_STATIC);
+  int result = sqlite3_step(m_stmt_write);
+  sqlite3_reset(m_stmt_write);
+  sqlite3_clear_bindings(m_stmt_write);
+
+  if (result != SQLITE_DONE)
+    throw(std::runtime_error("Error: Writing tile to '" + m_filepath + "' failed: " + std::string(sqlite3_errmsg(m_db))));
+
+  if (++m_nrof_pending >= kBatchSize)
+    commitPending();
+}
+
+bool io::MbtilesStore::read(int zoom_level, int tx, int ty, std::vector<uint8_t> &data)
+{
+  std::lock_guard<std::mutex> lock(m_mutex_db);
+
+  sqlite3_bind_int(m_stmt_read, 1, zoom_level);
+  sqlite3_bind_int(m_stmt_read, 2, tx);
+  sqlite3_bind_int(m_stmt_read, 3, ty);
+
+  bool is_found = false;
+  int result = sqlite3_step(m_stmt_read);
+  if (result == SQLITE_ROW)
+  {
+    auto blob = static_cast<const uint8_t*>(sqlite3_column_blob(m_stmt_read, 0));
+    int bytes = sqlite3_column_bytes(m_stmt_read, 0);
+    data.assign(blob, blob + bytes);
+    is_found = true;
+  }
+  sqlite3_reset(m_stmt_read);
+  sqlite3_clear_bindings(m_stmt_read);
+
+  if (result != SQLITE_ROW && result != SQLITE_DONE)
+    throw(std::runtime_error("Error: Reading tile from '" + m_filepath + "' failed: " + std::string(sqlite3_errmsg(m_db))));
+  return is_found;
+}
+
+void io::MbtilesStore::commit()
+{
+  std::lock_guard<std::mutex> lock(m_mutex_db);
+  commitPending();
+}
+
+void io::MbtilesStore::execute(const std::string &sql)
+{
+  char* msg = nullptr;
+  if (sqlite3_exec(m_db, sql.c_str(), nullptr, nullptr, &msg) != SQLITE_OK)
+  {
+    std::string error = (msg ? msg : "unknown error");
+    sqlite3_free(msg);
+    throw(std::runtime_error("Error: Executing '" + sql + "' on '" + m_filepath + "' failed: " + error));
+  }
+}
+
+void io::MbtilesStore::commitPending()
+{
+  if (m_nrof_pending == 0)
+    return;
+
+  m_nrof_pending = 0;
+  execute("COMMIT;");
+}
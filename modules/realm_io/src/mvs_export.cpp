@@ -1,12 +1,21 @@
 #include <realm_io/mvs_export.h>
 #include <realm_core/loguru.h>
 
+#include <stdexcept>
 #include <unordered_map>
 
+#include <opencv2/imgcodecs.hpp>
+
 using namespace realm::io;
 
-void MvsExport::saveFrames(const std::vector<Frame::Ptr> &frames, const std::string &directory)
+void MvsExport::saveFrames(const std::vector<Frame::Ptr> &frames,
+                           const std::string &directory,
+                           const ThreadPool::Ptr &thread_pool,
+                           int nrof_threads)
 {
+  if (frames.empty())
+    throw(std::invalid_argument("Error saving MVS interface: No frames provided."));
+
   Frame::Ptr first_frame = frames.front();
 
   UTMPose utm = first_frame->getGnssUtm();
@@ -25,15 +34,16 @@ void MvsExport::saveFrames(const std::vector<Frame::Ptr> &frames, const std::str
   camera.C         = MvsInterface::Pos3d(0, 0, 0);
   platform.cameras.push_back(camera);
 
-  std::unordered_map<uint32_t, MvsInterface::Vertex> sparse_cloud_map;
+  platform.poses.reserve(frames.size());
+  interface.images.reserve(frames.size());
 
-  std::vector<Frame::Ptr> frames_selected;
-  for (int i = 0; i < frames.size(); i++)
-    frames_selected.push_back(frames[i]);
+  // Vertices are appended to the interface as soon as they are first observed, the map only keeps their index. So no
+  // second copy of the sparse cloud is built and handed over at the end.
+  std::unordered_map<uint32_t, uint32_t> vertex_indices;
 
-  for (int i = 0; i < frames_selected.size(); ++i)
+  for (size_t i = 0; i < frames.size(); ++i)
   {
-    Frame::Ptr f = frames_selected.at(i);
+    const Frame::Ptr &f = frames[i];
     cv::Mat t = f->getCamera()->t();
 
     MvsInterface::Platform::Pose pose;
@@ -41,48 +51,53 @@ void MvsExport::saveFrames(const std::vector<Frame::Ptr> &frames, const std::str
     pose.C         = MvsInterface::Pos3d(t.at<double>(0) - utm.easting, t.at<double>(1) - utm.northing, t.at<double>(2));
     platform.poses.push_back(pose);
 
-    std::string filename = directory + "/image_" + std::to_string(i) + ".png";
-    std::cout << "filename: " << filename << std::endl;
-    cv::imwrite(filename, f->getImageUndistorted());
-
     MvsInterface::Image img;
-    img.name       = filename;
+    img.name       = directory + "/image_" + std::to_string(i) + ".png";
     img.cameraID   = 0;
     img.platformID = 0;
-    img.poseID     = i;
+    img.poseID     = static_cast<uint32_t>(i);
     interface.images.push_back(img);
 
     MvsInterface::Vertex::View view;
-    view.imageID    = i;
+    view.imageID    = static_cast<uint32_t>(i);
     view.confidence = 0.;
 
-    cv::Mat points = f->getSparseCloud()->data();
-    std::vector<uint32_t> point_ids = f->getSparseCloud()->getPointIds();
+    PointCloud::Ptr sparse_cloud = f->getSparseCloud();
+    if (sparse_cloud == nullptr)
+      continue;
 
-    for (int j = 0; j < points.rows; ++j)
+    const std::vector<uint32_t> &point_ids = sparse_cloud->getPointIds();
+    vertex_indices.reserve(vertex_indices.size() + point_ids.size());
+
+    for (int j = 0; j < sparse_cloud->size(); ++j)
     {
-      uint32_t id = point_ids[j];
-      auto it = sparse_cloud_map.find(id);
-      if (it != sparse_cloud_map.end())
-      {
-        it->second.views.push_back(view);
-      }
-      else
+      auto it = vertex_indices.emplace(point_ids[j], static_cast<uint32_t>(interface.vertices.size()));
+      if (!it.second)
       {
-        MvsInterface::Vertex vertex;
-        vertex.X.x = static_cast<float>(points.at<double>(j, 0) - utm.easting);
-        vertex.X.y = static_cast<float>(points.at<double>(j, 1) - utm.northing);
-        vertex.X.z = static_cast<float>(points.at<double>(j, 2));
-        vertex.views.push_back(view);
-        sparse_cloud_map[id] = vertex;
+        interface.vertices[it.first->second].views.push_back(view);
+        continue;
       }
+
+      MvsInterface::Vertex vertex;
+      cv::Point3d pt = sparse_cloud->getPoint(j);
+      vertex.X.x = static_cast<float>(pt.x - utm.easting);
+      vertex.X.y = static_cast<float>(pt.y - utm.northing);
+      vertex.X.z = static_cast<float>(pt.z);
+      vertex.views.push_back(view);
+      interface.vertices.push_back(std::move(vertex));
     }
   }
 
-  for (const auto& it : sparse_cloud_map)
-    interface.vertices.push_back(it.second);
-
   interface.platforms.push_back(platform);
 
+  // Images are undistorted and encoded independently. Only as many are in memory at once as there are workers.
+  parallelFor(thread_pool, cv::Range(0, static_cast<int>(frames.size())), [&](const cv::Range &range)
+  {
+    for (int i = range.start; i < range.end; ++i)
+      if (!cv::imwrite(interface.images[i].name, frames[i]->getImageUndistorted()))
+        LOG_F(WARNING, "Failed writing image for MVS interface: %s", interface.images[i].name.c_str());
+  }, nrof_threads);
+  LOG_F(INFO, "Saved %lu images for MVS interface to %s", frames.size(), directory.c_str());
+
   MvsArchive::SerializeSave(interface, directory + "/data.mvs");
-}
\ No newline at end of file
+}
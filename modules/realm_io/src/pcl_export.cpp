@@ -1,12 +1,11 @@
 
 
-#include <realm_io/pcl_export.h>
-
-#include <opencv2/imgproc.hpp>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
 
-#include <pcl/io/ply_io.h>
-#include <pcl/conversions.h>
-#include <pcl/point_types.h>
+#include <realm_io/pcl_export.h>
 
 #include <realm_core/cv_grid_map.h>
 
@@ -15,6 +14,166 @@ namespace realm
 namespace io
 {
 
+namespace
+{
+
+/*!
+ * @brief Buffered writer for binary PLY files. Vertices and faces are serialized directly into a large buffer, which
+ * is written with a single call once it is full. Data is written in the byte order of the host, which is announced
+ * in the header.
+ */
+class PlyWriter
+{
+  public:
+    explicit PlyWriter(const std::string &filename)
+        : m_file(fopen(filename.c_str(), "wb")),
+          m_offset(0)
+    {
+      if (m_file == nullptr)
+        throw(std::runtime_error("Error writing PLY: File '" + filename + "' could not be opened!"));
+      m_buffer.resize(1 << 22);
+    }
+
+    ~PlyWriter()
+    {
+      if (m_file != nullptr)
+        fclose(m_file);
+    }
+
+    void writeHeader(size_t nrof_vertices, bool has_normals, size_t nrof_faces)
+    {
+      const uint16_t probe = 1;
+      bool is_little_endian = (*reinterpret_cast<const uint8_t*>(&probe) == 1);
+
+      std::string header = "ply\n";
+      header += (is_little_endian ? "format binary_little_endian 1.0\n" : "format binary_big_endian 1.0\n");
+      header += "element vertex " + std::to_string(nrof_vertices) + "\n";
+      header += "property float x\nproperty float y\nproperty float z\n";
+      if (has_normals)
+        header += "property float nx\nproperty float ny\nproperty float nz\n";
+      header += "property uchar red\nproperty uchar green\nproperty uchar blue\n";
+      if (nrof_faces > 0)
+      {
+        header += "element face " + std::to_string(nrof_faces) + "\n";
+        header += "property list uchar int vertex_indices\n";
+      }
+      header += "end_header\n";
+      write(header.data(), header.size());
+    }
+
+    template <typename T>
+    void write(const T &value)
+    {
+      write(&value, sizeof(T));
+    }
+
+    void write(const void* data, size_t size)
+    {
+      if (m_offset + size > m_buffer.size())
+        flush();
+      if (size > m_buffer.size())
+      {
+        fwrite(data, 1, size, m_file);
+        return;
+      }
+      std::memcpy(m_buffer.data() + m_offset, data, size);
+      m_offset += size;
+    }
+
+    void close()
+    {
+      flush();
+      int result = fclose(m_file);
+      m_file = nullptr;
+      if (result != 0)
+        throw(std::runtime_error("Error writing PLY: Writing file failed!"));
+    }
+
+  private:
+    FILE* m_file;
+    std::vector<char> m_buffer;
+    size_t m_offset;
+
+    void flush()
+    {
+      if (m_offset > 0 && fwrite(m_buffer.data(), 1, m_offset, m_file) != m_offset)
+        throw(std::runtime_error("Error writing PLY: Writing file failed!"));
+      m_offset = 0;
+    }
+};
+
+/*!
+ * @brief Layers of a grid map prepared for streaming the valid cells as vertices
+ */
+struct ElevationCloud
+{
+  cv::Mat elevation;
+  cv::Mat normals;
+  cv::Mat color;
+  cv::Mat mask;
+  cv::Rect2d roi;
+  double resolution;
+};
+
+ElevationCloud prepareElevationCloud(const CvGridMap &map,
+                                     const std::string &ele_layer_name,
+                                     const std::string &normals_layer_name,
+                                     const std::string &color_layer_name,
+                                     const std::string &mask_layer_name)
+{
+  ElevationCloud cloud;
+  cloud.roi = map.roi();
+  cloud.resolution = map.resolution();
+
+  cloud.elevation = map[ele_layer_name];
+  if (cloud.elevation.type() != CV_32FC1)
+    cloud.elevation.convertTo(cloud.elevation, CV_32FC1);
+
+  if (!normals_layer_name.empty())
+  {
+    cloud.normals = map[normals_layer_name];
+    if (cloud.normals.type() != CV_32FC3)
+      throw(std::invalid_argument("Error writing PLY: Normals must be of type CV_32FC3!"));
+  }
+
+  cloud.color = map[color_layer_name];
+  if (cloud.color.type() != CV_8UC3 && cloud.color.type() != CV_8UC4)
+    throw(std::invalid_argument("Error writing PLY: Color must be of type CV_8UC3 or CV_8UC4!"));
+
+  // The mask is optional, invalid elevation is always skipped
+  if (!mask_layer_name.empty() && map.exists(mask_layer_name) && !map[mask_layer_name].empty())
+  {
+    cloud.mask = map[mask_layer_name];
+    if (cloud.mask.type() != CV_8UC1)
+      throw(std::invalid_argument("Error writing PLY: Mask must be of type CV_8UC1!"));
+  }
+  return cloud;
+}
+
+inline bool isValid(const ElevationCloud &cloud, int r, int c)
+{
+  float z = cloud.elevation.at<float>(r, c);
+  return std::isfinite(z) && (cloud.mask.empty() || cloud.mask.at<uchar>(r, c) > 0);
+}
+
+inline void writeVertex(PlyWriter &writer, const ElevationCloud &cloud, int r, int c)
+{
+  // ENU world frame, same as CvGridMap::atPosition3d
+  float xyz[3] = {static_cast<float>(cloud.roi.x + static_cast<double>(c) * cloud.resolution),
+                  static_cast<float>(cloud.roi.y + cloud.roi.height - static_cast<double>(r) * cloud.resolution),
+                  cloud.elevation.at<float>(r, c)};
+  writer.write(xyz, sizeof(xyz));
+
+  if (!cloud.normals.empty())
+    writer.write(cloud.normals.at<cv::Vec3f>(r, c));
+
+  const uchar* bgr = cloud.color.ptr<uchar>(r) + c * cloud.color.channels();
+  uchar rgb[3] = {bgr[2], bgr[1], bgr[0]};
+  writer.write(rgb, sizeof(rgb));
+}
+
+} // namespace
+
 void saveElevationPointsToPLY(const CvGridMap &map,
                               const std::string &ele_layer_name,
                               const std::string &normals_layer_name,
@@ -35,10 +194,6 @@ void saveElevationPoints(const CvGridMap &map,
                          const std::string &filename,
                          const std::string &suffix)
 {
-  assert(map.exists(ele_layer_name));
-  assert(normals_layer_name.empty() ? map.exists(normals_layer_name) : true);
-  assert(map.exists(mask_layer_name));
-
   if (normals_layer_name.empty())
     saveElevationPointsRGB(map, ele_layer_name, color_layer_name, mask_layer_name, filename, suffix);
   else
@@ -52,50 +207,7 @@ void saveElevationPointsRGB(const CvGridMap &map,
                             const std::string &filename,
                             const std::string &suffix)
 {
-  assert(map.exists(ele_layer_name));
-  assert(map.exists(color_layer_name));
-  assert(map.exists(mask_layer_name));
-
-  cv::Size2i size = map.size();
-  auto n = static_cast<uint32_t>(size.width*size.height);
-
-  cv::Mat elevation = map[ele_layer_name];
-  cv::Mat mask = (elevation == elevation);
-  cv::Mat color = map[color_layer_name];
-  if (color.type() == CV_8UC4)
-    cv::cvtColor(color, color, cv::ColorConversionCodes::COLOR_BGRA2BGR);
-
-  // Fill in the cloud data
-  pcl::PointCloud<pcl::PointXYZRGB> cloud;
-  cloud.width    = n;
-  cloud.height   = 1;
-  cloud.is_dense = false;
-  cloud.points.reserve(cloud.width * cloud.height);
-
-  for (int r = 0; r < size.height; ++r)
-    for (int c = 0; c < size.width; ++c)
-    {
-      // Skip invalid grid elements
-      if (mask.at<uchar>(r, c) == 0)
-        continue;
-
-      cv::Point3d pt = map.atPosition3d(r, c, "elevation");
-      cv::Vec3b bgr = color.at<cv::Vec3b>(r, c);
-
-      pcl::PointXYZRGB pt_rgb;
-      pt_rgb.x = static_cast<float>(pt.x);
-      pt_rgb.y = static_cast<float>(pt.y);
-      pt_rgb.z = static_cast<float>(pt.z);
-      pt_rgb.r = bgr[2];
-      pt_rgb.g = bgr[1];
-      pt_rgb.b = bgr[0];
-
-      cloud.push_back(pt_rgb);
-    }
-  cloud.resize(cloud.size());
-
-  if (suffix == "ply")
-    pcl::io::savePLYFileBinary(filename, cloud);
+  saveElevationPointsRGBNormal(map, ele_layer_name, "", color_layer_name, mask_layer_name, filename, suffix);
 }
 
 void saveElevationPointsRGBNormal(const CvGridMap &map,
@@ -106,56 +218,25 @@ void saveElevationPointsRGBNormal(const CvGridMap &map,
                                   const std::string &filename,
                                   const std::string &suffix)
 {
-  assert(map.exists(ele_layer_name));
-  assert(map.exists(normals_layer_name));
-  assert(map.exists(color_layer_name));
-  assert(map.exists(mask_layer_name));
-
-  cv::Size2i size = map.size();
-  auto n = static_cast<uint32_t>(size.width*size.height);
-
-  cv::Mat elevation = map[ele_layer_name];
-  cv::Mat elevation_normals = map[normals_layer_name];
-  cv::Mat mask = map[mask_layer_name];
-  cv::Mat color = map[color_layer_name];
-  if (color.type() == CV_8UC4)
-    cv::cvtColor(color, color, cv::ColorConversionCodes::COLOR_BGRA2BGR);
-
-  // Fill in the cloud data
-  pcl::PointCloud<pcl::PointXYZRGBNormal> cloud;
-  cloud.width    = n;
-  cloud.height   = 1;
-  cloud.is_dense = false;
-  cloud.points.reserve(cloud.width * cloud.height);
-
-  for (int r = 0; r < size.height; ++r)
-    for (int c = 0; c < size.width; ++c)
-    {
-      // Skip invalid grid elements
-      if (mask.at<uchar>(r, c) == 0)
-        continue;
-
-      cv::Point3d pt = map.atPosition3d(r, c, "elevation");
-      cv::Vec3f normal = elevation_normals.at<cv::Vec3f>(r, c);
-      cv::Vec3b bgr = color.at<cv::Vec3b>(r, c);
-
-      pcl::PointXYZRGBNormal pt_rgb;
-      pt_rgb.x = static_cast<float>(pt.x);
-      pt_rgb.y = static_cast<float>(pt.y);
-      pt_rgb.z = static_cast<float>(pt.z);
-      pt_rgb.r = bgr[2];
-      pt_rgb.g = bgr[1];
-      pt_rgb.b = bgr[0];
-      pt_rgb.normal_x = normal[0];
-      pt_rgb.normal_y = normal[1];
-      pt_rgb.normal_z = normal[2];
-
-      cloud.push_back(pt_rgb);
-    }
-  cloud.resize(cloud.size());
-
-  if (suffix == "ply")
-    pcl::io::savePLYFileBinary(filename, cloud);
+  if (suffix != "ply")
+    return;
+
+  ElevationCloud cloud = prepareElevationCloud(map, ele_layer_name, normals_layer_name, color_layer_name, mask_layer_name);
+
+  // The number of vertices is part of the header, so valid cells are counted before streaming them
+  size_t nrof_vertices = 0;
+  for (int r = 0; r < cloud.elevation.rows; ++r)
+    for (int c = 0; c < cloud.elevation.cols; ++c)
+      if (isValid(cloud, r, c))
+        nrof_vertices++;
+
+  PlyWriter writer(filename);
+  writer.writeHeader(nrof_vertices, !cloud.normals.empty(), 0);
+  for (int r = 0; r < cloud.elevation.rows; ++r)
+    for (int c = 0; c < cloud.elevation.cols; ++c)
+      if (isValid(cloud, r, c))
+        writeVertex(writer, cloud, r, c);
+  writer.close();
 }
 
 void saveElevationMeshToPLY(const CvGridMap &map,
@@ -179,72 +260,48 @@ void saveElevationMeshToPLY(const CvGridMap &map,
                             const std::string &mask_layer_name,
                             const std::string &filename)
 {
-  assert(map.exists(ele_layer_name));
-  assert(map.exists(normal_layer_name));
-  assert(map.exists(color_layer_name));
-  assert(map.exists(mask_layer_name));
-
-  cv::Size2i size = map.size();
-  auto n = static_cast<uint32_t>(size.width*size.height);
-
-  cv::Mat elevation = map[ele_layer_name];
-  cv::Mat elevation_normals = map[normal_layer_name];
-  cv::Mat mask = map[mask_layer_name];
-  cv::Mat color = map[color_layer_name];
-  if (color.type() == CV_8UC4)
-    cv::cvtColor(color, color, cv::ColorConversionCodes::COLOR_BGRA2BGR);
-
-  // Fill in the cloud data
-  pcl::PointCloud<pcl::PointXYZRGBNormal> cloud;
-  cloud.width    = n;
-  cloud.height   = 1;
-  cloud.is_dense = false;
-  cloud.points.reserve(cloud.width * cloud.height);
-
-  std::unordered_map<int, size_t> rc_to_idx;
-  for (int r = 0; r < size.height; ++r)
-    for (int c = 0; c < size.width; ++c)
-    {
-      // Skip invalid grid elements
-      if (mask.at<uchar>(r, c) == 0)
-        continue;
-
-      cv::Point3d pt = map.atPosition3d(r, c, "elevation");
-      cv::Vec3f normal = elevation_normals.at<cv::Vec3f>(r, c);
-      cv::Vec3b bgr = color.at<cv::Vec3b>(r, c);
-
-      pcl::PointXYZRGBNormal pt_rgb;
-      pt_rgb.x = static_cast<float>(pt.x);
-      pt_rgb.y = static_cast<float>(pt.y);
-      pt_rgb.z = static_cast<float>(pt.z);
-      pt_rgb.r = bgr[2];
-      pt_rgb.g = bgr[1];
-      pt_rgb.b = bgr[0];
-      pt_rgb.normal_x = normal[0];
-      pt_rgb.normal_y = normal[1];
-      pt_rgb.normal_z = normal[2];
-
-      cloud.push_back(pt_rgb);
-
-      int hash = r*size.width+c;
-      rc_to_idx[hash] = cloud.size()-1;
-    }
-
-  size_t count = 0;
-  std::vector<pcl::Vertices> polygons(vertices.size()/3);
-  for (size_t i = 0; i < vertices.size(); i+=3, ++count)
-    for (uint8_t j = 0; j < 3; ++j)
-    {
-      int hash = vertices[i+j].y*size.width + vertices[i+j].x;
-      polygons[count].vertices.push_back(rc_to_idx[hash]);
-    }
-
-  pcl::PolygonMesh mesh;
-  pcl::toPCLPointCloud2(cloud, mesh.cloud);
-  mesh.polygons = polygons;
-
-  pcl::io::savePLYFileBinary(filename, mesh);
+  ElevationCloud cloud = prepareElevationCloud(map, ele_layer_name, normal_layer_name, color_layer_name, mask_layer_name);
+  int cols = cloud.elevation.cols;
+  int rows = cloud.elevation.rows;
+
+  // Vertex index of every valid cell in the order they are written, -1 for invalid cells
+  std::vector<int32_t> cell_to_idx(static_cast<size_t>(rows) * cols, -1);
+  int32_t nrof_vertices = 0;
+  for (int r = 0; r < rows; ++r)
+    for (int c = 0; c < cols; ++c)
+      if (isValid(cloud, r, c))
+        cell_to_idx[static_cast<size_t>(r) * cols + c] = nrof_vertices++;
+
+  // Faces touching invalid or out of grid cells are skipped
+  auto idx = [&](const cv::Point2i &pt) -> int32_t
+  {
+    if (pt.x < 0 || pt.x >= cols || pt.y < 0 || pt.y >= rows)
+      return -1;
+    return cell_to_idx[static_cast<size_t>(pt.y) * cols + pt.x];
+  };
+
+  size_t nrof_faces = 0;
+  for (size_t i = 0; i + 2 < vertices.size(); i += 3)
+    if (idx(vertices[i]) >= 0 && idx(vertices[i+1]) >= 0 && idx(vertices[i+2]) >= 0)
+      nrof_faces++;
+
+  PlyWriter writer(filename);
+  writer.writeHeader(static_cast<size_t>(nrof_vertices), !cloud.normals.empty(), nrof_faces);
+  for (int r = 0; r < rows; ++r)
+    for (int c = 0; c < cols; ++c)
+      if (cell_to_idx[static_cast<size_t>(r) * cols + c] >= 0)
+        writeVertex(writer, cloud, r, c);
+
+  for (size_t i = 0; i + 2 < vertices.size(); i += 3)
+  {
+    int32_t face[3] = {idx(vertices[i]), idx(vertices[i+1]), idx(vertices[i+2])};
+    if (face[0] < 0 || face[1] < 0 || face[2] < 0)
+      continue;
+    writer.write(static_cast<uint8_t>(3));
+    writer.write(face, sizeof(face));
+  }
+  writer.close();
 }
 
-}
-}
+} // namespace io
+} // namespace realm
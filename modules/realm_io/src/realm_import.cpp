@@ -1,5 +1,14 @@
 
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <realm_io/realm_import.h>
 
 #include <eigen3/Eigen/Eigen>
@@ -44,83 +53,264 @@ cv::Mat io::loadGeoreferenceFromYaml(const std::string &filepath)
   return georeference;
 }
 
-std::unordered_map<uint64_t, cv::Mat> io::loadTrajectoryFromTxtTUM(const std::string &directory,
-                                                                   const std::string &filename)
+namespace
+{
+
+//! Files are only parsed in parallel chunks of at least this size, smaller ones are not worth the overhead
+const size_t g_min_chunk_size = 1 << 20;
+
+/*!
+ * @brief Read-only mapping of a text file, which is parsed in place without copying it into a stream buffer
+ */
+class MappedTextFile
 {
-  return io::loadTrajectoryFromTxtTUM(directory + "/" + filename);
+  public:
+    MappedTextFile(const std::string &filepath, const std::string &description)
+    : m_filepath(filepath),
+      m_description(description),
+      m_data(nullptr),
+      m_size(0)
+    {
+      int fd = open(filepath.c_str(), O_RDONLY);
+      if (fd < 0)
+        throw(std::runtime_error(createErrorMessage("Could not open file!")));
+
+      struct stat st{};
+      if (fstat(fd, &st) != 0)
+      {
+        close(fd);
+        throw(std::runtime_error(createErrorMessage("Could not read file size!")));
+      }
+
+      // Empty files can not be mapped, they are simply without lines
+      m_size = static_cast<size_t>(st.st_size);
+      if (m_size > 0)
+      {
+        m_data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m_data == MAP_FAILED)
+        {
+          m_data = nullptr;
+          close(fd);
+          throw(std::runtime_error(createErrorMessage("Mapping file failed!")));
+        }
+        madvise(m_data, m_size, MADV_SEQUENTIAL);
+      }
+
+      // The mapping stays valid after the descriptor is closed
+      close(fd);
+    }
+
+    ~MappedTextFile()
+    {
+      if (m_data != nullptr)
+        munmap(m_data, m_size);
+    }
+
+    MappedTextFile(const MappedTextFile &) = delete;
+    MappedTextFile& operator=(const MappedTextFile &) = delete;
+
+    const char* begin() const { return static_cast<const char*>(m_data); }
+    const char* end() const { return begin() + m_size; }
+    size_t size() const { return m_size; }
+
+    std::string createErrorMessage(const std::string &reason) const
+    {
+      return "Error loading " + m_description + " file from '" + m_filepath + "': " + reason;
+    }
+
+  private:
+    std::string m_filepath;
+    std::string m_description;
+    void* m_data;
+    size_t m_size;
 };
 
-std::unordered_map<uint64_t, cv::Mat> io::loadTrajectoryFromTxtTUM(const std::string &filepath)
+bool isBlank(char c)
 {
-  // Prepare result
-  std::unordered_map<uint64_t, cv::Mat> result;
+  return c == ' ' || c == '\t' || c == '\r';
+}
 
-  // Open file
-  std::ifstream file(filepath);
-  if (!file.is_open())
-    throw(std::runtime_error("Error loading trajectory file from '" + filepath + "': Could not open file!"));
+/*!
+ * @brief Copies the next whitespace separated token into a null terminated buffer, as the mapping is not terminated
+ * @return False if there is no token left in the line or it is too long to be a number
+ */
+bool nextToken(const char* &it, const char* end, char (&token)[64])
+{
+  while (it != end && isBlank(*it))
+    ++it;
+  size_t length = 0;
+  while (it != end && !isBlank(*it))
+  {
+    if (length == sizeof(token) - 1)
+      return false;
+    token[length++] = *it++;
+  }
+  token[length] = '\0';
+  return length > 0;
+}
+
+bool parseDouble(const char* &it, const char* end, double &value)
+{
+  char token[64];
+  if (!nextToken(it, end, token))
+    return false;
+  char* token_end;
+  value = std::strtod(token, &token_end);
+  return *token_end == '\0';
+}
+
+bool parseUnsigned(const char* &it, const char* end, uint64_t &value)
+{
+  char token[64];
+  if (!nextToken(it, end, token))
+    return false;
+  char* token_end;
+  value = std::strtoull(token, &token_end, 10);
+  return *token_end == '\0';
+}
 
-  // Iterating through every line
-  std::string str;
-  while (std::getline(file, str))
+/*!
+ * @brief Parses all lines of a file into values, blank lines and comments starting with '#' are skipped. The file is
+ * split into chunks at line boundaries, which are parsed independently into their own vector.
+ * @param parse_line Parser with signature bool(const char* begin, const char* end, T &value) for a single line
+ * @return Values of every chunk in the order of the lines
+ */
+template<typename T, typename LineParser>
+std::vector<std::vector<T>> parseLinesInChunks(const MappedTextFile &file,
+                                               const realm::ThreadPool::Ptr &thread_pool,
+                                               int nrof_threads,
+                                               const LineParser &parse_line)
+{
+  if (nrof_threads <= 0)
+    nrof_threads = (thread_pool != nullptr ? thread_pool->getNrofThreads() + 1 : cv::getNumThreads());
+  size_t nrof_chunks = std::max<size_t>(1, std::min<size_t>(static_cast<size_t>(nrof_threads), file.size() / g_min_chunk_size));
+
+  // Chunks start behind the first line break after their even share of the file
+  std::vector<const char*> bounds(nrof_chunks + 1, file.end());
+  bounds[0] = file.begin();
+  for (size_t i = 1; i < nrof_chunks; ++i)
   {
-    // Tokenize input line
-    std::vector<std::string> tokens = io::split(str.c_str(), ' ');
-    if (tokens.size() < 7)
-      throw(std::runtime_error("Error loading trajectory file from '\" + (directory+filename) + \"': Not enough arguments in line!"));
-
-    // Convert all tokens to values
-    uint64_t timestamp = std::stoul(tokens[0]);
-    double x = std::stod(tokens[1]);
-    double y = std::stod(tokens[2]);
-    double z = std::stod(tokens[3]);
-    double qx = std::stod(tokens[4]);
-    double qy = std::stod(tokens[5]);
-    double qz = std::stod(tokens[6]);
-    double qw = std::stod(tokens[7]);
+    const char* it = std::max(file.begin() + file.size() * i / nrof_chunks, bounds[i - 1]);
+    const char* line_break = static_cast<const char*>(std::memchr(it, '\n', static_cast<size_t>(file.end() - it)));
+    bounds[i] = (line_break != nullptr ? line_break + 1 : file.end());
+  }
+
+  std::vector<std::vector<T>> values(nrof_chunks);
+  std::vector<char> is_valid(nrof_chunks, 1);
+  realm::parallelFor(thread_pool, cv::Range(0, static_cast<int>(nrof_chunks)), [&](const cv::Range &range)
+  {
+    for (int k = range.start; k < range.end; ++k)
+    {
+      const char* it = bounds[k];
+      const char* end = bounds[k + 1];
+      while (it != end)
+      {
+        auto line_end = static_cast<const char*>(std::memchr(it, '\n', static_cast<size_t>(end - it)));
+        if (line_end == nullptr)
+          line_end = end;
+
+        const char* first = it;
+        while (first != line_end && isBlank(*first))
+          ++first;
+        if (first != line_end && *first != '#')
+        {
+          T value;
+          if (!parse_line(first, line_end, value))
+          {
+            is_valid[k] = 0;
+            break;
+          }
+          values[k].push_back(std::move(value));
+        }
+        it = (line_end == end ? end : line_end + 1);
+      }
+    }
+  }, static_cast<int>(nrof_chunks));
+
+  // A single malformed line fails the whole file
+  if (std::find(is_valid.begin(), is_valid.end(), 0) != is_valid.end())
+    throw(std::runtime_error(file.createErrorMessage("Not enough or malformed arguments in line!")));
+  return values;
+}
+
+} // namespace
+
+std::unordered_map<uint64_t, cv::Mat> io::loadTrajectoryFromTxtTUM(const std::string &directory,
+                                                                   const std::string &filename,
+                                                                   const ThreadPool::Ptr &thread_pool,
+                                                                   int nrof_threads)
+{
+  return io::loadTrajectoryFromTxtTUM(directory + "/" + filename, thread_pool, nrof_threads);
+}
+
+std::unordered_map<uint64_t, cv::Mat> io::loadTrajectoryFromTxtTUM(const std::string &filepath,
+                                                                   const ThreadPool::Ptr &thread_pool,
+                                                                   int nrof_threads)
+{
+  MappedTextFile file(filepath, "trajectory");
+
+  // Timestamp and pose of every line, parsed in chunks
+  using Entry = std::pair<uint64_t, cv::Mat>;
+  std::vector<std::vector<Entry>> entries = parseLinesInChunks<Entry>(file, thread_pool, nrof_threads,
+                                                                      [](const char* it, const char* end, Entry &entry)
+  {
+    double values[7];
+    if (!parseUnsigned(it, end, entry.first))
+      return false;
+    for (double &value : values)
+      if (!parseDouble(it, end, value))
+        return false;
 
     // Convert Quaternions to Rotation matrix
-    Eigen::Quaterniond quat(qw, qx, qy, qz);
+    Eigen::Quaterniond quat(values[6], values[3], values[4], values[5]);
     Eigen::Matrix3d R_eigen = quat.toRotationMatrix();
 
     // Pose as 3x4 matrix
-    cv::Mat pose = (cv::Mat_<double>(3, 4) << R_eigen(0, 0), R_eigen(0, 1), R_eigen(0, 2), x,
-                                              R_eigen(1, 0), R_eigen(1, 1), R_eigen(1, 2), y,
-                                              R_eigen(2, 0), R_eigen(2, 1), R_eigen(2, 2), z);
-    result[timestamp] = pose;
-  }
+    entry.second = (cv::Mat_<double>(3, 4) << R_eigen(0, 0), R_eigen(0, 1), R_eigen(0, 2), values[0],
+                                              R_eigen(1, 0), R_eigen(1, 1), R_eigen(1, 2), values[1],
+                                              R_eigen(2, 0), R_eigen(2, 1), R_eigen(2, 2), values[2]);
+    return true;
+  });
+
+  size_t nrof_entries = 0;
+  for (const auto &chunk : entries)
+    nrof_entries += chunk.size();
+
+  // Later lines overwrite earlier ones with the same timestamp, as the chunks are inserted in order
+  std::unordered_map<uint64_t, cv::Mat> result;
+  result.reserve(nrof_entries);
+  for (auto &chunk : entries)
+    for (auto &entry : chunk)
+      result[entry.first] = std::move(entry.second);
   return result;
-};
+}
 
-cv::Mat io::loadSurfacePointsFromTxt(const std::string &filepath)
+cv::Mat io::loadSurfacePointsFromTxt(const std::string &filepath,
+                                     const ThreadPool::Ptr &thread_pool,
+                                     int nrof_threads)
 {
-  // Prepare result
-  cv::Mat points;
-
-  // Open file
-  std::ifstream file(filepath);
-  if (!file.is_open())
-    throw(std::runtime_error("Error loading surface point file from '" + filepath + "': Could not open file!"));
+  MappedTextFile file(filepath, "surface point");
 
-  // Iterating through every line
-  std::string str;
-  while (std::getline(file, str))
+  std::vector<std::vector<cv::Vec3d>> points = parseLinesInChunks<cv::Vec3d>(file, thread_pool, nrof_threads,
+                                                                             [](const char* it, const char* end, cv::Vec3d &pt)
   {
-    // Tokenize input line
-    std::vector<std::string> tokens = io::split(str.c_str(), ' ');
-    if (tokens.size() < 2)
-      throw(std::runtime_error("Error loading surface point file from '" + filepath + "': Not enough arguments in line!"));
-
-    // Convert all tokens to values
-    double x = std::stod(tokens[0]);
-    double y = std::stod(tokens[1]);
-    double z = std::stod(tokens[2]);
-
-    // Point as 1x3 mat
-    cv::Mat pt = (cv::Mat_<double>(1, 3) << x, y, z);
-    points.push_back(pt);
-  }
-  return points;
+    return parseDouble(it, end, pt[0]) && parseDouble(it, end, pt[1]) && parseDouble(it, end, pt[2]);
+  });
+
+  // The chunks are copied into the rows of the result, which is only allocated once
+  std::vector<int> offsets(points.size() + 1, 0);
+  for (size_t i = 0; i < points.size(); ++i)
+    offsets[i + 1] = offsets[i] + static_cast<int>(points[i].size());
+
+  cv::Mat result(offsets.back(), 3, CV_64F);
+  for (size_t i = 0; i < points.size(); ++i)
+    if (!points[i].empty())
+      std::memcpy(result.ptr<double>(offsets[i]), points[i].data(), points[i].size() * sizeof(cv::Vec3d));
+
+  // Matches the former result of pushing rows to an empty matrix
+  if (result.rows == 0)
+    return cv::Mat();
+  return result;
 }
 
 CvGridMap::Ptr io::loadCvGridMap(const std::string &filepath)
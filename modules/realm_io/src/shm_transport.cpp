@@ -0,0 +1,349 @@
+
+
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <realm_core/loguru.h>
+#include <realm_io/shm_transport.h>
+
+using namespace realm;
+
+// Handles are read and written from different processes, so the sequences must not depend on a process local lock
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "Shared memory transport requires lock-free 64 bit atomics");
+
+constexpr int io::ShmTransport::kMaxLayers;
+
+namespace
+{
+
+const char g_magic[8] = {'R', 'E', 'A', 'L', 'M', 'S', 'H', 'M'};
+const uint32_t g_version = 1;
+
+//! Slots and layer data start at multiples of this, so they are aligned to cache lines
+const uint64_t g_alignment = 64;
+
+uint64_t alignOffset(uint64_t offset)
+{
+  return (offset + g_alignment - 1) / g_alignment * g_alignment;
+}
+
+std::string createSegmentName(const std::string &name)
+{
+  if (name.empty())
+    throw(std::invalid_argument("Error creating shared memory transport: Name is empty!"));
+  return (name[0] == '/' ? name : "/" + name);
+}
+
+size_t computeSlotStride(size_t slot_size)
+{
+  return alignOffset(sizeof(io::ShmTransport::SlotHeader)) + alignOffset(slot_size);
+}
+
+size_t computeSegmentSize(uint32_t nrof_slots, size_t slot_size)
+{
+  return alignOffset(sizeof(io::ShmTransport::SegmentHeader)) + nrof_slots * computeSlotStride(slot_size);
+}
+
+uint8_t* getSlotPointer(void* data, uint32_t slot, size_t slot_size)
+{
+  return static_cast<uint8_t*>(data) + alignOffset(sizeof(io::ShmTransport::SegmentHeader)) + slot * computeSlotStride(slot_size);
+}
+
+} // namespace
+
+io::ShmTransport::ShmTransport(const std::string &name, uint32_t nrof_slots, size_t slot_size)
+ : m_name(createSegmentName(name)),
+   m_data(nullptr),
+   m_size_bytes(computeSegmentSize(nrof_slots, slot_size)),
+   m_nrof_slots(nrof_slots),
+   m_slot_size(slot_size),
+   m_nrof_written(0)
+{
+  if (nrof_slots == 0 || slot_size == 0)
+    throw(std::invalid_argument("Error creating shared memory transport: Number and size of slots must be positive!"));
+
+  int fd = shm_open(m_name.c_str(), O_CREAT | O_RDWR, 0644);
+  if (fd < 0)
+    throw(std::runtime_error("Error creating shared memory transport: Segment could not be opened!"));
+
+  if (ftruncate(fd, static_cast<off_t>(m_size_bytes)) != 0)
+  {
+    close(fd);
+    shm_unlink(m_name.c_str());
+    throw(std::runtime_error("Error creating shared memory transport: Segment could not be resized!"));
+  }
+
+  m_data = mmap(nullptr, m_size_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+  // The mapping stays valid after the descriptor is closed
+  close(fd);
+
+  if (m_data == MAP_FAILED)
+  {
+    m_data = nullptr;
+    shm_unlink(m_name.c_str());
+    throw(std::runtime_error("Error creating shared memory transport: Mapping segment failed!"));
+  }
+
+  // Stale content of a reused segment is discarded, sequences of zero are never handed out
+  std::memset(m_data, 0, m_size_bytes);
+  for (uint32_t i = 0; i < m_nrof_slots; ++i)
+    new (getSlotPointer(m_data, i, m_slot_size)) SlotHeader();
+
+  SegmentHeader header{};
+  std::memcpy(header.magic, g_magic, sizeof(g_magic));
+  header.version = g_version;
+  header.nrof_slots = m_nrof_slots;
+  header.slot_size = m_slot_size;
+  std::memcpy(m_data, &header, sizeof(SegmentHeader));
+}
+
+io::ShmTransport::~ShmTransport()
+{
+  if (m_data != nullptr)
+    munmap(m_data, m_size_bytes);
+  shm_unlink(m_name.c_str());
+}
+
+bool io::ShmTransport::write(const cv::Mat &img, const std::string &topic, Handle &handle)
+{
+  return writeLayers({CvGridMap::Layer{"image", img, cv::INTER_LINEAR}}, cv::Rect2d(), 0.0, 0, 0, topic, handle);
+}
+
+bool io::ShmTransport::write(const CvGridMap &map, uint8_t zone, char band, const std::string &topic, Handle &handle)
+{
+  std::vector<CvGridMap::Layer> layers;
+  for (const auto &layer_name : map.getAllLayerNames())
+    layers.push_back(map.getLayer(layer_name));
+  return writeLayers(layers, map.roi(), map.resolution(), zone, band, topic, handle);
+}
+
+bool io::ShmTransport::writeLayers(const std::vector<CvGridMap::Layer> &layers, const cv::Rect2d &roi, double resolution,
+                                   uint8_t zone, char band, const std::string &topic, Handle &handle)
+{
+  if (layers.size() > static_cast<size_t>(kMaxLayers))
+  {
+    LOG_F(WARNING, "Message on '%s' has %lu layers, only %i fit into a shared memory slot. Dropping it.",
+          topic.c_str(), layers.size(), kMaxLayers);
+    return false;
+  }
+
+  // Layout and size check before anything is written, so a slot is never left half written
+  std::vector<uint64_t> offsets(layers.size());
+  uint64_t offset = 0;
+  for (size_t i = 0; i < layers.size(); ++i)
+  {
+    if (layers[i].name.size() >= sizeof(LayerEntry::name))
+    {
+      LOG_F(WARNING, "Message on '%s' has a layer name that is too long. Dropping it.", topic.c_str());
+      return false;
+    }
+    offsets[i] = offset;
+    offset = alignOffset(offset + static_cast<uint64_t>(layers[i].data.total()) * layers[i].data.elemSize());
+  }
+
+  if (offset > m_slot_size)
+  {
+    LOG_F(WARNING, "Message on '%s' has %lu bytes, only %lu fit into a shared memory slot. Dropping it.",
+          topic.c_str(), offset, m_slot_size);
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex_write);
+
+  uint32_t slot_idx = static_cast<uint32_t>(m_nrof_written % m_nrof_slots);
+  uint64_t sequence = 2 * (m_nrof_written + 1);
+  m_nrof_written++;
+
+  uint8_t* slot_ptr = getSlotPointer(m_data, slot_idx, m_slot_size);
+  auto slot = reinterpret_cast<SlotHeader*>(slot_ptr);
+  uint8_t* slot_data = slot_ptr + alignOffset(sizeof(SlotHeader));
+
+  // Odd sequence marks the slot as being written, readers of the old data will notice it
+  slot->sequence.store(sequence - 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  slot->nrof_layers = static_cast<uint32_t>(layers.size());
+  slot->zone = zone;
+  slot->band = band;
+  std::memset(slot->topic, 0, sizeof(slot->topic));
+  std::strncpy(slot->topic, topic.c_str(), sizeof(slot->topic) - 1);
+  slot->roi[0] = roi.x;
+  slot->roi[1] = roi.y;
+  slot->roi[2] = roi.width;
+  slot->roi[3] = roi.height;
+  slot->resolution = resolution;
+
+  for (size_t i = 0; i < layers.size(); ++i)
+  {
+    const cv::Mat &data = layers[i].data;
+
+    LayerEntry &entry = slot->layers[i];
+    std::memset(&entry, 0, sizeof(LayerEntry));
+    std::strncpy(entry.name, layers[i].name.c_str(), sizeof(entry.name) - 1);
+    entry.type = data.type();
+    entry.interpolation = layers[i].interpolation;
+    entry.rows = data.rows;
+    entry.cols = data.cols;
+    entry.offset = offsets[i];
+
+    // Operating rowise, so even non-continuous matrices like submap views are properly written
+    size_t row_bytes = data.cols * data.elemSize();
+    for (int r = 0; r < data.rows; ++r)
+      std::memcpy(slot_data + offsets[i] + r * row_bytes, data.ptr(r), row_bytes);
+  }
+
+  slot->sequence.store(sequence, std::memory_order_release);
+
+  handle.slot = slot_idx;
+  handle.sequence = sequence;
+  return true;
+}
+
+std::function<void(const cv::Mat &, const std::string &)> io::ShmTransport::createImageTransport(const NotifyFunc &notify)
+{
+  return [this, notify](const cv::Mat &img, const std::string &topic)
+  {
+    Handle handle{};
+    if (write(img, topic, handle))
+      notify(handle, topic);
+  };
+}
+
+std::function<void(const CvGridMap &, uint8_t, char, const std::string &)> io::ShmTransport::createCvGridMapTransport(const NotifyFunc &notify)
+{
+  return [this, notify](const CvGridMap &map, uint8_t zone, char band, const std::string &topic)
+  {
+    Handle handle{};
+    if (write(map, zone, band, topic, handle))
+      notify(handle, topic);
+  };
+}
+
+std::string io::ShmTransport::getName() const
+{
+  return m_name;
+}
+
+io::ShmTransportReader::ShmTransportReader(const std::string &name)
+ : m_data(nullptr),
+   m_size_bytes(0),
+   m_nrof_slots(0),
+   m_slot_size(0)
+{
+  std::string segment_name = createSegmentName(name);
+
+  int fd = shm_open(segment_name.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+    throw(std::invalid_argument("Error opening shared memory transport: Segment does not exist!"));
+
+  struct stat st{};
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(ShmTransport::SegmentHeader))
+  {
+    close(fd);
+    throw(std::runtime_error("Error opening shared memory transport: Segment is too small to contain a header!"));
+  }
+
+  m_size_bytes = static_cast<size_t>(st.st_size);
+  m_data = mmap(nullptr, m_size_bytes, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (m_data == MAP_FAILED)
+  {
+    m_data = nullptr;
+    throw(std::runtime_error("Error opening shared memory transport: Mapping segment failed!"));
+  }
+
+  ShmTransport::SegmentHeader header;
+  std::memcpy(&header, m_data, sizeof(ShmTransport::SegmentHeader));
+  if (std::memcmp(header.magic, g_magic, sizeof(g_magic)) != 0 || header.version != g_version
+      || computeSegmentSize(header.nrof_slots, header.slot_size) > m_size_bytes)
+  {
+    munmap(m_data, m_size_bytes);
+    throw(std::runtime_error("Error opening shared memory transport: Segment is no transport or of an unsupported version!"));
+  }
+
+  m_nrof_slots = header.nrof_slots;
+  m_slot_size = header.slot_size;
+}
+
+io::ShmTransportReader::~ShmTransportReader()
+{
+  if (m_data != nullptr)
+    munmap(m_data, m_size_bytes);
+}
+
+bool io::ShmTransportReader::read(const ShmTransport::Handle &handle, cv::Mat &img, bool do_copy) const
+{
+  const ShmTransport::SlotHeader* slot = getSlot(handle);
+  if (slot == nullptr || slot->sequence.load(std::memory_order_acquire) != handle.sequence)
+    return false;
+
+  const ShmTransport::LayerEntry &entry = slot->layers[0];
+  const uint8_t* slot_data = reinterpret_cast<const uint8_t*>(slot) + alignOffset(sizeof(ShmTransport::SlotHeader));
+  if (slot->nrof_layers != 1 || static_cast<size_t>(entry.rows) * entry.cols * CV_ELEM_SIZE(entry.type) > m_slot_size)
+    return false;
+
+  // Matrix headers can not point to const data, the mapping itself is read-only
+  cv::Mat view(entry.rows, entry.cols, entry.type, const_cast<uint8_t*>(slot_data + entry.offset));
+  img = (do_copy ? view.clone() : view);
+
+  return !do_copy || isValid(handle);
+}
+
+bool io::ShmTransportReader::read(const ShmTransport::Handle &handle, CvGridMap &map, uint8_t &zone, char &band, bool do_copy) const
+{
+  const ShmTransport::SlotHeader* slot = getSlot(handle);
+  if (slot == nullptr || slot->sequence.load(std::memory_order_acquire) != handle.sequence)
+    return false;
+
+  if (slot->nrof_layers > static_cast<uint32_t>(ShmTransport::kMaxLayers))
+    return false;
+
+  const uint8_t* slot_data = reinterpret_cast<const uint8_t*>(slot) + alignOffset(sizeof(ShmTransport::SlotHeader));
+
+  CvGridMap result(cv::Rect2d(slot->roi[0], slot->roi[1], slot->roi[2], slot->roi[3]), slot->resolution);
+  zone = slot->zone;
+  band = slot->band;
+
+  for (uint32_t i = 0; i < slot->nrof_layers; ++i)
+  {
+    ShmTransport::LayerEntry entry = slot->layers[i];
+    entry.name[sizeof(entry.name) - 1] = '\0';
+    if (entry.offset + static_cast<size_t>(entry.rows) * entry.cols * CV_ELEM_SIZE(entry.type) > m_slot_size
+        || !isValid(handle))
+      return false;
+
+    cv::Mat view(entry.rows, entry.cols, entry.type, const_cast<uint8_t*>(slot_data + entry.offset));
+    result.add(entry.name, (do_copy ? view.clone() : view), entry.interpolation);
+  }
+
+  // Slot could have been overwritten during copying, so the result is only handed out if the sequence did not change
+  if (!isValid(handle))
+    return false;
+
+  map = result;
+  return true;
+}
+
+bool io::ShmTransportReader::isValid(const ShmTransport::Handle &handle) const
+{
+  const ShmTransport::SlotHeader* slot = getSlot(handle);
+  if (slot == nullptr)
+    return false;
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return slot->sequence.load(std::memory_order_relaxed) == handle.sequence;
+}
+
+const io::ShmTransport::SlotHeader* io::ShmTransportReader::getSlot(const ShmTransport::Handle &handle) const
+{
+  if (handle.slot >= m_nrof_slots || handle.sequence == 0 || handle.sequence % 2 != 0)
+    return nullptr;
+  return reinterpret_cast<const ShmTransport::SlotHeader*>(getSlotPointer(m_data, handle.slot, m_slot_size));
+}
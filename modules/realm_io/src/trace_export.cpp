@@ -0,0 +1,119 @@
+
+
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+#include <realm_io/trace_export.h>
+
+using namespace realm;
+
+namespace
+{
+
+// Chrome trace timestamps are microseconds
+double toMicroseconds(uint64_t t_ns)
+{
+  return static_cast<double>(t_ns) / 1000.0;
+}
+
+void writeSlice(std::ofstream &file, bool &is_first, const std::string &name, uint32_t frame_id, size_t tid,
+                uint64_t t_start, uint64_t t_end)
+{
+  if (t_start == 0 || t_end < t_start)
+    return;
+
+  file << (is_first ? "" : ",\n") << "{\"name\":\"" << name << " #" << frame_id << "\",\"cat\":\"" << name
+       << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid << ",\"ts\":" << toMicroseconds(t_start)
+       << ",\"dur\":" << toMicroseconds(t_end - t_start) << ",\"args\":{\"frame_id\":" << frame_id << "}}";
+  is_first = false;
+}
+
+void writeFlow(std::ofstream &file, bool &is_first, const char *phase, uint32_t frame_id, size_t tid, uint64_t t)
+{
+  if (t == 0)
+    return;
+
+  file << (is_first ? "" : ",\n") << "{\"name\":\"frame\",\"cat\":\"flow\",\"ph\":\"" << phase
+       << "\",\"bp\":\"e\",\"id\":" << frame_id << ",\"pid\":1,\"tid\":" << tid << ",\"ts\":" << toMicroseconds(t) << "}";
+  is_first = false;
+}
+
+std::string escape(const std::string &str)
+{
+  std::string escaped;
+  for (char c : str)
+  {
+    if (c == '"' || c == '\\')
+      escaped += '\\';
+    escaped += c;
+  }
+  return escaped;
+}
+
+} // namespace
+
+void io::TraceExporter::add(const Frame::Ptr &frame)
+{
+  add(frame->getFrameId(), frame->getTrace());
+}
+
+void io::TraceExporter::add(uint32_t frame_id, const std::vector<StageTrace> &trace)
+{
+  std::unique_lock<std::mutex> lock(m_mutex_traces);
+  m_traces[frame_id] = trace;
+}
+
+void io::TraceExporter::save(const std::string &filepath) const
+{
+  std::unique_lock<std::mutex> lock(m_mutex_traces);
+
+  std::ofstream file(filepath.c_str());
+  if (!file.is_open())
+    throw(std::runtime_error("Error: Could not open trace file '" + filepath + "' for writing."));
+  file << std::fixed << std::setprecision(3);
+
+  // Every stage gets its own track in order of appearance
+  std::map<std::string, size_t> tids;
+  for (const auto &frame_trace : m_traces)
+    for (const auto &stage_trace : frame_trace.second)
+      if (tids.find(stage_trace.stage) == tids.end())
+        tids.emplace(stage_trace.stage, tids.size() + 1);
+
+  bool is_first = true;
+  file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+  for (const auto &tid : tids)
+  {
+    file << (is_first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid.second
+         << ",\"args\":{\"name\":\"" << escape(tid.first) << "\"}}";
+    is_first = false;
+  }
+
+  for (const auto &frame_trace : m_traces)
+  {
+    uint32_t frame_id = frame_trace.first;
+    const std::vector<StageTrace> &trace = frame_trace.second;
+
+    for (size_t i = 0; i < trace.size(); ++i)
+    {
+      const StageTrace &stage_trace = trace[i];
+      size_t tid = tids[stage_trace.stage];
+
+      // Processing starts right after the frame left the queue, if the stage did not record it separately
+      uint64_t t_process_start = (stage_trace.t_process_start > 0 ? stage_trace.t_process_start : stage_trace.t_dequeued);
+
+      writeSlice(file, is_first, "queue", frame_id, tid, stage_trace.t_enqueued, stage_trace.t_dequeued);
+      writeSlice(file, is_first, "process", frame_id, tid, t_process_start, stage_trace.t_process_end);
+
+      // Flow from the end of this stage to the arrival in the next one
+      if (i + 1 < trace.size() && stage_trace.t_process_end > 0 && trace[i + 1].t_enqueued > 0)
+      {
+        writeFlow(file, is_first, "s", frame_id, tid, stage_trace.t_process_end);
+        writeFlow(file, is_first, "f", frame_id, tids[trace[i + 1].stage], trace[i + 1].t_enqueued);
+      }
+    }
+  }
+
+  file << "\n]}\n";
+}
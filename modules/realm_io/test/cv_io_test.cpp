@@ -22,6 +22,7 @@
 
 #include <realm_io/cv_import.h>
 #include <realm_io/cv_export.h>
+#include <realm_io/mapped_image.h>
 #include <realm_io/utilities.h>
 
 // gtest
@@ -84,6 +85,33 @@ TEST(CvIO, ImageBinaryNonContinuous)
   io::removeFileOrDirectory(path_tmp + "/" + "img_8uc4.bin");
 }
 
+TEST(CvIO, ImageBinaryMapped)
+{
+  // Here we map a binary dump instead of reading it. Writing to the view must not change the file, as it is mapped
+  // copy-on-write.
+  std::string path_tmp = io::getTempDirectoryPath();
+
+  cv::Mat img_32fc1(500, 1000, CV_32FC1, cv::Scalar(125.0));
+  img_32fc1.at<float>(10, 20) = 42.0f;
+  io::saveImage(img_32fc1, path_tmp + "/" + "img_32fc1.bin");
+
+  {
+    io::MappedImage img_mapped(path_tmp + "/" + "img_32fc1.bin");
+    cv::Mat view = img_mapped.getView();
+    EXPECT_EQ(view.type(), CV_32FC1);
+    EXPECT_EQ(view.size(), img_32fc1.size());
+    EXPECT_NEAR(view.at<float>(10, 20), 42.0, 10e-3);
+    EXPECT_NEAR(view.at<float>(100, 100), 125.0, 10e-3);
+    view.at<float>(100, 100) = 0.0f;
+  }
+
+  cv::Mat img_32fc1_copy = io::loadImage(path_tmp + "/" + "img_32fc1.bin");
+  EXPECT_NEAR(img_32fc1_copy.at<float>(100, 100), 125.0, 10e-3);
+
+  EXPECT_THROW(io::MappedImage(path_tmp + "/" + "img_32fc1.png"), std::invalid_argument);
+  io::removeFileOrDirectory(path_tmp + "/" + "img_32fc1.bin");
+}
+
 TEST(CvIO, ImageBinaryLegacy)
 {
   // This test will check, whether the initial binary specification for cv::Mat have changed or not. We do this by
@@ -102,4 +130,26 @@ TEST(CvIO, FileNotExist)
 {
   // Test to show that non-existent files throw an error
   EXPECT_ANY_THROW(io::loadImage("/path/does/not/matter.gif"));
-}
\ No newline at end of file
+}
+TEST(CvIO, EncodeImageCompressed)
+{
+  // For this test we encode images for transport. 8 bit images are encoded as downscaled jpeg without alpha channel,
+  // floating point images can not be encoded.
+  cv::Mat img_8uc4(500, 1000, CV_8UC4, cv::Scalar(125, 125, 125, 255));
+
+  std::vector<uint8_t> data;
+  std::string format;
+  EXPECT_TRUE(io::encodeImageCompressed(img_8uc4, 0.5, 80, data, format));
+  EXPECT_EQ(format, "jpeg");
+
+  cv::Mat img_decoded = cv::imdecode(data, cv::IMREAD_UNCHANGED);
+  EXPECT_EQ(img_decoded.size(), cv::Size(500, 250));
+  EXPECT_EQ(img_decoded.channels(), 3);
+  EXPECT_NEAR(img_decoded.at<cv::Vec3b>(100, 100)[0], 125, 2);
+
+  EXPECT_TRUE(io::encodeImageCompressed(cv::Mat(10, 10, CV_16UC1, cv::Scalar(1000)), 1.0, 80, data, format));
+  EXPECT_EQ(format, "png");
+
+  EXPECT_FALSE(io::encodeImageCompressed(cv::Mat(10, 10, CV_32FC1, cv::Scalar(1.0)), 1.0, 80, data, format));
+  EXPECT_ANY_THROW(io::encodeImageCompressed(img_8uc4, 0.0, 80, data, format));
+}
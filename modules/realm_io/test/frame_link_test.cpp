@@ -0,0 +1,87 @@
+#include <chrono>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include <realm_io/frame_link.h>
+
+// gtest
+#include <gtest/gtest.h>
+
+using namespace realm;
+
+namespace
+{
+
+Frame::Ptr createFrame(uint32_t frame_id, const cv::Mat &img)
+{
+  auto cam = std::make_shared<camera::Pinhole>(1200.0, 1200.0, 400.0, 300.0, img.cols, img.rows);
+  return std::make_shared<Frame>("cam", frame_id, 1500000000 + frame_id, img, UTMPose(604347, 5792556, 100.0, 23.0, 32, 'U'),
+                                 cam, cv::Mat::eye(3, 3, CV_64F));
+}
+
+} // namespace
+
+TEST(FrameLink, SerializeCompressed)
+{
+  // Here we serialize a frame with the image encoded lossless and lossy. Lossless must restore the image exactly, the
+  // lossy one only approximately, but both in the size and type of the original image.
+  cv::Mat img(300, 400, CV_8UC3);
+  cv::randu(img, cv::Scalar::all(100), cv::Scalar::all(110));
+  Frame::Ptr frame = createFrame(3, img);
+
+  for (auto compression : {io::FrameImageCompression::PNG, io::FrameImageCompression::JPEG})
+  {
+    std::stringstream stream(std::ios::in | std::ios::out | std::ios::binary);
+    io::serializeFrame(stream, frame, compression, 90);
+    Frame::Ptr copy = io::deserializeFrame(stream);
+
+    EXPECT_EQ(copy->getFrameId(), 3u);
+    ASSERT_EQ(copy->getImageRaw().size(), img.size());
+    ASSERT_EQ(copy->getImageRaw().type(), img.type());
+    if (compression == io::FrameImageCompression::PNG)
+      EXPECT_EQ(cv::norm(copy->getImageRaw(), img, cv::NORM_INF), 0.0);
+    else
+      EXPECT_LT(cv::norm(copy->getImageRaw(), img, cv::NORM_L1) / img.total(), 10.0);
+  }
+}
+
+TEST(FrameLink, SendReceive)
+{
+  // For this test a sender connects to a receiver on the same host and sends several frames. They must arrive in
+  // order with their topics, as if the stages were running in the same process.
+  std::mutex mutex;
+  std::vector<std::pair<Frame::Ptr, std::string>> received;
+  io::FrameLinkReceiver receiver(0, [&](const Frame::Ptr &frame, const std::string &topic)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    received.emplace_back(frame, topic);
+  });
+  ASSERT_NE(receiver.getPort(), 0);
+
+  cv::Mat img(60, 80, CV_8UC3, cv::Scalar(10, 20, 30));
+  {
+    io::FrameLinkSender sender("127.0.0.1", receiver.getPort(), 8, io::FrameImageCompression::PNG);
+    auto transport = sender.createFrameTransport();
+    for (uint32_t i = 0; i < 5; ++i)
+      transport(createFrame(i, img), "output/frame");
+
+    EXPECT_TRUE(sender.flush(5000));
+    EXPECT_EQ(sender.getNrofSent(), 5u);
+    EXPECT_EQ(sender.getNrofDropped(), 0u);
+  }
+
+  // Sent frames might still be in flight, when the sender is done
+  for (int i = 0; i < 500 && receiver.getNrofReceived() < 5; ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  std::lock_guard<std::mutex> lock(mutex);
+  ASSERT_EQ(received.size(), 5u);
+  for (uint32_t i = 0; i < 5; ++i)
+  {
+    EXPECT_EQ(received[i].second, "output/frame");
+    EXPECT_EQ(received[i].first->getFrameId(), i);
+    EXPECT_EQ(received[i].first->getTimestamp(), 1500000000u + i);
+    EXPECT_EQ(cv::norm(received[i].first->getImageRaw(), img, cv::NORM_INF), 0.0);
+  }
+}
@@ -0,0 +1,67 @@
+#include <cmath>
+#include <limits>
+
+#include <realm_io/frame_store.h>
+#include <realm_io/utilities.h>
+
+// gtest
+#include <gtest/gtest.h>
+
+using namespace realm;
+
+namespace
+{
+
+Frame::Ptr createFrame(uint32_t frame_id)
+{
+  cv::Mat img(60, 80, CV_8UC3, cv::Scalar(frame_id, 20, 30));
+  auto cam = std::make_shared<camera::Pinhole>(1200.0, 1200.0, 40.0, 30.0, img.cols, img.rows);
+  auto frame = std::make_shared<Frame>("cam", frame_id, 1500000000 + frame_id, img, UTMPose(604347, 5792556, 100.0, 23.0, 32, 'U'),
+                                       cam, cv::Mat::eye(3, 3, CV_64F));
+
+  // Mostly empty surface model, like at the borders of a rectified frame
+  auto surface = std::make_shared<CvGridMap>(cv::Rect2d(0.0, 0.0, 199.0, 199.0), 1.0);
+  cv::Mat elevation(surface->size(), CV_32F, std::numeric_limits<float>::quiet_NaN());
+  elevation(cv::Rect2i(50, 50, 100, 100)).setTo(static_cast<float>(frame_id));
+  surface->add("elevation", elevation);
+  frame->setSurfaceModel(surface);
+  return frame;
+}
+
+} // namespace
+
+TEST(FrameStore, ColdStorage)
+{
+  // Here we add more frames than are kept resident, both with cold storage in memory and in a file. All frames must be
+  // restored in order with their surface models, while only the most recent ones are resident.
+  const std::string filepath = io::getTempDirectoryPath() + "/frame_store_test.bin";
+  for (auto cold_storage : {io::FrameColdStorage::MEMORY, io::FrameColdStorage::FILE})
+  {
+    io::FrameStore store(2, cold_storage, filepath);
+    for (uint32_t i = 0; i < 6; ++i)
+      store.add(createFrame(i));
+
+    EXPECT_EQ(store.size(), 6u);
+    EXPECT_EQ(store.getNrofCold(), 4u);
+
+    uint32_t frame_id = 0;
+    store.forEach([&](const Frame::Ptr &frame)
+    {
+      EXPECT_EQ(frame->getFrameId(), frame_id);
+      ASSERT_TRUE(frame->getSurfaceModel() != nullptr);
+      const cv::Mat &elevation = frame->getSurfaceModel()->get("elevation");
+      EXPECT_TRUE(std::isnan(elevation.at<float>(0, 0)));
+      EXPECT_FLOAT_EQ(elevation.at<float>(100, 100), static_cast<float>(frame_id));
+      frame_id++;
+    });
+    EXPECT_EQ(frame_id, 6u);
+
+    // Cold frames in memory must be considerably smaller than the resident ones
+    size_t bytes_resident = 2 * createFrame(0)->getByteSize();
+    if (cold_storage == io::FrameColdStorage::MEMORY)
+      EXPECT_LT(store.getByteSize() - bytes_resident, bytes_resident);
+    else
+      EXPECT_EQ(store.getByteSize(), bytes_resident);
+  }
+  EXPECT_FALSE(io::fileExists(filepath));
+}
@@ -0,0 +1,44 @@
+
+
+#include <cstdio>
+
+#include <realm_io/mbtiles_store.h>
+#include <realm_io/utilities.h>
+
+// gtest
+#include <gtest/gtest.h>
+
+using namespace realm;
+
+TEST(MbtilesStore, WriteRead)
+{
+  // Tiles are written in batches, but must be readable before and after they were committed. Reopening the file
+  // restores all committed tiles, writing the same index again replaces the data.
+  std::string filepath = io::getTempDirectoryPath() + "/mbtiles_store_test.mbtiles";
+  std::remove(filepath.c_str());
+
+  std::vector<uint8_t> data_in{1, 2, 3, 4, 5};
+  std::vector<uint8_t> data_out;
+  {
+    io::MbtilesStore store(filepath, "color_rgb", "png");
+    EXPECT_FALSE(store.read(18, 100, 200, data_out));
+
+    store.write(18, 100, 200, data_in);
+    EXPECT_TRUE(store.read(18, 100, 200, data_out));
+    EXPECT_EQ(data_out, data_in);
+
+    for (int i = 0; i < io::MbtilesStore::kBatchSize + 10; ++i)
+      store.write(17, i, 0, data_in);
+    store.commit();
+  }
+
+  io::MbtilesStore store(filepath, "color_rgb", "png");
+  EXPECT_TRUE(store.read(18, 100, 200, data_out));
+  EXPECT_EQ(data_out, data_in);
+  EXPECT_TRUE(store.read(17, io::MbtilesStore::kBatchSize + 9, 0, data_out));
+
+  std::vector<uint8_t> data_replaced{9, 8, 7};
+  store.write(18, 100, 200, data_replaced);
+  EXPECT_TRUE(store.read(18, 100, 200, data_out));
+  EXPECT_EQ(data_out, data_replaced);
+}
@@ -18,10 +18,19 @@
 * along with OpenREALM. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <atomic>
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <thread>
 
+#include <realm_io/checkpoint_store.h>
+#include <realm_io/export_service.h>
+#include <realm_io/frame_snapshot.h>
+#include <realm_io/mapped_grid_map.h>
 #include <realm_io/realm_import.h>
 #include <realm_io/realm_export.h>
+#include <realm_io/trace_export.h>
 #include <realm_io/utilities.h>
 
 // gtest
@@ -68,6 +77,50 @@ TEST(RealmIO, CvGridMapBinary)
   EXPECT_NEAR(layer_d.data.at<double>(50, 50), 125, 10e-3);
 }
 
+TEST(RealmIO, CvGridMapMapped)
+{
+  // For this test we save a CvGridMap in the memory mappable container and open it again. Layers are accessed as views
+  // into the mapping and as copies, both have to match the map we put in.
+  std::string path_tmp = io::getTempDirectoryPath();
+
+  auto map = std::make_shared<CvGridMap>(cv::Rect2d(50.0, 100.0, 200.0, 250.0), 1.0);
+  map->add("data_a", cv::Mat(map->size(), CV_8UC4, cv::Scalar(125, 125, 125, 255)), cv::INTER_AREA);
+  map->add("data_c", cv::Mat(map->size(), CV_32FC1, 125.0), cv::INTER_CUBIC);
+  map->add("data_d", cv::Mat(map->size(), CV_64FC1, 125.0), cv::INTER_LINEAR);
+  (*map)["data_d"].at<double>(10, 20) = 42.0;
+  io::MappedGridMap::save(*map, path_tmp + "/" + "tmp_map.grid.mmap");
+
+  io::MappedGridMap map_mapped(path_tmp + "/" + "tmp_map.grid.mmap");
+
+  cv::Rect2d roi = map_mapped.roi();
+  EXPECT_NEAR(roi.x, 50.0, 10e-3);
+  EXPECT_NEAR(roi.y, 100.0, 10e-3);
+  EXPECT_NEAR(roi.width, 200.0, 10e-3);
+  EXPECT_NEAR(roi.height, 250.0, 10e-3);
+  EXPECT_NEAR(map_mapped.resolution(), 1.0, 10e-3);
+  EXPECT_EQ(map_mapped.size(), map->size());
+  EXPECT_EQ(map_mapped.getAllLayerNames(), map->getAllLayerNames());
+  EXPECT_FALSE(map_mapped.exists("data_b"));
+  EXPECT_THROW(map_mapped.getLayerView("data_b"), std::out_of_range);
+
+  // Views point into the page-aligned layer blobs
+  cv::Mat view_a = map_mapped.getLayerView("data_a");
+  EXPECT_EQ(view_a.type(), CV_8UC4);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(view_a.data) % 4096, 0u);
+  EXPECT_EQ(view_a.at<cv::Vec4b>(50, 50), cv::Vec4b(125, 125, 125, 255));
+  EXPECT_EQ(map_mapped.getLayerInterpolation("data_a"), cv::INTER_AREA);
+  EXPECT_NEAR(map_mapped.getLayerView("data_c").at<float>(50, 50), 125, 10e-3);
+  EXPECT_NEAR(map_mapped.getLayerView("data_d").at<double>(10, 20), 42.0, 10e-3);
+
+  CvGridMap::Ptr map_copy = map_mapped.toCvGridMap({"data_d"});
+  EXPECT_EQ(map_copy->getAllLayerNames().size(), 1u);
+  EXPECT_EQ(map_copy->getLayer("data_d").interpolation, cv::INTER_LINEAR);
+  EXPECT_NEAR((*map_copy)["data_d"].at<double>(10, 20), 42.0, 10e-3);
+  EXPECT_NEAR((*map_copy)["data_d"].at<double>(50, 50), 125.0, 10e-3);
+
+  EXPECT_THROW(io::MappedGridMap(path_tmp + "/" + "tmp_map.grid.bin"), std::invalid_argument);
+}
+
 TEST(RealmIO, CvGridMapBinaryLegacy)
 {
   // This test will check, whether the initial binary specification for CvGridMap have changed or not. We do this by
@@ -107,4 +160,251 @@ TEST(RealmIO, CameraYaml)
   EXPECT_EQ(cam.width(), 1200);
   EXPECT_NEAR(cam.fx(), 1200.0, 10e-3);
   EXPECT_NEAR(cam.k2(), 0.2, 10e-3);
-}
\ No newline at end of file
+}
+
+TEST(RealmIO, TrajectoryTUM)
+{
+  // Here we save a trajectory with the exporter and load it again. Comments and blank lines have to be skipped.
+  std::string filepath = io::getTempDirectoryPath() + "/tmp_traj_TUM.txt";
+  {
+    std::ofstream file(filepath);
+    file << "# timestamp x y z qx qy qz qw\n\n";
+  }
+
+  cv::Mat pose = (cv::Mat_<double>(3, 4) << 0.0, -1.0, 0.0, 604347.5,
+                                            1.0, 0.0, 0.0, 5792556.25,
+                                            0.0, 0.0, 1.0, 100.0);
+  io::saveTrajectory(1500000001, pose, filepath);
+  io::saveTrajectory(1500000002, cv::Mat::eye(3, 4, CV_64F), filepath);
+
+  std::unordered_map<uint64_t, cv::Mat> trajectory = io::loadTrajectoryFromTxtTUM(filepath);
+  ASSERT_EQ(trajectory.size(), 2u);
+  EXPECT_LT(cv::norm(trajectory[1500000001], pose, cv::NORM_INF), 10e-3);
+  EXPECT_LT(cv::norm(trajectory[1500000002], cv::Mat::eye(3, 4, CV_64F), cv::NORM_INF), 10e-6);
+
+  {
+    std::ofstream file(filepath, std::ios::app);
+    file << "1500000003 1.0 2.0\n";
+  }
+  EXPECT_THROW(io::loadTrajectoryFromTxtTUM(filepath), std::runtime_error);
+  io::removeFileOrDirectory(filepath);
+}
+
+TEST(RealmIO, SurfacePointsTxtParallel)
+{
+  // For this test we write a point file large enough to be parsed in several chunks. Serial and parallel parsing must
+  // give the same points in the order of the lines.
+  std::string filepath = io::getTempDirectoryPath() + "/tmp_surface_points.txt";
+  const int nrof_points = 200000;
+  {
+    std::ofstream file(filepath);
+    file.precision(10);
+    for (int i = 0; i < nrof_points; ++i)
+      file << i * 0.5 << " " << -i << "\t" << 100.0 + i * 0.25 << "\r\n";
+  }
+
+  auto thread_pool = std::make_shared<ThreadPool>(4);
+  cv::Mat points_serial = io::loadSurfacePointsFromTxt(filepath);
+  cv::Mat points_parallel = io::loadSurfacePointsFromTxt(filepath, thread_pool, 0);
+
+  ASSERT_EQ(points_serial.rows, nrof_points);
+  ASSERT_EQ(points_parallel.rows, nrof_points);
+  EXPECT_EQ(points_serial.type(), CV_64F);
+  EXPECT_EQ(cv::norm(points_serial, points_parallel, cv::NORM_INF), 0.0);
+  EXPECT_NEAR(points_parallel.at<double>(nrof_points - 1, 0), (nrof_points - 1) * 0.5, 10e-6);
+  EXPECT_NEAR(points_parallel.at<double>(nrof_points - 1, 1), -(nrof_points - 1), 10e-6);
+  EXPECT_NEAR(points_parallel.at<double>(12345, 2), 100.0 + 12345 * 0.25, 10e-6);
+  io::removeFileOrDirectory(filepath);
+}
+
+TEST(RealmIO, ChromeTrace)
+{
+  // Here we export the trace of two frames through two stages. The second frame is still waiting in the queue of the
+  // second stage, so no slice is written there yet. We only check the structure of the file, the format itself is
+  // defined by the Chrome trace event specification.
+  std::string filepath = io::getTempDirectoryPath() + "/trace.json";
+
+  io::TraceExporter exporter;
+  exporter.add(0, {StageTrace{"densification", 1000000, 2000000, 2000000, 5000000},
+                   StageTrace{"mosaicing", 6000000, 7000000, 0, 9000000}});
+  exporter.add(1, {StageTrace{"densification", 3000000, 5000000, 5000000, 8000000},
+                   StageTrace{"mosaicing", 8500000, 0, 0, 0}});
+  exporter.save(filepath);
+
+  std::ifstream file(filepath);
+  std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+  auto count = [&](const std::string &str)
+  {
+    size_t n = 0;
+    for (size_t pos = content.find(str); pos != std::string::npos; pos = content.find(str, pos + 1))
+      n++;
+    return n;
+  };
+
+  EXPECT_EQ(content.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["), 0u);
+  EXPECT_EQ(count("\"ph\":\"M\""), 2u);
+  EXPECT_EQ(count("\"ph\":\"X\""), 6u);
+  EXPECT_EQ(count("\"ph\":\"s\""), 2u);
+  EXPECT_EQ(count("\"ph\":\"f\""), 2u);
+
+  // Processing of the first frame in the second stage starts after dequeuing, duration is 2 ms = 2000 us
+  EXPECT_NE(content.find("\"name\":\"process #0\",\"cat\":\"process\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":7000.000,\"dur\":2000.000"), std::string::npos);
+}
+
+TEST(RealmIO, ExportService)
+{
+  // For this test we submit jobs to the export service. All of them have to be finished after flush, a failing job must
+  // not stop the service and with a full queue the oldest waiting job is dropped.
+  std::atomic<int> nrof_finished{0};
+  {
+    io::ExportService service(2, 4, false);
+    for (int i = 0; i < 10; ++i)
+      service.submit("job", [&nrof_finished]{ nrof_finished++; });
+    service.submit("job_failing", []{ throw(std::runtime_error("Export failed")); });
+    service.flush();
+    EXPECT_EQ(nrof_finished, 10);
+    EXPECT_EQ(service.getNrofPending(), 0u);
+    EXPECT_EQ(service.getNrofDropped(), 0u);
+  }
+
+  std::mutex mutex_block;
+  std::unique_lock<std::mutex> lock_block(mutex_block);
+  std::atomic<bool> is_blocking{false};
+  io::ExportService service(1, 1, true);
+
+  // First job blocks the only worker, second one waits in the queue and is replaced by the third
+  service.submit("job_blocking", [&]{ is_blocking = true; std::unique_lock<std::mutex> lock(mutex_block); });
+  while (!is_blocking)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  EXPECT_TRUE(service.submit("job_dropped", [&nrof_finished]{ nrof_finished += 100; }));
+  EXPECT_FALSE(service.submit("job_kept", [&nrof_finished]{ nrof_finished++; }));
+  lock_block.unlock();
+  service.flush();
+  EXPECT_EQ(service.getNrofDropped(), 1u);
+  EXPECT_EQ(nrof_finished, 11);
+}
+
+TEST(RealmIO, FrameSnapshot)
+{
+  // For this test we write a frame with all the data the pipeline adds to it into a snapshot and read it again. The
+  // restored frame must be in the same state, so a stage fed with it behaves exactly like in the full pipeline.
+  std::string filepath = io::getTempDirectoryPath() + "/frames.frames.bin";
+
+  auto cam = std::make_shared<camera::Pinhole>(1200.0, 1200.0, 400.0, 300.0, 800, 600);
+  cam->setDistortionMap(-0.1, 0.01, 0.001, 0.002, 0.0);
+  cv::Mat img(600, 800, CV_8UC3, cv::Scalar(10, 20, 30));
+  auto frame = std::make_shared<Frame>("cam", 7, 1500000000, img, UTMPose(604347, 5792556, 100.0, 23.0, 32, 'U'),
+                                       cam, cv::Mat::eye(3, 3, CV_64F));
+
+  cv::Mat pose = (cv::Mat_<double>(3, 4) << 1.0, 0.0, 0.0, 1.0, 0.0, -1.0, 0.0, 2.0, 0.0, 0.0, -1.0, 3.0);
+  cv::Mat georeference = cv::Mat::eye(4, 4, CV_64F);
+  georeference.at<double>(0, 3) = 604000.0;
+  georeference.at<double>(1, 3) = 5792000.0;
+  frame->setImageResizeFactor(0.5);
+  frame->setVisualPose(pose);
+  frame->initGeoreference(georeference);
+  frame->setKeyframe(true);
+  frame->setSurfaceAssumption(SurfaceAssumption::ELEVATION);
+
+  auto cloud = std::make_shared<PointCloud>();
+  cv::Vec3b color(1, 2, 3);
+  cloud->push_back(11, cv::Point3d(604001.0, 5792002.0, -10.0), &color);
+  cloud->push_back(12, cv::Point3d(604003.0, 5792004.0, -12.0), &color);
+  frame->setSparseCloud(cloud, false);
+
+  camera::Pinhole::Ptr cam_resized = frame->getResizedCamera();
+  frame->setDepthmap(std::make_shared<Depthmap>(cv::Mat(300, 400, CV_32F, 90.0f), *cam_resized));
+
+  auto surface_model = std::make_shared<CvGridMap>(cv::Rect2d(604000.0, 5792000.0, 20.0, 10.0), 1.0);
+  surface_model->add("elevation", cv::Mat(surface_model->size(), CV_32F, 5.0f), cv::INTER_LINEAR);
+  frame->setSurfaceModel(surface_model);
+
+  auto orthophoto = std::make_shared<CvGridMap>(cv::Rect2d(604000.0, 5792000.0, 20.0, 10.0), 0.5);
+  orthophoto->add("color_rgb", cv::Mat(orthophoto->size(), CV_8UC4, cv::Scalar(4, 5, 6, 255)), cv::INTER_LINEAR);
+  frame->setOrthophoto(orthophoto);
+
+  {
+    io::FrameSnapshotWriter writer(filepath);
+    writer.write(frame);
+    writer.write(frame);
+    EXPECT_EQ(writer.getNrofFrames(), 2u);
+  }
+
+  io::FrameSnapshotReader reader(filepath);
+  for (int i = 0; i < 2; ++i)
+  {
+    ASSERT_TRUE(reader.hasNext());
+    Frame::Ptr copy = reader.next();
+    ASSERT_NE(copy, nullptr);
+
+    EXPECT_EQ(copy->getCameraId(), "cam");
+    EXPECT_EQ(copy->getFrameId(), 7u);
+    EXPECT_EQ(copy->getTimestamp(), 1500000000u);
+    EXPECT_EQ(copy->getGnssUtm().zone, 32);
+    EXPECT_NEAR(copy->getGnssUtm().northing, 5792556.0, 10e-6);
+    EXPECT_TRUE(copy->isKeyframe());
+    EXPECT_TRUE(copy->isGeoreferenced());
+    EXPECT_TRUE(copy->hasAccuratePose());
+    EXPECT_EQ(copy->getSurfaceAssumption(), SurfaceAssumption::ELEVATION);
+    EXPECT_NEAR(copy->getImageResizeFactor(), 0.5, 10e-6);
+    EXPECT_TRUE(copy->getCamera()->hasDistortion());
+    EXPECT_NEAR(cv::norm(copy->getPose() - frame->getPose()), 0.0, 10e-6);
+    EXPECT_NEAR(cv::norm(copy->getGeoreference() - georeference), 0.0, 10e-6);
+    EXPECT_EQ(cv::norm(copy->getImageRaw(), img, cv::NORM_INF), 0.0);
+
+    ASSERT_NE(copy->getSparseCloud(), nullptr);
+    EXPECT_EQ(copy->getSparseCloud()->size(), 2);
+    EXPECT_EQ(copy->getSparseCloud()->getPointIds()[1], 12u);
+    EXPECT_NEAR(copy->getSparseCloud()->getPoint(1).y, 5792004.0, 10e-3);
+    EXPECT_EQ(copy->getSparseCloud()->getColors()[0], color);
+
+    ASSERT_NE(copy->getDepthmap(), nullptr);
+    EXPECT_EQ(copy->getDepthmap()->getCamera()->width(), 400u);
+    EXPECT_NEAR(copy->getDepthmap()->data().at<float>(150, 200), 90.0f, 10e-6);
+
+    ASSERT_NE(copy->getSurfaceModel(), nullptr);
+    EXPECT_NEAR(copy->getSurfaceModel()->getLayer("elevation").data.at<float>(5, 10), 5.0f, 10e-6);
+    ASSERT_NE(copy->getOrthophoto(), nullptr);
+    EXPECT_NEAR(copy->getOrthophoto()->resolution(), 0.5, 10e-6);
+    EXPECT_EQ(copy->getOrthophoto()->getLayer("color_rgb").data.at<cv::Vec4b>(3, 3), cv::Vec4b(4, 5, 6, 255));
+  }
+  EXPECT_FALSE(reader.hasNext());
+  EXPECT_EQ(reader.next(), nullptr);
+}
+
+TEST(RealmIO, CheckpointStore)
+{
+  // For this test a checkpoint file is replaced by a newer version. A write function that fails before creating its
+  // file must keep the previous version, so a crash while writing never leaves an incomplete checkpoint behind.
+  std::string directory = io::getTempDirectoryPath() + "/checkpoint_store_test";
+  io::CheckpointStore store(directory);
+  EXPECT_TRUE(io::dirExists(directory));
+  EXPECT_FALSE(store.exists("state.yaml"));
+
+  auto write_value = [](int value)
+  {
+    return [value](const std::string &filepath)
+    {
+      std::ofstream file(filepath);
+      file << value;
+    };
+  };
+
+  EXPECT_TRUE(store.write("state.yaml", write_value(1)));
+  EXPECT_TRUE(store.write("state.yaml", write_value(2)));
+  EXPECT_FALSE(store.write("state.yaml", [](const std::string &) {}));
+  EXPECT_THROW(store.write("state.yaml", [](const std::string &) { throw(std::runtime_error("Write failed")); }),
+               std::runtime_error);
+
+  ASSERT_TRUE(store.exists("state.yaml"));
+  std::ifstream file(store.getFilepath("state.yaml"));
+  int value = 0;
+  file >> value;
+  EXPECT_EQ(value, 2);
+  EXPECT_FALSE(io::fileExists(store.getFilepath("tmp_state.yaml")));
+
+  store.remove("state.yaml");
+  EXPECT_FALSE(store.exists("state.yaml"));
+  io::removeFileOrDirectory(directory);
+}
@@ -0,0 +1,82 @@
+#include <realm_io/shm_transport.h>
+
+// gtest
+#include <gtest/gtest.h>
+
+using namespace realm;
+
+TEST(ShmTransport, WriteRead)
+{
+  // Here we publish an image and a grid map through the transport functions and read them back through the handles
+  // with a reader of the same segment, both as copy and as view into the segment.
+  io::ShmTransport transport("realm_shm_transport_test", 4, 1 << 20);
+  io::ShmTransportReader reader(transport.getName());
+
+  std::vector<std::pair<io::ShmTransport::Handle, std::string>> handles;
+  auto notify = [&handles](const io::ShmTransport::Handle &handle, const std::string &topic)
+  {
+    handles.emplace_back(handle, topic);
+  };
+
+  cv::Mat img(100, 200, CV_8UC3, cv::Scalar(10, 20, 30));
+  transport.createImageTransport(notify)(img, "output/rgb");
+
+  CvGridMap map(cv::Rect2d(0.0, 0.0, 10.0, 10.0), 0.5);
+  map.add("elevation", cv::Mat(map.size(), CV_32F, cv::Scalar(5.0f)));
+  map.add("color_rgb", cv::Mat(map.size(), CV_8UC4, cv::Scalar(1, 2, 3, 255)), cv::INTER_NEAREST);
+  transport.createCvGridMapTransport(notify)(map.getSubmap({"elevation", "color_rgb"}, cv::Rect2i(2, 3, 10, 8)), 32, 'U', "output/update/ortho");
+
+  ASSERT_EQ(handles.size(), 2);
+  EXPECT_EQ(handles[0].second, "output/rgb");
+  EXPECT_EQ(handles[1].second, "output/update/ortho");
+
+  cv::Mat img_copy;
+  EXPECT_TRUE(reader.read(handles[0].first, img_copy));
+  EXPECT_EQ(cv::norm(img_copy, img, cv::NORM_INF), 0.0);
+
+  cv::Mat img_view;
+  EXPECT_TRUE(reader.read(handles[0].first, img_view, false));
+  EXPECT_EQ(cv::norm(img_view, img, cv::NORM_INF), 0.0);
+  EXPECT_TRUE(reader.isValid(handles[0].first));
+
+  CvGridMap map_read;
+  uint8_t zone = 0;
+  char band = 0;
+  EXPECT_TRUE(reader.read(handles[1].first, map_read, zone, band));
+  EXPECT_EQ(zone, 32);
+  EXPECT_EQ(band, 'U');
+  EXPECT_EQ(map_read.size(), cv::Size(10, 8));
+  EXPECT_DOUBLE_EQ(map_read.resolution(), 0.5);
+  EXPECT_EQ(map_read.getLayer("color_rgb").interpolation, cv::INTER_NEAREST);
+  EXPECT_EQ(cv::norm(map_read["elevation"], cv::Mat(8, 10, CV_32F, cv::Scalar(5.0f)), cv::NORM_INF), 0.0);
+}
+
+TEST(ShmTransport, OverwrittenSlots)
+{
+  // For this test we publish more messages than there are slots. Handles of overwritten slots must be rejected, and
+  // messages not fitting into a slot are dropped without notification.
+  io::ShmTransport transport("realm_shm_transport_test_overwrite", 2, 1024);
+  io::ShmTransportReader reader(transport.getName());
+
+  io::ShmTransport::Handle first{}, last{};
+  EXPECT_TRUE(transport.write(cv::Mat(10, 10, CV_8UC1, cv::Scalar(1)), "output/rgb", first));
+  EXPECT_TRUE(transport.write(cv::Mat(10, 10, CV_8UC1, cv::Scalar(2)), "output/rgb", last));
+  EXPECT_TRUE(reader.isValid(first));
+
+  EXPECT_TRUE(transport.write(cv::Mat(10, 10, CV_8UC1, cv::Scalar(3)), "output/rgb", last));
+  EXPECT_EQ(last.slot, first.slot);
+  EXPECT_FALSE(reader.isValid(first));
+
+  cv::Mat img;
+  EXPECT_FALSE(reader.read(first, img));
+  EXPECT_TRUE(reader.read(last, img));
+  EXPECT_EQ(img.at<uchar>(0, 0), 3);
+
+  int nrof_notified = 0;
+  auto transport_img = transport.createImageTransport([&nrof_notified](const io::ShmTransport::Handle &, const std::string &)
+  {
+    nrof_notified++;
+  });
+  transport_img(cv::Mat(100, 100, CV_8UC1, cv::Scalar(4)), "output/rgb");
+  EXPECT_EQ(nrof_notified, 0);
+}
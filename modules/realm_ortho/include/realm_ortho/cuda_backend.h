@@ -0,0 +1,88 @@
+
+
+#ifndef PROJECT_CUDA_BACKEND_H
+#define PROJECT_CUDA_BACKEND_H
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <realm_core/camera.h>
+#include <realm_core/cv_grid_map.h>
+#include <realm_core/mat_pool.h>
+
+namespace realm
+{
+namespace ortho
+{
+namespace cuda
+{
+
+/*!
+ * @brief Checks if the library was built with CUDA and a device is present. If not, all other functions of the backend
+ * throw, so callers have to fall back to the CPU implementation.
+ * @return True if rectification and blending can be processed on the GPU
+ */
+bool isAvailable();
+
+/*!
+ * @brief Checks if an interpolation can be used for sampling the image on the GPU
+ * @param interpolation OpenCV interpolation flag
+ * @return True for cv::INTER_NEAREST and cv::INTER_LINEAR
+ */
+bool isInterpolationSupported(int interpolation);
+
+/*!
+ * @brief Backprojection from grid on the GPU, see ortho::backprojectFromGrid. It computes in single precision in a local
+ * frame and uses the approximated elevation angle, so the result equals the vectorized kernel on the CPU. The device
+ * buffers are kept per thread, so they are only allocated when the grid grows. On integrated GPUs, e.g. Jetson,
+ * matrices in pinned memory (see MatPool::Memory) are accessed in place without copying them.
+ * @param img Image data that is corrected from lens distortion, has to be CV_8UC4
+ * @param cam Underlying camera model, currently only pinhole camera is supported
+ * @param surface Surface structure as matrix with each element resembling the elevation to a reference plane
+ * @param roi Region of interest in geographic coordinates with (x, y) = lower left corner
+ * @param GSD Ground sampling distance, therefore the resolution of the surface cells
+ * @param is_elevated Flag to set whether the surface is planar or has elevation
+ * @param verbose Flag to log processing information
+ * @param interpolation OpenCV interpolation flag, only cv::INTER_NEAREST and cv::INTER_LINEAR are supported
+ * @param mat_pool Pool the layers of the result are allocated from. If nullptr, OpenCV allocates them
+ * @return Rectified grid with the same layers as the backprojection on the CPU
+ */
+CvGridMap::Ptr backprojectFromGrid(
+    const cv::Mat &img,
+    const camera::Pinhole &cam,
+    cv::Mat &surface,
+    const cv::Rect2d &roi,
+    double GSD,
+    bool is_elevated,
+    bool verbose = true,
+    int interpolation = cv::INTER_NEAREST,
+    MatPool* mat_pool = nullptr);
+
+/*!
+ * @brief Blending of new data into the reference on the GPU, same as the blending of the mosaicing on the CPU. New data
+ * is taken if it was observed under a steeper elevation angle. All layers must have the same size, the reference
+ * layers may be views into a larger map and are written in place.
+ * @param ref_color Color of the reference, CV_8UC4
+ * @param ref_elevation Elevation of the reference, CV_32F
+ * @param ref_angle Elevation angle of the reference, CV_32F
+ * @param ref_nobs Number of observations of the reference, CV_16UC1
+ * @param ref_var Elevation variance of the reference, CV_32F. If empty, the elevation of the steepest observation is kept
+ *        instead of fusing all observations into a running mean and variance
+ * @param src_color Color of the new data, CV_8UC4
+ * @param src_elevation Elevation of the new data, CV_32F
+ * @param src_angle Elevation angle of the new data, CV_32F
+ */
+void blend(cv::Mat &ref_color,
+           cv::Mat &ref_elevation,
+           cv::Mat &ref_angle,
+           cv::Mat &ref_nobs,
+           cv::Mat &ref_var,
+           const cv::Mat &src_color,
+           const cv::Mat &src_elevation,
+           const cv::Mat &src_angle);
+
+} // namespace cuda
+} // namespace ortho
+} // namespace realm
+
+#endif //PROJECT_CUDA_BACKEND_H
@@ -14,6 +14,10 @@
 namespace realm
 {
 
+/*!
+ * @brief Delaunay triangulation of the valid cells of a grid map with CGAL. Points on the regular raster of a grid map
+ * are triangulated much faster by GridTriangulation, so this is only meant for irregular point sets.
+ */
 class Delaunay2D
 {
   public:
@@ -4,16 +4,18 @@
 #define PROJECT_DSM_H
 
 #include <memory>
-#include <numeric>
+#include <utility>
+#include <vector>
 
 #include <eigen3/Eigen/Eigen>
 #include <opencv2/core.hpp>
 
 #include <realm_core/enums.h>
 #include <realm_core/cv_grid_map.h>
+#include <realm_core/depthmap.h>
 #include <realm_core/plane_fitter.h>
-#include <realm_ortho/nanoflann.h>
-#include <realm_ortho/nearest_neighbor.h>
+#include <realm_core/thread_pool.h>
+#include <realm_ortho/point_grid_index.h>
 
 namespace realm
 {
@@ -25,11 +27,6 @@ class DigitalSurfaceModel
     using Ptr = std::shared_ptr<DigitalSurfaceModel>;
     using ConstPtr = std::shared_ptr<const DigitalSurfaceModel>;
 
-    // Wrapping typedefs in realm convention
-    static constexpr size_t kMaxLeaf = 10u;
-    static constexpr size_t kDimensionKdTree = 2u;
-    using PointCloudAdaptor_t = PointCloudAdaptor<ortho::PointCloud<double>>;
-    using KdTree_t = nanoflann::KDTreeSingleIndexAdaptor<ortho::nanoflann::L2_Adaptor<double, PointCloudAdaptor_t>, PointCloudAdaptor_t, kDimensionKdTree>;
   public:
     enum class SurfaceNormalMode
     {
@@ -53,8 +50,31 @@ class DigitalSurfaceModel
      * @param roi Region of interest of the observed surface, usually utm coordinates and width/height in [m]
      * @param points Cloud of observed surface points as Mat structured rowise: x, y, z
      * @param knn_radius_factor Factor for initial knn-search is GSD * knn_radius_factor
+     * @param nrof_threads Number of threads used for the elevation computation, <= 0 uses all available cores
+     * @param coarse_step Step size in grid cells of the coarse grid for hierarchical evaluation, <= 1 evaluates every cell
+     * @param th_flatness Maximum elevation difference in [m] of the coarse grid corners, for which a block is considered
+     *        flat and interpolated instead of evaluated
+     * @param thread_pool Shared thread pool of the pipeline. If nullptr, OpenCV's parallel framework is used
+     * @param index Spatial index to be rebuilt for the points, e.g. to reuse its buffers for the following frames.
+     *        Must not be used by anyone else during construction. If nullptr, a new grid index is created
      */
-    DigitalSurfaceModel(const cv::Rect2d &roi, const cv::Mat &points, SurfaceNormalMode mode, int knn_max_iter);
+    DigitalSurfaceModel(const cv::Rect2d &roi, const cv::Mat &points, SurfaceNormalMode mode, int knn_max_iter,
+                        int nrof_threads = 0, int coarse_step = 1, double th_flatness = 0.0,
+                        const ThreadPool::Ptr &thread_pool = nullptr, const NeighbourIndex2D::Ptr &index = nullptr);
+
+    /*!
+     * @brief Constructor for elevated surfaces rasterized directly from a depth map. Every valid depth is reprojected
+     * and averaged into its grid cell, so the computation is linear in the number of pixels and needs no neighbour
+     * search. Resolution is the ground footprint of a pixel at median depth. Empty cells with at least four observed
+     * neighbours are filled with the mean of them.
+     * @param roi Region of interest of the observed surface, usually utm coordinates and width/height in [m]
+     * @param depthmap Depth map with the camera model and pose of its reconstruction
+     * @param mode Normals are computed from the elevation gradient for every mode other than NONE
+     * @param nrof_threads Number of threads used for the rasterization, <= 0 uses all available cores
+     * @param thread_pool Shared thread pool of the pipeline. If nullptr, OpenCV's parallel framework is used
+     */
+    DigitalSurfaceModel(const cv::Rect2d &roi, const Depthmap::Ptr &depthmap, SurfaceNormalMode mode,
+                        int nrof_threads = 0, const ThreadPool::Ptr &thread_pool = nullptr);
 
     CvGridMap::Ptr getSurfaceGrid();
 
@@ -66,6 +86,19 @@ class DigitalSurfaceModel
     //! Maximum iterations per grid cell to find the next nearest neigbour in the dense clouds.
     int m_knn_max_iter;
 
+    //! Number of threads for the elevation computation. The spatial index is read-only after initialization, so grid
+    //! cells can be evaluated concurrently.
+    int m_nrof_threads;
+
+    //! Shared thread pool of the pipeline, can be nullptr
+    ThreadPool::Ptr m_thread_pool;
+
+    //! Step size of the coarse grid in cells for hierarchical evaluation. Disabled for values <= 1
+    int m_coarse_step;
+
+    //! Maximum elevation difference within a coarse block to be interpolated rather than evaluated
+    double m_th_flatness;
+
     //! Assumption of the DSM. Either planar or elevation
     SurfaceAssumption m_assumption;
 
@@ -76,21 +109,18 @@ class DigitalSurfaceModel
     CvGridMap::Ptr m_surface;
 
     //! Input point cloud (only for elevation surface)
-    ortho::PointCloud<double> m_point_cloud;
-
-    //! Adapter for point cloud k-d tree and NN search (only for elevation surface)
-    std::unique_ptr<PointCloudAdaptor_t> m_point_cloud_adaptor;
+    cv::Mat m_point_cloud;
 
-    //! Binary k-d tree for NN search. Only in xy-direction (only for elevation surface)
-    std::unique_ptr<KdTree_t> m_kd_tree;
+    //! Spatial index for NN search. Only in xy-direction (only for elevation surface)
+    NeighbourIndex2D::Ptr m_index;
 
     /*!
-     * @brief Initializes a k-d tree from the input point cloud. Important: k-d tree has 2 dimensions due to search in
+     * @brief Builds the spatial index from the input point cloud. Important: Index has 2 dimensions due to search in
      *        x- and y-direction only.
-     * @param point_cloud Point cloud for which the k-d tree should be computed. Is structured as OpenCV mat type with
+     * @param point_cloud Point cloud for which the index should be built. Is structured as OpenCV mat type with
      *        row(i) = (x,y,z,r,g,b,nx,ny,nz)
      */
-    void initKdTree(const PointCloud<double> &point_cloud);
+    void initIndex(const cv::Mat &point_cloud);
 
     /*!
      * @brief Ground sampling distance for input point cloud is computed. Gives a guess on the resolution of the grid
@@ -98,7 +128,16 @@ class DigitalSurfaceModel
      * @param point_cloud Point cloud structured as OpenCV mat type with row(i) = (x,y,z,r,g,b,nx,ny,nz)
      * @return GSD that roughly describes the average minimum xy-distance for points of point cloud
      */
-    double computePointCloudGSD(const PointCloud<double> &point_cloud);
+    double computePointCloudGSD(const cv::Mat &point_cloud);
+
+    /*!
+     * @brief Removes all points outside the region of interest with a margin of 10% of its larger edge, so the index
+     *        is only built for points that can contribute to the grid. Points with non-finite coordinates are removed.
+     * @param points Point cloud structured as OpenCV mat type with row(i) = (x,y,z,r,g,b,nx,ny,nz)
+     * @param roi Region of interest of the observed surface
+     * @return Points inside the region, the input itself if all points are inside or none
+     */
+    cv::Mat cullPointCloud(const cv::Mat &points, const cv::Rect2d &roi);
 
     /*!
      * @brief Filter function for input point cloud. Currently not in use, but might be implemented later.
@@ -108,59 +147,62 @@ class DigitalSurfaceModel
     cv::Mat filterPointCloud(const cv::Mat &points);
 
     /*!
-     * @brief Main function to compute elevation grid map from an input point cloud. K-d tree must have been initialized
+     * @brief Main function to compute elevation grid map from an input point cloud. Index must have been initialized
      *        beforhand.
      * @param point_cloud Point cloud structured as OpenCV mat type with row(i) = (x,y,z,r,g,b,nx,ny,nz)
      */
     void computeElevation(const cv::Mat &point_cloud);
 
     /*!
-     * @brief Function to compute the surface normal based on the local neighbourhood. Several modi can be selected, like
-     *        random neighbours, furthest neighbours or best-fit
-     * @param points Vector of all neighboured points
-     * @param dists Vector of distances to neighboured points
-     * @return Surface normal for input points
+     * @brief Computes elevation and optionally the surface normal of a single grid cell. Thread-safe, as long as every
+     *        thread provides its own result container.
+     * @param point_cloud Point cloud structured as OpenCV mat type with row(i) = (x,y,z,r,g,b,nx,ny,nz)
+     * @param r Row of the grid cell
+     * @param c Column of the grid cell
+     * @param indices_dists Result container of the radius search, is reused between calls to avoid reallocation
+     * @param elevation Output; Interpolated elevation of the grid cell
+     * @param normal Output; Surface normal of the grid cell, only written if normals are computed
+     * @return True if enough neighbours were found to compute the elevation
      */
-    cv::Vec3f computeSurfaceNormal(const std::vector<PlaneFitter::Point> &points, const std::vector<double> &dists);
+    bool computeElevationAtCell(const cv::Mat &point_cloud, uint32_t r, uint32_t c,
+                                std::vector<std::pair<int, double>> &indices_dists, float &elevation, cv::Vec3f &normal);
 
     /*!
-     * @brief Function to compute the indices of the k highest elements in the input vector
-     * @param vec Vector with elements
-     * @param k Number of k highest elements
-     * @return Indices of k highest elements
+     * @brief Main function to compute the elevation grid map from a depth map by rasterization. Creates the surface.
+     * @param roi Region of interest of the observed surface
+     * @param depthmap Depth map with the camera model and pose of its reconstruction
      */
-    std::vector<size_t> getKmaxElementsIndices(std::vector<double> vec, size_t k);
+    void rasterizeDepthmap(const cv::Rect2d &roi, const Depthmap::Ptr &depthmap);
 
     /*!
-     * @brief Function to interpolate height for a grid cell from a number of input points and their corresponding
-     *        distances. Method is called "Inverse distance weighted" (IDW)
-     * @param heights Height values of all neighboured points
-     * @param dists Distance values of all neighboured points
-     * @return Height interpolated
+     * @brief Computes surface normals from the gradient of the elevation by central differences. Cells at borders or
+     * next to unobserved cells use one-sided differences.
+     * @param elevation Elevation layer, unobserved cells are NaN
+     * @return Normal layer, zero for unobserved cells
      */
-    float interpolateHeight(const std::vector<double> &heights, const std::vector<double> &dists);
+    cv::Mat computeNormalsFromElevation(const cv::Mat &elevation);
 
     /*!
-     * @brief Function to interpolate surface normal for a grid cell from a number of input points and their corresponding
-     *        normal. Method is called "Inverse distance weighted" (IDW)
-     * @param normals All normals of the neighboured points
-     * @param dists Distance values of all neighboured points
-     * @return Interpolated surface normal
+     * @brief Coarse-to-fine evaluation of the elevation. A coarse grid with step size 'm_coarse_step' is evaluated first.
+     *        Every block between four coarse cells is then either
+     *        - skipped, if no point of the cloud is within search distance of any of its cells,
+     *        - bilinearly interpolated, if the elevation difference of its corners is below 'm_th_flatness',
+     *        - or fully evaluated otherwise.
+     * @param point_cloud Point cloud structured as OpenCV mat type with row(i) = (x,y,z,r,g,b,nx,ny,nz)
+     * @param elevation Output; Elevation layer, must be initialized with NaN
+     * @param elevation_normal Output; Normal layer, must be initialized with zeros
      */
-    cv::Vec3f interpolateNormal(const std::vector<PlaneFitter::Normal> &normals, const std::vector<double> &dists);
+    void computeElevationHierarchical(const cv::Mat &point_cloud, cv::Mat &elevation, cv::Mat &elevation_normal);
 
-    template <typename T>
-    std::vector<size_t> sort_indices(const std::vector<T> &v)
-    {
-        // initialize original index locations
-        std::vector<size_t> indices(v.size());
-        std::iota(indices.begin(), indices.end(), 0);
-
-        // sort indexes based on comparing values in v
-        std::sort(indices.begin(), indices.end(),
-             [&v](size_t i1, size_t i2) {return v[i1] < v[i2];});
-        return indices;
-    }
+    /*!
+     * @brief Function to compute the surface normal based on the local neighbourhood. Several modi can be selected, like
+     *        random neighbours, furthest neighbours or best-fit. Allocation-free, the selected points are accumulated
+     *        into a closed form plane fit.
+     * @param point_cloud Point cloud structured as OpenCV mat type with row(i) = (x,y,z,r,g,b,nx,ny,nz)
+     * @param indices_dists Rows and squared distances of at least three neighbours
+     * @return Surface normal pointing up
+     */
+    cv::Vec3f computeSurfaceNormal(const cv::Mat &point_cloud, const std::vector<std::pair<int, double>> &indices_dists);
 };
 } // namespace ortho
 } // namespace realm
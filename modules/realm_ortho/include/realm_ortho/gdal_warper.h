@@ -18,8 +18,9 @@ namespace gis
 
 /*!
  * @brief GdalWarper allows to transform an input CvGridMap from UTM coordinates into an EPSG standardized frame
- * utilizing GDAL library as backbone. The grid map is expected to fit into memory and must not contain more than
- * one layer. The number of threads used to compute the transformation can be provided.
+ * utilizing GDAL library as backbone. The grid map is expected to fit into memory. All layers are warped together,
+ * so the transformation is only computed once per map. The number of threads used to compute the transformation can
+ * be provided.
  */
 class GdalWarper
 {
@@ -48,13 +49,15 @@ public:
   /*!
    * @brief: Following the example in https://gdal.org/tutorials/warp_tut.html
    * The provided map must be in UTM coordinates and will be warped into the previously defined, target EPSG frame.
-   * Only single layer maps are currently supported. The interpolation strategy is taken from the CvGridMap layer
-   * meta information. No data values are kept as is, though there is currently an issue of GDAL setting no data values
+   * All layers are stacked as bands of one dataset and share the output geometry and the reprojection transformer.
+   * Layers with the same interpolation are warped in one operation, layers with four channels on their own, because
+   * the fourth channel is used as alpha band. The interpolation strategy is taken from the CvGridMap layer meta
+   * information. No data values are kept as is, though there is currently an issue of GDAL setting no data values
    * for floating point data to 0.0. The current fix is to identify cells with value 0.0 and fill them to NaN after
    * warping. The resulting map is a deep copy.
-   * @param map Map to be warped into a new coordinate system. Must not contain more than one layer.
+   * @param map Map to be warped into a new coordinate system
    * @param zone UTM zone of the grid. TODO: should probably be solved smarter in the future
-   * @return Warped map in the desired coordinate system. Coordinate system must be cartesian.
+   * @return Warped map with all layers in the desired coordinate system. Coordinate system must be cartesian.
    */
   CvGridMap::Ptr warpRaster(const CvGridMap &map, uint8_t zone);
 
@@ -71,6 +74,13 @@ private:
   /// Number of threads used for projection
   int m_nrof_threads;
 
+  /// Definition of the target coordinate frame in WKT, created once the EPSG code is set
+  std::string m_proj_target;
+
+  /// UTM zone of the previously warped map and the definition of its coordinate frame in WKT
+  uint8_t m_zone_source;
+  std::string m_proj_source;
+
   /// Internal GDAL memory driver to create a dataset from the layer input
   GDALDriver* m_driver;
 
@@ -81,6 +91,42 @@ private:
    * @param data Floating point matrix to be fixed
    */
   void fixGdalNoData(cv::Mat &data);
+
+  /*!
+   * @brief Converts the depth of an OpenCV matrix type into the GDAL data type of a band
+   * @param type OpenCV matrix type, e.g. CV_32FC1
+   * @return GDAL data type
+   */
+  static GDALDataType getGdalDataType(int type);
+
+  /*!
+   * @brief Adds one band per channel of a matrix to a memory dataset. The bands reference the matrix data without
+   * copying, so the matrix must be continuous and outlive the dataset.
+   * @param dataset Memory dataset of the same size as the matrix
+   * @param data Matrix with interleaved channels
+   */
+  static void addBands(GDALDataset* dataset, const cv::Mat &data);
+
+  /*!
+   * @brief Getter for the definition of a UTM coordinate frame in WKT, which is cached for the last requested zone
+   * @param zone UTM zone
+   * @return WKT of the coordinate frame
+   */
+  const std::string& getProjectionUTM(uint8_t zone);
+
+  /*!
+   * @brief Getter for the no data value of a layer type, NaN for floating point and 0 otherwise
+   * @param type OpenCV matrix type, e.g. CV_32FC1
+   * @return No data value
+   */
+  static double getNoDataValue(int type);
+
+  /*!
+   * @brief Converts an OpenCV interpolation flag into the corresponding GDAL resampling algorithm
+   * @param interpolation OpenCV interpolation flag, e.g. cv::INTER_LINEAR
+   * @return GDAL resampling algorithm, bilinear for unknown flags
+   */
+  static GDALResampleAlg getResampleAlg(int interpolation);
 };
 
 } // namespace gis
@@ -0,0 +1,86 @@
+
+
+#ifndef PROJECT_GRID_TRIANGULATION_H
+#define PROJECT_GRID_TRIANGULATION_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include <realm_core/cv_grid_map.h>
+#include <realm_core/thread_pool.h>
+
+namespace realm
+{
+
+/*!
+ * @brief Triangulation of the cells of a grid map, that exploits the regular raster instead of computing a Delaunay
+ * triangulation. Every 2x2 neighbourhood of valid cells is split into two faces, neighbourhoods with three valid cells
+ * into one, so the mesh is computed in linear time and follows holes of the mask instead of bridging them. Optionally
+ * flat areas are simplified with a quadtree: Blocks of cells with an elevation range below a threshold are replaced by
+ * a fan around their centre, that keeps all border vertices, so the mesh stays free of cracks next to finer blocks.
+ * Delaunay2D is only needed for irregular point sets, that do not lie on the raster.
+ */
+class GridTriangulation
+{
+  public:
+    using Ptr = std::shared_ptr<GridTriangulation>;
+    using ConstPtr = std::shared_ptr<const GridTriangulation>;
+
+  public:
+    /*!
+     * @brief Constructor
+     * @param max_level Maximum level of the quadtree, blocks have an edge length of up to 2^max_level cells. 0 disables
+     *        the simplification.
+     * @param max_deviation Maximum elevation range in [m] of a block to be simplified
+     * @param nrof_threads Number of threads, <= 0 uses all available, 1 runs serially
+     * @param thread_pool Shared thread pool of the pipeline, can be nullptr
+     */
+    explicit GridTriangulation(int max_level = 0,
+                               double max_deviation = 0.0,
+                               int nrof_threads = 1,
+                               const ThreadPool::Ptr &thread_pool = nullptr);
+
+    /*!
+     * @brief Triangulates all valid cells of the grid. Output has the same format as Delaunay2D::buildMesh.
+     * @param grid Grid map to be triangulated
+     * @param mask Name of the layer of type CV_8UC1 marking valid cells, all cells are valid if empty
+     * @param layer_elevation Name of the elevation layer. Cells with NaN elevation are invalid. Needed for the
+     *        simplification, which is skipped if the layer does not exist.
+     * @return Indices (x = col, y = row) of the vertices, every three of them form a face counter clockwise seen from
+     *         above
+     */
+    std::vector<cv::Point2i> buildMesh(const CvGridMap &grid,
+                                       const std::string &mask = "",
+                                       const std::string &layer_elevation = "elevation") const;
+
+  private:
+
+    int m_max_level;
+    double m_max_deviation;
+    int m_nrof_threads;
+    ThreadPool::Ptr m_thread_pool;
+
+    /*!
+     * @brief Recursively triangulates a block of cells of the quadtree
+     * @param valid Mask of valid cells
+     * @param elevation Elevation of type CV_32F, can be empty
+     * @param r Row of the upper left cell
+     * @param c Column of the upper left cell
+     * @param size Edge length of the block in quads, a power of two
+     * @param vertex_ids Output; Vertices of the faces
+     */
+    void triangulateBlock(const cv::Mat &valid, const cv::Mat &elevation, int r, int c, int size,
+                          std::vector<cv::Point2i> &vertex_ids) const;
+
+    /*!
+     * @brief Checks if a block can be replaced by a fan, because all vertices are valid and flat
+     */
+    bool isBlockFlat(const cv::Mat &valid, const cv::Mat &elevation, int r, int c, int size) const;
+};
+
+} // namespace realm
+
+#endif //PROJECT_GRID_TRIANGULATION_H
@@ -3,7 +3,9 @@
 #ifndef GENERAL_TESTBED_MAP_TILER_H
 #define GENERAL_TESTBED_MAP_TILER_H
 
+#include <array>
 #include <cmath>
+#include <cstdint>
 #include <map>
 
 #include <realm_ortho/rectification.h>
@@ -27,6 +29,9 @@ class MapTiler
 public:
   using Ptr = std::shared_ptr<MapTiler>;
 
+  /// Number of zoom levels in the lookup tables, zoom levels are 0 to kNrofZoomLevels - 1
+  static constexpr int kNrofZoomLevels = 35;
+
   struct TiledMap
   {
     cv::Rect2i roi;
@@ -49,17 +54,69 @@ public:
    * specific zoom levels are provided, only the maximum possible zoom level is tiled. This in turn is computed based on
    * the resolution of the input grid map. We perform an up-scaling to the next higher resolution, so we are not missing
    * out on information provided by the raw data, while accepting higher computational load for interpolated data.
-   * @param map Map in EPSG:3857 coordinates
+   * The maximum zoom level is resampled from the input map into one buffer per layer, which is padded to the tile
+   * boundaries. Its tiles are views into these buffers, so they are not copied. All lower zoom levels are downsampled
+   * from the tiles of the next higher one (see createParentTile). Tiles of a zoom level are created in parallel.
+   * @param map Map in EPSG:3857 coordinates, is not modified
    * @param zoom_level_min (optional) Minimum zoom level that should be tiled. If none provided, only maximum zoom level
    * is created.
    * @param zoom_level_max (optional) Maximum zoom level that should be tiled. If none provided, the maximum zoom level
    * will be automatically computed.
+   * @param thread_pool (optional) Shared thread pool the tiles are created on. If nullptr, OpenCV's parallel framework
+   * is used
+   * @param nrof_threads (optional) Number of threads, <= 0 uses all available cores
    * @return Tiled map for each requested zoom level. The tiled map consists of a region of interest spanning the
    * coordinates of the tiles (x, y, width, height) on the specific zoom level and the corresponding data as a vector.
    */
-  std::map<int, TiledMap> createTiles(const CvGridMap::Ptr &map, int zoom_level_min = -1, int zoom_level_max = -1);
+  std::map<int, TiledMap> createTiles(const CvGridMap::Ptr &map, int zoom_level_min = -1, int zoom_level_max = -1,
+                                      const ThreadPool::Ptr &thread_pool = nullptr, int nrof_threads = 0);
+
+  /*!
+   * @brief Resolution (meters/pixel) of a zoom level as used for tileing
+   * @param zoom_level Zoom level of the pyramid
+   * @return Resolution of the pixels
+   */
+  double getResolution(int zoom_level) const;
+
+  /*!
+   * @brief Creates a tile from its four children on the next higher zoom level by 2x2 downsampling, so lower zoom
+   * levels can be updated incrementally from the tiles that changed instead of tileing the whole map again. The
+   * children (2*tx + {0, 1}, 2*ty + {0, 1}) are identified by their indices, missing ones are left empty. Children must
+   * be locked by the caller.
+   * @param zoom_level Zoom level of the created tile
+   * @param tx Tile index in x-direction of the created tile
+   * @param ty Tile index in y-direction of the created tile
+   * @param children Existing children on zoom level + 1, at least one
+   * @param layer_names Layers of the children that should be downsampled
+   * @return Tile with the downsampled data of all children
+   */
+  Tile::Ptr createParentTile(int zoom_level, int tx, int ty, const std::vector<Tile::Ptr> &children,
+                             const std::vector<std::string> &layer_names);
+
+  /*!
+   * @brief Computes the boundaries of tile indices including the region of interest in a geographic frame
+   * @param roi Region of interest in geographic frame for which the tile ROI should be computed
+   * @param zoom_level Zoom level of the tile map
+   * @return Tile indices (x, y, width, height) covering the region of interest
+   */
+  cv::Rect2i computeTileBounds(const cv::Rect2d &roi, int zoom_level);
+
+  /*!
+   * @brief Computes the boundaries of tile indices including the region of interest on a range of zoom levels at once
+   * @param roi Region of interest in geographic frame for which the tile ROIs should be computed
+   * @param zoom_level_min Minimum zoom level of the tile map
+   * @param zoom_level_max Maximum zoom level of the tile map
+   * @return Tile indices (x, y, width, height) covering the region of interest, element i for zoom level min + i
+   */
+  std::vector<cv::Rect2i> computeTileBounds(const cv::Rect2d &roi, int zoom_level_min, int zoom_level_max);
 
-  double getResolution(int zoom_level);
+  /*!
+   * @brief Transforms a coordinate in WGS84 into the Web Mercator frame (EPSG:3857) the tiles are computed in
+   * @param lat Latitude in WGS84
+   * @param lon Longitude in WGS84
+   * @return Global coordinate in meters (mx, my)
+   */
+  cv::Point2d computeMetersFromLatLon(double lat, double lon) const;
 
 private:
 
@@ -75,14 +132,27 @@ private:
   /// Shift of the coordinate frame origin
   double m_origin_shift;
 
-  /// Size of the tiles in [pix], usually this is 256
-  int m_tile_size;
-
   /// Lookup table to map zoom levels to a specific resolution in [m/pix]
-  std::map<int, double> m_lookup_resolution_from_zoom;
+  std::array<double, kNrofZoomLevels> m_lookup_resolution_from_zoom;
+
+  /// Lookup table to map zoom levels to the inverse of the resolution in [pix/m], so no division is needed per lookup
+  std::array<double, kNrofZoomLevels> m_lookup_resolution_inv_from_zoom;
 
-  /// Lookup table to map zoom levels to an absolute number of tiles
-  std::map<int, long>   m_lookup_nrof_tiles_from_zoom;
+  /*!
+   * @brief Number of tiles in x- and y-direction on a zoom level
+   * @param zoom_level Zoom level of the tile map
+   * @return 2^zoom level
+   */
+  static constexpr int64_t computeNrofTiles(int zoom_level)
+  {
+    return int64_t(1) << zoom_level;
+  }
+
+  /*!
+   * @brief Checks that a zoom level is within the lookup tables
+   * @param zoom_level Zoom level of the tile map
+   */
+  static void checkZoomLevel(int zoom_level);
 
   /*!
    * @brief Computes the slippy tile index for a given zoom level that contains the requested coordinate in WGS84. The
@@ -142,13 +212,6 @@ private:
    */
   cv::Point2i computeTileFromMeters(double mx, double my, int zoom_level);
 
-  /*!
-   * @brief Computes the boundaries of tile indices including the region of interest in a geographic frame
-   * @param roi Region of interest in geographic frame for which the tile ROI should be computed
-   * @param zoom_level Zoom level of the tile map
-   * @return
-   */
-  cv::Rect2i computeTileBounds(const cv::Rect2d &roi, int zoom_level);
 
   /*!
    * @brief Each tile is indexed with (tx, ty). Together with the corresponding tile size this coordinate can be
@@ -207,6 +270,28 @@ private:
    * @param latitude (optional) Rough latitude of the area of operation [in degrees]
    */
   void computeLookupResolutionFromZoom(double latitude = 0.0);
+
+  /*!
+   * @brief Creates all parent tiles of a tiled map on the next lower zoom level in parallel
+   * @param children Tiled map on zoom level + 1 as created by createTiles
+   * @param zoom_level Zoom level of the parent tiles
+   * @param layer_names Layers of the children that should be downsampled
+   * @param thread_pool Shared thread pool, can be nullptr
+   * @param nrof_threads Number of threads, <= 0 uses all available cores
+   * @return Tiled map with all parents of the children
+   */
+  TiledMap createParentTiles(const TiledMap &children, int zoom_level, const std::vector<std::string> &layer_names,
+                             const ThreadPool::Ptr &thread_pool, int nrof_threads);
+
+  /*!
+   * @brief Resamples all layers of a map to a new resolution directly into buffers, that are padded to include a
+   * region of interest. Padding is NaN for floating point layers and zero for all others.
+   * @param map Map to be resampled, is not modified
+   * @param resolution Resolution of the result
+   * @param roi_padded Region of interest, that the result has to include, e.g. the boundaries of the tiles
+   * @return Map with resampled and padded layers
+   */
+  CvGridMap createPaddedMap(const CvGridMap &map, double resolution, const cv::Rect2d &roi_padded) const;
 };
 
 } // namespace realm
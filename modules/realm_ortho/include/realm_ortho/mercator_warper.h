@@ -0,0 +1,65 @@
+
+
+#ifndef PROJECT_MERCATOR_WARPER_H
+#define PROJECT_MERCATOR_WARPER_H
+
+#include <memory>
+
+#include <realm_core/cv_grid_map.h>
+
+namespace realm
+{
+namespace gis
+{
+
+/*!
+ * @brief MercatorWarper transforms an input CvGridMap from UTM coordinates into Web Mercator (EPSG:3857) with the
+ * closed-form projections of realm_core instead of GDAL. It is meant for small map updates, for which setting up the
+ * GDAL datasets and transformers costs more than the warp itself. The output geometry follows GdalWarper, so both
+ * can be used interchangeably: The resolution keeps the number of cells along the diagonal and cells are sampled at
+ * their centres. Like GDAL, the exact projection is only computed every few cells and interpolated linearly in between.
+ */
+class MercatorWarper
+{
+public:
+  using Ptr = std::shared_ptr<MercatorWarper>;
+
+public:
+  /*!
+   * @brief Constructor
+   * @param step Distance in cells between exactly projected cells, 1 projects every cell
+   */
+  explicit MercatorWarper(int step = 8);
+
+  /*!
+   * @brief Warps all layers of a map into Web Mercator. The interpolation is taken from the layer meta information,
+   * cells outside of the input are NaN for floating point layers and 0 otherwise. The resulting map is a deep copy.
+   * @param map Map to be warped, must be in UTM coordinates of the northern hemisphere
+   * @param zone UTM zone of the grid
+   * @return Warped map with all layers in Web Mercator
+   */
+  CvGridMap::Ptr warpRaster(const CvGridMap &map, uint8_t zone) const;
+
+private:
+
+  /// Distance in cells between exactly projected cells
+  int m_step;
+
+  /*!
+   * @brief Computes the source cell of every output cell for cv::remap
+   * @param map Map to be warped
+   * @param zone UTM zone of the grid
+   * @param roi_dst Bounds of the output in Web Mercator, upper left corner of the first cell and lower right of the last
+   * @param resolution_dst Resolution of the output
+   * @param size_dst Size of the output
+   * @param map_x Output; Source column of every output cell
+   * @param map_y Output; Source row of every output cell
+   */
+  void computeRemap(const CvGridMap &map, uint8_t zone, const cv::Rect2d &roi_dst, double resolution_dst,
+                    const cv::Size &size_dst, cv::Mat &map_x, cv::Mat &map_y) const;
+};
+
+} // namespace gis
+} // namespace realm
+
+#endif //PROJECT_MERCATOR_WARPER_H
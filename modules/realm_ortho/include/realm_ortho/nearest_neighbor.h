@@ -11,9 +11,13 @@
 
 // SYSTEM
 #include <memory>
+#include <utility>
+#include <vector>
 
 // NON-SYSTEM
 #include <eigen3/Eigen/Core>
+#include <opencv2/core.hpp>
+#include <realm_core/thread_pool.h>
 #include <realm_ortho/nanoflann.h>
 
 namespace realm {
@@ -77,6 +81,130 @@ struct PointCloudAdaptor {
     return false;
   }
 };  // end of PointCloudAdaptor
+
+// Adaptor for point clouds structured as OpenCV mat type with row(i) = (x, y, z, ...) of type CV_64F. Rows are read in
+// place, so the k-d tree is built without copying the points into another container.
+struct MatPointCloudAdaptor {
+  typedef double coord_t;
+  const cv::Mat points;  //!< Shallow copy of the point matrix
+  explicit MatPointCloudAdaptor(const cv::Mat &points_) : points(points_) {}
+  inline size_t kdtree_get_point_count() const {
+    return static_cast<size_t>(points.rows);
+  }
+  inline coord_t kdtree_distance(const coord_t *p1, const size_t idx_p2,
+                                 size_t size) const {
+    const coord_t *p2 = points.ptr<coord_t>(static_cast<int>(idx_p2));
+    coord_t dist = 0;
+    for (size_t i = 0; i < size; ++i)
+      dist += (p1[i] - p2[i]) * (p1[i] - p2[i]);
+    return dist;
+  }
+  inline coord_t kdtree_get_pt(const size_t idx, int dim) const {
+    return points.ptr<coord_t>(static_cast<int>(idx))[dim];
+  }
+  template <class BBOX>
+  bool kdtree_get_bbox(BBOX & /*bb*/) const {
+    return false;
+  }
+};  // end of MatPointCloudAdaptor
+
+/*!
+ * @brief Interface of the spatial indices for neighbour searches of a point cloud in x- and y-direction, e.g. for the
+ * elevation of the surface model. Implementations can be exchanged depending on the distribution of the points.
+ * Queries are thread safe, building is not.
+ */
+class NeighbourIndex2D
+{
+  public:
+    using Ptr = std::shared_ptr<NeighbourIndex2D>;
+    using ConstPtr = std::shared_ptr<const NeighbourIndex2D>;
+
+    enum class Type
+    {
+        GRID,     // Uniform grid of buckets, see PointGridIndex
+        KD_TREE   // nanoflann k-d tree, see KdTreeIndex2D
+    };
+
+  public:
+    virtual ~NeighbourIndex2D() = default;
+
+    /*!
+     * @brief Factory for the indices
+     * @param type Type of the index
+     * @return Empty index, must be built before use
+     */
+    static Ptr create(Type type);
+
+    /*!
+     * @brief Builds the index for a point cloud, replaces the previous one. Indices of the results are the rows of it.
+     * @param points Point cloud as CV_64F mat structured rowise: x, y, ...
+     * @param thread_pool Shared thread pool of the pipeline. If nullptr, OpenCV's parallel framework is used
+     * @param nrof_threads Number of threads, <= 0 uses all available, 1 builds serially
+     */
+    virtual void build(const cv::Mat &points, const ThreadPool::Ptr &thread_pool, int nrof_threads) = 0;
+
+    /*!
+     * @brief Finds all points with a squared xy-distance below the given one, same as a nanoflann::RadiusResultSet
+     * @param x Coordinate of the query point
+     * @param y Coordinate of the query point
+     * @param radius_sq Squared search radius
+     * @param indices_dists Output; Row and squared distance of the points found, unsorted
+     */
+    virtual void radiusSearch(double x, double y, double radius_sq,
+                              std::vector<std::pair<int, double>> &indices_dists) const = 0;
+
+    /*!
+     * @brief Finds the k nearest points in xy-direction
+     * @param x Coordinate of the query point
+     * @param y Coordinate of the query point
+     * @param k Number of neighbours
+     * @param indices Output; Rows of the neighbours sorted by distance, must hold k elements
+     * @param dists_sq Output; Squared distances of the neighbours, must hold k elements
+     * @return Number of neighbours found, less than k only if the index holds less points
+     */
+    virtual size_t knnSearch(double x, double y, size_t k, size_t* indices, double* dists_sq) const = 0;
+
+    /*!
+     * @brief Checks if any point is within a distance in xy-direction
+     * @param x Coordinate of the query point
+     * @param y Coordinate of the query point
+     * @param radius Search radius
+     * @return True if a point with distance <= radius exists
+     */
+    virtual bool hasNeighbour(double x, double y, double radius) const = 0;
+
+    /*!
+     * @brief Getter for the number of points in the index
+     * @return Number of indexed points
+     */
+    virtual size_t size() const = 0;
+};
+
+/*!
+ * @brief Binary k-d tree of nanoflann over the rows of a point cloud, reads the points in place. Building is serial.
+ */
+class KdTreeIndex2D : public NeighbourIndex2D
+{
+  public:
+    static constexpr size_t kMaxLeaf = 10u;
+    static constexpr size_t kDimension = 2u;
+    using KdTree_t = nanoflann::KDTreeSingleIndexAdaptor<nanoflann::L2_Adaptor<double, MatPointCloudAdaptor>, MatPointCloudAdaptor, kDimension>;
+
+  public:
+    void build(const cv::Mat &points, const ThreadPool::Ptr &thread_pool, int nrof_threads) override;
+    void radiusSearch(double x, double y, double radius_sq,
+                      std::vector<std::pair<int, double>> &indices_dists) const override;
+    size_t knnSearch(double x, double y, size_t k, size_t* indices, double* dists_sq) const override;
+    bool hasNeighbour(double x, double y, double radius) const override;
+    size_t size() const override;
+
+  private:
+
+    //! Adapter of the point cloud, holds a shallow copy of it
+    std::unique_ptr<MatPointCloudAdaptor> m_adaptor;
+
+    std::unique_ptr<KdTree_t> m_kd_tree;
+};
 }
 }
 #endif  // NEAREST_NEIGHBOR_H_
@@ -0,0 +1,128 @@
+
+
+#ifndef PROJECT_POINT_GRID_INDEX_H
+#define PROJECT_POINT_GRID_INDEX_H
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include <realm_core/thread_pool.h>
+#include <realm_ortho/nearest_neighbor.h>
+
+namespace realm
+{
+namespace ortho
+{
+
+/*!
+ * @brief Spatial index of a point cloud in x- and y-direction for the neighbour searches of the surface model. Points
+ * are sorted into the cells of a uniform grid, so building the index is a single parallel pass plus a counting sort
+ * instead of a recursive tree construction. Cell size is derived from the point density, so a query only touches the
+ * few cells around it. Cells are stored row-major, neighbouring queries of a raster scan therefore read neighbouring
+ * memory. Points outside the central extent of the cloud are put into the border cells, so far outliers neither
+ * inflate the grid nor get lost. All buffers are kept between builds, an index reused for the following frames
+ * therefore does not allocate once it has reached the size of the largest cloud.
+ */
+class PointGridIndex : public NeighbourIndex2D
+{
+  public:
+    using Ptr = std::shared_ptr<PointGridIndex>;
+    using ConstPtr = std::shared_ptr<const PointGridIndex>;
+
+  public:
+    PointGridIndex();
+
+    /*!
+     * @brief Builds the index for a point cloud, points with non-finite coordinates are left out. The cloud is not
+     * referenced afterwards.
+     */
+    void build(const cv::Mat &points, const ThreadPool::Ptr &thread_pool = nullptr, int nrof_threads = 0) override;
+
+    /*!
+     * @brief Results are in the order of the grid cells, within a cell in the order of the rows
+     */
+    void radiusSearch(double x, double y, double radius_sq,
+                      std::vector<std::pair<int, double>> &indices_dists) const override;
+
+    size_t knnSearch(double x, double y, size_t k, size_t* indices, double* dists_sq) const override;
+
+    /*!
+     * @brief Unlike a nearest neighbour search the cost is bounded by the radius, even if the query is far away from all
+     * points
+     */
+    bool hasNeighbour(double x, double y, double radius) const override;
+
+    size_t size() const override;
+
+    /*!
+     * @brief Getter for the edge length of the grid cells, derived from the point density during build
+     * @return Cell size in units of the point cloud
+     */
+    double getCellSize() const;
+
+  private:
+
+    struct Entry
+    {
+      double x;
+      double y;
+      int idx;
+    };
+
+    //! Origin and edge length of the grid cells
+    double m_x0;
+    double m_y0;
+    double m_cell_size;
+
+    //! Number of grid cells in x- and y-direction
+    int64_t m_width;
+    int64_t m_height;
+
+    //! Entries sorted row-major by cell, cell i owns [m_cell_begin[i], m_cell_begin[i+1])
+    std::vector<Entry> m_entries;
+    std::vector<uint32_t> m_cell_begin;
+
+    //! Cell of every row of the last cloud, UINT32_MAX for rows left out. Only used during build
+    std::vector<uint32_t> m_cell_of_row;
+
+    /*!
+     * @brief Estimates origin, cell size and dimension of the grid from the extent of the central 96% of a sample of
+     * the points
+     * @param points Point cloud as CV_64F mat
+     * @param nrof_valid Number of finite points
+     */
+    void computeGeometry(const cv::Mat &points, size_t nrof_valid);
+
+    //! Cell coordinates, clamped to the grid
+    int64_t toCellX(double x) const;
+    int64_t toCellY(double y) const;
+
+    /*!
+     * @brief Calls 'func' for every entry in the cells [ix0, ix1] x [iy0, iy1] until it returns false. Range must be
+     * within the grid.
+     * @return False if the iteration was stopped by 'func'
+     */
+    template <typename Func>
+    bool forEachInCells(int64_t ix0, int64_t ix1, int64_t iy0, int64_t iy1, Func func) const
+    {
+      for (int64_t iy = iy0; iy <= iy1; ++iy)
+      {
+        // Cells of a grid row are contiguous, so the entries of the whole range of the row are as well
+        int64_t row = iy * m_width;
+        for (uint32_t i = m_cell_begin[row + ix0]; i < m_cell_begin[row + ix1 + 1]; ++i)
+          if (!func(m_entries[i]))
+            return false;
+      }
+      return true;
+    }
+};
+
+} // namespace ortho
+} // namespace realm
+
+#endif //PROJECT_POINT_GRID_INDEX_H
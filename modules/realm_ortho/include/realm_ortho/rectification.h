@@ -10,6 +10,8 @@
 #include <realm_core/structs.h>
 #include <realm_core/frame.h>
 #include <realm_core/cv_grid_map.h>
+#include <realm_core/thread_pool.h>
+#include <realm_core/mat_pool.h>
 
 namespace realm
 {
@@ -17,11 +19,19 @@ namespace ortho
 {
 
 /*!
- * @brief Simplified interface function for rectification
+ * @brief Simplified interface function for rectification. Frames with planar surface assumption are rectified by the
+ * homography of the plane, all others by the backprojection from grid.
  * @param frame container for aerial measurement data
+ * @param nrof_threads Number of threads used for the backprojection, <= 0 uses all available cores
+ * @param interpolation OpenCV interpolation flag for sampling the image, e.g. cv::INTER_NEAREST, cv::INTER_LINEAR
+ * @param thread_pool Shared thread pool of the pipeline. If nullptr, OpenCV's parallel framework is used
+ * @param mat_pool Pool the temporaries and layers of the result are allocated from. If nullptr, OpenCV allocates them
+ * @param use_cuda Flag to compute the backprojection from grid on the GPU. Falls back to the CPU, if no CUDA device is
+ *        available or the interpolation is not supported on the GPU. Planar surfaces are always rectified on the CPU.
  * @return Rectified input data
  */
-CvGridMap::Ptr rectify(const Frame::Ptr &frame);
+CvGridMap::Ptr rectify(const Frame::Ptr &frame, int nrof_threads = 0, int interpolation = cv::INTER_NEAREST,
+                       const ThreadPool::Ptr &thread_pool = nullptr, MatPool* mat_pool = nullptr, bool use_cuda = false);
 
 /*!
  * @brief Rectification is achieved using the workflow presented in: http://www.timohinzmann.com/publications/fsr_2017_hinzmann.pdf.
@@ -34,6 +44,16 @@ CvGridMap::Ptr rectify(const Frame::Ptr &frame);
  * @param roi Region of interest in geographic coordinates with (x, y) = lower left corner
  * @param GSD Ground sampling distance, therefore the resolution of the surface cells
  * @param is_elevated Flag to set whether the surface is planar or has elevation
+ * @param verbose Flag to log processing information
+ * @param nrof_threads Number of threads used for the backprojection. The surface is split into row bands, which are
+ *        processed concurrently. <= 0 uses all available cores, 1 processes the grid serially
+ * @param use_simd Flag to use the vectorized kernel. It computes in single precision in a local frame and uses an
+ *        approximated elevation angle (error < 0.05°). Vectorized for the CPU features at runtime, see cpu_dispatch.h
+ * @param interpolation OpenCV interpolation flag for sampling the image. Nearest neighbour samples every cell directly,
+ *        all other flags (e.g. cv::INTER_LINEAR, cv::INTER_CUBIC) sample the whole grid with cv::remap
+ * @param thread_pool Shared thread pool of the pipeline. If nullptr, OpenCV's parallel framework is used
+ * @param mat_pool Pool the temporaries and layers of the result are allocated from, so their buffers are reused across
+ *        frames. If nullptr, OpenCV allocates them
  */
 CvGridMap::Ptr backprojectFromGrid(
     const cv::Mat &img,
@@ -42,12 +62,61 @@ CvGridMap::Ptr backprojectFromGrid(
     const cv::Rect2d &roi,
     double GSD,
     bool is_elevated,
-    bool verbose = true);
+    bool verbose = true,
+    int nrof_threads = 0,
+    bool use_simd = true,
+    int interpolation = cv::INTER_NEAREST,
+    const ThreadPool::Ptr &thread_pool = nullptr,
+    MatPool* mat_pool = nullptr);
+
+/*!
+ * @brief Rectification of a planar surface. The mapping of a plane into the camera image is a homography, so instead of
+ * projecting every cell individually the image is warped onto the grid of the roi at once. The surface is only read
+ * for NaN cells and written afterwards to invalidate cells outside the camera footprint, its elevation is expected to
+ * be constant. Result has the same layers as the backprojection from grid.
+ * @param img Image data that is corrected from lens distortion
+ * @param cam Underlying camera model, currently only pinhole camera is supported
+ * @param surface Surface structure as matrix with the constant elevation of the plane in each cell
+ * @param roi Region of interest in geographic coordinates with (x, y) = lower left corner
+ * @param GSD Ground sampling distance, therefore the resolution of the surface cells
+ * @param elevation Elevation of the plane
+ * @param verbose Flag to log processing information
+ * @param nrof_threads Number of threads used for the computation of the elevation angles, <= 0 uses all available cores
+ * @param interpolation OpenCV interpolation flag for sampling the image, e.g. cv::INTER_NEAREST, cv::INTER_LINEAR
+ * @param thread_pool Shared thread pool of the pipeline. If nullptr, OpenCV's parallel framework is used
+ * @param mat_pool Pool the temporaries and layers of the result are allocated from. If nullptr, OpenCV allocates them
+ */
+CvGridMap::Ptr rectifyPlanar(
+    const cv::Mat &img,
+    const camera::Pinhole &cam,
+    cv::Mat &surface,
+    const cv::Rect2d &roi,
+    double GSD,
+    double elevation,
+    bool verbose = true,
+    int nrof_threads = 0,
+    int interpolation = cv::INTER_NEAREST,
+    const ThreadPool::Ptr &thread_pool = nullptr,
+    MatPool* mat_pool = nullptr);
 
 namespace internal
 {
 
-inline double computeElevationAngle(double t[3], double p[3]);
+/*!
+ * @brief Computes the angle between the ground plane and the line of sight from a surface point to the camera
+ * @param t Position of the camera
+ * @param p Position of the surface point
+ * @return Elevation angle in [deg]
+ */
+double computeElevationAngle(double t[3], double p[3]);
+
+/*!
+ * @brief Fast approximation of the elevation angle, as used by the vectorized backprojection
+ * @param dz Absolute vertical distance between camera and surface point
+ * @param dh Horizontal distance between camera and surface point
+ * @return Elevation angle in [deg]
+ */
+float computeElevationAngleFast(float dz, float dh);
 
 } // namespace internal
 } // namespace ortho
@@ -5,10 +5,16 @@
 
 #include <mutex>
 #include <memory>
+#include <shared_mutex>
 #include <opencv2/core.hpp>
 
 #include <realm_core/cv_grid_map.h>
 
+// Edge length of the tiles in [pix], set by the build for all users of the library
+#ifndef REALM_TILE_SIZE
+#define REALM_TILE_SIZE 256
+#endif
+
 namespace realm
 {
 
@@ -21,6 +27,11 @@ class Tile
 public:
   using Ptr = std::shared_ptr<Tile>;
 
+  /// Edge length of the tiles in [pix]. Known at compile time, so loops over the tile data have constant bounds
+  static constexpr int kSize = REALM_TILE_SIZE;
+
+  static_assert(kSize >= 16 && (kSize & (kSize - 1)) == 0, "Tile size must be a power of two");
+
 public:
   /*!
    * @brief Non-default constructor
@@ -32,15 +43,26 @@ public:
   Tile(int zoom_level, int tx, int ty, const CvGridMap &map);
 
   /*!
-   * @brief Locks the tile when being accessed or modified to prevent multi-threading problems.
+   * @brief Locks the tile exclusively when being modified to prevent multi-threading problems.
    */
   void lock();
 
   /*!
-   * @brief Releases the lock on the tile for other processes to access or write it.
+   * @brief Releases the exclusive lock on the tile for other processes to access or write it.
    */
   void unlock();
 
+  /*!
+   * @brief Locks the tile for read-only access. Any number of threads can hold the shared lock at the same time, but
+   * none while the tile is locked exclusively.
+   */
+  void lockShared();
+
+  /*!
+   * @brief Releases the shared lock on the tile.
+   */
+  void unlockShared();
+
   /*!
    * @brief Getter for the zoom level
    * @return Zoom level of the data
@@ -78,8 +100,8 @@ private:
   /// Multi-layered grid map container
   CvGridMap::Ptr m_data;
 
-  /// Main mutex to prevent simultaneous access from different threads
-  std::mutex m_mutex_data;
+  /// Main mutex to prevent simultaneous modification from different threads, readers share it
+  std::shared_timed_mutex m_mutex_data;
 };
 
 } // namespace realm
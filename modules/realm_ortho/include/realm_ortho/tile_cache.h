@@ -3,13 +3,17 @@
 #ifndef GENERAL_TESTBED_TILE_CACHE_H
 #define GENERAL_TESTBED_TILE_CACHE_H
 
+#include <atomic>
+#include <deque>
 #include <map>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include <opencv2/highgui.hpp>
 
 #include <realm_core/loguru.h>
+#include <realm_core/thread_pool.h>
 #include <realm_core/worker_thread_base.h>
 #include <realm_io/utilities.h>
 #include <realm_ortho/tile.h>
@@ -17,6 +21,11 @@
 namespace realm
 {
 
+namespace io
+{
+class MbtilesStore;
+}
+
 class TileCache : public WorkerThreadBase
 {
 public:
@@ -36,6 +45,11 @@ public:
     std::vector<LayerMetaData> layer_meta;
     Tile::Ptr tile;
     bool was_written;
+    bool is_outdated{false};
+    bool was_spilled{false};
+
+    // Version of the tile, incremented every time newer data is added for it
+    uint64_t version{1};
 
     mutable std::mutex mutex;
   };
@@ -43,24 +57,136 @@ public:
   using CacheElementGrid = std::map<int, std::map<int, CacheElement::Ptr>>;
 
 public:
-  TileCache(const std::string &id, double sleep_time, const std::string &output_directory, bool verbose);
+  /*!
+   * @brief Constructor
+   * @param id Name of the cache, used for the worker thread
+   * @param sleep_time Sleep time of the worker thread in [ms]
+   * @param output_directory Directory the tiles are written to
+   * @param verbose Flag for verbose logging
+   * @param nrof_writer_threads Number of threads encoding and writing tiles to disk concurrently, <= 0 uses all
+   * available cores
+   */
+  TileCache(const std::string &id, double sleep_time, const std::string &output_directory, bool verbose,
+            int nrof_writer_threads = 2);
   ~TileCache();
 
   void add(int zoom_level, const std::vector<Tile::Ptr> &tiles, const cv::Rect2i &roi_idx);
 
+  /*!
+   * @brief Getter for a cached tile, which is loaded if it was flushed before. The tile is returned locked exclusively,
+   * the caller has to unlock it.
+   * @return Tile or nullptr, if it does not exist
+   */
   Tile::Ptr get(int tx, int ty, int zoom_level);
 
+  /*!
+   * @brief Getter for a cached tile for read-only access, which is loaded if it was flushed before. The tile is
+   * returned with a shared lock, the caller has to release it with unlockShared(). Other readers, e.g. the writer
+   * threads of the cache, are not blocked by it.
+   * @return Tile or nullptr, if it does not exist
+   */
+  Tile::Ptr getShared(int tx, int ty, int zoom_level);
+
+  /*!
+   * @brief Reads the encoded data of a single layer of a tile, e.g. to serve it to clients. Tiles in memory are encoded
+   * directly, so updates are available before they were written to disk. Flushed tiles are read from disk. 8 bit layers
+   * are encoded as png, all others in the binary format of io::saveImageToBinary, the same as on disk.
+   * @param zoom_level Zoom level of the tile
+   * @param tx Tile index in x-direction
+   * @param ty Tile index in y-direction
+   * @param layer_name Name of the layer
+   * @param data Encoded data of the layer
+   * @param version Version of the tile, which is incremented every time the tile is updated
+   * @return True if the tile and layer exist
+   */
+  bool readEncoded(int zoom_level, int tx, int ty, const std::string &layer_name, std::vector<uint8_t> &data,
+                   uint64_t &version);
+
   void setOutputFolder(const std::string &dir);
 
+  /*!
+   * @brief Writes all tiles to disk and releases their data. Afterwards the index of the cache is written as
+   * "tile_index.bin" into the output directory, so the tile set can be reopened with loadIndex().
+   */
   void flushAll();
+
+  /*!
+   * @brief Loads all flushed tiles from disk concurrently on the writer threads, e.g. to warm up a cache restored with
+   * loadIndex(). Blocks until all tiles are loaded.
+   */
   void loadAll();
 
+  /*!
+   * @brief Writes an index of all tiles that were written to disk, e.g. as part of a checkpoint. Together with the
+   * published tiles it is sufficient to restore the cache with loadIndex(), tile data is not part of the index. Tiles
+   * not yet written are missing in the index.
+   * @param filepath Absolute path of the index file
+   */
+  void saveIndex(const std::string &filepath);
+
+  /*!
+   * @brief Restores the cache from an index written by saveIndex(). All tiles are restored as flushed, so they are
+   * loaded from the output directory on demand. The output directory of the index is taken over, tiles added before
+   * are dropped. Must be called before the first tiles are added.
+   * @param filepath Absolute path of the index file
+   * @return Number of tiles restored
+   * @throws std::runtime_error if the index can not be read or was written for a different storage
+   */
+  size_t loadIndex(const std::string &filepath);
+
+  /*!
+   * @brief Computes the memory of all tiles currently held in the cache, flushed tiles are not counted
+   * @return Size of the cached tile data in bytes
+   */
+  size_t getByteSize();
+
+  /*!
+   * @brief Enables flushing all tiles to disk after they were written instead of only those outside the predicted
+   * region of interest, e.g. when the pipeline exceeds its memory budget. Tiles are loaded again on demand.
+   * @param is_enabled True to flush all tiles, false to keep the predicted region in memory
+   */
+  void setAggressiveFlush(bool is_enabled);
+
+  /*!
+   * @brief Sets the maximum memory of the tiles held in the cache. Tiles are first flushed if they are outside the
+   * predicted region of interest. If the remaining ones still exceed the capacity, the least recently used are flushed
+   * as well. Estimates are based on the tile data, the bookkeeping of the cache is not included.
+   * @param bytes Capacity in bytes, 0 for unlimited
+   */
+  void setByteCapacity(size_t bytes);
+
+  /*!
+   * @brief Loads the tiles of a region that is expected to be requested soon asynchronously from disk, e.g. the
+   * future footprints predicted from the trajectory. Tiles inside the region are also kept in memory on the next update.
+   * Tiles that were never added to the cache are ignored.
+   * @param zoom_level Zoom level of the tiles
+   * @param roi_idx Region of tile indices (x, y, width, height) to prefetch
+   */
+  void prefetch(int zoom_level, const cv::Rect2i &roi_idx);
+
+  /*!
+   * @brief Enables writing the tiles into one MBTiles file per layer instead of one file per tile in a directory tree,
+   * e.g. "color_rgb.mbtiles" in the output directory. Must be set before the first tiles are added.
+   * @param is_enabled True to write MBTiles, false for the directory tree
+   * @throws std::runtime_error if OpenREALM was built without SQLite support
+   */
+  void setMbtilesStorage(bool is_enabled);
+
+  /*!
+   * @brief Enables keeping a copy of flushed tiles in an uncompressed, cache-internal format. Reloading them avoids
+   * decoding the published png or binary tiles, which dominates the cost of flushing and reloading tiles in memory
+   * constrained runs. The published output is not affected. Spilled copies are removed on destruction.
+   * @param dir Directory for the spilled tiles, is created if it does not exist. Empty to disable spilling.
+   */
+  void setSpillDirectory(const std::string &dir);
+
 private:
 
   bool m_has_init_directories;
 
   std::mutex m_mutex_settings;
   std::string m_dir_toplevel;
+  std::string m_dir_spill;
 
   std::mutex m_mutex_cache;
   std::map<int, CacheElementGrid> m_cache;
@@ -68,6 +194,30 @@ private:
   std::mutex m_mutex_do_update;
   bool m_do_update;
 
+  std::atomic<bool> m_is_flush_aggressive;
+  std::atomic<size_t> m_byte_capacity;
+
+  bool m_use_mbtiles;
+
+  // Directories of the tile tree known to exist, so adding tiles does not query the file system for every column.
+  // Only accessed while holding the cache lock.
+  std::unordered_set<std::string> m_dirs_created;
+
+  // Tile stores of all layers when writing MBTiles, created on first access
+  mutable std::mutex m_mutex_stores;
+  mutable std::map<std::string, std::shared_ptr<io::MbtilesStore>> m_stores;
+
+  // Elements added since the last update, which still have to be written to disk
+  std::mutex m_mutex_dirty_elements;
+  std::deque<CacheElement::Ptr> m_dirty_elements;
+
+  // Elements with tile data in memory, which are candidates for flushing
+  std::mutex m_mutex_resident_elements;
+  std::unordered_set<CacheElement::Ptr> m_resident_elements;
+
+  // Threads encoding and writing the dirty elements and prefetching tiles from disk
+  ThreadPool m_pool_writer;
+
   std::mutex m_mutex_roi_prev_request;
   std::map<int, cv::Rect2i> m_roi_prev_request;
 
@@ -83,14 +233,80 @@ private:
 
   void flush(const CacheElement::Ptr &element) const;
 
+  /*!
+   * @brief Writes the layers of an element uncompressed into the spill directory, if not already done
+   * @param element Element with tile data in memory
+   */
+  void spill(const CacheElement::Ptr &element) const;
+
+  /*!
+   * @brief Creates the path of the spilled copy of a single layer of an element
+   * @param element Element of the tile
+   * @param meta Meta data of the layer
+   * @return Absolute path of the spill file
+   */
+  std::string createSpillFilename(const CacheElement::Ptr &element, const LayerMetaData &meta) const;
+
+  /*!
+   * @brief Creates the path of a single layer of a tile inside the directory tree of the cache
+   * @param zoom_level Zoom level of the tile
+   * @param tx Tile index in x-direction
+   * @param ty Tile index in y-direction
+   * @param meta Meta data of the layer, the type determines the file extension
+   * @return Absolute path of the tile file
+   */
+  std::string createTileFilename(int zoom_level, int tx, int ty, const LayerMetaData &meta) const;
+
+  /*!
+   * @brief Getter for the MBTiles store of a layer, which is opened or created on first access
+   * @param meta Meta data of the layer
+   * @return Store of the layer
+   */
+  std::shared_ptr<io::MbtilesStore> getStore(const LayerMetaData &meta) const;
+
+  /*!
+   * @brief Commits the pending writes of all MBTiles stores to disk
+   */
+  void commitStores();
+
+  /*!
+   * @brief Writes all dirty elements concurrently on the writer threads and blocks until they are finished. Elements
+   * added while writing are kept for the next call.
+   * @return Number of tiles written
+   */
+  int writeDirtyElements();
+
   bool isCached(const CacheElement::Ptr &element) const;
 
+  /*!
+   * @brief Looks up the element of a tile and loads its data, if it was flushed before. Access time of the element is
+   * updated. The tile of the element is returned locked, either shared or exclusively.
+   * @param is_shared Flag to lock the tile shared instead of exclusively
+   * @return Element or nullptr, if it does not exist
+   */
+  CacheElement::Ptr findAndLoad(int tx, int ty, int zoom_level, bool is_shared);
+
   size_t estimateByteSize(const Tile::Ptr &tile) const;
 
   void updatePrediction(int zoom_level, const cv::Rect2i &roi_current);
 
+  /*!
+   * @brief Creates the directory of a tile tree for all layers, directories created before are skipped without
+   * accessing the file system
+   * @param toplevel Top level directory of the cache with trailing slash
+   * @param layer_names Names of the layers, every layer has its own tree
+   * @param tile_tree Path inside the tree of a layer, e.g. "/18/140123"
+   */
   void createDirectories(const std::string &toplevel, const std::vector<std::string> &layer_names, const std::string &tile_tree);
 
+  /*!
+   * @brief Creates the directories of all tile columns of the predicted region of interest, so tiles of the next
+   * updates are written into existing directories
+   * @param zoom_level Zoom level of the prediction
+   * @param layer_names Names of the layers
+   */
+  void createPredictedDirectories(int zoom_level, const std::vector<std::string> &layer_names);
+
 };
 
 }
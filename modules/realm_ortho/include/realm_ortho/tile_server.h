@@ -0,0 +1,124 @@
+
+
+#ifndef PROJECT_TILE_SERVER_H
+#define PROJECT_TILE_SERVER_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <realm_core/thread_pool.h>
+#include <realm_ortho/tile_cache.h>
+
+namespace realm
+{
+
+/*!
+ * @brief Lightweight HTTP server for XYZ tiles, which reads them directly from the memory of a tile cache. Updated
+ * tiles are therefore available to clients as soon as they were added to the cache, without waiting for them to be
+ * written to disk. Flushed tiles are read from disk. Tiles are requested with the same path as in the directory tree
+ * of the cache, e.g. "curl http://127.0.0.1:8080/color_rgb/18/140123/91234.png". Every response carries the version of
+ * the tile as entity tag, so clients revalidating with "If-None-Match" get an empty "304 Not Modified" until the tile
+ * changes.
+ */
+class TileServer
+{
+  public:
+    using Ptr = std::shared_ptr<TileServer>;
+    using ConstPtr = std::shared_ptr<const TileServer>;
+
+    /*!
+     * @brief Parsed path of a tile request
+     */
+    struct Request
+    {
+      std::string layer_name;
+      int zoom_level;
+      int tx;
+      int ty;
+    };
+
+  public:
+    /*!
+     * @brief Constructor, the server is not listening before start() was called
+     * @param tile_cache Cache the tiles are served from
+     * @param port Port to listen on for requests
+     * @param address IPv4 address to bind to. Defaults to localhost, use "0.0.0.0" to serve the tiles to a remote
+     * ground station
+     * @param nrof_threads Number of threads answering requests concurrently, <= 0 uses all available cores
+     */
+    TileServer(const TileCache::Ptr &tile_cache, int port, const std::string &address = "127.0.0.1", int nrof_threads = 2);
+
+    /*!
+     * @brief Destructor stops the server if still running
+     */
+    ~TileServer();
+
+    TileServer(const TileServer &other) = delete;
+    TileServer& operator=(const TileServer &other) = delete;
+
+    /*!
+     * @brief Binds the socket and starts answering requests in a separate thread
+     * @throws std::runtime_error if the socket could not be bound, e.g. because the port is already in use
+     */
+    void start();
+
+    /*!
+     * @brief Stops accepting requests and closes the socket. Accepted requests are still answered by the pool.
+     */
+    void stop();
+
+    /*!
+     * @brief Parses the path of a tile request of the form "/<layer>/<zoom>/<x>/<y>.<extension>"
+     * @param path Path of the HTTP request, query parameters are ignored
+     * @param request Parsed request
+     * @return True if the path is a valid tile request
+     */
+    static bool parsePath(const std::string &path, Request &request);
+
+    /*!
+     * @brief Creates the HTTP response for a request
+     * @param request_header Header of the HTTP request
+     * @return Complete HTTP response with header and body
+     */
+    std::string createResponse(const std::string &request_header);
+
+  private:
+
+    //! Cache the tiles are served from
+    TileCache::Ptr m_tile_cache;
+
+    //! Port to listen on
+    int m_port;
+
+    //! IPv4 address to bind to
+    std::string m_address;
+
+    //! File descriptor of the listening socket, -1 if not bound
+    int m_socket;
+
+    //! Flag to stop the serving thread
+    std::atomic<bool> m_is_running;
+
+    //! Thread accepting the connections
+    std::thread m_thread;
+
+    //! Threads answering the requests, so clients loading many tiles at once are served concurrently
+    ThreadPool m_pool;
+
+    /*!
+     * @brief Loop of the serving thread, accepts connections until the server is stopped
+     */
+    void serve();
+
+    /*!
+     * @brief Reads the request of an accepted connection and answers it
+     * @param connection File descriptor of the accepted connection
+     */
+    void respond(int connection);
+};
+
+} // namespace realm
+
+#endif //PROJECT_TILE_SERVER_H
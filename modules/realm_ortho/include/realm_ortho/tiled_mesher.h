@@ -0,0 +1,104 @@
+
+
+#ifndef PROJECT_TILED_MESHER_H
+#define PROJECT_TILED_MESHER_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <realm_core/structs.h>
+#include <realm_core/cv_grid_map.h>
+
+namespace realm
+{
+
+/*!
+ * @brief Incremental mesher for growing elevation maps. The world is partitioned into square tiles, which are
+ * triangulated independently on a regular grid of vertices. Vertices are sampled at fixed world positions, so
+ * neighbouring tiles share their border vertices and the mesh has no cracks, no matter in which order tiles are
+ * updated. An update only re-triangulates the tiles touching the updated region and returns the tiles, that actually
+ * changed, so the cost of an update is proportional to its region instead of the whole map.
+ */
+class TiledMesher
+{
+  public:
+    using Ptr = std::shared_ptr<TiledMesher>;
+    using ConstPtr = std::shared_ptr<const TiledMesher>;
+
+  public:
+    /*!
+     * @brief Constructor of an empty mesh
+     * @param tile_size Edge length of the tiles in [m]
+     * @param resolution Distance between the vertices in [m]. If <= 0, the resolution of the first map is used
+     */
+    TiledMesher(double tile_size, double resolution = 0.0);
+
+    /*!
+     * @brief Re-triangulates all tiles touching the updated region of the map
+     * @param map Map with elevation and color, typically the global map
+     * @param layer_elevation Name of the elevation layer, invalid cells are NaN
+     * @param layer_color Name of the color layer of type CV_8UC4, can be empty
+     * @param roi_update Region of the map that changed since the last update
+     * @return Tiles with changed faces
+     */
+    std::vector<MeshTile> update(const CvGridMap &map,
+                                 const std::string &layer_elevation,
+                                 const std::string &layer_color,
+                                 const cv::Rect2d &roi_update);
+
+    /*!
+     * @brief Getter for the faces of all tiles
+     * @return Complete mesh
+     */
+    std::vector<Face> getFaces() const;
+
+    /*!
+     * @brief Getter for the number of tiles with faces
+     * @return Number of tiles
+     */
+    size_t getNrofTiles() const;
+
+    /*!
+     * @brief Removes all tiles, e.g. after a reset of the map
+     */
+    void clear();
+
+  private:
+
+    //! Cached tile with a hash of its sampled vertices to detect, if the data has actually changed
+    struct CachedTile
+    {
+      uint64_t hash;
+      MeshTile tile;
+    };
+
+    double m_tile_size;
+    double m_resolution;
+
+    //! Number of quads along the edge of a tile
+    int m_nrof_quads;
+
+    //! Tiles sorted by their index (x, y)
+    std::map<std::pair<int, int>, CachedTile> m_tiles;
+
+    /*!
+     * @brief Samples the vertices of a tile and triangulates all quads with at least three valid vertices
+     * @param map Map with elevation and color
+     * @param elevation Elevation layer of type CV_32F
+     * @param color Color layer of type CV_8UC4, can be empty
+     * @param tx Column index of the tile
+     * @param ty Row index of the tile
+     * @param hash Output; Hash of the sampled vertices
+     * @return Tile with faces
+     */
+    MeshTile triangulateTile(const CvGridMap &map, const cv::Mat &elevation, const cv::Mat &color, int tx, int ty,
+                             uint64_t &hash) const;
+};
+
+} // namespace realm
+
+#endif //PROJECT_TILED_MESHER_H
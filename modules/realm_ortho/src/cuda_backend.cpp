@@ -0,0 +1,319 @@
+
+
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include <realm_core/loguru.h>
+#include <realm_ortho/cuda_backend.h>
+
+#ifdef REALM_ORTHO_WITH_CUDA
+#include "cuda_kernels.h"
+#endif
+
+using namespace realm;
+
+bool ortho::cuda::isInterpolationSupported(int interpolation)
+{
+  return interpolation == cv::INTER_NEAREST || interpolation == cv::INTER_LINEAR;
+}
+
+#ifdef REALM_ORTHO_WITH_CUDA
+
+namespace
+{
+
+void checkCuda(cudaError_t error, const std::string &what)
+{
+  if (error != cudaSuccess)
+    throw(std::runtime_error("Error " + what + ": " + std::string(cudaGetErrorString(error))));
+}
+
+/*!
+ * @brief Buffer in device memory, that only grows. Reallocation drops the content.
+ */
+class DeviceBuffer
+{
+  public:
+    DeviceBuffer() : m_data(nullptr), m_capacity(0) {}
+
+    ~DeviceBuffer()
+    {
+      // Errors are ignored, the context might already be destroyed when threads are torn down at exit
+      if (m_data != nullptr)
+        cudaFree(m_data);
+    }
+
+    DeviceBuffer(const DeviceBuffer &) = delete;
+    DeviceBuffer& operator=(const DeviceBuffer &) = delete;
+
+    void* get(size_t bytes)
+    {
+      if (bytes > m_capacity)
+      {
+        if (m_data != nullptr)
+          cudaFree(m_data);
+        m_data = nullptr;
+        m_capacity = 0;
+        checkCuda(cudaMalloc(&m_data, bytes), "allocating device memory");
+        m_capacity = bytes;
+      }
+      return m_data;
+    }
+
+  private:
+    void* m_data;
+    size_t m_capacity;
+};
+
+/*!
+ * @brief Device buffers of one thread. Frames in flight are processed by different threads, each one on its own default
+ * stream, so they neither share buffers nor serialize on the device.
+ */
+struct Workspace
+{
+    DeviceBuffer img;
+    DeviceBuffer surface;
+    DeviceBuffer color;
+    DeviceBuffer angle;
+    DeviceBuffer elevated;
+    DeviceBuffer nobs;
+    DeviceBuffer var;
+    DeviceBuffer src_color;
+    DeviceBuffer src_elevation;
+    DeviceBuffer src_angle;
+};
+
+struct DeviceInfo
+{
+    bool is_available;
+    bool is_integrated;
+};
+
+const DeviceInfo& getDeviceInfo()
+{
+  static const DeviceInfo info = []
+  {
+    int nrof_devices = 0;
+    if (cudaGetDeviceCount(&nrof_devices) != cudaSuccess || nrof_devices == 0)
+    {
+      LOG_F(WARNING, "No CUDA device found, rectification and blending are processed on the CPU.");
+      return DeviceInfo{false, false};
+    }
+
+    cudaDeviceProp prop{};
+    cudaGetDeviceProperties(&prop, 0);
+    LOG_F(INFO, "CUDA device for rectification and blending: %s (integrated: %i)", prop.name, prop.integrated);
+    return DeviceInfo{true, prop.integrated != 0};
+  }();
+  return info;
+}
+
+Workspace& getWorkspace()
+{
+  thread_local Workspace workspace;
+  return workspace;
+}
+
+/*!
+ * @brief On integrated GPUs, e.g. Jetson, host and device share the memory. Matrices in pinned memory are therefore
+ * accessed by the kernels in place. On discrete GPUs kernels would read them across the bus, so they are copied.
+ */
+template<typename T>
+bool mapPinned(const cv::Mat &mat, ortho::cuda::kernels::Pitched<T> &device)
+{
+  if (!getDeviceInfo().is_integrated)
+    return false;
+  void* data = MatPool::getDevicePointer(mat);
+  if (data == nullptr)
+    return false;
+  device = {static_cast<T*>(data), mat.step};
+  return true;
+}
+
+template<typename T>
+ortho::cuda::kernels::Pitched<T> allocate(DeviceBuffer &buffer, const cv::Mat &mat)
+{
+  ortho::cuda::kernels::Pitched<T> device{nullptr, 0};
+  if (mapPinned(mat, device))
+    return device;
+  size_t pitch = mat.cols*mat.elemSize();
+  return {static_cast<T*>(buffer.get(pitch*mat.rows)), pitch};
+}
+
+template<typename T>
+ortho::cuda::kernels::Pitched<T> upload(DeviceBuffer &buffer, const cv::Mat &mat)
+{
+  // Layers might be views into a larger map, so rows are copied with their own step
+  ortho::cuda::kernels::Pitched<T> device{nullptr, 0};
+  if (mapPinned(mat, device))
+    return device;
+  device = allocate<T>(buffer, mat);
+  checkCuda(cudaMemcpy2DAsync(const_cast<typename std::remove_const<T>::type*>(device.data), device.pitch, mat.data, mat.step,
+                              device.pitch, mat.rows, cudaMemcpyHostToDevice, cudaStreamPerThread), "uploading to device");
+  return device;
+}
+
+template<typename T>
+void download(const ortho::cuda::kernels::Pitched<T> &device, cv::Mat &mat)
+{
+  ortho::cuda::kernels::Pitched<T> mapped{nullptr, 0};
+  if (mapPinned(mat, mapped) && mapped.data == device.data)
+    return;
+  checkCuda(cudaMemcpy2DAsync(mat.data, mat.step, device.data, device.pitch, device.pitch, mat.rows,
+                              cudaMemcpyDeviceToHost, cudaStreamPerThread), "downloading from device");
+}
+
+} // namespace
+
+bool ortho::cuda::isAvailable()
+{
+  return getDeviceInfo().is_available;
+}
+
+CvGridMap::Ptr ortho::cuda::backprojectFromGrid(
+    const cv::Mat &img,
+    const camera::Pinhole &cam,
+    cv::Mat &surface,
+    const cv::Rect2d &roi,
+    double GSD,
+    bool is_elevated,
+    bool verbose,
+    int interpolation,
+    MatPool* mat_pool)
+{
+  if (!isAvailable())
+    throw(std::runtime_error("Error rectifying on GPU: No CUDA device available."));
+  if (!isInterpolationSupported(interpolation))
+    throw(std::invalid_argument("Error rectifying on GPU: Interpolation not supported."));
+  if (img.type() != CV_8UC4 || surface.type() != CV_32F)
+    throw(std::invalid_argument("Error rectifying on GPU: Unexpected types of image or surface."));
+
+  LOG_IF_F(INFO, verbose, "Processing rectification on GPU:");
+  LOG_IF_F(INFO, verbose, "- ROI (%f, %f, %f, %f)", roi.x, roi.y, roi.width, roi.height);
+  LOG_IF_F(INFO, verbose, "- Dimensions: %i x %i", surface.rows, surface.cols);
+  LOG_IF_F(INFO, verbose, "- Interpolation: %i", interpolation);
+
+  // Projection is shifted into the local frame of the upper left corner of the roi in double precision once, like for
+  // the vectorized kernel on the CPU
+  cv::Mat cv_P = cam.P();
+  cv::Mat t_pose = cam.t();
+  double origin[3]{roi.x, roi.y+roi.height, 0.0};
+
+  kernels::BackprojectParams params{};
+  for (int i = 0; i < 3; ++i)
+  {
+    for (int j = 0; j < 3; ++j)
+      params.P[i][j] = static_cast<float>(cv_P.at<double>(i, j));
+    params.P[i][3] = static_cast<float>(cv_P.at<double>(i, 0)*origin[0] + cv_P.at<double>(i, 1)*origin[1]
+                                        + cv_P.at<double>(i, 2)*origin[2] + cv_P.at<double>(i, 3));
+    params.t[i] = static_cast<float>(t_pose.at<double>(i) - origin[i]);
+  }
+  params.gsd = static_cast<float>(GSD);
+  params.rows = surface.rows;
+  params.cols = surface.cols;
+  params.img_rows = img.rows;
+  params.img_cols = img.cols;
+  params.elevated_val = (is_elevated ? (uint8_t)0 : (uint8_t)255);
+  params.use_bilinear = (interpolation == cv::INTER_LINEAR);
+
+  // Every cell is written by the kernel, so the layers do not have to be initialized
+  auto create = [&](int type)
+  {
+    return (mat_pool != nullptr ? mat_pool->create(surface.size(), type) : cv::Mat(surface.size(), type));
+  };
+  cv::Mat color_data       = create(CV_8UC4);
+  cv::Mat elevation_angle  = create(CV_32FC1);
+  cv::Mat elevated         = create(CV_8UC1);
+  cv::Mat num_observations = create(CV_16UC1);
+
+  Workspace &workspace = getWorkspace();
+  auto d_img = upload<const uchar4>(workspace.img, img);
+  auto d_surface = upload<float>(workspace.surface, surface);
+  auto d_color = allocate<uchar4>(workspace.color, color_data);
+  auto d_angle = allocate<float>(workspace.angle, elevation_angle);
+  auto d_elevated = allocate<uint8_t>(workspace.elevated, elevated);
+  auto d_nobs = allocate<uint16_t>(workspace.nobs, num_observations);
+
+  checkCuda(kernels::backproject(params, d_img, d_surface, d_color, d_angle, d_elevated, d_nobs, cudaStreamPerThread),
+            "launching backprojection");
+
+  download(d_surface, surface);
+  download(d_color, color_data);
+  download(d_angle, elevation_angle);
+  download(d_elevated, elevated);
+  download(d_nobs, num_observations);
+  checkCuda(cudaStreamSynchronize(cudaStreamPerThread), "rectifying on GPU");
+
+  LOG_IF_F(INFO, verbose, "Image successfully rectified.");
+
+  auto rectification = std::make_shared<CvGridMap>(roi, GSD);
+  rectification->add("color_rgb", color_data);
+  rectification->add("elevation_angle", elevation_angle);
+  rectification->add("elevated", elevated);
+  rectification->add("num_observations", num_observations);
+  return rectification;
+}
+
+void ortho::cuda::blend(cv::Mat &ref_color,
+                        cv::Mat &ref_elevation,
+                        cv::Mat &ref_angle,
+                        cv::Mat &ref_nobs,
+                        cv::Mat &ref_var,
+                        const cv::Mat &src_color,
+                        const cv::Mat &src_elevation,
+                        const cv::Mat &src_angle)
+{
+  if (!isAvailable())
+    throw(std::runtime_error("Error blending on GPU: No CUDA device available."));
+
+  cv::Size size = ref_color.size();
+  if (ref_elevation.size() != size || ref_angle.size() != size || ref_nobs.size() != size
+      || (!ref_var.empty() && ref_var.size() != size)
+      || src_color.size() != size || src_elevation.size() != size || src_angle.size() != size)
+    throw(std::invalid_argument("Error blending on GPU: Layers have different sizes."));
+
+  Workspace &workspace = getWorkspace();
+  auto d_ref_color = upload<uchar4>(workspace.color, ref_color);
+  auto d_ref_elevation = upload<float>(workspace.surface, ref_elevation);
+  auto d_ref_angle = upload<float>(workspace.angle, ref_angle);
+  auto d_ref_nobs = upload<uint16_t>(workspace.nobs, ref_nobs);
+  kernels::Pitched<float> d_ref_var{nullptr, 0};
+  if (!ref_var.empty())
+    d_ref_var = upload<float>(workspace.var, ref_var);
+  auto d_src_color = upload<const uchar4>(workspace.src_color, src_color);
+  auto d_src_elevation = upload<const float>(workspace.src_elevation, src_elevation);
+  auto d_src_angle = upload<const float>(workspace.src_angle, src_angle);
+
+  checkCuda(kernels::blend(size.height, size.width, d_ref_color, d_ref_elevation, d_ref_angle, d_ref_nobs, d_ref_var,
+                           d_src_color, d_src_elevation, d_src_angle, cudaStreamPerThread), "launching blending");
+
+  download(d_ref_color, ref_color);
+  download(d_ref_elevation, ref_elevation);
+  download(d_ref_angle, ref_angle);
+  download(d_ref_nobs, ref_nobs);
+  if (!ref_var.empty())
+    download(d_ref_var, ref_var);
+  checkCuda(cudaStreamSynchronize(cudaStreamPerThread), "blending on GPU");
+}
+
+#else
+
+bool ortho::cuda::isAvailable()
+{
+  return false;
+}
+
+CvGridMap::Ptr ortho::cuda::backprojectFromGrid(const cv::Mat &, const camera::Pinhole &, cv::Mat &, const cv::Rect2d &,
+                                                 double, bool, bool, int, MatPool*)
+{
+  throw(std::runtime_error("Error rectifying on GPU: OpenREALM was built without CUDA support."));
+}
+
+void ortho::cuda::blend(cv::Mat &, cv::Mat &, cv::Mat &, cv::Mat &, cv::Mat &, const cv::Mat &, const cv::Mat &,
+                        const cv::Mat &)
+{
+  throw(std::runtime_error("Error blending on GPU: OpenREALM was built without CUDA support."));
+}
+
+#endif
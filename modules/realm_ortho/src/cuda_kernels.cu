@@ -0,0 +1,206 @@
+
+
+#include <math_constants.h>
+
+#include "cuda_kernels.h"
+
+using namespace realm::ortho::cuda;
+
+namespace
+{
+// Same approximation of the elevation angle as the vectorized backprojection on the CPU, see rectification.cpp
+__constant__ float kAtanP1 = 0.9997878412794807f;
+__constant__ float kAtanP3 = -0.3258083974640975f;
+__constant__ float kAtanP5 = 0.1555786518463281f;
+__constant__ float kAtanP7 = -0.04432655554792128f;
+__constant__ float kHalfPi = 1.5707963267948966f;
+__constant__ float kRadToDeg = 180.0f/3.1415f;
+
+const int kBlockWidth = 32;
+const int kBlockHeight = 8;
+
+__device__ float computeElevationAngleFast(float dz, float dh)
+{
+  float a = fminf(dz, dh) / fmaxf(dz, dh);
+  float a2 = a*a;
+  float angle = (((kAtanP7*a2 + kAtanP5)*a2 + kAtanP3)*a2 + kAtanP1)*a;
+  return (dz > dh ? kHalfPi - angle : angle) * kRadToDeg;
+}
+
+__device__ uchar4 sampleBilinear(const kernels::Pitched<const uchar4> &img, int rows, int cols, float x, float y)
+{
+  // Pixel centers are at integer coordinates, border is replicated like the remap on the CPU
+  int x0 = static_cast<int>(floorf(x));
+  int y0 = static_cast<int>(floorf(y));
+  float fx = x - static_cast<float>(x0);
+  float fy = y - static_cast<float>(y0);
+
+  int xa = min(max(x0, 0), cols - 1);
+  int xb = min(max(x0 + 1, 0), cols - 1);
+  int ya = min(max(y0, 0), rows - 1);
+  int yb = min(max(y0 + 1, 0), rows - 1);
+
+  uchar4 p00 = img.row(ya)[xa];
+  uchar4 p01 = img.row(ya)[xb];
+  uchar4 p10 = img.row(yb)[xa];
+  uchar4 p11 = img.row(yb)[xb];
+
+  float w00 = (1.0f - fx)*(1.0f - fy);
+  float w01 = fx*(1.0f - fy);
+  float w10 = (1.0f - fx)*fy;
+  float w11 = fx*fy;
+
+  return make_uchar4(
+      static_cast<unsigned char>(fminf(w00*p00.x + w01*p01.x + w10*p10.x + w11*p11.x + 0.5f, 255.0f)),
+      static_cast<unsigned char>(fminf(w00*p00.y + w01*p01.y + w10*p10.y + w11*p11.y + 0.5f, 255.0f)),
+      static_cast<unsigned char>(fminf(w00*p00.z + w01*p01.z + w10*p10.z + w11*p11.z + 0.5f, 255.0f)),
+      static_cast<unsigned char>(fminf(w00*p00.w + w01*p01.w + w10*p10.w + w11*p11.w + 0.5f, 255.0f)));
+}
+
+__global__ void backprojectKernel(kernels::BackprojectParams params,
+                                  kernels::Pitched<const uchar4> img,
+                                  kernels::Pitched<float> surface,
+                                  kernels::Pitched<uchar4> color,
+                                  kernels::Pitched<float> elevation_angle,
+                                  kernels::Pitched<uint8_t> elevated,
+                                  kernels::Pitched<uint16_t> num_observations)
+{
+  int c = blockIdx.x*blockDim.x + threadIdx.x;
+  int r = blockIdx.y*blockDim.y + threadIdx.y;
+  if (c >= params.cols || r >= params.rows)
+    return;
+
+  float* surface_row = surface.row(r);
+  float e = surface_row[c];
+
+  uchar4 color_val = make_uchar4(0, 0, 0, 0);
+  float angle_val = 0.0f;
+  uint8_t elevated_val = 0;
+  uint16_t num_observations_val = 0;
+
+  // NaN elevation marks cells without surface information, they are left untouched
+  if (e == e)
+  {
+    float x_local = static_cast<float>(c)*params.gsd;
+    float y_local = -static_cast<float>(r)*params.gsd;
+    float z = params.P[2][0]*x_local + params.P[2][1]*y_local + params.P[2][2]*e + params.P[2][3];
+    float x = (params.P[0][0]*x_local + params.P[0][1]*y_local + params.P[0][2]*e + params.P[0][3]) / z;
+    float y = (params.P[1][0]*x_local + params.P[1][1]*y_local + params.P[1][2]*e + params.P[1][3]) / z;
+
+    if (x > 0.0f && x < params.img_cols && y > 0.0f && y < params.img_rows)
+    {
+      if (params.use_bilinear)
+        color_val = sampleBilinear(img, params.img_rows, params.img_cols, x - 0.5f, y - 0.5f);
+      else
+        color_val = img.row(static_cast<int>(y))[static_cast<int>(x)];
+
+      float dx = params.t[0] - x_local;
+      float dy = params.t[1] - y_local;
+      angle_val = computeElevationAngleFast(fabsf(params.t[2] - e), sqrtf(dx*dx + dy*dy));
+      elevated_val = params.elevated_val;
+      num_observations_val = 1;
+    }
+    else
+      surface_row[c] = CUDART_NAN_F;
+  }
+
+  color.row(r)[c] = color_val;
+  elevation_angle.row(r)[c] = angle_val;
+  elevated.row(r)[c] = elevated_val;
+  num_observations.row(r)[c] = num_observations_val;
+}
+
+__global__ void blendKernel(int rows,
+                            int cols,
+                            kernels::Pitched<uchar4> ref_color,
+                            kernels::Pitched<float> ref_elevation,
+                            kernels::Pitched<float> ref_angle,
+                            kernels::Pitched<uint16_t> ref_nobs,
+                            kernels::Pitched<float> ref_var,
+                            kernels::Pitched<const uchar4> src_color,
+                            kernels::Pitched<const float> src_elevation,
+                            kernels::Pitched<const float> src_angle)
+{
+  int c = blockIdx.x*blockDim.x + threadIdx.x;
+  int r = blockIdx.y*blockDim.y + threadIdx.y;
+  if (c >= cols || r >= rows)
+    return;
+
+  bool fuse_elevation = (ref_var.data != nullptr);
+  float* ref_elevation_row = ref_elevation.row(r);
+  float* ref_angle_row = ref_angle.row(r);
+  uint16_t* ref_nobs_row = ref_nobs.row(r);
+
+  float angle_ref = ref_angle_row[c];
+  if (isnan(angle_ref))
+    angle_ref = 0.0f;
+
+  float angle_src = src_angle.row(r)[c];
+  if (angle_src > angle_ref)
+  {
+    ref_color.row(r)[c] = src_color.row(r)[c];
+    ref_angle_row[c] = angle_src;
+    if (!fuse_elevation)
+    {
+      ref_elevation_row[c] = src_elevation.row(r)[c];
+      ref_nobs_row[c] = static_cast<uint16_t>(min(ref_nobs_row[c] + 1, 65535));
+    }
+  }
+  else
+    ref_angle_row[c] = angle_ref;
+
+  // Welford update of mean and variance, see Mosaicing::blend
+  float elevation = src_elevation.row(r)[c];
+  if (!fuse_elevation || isnan(elevation))
+    return;
+  float* ref_var_row = ref_var.row(r);
+  if (isnan(ref_var_row[c]))
+  {
+    ref_var_row[c] = 0.0f;
+    return;
+  }
+  auto n = static_cast<float>(ref_nobs_row[c]);
+  float delta = elevation - ref_elevation_row[c];
+  ref_elevation_row[c] += delta / (n + 1.0f);
+  ref_var_row[c] = (ref_var_row[c]*n + delta*(elevation - ref_elevation_row[c])) / (n + 1.0f);
+  ref_nobs_row[c] = static_cast<uint16_t>(min(ref_nobs_row[c] + 1, 65535));
+}
+
+dim3 computeGrid(int rows, int cols)
+{
+  return dim3((cols + kBlockWidth - 1) / kBlockWidth, (rows + kBlockHeight - 1) / kBlockHeight);
+}
+} // namespace
+
+cudaError_t kernels::backproject(const BackprojectParams &params,
+                                 Pitched<const uchar4> img,
+                                 Pitched<float> surface,
+                                 Pitched<uchar4> color,
+                                 Pitched<float> elevation_angle,
+                                 Pitched<uint8_t> elevated,
+                                 Pitched<uint16_t> num_observations,
+                                 cudaStream_t stream)
+{
+  dim3 block(kBlockWidth, kBlockHeight);
+  backprojectKernel<<<computeGrid(params.rows, params.cols), block, 0, stream>>>(
+      params, img, surface, color, elevation_angle, elevated, num_observations);
+  return cudaGetLastError();
+}
+
+cudaError_t kernels::blend(int rows,
+                           int cols,
+                           Pitched<uchar4> ref_color,
+                           Pitched<float> ref_elevation,
+                           Pitched<float> ref_angle,
+                           Pitched<uint16_t> ref_nobs,
+                           Pitched<float> ref_var,
+                           Pitched<const uchar4> src_color,
+                           Pitched<const float> src_elevation,
+                           Pitched<const float> src_angle,
+                           cudaStream_t stream)
+{
+  dim3 block(kBlockWidth, kBlockHeight);
+  blendKernel<<<computeGrid(rows, cols), block, 0, stream>>>(
+      rows, cols, ref_color, ref_elevation, ref_angle, ref_nobs, ref_var, src_color, src_elevation, src_angle);
+  return cudaGetLastError();
+}
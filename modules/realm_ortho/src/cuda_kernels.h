@@ -0,0 +1,88 @@
+
+
+#ifndef PROJECT_CUDA_KERNELS_H
+#define PROJECT_CUDA_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <cuda_runtime.h>
+
+namespace realm
+{
+namespace ortho
+{
+namespace cuda
+{
+namespace kernels
+{
+
+/*!
+ * @brief Pointer to a 2D array in device memory with the row pitch in bytes. Kept free of OpenCV, so the kernels can be
+ * compiled by nvcc independently of the OpenCV headers.
+ */
+template<typename T>
+struct Pitched
+{
+    T* data;
+    size_t pitch;
+
+    __host__ __device__ T* row(int r) const
+    {
+      return reinterpret_cast<T*>(const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(data)) + r*pitch);
+    }
+};
+
+/*!
+ * @brief Parameters of the backprojection. Projection and camera position are shifted into the local frame of the upper
+ * left corner of the roi, so all per cell operations can be computed in single precision.
+ */
+struct BackprojectParams
+{
+    float P[3][4];
+    float t[3];
+    float gsd;
+    int rows;
+    int cols;
+    int img_rows;
+    int img_cols;
+    uint8_t elevated_val;
+    bool use_bilinear;
+};
+
+/*!
+ * @brief Projects every cell of the surface into the image, samples its color and computes the elevation angle. Every
+ * output cell is written, so the outputs do not have to be initialized. Cells outside the image are set NaN in the
+ * surface.
+ */
+cudaError_t backproject(const BackprojectParams &params,
+                        Pitched<const uchar4> img,
+                        Pitched<float> surface,
+                        Pitched<uchar4> color,
+                        Pitched<float> elevation_angle,
+                        Pitched<uint8_t> elevated,
+                        Pitched<uint16_t> num_observations,
+                        cudaStream_t stream);
+
+/*!
+ * @brief Blends new data into the reference, same as the blending on the CPU. The variance may be nullptr, then the
+ * elevation of the steepest observation is kept instead of the running mean.
+ */
+cudaError_t blend(int rows,
+                  int cols,
+                  Pitched<uchar4> ref_color,
+                  Pitched<float> ref_elevation,
+                  Pitched<float> ref_angle,
+                  Pitched<uint16_t> ref_nobs,
+                  Pitched<float> ref_var,
+                  Pitched<const uchar4> src_color,
+                  Pitched<const float> src_elevation,
+                  Pitched<const float> src_angle,
+                  cudaStream_t stream);
+
+} // namespace kernels
+} // namespace cuda
+} // namespace ortho
+} // namespace realm
+
+#endif //PROJECT_CUDA_KERNELS_H
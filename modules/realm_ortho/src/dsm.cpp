@@ -2,10 +2,24 @@
 
 #include <realm_ortho/dsm.h>
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
 #include <opencv2/imgproc.hpp>
+#include <opencv2/core/utility.hpp>
 
 using namespace realm::ortho;
 
+namespace
+{
+
+// Margin around the region of interest relative to its larger edge, in which points are kept. Cells at the border of
+// the grid search beyond the region, so points close to it still contribute.
+const double g_roi_margin = 0.1;
+
+} // namespace
+
 DigitalSurfaceModel::DigitalSurfaceModel(const cv::Rect2d &roi, double elevation)
 : m_use_prior_normals(false),
   m_assumption(SurfaceAssumption::PLANAR),
@@ -23,18 +37,28 @@ DigitalSurfaceModel::DigitalSurfaceModel(const cv::Rect2d &roi, double elevation
 DigitalSurfaceModel::DigitalSurfaceModel(const cv::Rect2d &roi,
                                          const cv::Mat& points,
                                          SurfaceNormalMode mode,
-                                         int knn_max_iter)
+                                         int knn_max_iter,
+                                         int nrof_threads,
+                                         int coarse_step,
+                                         double th_flatness,
+                                         const ThreadPool::Ptr &thread_pool,
+                                         const NeighbourIndex2D::Ptr &index)
     : m_use_prior_normals(false),
       m_knn_max_iter(knn_max_iter),
+      m_nrof_threads(nrof_threads),
+      m_thread_pool(thread_pool),
+      m_coarse_step(coarse_step),
+      m_th_flatness(th_flatness),
       m_assumption(SurfaceAssumption::ELEVATION),
-      m_surface_normal_mode(mode)
+      m_surface_normal_mode(mode),
+      m_index(index ? index : std::make_shared<PointGridIndex>())
 {
   // Elevation surface means, that prior information
   // about the surface is available. Here in the form
   // of a point cloud of observed points.
   // Strategy is now to:
-  // 0) Filter input point cloud for outlier
-  // 1) Create a Kd-tree of the observed point cloud
+  // 0) Cull input point cloud to the region of interest and filter for outlier
+  // 1) Create a spatial index of the observed point cloud
   // 2) Estimate resolution of the point cloud
   // 3) Create a grid map based on the previously computed resolution
 
@@ -42,27 +66,71 @@ DigitalSurfaceModel::DigitalSurfaceModel(const cv::Rect2d &roi,
   if (points.cols >= 9)
     m_use_prior_normals = true;
 
-  // 0) Filter input point cloud and create container
-  cv::Mat points_filtered = filterPointCloud(points);
-
-  m_point_cloud.pts.clear();
-  m_point_cloud.pts.resize((unsigned long)points_filtered.rows);
-  for (int i = 0; i < points_filtered.rows; ++i)
-  {
-    m_point_cloud.pts[i].x = points_filtered.at<double>(i, 0);
-    m_point_cloud.pts[i].y = points_filtered.at<double>(i, 1);
-    m_point_cloud.pts[i].z = points_filtered.at<double>(i, 2);
-  }
+  // 0) Cull points outside the region, e.g. tracked map points far from the footprint, then filter the remaining ones
+  m_point_cloud = filterPointCloud(cullPointCloud(points, roi));
 
-  // 1) Init Kd-tree
-  initKdTree(m_point_cloud);
+  // 1) Init spatial index
+  initIndex(m_point_cloud);
 
   // 2) Estimate resolution based on the point cloud
   double GSD_estimated = computePointCloudGSD(m_point_cloud);
 
   // 3) Create grid map based on point cloud resolution and surface info
   m_surface = std::make_shared<CvGridMap>(roi, GSD_estimated);
-  computeElevation(points_filtered);
+  computeElevation(m_point_cloud);
+
+  // Index is only needed during construction. Released, so the owner can rebuild it for the next frame
+  m_index.reset();
+}
+
+DigitalSurfaceModel::DigitalSurfaceModel(const cv::Rect2d &roi,
+                                         const Depthmap::Ptr &depthmap,
+                                         SurfaceNormalMode mode,
+                                         int nrof_threads,
+                                         const ThreadPool::Ptr &thread_pool)
+    : m_use_prior_normals(false),
+      m_knn_max_iter(0),
+      m_nrof_threads(nrof_threads),
+      m_thread_pool(thread_pool),
+      m_coarse_step(1),
+      m_th_flatness(0.0),
+      m_assumption(SurfaceAssumption::ELEVATION),
+      m_surface_normal_mode(mode)
+{
+  if (!depthmap)
+    throw(std::invalid_argument("Error creating elevation surface: Depth map is nullptr!"));
+  rasterizeDepthmap(roi, depthmap);
+}
+
+cv::Mat DigitalSurfaceModel::cullPointCloud(const cv::Mat &points, const cv::Rect2d &roi)
+{
+  assert(points.type() == CV_64F);
+
+  double margin = g_roi_margin * std::max(roi.width, roi.height);
+  double x_min = roi.x - margin;
+  double x_max = roi.x + roi.width + margin;
+  double y_min = roi.y - margin;
+  double y_max = roi.y + roi.height + margin;
+
+  // Comparisons with non-finite coordinates fail, so invalid points of dense clouds are removed as well
+  std::vector<int> rows_inside;
+  rows_inside.reserve(static_cast<size_t>(points.rows));
+  for (int r = 0; r < points.rows; ++r)
+  {
+    const double* pt = points.ptr<double>(r);
+    if (pt[0] >= x_min && pt[0] <= x_max && pt[1] >= y_min && pt[1] <= y_max)
+      rows_inside.push_back(r);
+  }
+
+  // Clouds without any point in the region are kept as they are, so the surface is computed as before
+  if (rows_inside.size() == static_cast<size_t>(points.rows) || rows_inside.empty())
+    return points;
+
+  cv::Mat points_inside(static_cast<int>(rows_inside.size()), points.cols, points.type());
+  size_t row_bytes = points.cols * points.elemSize();
+  for (size_t i = 0; i < rows_inside.size(); ++i)
+    std::memcpy(points_inside.ptr(static_cast<int>(i)), points.ptr(rows_inside[i]), row_bytes);
+  return points_inside;
 }
 
 cv::Mat DigitalSurfaceModel::filterPointCloud(const cv::Mat &points)
@@ -113,39 +181,30 @@ cv::Mat DigitalSurfaceModel::filterPointCloud(const cv::Mat &points)
   return points;
 }
 
-void DigitalSurfaceModel::initKdTree(const PointCloud<double> &point_cloud)
+void DigitalSurfaceModel::initIndex(const cv::Mat &point_cloud)
 {
   assert(m_assumption == SurfaceAssumption::ELEVATION);
 
-  // Build kd-tree for space hierarchy
-  m_point_cloud_adaptor.reset(new PointCloudAdaptor_t(m_point_cloud));
-  m_kd_tree.reset(new DigitalSurfaceModel::KdTree_t(kDimensionKdTree, *m_point_cloud_adaptor, nanoflann::KDTreeSingleIndexAdaptorParams(kMaxLeaf)));
-  m_kd_tree->buildIndex();
+  // Build index for space hierarchy. Depending on the index it reuses the buffers of a previous frame
+  m_index->build(point_cloud, m_thread_pool, m_nrof_threads);
 }
 
-double DigitalSurfaceModel::computePointCloudGSD(const PointCloud<double> &point_cloud)
+double DigitalSurfaceModel::computePointCloudGSD(const cv::Mat &point_cloud)
 {
   // Prepare container
-  size_t n = point_cloud.pts.size();
+  auto n = static_cast<size_t>(point_cloud.rows);
   std::vector<double> dists;
-  std::vector<size_t> tmp_indices(2);
-  std::vector<double> tmp_dists(2);
+  size_t tmp_indices[2];
+  double tmp_dists[2];
 
   // Iterate through the point cloud and compute nearest neighbour distance
-  auto n_iter = static_cast<size_t>(0.01 * n);
+  auto n_iter = std::max(static_cast<size_t>(0.01 * n), static_cast<size_t>(1));
   dists.reserve(n/n_iter+1);
   for (size_t i = 0; i < n; i+=n_iter)
   {
-    PointCloud<double>::Point pt = point_cloud.pts[i];
-
-    // Preparation of output container
-    tmp_indices.clear();
-    tmp_dists.clear();
-
-    // Initialization
-    const double query_pt[3]{pt.x, pt.y, 0.0};
-
-    m_kd_tree->knnSearch(&query_pt[0], 2u, &tmp_indices[0], &tmp_dists[0]);
+    auto pt = point_cloud.ptr<double>(static_cast<int>(i));
+    if (m_index->knnSearch(pt[0], pt[1], 2u, &tmp_indices[0], &tmp_dists[0]) < 2u)
+      continue;
 
     // "closest point" distance is zero, because search point is also trained data
     // Therefore choose the one point that distance is above approx 0.0
@@ -170,53 +229,24 @@ void DigitalSurfaceModel::computeElevation(const cv::Mat &point_cloud)
   // Optional computation according to flag
   cv::Mat elevation_normal(size, CV_32FC3, cv::Scalar(0.0, 0.0, 0.0));
 
-  for (uint32_t r = 0; r < size.height; ++r)
-    for (uint32_t c = 0; c < size.width; ++c)
+  // Grid is split into bands of rows which are processed in parallel. Each band has its own result container of the
+  // neighbour search and only writes to its own rows.
+  auto compute_rows = [&](const cv::Range &range)
+  {
+    std::vector<std::pair<int, double>> indices_dists;
+    for (int r = range.start; r < range.end; ++r)
     {
-      cv::Point2d pt = m_surface->atPosition2d(r, c);
-      std::vector<double> query_pt{pt.x, pt.y, 0.0};
-
-      // Prepare kd-search for nearest neighbors
-      double resolution = m_surface->resolution();
-      std::vector<std::pair<int, double>> indices_dists;
-
-      // Process neighbor search, if no neighbors are found, extend search distance
-      for (int i = 0; i < m_knn_max_iter; ++i)
-      {
-        nanoflann::RadiusResultSet<double, int> result_set(static_cast<double>(i) * resolution, indices_dists);
-        m_kd_tree->findNeighbors(result_set, &query_pt[0], nanoflann::SearchParams());
-
-        // Process only if neighbours were found
-        if (result_set.size() >= 3u)
-        {
-          std::vector<double> distances;
-          std::vector<double> heights;
-          std::vector<PlaneFitter::Point> points;
-          std::vector<PlaneFitter::Normal> normals_prior;
-          for (const auto &s : result_set.m_indices_dists)
-          {
-            distances.push_back(s.second);
-            heights.push_back(point_cloud.at<double>(s.first, 2));
-            points.emplace_back(PlaneFitter::Point{point_cloud.at<double>(s.first, 0),
-                                                   point_cloud.at<double>(s.first, 1),
-                                                   point_cloud.at<double>(s.first, 2)});
-            if (point_cloud.cols >= 9)
-              normals_prior.emplace_back(PlaneFitter::Normal{point_cloud.at<double>(s.first, 6),
-                                                             point_cloud.at<double>(s.first, 7),
-                                                             point_cloud.at<double>(s.first, 8)});
-          }
-
-          elevation.at<float>(r, c) = interpolateHeight(heights, distances);
-
-          if ((m_surface_normal_mode == SurfaceNormalMode::NONE) && m_use_prior_normals)
-            elevation_normal.at<cv::Vec3f>(r, c) = interpolateNormal(normals_prior, distances);
-          else if (m_surface_normal_mode != SurfaceNormalMode::NONE)
-            elevation_normal.at<cv::Vec3f>(r, c) = computeSurfaceNormal(points, distances);
-
-          break;
-        }
-      }
+      auto elevation_row = elevation.ptr<float>(r);
+      auto elevation_normal_row = elevation_normal.ptr<cv::Vec3f>(r);
+      for (int c = 0; c < size.width; ++c)
+        computeElevationAtCell(point_cloud, r, c, indices_dists, elevation_row[c], elevation_normal_row[c]);
     }
+  };
+
+  if (m_coarse_step > 1 && size.width > 1 && size.height > 1)
+    computeElevationHierarchical(point_cloud, elevation, elevation_normal);
+  else
+    realm::parallelFor(m_thread_pool, cv::Range(0, size.height), compute_rows, m_nrof_threads);
 
   m_surface->add("elevation", elevation);
 
@@ -230,47 +260,342 @@ void DigitalSurfaceModel::computeElevation(const cv::Mat &point_cloud)
     m_surface->add("elevation_normal", elevation_normal);
 }
 
-realm::CvGridMap::Ptr DigitalSurfaceModel::getSurfaceGrid()
+bool DigitalSurfaceModel::computeElevationAtCell(const cv::Mat &point_cloud, uint32_t r, uint32_t c,
+                                                 std::vector<std::pair<int, double>> &indices_dists,
+                                                 float &elevation, cv::Vec3f &normal)
 {
-  return m_surface;
+  cv::Point2d pt = m_surface->atPosition2d(r, c);
+
+  // Prepare search for nearest neighbors
+  double resolution = m_surface->resolution();
+
+  // Process neighbor search, if no neighbors are found, extend search distance
+  for (int i = 0; i < m_knn_max_iter; ++i)
+  {
+    m_index->radiusSearch(pt.x, pt.y, static_cast<double>(i) * resolution, indices_dists);
+
+    // Process only if neighbours were found
+    if (indices_dists.size() >= 3u)
+    {
+      // Height and prior normals are interpolated by "Inverse distance weighting" (IDW) directly from the cloud, so
+      // no containers have to be allocated per cell
+      bool use_prior_normals = (m_surface_normal_mode == SurfaceNormalMode::NONE) && m_use_prior_normals;
+      double numerator = 0.0;
+      double denominator = 0.0;
+      cv::Vec3d numerator_normal(0.0, 0.0, 0.0);
+      for (const auto &s : indices_dists)
+      {
+        const double* p = point_cloud.ptr<double>(s.first);
+        numerator += p[2] / s.second;
+        denominator += 1.0 / s.second;
+        if (use_prior_normals)
+          numerator_normal += cv::Vec3d(p[6], p[7], p[8]) / s.second;
+      }
+
+      elevation = static_cast<float>(numerator / denominator);
+
+      if (use_prior_normals)
+        normal = cv::normalize(cv::Vec3f(numerator_normal / denominator));
+      else if (m_surface_normal_mode != SurfaceNormalMode::NONE)
+        normal = computeSurfaceNormal(point_cloud, indices_dists);
+
+      return true;
+    }
+  }
+  return false;
 }
 
-float DigitalSurfaceModel::interpolateHeight(const std::vector<double> &heights, const std::vector<double> &dists)
+void DigitalSurfaceModel::computeElevationHierarchical(const cv::Mat &point_cloud, cv::Mat &elevation, cv::Mat &elevation_normal)
 {
-  double numerator = 0.0;
-  double denominator = 0.0;
-  for (size_t i = 0u; i < heights.size(); ++i)
+  cv::Size2i size = elevation.size();
+  double resolution = m_surface->resolution();
+  bool has_normals = (m_surface_normal_mode != SurfaceNormalMode::NONE || m_use_prior_normals);
+
+  // Indices of the coarse grid. Last row and column are always part of it, so the whole grid is covered by blocks
+  auto create_coarse_indices = [&](int n)
   {
-    numerator += heights[i] / dists[i];
-    denominator += 1.0 / dists[i];
-  }
-  return static_cast<float>(numerator / denominator);
+    std::vector<int> indices;
+    for (int i = 0; i < n-1; i += m_coarse_step)
+      indices.push_back(i);
+    indices.push_back(n-1);
+    return indices;
+  };
+  std::vector<int> coarse_rows = create_coarse_indices(size.height);
+  std::vector<int> coarse_cols = create_coarse_indices(size.width);
+  auto nrof_coarse_rows = static_cast<int>(coarse_rows.size());
+  auto nrof_coarse_cols = static_cast<int>(coarse_cols.size());
+
+  // 1) Evaluate coarse grid
+  cv::Mat coarse_valid = cv::Mat::zeros(nrof_coarse_rows, nrof_coarse_cols, CV_8UC1);
+  realm::parallelFor(m_thread_pool, cv::Range(0, nrof_coarse_rows), [&](const cv::Range &range)
+  {
+    std::vector<std::pair<int, double>> indices_dists;
+    for (int i = range.start; i < range.end; ++i)
+      for (int j = 0; j < nrof_coarse_cols; ++j)
+      {
+        int r = coarse_rows[i];
+        int c = coarse_cols[j];
+        if (computeElevationAtCell(point_cloud, r, c, indices_dists, elevation.at<float>(r, c), elevation_normal.at<cv::Vec3f>(r, c)))
+          coarse_valid.at<uchar>(i, j) = 255;
+      }
+  }, m_nrof_threads);
+
+  // Points in the neighbour search are compared by squared distance. Every point, that contributes to one of the cells
+  // inside a block must therefore be within this distance to the block center
+  double max_search_dist = sqrt(static_cast<double>(std::max(m_knn_max_iter-1, 0)) * resolution);
+
+  // 2) Process blocks between the coarse cells. Every block owns the rows [r0, r1) and cols [c0, c1). Only the last
+  //    block row and column own their closing border as well. Bands of block rows are processed in parallel.
+  realm::parallelFor(m_thread_pool, cv::Range(0, nrof_coarse_rows-1), [&](const cv::Range &range)
+  {
+    std::vector<std::pair<int, double>> indices_dists;
+    for (int i = range.start; i < range.end; ++i)
+      for (int j = 0; j < nrof_coarse_cols-1; ++j)
+      {
+        int r0 = coarse_rows[i], r1 = coarse_rows[i+1];
+        int c0 = coarse_cols[j], c1 = coarse_cols[j+1];
+        int r_end = (i == nrof_coarse_rows-2 ? r1+1 : r1);
+        int c_end = (j == nrof_coarse_cols-2 ? c1+1 : c1);
+
+        int nrof_valid = coarse_valid.at<uchar>(i, j) / 255 + coarse_valid.at<uchar>(i, j+1) / 255
+                         + coarse_valid.at<uchar>(i+1, j) / 255 + coarse_valid.at<uchar>(i+1, j+1) / 255;
+
+        float e00 = elevation.at<float>(r0, c0);
+        float e01 = elevation.at<float>(r0, c1);
+        float e10 = elevation.at<float>(r1, c0);
+        float e11 = elevation.at<float>(r1, c1);
+
+        if (nrof_valid == 0)
+        {
+          // Empty block: Check if any point is close enough to contribute to one of the cells
+          cv::Point2d center = (m_surface->atPosition2d(r0, c0) + m_surface->atPosition2d(r1, c1)) * 0.5;
+          double half_diagonal = 0.5 * resolution * sqrt(static_cast<double>((r1-r0)*(r1-r0) + (c1-c0)*(c1-c0)));
+          if (!m_index->hasNeighbour(center.x, center.y, half_diagonal + max_search_dist))
+            continue;
+        }
+        else if (nrof_valid == 4
+                 && std::max(std::max(e00, e01), std::max(e10, e11)) - std::min(std::min(e00, e01), std::min(e10, e11)) <= m_th_flatness)
+        {
+          // Flat block: Bilinear interpolation of elevation and normals between the corners
+          cv::Vec3f n00 = elevation_normal.at<cv::Vec3f>(r0, c0);
+          cv::Vec3f n01 = elevation_normal.at<cv::Vec3f>(r0, c1);
+          cv::Vec3f n10 = elevation_normal.at<cv::Vec3f>(r1, c0);
+          cv::Vec3f n11 = elevation_normal.at<cv::Vec3f>(r1, c1);
+          for (int r = r0; r < r_end; ++r)
+          {
+            auto wr = static_cast<float>(r-r0) / static_cast<float>(r1-r0);
+            for (int c = c0; c < c_end; ++c)
+            {
+              auto wc = static_cast<float>(c-c0) / static_cast<float>(c1-c0);
+              elevation.at<float>(r, c) = (1.0f-wr)*((1.0f-wc)*e00 + wc*e01) + wr*((1.0f-wc)*e10 + wc*e11);
+              if (has_normals)
+                elevation_normal.at<cv::Vec3f>(r, c) = cv::normalize(cv::Vec3f((1.0f-wr)*((1.0f-wc)*n00 + wc*n01) + wr*((1.0f-wc)*n10 + wc*n11)));
+            }
+          }
+          continue;
+        }
+
+        // Block with structure or partially observed: Evaluate every cell, that is not part of the coarse grid
+        for (int r = r0; r < r_end; ++r)
+          for (int c = c0; c < c_end; ++c)
+          {
+            if ((r == r0 || r == r1) && (c == c0 || c == c1))
+              continue;
+            computeElevationAtCell(point_cloud, r, c, indices_dists, elevation.at<float>(r, c), elevation_normal.at<cv::Vec3f>(r, c));
+          }
+      }
+  }, m_nrof_threads);
 }
 
-cv::Vec3f DigitalSurfaceModel::interpolateNormal(const std::vector<PlaneFitter::Normal> &normals, const std::vector<double> &dists)
+void DigitalSurfaceModel::rasterizeDepthmap(const cv::Rect2d &roi, const Depthmap::Ptr &depthmap)
 {
-  cv::Vec3f numerator(0.0f, 0.0f, 0.0f);
-  double denominator = 0.0;
-  for (size_t i = 0u; i < dists.size(); ++i)
+  camera::Pinhole::ConstPtr cam = depthmap->getCamera();
+  cv::Mat depth = depthmap->data();
+  if (depth.type() != CV_32F)
+    throw(std::invalid_argument("Error rasterizing depth map: Matrix has wrong type. It is expected to have type CV_32F."));
+
+  cv::Mat R_c2w = cam->R();
+  cv::Mat t_c2w = cam->t();
+  if (R_c2w.empty() || t_c2w.empty())
+    throw(std::invalid_argument("Error rasterizing depth map: Pose of the camera is empty!"));
+
+  double fx = cam->fx();
+  double fy = cam->fy();
+  double cx = cam->cx();
+  double cy = cam->cy();
+  double R[3][3], t[3];
+  for (int r = 0; r < 3; ++r)
+  {
+    for (int c = 0; c < 3; ++c)
+      R[r][c] = R_c2w.at<double>(r, c);
+    t[r] = t_c2w.at<double>(r);
+  }
+
+  // 1) Resolution is the ground footprint of a pixel at median depth, estimated from every 4th pixel in both directions
+  std::vector<float> depth_samples;
+  for (int r = 0; r < depth.rows; r += 4)
+    for (int c = 0; c < depth.cols; c += 4)
+      if (depth.at<float>(r, c) > 0.0f)
+        depth_samples.push_back(depth.at<float>(r, c));
+
+  if (depth_samples.empty())
   {
-    numerator[0] += normals[i].x / dists[i];
-    numerator[1] += normals[i].y / dists[i];
-    numerator[2] += normals[i].z / dists[i];
-    denominator += 1.0 / dists[i];
+    m_surface = std::make_shared<CvGridMap>(roi, 1.0);
+    m_surface->add("elevation", cv::Mat(m_surface->size(), CV_32FC1, std::numeric_limits<float>::quiet_NaN()));
+    return;
   }
-  return cv::normalize(numerator / static_cast<float>(denominator));
+
+  auto median = depth_samples.begin() + depth_samples.size() / 2;
+  std::nth_element(depth_samples.begin(), median, depth_samples.end());
+  m_surface = std::make_shared<CvGridMap>(roi, static_cast<double>(*median) / fx);
+
+  cv::Size2i size = m_surface->size();
+  cv::Rect2d roi_grid = m_surface->roi();
+  double resolution = m_surface->resolution();
+
+  // 2) Grid cell of every pixel, pixels are independent. Cell is -1 for invalid depths and points outside the grid
+  std::vector<int> cell_of_pixel(depth.total());
+  std::vector<float> elevation_of_pixel(depth.total());
+  realm::parallelFor(m_thread_pool, cv::Range(0, depth.rows), [&](const cv::Range &range)
+  {
+    for (int r = range.start; r < range.end; ++r)
+    {
+      const float* depth_row = depth.ptr<float>(r);
+      for (int c = 0; c < depth.cols; ++c)
+      {
+        size_t idx = static_cast<size_t>(r) * depth.cols + c;
+        cell_of_pixel[idx] = -1;
+
+        auto d = static_cast<double>(depth_row[c]);
+        if (d <= 0.0)
+          continue;
+
+        double u = (c - cx) * d / fx;
+        double v = (r - cy) * d / fy;
+        double x = R[0][0]*u + R[0][1]*v + R[0][2]*d + t[0];
+        double y = R[1][0]*u + R[1][1]*v + R[1][2]*d + t[1];
+        double z = R[2][0]*u + R[2][1]*v + R[2][2]*d + t[2];
+
+        auto col = static_cast<int>(std::round((x - roi_grid.x) / resolution));
+        auto row = static_cast<int>(std::round((roi_grid.y + roi_grid.height - y) / resolution));
+        if (col < 0 || col >= size.width || row < 0 || row >= size.height)
+          continue;
+
+        cell_of_pixel[idx] = row * size.width + col;
+        elevation_of_pixel[idx] = static_cast<float>(z);
+      }
+    }
+  }, m_nrof_threads);
+
+  // 3) Accumulation is a single addition per pixel. It is done serially, so no grid per thread has to be merged
+  cv::Mat sum = cv::Mat::zeros(size, CV_64FC1);
+  cv::Mat count = cv::Mat::zeros(size, CV_32SC1);
+  auto sum_data = sum.ptr<double>();
+  auto count_data = count.ptr<int>();
+  for (size_t i = 0; i < cell_of_pixel.size(); ++i)
+  {
+    int cell = cell_of_pixel[i];
+    if (cell < 0)
+      continue;
+    sum_data[cell] += elevation_of_pixel[i];
+    count_data[cell]++;
+  }
+
+  // 4) Mean elevation of every cell. Holes of a single cell, e.g. from the pixel footprint being slightly smaller than
+  //    the resolution, are filled with the mean of their observed neighbours
+  cv::Mat elevation(size, CV_32FC1, std::numeric_limits<float>::quiet_NaN());
+  realm::parallelFor(m_thread_pool, cv::Range(0, size.height), [&](const cv::Range &range)
+  {
+    for (int r = range.start; r < range.end; ++r)
+      for (int c = 0; c < size.width; ++c)
+      {
+        if (count.at<int>(r, c) > 0)
+        {
+          elevation.at<float>(r, c) = static_cast<float>(sum.at<double>(r, c) / count.at<int>(r, c));
+          continue;
+        }
+
+        double sum_neighbours = 0.0;
+        int nrof_neighbours = 0;
+        for (int dr = -1; dr <= 1; ++dr)
+          for (int dc = -1; dc <= 1; ++dc)
+          {
+            int rn = r + dr, cn = c + dc;
+            if (rn < 0 || rn >= size.height || cn < 0 || cn >= size.width || count.at<int>(rn, cn) == 0)
+              continue;
+            sum_neighbours += sum.at<double>(rn, cn) / count.at<int>(rn, cn);
+            nrof_neighbours++;
+          }
+        if (nrof_neighbours >= 4)
+          elevation.at<float>(r, c) = static_cast<float>(sum_neighbours / nrof_neighbours);
+      }
+  }, m_nrof_threads);
+
+  m_surface->add("elevation", elevation);
+
+  if (m_surface_normal_mode != SurfaceNormalMode::NONE)
+    m_surface->add("elevation_normal", computeNormalsFromElevation(elevation));
 }
 
-cv::Vec3f DigitalSurfaceModel::computeSurfaceNormal(const std::vector<PlaneFitter::Point> &points, const std::vector<double> &dists)
+cv::Mat DigitalSurfaceModel::computeNormalsFromElevation(const cv::Mat &elevation)
 {
-  assert(m_surface_normal_mode != SurfaceNormalMode::NONE);
+  double resolution = m_surface->resolution();
+  cv::Mat normals(elevation.size(), CV_32FC3, cv::Scalar(0.0, 0.0, 0.0));
 
-  // Creation of plane fitter
-  PlaneFitter plane_fitter;
+  // Slope between the neighbours in one direction. Unobserved neighbours are NaN and fall back to one-sided differences
+  auto slope = [resolution](float e_minus, float e, float e_plus) -> float
+  {
+    bool has_minus = (e_minus == e_minus);
+    bool has_plus = (e_plus == e_plus);
+    if (has_minus && has_plus)
+      return static_cast<float>((e_plus - e_minus) / (2.0 * resolution));
+    if (has_plus)
+      return static_cast<float>((e_plus - e) / resolution);
+    if (has_minus)
+      return static_cast<float>((e - e_minus) / resolution);
+    return 0.0f;
+  };
+
+  const float kNaN = std::numeric_limits<float>::quiet_NaN();
+  realm::parallelFor(m_thread_pool, cv::Range(0, elevation.rows), [&](const cv::Range &range)
+  {
+    for (int r = range.start; r < range.end; ++r)
+      for (int c = 0; c < elevation.cols; ++c)
+      {
+        float e = elevation.at<float>(r, c);
+        if (e != e)
+          continue;
+
+        // Rows are ordered north to south, so the row above is in positive y-direction
+        float dz_dx = slope(c > 0 ? elevation.at<float>(r, c-1) : kNaN, e,
+                            c < elevation.cols-1 ? elevation.at<float>(r, c+1) : kNaN);
+        float dz_dy = slope(r < elevation.rows-1 ? elevation.at<float>(r+1, c) : kNaN, e,
+                            r > 0 ? elevation.at<float>(r-1, c) : kNaN);
+        normals.at<cv::Vec3f>(r, c) = cv::normalize(cv::Vec3f(-dz_dx, -dz_dy, 1.0f));
+      }
+  }, m_nrof_threads);
 
-  // Vector to save point indices that are used for normal computation
-  std::vector<size_t> indices_points;
-  std::vector<PlaneFitter::Point> points_selected;
+  return normals;
+}
+
+realm::CvGridMap::Ptr DigitalSurfaceModel::getSurfaceGrid()
+{
+  return m_surface;
+}
+
+cv::Vec3f DigitalSurfaceModel::computeSurfaceNormal(const cv::Mat &point_cloud,
+                                                    const std::vector<std::pair<int, double>> &indices_dists)
+{
+  assert(m_surface_normal_mode != SurfaceNormalMode::NONE);
+  assert(indices_dists.size() >= 3);
+
+  // Points are accumulated into the plane fit, no matter how many of them are selected
+  PlaneFitAccumulator<double> plane_fit;
+  auto add_point = [&](size_t i)
+  {
+    const double* p = point_cloud.ptr<double>(indices_dists[i].first);
+    plane_fit.add(p[0], p[1], p[2]);
+  };
 
   switch(m_surface_normal_mode)
   {
@@ -280,51 +605,46 @@ cv::Vec3f DigitalSurfaceModel::computeSurfaceNormal(const std::vector<PlaneFitte
 
     case SurfaceNormalMode::RANDOM_NEIGHBOURS:
       // Select the first three points found
-      indices_points = std::vector<size_t>{0, 1, 2};
-      points_selected = std::vector<PlaneFitter::Point>{
-          points[indices_points[0]],
-          points[indices_points[1]],
-          points[indices_points[2]]};
+      for (size_t i = 0; i < 3; ++i)
+        add_point(i);
       break;
 
     case SurfaceNormalMode::FURTHEST_NEIGHBOURS:
-      // Select furthest points found
-      indices_points = getKmaxElementsIndices(dists, 3);
-      points_selected = std::vector<PlaneFitter::Point>{
-          points[indices_points[0]],
-          points[indices_points[1]],
-          points[indices_points[2]]};
+    {
+      // Select furthest points found, kept sorted descending by distance in a single pass
+      size_t furthest[3]{0, 1, 2};
+      std::sort(furthest, furthest + 3, [&](size_t a, size_t b)
+      {
+        return indices_dists[a].second > indices_dists[b].second;
+      });
+      for (size_t i = 3; i < indices_dists.size(); ++i)
+      {
+        if (indices_dists[i].second <= indices_dists[furthest[2]].second)
+          continue;
+        furthest[2] = i;
+        for (size_t j = 2; j > 0 && indices_dists[furthest[j]].second > indices_dists[furthest[j-1]].second; --j)
+          std::swap(furthest[j], furthest[j-1]);
+      }
+      for (size_t i : furthest)
+        add_point(i);
       break;
+    }
 
     case SurfaceNormalMode::BEST_FIT:
       // All points used for best fit
-      points_selected = points;
+      for (size_t i = 0; i < indices_dists.size(); ++i)
+        add_point(i);
       break;
   }
 
-  // In case of 3 points no best fit is computed -> exact solution
-  PlaneFitter::Plane plane = plane_fitter.estimate(points_selected);
+  // In case of 3 points the fit is the exact solution. Points on a line define no plane, the surface is assumed flat
+  double n[3];
+  if (!plane_fit.estimate(n))
+    return cv::Vec3f(0.0f, 0.0f, 1.0f);
 
   // Ensure surface points up
-  if (plane.n.z < 0)
-    return cv::Vec3f((float)-plane.n.x, (float)-plane.n.y, (float)-plane.n.z);
+  if (n[2] < 0)
+    return cv::Vec3f((float)-n[0], (float)-n[1], (float)-n[2]);
   else
-    return cv::Vec3f((float)plane.n.x, (float)plane.n.y, (float)plane.n.z);
+    return cv::Vec3f((float)n[0], (float)n[1], (float)n[2]);
 }
-
-std::vector<size_t> DigitalSurfaceModel::getKmaxElementsIndices(std::vector<double> vec, size_t k)
-{
-  size_t n = vec.size();
-  if (k == n)
-    return std::vector<size_t>{0, 1, 2};
-  else if(k > n)
-    throw(std::out_of_range("Error computing kMaxElementsIndices: Not enough input values."));
-
-  std::vector<size_t> result; result.reserve(k);
-  std::vector<size_t> indices_sorted = sort_indices(vec);
-
-  for (size_t i = n; n - k < i; --i)
-    result.push_back(indices_sorted[i-1]);
-
-  return result;
-}
\ No newline at end of file
@@ -1,5 +1,8 @@
 
 
+#include <limits>
+#include <map>
+
 #include <realm_ortho/gdal_warper.h>
 
 #include <opencv2/highgui.hpp>
@@ -8,7 +11,8 @@ using namespace realm;
 
 gis::GdalWarper::GdalWarper()
  : m_epsg_target(0),
-   m_nrof_threads(-1)
+   m_nrof_threads(-1),
+   m_zone_source(0)
 {
   GDALAllRegister();
 
@@ -19,6 +23,18 @@ gis::GdalWarper::GdalWarper()
 void gis::GdalWarper::setTargetEPSG(int epsg_code)
 {
   m_epsg_target = epsg_code;
+
+  // Target coordinate system is the same for every warp, so its definition is only created once
+  char *gdal_proj_dst = nullptr;
+  OGRSpatialReference oSRS;
+  gis::initAxisMappingStrategy(&oSRS);
+
+  oSRS.importFromEPSG(m_epsg_target);
+  oSRS.exportToWkt(&gdal_proj_dst);
+  CPLAssert(gdal_proj_dst != NULL && strlen(gdal_proj_dst) > 0);
+
+  m_proj_target = gdal_proj_dst;
+  CPLFree(gdal_proj_dst);
 }
 
 void gis::GdalWarper::setNrofThreads(int nrof_threads)
@@ -38,8 +54,8 @@ CvGridMap::Ptr gis::GdalWarper::warpRaster(const CvGridMap &map, uint8_t zone)
     throw(std::runtime_error("Error warping map: Target EPSG was not set!"));
 
   std::vector<std::string> layer_names = map.getAllLayerNames();
-  if (layer_names.size() > 1)
-    throw(std::invalid_argument("Error warping map: There is more than one layer in the map. This is currently not supported."));
+  if (layer_names.empty())
+    throw(std::invalid_argument("Error warping map: There are no layers in the map."));
 
   //=======================================//
   //
@@ -47,194 +63,175 @@ CvGridMap::Ptr gis::GdalWarper::warpRaster(const CvGridMap &map, uint8_t zone)
   //
   //=======================================//
 
-  // Extract data and metadata
-  cv::Mat data = map[layer_names[0]];
-  io::GDALDatasetMeta* meta = io::computeGDALDatasetMeta(map, zone);
-
-  // Convert the source map into a GDAL dataset
-  GDALDataset* dataset_mem_src;
-  dataset_mem_src = io::generateMemoryDataset(data, *meta);
+  // All layers share the geometry of the map, so they are stacked as bands of one dataset. Bands point directly into
+  // the layer data, so no copies are made. The first band of every layer is stored for mapping the output back.
+  double geoinfo_src[6] = {map.roi().x, map.resolution(), 0.0, map.roi().y + map.roi().height, 0.0, -map.resolution()};
 
-  // Get source coordinate system.
-  const char *gdal_proj_src = GDALGetProjectionRef(dataset_mem_src);
-  CPLAssert(gdal_proj_src != NULL && strlen(gdal_proj_src) > 0);
+  GDALDataset* dataset_mem_src = m_driver->Create("", map.size().width, map.size().height, 0, GDT_Byte, nullptr);
+  dataset_mem_src->SetGeoTransform(geoinfo_src);
+  dataset_mem_src->SetProjection(getProjectionUTM(zone).c_str());
 
-  // Set target coordinate system
-  char *gdal_proj_dst = nullptr;
-  OGRSpatialReference oSRS;
-  gis::initAxisMappingStrategy(&oSRS);
+  std::vector<cv::Mat> data_src;
+  std::vector<int> band_offsets;
+  for (const auto &layer_name : layer_names)
+  {
+    // Bands require a continuous memory layout, which is only copied if necessary
+    cv::Mat data = map[layer_name];
+    if (!data.isContinuous())
+      data = data.clone();
+#ifdef CV_16F
+    // GDAL has no half precision bands, so they are warped in single precision and converted back afterwards
+    if (data.depth() == CV_16F)
+      data.convertTo(data, CV_32F);
+#endif
+    data_src.push_back(data);
+
+    band_offsets.push_back(dataset_mem_src->GetRasterCount());
+    addBands(dataset_mem_src, data);
+  }
 
-  oSRS.importFromEPSG(m_epsg_target);
-  oSRS.exportToWkt(&gdal_proj_dst);
-  CPLAssert(gdal_proj_dst != NULL && strlen(gdal_proj_dst) > 0);
+  const char *gdal_proj_dst = m_proj_target.c_str();
 
-  // Create a transformer that maps from source pixel/line coordinates
-  // to destination georeferenced coordinates (not destination
-  // pixel line).  We do that by omitting the destination dataset
-  // handle (setting it to NULL).
-  void *projector = GDALCreateGenImgProjTransformer(dataset_mem_src, gdal_proj_src, NULL, gdal_proj_dst, FALSE, 0, 1);
-  CPLAssert( projector != NULL );
+  // The same transformer is used to compute the output geometry and to warp. Without a destination geotransform it
+  // maps from source pixel/line coordinates to destination georeferenced coordinates, which is required to get the
+  // approximate output bounds and resolution.
+  void *transformer = GDALCreateGenImgProjTransformer(dataset_mem_src, GDALGetProjectionRef(dataset_mem_src), NULL, gdal_proj_dst, FALSE, 0, 1);
+  if (transformer == nullptr)
+    throw(std::runtime_error("Error warping map: Creating transformer failed!"));
 
-  // Get approximate output georeferenced bounds and resolution for file.
   double geoinfo_target[6];
   int warped_cols = 0, warped_rows = 0;
-  CPLErr eErr = GDALSuggestedWarpOutput(dataset_mem_src, GDALGenImgProjTransform, projector, geoinfo_target, &warped_cols , &warped_rows  );
+  CPLErr eErr = GDALSuggestedWarpOutput(dataset_mem_src, GDALGenImgProjTransform, transformer, geoinfo_target, &warped_cols, &warped_rows);
   CPLAssert( eErr == CE_None );
-  GDALDestroyGenImgProjTransformer(projector);
-
-  // Create the output object.
-  GDALDataset* dataset_mem_dst = m_driver->Create("", warped_cols , warped_rows , data.channels(), meta->datatype, nullptr );
-  CPLAssert( hDstDS != NULL );
-
-  // Write out the projection definition.
-  GDALSetProjection(dataset_mem_dst, gdal_proj_dst);
-  GDALSetGeoTransform(dataset_mem_dst, geoinfo_target);
-
-  CPLFree(gdal_proj_dst);
 
-  //=======================================//
-  //
-  //      Step 3: Prepare warping
-  //
-  //=======================================//
+  // From now on the transformer maps to destination pixel/line coordinates
+  GDALSetGenImgProjTransformerDstGeoTransform(transformer, geoinfo_target);
 
-  double no_data_value;
+  // Create the output object with the same band layout as the source. The bands point directly into the output
+  // matrices, so the warped data does not have to be read back.
+  GDALDataset* dataset_mem_dst = m_driver->Create("", warped_cols, warped_rows, 0, GDT_Byte, nullptr);
 
-  switch(data.type() & CV_MAT_DEPTH_MASK)
+  std::vector<cv::Mat> data_dst;
+  for (const auto &data : data_src)
   {
-    case CV_32F:
-      no_data_value = std::numeric_limits<float>::quiet_NaN();
-      break;
-    case CV_64F:
-      no_data_value = std::numeric_limits<double>::quiet_NaN();
-      break;
-    default:
-      no_data_value = 0.0;
+    data_dst.emplace_back(warped_rows, warped_cols, data.type());
+    addBands(dataset_mem_dst, data_dst.back());
   }
 
-  GDALResampleAlg resample_alg;
-  switch(map.getLayer(layer_names[0]).interpolation)
-  {
-    case cv::INTER_NEAREST:
-      resample_alg = GRA_NearestNeighbour;
-      break;
-    case cv::INTER_LINEAR:
-      resample_alg = GRA_Bilinear;
-      break;
-    case cv::INTER_CUBIC:
-      resample_alg = GRA_Cubic;
-      break;
-    default:
-      resample_alg = GRA_Bilinear;
-  }
+  // Write out the projection definition.
+  GDALSetProjection(dataset_mem_dst, gdal_proj_dst);
+  GDALSetGeoTransform(dataset_mem_dst, geoinfo_target);
 
-  char** warper_system_options = nullptr;
-  warper_system_options = CSLSetNameValue(warper_system_options, "INIT_DEST", "NO_DATA");
-
-  if (m_nrof_threads <= 0)
-    warper_system_options = CSLSetNameValue(warper_system_options, "NUM_THREADS", "ALL_CPUS");
-  else
-    warper_system_options = CSLSetNameValue(warper_system_options, "NUM_THREADS", std::to_string(m_nrof_threads).c_str());
-
-  // Setup warp options.
-  GDALWarpOptions *warper_options = GDALCreateWarpOptions();
-  warper_options->eResampleAlg = resample_alg;
-  warper_options->papszWarpOptions = warper_system_options;
-  warper_options->padfSrcNoDataReal = new double(no_data_value);
-  warper_options->padfDstNoDataReal = new double(no_data_value);
-  warper_options->hSrcDS = dataset_mem_src;
-  warper_options->hDstDS = dataset_mem_dst;
-  warper_options->nBandCount = 0;
-  warper_options->nSrcAlphaBand = (data.channels() == 4 ? data.channels() : 0);
-  warper_options->nDstAlphaBand = (data.channels() == 4 ? data.channels() : 0);
-
-  // Establish reprojection transformer.
-  warper_options->pTransformerArg = GDALCreateGenImgProjTransformer(
-                                       dataset_mem_src,
-                                       GDALGetProjectionRef(dataset_mem_src),
-                                       dataset_mem_dst,
-                                       GDALGetProjectionRef(dataset_mem_dst),
-                                       FALSE, 0.0, 1 );
-
-  warper_options->pfnTransformer = GDALGenImgProjTransform;
+  // Scanlines are transformed exactly at a few points and interpolated in between with an error below an eighth of a
+  // pixel, which is the default of gdalwarp as well
+  void *transformer_approx = GDALCreateApproxTransformer(GDALGenImgProjTransform, transformer, 0.125);
 
   //=======================================//
   //
-  //      Step 4: Warping
+  //      Step 3: Warping
   //
   //=======================================//
 
-  GDALWarpOperation warping;
-  warping.Initialize(warper_options);
-  warping.ChunkAndWarpImage(0, 0, GDALGetRasterXSize(dataset_mem_dst), GDALGetRasterYSize(dataset_mem_dst));
-
-  int raster_cols = dataset_mem_dst->GetRasterXSize();
-  int raster_rows = dataset_mem_dst->GetRasterYSize();
-  int raster_channels = dataset_mem_dst->GetRasterCount();
-
-  int single_channel_type;
-  switch(data.type() & CV_MAT_DEPTH_MASK)
+  // Resampling and alpha bands are options of the whole warp operation. Layers with the same interpolation are
+  // therefore warped together, layers with an alpha channel on their own, so it does not mask the other layers.
+  std::map<std::pair<int, int>, std::vector<size_t>> layer_groups;
+  for (size_t i = 0; i < layer_names.size(); ++i)
   {
-    case CV_8U:
-      single_channel_type = CV_8UC1;
-      break;
-    case CV_16U:
-      single_channel_type = CV_16UC1;
-      break;
-    case CV_32F:
-      single_channel_type = CV_32FC1;
-      break;
-    case CV_64F:
-      single_channel_type = CV_64FC1;
-      break;
+    const CvGridMap::Layer &layer = map.getLayer(layer_names[i]);
+    int group_alpha = (layer.data.channels() == 4 ? static_cast<int>(i) : -1);
+    layer_groups[{layer.interpolation, group_alpha}].push_back(i);
   }
 
-  std::vector<cv::Mat> warped_data_split;
-  for(int i = 1; i <= raster_channels; ++i)
+  for (const auto &layer_group : layer_groups)
   {
-    // Save the channel in var not in the vector of Mat
-    cv::Mat bckVar(raster_rows, raster_cols, single_channel_type);
+    bool has_alpha = (layer_group.first.second >= 0);
 
-    GDALRasterBand *band = dataset_mem_dst->GetRasterBand(i);
-    band->SetNoDataValue(no_data_value);
+    std::vector<int> bands;
+    std::vector<double> no_data_values;
+    int band_alpha = 0;
+    for (size_t idx : layer_group.second)
+    {
+      const cv::Mat &data = map[layer_names[idx]];
+      int nrof_bands = (has_alpha ? 3 : data.channels());
+      for (int i = 1; i <= nrof_bands; ++i)
+      {
+        bands.push_back(band_offsets[idx] + i);
+        no_data_values.push_back(getNoDataValue(data.type()));
+      }
+      if (has_alpha)
+        band_alpha = band_offsets[idx] + 4;
+    }
 
-    eErr = band->RasterIO(GF_Read, 0, 0, raster_cols, raster_rows, bckVar.data, raster_cols, raster_rows, band->GetRasterDataType(), 0, 0);
-    CPLAssert( eErr == CE_None );
+    char** warper_system_options = nullptr;
+    warper_system_options = CSLSetNameValue(warper_system_options, "INIT_DEST", "NO_DATA");
+
+    if (m_nrof_threads <= 0)
+      warper_system_options = CSLSetNameValue(warper_system_options, "NUM_THREADS", "ALL_CPUS");
+    else
+      warper_system_options = CSLSetNameValue(warper_system_options, "NUM_THREADS", std::to_string(m_nrof_threads).c_str());
+
+    // Setup warp options. Arrays are allocated with CPLMalloc, because they are freed by GDALDestroyWarpOptions.
+    GDALWarpOptions *warper_options = GDALCreateWarpOptions();
+    warper_options->eResampleAlg = getResampleAlg(layer_group.first.first);
+    warper_options->papszWarpOptions = warper_system_options;
+    warper_options->hSrcDS = dataset_mem_src;
+    warper_options->hDstDS = dataset_mem_dst;
+    warper_options->nBandCount = static_cast<int>(bands.size());
+    warper_options->panSrcBands = static_cast<int*>(CPLMalloc(sizeof(int) * bands.size()));
+    warper_options->panDstBands = static_cast<int*>(CPLMalloc(sizeof(int) * bands.size()));
+    warper_options->padfSrcNoDataReal = static_cast<double*>(CPLMalloc(sizeof(double) * bands.size()));
+    warper_options->padfDstNoDataReal = static_cast<double*>(CPLMalloc(sizeof(double) * bands.size()));
+    for (size_t i = 0; i < bands.size(); ++i)
+    {
+      warper_options->panSrcBands[i] = bands[i];
+      warper_options->panDstBands[i] = bands[i];
+      warper_options->padfSrcNoDataReal[i] = no_data_values[i];
+      warper_options->padfDstNoDataReal[i] = no_data_values[i];
+    }
+    warper_options->nSrcAlphaBand = band_alpha;
+    warper_options->nDstAlphaBand = band_alpha;
+    warper_options->pTransformerArg = transformer_approx;
+    warper_options->pfnTransformer = GDALApproxTransform;
 
-    fixGdalNoData(bckVar);
+    GDALWarpOperation warping;
+    warping.Initialize(warper_options);
+    warping.ChunkAndWarpImage(0, 0, GDALGetRasterXSize(dataset_mem_dst), GDALGetRasterYSize(dataset_mem_dst));
 
-    warped_data_split.push_back(bckVar);
+    // Transformer is not owned by the options and still needed by the following groups
+    GDALDestroyWarpOptions(warper_options);
   }
 
-  cv::Mat warped_data;
-  cv::merge(warped_data_split, warped_data);
+  GDALDestroyApproxTransformer(transformer_approx);
+  GDALDestroyGenImgProjTransformer(transformer);
 
-  GDALDestroyGenImgProjTransformer(warper_options->pTransformerArg );
-  GDALDestroyWarpOptions(warper_options );
-  delete meta;
+  // Bands reference the matrices, so the datasets must be closed before
+  GDALClose(dataset_mem_dst);
+  GDALClose(dataset_mem_src);
 
   //=======================================//
   //
-  //      Step 5: Compute output
+  //      Step 4: Compute output
   //
   //=======================================//
 
-  double warped_geoinfo[6];
-  dataset_mem_dst->GetGeoTransform(warped_geoinfo);
-
-  double warped_resolution = warped_geoinfo[1];
+  double warped_resolution = geoinfo_target[1];
 
   cv::Rect2d warped_roi;
-  warped_roi.x = warped_geoinfo[0];
-  warped_roi.y = warped_geoinfo[3] - warped_data.rows * warped_resolution;
-  warped_roi.width = warped_data.cols * warped_resolution - warped_resolution;
-  warped_roi.height = warped_data.rows * warped_resolution - warped_resolution;
+  warped_roi.x = geoinfo_target[0];
+  warped_roi.y = geoinfo_target[3] - warped_rows * warped_resolution;
+  warped_roi.width = warped_cols * warped_resolution - warped_resolution;
+  warped_roi.height = warped_rows * warped_resolution - warped_resolution;
 
   auto output = std::make_shared<CvGridMap>(warped_roi, warped_resolution);
-  output->add(layer_names[0], warped_data, map.getLayer(layer_names[0]).interpolation);
 
-  GDALClose(dataset_mem_dst);
-  GDALClose(dataset_mem_src);
+  for (size_t idx = 0; idx < layer_names.size(); ++idx)
+  {
+    fixGdalNoData(data_dst[idx]);
+    const cv::Mat &data = map[layer_names[idx]];
+    if (data_dst[idx].type() != data.type())
+      data_dst[idx].convertTo(data_dst[idx], data.type());
+    output->add(layer_names[idx], data_dst[idx], map.getLayer(layer_names[idx]).interpolation);
+  }
 
   return output;
 }
@@ -333,6 +330,93 @@ void gis::GdalWarper::warpPoints()
     coordinate_transformation->Transform(1, &x, &y);*/
 }
 
+void gis::GdalWarper::addBands(GDALDataset* dataset, const cv::Mat &data)
+{
+  GDALDataType datatype = getGdalDataType(data.type());
+
+  // Channels are interleaved, so every band starts at its channel offset and steps over all channels
+  for (int i = 0; i < data.channels(); ++i)
+  {
+    char pointer[64];
+    int length = CPLPrintPointer(pointer, const_cast<uchar*>(data.data) + i * data.elemSize1(), sizeof(pointer) - 1);
+    pointer[length] = '\0';
+
+    char** options = nullptr;
+    options = CSLSetNameValue(options, "DATAPOINTER", pointer);
+    options = CSLSetNameValue(options, "PIXELOFFSET", std::to_string(data.elemSize()).c_str());
+    options = CSLSetNameValue(options, "LINEOFFSET", std::to_string(data.step[0]).c_str());
+    CPLErr error_code = dataset->AddBand(datatype, options);
+    CSLDestroy(options);
+
+    if (error_code != CE_None)
+      throw(std::runtime_error("Error warping map: Adding band to memory dataset failed!"));
+  }
+}
+
+const std::string& gis::GdalWarper::getProjectionUTM(uint8_t zone)
+{
+  // Consecutive frames are almost always in the same zone, so the definition is only created when it changes
+  if (zone != m_zone_source || m_proj_source.empty())
+  {
+    char *gdal_proj_src = nullptr;
+    OGRSpatialReference oSRS;
+    gis::initAxisMappingStrategy(&oSRS);
+    oSRS.SetUTM(zone, TRUE);
+    oSRS.SetWellKnownGeogCS("WGS84");
+    oSRS.exportToWkt(&gdal_proj_src);
+
+    m_proj_source = gdal_proj_src;
+    m_zone_source = zone;
+    CPLFree(gdal_proj_src);
+  }
+  return m_proj_source;
+}
+
+GDALDataType gis::GdalWarper::getGdalDataType(int type)
+{
+  switch(type & CV_MAT_DEPTH_MASK)
+  {
+    case CV_8U:
+      return GDT_Byte;
+    case CV_16U:
+      return GDT_UInt16;
+    case CV_32F:
+      return GDT_Float32;
+    case CV_64F:
+      return GDT_Float64;
+    default:
+      throw(std::invalid_argument("Error warping map: Layer type not supported!"));
+  }
+}
+
+double gis::GdalWarper::getNoDataValue(int type)
+{
+  switch(type & CV_MAT_DEPTH_MASK)
+  {
+    case CV_32F:
+      return std::numeric_limits<float>::quiet_NaN();
+    case CV_64F:
+      return std::numeric_limits<double>::quiet_NaN();
+    default:
+      return 0.0;
+  }
+}
+
+GDALResampleAlg gis::GdalWarper::getResampleAlg(int interpolation)
+{
+  switch(interpolation)
+  {
+    case cv::INTER_NEAREST:
+      return GRA_NearestNeighbour;
+    case cv::INTER_LINEAR:
+      return GRA_Bilinear;
+    case cv::INTER_CUBIC:
+      return GRA_Cubic;
+    default:
+      return GRA_Bilinear;
+  }
+}
+
 void gis::GdalWarper::fixGdalNoData(cv::Mat &data)
 {
   if (data.type() == CV_32F)
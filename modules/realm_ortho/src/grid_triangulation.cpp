@@ -0,0 +1,155 @@
+
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <realm_ortho/grid_triangulation.h>
+
+using namespace realm;
+
+GridTriangulation::GridTriangulation(int max_level, double max_deviation, int nrof_threads, const ThreadPool::Ptr &thread_pool)
+    : m_max_level(std::max(max_level, 0)),
+      m_max_deviation(max_deviation),
+      m_nrof_threads(nrof_threads),
+      m_thread_pool(thread_pool)
+{
+}
+
+std::vector<cv::Point2i> GridTriangulation::buildMesh(const CvGridMap &grid,
+                                                      const std::string &mask,
+                                                      const std::string &layer_elevation) const
+{
+  cv::Size size = grid.size();
+
+  cv::Mat valid;
+  if (mask.empty())
+    valid = cv::Mat(size, CV_8UC1, cv::Scalar(255));
+  else
+    valid = grid[mask].clone();
+
+  cv::Mat elevation;
+  if (!layer_elevation.empty() && grid.exists(layer_elevation))
+  {
+    elevation = grid[layer_elevation];
+    if (elevation.type() != CV_32FC1)
+      elevation.convertTo(elevation, CV_32FC1);
+
+    // NaN compares unequal to itself
+    valid &= (elevation == elevation);
+  }
+
+  if (size.width < 2 || size.height < 2)
+    return std::vector<cv::Point2i>();
+
+  // Root blocks of the quadtree cover the quads of the grid, blocks reaching over the border are split until their
+  // quads are inside
+  int block_size = 1 << (elevation.empty() ? 0 : m_max_level);
+  int nrof_quads_rows = size.height - 1;
+  int nrof_quads_cols = size.width - 1;
+  int nrof_block_rows = (nrof_quads_rows + block_size - 1) / block_size;
+  int nrof_block_cols = (nrof_quads_cols + block_size - 1) / block_size;
+
+  // Every row of blocks is triangulated independently, results are concatenated in order to be deterministic
+  std::vector<std::vector<cv::Point2i>> vertex_ids_rows(static_cast<size_t>(nrof_block_rows));
+  parallelFor(m_thread_pool, cv::Range(0, nrof_block_rows), [&](const cv::Range &range)
+  {
+    for (int br = range.start; br < range.end; ++br)
+    {
+      std::vector<cv::Point2i> &vertex_ids = vertex_ids_rows[br];
+      vertex_ids.reserve(static_cast<size_t>(block_size) * nrof_quads_cols * 6);
+      for (int bc = 0; bc < nrof_block_cols; ++bc)
+        triangulateBlock(valid, elevation, br * block_size, bc * block_size, block_size, vertex_ids);
+    }
+  }, m_nrof_threads);
+
+  size_t nrof_vertex_ids = 0;
+  for (const auto &vertex_ids : vertex_ids_rows)
+    nrof_vertex_ids += vertex_ids.size();
+
+  std::vector<cv::Point2i> vertex_ids;
+  vertex_ids.reserve(nrof_vertex_ids);
+  for (const auto &vertex_ids_row : vertex_ids_rows)
+    vertex_ids.insert(vertex_ids.end(), vertex_ids_row.begin(), vertex_ids_row.end());
+  return vertex_ids;
+}
+
+void GridTriangulation::triangulateBlock(const cv::Mat &valid, const cv::Mat &elevation, int r, int c, int size,
+                                         std::vector<cv::Point2i> &vertex_ids) const
+{
+  if (r >= valid.rows - 1 || c >= valid.cols - 1)
+    return;
+
+  if (size == 1)
+  {
+    // Corners of the quad counter clockwise seen from above, rows are pointing south: SW, SE, NE, NW
+    const cv::Point2i ring[4] = {cv::Point2i(c, r + 1), cv::Point2i(c + 1, r + 1), cv::Point2i(c + 1, r), cv::Point2i(c, r)};
+
+    int nrof_valid = 0;
+    cv::Point2i corners[4];
+    for (const auto &pt : ring)
+      if (valid.at<uchar>(pt.y, pt.x) > 0)
+        corners[nrof_valid++] = pt;
+
+    if (nrof_valid == 4)
+    {
+      vertex_ids.insert(vertex_ids.end(), {corners[0], corners[1], corners[2]});
+      vertex_ids.insert(vertex_ids.end(), {corners[0], corners[2], corners[3]});
+    }
+    else if (nrof_valid == 3)
+      vertex_ids.insert(vertex_ids.end(), {corners[0], corners[1], corners[2]});
+    return;
+  }
+
+  if (isBlockFlat(valid, elevation, r, c, size))
+  {
+    // Fan around the centre with every vertex of the border, so neighbouring finer blocks share all edges
+    cv::Point2i centre(c + size / 2, r + size / 2);
+
+    std::vector<cv::Point2i> border;
+    border.reserve(static_cast<size_t>(4 * size));
+    for (int i = 0; i < size; ++i)
+      border.emplace_back(c + i, r + size);
+    for (int i = 0; i < size; ++i)
+      border.emplace_back(c + size, r + size - i);
+    for (int i = 0; i < size; ++i)
+      border.emplace_back(c + size - i, r);
+    for (int i = 0; i < size; ++i)
+      border.emplace_back(c, r + i);
+
+    for (size_t i = 0; i < border.size(); ++i)
+      vertex_ids.insert(vertex_ids.end(), {centre, border[i], border[(i + 1) % border.size()]});
+    return;
+  }
+
+  int half = size / 2;
+  triangulateBlock(valid, elevation, r, c, half, vertex_ids);
+  triangulateBlock(valid, elevation, r, c + half, half, vertex_ids);
+  triangulateBlock(valid, elevation, r + half, c, half, vertex_ids);
+  triangulateBlock(valid, elevation, r + half, c + half, half, vertex_ids);
+}
+
+bool GridTriangulation::isBlockFlat(const cv::Mat &valid, const cv::Mat &elevation, int r, int c, int size) const
+{
+  // Blocks reaching over the border of the grid are always split
+  if (elevation.empty() || r + size >= valid.rows || c + size >= valid.cols)
+    return false;
+
+  float ele_min = std::numeric_limits<float>::max();
+  float ele_max = std::numeric_limits<float>::lowest();
+  for (int i = r; i <= r + size; ++i)
+  {
+    const auto* valid_row = valid.ptr<uchar>(i);
+    const auto* elevation_row = elevation.ptr<float>(i);
+    for (int j = c; j <= c + size; ++j)
+    {
+      if (valid_row[j] == 0)
+        return false;
+      ele_min = std::min(ele_min, elevation_row[j]);
+      ele_max = std::max(ele_max, elevation_row[j]);
+    }
+    if (ele_max - ele_min > m_max_deviation)
+      return false;
+  }
+  return true;
+}
@@ -1,5 +1,8 @@
 
 
+#include <algorithm>
+
+#include <realm_core/projection.h>
 #include <realm_ortho/map_tiler.h>
 
 using namespace realm;
@@ -7,33 +10,31 @@ using namespace realm;
 MapTiler::MapTiler(bool verbosity)
     : m_verbosity(verbosity),
       m_zoom_level_min(11),
-      m_zoom_level_max(35),
-      m_tile_size(256)
+      m_zoom_level_max(kNrofZoomLevels)
 {
-  m_origin_shift = 2 * M_PI * 6378137 / 2.0;
+  m_origin_shift = M_PI * gis::projection::wgs84_a;
 
   // Setup lookup table for zoom level resolution
-  for (int i = 0; i < m_zoom_level_max; ++i)
-  {
-    m_lookup_nrof_tiles_from_zoom[i] = std::pow(2, i);
-  }
-
   computeLookupResolutionFromZoom();
 }
 
-double MapTiler::getResolution(int zoom_level)
+constexpr int MapTiler::kNrofZoomLevels;
+
+void MapTiler::checkZoomLevel(int zoom_level)
 {
-  auto it = m_lookup_resolution_from_zoom.find(zoom_level);
-  if (it != m_lookup_resolution_from_zoom.end())
-    return it->second;
-  else
+  if (zoom_level < 0 || zoom_level >= kNrofZoomLevels)
     throw(std::invalid_argument("Error getting resolution for zoom level: Lookup table does not contain key!"));
 }
 
-std::map<int, MapTiler::TiledMap> MapTiler::createTiles(const CvGridMap::Ptr &map, int zoom_level_min, int zoom_level_max)
+double MapTiler::getResolution(int zoom_level) const
+{
+  checkZoomLevel(zoom_level);
+  return m_lookup_resolution_from_zoom[zoom_level];
+}
+
+std::map<int, MapTiler::TiledMap> MapTiler::createTiles(const CvGridMap::Ptr &map, int zoom_level_min, int zoom_level_max,
+                                                        const ThreadPool::Ptr &thread_pool, int nrof_threads)
 {
-  // Set the region of interest before entering the loop, so that even though we transform the map itself the original
-  // boundaries will matter
   cv::Rect2d roi = map->roi();
 
   // Identify the zoom levels we work on
@@ -55,63 +56,223 @@ std::map<int, MapTiler::TiledMap> MapTiler::createTiles(const CvGridMap::Ptr &ma
   // Computation of tiles per zoom level
   std::map<int, TiledMap> tiles_from_zoom;
 
-  for (int zoom_level = zoom_level_max; zoom_level >= zoom_level_min; --zoom_level)
+  // Only the maximum zoom level is resampled from the map
+  double zoom_resolution = getResolution(zoom_level_max);
+
+  LOG_IF_F(INFO, m_verbosity, "Tileing map on zoom level %i, resolution = %4.4f", zoom_level_max, zoom_resolution);
+
+  // First identify how many tiles we have to split our map into by computing the tile indices. With the tile indices
+  // we can compute the exact region of interest in the geographic frame in meters.
+  cv::Rect2i tile_bounds_idx = computeTileBounds(roi, zoom_level_max);
+  cv::Rect2d tile_bounds_meters = computeTileBoundsMeters(tile_bounds_idx, zoom_level_max);
+
+  // The map is resampled directly into a buffer padded to the tile map boundaries, so every layer is allocated once
+  // and the input map is left untouched
+  CvGridMap padded = createPaddedMap(*map, zoom_resolution, tile_bounds_meters);
+  std::vector<std::string> layer_names = padded.getAllLayerNames();
+
+  // Tiles are views into the padded buffer. They are stored with x-direction first and y-direction descending.
+  std::vector<Tile::Ptr> tiles(static_cast<size_t>(tile_bounds_idx.area()));
+  parallelFor(thread_pool, cv::Range(0, tile_bounds_idx.area()), [&](const cv::Range &range)
   {
-    double zoom_resolution = getResolution(zoom_level);
+    for (int i = range.start; i < range.end; ++i)
+    {
+      // Note: Coordinate system of the tiles is up positive, while image is down positive. Therefore the inverse order
+      int x = i / tile_bounds_idx.height;
+      int y = tile_bounds_idx.height - i % tile_bounds_idx.height;
+      cv::Rect2i data_roi(x*Tile::kSize, y*Tile::kSize, Tile::kSize, Tile::kSize);
+      tiles[i] = std::make_shared<Tile>(zoom_level_max, tile_bounds_idx.x + x, tile_bounds_idx.y + tile_bounds_idx.height - y, padded.getSubmap(layer_names, data_roi));
+    }
+  }, nrof_threads);
 
-    LOG_IF_F(INFO, m_verbosity, "Tileing map on zoom level %i, resolution = %4.4f", zoom_level, zoom_resolution);
-    map->changeResolution(zoom_resolution);
+  tiles_from_zoom[zoom_level_max] = TiledMap{tile_bounds_idx, tiles};
 
-    // Map is now in the right coordinate frame and has the correct resolution. It's time to start tileing it
-    // Therefore first identify how many tiles we have to split our map into by computing the tile indices
-    cv::Rect2i tile_bounds_idx = computeTileBounds(roi, zoom_level);
+  // Lower zoom levels are downsampled from the tiles of the previous one, every parent tile independently
+  for (int zoom_level = zoom_level_max - 1; zoom_level >= zoom_level_min; --zoom_level)
+  {
+    LOG_IF_F(INFO, m_verbosity, "Tileing map on zoom level %i, resolution = %4.4f", zoom_level, getResolution(zoom_level));
+    tiles_from_zoom[zoom_level] = createParentTiles(tiles_from_zoom[zoom_level + 1], zoom_level, layer_names, thread_pool, nrof_threads);
+  }
+
+  return tiles_from_zoom;
+}
+
+MapTiler::TiledMap MapTiler::createParentTiles(const TiledMap &children, int zoom_level,
+                                               const std::vector<std::string> &layer_names,
+                                               const ThreadPool::Ptr &thread_pool, int nrof_threads)
+{
+  const cv::Rect2i &roi_children = children.roi;
+
+  // Parents of the tiles (x, y) are (x/2, y/2), indices are never negative
+  cv::Rect2i roi;
+  roi.x = roi_children.x / 2;
+  roi.y = roi_children.y / 2;
+  roi.width = (roi_children.x + roi_children.width - 1) / 2 - roi.x + 1;
+  roi.height = (roi_children.y + roi_children.height - 1) / 2 - roi.y + 1;
+
+  // Children are stored with x-direction first and y-direction descending (see createTiles)
+  auto find_child = [&](int tx, int ty) -> Tile::Ptr
+  {
+    int x = tx - roi_children.x;
+    int y = roi_children.y + roi_children.height - 1 - ty;
+    if (x < 0 || x >= roi_children.width || y < 0 || y >= roi_children.height)
+      return nullptr;
+    return children.tiles[static_cast<size_t>(x*roi_children.height + y)];
+  };
+
+  std::vector<Tile::Ptr> tiles(static_cast<size_t>(roi.area()));
+  parallelFor(thread_pool, cv::Range(0, roi.area()), [&](const cv::Range &range)
+  {
+    for (int i = range.start; i < range.end; ++i)
+    {
+      int tx = roi.x + i / roi.height;
+      int ty = roi.y + roi.height - 1 - i % roi.height;
+
+      std::vector<Tile::Ptr> tiles_child;
+      for (int dx = 0; dx < 2; ++dx)
+        for (int dy = 0; dy < 2; ++dy)
+        {
+          Tile::Ptr child = find_child(2*tx + dx, 2*ty + dy);
+          if (child)
+            tiles_child.push_back(child);
+        }
+      tiles[i] = createParentTile(zoom_level, tx, ty, tiles_child, layer_names);
+    }
+  }, nrof_threads);
 
-    // With the tile indices we can compute the exact region of interest in the geographic frame in meters
-    cv::Rect2d tile_bounds_meters = computeTileBoundsMeters(tile_bounds_idx, zoom_level);
+  return TiledMap{roi, tiles};
+}
+
+CvGridMap MapTiler::createPaddedMap(const CvGridMap &map, double resolution, const cv::Rect2d &roi_padded) const
+{
+  // Geometry of the map at the new resolution and after the extension to the padded region, exactly as computed by
+  // changeResolution(...) and extendToInclude(...) of the map itself
+  CvGridMap resampled(map.roi(), resolution);
+  CvGridMap padded(resampled.roi(), resolution);
+  padded.extendToInclude(roi_padded);
+
+  cv::Rect2d roi_resampled = resampled.roi();
+  cv::Rect2d roi_set = padded.roi();
+  int offset_x = std::max(static_cast<int>(std::round((roi_resampled.x - roi_set.x) / resolution)), 0);
+  int offset_y = std::max(static_cast<int>(std::round((roi_set.y + roi_set.height - (roi_resampled.y + roi_resampled.height)) / resolution)), 0);
+
+  cv::Rect2i data_roi(cv::Point2i(offset_x, offset_y), resampled.size());
+  if ((data_roi & cv::Rect2i(cv::Point2i(0, 0), padded.size())) != data_roi)
+    throw(std::runtime_error("Error computing tiles: Resampled map exceeds the padded tile boundaries."));
+
+  for (const auto &layer_name : map.getAllLayerNames())
+  {
+    CvGridMap::Layer layer = map.getLayer(layer_name);
+    if (layer.data.empty())
+      continue;
 
-    // Because our map is not yet guaranteed to have exactly the size of the tile region, we have to perform padding to
-    // to fit exactly the tile map boundaries
-    map->extendToInclude(tile_bounds_meters);
+    cv::Mat data = CvGridMap::createEmptyData(padded.size(), layer.data.type());
 
-    std::vector<Tile::Ptr> tiles;
-    for (int x = 0; x < tile_bounds_idx.width; ++x)
-      // Note: Coordinate system of the tiles is up positive, while image is down positive. Therefore the inverse loop
-      for (int y = tile_bounds_idx.height; y > 0; --y)
+    // Resizing into the region of the padded buffer writes in place, as size and type already match
+    cv::Mat data_resampled = data(data_roi);
+    if (layer.data.size() != data_resampled.size())
+      CvGridMap::resizeData(layer.data, data_resampled, data_resampled.size(), layer.interpolation);
+    else
+      layer.data.copyTo(data_resampled);
+
+    padded.add(layer.name, data, layer.interpolation);
+  }
+
+  return padded;
+}
+
+Tile::Ptr MapTiler::createParentTile(int zoom_level, int tx, int ty, const std::vector<Tile::Ptr> &children,
+                                     const std::vector<std::string> &layer_names)
+{
+  if (children.empty())
+    throw(std::invalid_argument("Error creating parent tile: No children provided."));
+
+  double zoom_resolution = getResolution(zoom_level);
+
+  // The grid has one sample per pixel, so it is one resolution smaller than the tile bounds (see CvGridMap)
+  cv::Rect2d tile_bounds_meters = computeTileBoundsMeters(tx, ty, zoom_level);
+  tile_bounds_meters.width -= zoom_resolution;
+  tile_bounds_meters.height -= zoom_resolution;
+  CvGridMap map(tile_bounds_meters, zoom_resolution);
+
+  // Every child is downsampled directly into its quadrant of the parent. For the 2x2 downsampling the samples of a
+  // quadrant only depend on its child, so the children do not have to be composed at their own resolution first.
+  const int size_quadrant = Tile::kSize / 2;
+
+  for (const auto &layer_name : layer_names)
+  {
+    int interpolation = cv::INTER_LINEAR;
+
+    cv::Mat data;
+    for (const auto &child : children)
+    {
+      if (!child->data()->exists(layer_name))
+        continue;
+
+      CvGridMap::Layer layer = child->data()->getLayer(layer_name);
+      if (layer.data.empty())
+        continue;
+
+      if (data.empty())
       {
-        cv::Rect2i data_roi(x*256, y*256, 256, 256);
-        Tile::Ptr tile_current = std::make_shared<Tile>(zoom_level, tile_bounds_idx.x + x, tile_bounds_idx.y + tile_bounds_idx.height - y, map->getSubmap(map->getAllLayerNames(), data_roi));
-        tiles.push_back(tile_current);
+        interpolation = layer.interpolation;
+        data = CvGridMap::createEmptyData(map.size(), layer.data.type());
       }
 
-    tiles_from_zoom[zoom_level] = TiledMap{tile_bounds_idx, tiles};
+      int dx = child->x() - 2*tx;
+      int dy = child->y() - 2*ty;
+      if (dx < 0 || dx > 1 || dy < 0 || dy > 1)
+        throw(std::invalid_argument("Error creating parent tile: Tile is not a child."));
+
+      // Northern children are in the upper rows
+      cv::Rect2i roi_quadrant(dx*size_quadrant, (1 - dy)*size_quadrant, size_quadrant, size_quadrant);
+      cv::Mat data_quadrant = data(roi_quadrant);
+      CvGridMap::resizeData(layer.data, data_quadrant, roi_quadrant.size(), interpolation);
+    }
+
+    if (data.empty())
+      continue;
+
+    map.add(layer_name, data, interpolation);
   }
 
-  return tiles_from_zoom;
+  return std::make_shared<Tile>(zoom_level, tx, ty, map);
 }
 
 void MapTiler::computeLookupResolutionFromZoom(double latitude)
 {
-  for (int i = 0; i < m_zoom_level_max; ++i)
+  for (int i = 0; i < kNrofZoomLevels; ++i)
   {
     m_lookup_resolution_from_zoom[i] = computeZoomResolution(i, latitude);
+    m_lookup_resolution_inv_from_zoom[i] = 1.0 / m_lookup_resolution_from_zoom[i];
   }
 }
 
 cv::Point2i MapTiler::computeTileFromLatLon(double lat, double lon, int zoom_level) const
 {
-  double lat_rad = lat * M_PI / 180.0;
-  auto n = static_cast<double>(m_lookup_nrof_tiles_from_zoom.at(zoom_level));
+  checkZoomLevel(zoom_level);
+  auto n = static_cast<double>(computeNrofTiles(zoom_level));
+  cv::Point2d meters = computeMetersFromLatLon(lat, lon);
 
+  // Slippy tiles are counted from the north west corner of the Web Mercator frame
   cv::Point2i pos;
-  pos.x = static_cast<int>(std::floor((lon + 180.0) / 360.0 * n));
-  pos.y = static_cast<int>(std::floor((1.0 - asinh(tan(lat_rad)) / M_PI) / 2.0 * n));
+  pos.x = static_cast<int>(std::floor((meters.x + m_origin_shift) / (2.0 * m_origin_shift) * n));
+  pos.y = static_cast<int>(std::floor((m_origin_shift - meters.y) / (2.0 * m_origin_shift) * n));
   return pos;
 }
 
+cv::Point2d MapTiler::computeMetersFromLatLon(double lat, double lon) const
+{
+  cv::Point2d meters;
+  gis::projection::projectToWebMercator(lat, lon, meters.x, meters.y);
+  return meters;
+}
+
 cv::Point2d MapTiler::computeMetersFromPixels(int px, int py, int zoom_level)
 {
+  checkZoomLevel(zoom_level);
   cv::Point2d meters;
-  double resolution = m_lookup_resolution_from_zoom.at(zoom_level);
+  double resolution = m_lookup_resolution_from_zoom[zoom_level];
   meters.x = px * resolution - m_origin_shift;
   meters.y = py * resolution - m_origin_shift;
   return meters;
@@ -119,18 +280,19 @@ cv::Point2d MapTiler::computeMetersFromPixels(int px, int py, int zoom_level)
 
 cv::Point2i MapTiler::computePixelsFromMeters(double mx, double my, int zoom_level)
 {
+  checkZoomLevel(zoom_level);
   cv::Point2i pixels;
-  double resolution = m_lookup_resolution_from_zoom.at(zoom_level);
-  pixels.x = (mx + m_origin_shift) / resolution;
-  pixels.y = (my + m_origin_shift) / resolution;
+  double resolution_inv = m_lookup_resolution_inv_from_zoom[zoom_level];
+  pixels.x = (mx + m_origin_shift) * resolution_inv;
+  pixels.y = (my + m_origin_shift) * resolution_inv;
   return pixels;
 }
 
 cv::Point2i MapTiler::computeTileFromPixels(int px, int py, int zoom_level)
 {
   cv::Point2i tile;
-  tile.x = int(std::ceil(px / (double)(m_tile_size)) - 1);
-  tile.y = int(std::ceil(py / (double)(m_tile_size)) - 1);
+  tile.x = int(std::ceil(px / (double)(Tile::kSize)) - 1);
+  tile.y = int(std::ceil(py / (double)(Tile::kSize)) - 1);
   return tile;
 }
 
@@ -148,10 +310,33 @@ cv::Rect2i MapTiler::computeTileBounds(const cv::Rect2d &roi, int zoom_level)
   return cv::Rect2i(tile_idx_low.x, tile_idx_low.y, tile_idx_high.x - tile_idx_low.x + 1, tile_idx_high.y - tile_idx_low.y + 1);
 }
 
+std::vector<cv::Rect2i> MapTiler::computeTileBounds(const cv::Rect2d &roi, int zoom_level_min, int zoom_level_max)
+{
+  checkZoomLevel(zoom_level_min);
+  checkZoomLevel(zoom_level_max);
+
+  std::vector<cv::Rect2i> tile_bounds;
+  tile_bounds.reserve(static_cast<size_t>(std::max(zoom_level_max - zoom_level_min + 1, 0)));
+
+  // Same as computeTileBounds(roi, zoom_level), but the corners are shifted into the pixel frame only once
+  double x_low = roi.x + m_origin_shift;
+  double y_low = roi.y + m_origin_shift;
+  double x_high = roi.x + roi.width + m_origin_shift;
+  double y_high = roi.y + roi.height + m_origin_shift;
+  for (int zoom_level = zoom_level_min; zoom_level <= zoom_level_max; ++zoom_level)
+  {
+    double resolution_inv = m_lookup_resolution_inv_from_zoom[zoom_level];
+    cv::Point2i tile_idx_low = computeTileFromPixels(static_cast<int>(x_low * resolution_inv), static_cast<int>(y_low * resolution_inv), zoom_level);
+    cv::Point2i tile_idx_high = computeTileFromPixels(static_cast<int>(x_high * resolution_inv), static_cast<int>(y_high * resolution_inv), zoom_level);
+    tile_bounds.emplace_back(tile_idx_low.x, tile_idx_low.y, tile_idx_high.x - tile_idx_low.x + 1, tile_idx_high.y - tile_idx_low.y + 1);
+  }
+  return tile_bounds;
+}
+
 cv::Rect2d MapTiler::computeTileBoundsMeters(int tx, int ty, int zoom_level)
 {
-  cv::Point2d p_min = computeMetersFromPixels(tx * m_tile_size, ty * m_tile_size, zoom_level);
-  cv::Point2d p_max = computeMetersFromPixels((tx + 1) * m_tile_size, (ty + 1) * m_tile_size, zoom_level);
+  cv::Point2d p_min = computeMetersFromPixels(tx * Tile::kSize, ty * Tile::kSize, zoom_level);
+  cv::Point2d p_max = computeMetersFromPixels((tx + 1) * Tile::kSize, (ty + 1) * Tile::kSize, zoom_level);
   return cv::Rect2d(p_min.x, p_min.y, p_max.x - p_min.x, p_max.y - p_min.y);
 }
 
@@ -164,13 +349,13 @@ cv::Rect2d MapTiler::computeTileBoundsMeters(const cv::Rect2i &idx_roi, int zoom
 
 WGSPose MapTiler::computeLatLonForTile(int x, int y, int zoom_level) const
 {
-  auto n = static_cast<double>(m_lookup_nrof_tiles_from_zoom.at(zoom_level));
-  double k = M_PI - 2.0 * M_PI * y / n;
+  checkZoomLevel(zoom_level);
+  auto n = static_cast<double>(computeNrofTiles(zoom_level));
+  double mx = x / n * 2.0 * m_origin_shift - m_origin_shift;
+  double my = m_origin_shift - y / n * 2.0 * m_origin_shift;
 
   WGSPose wgs{};
-  wgs.latitude = 180.0 / M_PI * atan(0.5 * (exp(k) - exp(-k)));
-  wgs.longitude = x / n * 360.0 - 180;
-
+  gis::projection::projectFromWebMercator(mx, my, wgs.latitude, wgs.longitude);
   return wgs;
 }
 
@@ -178,7 +363,7 @@ int MapTiler::computeZoomForPixelSize(double GSD, bool do_upscale) const
 {
   for (int i = 0; i < m_zoom_level_max; ++i)
   {
-    if (GSD >= m_lookup_resolution_from_zoom.at(i) + 10e-3)
+    if (GSD >= m_lookup_resolution_from_zoom[i] + 10e-3)
     {
       if (do_upscale)
         return std::max(0, i);
@@ -192,7 +377,7 @@ int MapTiler::computeZoomForPixelSize(double GSD, bool do_upscale) const
 double MapTiler::computeZoomResolution(int zoom_level, double latitude) const
 {
   if (fabs(latitude) < 10e-3)
-    return (2 * M_PI * 6378137 / m_tile_size) / m_lookup_nrof_tiles_from_zoom.at(zoom_level);
+    return (2 * M_PI * 6378137 / Tile::kSize) / static_cast<double>(computeNrofTiles(zoom_level));
   else
-    return 156543.03 * cos(latitude*M_PI/180) / m_lookup_nrof_tiles_from_zoom.at(zoom_level);
+    return 156543.03 * cos(latitude*M_PI/180) / static_cast<double>(computeNrofTiles(zoom_level));
 }
\ No newline at end of file
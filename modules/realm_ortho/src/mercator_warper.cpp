@@ -0,0 +1,153 @@
+
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include <opencv2/imgproc.hpp>
+
+#include <realm_core/projection.h>
+#include <realm_ortho/mercator_warper.h>
+
+using namespace realm;
+
+gis::MercatorWarper::MercatorWarper(int step)
+ : m_step(std::max(step, 1))
+{
+}
+
+CvGridMap::Ptr gis::MercatorWarper::warpRaster(const CvGridMap &map, uint8_t zone) const
+{
+  std::vector<std::string> layer_names = map.getAllLayerNames();
+  if (layer_names.empty())
+    throw(std::invalid_argument("Error warping map: There are no layers in the map."));
+
+  cv::Size size_src = map.size();
+  double resolution_src = map.resolution();
+
+  // Cells are areas like GDAL pixels, so the extent reaches from the outer edges of the border cells
+  double left = map.roi().x;
+  double top = map.roi().y + map.roi().height;
+  double right = left + size_src.width * resolution_src;
+  double bottom = top - size_src.height * resolution_src;
+
+  // Edges of the map are curved in Web Mercator, so they are sampled instead of only projecting the corners
+  const int nrof_samples = 21;
+  std::vector<double> x, y;
+  x.reserve(4 * nrof_samples);
+  y.reserve(4 * nrof_samples);
+  for (int i = 0; i < nrof_samples; ++i)
+  {
+    double t = static_cast<double>(i) / (nrof_samples - 1);
+    x.insert(x.end(), {left + t * (right - left), left + t * (right - left), left, right});
+    y.insert(y.end(), {top, bottom, bottom + t * (top - bottom), bottom + t * (top - bottom)});
+  }
+  projection::projectUTMToWebMercator(x.size(), zone, true, x.data(), y.data());
+
+  auto x_minmax = std::minmax_element(x.begin(), x.end());
+  auto y_minmax = std::minmax_element(y.begin(), y.end());
+  cv::Rect2d roi_dst(*x_minmax.first, *y_minmax.first, *x_minmax.second - *x_minmax.first, *y_minmax.second - *y_minmax.first);
+
+  // Same number of cells along the diagonal as the source, like the suggested output of GDAL
+  double resolution_dst = std::hypot(roi_dst.width, roi_dst.height) / std::hypot(size_src.width, size_src.height);
+  cv::Size size_dst(std::max(static_cast<int>(roi_dst.width / resolution_dst + 0.5), 1),
+                    std::max(static_cast<int>(roi_dst.height / resolution_dst + 0.5), 1));
+
+  cv::Mat map_x, map_y;
+  computeRemap(map, zone, roi_dst, resolution_dst, size_dst, map_x, map_y);
+
+  // Output geometry is set up exactly like GdalWarper::warpRaster
+  cv::Rect2d warped_roi;
+  warped_roi.x = roi_dst.x;
+  warped_roi.y = roi_dst.y + roi_dst.height - size_dst.height * resolution_dst;
+  warped_roi.width = size_dst.width * resolution_dst - resolution_dst;
+  warped_roi.height = size_dst.height * resolution_dst - resolution_dst;
+
+  auto output = std::make_shared<CvGridMap>(warped_roi, resolution_dst);
+
+  for (const auto &layer_name : layer_names)
+  {
+    const CvGridMap::Layer &layer = map.getLayer(layer_name);
+
+    int interpolation = layer.interpolation;
+    if (interpolation != cv::INTER_NEAREST && interpolation != cv::INTER_LINEAR && interpolation != cv::INTER_CUBIC)
+      interpolation = cv::INTER_LINEAR;
+
+    cv::Mat data = layer.data;
+#ifdef CV_16F
+    // cv::remap does not support half precision, it is interpolated in single precision and converted back
+    if (data.depth() == CV_16F)
+      data.convertTo(data, CV_32F);
+#endif
+
+    int depth = data.depth();
+    double no_data = (depth == CV_32F || depth == CV_64F ? std::numeric_limits<double>::quiet_NaN() : 0.0);
+
+    cv::Mat data_warped;
+    cv::remap(data, data_warped, map_x, map_y, interpolation, cv::BORDER_CONSTANT, cv::Scalar::all(no_data));
+    if (data_warped.type() != layer.data.type())
+      data_warped.convertTo(data_warped, layer.data.type());
+    output->add(layer_name, data_warped, layer.interpolation);
+  }
+
+  return output;
+}
+
+void gis::MercatorWarper::computeRemap(const CvGridMap &map, uint8_t zone, const cv::Rect2d &roi_dst,
+                                       double resolution_dst, const cv::Size &size_dst, cv::Mat &map_x,
+                                       cv::Mat &map_y) const
+{
+  double resolution_src = map.resolution();
+  double left_src = map.roi().x;
+  double top_src = map.roi().y + map.roi().height;
+  double top_dst = roi_dst.y + roi_dst.height;
+
+  map_x.create(size_dst, CV_32FC1);
+  map_y.create(size_dst, CV_32FC1);
+
+  // Columns that are projected exactly, always including the last one
+  std::vector<int> cols;
+  for (int c = 0; c < size_dst.width; c += m_step)
+    cols.push_back(c);
+  if (cols.back() != size_dst.width - 1)
+    cols.push_back(size_dst.width - 1);
+
+  std::vector<double> x(cols.size());
+  std::vector<double> y(cols.size());
+
+  for (int r = 0; r < size_dst.height; ++r)
+  {
+    // Centres of the output cells in Web Mercator
+    for (size_t i = 0; i < cols.size(); ++i)
+    {
+      x[i] = roi_dst.x + (cols[i] + 0.5) * resolution_dst;
+      y[i] = top_dst - (r + 0.5) * resolution_dst;
+    }
+    projection::projectWebMercatorToUTM(cols.size(), zone, true, x.data(), y.data());
+
+    // Source cells in the pixel convention of cv::remap, that is integer coordinates at the cell centres
+    for (size_t i = 0; i < cols.size(); ++i)
+    {
+      x[i] = (x[i] - left_src) / resolution_src - 0.5;
+      y[i] = (top_src - y[i]) / resolution_src - 0.5;
+    }
+
+    auto* row_x = map_x.ptr<float>(r);
+    auto* row_y = map_y.ptr<float>(r);
+    row_x[cols[0]] = static_cast<float>(x[0]);
+    row_y[cols[0]] = static_cast<float>(y[0]);
+    for (size_t i = 1; i < cols.size(); ++i)
+    {
+      int c0 = cols[i - 1];
+      int c1 = cols[i];
+      for (int c = c0 + 1; c <= c1; ++c)
+      {
+        double t = static_cast<double>(c - c0) / (c1 - c0);
+        row_x[c] = static_cast<float>(x[i - 1] + t * (x[i] - x[i - 1]));
+        row_y[c] = static_cast<float>(y[i - 1] + t * (y[i] - y[i - 1]));
+      }
+    }
+  }
+}
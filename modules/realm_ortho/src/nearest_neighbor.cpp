@@ -0,0 +1,72 @@
+
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <realm_ortho/nearest_neighbor.h>
+#include <realm_ortho/point_grid_index.h>
+
+using namespace realm::ortho;
+
+NeighbourIndex2D::Ptr NeighbourIndex2D::create(Type type)
+{
+  switch (type)
+  {
+    case Type::GRID:
+      return std::make_shared<PointGridIndex>();
+    case Type::KD_TREE:
+      return std::make_shared<KdTreeIndex2D>();
+  }
+  throw(std::invalid_argument("Error creating neighbour index: Unknown type!"));
+}
+
+void KdTreeIndex2D::build(const cv::Mat &points, const ThreadPool::Ptr &/*thread_pool*/, int /*nrof_threads*/)
+{
+  if (!points.empty() && (points.type() != CV_64F || points.cols < 2))
+    throw(std::invalid_argument("Error building k-d tree: Point cloud must be of type CV_64F with x, y in cols!"));
+
+  m_kd_tree.reset();
+  m_adaptor.reset(new MatPointCloudAdaptor(points));
+  if (points.empty())
+    return;
+
+  m_kd_tree.reset(new KdTree_t(kDimension, *m_adaptor, nanoflann::KDTreeSingleIndexAdaptorParams(kMaxLeaf)));
+  m_kd_tree->buildIndex();
+}
+
+void KdTreeIndex2D::radiusSearch(double x, double y, double radius_sq,
+                                 std::vector<std::pair<int, double>> &indices_dists) const
+{
+  indices_dists.clear();
+  if (!m_kd_tree)
+    return;
+
+  const double query_pt[2]{x, y};
+  nanoflann::RadiusResultSet<double, int> result_set(radius_sq, indices_dists);
+  m_kd_tree->findNeighbors(result_set, &query_pt[0], nanoflann::SearchParams());
+}
+
+size_t KdTreeIndex2D::knnSearch(double x, double y, size_t k, size_t* indices, double* dists_sq) const
+{
+  if (!m_kd_tree || k == 0)
+    return 0;
+
+  k = std::min(k, size());
+  const double query_pt[2]{x, y};
+  m_kd_tree->knnSearch(&query_pt[0], k, indices, dists_sq);
+  return k;
+}
+
+bool KdTreeIndex2D::hasNeighbour(double x, double y, double radius) const
+{
+  size_t idx;
+  double dist_sq;
+  if (radius < 0.0 || knnSearch(x, y, 1u, &idx, &dist_sq) == 0)
+    return false;
+  return dist_sq <= radius*radius;
+}
+
+size_t KdTreeIndex2D::size() const
+{
+  return (m_adaptor ? m_adaptor->kdtree_get_point_count() : 0u);
+}
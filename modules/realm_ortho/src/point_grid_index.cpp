@@ -0,0 +1,262 @@
+
+
+#include <realm_ortho/point_grid_index.h>
+
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+using namespace realm::ortho;
+
+PointGridIndex::PointGridIndex()
+    : m_x0(0.0),
+      m_y0(0.0),
+      m_cell_size(1.0),
+      m_width(1),
+      m_height(1),
+      m_cell_begin(2, 0)
+{
+}
+
+void PointGridIndex::build(const cv::Mat &points, const ThreadPool::Ptr &thread_pool, int nrof_threads)
+{
+  if (!points.empty() && (points.type() != CV_64F || points.cols < 2))
+    throw(std::invalid_argument("Error building point grid index: Point cloud must be of type CV_64F with x, y in cols!"));
+
+  auto n = static_cast<size_t>(points.rows);
+  m_entries.clear();
+
+  // 1) Geometry of the grid from the extent of a sample
+  size_t nrof_valid = 0;
+  for (size_t i = 0; i < n; ++i)
+  {
+    auto pt = points.ptr<double>(static_cast<int>(i));
+    if (std::isfinite(pt[0]) && std::isfinite(pt[1]))
+      nrof_valid++;
+  }
+  computeGeometry(points, nrof_valid);
+
+  auto nrof_cells = static_cast<size_t>(m_width * m_height);
+  m_cell_begin.assign(nrof_cells + 1, 0);
+  if (nrof_valid == 0)
+    return;
+
+  // 2) Cell of every point, rows are independent
+  m_cell_of_row.resize(n);
+  realm::parallelFor(thread_pool, cv::Range(0, static_cast<int>(n)), [&](const cv::Range &range)
+  {
+    for (int i = range.start; i < range.end; ++i)
+    {
+      auto pt = points.ptr<double>(i);
+      if (std::isfinite(pt[0]) && std::isfinite(pt[1]))
+        m_cell_of_row[i] = static_cast<uint32_t>(toCellY(pt[1]) * m_width + toCellX(pt[0]));
+      else
+        m_cell_of_row[i] = std::numeric_limits<uint32_t>::max();
+    }
+  }, nrof_threads);
+
+  // 3) Counting sort of the points into the cells. Begin of every cell is used as insert position first and shifted
+  //    back afterwards, so rows stay ascending inside a cell and no further buffer is needed.
+  for (size_t i = 0; i < n; ++i)
+    if (m_cell_of_row[i] != std::numeric_limits<uint32_t>::max())
+      m_cell_begin[m_cell_of_row[i] + 1]++;
+  for (size_t c = 0; c < nrof_cells; ++c)
+    m_cell_begin[c + 1] += m_cell_begin[c];
+
+  m_entries.resize(nrof_valid);
+  for (size_t i = 0; i < n; ++i)
+  {
+    uint32_t c = m_cell_of_row[i];
+    if (c == std::numeric_limits<uint32_t>::max())
+      continue;
+    auto pt = points.ptr<double>(static_cast<int>(i));
+    m_entries[m_cell_begin[c]++] = Entry{pt[0], pt[1], static_cast<int>(i)};
+  }
+  for (size_t c = nrof_cells; c > 0; --c)
+    m_cell_begin[c] = m_cell_begin[c - 1];
+  m_cell_begin[0] = 0;
+}
+
+void PointGridIndex::computeGeometry(const cv::Mat &points, size_t nrof_valid)
+{
+  m_x0 = 0.0;
+  m_y0 = 0.0;
+  m_cell_size = 1.0;
+  m_width = 1;
+  m_height = 1;
+  if (nrof_valid == 0)
+    return;
+
+  const size_t kMaxSamples = 2048;
+  auto n = static_cast<size_t>(points.rows);
+  size_t step = std::max<size_t>(n / kMaxSamples, 1);
+
+  std::vector<double> xs, ys;
+  xs.reserve(kMaxSamples + 1);
+  ys.reserve(kMaxSamples + 1);
+  for (size_t i = 0; i < n; i += step)
+  {
+    auto pt = points.ptr<double>(static_cast<int>(i));
+    if (std::isfinite(pt[0]) && std::isfinite(pt[1]))
+    {
+      xs.push_back(pt[0]);
+      ys.push_back(pt[1]);
+    }
+  }
+  for (size_t i = 0; i < n && xs.empty(); ++i)
+  {
+    // Sample missed the few finite points, the first one is used as origin
+    auto pt = points.ptr<double>(static_cast<int>(i));
+    if (std::isfinite(pt[0]) && std::isfinite(pt[1]))
+    {
+      xs.push_back(pt[0]);
+      ys.push_back(pt[1]);
+    }
+  }
+
+  auto quantile = [](std::vector<double> &v, double q)
+  {
+    auto it = v.begin() + static_cast<long>(q * static_cast<double>(v.size() - 1));
+    std::nth_element(v.begin(), it, v.end());
+    return *it;
+  };
+  double x_min = quantile(xs, 0.02), x_max = quantile(xs, 0.98);
+  double y_min = quantile(ys, 0.02), y_max = quantile(ys, 0.98);
+  double width = x_max - x_min;
+  double height = y_max - y_min;
+
+  // About four points per cell for evenly distributed clouds
+  auto density_n = static_cast<double>(nrof_valid);
+  if (width > 0.0 && height > 0.0)
+    m_cell_size = 2.0 * std::sqrt(width * height / density_n);
+  else if (width > 0.0 || height > 0.0)
+    m_cell_size = 4.0 * std::max(width, height) / density_n;
+
+  // Cell count is bounded by the number of points, even for rounding issues of degenerated extents
+  auto max_cells = static_cast<double>(nrof_valid);
+  m_width = static_cast<int64_t>(std::min(std::floor(width / m_cell_size) + 1.0, max_cells));
+  m_height = static_cast<int64_t>(std::min(std::floor(height / m_cell_size) + 1.0, max_cells));
+  while (m_width * m_height > static_cast<int64_t>(nrof_valid) + 1)
+  {
+    m_cell_size *= 2.0;
+    m_width = (m_width + 1) / 2;
+    m_height = (m_height + 1) / 2;
+  }
+
+  m_x0 = x_min;
+  m_y0 = y_min;
+}
+
+void PointGridIndex::radiusSearch(double x, double y, double radius_sq,
+                                  std::vector<std::pair<int, double>> &indices_dists) const
+{
+  indices_dists.clear();
+  if (m_entries.empty() || radius_sq <= 0.0)
+    return;
+
+  double radius = std::sqrt(radius_sq);
+  forEachInCells(toCellX(x - radius), toCellX(x + radius), toCellY(y - radius), toCellY(y + radius),
+                 [&](const Entry &e)
+  {
+    double dx = e.x - x;
+    double dy = e.y - y;
+    double dist_sq = dx*dx + dy*dy;
+    if (dist_sq < radius_sq)
+      indices_dists.emplace_back(e.idx, dist_sq);
+    return true;
+  });
+}
+
+size_t PointGridIndex::knnSearch(double x, double y, size_t k, size_t* indices, double* dists_sq) const
+{
+  if (m_entries.empty() || k == 0)
+    return 0;
+
+  // Best k found so far, sorted ascending by distance
+  size_t nrof_found = 0;
+  auto insert = [&](const Entry &e)
+  {
+    double dx = e.x - x;
+    double dy = e.y - y;
+    double dist_sq = dx*dx + dy*dy;
+    if (nrof_found == k && dist_sq >= dists_sq[k-1])
+      return true;
+    size_t pos = (nrof_found < k ? nrof_found++ : k-1);
+    while (pos > 0 && dists_sq[pos-1] > dist_sq)
+    {
+      dists_sq[pos] = dists_sq[pos-1];
+      indices[pos] = indices[pos-1];
+      --pos;
+    }
+    dists_sq[pos] = dist_sq;
+    indices[pos] = static_cast<size_t>(e.idx);
+    return true;
+  };
+
+  // Rings of cells around the cell of the query, clipped to the grid. A point in a cell outside the visited rings is at
+  // least 'ring' cells away from the query, also if it was clamped into a border cell.
+  int64_t cx = toCellX(x);
+  int64_t cy = toCellY(y);
+  for (int64_t ring = 0; ; ++ring)
+  {
+    int64_t ix0 = std::max<int64_t>(cx - ring, 0), ix1 = std::min<int64_t>(cx + ring, m_width - 1);
+    int64_t iy0 = std::max<int64_t>(cy - ring, 0), iy1 = std::min<int64_t>(cy + ring, m_height - 1);
+
+    if (ring == 0)
+      forEachInCells(cx, cx, cy, cy, insert);
+    else
+    {
+      if (cy - ring >= 0)
+        forEachInCells(ix0, ix1, cy - ring, cy - ring, insert);
+      if (cy + ring < m_height)
+        forEachInCells(ix0, ix1, cy + ring, cy + ring, insert);
+      int64_t iy0_inner = std::max<int64_t>(cy - ring + 1, 0), iy1_inner = std::min<int64_t>(cy + ring - 1, m_height - 1);
+      if (cx - ring >= 0 && iy0_inner <= iy1_inner)
+        forEachInCells(cx - ring, cx - ring, iy0_inner, iy1_inner, insert);
+      if (cx + ring < m_width && iy0_inner <= iy1_inner)
+        forEachInCells(cx + ring, cx + ring, iy0_inner, iy1_inner, insert);
+    }
+
+    bool is_grid_covered = (ix0 == 0 && iy0 == 0 && ix1 == m_width - 1 && iy1 == m_height - 1);
+    double dist_min = static_cast<double>(ring) * m_cell_size;
+    if (is_grid_covered || (nrof_found == k && dists_sq[k-1] <= dist_min*dist_min))
+      return nrof_found;
+  }
+}
+
+bool PointGridIndex::hasNeighbour(double x, double y, double radius) const
+{
+  if (m_entries.empty() || radius < 0.0)
+    return false;
+
+  double radius_sq = radius*radius;
+  return !forEachInCells(toCellX(x - radius), toCellX(x + radius), toCellY(y - radius), toCellY(y + radius),
+                         [&](const Entry &e)
+  {
+    double dx = e.x - x;
+    double dy = e.y - y;
+    return dx*dx + dy*dy > radius_sq;
+  });
+}
+
+size_t PointGridIndex::size() const
+{
+  return m_entries.size();
+}
+
+double PointGridIndex::getCellSize() const
+{
+  return m_cell_size;
+}
+
+int64_t PointGridIndex::toCellX(double x) const
+{
+  double ix = std::floor((x - m_x0) / m_cell_size);
+  return static_cast<int64_t>(std::max(0.0, std::min(ix, static_cast<double>(m_width - 1))));
+}
+
+int64_t PointGridIndex::toCellY(double y) const
+{
+  double iy = std::floor((y - m_y0) / m_cell_size);
+  return static_cast<int64_t>(std::max(0.0, std::min(iy, static_cast<double>(m_height - 1))));
+}
@@ -1,11 +1,56 @@
 
 
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+#include <opencv2/core/utility.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <realm_core/cpu_dispatch.h>
 #include <realm_core/loguru.h>
+#include <realm_ortho/cuda_backend.h>
 #include <realm_ortho/rectification.h>
 
 using namespace realm;
 
-CvGridMap::Ptr ortho::rectify(const Frame::Ptr &frame)
+namespace
+{
+// Coefficients of the polynomial approximation of atan(a) with a in [0, 1], max. error ~0.01°
+const float kAtanP1 = 0.9997878412794807f;
+const float kAtanP3 = -0.3258083974640975f;
+const float kAtanP5 = 0.1555786518463281f;
+const float kAtanP7 = -0.04432655554792128f;
+const float kHalfPi = 1.5707963267948966f;
+
+// Same conversion as in the scalar computation of the elevation angle, so both paths are consistent with each other
+const float kRadToDeg = 180.0f/3.1415f;
+
+/*!
+ * @brief Projects one row of the surface in the local frame of the roi into the image and computes the approximated
+ * elevation angles of its cells. The cells are independent of each other, so every clone of the kernel is vectorized
+ * with the register width of its target.
+ */
+REALM_CPU_DISPATCH
+void projectRowLocal(const float* surface_row, int cols, float gsd, const float (&P_local)[3][4],
+                     const float (&offset)[3], const float (&t_local)[3], float dy,
+                     float* img_x, float* img_y, float* angles)
+{
+  for (int c = 0; c < cols; ++c)
+  {
+    float x_local = static_cast<float>(c)*gsd;
+    float z = P_local[2][0]*x_local + P_local[2][2]*surface_row[c] + offset[2];
+    img_x[c] = (P_local[0][0]*x_local + P_local[0][2]*surface_row[c] + offset[0]) / z;
+    img_y[c] = (P_local[1][0]*x_local + P_local[1][2]*surface_row[c] + offset[1]) / z;
+
+    float dx = t_local[0] - x_local;
+    angles[c] = realm::ortho::internal::computeElevationAngleFast(std::abs(t_local[2] - surface_row[c]), std::sqrt(dx*dx + dy*dy));
+  }
+}
+} // namespace
+
+CvGridMap::Ptr ortho::rectify(const Frame::Ptr &frame, int nrof_threads, int interpolation,
+                              const ThreadPool::Ptr &thread_pool, MatPool* mat_pool, bool use_cuda)
 {
   // Check if all relevant layers are in the observed map
   CvGridMap::Ptr surface_model = frame->getSurfaceModel();
@@ -13,7 +58,53 @@ CvGridMap::Ptr ortho::rectify(const Frame::Ptr &frame)
   if (!surface_model->exists("elevation") || (*surface_model)["elevation"].type() != CV_32F)
     throw(std::invalid_argument("Error: Layer 'elevation' does not exist or type is wrong."));
 
+  // Planar surfaces are rectified by a single homography. The plane is constant, so its elevation is taken from the
+  // first cell, that was not invalidated yet.
+  if (frame->getSurfaceAssumption() == SurfaceAssumption::PLANAR)
+  {
+    cv::Mat &surface = surface_model->get("elevation");
+    double elevation = std::numeric_limits<double>::quiet_NaN();
+    for (int r = 0; r < surface.rows && elevation != elevation; ++r)
+    {
+      const float* surface_row = surface.ptr<float>(r);
+      for (int c = 0; c < surface.cols; ++c)
+        if (surface_row[c] == surface_row[c])
+        {
+          elevation = static_cast<double>(surface_row[c]);
+          break;
+        }
+    }
+
+    if (elevation == elevation)
+      return rectifyPlanar(
+          frame->getImageUndistorted(),
+          *frame->getCamera(),
+          surface,
+          surface_model->roi(),
+          surface_model->resolution(),
+          elevation,
+          true,
+          nrof_threads,
+          interpolation,
+          thread_pool,
+          mat_pool
+          );
+  }
+
   // Apply rectification using the backprojection from grid
+  if (use_cuda && cuda::isAvailable() && cuda::isInterpolationSupported(interpolation))
+    return cuda::backprojectFromGrid(
+        frame->getImageUndistorted(),
+        *frame->getCamera(),
+        surface_model->get("elevation"),
+        surface_model->roi(),
+        surface_model->resolution(),
+        frame->getSurfaceAssumption() == SurfaceAssumption::ELEVATION,
+        true,
+        interpolation,
+        mat_pool
+        );
+
   CvGridMap::Ptr rectification =
       backprojectFromGrid(
           frame->getImageUndistorted(),
@@ -21,7 +112,13 @@ CvGridMap::Ptr ortho::rectify(const Frame::Ptr &frame)
           surface_model->get("elevation"),
           surface_model->roi(),
           surface_model->resolution(),
-          frame->getSurfaceAssumption() == SurfaceAssumption::ELEVATION
+          frame->getSurfaceAssumption() == SurfaceAssumption::ELEVATION,
+          true,
+          nrof_threads,
+          true,
+          interpolation,
+          thread_pool,
+          mat_pool
           );
 
   return rectification;
@@ -34,7 +131,12 @@ CvGridMap::Ptr ortho::backprojectFromGrid(
     const cv::Rect2d &roi,
     double GSD,
     bool is_elevated,
-    bool verbose)
+    bool verbose,
+    int nrof_threads,
+    bool use_simd,
+    int interpolation,
+    const ThreadPool::Ptr &thread_pool,
+    MatPool* mat_pool)
 {
   // Implementation details:
   // Implementation is chosen as a compromise between readability and performance. Especially the raw array operations
@@ -52,45 +154,283 @@ CvGridMap::Ptr ortho::backprojectFromGrid(
   cv::Mat t_pose = cam.t();
   double t[3] = {t_pose.at<double>(0), t_pose.at<double>(1), t_pose.at<double>(2)};
 
+  // All full size matrices are taken from the pool if one is provided. The grid usually has the same size for every
+  // frame, so their buffers are reused instead of being requested from the system each time.
+  auto create_zeros = [&](int type)
+  {
+    return (mat_pool != nullptr ? mat_pool->zeros(surface.size(), type) : cv::Mat(cv::Mat::zeros(surface.size(), type)));
+  };
+
   uchar is_elevated_val    = (is_elevated ? (uchar)0 : (uchar)255);
-  cv::Mat valid            = (surface == surface);                      // Check for NaN values in the elevation
-  cv::Mat color_data       = cv::Mat::zeros(surface.size(), CV_8UC4);   // contains BGRA color data
-  cv::Mat elevation_angle  = cv::Mat::zeros(surface.size(), CV_32FC1);  // contains the observed elevation angle
-  cv::Mat elevated         = cv::Mat::zeros(surface.size(), CV_8UC1);   // flag to set wether the surface has elevation info or not
-  cv::Mat num_observations = cv::Mat::zeros(surface.size(), CV_16UC1);  // number of observations, should be one if it's a valid surface point
+  cv::Mat valid            = (mat_pool != nullptr ? mat_pool->create(surface.size(), CV_8UC1) : cv::Mat());
+  cv::compare(surface, surface, valid, cv::CMP_EQ);                     // Check for NaN values in the elevation
+  cv::Mat color_data       = create_zeros(CV_8UC4);                     // contains BGRA color data
+  cv::Mat elevation_angle  = create_zeros(CV_32FC1);                    // contains the observed elevation angle
+  cv::Mat elevated         = create_zeros(CV_8UC1);                     // flag to set wether the surface has elevation info or not
+  cv::Mat num_observations = create_zeros(CV_16UC1);                    // number of observations, should be one if it's a valid surface point
+
+  // Nearest neighbour is sampled directly from the image. All other interpolations only store the projected image
+  // coordinates and sample the whole grid at once using remap afterwards. Note: remap has the pixel centers at integer
+  // coordinates, while the direct sampling truncates. Therefore the coordinates are shifted by half a pixel.
+  bool use_remap = (interpolation != cv::INTER_NEAREST);
+  cv::Mat map_x, map_y;
+  if (use_remap)
+  {
+    map_x = create_zeros(CV_32FC1);
+    map_y = create_zeros(CV_32FC1);
+  }
 
   LOG_IF_F(INFO, verbose, "Processing rectification:");
   LOG_IF_F(INFO, verbose, "- ROI (%f, %f, %f, %f)", roi.x, roi.y, roi.width, roi.height);
   LOG_IF_F(INFO, verbose, "- Dimensions: %i x %i", surface.rows, surface.cols);
+  LOG_IF_F(INFO, verbose, "- Threads: %i", nrof_threads);
+  LOG_IF_F(INFO, verbose, "- SIMD: %i (%s)", use_simd, getCpuDispatchTarget());
+  LOG_IF_F(INFO, verbose, "- Interpolation: %i", interpolation);
 
-  // Iterate through surface and project every cell to the image
-  for (uint32_t r = 0; r < surface.rows; ++r)
-    for (uint32_t c = 0; c < surface.cols; ++c)
+  // Scalar kernel: Iterate through surface and project every cell to the image
+  auto backproject_rows = [&](const cv::Range &range)
+  {
+    for (int r = range.start; r < range.end; ++r)
     {
-      if (!valid.at<uchar>(r, c))
+      const uchar* valid_row         = valid.ptr<uchar>(r);
+      float* surface_row             = surface.ptr<float>(r);
+      cv::Vec4b* color_row           = color_data.ptr<cv::Vec4b>(r);
+      float* elevation_angle_row     = elevation_angle.ptr<float>(r);
+      uchar* elevated_row            = elevated.ptr<uchar>(r);
+      uint16_t* num_observations_row = num_observations.ptr<uint16_t>(r);
+      float* map_x_row               = (use_remap ? map_x.ptr<float>(r) : nullptr);
+      float* map_y_row               = (use_remap ? map_y.ptr<float>(r) : nullptr);
+
+      for (int c = 0; c < surface.cols; ++c)
       {
-        continue;
+        if (!valid_row[c])
+        {
+          continue;
+        }
+
+        auto elevation_val = static_cast<double>(surface_row[c]);
+
+        double pt[3]{roi.x+(double)c*GSD, roi.y+roi.height-(double)r*GSD, elevation_val};
+        double z = P[2][0]*pt[0]+P[2][1]*pt[1]+P[2][2]*pt[2]+P[2][3]*1.0;
+        double x = (P[0][0]*pt[0]+P[0][1]*pt[1]+P[0][2]*pt[2]+P[0][3]*1.0)/z;
+        double y = (P[1][0]*pt[0]+P[1][1]*pt[1]+P[1][2]*pt[2]+P[1][3]*1.0)/z;
+
+        if (x > 0.0 && x < img.cols && y > 0.0 && y < img.rows)
+        {
+          if (use_remap)
+          {
+            map_x_row[c]          = static_cast<float>(x - 0.5);
+            map_y_row[c]          = static_cast<float>(y - 0.5);
+          }
+          else
+            color_row[c]          = img.at<cv::Vec4b>((int)y, (int)x);
+          elevation_angle_row[c]  = static_cast<float>(ortho::internal::computeElevationAngle(t, pt));
+          elevated_row[c]         = is_elevated_val;
+          num_observations_row[c] = 1;
+        }
+        else
+        {
+          surface_row[c]          = std::numeric_limits<float>::quiet_NaN();
+        }
       }
+    }
+  };
 
-      auto elevation_val = static_cast<double>(surface.at<float>(r, c));
+  // Vectorized kernel: Single precision is not sufficient for geographic coordinates (e.g. UTM eastings of ~600000 m
+  // would be resolved with ~6 cm only). Therefore the projection is shifted into a local frame with its origin in
+  // the upper left corner of the roi. The translation is applied to the projection matrix and camera position in double
+  // precision once, so all per cell operations can be computed in float.
+  double origin[3]{roi.x, roi.y+roi.height, 0.0};
+  float P_local[3][4];
+  for (int i = 0; i < 3; ++i)
+  {
+    P_local[i][0] = static_cast<float>(P[i][0]);
+    P_local[i][1] = static_cast<float>(P[i][1]);
+    P_local[i][2] = static_cast<float>(P[i][2]);
+    P_local[i][3] = static_cast<float>(P[i][0]*origin[0]+P[i][1]*origin[1]+P[i][2]*origin[2]+P[i][3]);
+  }
+  float t_local[3]{static_cast<float>(t[0]-origin[0]), static_cast<float>(t[1]-origin[1]), static_cast<float>(t[2]-origin[2])};
 
-      double pt[3]{roi.x+(double)c*GSD, roi.y+roi.height-(double)r*GSD, elevation_val};
-      double z = P[2][0]*pt[0]+P[2][1]*pt[1]+P[2][2]*pt[2]+P[2][3]*1.0;
-      double x = (P[0][0]*pt[0]+P[0][1]*pt[1]+P[0][2]*pt[2]+P[0][3]*1.0)/z;
-      double y = (P[1][0]*pt[0]+P[1][1]*pt[1]+P[1][2]*pt[2]+P[1][3]*1.0)/z;
+  auto backproject_rows_simd = [&](const cv::Range &range)
+  {
+    // Projected image coordinates of one row
+    std::vector<float> img_x(surface.cols);
+    std::vector<float> img_y(surface.cols);
+    std::vector<float> angles(surface.cols);
 
-      if (x > 0.0 && x < img.cols && y > 0.0 && y < img.rows)
+    for (int r = range.start; r < range.end; ++r)
+    {
+      float* surface_row             = surface.ptr<float>(r);
+      cv::Vec4b* color_row           = color_data.ptr<cv::Vec4b>(r);
+      float* elevation_angle_row     = elevation_angle.ptr<float>(r);
+      uchar* elevated_row            = elevated.ptr<uchar>(r);
+      uint16_t* num_observations_row = num_observations.ptr<uint16_t>(r);
+      float* map_x_row               = (use_remap ? map_x.ptr<float>(r) : nullptr);
+      float* map_y_row               = (use_remap ? map_y.ptr<float>(r) : nullptr);
+
+      // Within one row the local y-coordinate is constant, so the projection only depends on (x, elevation)
+      auto y_local = static_cast<float>(-(double)r*GSD);
+      float offset[3];
+      for (int i = 0; i < 3; ++i)
+        offset[i] = P_local[i][1]*y_local + P_local[i][3];
+      float dy = t_local[1] - y_local;
+
+      projectRowLocal(surface_row, surface.cols, static_cast<float>(GSD), P_local, offset, t_local, dy,
+                      img_x.data(), img_y.data(), angles.data());
+
+      // Sampling of the image data has to be done per cell, as gather operations are not available
+      for (int c = 0; c < surface.cols; ++c)
       {
-        color_data.at<cv::Vec4b>(r, c)      = img.at<cv::Vec4b>((int)y, (int)x);
-        elevation_angle.at<float>(r, c)     = static_cast<float>(ortho::internal::computeElevationAngle(t, pt));
-        elevated.at<uchar>(r, c)            = is_elevated_val;
-        num_observations.at<uint16_t>(r, c) = 1;
+        // NaN elevation results in NaN projection, but is not marked as invalid
+        if (surface_row[c] != surface_row[c])
+        {
+          continue;
+        }
+
+        float x = img_x[c];
+        float y = img_y[c];
+        if (x > 0.0f && x < img.cols && y > 0.0f && y < img.rows)
+        {
+          if (use_remap)
+          {
+            map_x_row[c]          = x - 0.5f;
+            map_y_row[c]          = y - 0.5f;
+          }
+          else
+            color_row[c]          = img.at<cv::Vec4b>((int)y, (int)x);
+          elevation_angle_row[c]  = angles[c];
+          elevated_row[c]         = is_elevated_val;
+          num_observations_row[c] = 1;
+        }
+        else
+        {
+          surface_row[c]          = std::numeric_limits<float>::quiet_NaN();
+        }
       }
-      else
+    }
+  };
+
+  // Rows are independent of each other, so the grid is split into bands of rows which are processed in parallel. Every
+  // band only writes to its own rows.
+  std::function<void(const cv::Range&)> kernel;
+  if (use_simd)
+    kernel = backproject_rows_simd;
+  else
+    kernel = backproject_rows;
+
+  parallelFor(thread_pool, cv::Range(0, surface.rows), kernel, nrof_threads);
+
+  if (use_remap)
+  {
+    // Border is replicated so cells at the image boundary are not blended with black. Cells that were not observed
+    // are reset afterwards.
+    cv::remap(img, color_data, map_x, map_y, interpolation, cv::BORDER_REPLICATE);
+
+    // The mask reuses the buffer of the validity check, which is not needed anymore
+    cv::compare(num_observations, 0, valid, cv::CMP_EQ);
+    color_data.setTo(cv::Scalar::all(0), valid);
+  }
+
+  LOG_IF_F(INFO, verbose, "Image successfully rectified.");
+
+  auto rectification = std::make_shared<CvGridMap>(roi, GSD);
+  rectification->add("color_rgb", color_data);
+  rectification->add("elevation_angle", elevation_angle);
+  rectification->add("elevated", elevated);
+  rectification->add("num_observations", num_observations);
+  return rectification;
+}
+
+CvGridMap::Ptr ortho::rectifyPlanar(
+    const cv::Mat &img,
+    const camera::Pinhole &cam,
+    cv::Mat &surface,
+    const cv::Rect2d &roi,
+    double GSD,
+    double elevation,
+    bool verbose,
+    int nrof_threads,
+    int interpolation,
+    const ThreadPool::Ptr &thread_pool,
+    MatPool* mat_pool)
+{
+  auto create_zeros = [&](int type)
+  {
+    return (mat_pool != nullptr ? mat_pool->zeros(surface.size(), type) : cv::Mat(cv::Mat::zeros(surface.size(), type)));
+  };
+  auto create = [&](int type)
+  {
+    return (mat_pool != nullptr ? mat_pool->create(surface.size(), type) : cv::Mat(surface.size(), type));
+  };
+
+  LOG_IF_F(INFO, verbose, "Processing planar rectification:");
+  LOG_IF_F(INFO, verbose, "- ROI (%f, %f, %f, %f)", roi.x, roi.y, roi.width, roi.height);
+  LOG_IF_F(INFO, verbose, "- Dimensions: %i x %i", surface.rows, surface.cols);
+  LOG_IF_F(INFO, verbose, "- Elevation: %4.2f", elevation);
+  LOG_IF_F(INFO, verbose, "- Interpolation: %i", interpolation);
+
+  // Cell (c, r) lies at (roi.x + c*GSD, roi.y + roi.height - r*GSD, elevation) in the world frame. Concatenated with the
+  // projection this is the homography from grid to image. Pixel centers of the warp are at integer coordinates, while
+  // the backprojection from grid truncates, therefore it is shifted by half a pixel.
+  cv::Mat grid_to_world = (cv::Mat_<double>(4, 3) << GSD, 0.0, roi.x,
+                                                     0.0, -GSD, roi.y + roi.height,
+                                                     0.0, 0.0, elevation,
+                                                     0.0, 0.0, 1.0);
+  cv::Mat shift = (cv::Mat_<double>(3, 3) << 1.0, 0.0, -0.5,
+                                             0.0, 1.0, -0.5,
+                                             0.0, 0.0, 1.0);
+  cv::Mat H = shift * cam.P() * grid_to_world;
+
+  // Cells are observed, if they are sampled from within the image. Warping a mask with nearest neighbour results in the
+  // same footprint for all interpolations.
+  cv::Mat img_mask = (mat_pool != nullptr ? mat_pool->create(img.size(), CV_8UC1) : cv::Mat(img.size(), CV_8UC1));
+  img_mask.setTo(cv::Scalar(255));
+  cv::Mat valid = create(CV_8UC1);
+  cv::warpPerspective(img_mask, valid, H, surface.size(), cv::INTER_NEAREST | cv::WARP_INVERSE_MAP, cv::BORDER_CONSTANT, cv::Scalar(0));
+
+  cv::Mat not_nan = create(CV_8UC1);
+  cv::compare(surface, surface, not_nan, cv::CMP_EQ);
+  cv::bitwise_and(valid, not_nan, valid);
+
+  // Border is replicated so cells at the image boundary are not blended with black
+  cv::Mat color_data = create(CV_8UC4);
+  cv::warpPerspective(img, color_data, H, surface.size(), interpolation | cv::WARP_INVERSE_MAP, cv::BORDER_REPLICATE);
+
+  // The mask of unobserved cells reuses the buffer of the NaN check, which is not needed anymore
+  cv::bitwise_not(valid, not_nan);
+  color_data.setTo(cv::Scalar::all(0), not_nan);
+  surface.setTo(cv::Scalar(std::numeric_limits<float>::quiet_NaN()), not_nan);
+
+  cv::Mat elevated = create_zeros(CV_8UC1);
+  elevated.setTo(cv::Scalar(255), valid);
+  cv::Mat num_observations = create_zeros(CV_16UC1);
+  num_observations.setTo(cv::Scalar(1), valid);
+
+  // Vertical distance to the camera is constant for the plane, so only the horizontal distance differs per cell. It is
+  // computed in the local frame of the upper left corner of the roi, like in the vectorized backprojection.
+  cv::Mat t_pose = cam.t();
+  auto tx = static_cast<float>(t_pose.at<double>(0) - roi.x);
+  auto ty = static_cast<float>(t_pose.at<double>(1) - (roi.y + roi.height));
+  auto dz = static_cast<float>(std::abs(t_pose.at<double>(2) - elevation));
+  auto gsd = static_cast<float>(GSD);
+
+  cv::Mat elevation_angle = create_zeros(CV_32FC1);
+  parallelFor(thread_pool, cv::Range(0, surface.rows), [&](const cv::Range &range)
+  {
+    for (int r = range.start; r < range.end; ++r)
+    {
+      const uchar* valid_row     = valid.ptr<uchar>(r);
+      float* elevation_angle_row = elevation_angle.ptr<float>(r);
+      float dy = ty + static_cast<float>(r)*gsd;
+      for (int c = 0; c < surface.cols; ++c)
       {
-        surface.at<float>(r, c)             = std::numeric_limits<float>::quiet_NaN();
+        if (!valid_row[c])
+          continue;
+        float dx = tx - static_cast<float>(c)*gsd;
+        elevation_angle_row[c] = internal::computeElevationAngleFast(dz, std::sqrt(dx*dx + dy*dy));
       }
     }
+  }, nrof_threads);
 
   LOG_IF_F(INFO, verbose, "Image successfully rectified.");
 
@@ -107,4 +447,13 @@ double ortho::internal::computeElevationAngle(double *t, double *p)
   double v[3]{t[0]-p[0], t[1]-p[1], t[2]-p[2]};
   double v_length = sqrt(v[0]*v[0]+v[1]*v[1]+v[2]*v[2]);
   return acos(sqrt(v[0]*v[0]+v[1]*v[1])/v_length)*180/3.1415;
-}
\ No newline at end of file
+}
+
+float ortho::internal::computeElevationAngleFast(float dz, float dh)
+{
+  // Polynomial approximation of atan(a) for a in [0, 1], the octant is resolved afterwards
+  float a = std::min(dz, dh) / std::max(dz, dh);
+  float a2 = a*a;
+  float angle = (((kAtanP7*a2 + kAtanP5)*a2 + kAtanP3)*a2 + kAtanP1)*a;
+  return (dz > dh ? kHalfPi - angle : angle) * kRadToDeg;
+}
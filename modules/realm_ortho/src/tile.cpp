@@ -1,9 +1,12 @@
 
 
+#include <realm_core/profiling.h>
 #include <realm_ortho/tile.h>
 
 using namespace realm;
 
+constexpr int Tile::kSize;
+
 Tile::Tile(int zoom_level, int tx, int ty, const CvGridMap &map)
  : m_zoom_level(zoom_level),
    m_index(tx, ty),
@@ -13,7 +16,7 @@ Tile::Tile(int zoom_level, int tx, int ty, const CvGridMap &map)
 
 void Tile::lock()
 {
-  m_mutex_data.lock();
+  lockProfiled(m_mutex_data, "Wait Tile::lock");
 }
 
 void Tile::unlock()
@@ -21,6 +24,16 @@ void Tile::unlock()
   m_mutex_data.unlock();
 }
 
+void Tile::lockShared()
+{
+  m_mutex_data.lock_shared();
+}
+
+void Tile::unlockShared()
+{
+  m_mutex_data.unlock_shared();
+}
+
 int Tile::zoom_level() const
 {
   return m_zoom_level;
@@ -1,18 +1,86 @@
 
 
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
 
+#include <realm_core/profiling.h>
+#include <realm_core/scoped_timer.h>
 #include <realm_ortho/tile_cache.h>
 #include <realm_io/cv_import.h>
 #include <realm_io/cv_export.h>
 
+#ifdef WITH_SQLITE
+#include <realm_io/mbtiles_store.h>
+#endif
+
 using namespace realm;
 
-TileCache::TileCache(const std::string &id, double sleep_time, const std::string &output_directory, bool verbose)
+namespace
+{
+
+// Tile data inside the MBTiles stores. 8 bit layers are compressed as png, all others are stored in the binary
+// format of io::saveImageToBinary, which is a header of four ints (cols, rows, element size, type) followed by
+// the row data.
+std::vector<uint8_t> encodeTile(const cv::Mat &data)
+{
+  std::vector<uint8_t> buffer;
+  if ((data.type() & CV_MAT_DEPTH_MASK) == CV_8U)
+  {
+    cv::imencode(".png", data, buffer);
+    return buffer;
+  }
+
+  int header[4] = {data.cols, data.rows, (int)data.elemSize(), data.type()};
+  size_t row_size = data.cols * data.elemSize();
+  buffer.resize(sizeof(header) + data.rows * row_size);
+  memcpy(buffer.data(), header, sizeof(header));
+
+  // Operating rowise, so even non-continuous matrices are properly written
+  for (int r = 0; r < data.rows; ++r)
+    memcpy(buffer.data() + sizeof(header) + r * row_size, data.ptr<uint8_t>(r), row_size);
+  return buffer;
+}
+
+cv::Mat decodeTile(const std::vector<uint8_t> &buffer, int type)
+{
+  if ((type & CV_MAT_DEPTH_MASK) == CV_8U)
+    return cv::imdecode(buffer, cv::IMREAD_UNCHANGED);
+
+  int header[4];
+  if (buffer.size() < sizeof(header))
+    throw(std::runtime_error("Error reading tile: Data is smaller than header!"));
+  memcpy(header, buffer.data(), sizeof(header));
+
+  cv::Mat data(header[1], header[0], header[3]);
+  size_t bytes = data.total() * data.elemSize();
+  if ((size_t)header[2] != data.elemSize() || buffer.size() != sizeof(header) + bytes)
+    throw(std::runtime_error("Error reading tile: Data does not match matrix dimension!"));
+  memcpy(data.data, buffer.data() + sizeof(header), bytes);
+  return data;
+}
+
+// Header of the files written by TileCache::saveIndex
+constexpr char kIndexMagic[8] = {'R', 'E', 'A', 'L', 'M', 'T', 'C', 'I'};
+constexpr uint32_t kIndexVersion = 1;
+
+// Index written next to the tiles by TileCache::flushAll
+constexpr const char* kIndexFilename = "tile_index.bin";
+
+} // namespace
+
+TileCache::TileCache(const std::string &id, double sleep_time, const std::string &output_directory, bool verbose,
+                     int nrof_writer_threads)
  : WorkerThreadBase("tile_cache_" + id, sleep_time, verbose),
    m_dir_toplevel(output_directory),
    m_has_init_directories(false),
-   m_do_update(false)
+   m_do_update(false),
+   m_is_flush_aggressive(false),
+   m_byte_capacity(0),
+   m_use_mbtiles(false),
+   m_pool_writer(nrof_writer_threads)
 {
   m_data_ready_functor = [=]{ return (m_do_update || isFinishRequested()); };
 }
@@ -20,6 +88,42 @@ TileCache::TileCache(const std::string &id, double sleep_time, const std::string
 TileCache::~TileCache()
 {
   flushAll();
+
+  for (auto &zoom_levels : m_cache)
+    for (auto &cache_column : zoom_levels.second)
+      for (auto &cache_element : cache_column.second)
+        if (cache_element.second->was_spilled)
+          for (const auto &meta : cache_element.second->layer_meta)
+            std::remove(createSpillFilename(cache_element.second, meta).c_str());
+}
+
+void TileCache::setAggressiveFlush(bool is_enabled)
+{
+  m_is_flush_aggressive = is_enabled;
+}
+
+void TileCache::setByteCapacity(size_t bytes)
+{
+  m_byte_capacity = bytes;
+}
+
+void TileCache::setMbtilesStorage(bool is_enabled)
+{
+#ifdef WITH_SQLITE
+  std::lock_guard<std::mutex> lock(m_mutex_settings);
+  m_use_mbtiles = is_enabled;
+#else
+  if (is_enabled)
+    throw(std::runtime_error("Error: MBTiles storage requested, but OpenREALM was built without SQLite support."));
+#endif
+}
+
+void TileCache::setSpillDirectory(const std::string &dir)
+{
+  std::lock_guard<std::mutex> lock(m_mutex_settings);
+  if (!dir.empty() && !io::dirExists(dir))
+    io::createDir(dir);
+  m_dir_spill = dir;
 }
 
 void TileCache::setOutputFolder(const std::string &dir)
@@ -34,8 +138,6 @@ bool TileCache::process()
 
   if (m_mutex_do_update.try_lock())
   {
-    long t;
-
     // Give update lock free as fast as possible, so we won't block other threads from adding data
     bool do_update = m_do_update;
     m_do_update = false;
@@ -43,43 +145,103 @@ bool TileCache::process()
 
     if (do_update)
     {
-      int n_tiles_written = 0;
+      ScopedTimer timer_cache_flush("Cache Flush");
+
+      int n_tiles_written = writeDirtyElements();
+
+      // Only elements in memory are candidates for flushing. A snapshot is taken, so new tiles can be added while old
+      // ones are flushed.
+      std::vector<CacheElement::Ptr> resident_elements;
+      {
+        std::lock_guard<std::mutex> lock(m_mutex_resident_elements);
+        resident_elements.assign(m_resident_elements.begin(), m_resident_elements.end());
+      }
+
+      std::map<int, cv::Rect2i> roi_prediction;
+      {
+        std::lock_guard<std::mutex> lock(m_mutex_roi_prediction);
+        roi_prediction = m_roi_prediction;
+      }
+
+      int n_tiles_flushed = 0;
+      size_t bytes_resident = 0;
+      std::vector<std::pair<long, CacheElement::Ptr>> elements_lru;
+      for (const auto &element : resident_elements)
+      {
+        std::lock_guard<std::mutex> lock(element->mutex);
+
+        // Scanning only reads the tile, readers like the blending are therefore not blocked unless it is flushed. The
+        // element stays locked, so nothing is changed between releasing the shared lock and flushing.
+        element->tile->lockShared();
+        bool is_resident = (!element->is_outdated && isCached(element));
+        bool do_flush = false;
+        if (is_resident)
+        {
+          const cv::Rect2i &roi = roi_prediction.at(element->tile->zoom_level());
+          int tx = element->tile->x();
+          int ty = element->tile->y();
+          do_flush = (m_is_flush_aggressive
+                      || tx < roi.x || tx > roi.x + roi.width
+                      || ty < roi.y || ty > roi.y + roi.height);
+        }
+
+        if (is_resident && !do_flush)
+        {
+          size_t bytes = element->tile->data()->getByteSize();
+          bytes_resident += bytes;
+          elements_lru.emplace_back(element->timestamp, element);
+        }
+        element->tile->unlockShared();
+
+        if (do_flush)
+        {
+          element->tile->lock();
+          flush(element);
+          element->tile->unlock();
+          n_tiles_flushed++;
+          is_resident = false;
+        }
 
-      t = getCurrentTimeMilliseconds();
+        if (!is_resident)
+        {
+          std::lock_guard<std::mutex> lock_resident(m_mutex_resident_elements);
+          m_resident_elements.erase(element);
+        }
+      }
 
-      for (auto &cached_elements_zoom : m_cache)
+      // Least recently used tiles are flushed until the remaining ones fit into the capacity
+      size_t byte_capacity = m_byte_capacity;
+      if (byte_capacity > 0 && bytes_resident > byte_capacity)
       {
-        cv::Rect2i roi_prediction = m_roi_prediction.at(cached_elements_zoom.first);
-        for (auto &cached_elements_column : cached_elements_zoom.second)
+        std::sort(elements_lru.begin(), elements_lru.end(),
+            [](const std::pair<long, CacheElement::Ptr> &lhs, const std::pair<long, CacheElement::Ptr> &rhs)
+            { return lhs.first < rhs.first; });
+
+        for (const auto &element_lru : elements_lru)
         {
-          for (auto &cached_elements : cached_elements_column.second)
+          if (bytes_resident <= byte_capacity)
+            break;
+
+          const CacheElement::Ptr &element = element_lru.second;
+          std::lock_guard<std::mutex> lock(element->mutex);
+          element->tile->lock();
+          size_t bytes = element->tile->data()->getByteSize();
+          if (!element->is_outdated && isCached(element))
           {
-            std::lock_guard<std::mutex> lock(cached_elements.second->mutex);
-            cached_elements.second->tile->lock();
-
-            if (!cached_elements.second->was_written)
-            {
-              n_tiles_written++;
-              write(cached_elements.second);
-            }
-
-            if (isCached(cached_elements.second))
-            {
-              int tx = cached_elements.second->tile->x();
-              int ty = cached_elements.second->tile->y();
-              if (tx < roi_prediction.x || tx > roi_prediction.x + roi_prediction.width
-                  || ty < roi_prediction.y || ty > roi_prediction.y + roi_prediction.height)
-              {
-                flush(cached_elements.second);
-              }
-            }
-            cached_elements.second->tile->unlock();
+            flush(element);
+            n_tiles_flushed++;
           }
+          element->tile->unlock();
+
+          bytes_resident -= std::min(bytes, bytes_resident);
+
+          std::lock_guard<std::mutex> lock_resident(m_mutex_resident_elements);
+          m_resident_elements.erase(element);
         }
       }
 
-      LOG_IF_F(INFO, m_verbose, "Tiles written: %i", n_tiles_written);
-      LOG_IF_F(INFO, m_verbose, "Timing [Cache Flush]: %lu ms", getCurrentTimeMilliseconds() - t);
+      LOG_IF_F(INFO, m_verbose, "Tiles written: %i, flushed: %i", n_tiles_written, n_tiles_flushed);
+      timer_cache_flush.stop();
 
       has_processed = true;
     }
@@ -90,11 +252,16 @@ bool TileCache::process()
 void TileCache::reset()
 {
   m_cache.clear();
+
+  std::lock_guard<std::mutex> lock(m_mutex_dirty_elements);
+  m_dirty_elements.clear();
+  std::lock_guard<std::mutex> lock1(m_mutex_resident_elements);
+  m_resident_elements.clear();
 }
 
 void TileCache::add(int zoom_level, const std::vector<Tile::Ptr> &tiles, const cv::Rect2i &roi_idx)
 {
-  std::lock_guard<std::mutex> lock(m_mutex_cache);
+  auto lock = uniqueLockProfiled(m_mutex_cache, "Wait m_mutex_cache");
 
   // Assuming all tiles are based on the same data, therefore have the same number of layers and layer names
   std::vector<std::string> layer_names = tiles[0]->data()->getAllLayerNames();
@@ -107,7 +274,7 @@ void TileCache::add(int zoom_level, const std::vector<Tile::Ptr> &tiles, const c
     layer_meta.emplace_back(LayerMetaData{layer_name, layer.data.type(), layer.interpolation});
   }
 
-  if (!m_has_init_directories)
+  if (!m_has_init_directories && !m_use_mbtiles)
   {
     createDirectories(m_dir_toplevel + "/", layer_names, "");
     m_has_init_directories = true;
@@ -117,7 +284,10 @@ void TileCache::add(int zoom_level, const std::vector<Tile::Ptr> &tiles, const c
 
   long timestamp = getCurrentTimeMilliseconds();
 
-  long t = getCurrentTimeMilliseconds();
+  ScopedTimer timer_cache_push("Cache Push");
+
+  std::vector<CacheElement::Ptr> elements_added;
+  elements_added.reserve(tiles.size());
 
   // Cache for this zoom level already exists
   if (it_zoom != m_cache.end())
@@ -126,13 +296,15 @@ void TileCache::add(int zoom_level, const std::vector<Tile::Ptr> &tiles, const c
     {
       // Here we find a tile grid for a specific zoom level and add the new tiles to it.
       // Important: Tiles that already exist will be overwritten!
-      t->lock();
+      t->lockShared();
       auto it_tile_x = it_zoom->second.find(t->x());
       if (it_tile_x == it_zoom->second.end())
       {
         // Zoom level exists, but tile column is
-        createDirectories(m_dir_toplevel + "/", layer_names, "/" + std::to_string(zoom_level) + "/" + std::to_string(t->x()));
+        if (!m_use_mbtiles)
+          createDirectories(m_dir_toplevel + "/", layer_names, "/" + std::to_string(zoom_level) + "/" + std::to_string(t->x()));
         it_zoom->second[t->x()][t->y()].reset(new CacheElement{timestamp, layer_meta, t, false});
+        elements_added.push_back(it_zoom->second[t->x()][t->y()]);
       }
       else
       {
@@ -141,48 +313,81 @@ void TileCache::add(int zoom_level, const std::vector<Tile::Ptr> &tiles, const c
         {
           // Zoom level and column was found, but tile did not yet exist
           it_tile_x->second[t->y()].reset(new CacheElement{timestamp, layer_meta, t, false});
+          elements_added.push_back(it_tile_x->second[t->y()]);
         }
         else
         {
-          // Existing tile was found inside zoom level and column
-          it_tile_xy->second->mutex.lock(); // note: mutex goes out of scope after this operation, no unlock needed.
+          // Existing tile was found inside zoom level and column. The outdated element might still be queued for
+          // writing or flushing, so it is marked to never overwrite the newer data.
+          CacheElement::Ptr element_outdated = it_tile_xy->second;
+          std::lock_guard<std::mutex> lock_outdated(element_outdated->mutex);
+          element_outdated->is_outdated = true;
           it_tile_xy->second.reset(new CacheElement{timestamp, layer_meta, t, false});
+          it_tile_xy->second->version = element_outdated->version + 1;
+          elements_added.push_back(it_tile_xy->second);
         }
       }
-      t->unlock();
+      t->unlockShared();
     }
   }
   // Cache for this zoom level does not yet exist
   else
   {
-    createDirectories(m_dir_toplevel + "/", layer_names, "/" + std::to_string(zoom_level));
+    if (!m_use_mbtiles)
+      createDirectories(m_dir_toplevel + "/", layer_names, "/" + std::to_string(zoom_level));
 
     CacheElementGrid tile_grid;
     for (const auto &t : tiles)
     {
       // By assigning a new grid of tiles to the zoom level we overwrite all existing data. But in this case there was
       // no prior data found for the specific zoom level.
-      t->lock();
-      auto it_tile_x = it_zoom->second.find(t->x());
-      if (it_tile_x == it_zoom->second.end())
+      t->lockShared();
+      if (!m_use_mbtiles && tile_grid.find(t->x()) == tile_grid.end())
         createDirectories(m_dir_toplevel + "/", layer_names, "/" + std::to_string(zoom_level) + "/" + std::to_string(t->x()));
 
       tile_grid[t->x()][t->y()].reset(new CacheElement{timestamp, layer_meta, t, false});
-      t->unlock();
+      elements_added.push_back(tile_grid[t->x()][t->y()]);
+      t->unlockShared();
     }
     m_cache[zoom_level] = tile_grid;
   }
 
-  LOG_IF_F(INFO, m_verbose, "Timing [Cache Push]: %lu ms", getCurrentTimeMilliseconds() - t);
+  timer_cache_push.stop();
 
   updatePrediction(zoom_level, roi_idx);
 
+  if (!m_use_mbtiles)
+    createPredictedDirectories(zoom_level, layer_names);
+
+  // New elements are in memory and must be written. The prediction has to be updated before, as it is required for
+  // every resident element.
+  {
+    std::lock_guard<std::mutex> lock_dirty(m_mutex_dirty_elements);
+    m_dirty_elements.insert(m_dirty_elements.end(), elements_added.begin(), elements_added.end());
+  }
+  {
+    std::lock_guard<std::mutex> lock_resident(m_mutex_resident_elements);
+    m_resident_elements.insert(elements_added.begin(), elements_added.end());
+  }
+
   std::lock_guard<std::mutex> lock1(m_mutex_do_update);
   m_do_update = true;
   notify();
 }
 
 Tile::Ptr TileCache::get(int tx, int ty, int zoom_level)
+{
+  CacheElement::Ptr element = findAndLoad(tx, ty, zoom_level, false);
+  return (element ? element->tile : nullptr);
+}
+
+Tile::Ptr TileCache::getShared(int tx, int ty, int zoom_level)
+{
+  CacheElement::Ptr element = findAndLoad(tx, ty, zoom_level, true);
+  return (element ? element->tile : nullptr);
+}
+
+TileCache::CacheElement::Ptr TileCache::findAndLoad(int tx, int ty, int zoom_level, bool is_shared)
 {
   auto it_zoom = m_cache.find(zoom_level);
   if (it_zoom == m_cache.end())
@@ -202,17 +407,162 @@ Tile::Ptr TileCache::get(int tx, int ty, int zoom_level)
     return nullptr;
   }
 
-  std::lock_guard<std::mutex> lock(it_tile_xy->second->mutex);
+  CacheElement::Ptr element = it_tile_xy->second;
+  std::lock_guard<std::mutex> lock(element->mutex);
+
+  // Access time is the criterion for evicting tiles once the cache exceeds its capacity
+  element->timestamp = getCurrentTimeMilliseconds();
 
   // Warning: We lock the tile now and return it to the calling thread locked. Therefore the responsibility to unlock
-  // it is on the calling thread!
-  it_tile_xy->second->tile->lock();
-  if (!isCached(it_tile_xy->second))
+  // it is on the calling thread! Loading requires the exclusive lock. The element is locked meanwhile, so the tile can
+  // not be flushed between loading it and handing it out shared.
+  if (is_shared)
+  {
+    element->tile->lockShared();
+    if (isCached(element))
+      return element;
+    element->tile->unlockShared();
+  }
+
+  element->tile->lock();
+  if (!isCached(element))
+  {
+    load(element);
+
+    std::lock_guard<std::mutex> lock_resident(m_mutex_resident_elements);
+    m_resident_elements.insert(element);
+  }
+
+  if (is_shared)
   {
-    load(it_tile_xy->second);
+    element->tile->unlock();
+    element->tile->lockShared();
   }
 
-  return it_tile_xy->second->tile;
+  return element;
+}
+
+bool TileCache::readEncoded(int zoom_level, int tx, int ty, const std::string &layer_name, std::vector<uint8_t> &data,
+                            uint64_t &version)
+{
+  // Readers are not the thread adding tiles, so the lookup must be protected
+  CacheElement::Ptr element;
+  {
+    auto lock = uniqueLockProfiled(m_mutex_cache, "Wait m_mutex_cache");
+    auto it_zoom = m_cache.find(zoom_level);
+    if (it_zoom == m_cache.end())
+      return false;
+    auto it_tile_x = it_zoom->second.find(tx);
+    if (it_tile_x == it_zoom->second.end())
+      return false;
+    auto it_tile_xy = it_tile_x->second.find(ty);
+    if (it_tile_xy == it_tile_x->second.end())
+      return false;
+    element = it_tile_xy->second;
+  }
+
+  auto it_meta = std::find_if(element->layer_meta.begin(), element->layer_meta.end(),
+                              [&](const LayerMetaData &meta) { return meta.name == layer_name; });
+  if (it_meta == element->layer_meta.end())
+    return false;
+
+  // With the shared lock the tile can not be flushed, so the element is only locked to acquire it. Encoding therefore
+  // neither blocks the writer threads nor other readers.
+  bool is_cached;
+  {
+    std::lock_guard<std::mutex> lock(element->mutex);
+    version = element->version;
+    element->tile->lockShared();
+    is_cached = isCached(element);
+    if (!is_cached)
+      element->tile->unlockShared();
+  }
+
+  if (is_cached)
+  {
+    try
+    {
+      data = encodeTile(element->tile->data()->get(layer_name));
+    }
+    catch (...)
+    {
+      element->tile->unlockShared();
+      throw;
+    }
+    element->tile->unlockShared();
+    return true;
+  }
+
+  // Flushed tiles were written before, the encoding on disk is the same
+#ifdef WITH_SQLITE
+  if (m_use_mbtiles)
+    return getStore(*it_meta)->read(zoom_level, tx, ty, data);
+#endif
+
+  std::ifstream file(createTileFilename(zoom_level, tx, ty, *it_meta), std::ios::binary);
+  if (!file)
+    return false;
+  data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  return true;
+}
+
+void TileCache::prefetch(int zoom_level, const cv::Rect2i &roi_idx)
+{
+  std::vector<CacheElement::Ptr> elements;
+  {
+    auto lock = uniqueLockProfiled(m_mutex_cache, "Wait m_mutex_cache");
+    auto it_zoom = m_cache.find(zoom_level);
+    if (it_zoom == m_cache.end())
+      return;
+
+    for (auto it_tile_x = it_zoom->second.lower_bound(roi_idx.x);
+         it_tile_x != it_zoom->second.end() && it_tile_x->first < roi_idx.x + roi_idx.width; ++it_tile_x)
+      for (auto it_tile_xy = it_tile_x->second.lower_bound(roi_idx.y);
+           it_tile_xy != it_tile_x->second.end() && it_tile_xy->first < roi_idx.y + roi_idx.height; ++it_tile_xy)
+        elements.push_back(it_tile_xy->second);
+  }
+
+  // Predicted tiles should survive the next update
+  {
+    std::lock_guard<std::mutex> lock(m_mutex_roi_prediction);
+    auto it_roi_prediction = m_roi_prediction.find(zoom_level);
+    if (it_roi_prediction != m_roi_prediction.end())
+      it_roi_prediction->second |= roi_idx;
+  }
+
+  for (const auto &element : elements)
+  {
+    m_pool_writer.submit([this, element]()
+    {
+      std::lock_guard<std::mutex> lock(element->mutex);
+
+      // Tiles already in memory are the common case, they are checked without blocking readers
+      element->tile->lockShared();
+      bool is_cached = isCached(element);
+      element->tile->unlockShared();
+      if (element->is_outdated || is_cached)
+        return;
+
+      element->tile->lock();
+      try
+      {
+        if (!isCached(element))
+        {
+          load(element);
+          element->timestamp = getCurrentTimeMilliseconds();
+
+          std::lock_guard<std::mutex> lock_resident(m_mutex_resident_elements);
+          m_resident_elements.insert(element);
+        }
+      }
+      catch (const std::exception &e)
+      {
+        LOG_IF_F(WARNING, m_verbose, "Prefetching tile (%i, %i, %i) [zoom, x, y] failed: %s",
+                 element->tile->zoom_level(), element->tile->x(), element->tile->y(), e.what());
+      }
+      element->tile->unlock();
+    });
+  }
 }
 
 void TileCache::flushAll()
@@ -221,7 +571,9 @@ void TileCache::flushAll()
 
   LOG_IF_F(INFO, m_verbose, "Flushing all tiles...");
 
-  long t = getCurrentTimeMilliseconds();
+  ScopedTimer timer_flush_all("Flush All");
+
+  n_tiles_written += writeDirtyElements();
 
   for (auto &zoom_levels : m_cache)
     for (auto &cache_column : zoom_levels.second)
@@ -235,57 +587,299 @@ void TileCache::flushAll()
           n_tiles_written++;
         }
 
-        cache_element.second->tile->data() = nullptr;
+        // Layers are removed instead of the whole map, so the extent of the tile is kept and it can be loaded again
+        for (const auto &meta : cache_element.second->layer_meta)
+          cache_element.second->tile->data()->remove(meta.name);
         cache_element.second->tile->unlock();
       }
 
+  commitStores();
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex_resident_elements);
+    m_resident_elements.clear();
+  }
+
+  // Index is written next to the tiles, so reopening the tile set does not require scanning the directory tree
+  std::string dir_toplevel;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex_settings);
+    dir_toplevel = m_dir_toplevel;
+  }
+  if (!m_cache.empty() && !dir_toplevel.empty() && io::dirExists(dir_toplevel))
+  {
+    try
+    {
+      saveIndex(dir_toplevel + "/" + kIndexFilename);
+    }
+    catch (const std::exception &e)
+    {
+      LOG_F(WARNING, "Writing index of tile cache failed: %s", e.what());
+    }
+  }
+
   LOG_IF_F(INFO, m_verbose, "Tiles written: %i", n_tiles_written);
-  LOG_IF_F(INFO, m_verbose, "Timing [Flush All]: %lu ms", getCurrentTimeMilliseconds() - t);
+  timer_flush_all.stop();
 }
 
 void TileCache::loadAll()
 {
-  for (auto &zoom_levels : m_cache)
-    for (auto &cache_column : zoom_levels.second)
-      for (auto &cache_element : cache_column.second)
+  std::vector<CacheElement::Ptr> elements;
+  {
+    auto lock = uniqueLockProfiled(m_mutex_cache, "Wait m_mutex_cache");
+    for (const auto &zoom_levels : m_cache)
+      for (const auto &cache_column : zoom_levels.second)
+        for (const auto &cache_element : cache_column.second)
+          elements.push_back(cache_element.second);
+  }
+
+  ScopedTimer timer_load_all("Load All");
+
+  // Decoding dominates loading, tiles are independent and are therefore decoded concurrently
+  std::vector<std::future<void>> futures;
+  futures.reserve(elements.size());
+  for (const auto &element : elements)
+    futures.push_back(m_pool_writer.submit([this, element]()
+    {
+      std::lock_guard<std::mutex> lock(element->mutex);
+      element->tile->lock();
+      try
       {
-        std::lock_guard<std::mutex> lock(cache_element.second->mutex);
-        cache_element.second->tile->lock();
-        if (!isCached(cache_element.second))
-          load(cache_element.second);
-        cache_element.second->tile->unlock();
+        if (!isCached(element))
+        {
+          load(element);
+
+          std::lock_guard<std::mutex> lock_resident(m_mutex_resident_elements);
+          m_resident_elements.insert(element);
+        }
+      }
+      catch (...)
+      {
+        element->tile->unlock();
+        throw;
       }
+      element->tile->unlock();
+    }));
+
+  // All tasks must be finished before rethrowing any exception, as the caller expects no loads in flight afterwards
+  for (auto &f : futures)
+    f.wait();
+  for (auto &f : futures)
+    f.get();
+
+  LOG_IF_F(INFO, m_verbose, "Tiles loaded: %lu", elements.size());
+  timer_load_all.stop();
+}
+
+void TileCache::saveIndex(const std::string &filepath)
+{
+  struct IndexEntry
+  {
+    int zoom_level;
+    int tx;
+    int ty;
+    uint64_t version;
+    cv::Rect2d roi;
+    double resolution;
+    std::vector<LayerMetaData> layer_meta;
+  };
+
+  // Entries are collected first, so the cache is not blocked while writing the file
+  std::vector<IndexEntry> entries;
+  {
+    auto lock = uniqueLockProfiled(m_mutex_cache, "Wait m_mutex_cache");
+    for (const auto &zoom_levels : m_cache)
+      for (const auto &cache_column : zoom_levels.second)
+        for (const auto &cache_element : cache_column.second)
+        {
+          const CacheElement::Ptr &element = cache_element.second;
+          std::lock_guard<std::mutex> lock_element(element->mutex);
+          if (!element->was_written || element->is_outdated)
+            continue;
+
+          element->tile->lockShared();
+          if (element->tile->data())
+            entries.push_back(IndexEntry{zoom_levels.first, cache_column.first, cache_element.first, element->version,
+                                         element->tile->data()->roi(), element->tile->data()->resolution(),
+                                         element->layer_meta});
+          element->tile->unlockShared();
+        }
+  }
+
+  std::string dir_toplevel;
+  bool use_mbtiles;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex_settings);
+    dir_toplevel = m_dir_toplevel;
+    use_mbtiles = m_use_mbtiles;
+  }
+
+  std::ofstream file(filepath, std::ios::binary);
+  if (!file)
+    throw(std::runtime_error("Error writing tile index: Could not open '" + filepath + "'!"));
+
+  auto write_value = [&file](const auto &value) { file.write(reinterpret_cast<const char*>(&value), sizeof(value)); };
+  auto write_string = [&](const std::string &str)
+  {
+    write_value((uint32_t)str.size());
+    file.write(str.data(), str.size());
+  };
+
+  file.write(kIndexMagic, sizeof(kIndexMagic));
+  write_value(kIndexVersion);
+  write_string(dir_toplevel);
+  write_value((uint8_t)use_mbtiles);
+  write_value((uint64_t)entries.size());
+  for (const auto &entry : entries)
+  {
+    write_value(entry.zoom_level);
+    write_value(entry.tx);
+    write_value(entry.ty);
+    write_value(entry.version);
+    write_value(entry.roi.x);
+    write_value(entry.roi.y);
+    write_value(entry.roi.width);
+    write_value(entry.roi.height);
+    write_value(entry.resolution);
+    write_value((uint32_t)entry.layer_meta.size());
+    for (const auto &meta : entry.layer_meta)
+    {
+      write_string(meta.name);
+      write_value(meta.type);
+      write_value(meta.interpolation_flag);
+    }
+  }
+
+  if (!file)
+    throw(std::runtime_error("Error writing tile index: Writing '" + filepath + "' failed!"));
+}
+
+size_t TileCache::loadIndex(const std::string &filepath)
+{
+  std::ifstream file(filepath, std::ios::binary);
+  if (!file)
+    throw(std::runtime_error("Error reading tile index: Could not open '" + filepath + "'!"));
+
+  auto read_value = [&file](auto &value)
+  {
+    if (!file.read(reinterpret_cast<char*>(&value), sizeof(value)))
+      throw(std::runtime_error("Error reading tile index: Unexpected end of file!"));
+  };
+  auto read_string = [&]()
+  {
+    uint32_t size;
+    read_value(size);
+    std::string str(size, '\0');
+    if (size > 0 && !file.read(&str[0], size))
+      throw(std::runtime_error("Error reading tile index: Unexpected end of file!"));
+    return str;
+  };
+
+  char magic[sizeof(kIndexMagic)];
+  uint32_t version;
+  read_value(magic);
+  read_value(version);
+  if (memcmp(magic, kIndexMagic, sizeof(kIndexMagic)) != 0 || version != kIndexVersion)
+    throw(std::runtime_error("Error reading tile index: '" + filepath + "' is no tile index of this version!"));
+
+  std::string dir_toplevel = read_string();
+  uint8_t use_mbtiles;
+  read_value(use_mbtiles);
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex_settings);
+    if ((bool)use_mbtiles != m_use_mbtiles)
+      throw(std::runtime_error("Error reading tile index: Index was written for a different tile storage!"));
+  }
+
+  uint64_t nrof_entries;
+  read_value(nrof_entries);
+
+  long timestamp = getCurrentTimeMilliseconds();
+
+  std::map<int, CacheElementGrid> cache;
+  for (uint64_t i = 0; i < nrof_entries; ++i)
+  {
+    int zoom_level, tx, ty;
+    uint64_t tile_version;
+    cv::Rect2d roi;
+    double resolution;
+    uint32_t nrof_layers;
+    read_value(zoom_level);
+    read_value(tx);
+    read_value(ty);
+    read_value(tile_version);
+    read_value(roi.x);
+    read_value(roi.y);
+    read_value(roi.width);
+    read_value(roi.height);
+    read_value(resolution);
+    read_value(nrof_layers);
+
+    std::vector<LayerMetaData> layer_meta(nrof_layers);
+    for (auto &meta : layer_meta)
+    {
+      meta.name = read_string();
+      read_value(meta.type);
+      read_value(meta.interpolation_flag);
+    }
+
+    // Tiles are restored without data, which marks them as flushed
+    auto tile = std::make_shared<Tile>(zoom_level, tx, ty, CvGridMap(roi, resolution));
+    CacheElement::Ptr element(new CacheElement{timestamp, layer_meta, tile, true});
+    element->version = tile_version;
+    cache[zoom_level][tx][ty] = element;
+  }
+
+  // Cache is only changed once the index was read completely
+  {
+    std::lock_guard<std::mutex> lock(m_mutex_settings);
+    m_dir_toplevel = dir_toplevel;
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_mutex_dirty_elements);
+    m_dirty_elements.clear();
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_mutex_resident_elements);
+    m_resident_elements.clear();
+  }
+
+  auto lock = uniqueLockProfiled(m_mutex_cache, "Wait m_mutex_cache");
+  m_cache.swap(cache);
+  m_has_init_directories = false;
+
+  LOG_IF_F(INFO, m_verbose, "Restored %lu tiles from index '%s'", (unsigned long)nrof_entries, filepath.c_str());
+  return nrof_entries;
 }
 
 void TileCache::load(const CacheElement::Ptr &element) const
 {
   for (const auto &meta : element->layer_meta)
   {
-    std::string filename = m_dir_toplevel + "/"
-                           + meta.name + "/"
-                           + std::to_string(element->tile->zoom_level()) + "/"
-                           + std::to_string(element->tile->x()) + "/"
-                           + std::to_string(element->tile->y());
-
-    int type = meta.type & CV_MAT_DEPTH_MASK;
+    // Spilled copies are preferred, as they are read without decoding
+    if (element->was_spilled)
+    {
+      element->tile->data()->add(meta.name, io::loadImageFromBinary(createSpillFilename(element, meta)), meta.interpolation_flag);
+      continue;
+    }
 
-    switch(type)
+#ifdef WITH_SQLITE
+    if (m_use_mbtiles)
     {
-      case CV_8U:
-        filename += ".png";
-        break;
-      case CV_16U:
-        filename += ".bin";
-        break;
-      case CV_32F:
-        filename += ".bin";
-        break;
-      case CV_64F:
-        filename += ".bin";
-        break;
-      default:
-        throw(std::invalid_argument("Error reading tile: data type unknown!"));
+      std::vector<uint8_t> buffer;
+      if (!getStore(meta)->read(element->tile->zoom_level(), element->tile->x(), element->tile->y(), buffer))
+      {
+        LOG_IF_F(WARNING, m_verbose, "Failed reading tile (%i, %i, %i) [zoom, x, y] of layer '%s' from MBTiles",
+                 element->tile->zoom_level(), element->tile->x(), element->tile->y(), meta.name.c_str());
+        throw(std::invalid_argument("Error loading tile."));
+      }
+      element->tile->data()->add(meta.name, decodeTile(buffer, meta.type), meta.interpolation_flag);
+      continue;
     }
+#endif
+
+    std::string filename = createTileFilename(element->tile->zoom_level(), element->tile->x(), element->tile->y(), meta);
 
     if (io::fileExists(filename))
     {
@@ -309,43 +903,66 @@ void TileCache::write(const CacheElement::Ptr &element) const
   {
     cv::Mat data = element->tile->data()->get(meta.name);
 
-    std::string filename = m_dir_toplevel + "/"
-                           + meta.name + "/"
-                           + std::to_string(element->tile->zoom_level()) + "/"
-                           + std::to_string(element->tile->x()) + "/"
-                           + std::to_string(element->tile->y());
-
-    int type = data.type() & CV_MAT_DEPTH_MASK;
-
-    switch(type)
+#ifdef WITH_SQLITE
+    if (m_use_mbtiles)
     {
-      case CV_8U:
-        filename += ".png";
-        break;
-      case CV_16U:
-        filename += ".bin";
-        break;
-      case CV_32F:
-        filename += ".bin";
-        break;
-      case CV_64F:
-        filename += ".bin";
-        break;
-      default:
-        throw(std::invalid_argument("Error writing tile: data type unknown!"));
+      getStore(meta)->write(element->tile->zoom_level(), element->tile->x(), element->tile->y(), encodeTile(data));
+      element->was_written = true;
+      continue;
     }
+#endif
 
-    io::saveImage(data, filename);
+    io::saveImage(data, createTileFilename(element->tile->zoom_level(), element->tile->x(), element->tile->y(), meta));
 
     element->was_written = true;
   }
 }
 
+int TileCache::writeDirtyElements()
+{
+  std::deque<CacheElement::Ptr> elements;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex_dirty_elements);
+    elements.swap(m_dirty_elements);
+  }
+
+  std::atomic<int> n_tiles_written{0};
+
+  std::vector<std::future<void>> futures;
+  futures.reserve(elements.size());
+  for (const auto &element : elements)
+    futures.push_back(m_pool_writer.submit([this, element, &n_tiles_written]()
+    {
+      // Writing only reads the tile data, the flag is protected by the element
+      std::lock_guard<std::mutex> lock(element->mutex);
+      element->tile->lockShared();
+      if (!element->was_written && !element->is_outdated)
+      {
+        write(element);
+        n_tiles_written++;
+      }
+      element->tile->unlockShared();
+    }));
+
+  // All tasks must be finished before rethrowing any exception, as they reference the local counter
+  for (auto &f : futures)
+    f.wait();
+  for (auto &f : futures)
+    f.get();
+
+  commitStores();
+
+  return n_tiles_written;
+}
+
 void TileCache::flush(const CacheElement::Ptr &element) const
 {
   if (!element->was_written)
     write(element);
 
+  if (!m_dir_spill.empty())
+    spill(element);
+
   for (const auto &meta : element->layer_meta)
   {
     element->tile->data()->remove(meta.name);
@@ -354,6 +971,85 @@ void TileCache::flush(const CacheElement::Ptr &element) const
   LOG_IF_F(INFO, m_verbose, "Flushed tile (%i, %i, %i) [zoom, x, y]", element->tile->zoom_level(), element->tile->x(), element->tile->y());
 }
 
+void TileCache::spill(const CacheElement::Ptr &element) const
+{
+  // Tile data of an element is never modified, newer data is added as a new element. So one copy is sufficient.
+  if (element->was_spilled)
+    return;
+
+  for (const auto &meta : element->layer_meta)
+    io::saveImageToBinary(element->tile->data()->get(meta.name), createSpillFilename(element, meta));
+
+  element->was_spilled = true;
+}
+
+std::string TileCache::createTileFilename(int zoom_level, int tx, int ty, const LayerMetaData &meta) const
+{
+  std::string filename = m_dir_toplevel + "/"
+                         + meta.name + "/"
+                         + std::to_string(zoom_level) + "/"
+                         + std::to_string(tx) + "/"
+                         + std::to_string(ty);
+
+  int type = meta.type & CV_MAT_DEPTH_MASK;
+
+  switch(type)
+  {
+    case CV_8U:
+      filename += ".png";
+      break;
+    case CV_16U:
+      filename += ".bin";
+      break;
+    case CV_32F:
+      filename += ".bin";
+      break;
+    case CV_64F:
+      filename += ".bin";
+      break;
+#ifdef CV_16F
+    case CV_16F:
+      filename += ".bin";
+      break;
+#endif
+    default:
+      throw(std::invalid_argument("Error creating tile filename: data type unknown!"));
+  }
+  return filename;
+}
+
+std::string TileCache::createSpillFilename(const CacheElement::Ptr &element, const LayerMetaData &meta) const
+{
+  return m_dir_spill + "/" + meta.name + "_" + std::to_string(element->tile->zoom_level()) + "_"
+         + std::to_string(element->tile->x()) + "_" + std::to_string(element->tile->y()) + ".bin";
+}
+
+std::shared_ptr<io::MbtilesStore> TileCache::getStore(const LayerMetaData &meta) const
+{
+#ifdef WITH_SQLITE
+  std::lock_guard<std::mutex> lock(m_mutex_stores);
+  auto it_store = m_stores.find(meta.name);
+  if (it_store != m_stores.end())
+    return it_store->second;
+
+  std::string format = ((meta.type & CV_MAT_DEPTH_MASK) == CV_8U ? "png" : "bin");
+  auto store = std::make_shared<io::MbtilesStore>(m_dir_toplevel + "/" + meta.name + ".mbtiles", meta.name, format);
+  m_stores[meta.name] = store;
+  return store;
+#else
+  throw(std::runtime_error("Error: OpenREALM was built without SQLite support."));
+#endif
+}
+
+void TileCache::commitStores()
+{
+#ifdef WITH_SQLITE
+  std::lock_guard<std::mutex> lock(m_mutex_stores);
+  for (auto &store : m_stores)
+    store.second->commit();
+#endif
+}
+
 bool TileCache::isCached(const CacheElement::Ptr &element) const
 {
   return !(element->tile->data()->empty());
@@ -361,12 +1057,23 @@ bool TileCache::isCached(const CacheElement::Ptr &element) const
 
 size_t TileCache::estimateByteSize(const Tile::Ptr &tile) const
 {
-  tile->lock();
-  //size_t bytes = tile->data().total() * tile->data().elemSize();
-  tile->unlock();
+  tile->lockShared();
+  size_t bytes = (tile->data() ? tile->data()->getByteSize() : 0);
+  tile->unlockShared();
+
+  return bytes;
+}
 
-  //return bytes;
-  return 0;
+size_t TileCache::getByteSize()
+{
+  auto lock = uniqueLockProfiled(m_mutex_cache, "Wait m_mutex_cache");
+
+  size_t bytes = 0;
+  for (const auto &zoom_levels : m_cache)
+    for (const auto &cache_column : zoom_levels.second)
+      for (const auto &cache_element : cache_column.second)
+        bytes += estimateByteSize(cache_element.second->tile);
+  return bytes;
 }
 
 void TileCache::updatePrediction(int zoom_level, const cv::Rect2i &roi_current)
@@ -392,13 +1099,33 @@ void TileCache::updatePrediction(int zoom_level, const cv::Rect2i &roi_current)
     it_roi_prediction->second.height = roi_current.height + (roi_current.height - it_roi_prev_request->second.height);
   }
 
-  it_roi_prev_request->second = roi_current;
+  m_roi_prev_request[zoom_level] = roi_current;
 }
 
 void TileCache::createDirectories(const std::string &toplevel, const std::vector<std::string> &layer_names, const std::string &tile_tree)
 {
   for (const auto &layer_name : layer_names)
   {
-    io::createDir(toplevel + layer_name + tile_tree);
+    std::string dir = toplevel + layer_name + tile_tree;
+    if (m_dirs_created.insert(dir).second)
+      io::createDir(dir);
   }
+}
+
+void TileCache::createPredictedDirectories(int zoom_level, const std::vector<std::string> &layer_names)
+{
+  cv::Rect2i roi;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex_roi_prediction);
+    roi = m_roi_prediction.at(zoom_level);
+  }
+
+  // Prediction is an extrapolation, so it is limited to the valid tile indices of the zoom level
+  int tx_max = (1 << zoom_level) - 1;
+  int tx_first = std::max(roi.x, 0);
+  int tx_last = std::min(roi.x + roi.width, tx_max);
+
+  std::string dir_zoom = "/" + std::to_string(zoom_level) + "/";
+  for (int tx = tx_first; tx <= tx_last; ++tx)
+    createDirectories(m_dir_toplevel + "/", layer_names, dir_zoom + std::to_string(tx));
 }
\ No newline at end of file
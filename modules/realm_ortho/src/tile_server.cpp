@@ -0,0 +1,217 @@
+
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <realm_core/loguru.h>
+
+#include <realm_ortho/tile_server.h>
+
+using namespace realm;
+
+namespace
+{
+
+std::string createStatusResponse(const std::string &status)
+{
+  return "HTTP/1.1 " + status + "\r\n"
+         "Content-Length: 0\r\n"
+         "Access-Control-Allow-Origin: *\r\n"
+         "Connection: close\r\n\r\n";
+}
+
+} // namespace
+
+TileServer::TileServer(const TileCache::Ptr &tile_cache, int port, const std::string &address, int nrof_threads)
+    : m_tile_cache(tile_cache),
+      m_port(port),
+      m_address(address),
+      m_socket(-1),
+      m_is_running(false),
+      m_pool(nrof_threads)
+{
+  if (!tile_cache)
+    throw(std::invalid_argument("Error: Tile server requires a tile cache."));
+  if (port <= 0 || port > 65535)
+    throw(std::invalid_argument("Error: Port of tile server out of range: " + std::to_string(port)));
+}
+
+TileServer::~TileServer()
+{
+  stop();
+}
+
+void TileServer::start()
+{
+  if (m_is_running)
+    return;
+
+  m_socket = socket(AF_INET, SOCK_STREAM, 0);
+  if (m_socket < 0)
+    throw(std::runtime_error("Error: Could not create socket for tile server."));
+
+  int reuse = 1;
+  setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(static_cast<uint16_t>(m_port));
+  if (inet_pton(AF_INET, m_address.c_str(), &addr.sin_addr) != 1
+      || bind(m_socket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0
+      || listen(m_socket, 64) < 0)
+  {
+    close(m_socket);
+    m_socket = -1;
+    throw(std::runtime_error("Error: Could not bind tile server to " + m_address + ":" + std::to_string(m_port)));
+  }
+
+  m_is_running = true;
+  m_thread = std::thread(&TileServer::serve, this);
+  LOG_F(INFO, "Serving tiles on %s:%i", m_address.c_str(), m_port);
+}
+
+void TileServer::stop()
+{
+  if (!m_is_running)
+    return;
+
+  m_is_running = false;
+  if (m_thread.joinable())
+    m_thread.join();
+  close(m_socket);
+  m_socket = -1;
+}
+
+bool TileServer::parsePath(const std::string &path, Request &request)
+{
+  std::string p = path.substr(0, path.find('?'));
+
+  // Layer names are plain identifiers, so "/<layer>/<zoom>/<x>/<y>.<extension>" is split at the slashes
+  char layer_name[64];
+  char extension[8];
+  int nrof_chars = 0;
+  if (std::sscanf(p.c_str(), "/%63[A-Za-z0-9_]/%d/%d/%d.%7[a-z]%n", layer_name, &request.zoom_level, &request.tx,
+                  &request.ty, extension, &nrof_chars) != 5 || static_cast<size_t>(nrof_chars) != p.size())
+    return false;
+
+  std::string ext(extension);
+  if (ext != "png" && ext != "bin")
+    return false;
+
+  request.layer_name = layer_name;
+  return request.zoom_level >= 0 && request.tx >= 0 && request.ty >= 0;
+}
+
+std::string TileServer::createResponse(const std::string &request_header)
+{
+  std::istringstream stream(request_header);
+  std::string method, path;
+  if (!(stream >> method >> path) || method != "GET")
+    return createStatusResponse("400 Bad Request");
+
+  Request request;
+  if (!parsePath(path, request))
+    return createStatusResponse("404 Not Found");
+
+  std::vector<uint8_t> data;
+  uint64_t version = 0;
+  try
+  {
+    if (!m_tile_cache->readEncoded(request.zoom_level, request.tx, request.ty, request.layer_name, data, version))
+      return createStatusResponse("404 Not Found");
+  }
+  catch (const std::exception &e)
+  {
+    LOG_F(WARNING, "Reading tile for request '%s' failed: %s", path.c_str(), e.what());
+    return createStatusResponse("500 Internal Server Error");
+  }
+
+  // Entity tag changes with every update of the tile. A client having the current version gets no body.
+  std::string etag = "\"" + std::to_string(request.zoom_level) + "-" + std::to_string(request.tx) + "-"
+                     + std::to_string(request.ty) + "-" + std::to_string(version) + "\"";
+  std::string line;
+  while (std::getline(stream, line))
+  {
+    std::string key = "If-None-Match:";
+    if (line.size() > key.size() && strncasecmp(line.c_str(), key.c_str(), key.size()) == 0
+        && line.find(etag) != std::string::npos)
+      return "HTTP/1.1 304 Not Modified\r\n"
+             "ETag: " + etag + "\r\n"
+             "Access-Control-Allow-Origin: *\r\n"
+             "Connection: close\r\n\r\n";
+  }
+
+  // 8 bit layers are png, all others binary. The type is told by the data, not by the extension of the request.
+  bool is_png = (data.size() > 4 && data[0] == 0x89 && data[1] == 'P' && data[2] == 'N' && data[3] == 'G');
+  std::string response = "HTTP/1.1 200 OK\r\n"
+                         "Content-Type: " + std::string(is_png ? "image/png" : "application/octet-stream") + "\r\n"
+                         "Content-Length: " + std::to_string(data.size()) + "\r\n"
+                         "ETag: " + etag + "\r\n"
+                         "Cache-Control: no-cache\r\n"
+                         "Access-Control-Allow-Origin: *\r\n"
+                         "Connection: close\r\n\r\n";
+  response.append(data.begin(), data.end());
+  return response;
+}
+
+void TileServer::serve()
+{
+  while (m_is_running)
+  {
+    // Wake up regularly to check for stop requests
+    pollfd fd{m_socket, POLLIN, 0};
+    if (poll(&fd, 1, 200) <= 0)
+      continue;
+
+    int connection = accept(m_socket, nullptr, nullptr);
+    if (connection < 0)
+      continue;
+
+    m_pool.submit([this, connection]()
+    {
+      respond(connection);
+      close(connection);
+    });
+  }
+}
+
+void TileServer::respond(int connection)
+{
+  // Only the header is needed, requests for tiles have no body
+  std::string request;
+  char buffer[2048];
+  while (request.find("\r\n\r\n") == std::string::npos && request.size() < 16384)
+  {
+    pollfd fd{connection, POLLIN, 0};
+    if (poll(&fd, 1, 1000) <= 0)
+      break;
+    ssize_t n = recv(connection, buffer, sizeof(buffer), 0);
+    if (n <= 0)
+      break;
+    request.append(buffer, static_cast<size_t>(n));
+  }
+
+  std::string response = createResponse(request);
+
+  size_t nrof_sent = 0;
+  while (nrof_sent < response.size())
+  {
+    ssize_t n = send(connection, response.data() + nrof_sent, response.size() - nrof_sent, MSG_NOSIGNAL);
+    if (n <= 0)
+    {
+      LOG_F(WARNING, "Sending tile failed: %s", std::strerror(errno));
+      return;
+    }
+    nrof_sent += static_cast<size_t>(n);
+  }
+}
@@ -0,0 +1,213 @@
+
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include <realm_ortho/tiled_mesher.h>
+
+using namespace realm;
+
+namespace
+{
+
+// FNV-1a, only used to detect changes of the sampled vertices, not for security
+const uint64_t g_fnv_offset = 14695981039346656037ull;
+const uint64_t g_fnv_prime = 1099511628211ull;
+
+inline void hashBytes(uint64_t &hash, const void* data, size_t size)
+{
+  const auto bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; ++i)
+  {
+    hash ^= bytes[i];
+    hash *= g_fnv_prime;
+  }
+}
+
+} // namespace
+
+TiledMesher::TiledMesher(double tile_size, double resolution)
+    : m_tile_size(tile_size),
+      m_resolution(resolution),
+      m_nrof_quads(0)
+{
+  if (tile_size <= 0.0)
+    throw(std::invalid_argument("Error creating tiled mesher: Tile size must be positive."));
+  if (m_resolution > 0.0)
+    m_nrof_quads = std::max(static_cast<int>(std::round(m_tile_size / m_resolution)), 1);
+}
+
+std::vector<MeshTile> TiledMesher::update(const CvGridMap &map,
+                                          const std::string &layer_elevation,
+                                          const std::string &layer_color,
+                                          const cv::Rect2d &roi_update)
+{
+  std::vector<MeshTile> tiles_changed;
+
+  cv::Rect2d roi = roi_update & map.roi();
+  if (roi.area() <= 0.0 || !map.exists(layer_elevation))
+    return tiles_changed;
+
+  if (m_nrof_quads == 0)
+  {
+    m_resolution = map.resolution();
+    m_nrof_quads = std::max(static_cast<int>(std::round(m_tile_size / m_resolution)), 1);
+  }
+
+  cv::Mat elevation = map[layer_elevation];
+  if (elevation.type() != CV_32FC1)
+    elevation.convertTo(elevation, CV_32FC1);
+
+  cv::Mat color;
+  if (!layer_color.empty() && map.exists(layer_color))
+  {
+    color = map[layer_color];
+    if (color.type() != CV_8UC4)
+      throw(std::invalid_argument("Error updating mesh: Color layer must be of type CV_8UC4."));
+  }
+
+  // Vertices on the border of a tile are shared with the neighbour, so an update on the border touches both tiles
+  double edge = m_nrof_quads * m_resolution;
+  auto tx0 = static_cast<int>(std::floor(roi.x / edge));
+  auto ty0 = static_cast<int>(std::floor(roi.y / edge));
+  auto tx1 = static_cast<int>(std::floor((roi.x + roi.width) / edge));
+  auto ty1 = static_cast<int>(std::floor((roi.y + roi.height) / edge));
+
+  for (int ty = ty0; ty <= ty1; ++ty)
+    for (int tx = tx0; tx <= tx1; ++tx)
+    {
+      uint64_t hash;
+      MeshTile tile = triangulateTile(map, elevation, color, tx, ty, hash);
+
+      auto it = m_tiles.find(std::make_pair(tx, ty));
+      if (it != m_tiles.end() && it->second.hash == hash)
+        continue;
+
+      if (tile.faces.empty())
+      {
+        // Tiles that lost all their faces are reported once, so receivers can remove them
+        if (it != m_tiles.end())
+        {
+          m_tiles.erase(it);
+          tiles_changed.push_back(tile);
+        }
+        continue;
+      }
+
+      m_tiles[std::make_pair(tx, ty)] = CachedTile{hash, tile};
+      tiles_changed.push_back(std::move(tile));
+    }
+  return tiles_changed;
+}
+
+std::vector<Face> TiledMesher::getFaces() const
+{
+  size_t nrof_faces = 0;
+  for (const auto &tile : m_tiles)
+    nrof_faces += tile.second.tile.faces.size();
+
+  std::vector<Face> faces;
+  faces.reserve(nrof_faces);
+  for (const auto &tile : m_tiles)
+    faces.insert(faces.end(), tile.second.tile.faces.begin(), tile.second.tile.faces.end());
+  return faces;
+}
+
+size_t TiledMesher::getNrofTiles() const
+{
+  return m_tiles.size();
+}
+
+void TiledMesher::clear()
+{
+  m_tiles.clear();
+}
+
+MeshTile TiledMesher::triangulateTile(const CvGridMap &map, const cv::Mat &elevation, const cv::Mat &color, int tx, int ty,
+                                      uint64_t &hash) const
+{
+  int n = m_nrof_quads;
+  double edge = n * m_resolution;
+
+  MeshTile tile;
+  tile.x = tx;
+  tile.y = ty;
+  tile.roi = cv::Rect2d(tx * edge, ty * edge, edge, edge);
+
+  cv::Rect2d roi_map = map.roi();
+  double resolution_map = map.resolution();
+
+  // Vertices are sampled at fixed world positions from the nearest grid cell, row j = 0 is the southern border
+  std::vector<cv::Point3d> vertices((n + 1) * (n + 1));
+  std::vector<cv::Vec4b> colors((n + 1) * (n + 1), cv::Vec4b(0, 0, 0, 255));
+  std::vector<uint8_t> is_valid((n + 1) * (n + 1), 0);
+
+  hash = g_fnv_offset;
+  for (int j = 0; j <= n; ++j)
+    for (int i = 0; i <= n; ++i)
+    {
+      double x = (static_cast<double>(tx) * n + i) * m_resolution;
+      double y = (static_cast<double>(ty) * n + j) * m_resolution;
+      auto c = static_cast<int>(std::round((x - roi_map.x) / resolution_map));
+      auto r = static_cast<int>(std::round((roi_map.y + roi_map.height - y) / resolution_map));
+
+      int idx = j * (n + 1) + i;
+      if (r >= 0 && r < elevation.rows && c >= 0 && c < elevation.cols)
+      {
+        float z = elevation.at<float>(r, c);
+        if (std::isfinite(z))
+        {
+          is_valid[idx] = 1;
+          vertices[idx] = cv::Point3d(x, y, z);
+          if (!color.empty())
+            colors[idx] = color.at<cv::Vec4b>(r, c);
+          hashBytes(hash, &z, sizeof(float));
+          hashBytes(hash, colors[idx].val, 4);
+        }
+      }
+      hashBytes(hash, &is_valid[idx], 1);
+    }
+
+  auto addFace = [&](int a, int b, int c)
+  {
+    Face face;
+    face.vertices[0] = vertices[a];
+    face.vertices[1] = vertices[b];
+    face.vertices[2] = vertices[c];
+    face.color[0] = colors[a];
+    face.color[1] = colors[b];
+    face.color[2] = colors[c];
+    tile.faces.push_back(face);
+  };
+
+  // Quads with four valid vertices are split into two faces, quads with three into one. All faces are counter
+  // clockwise seen from above.
+  for (int j = 0; j < n; ++j)
+    for (int i = 0; i < n; ++i)
+    {
+      int v00 = j * (n + 1) + i;
+      int v10 = v00 + 1;
+      int v01 = v00 + (n + 1);
+      int v11 = v01 + 1;
+
+      int nrof_valid = is_valid[v00] + is_valid[v10] + is_valid[v01] + is_valid[v11];
+      if (nrof_valid == 4)
+      {
+        addFace(v00, v10, v11);
+        addFace(v00, v11, v01);
+      }
+      else if (nrof_valid == 3)
+      {
+        if (!is_valid[v00])
+          addFace(v10, v11, v01);
+        else if (!is_valid[v10])
+          addFace(v00, v11, v01);
+        else if (!is_valid[v11])
+          addFace(v00, v10, v01);
+        else
+          addFace(v00, v10, v11);
+      }
+    }
+  return tile;
+}
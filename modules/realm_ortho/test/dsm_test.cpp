@@ -0,0 +1,135 @@
+
+
+#include <iostream>
+#include <realm_ortho/dsm.h>
+
+// gtest
+#include <gtest/gtest.h>
+
+using namespace realm;
+using namespace realm::ortho;
+
+TEST(DigitalSurfaceModel, HierarchicalEqualsFull)
+{
+  // For this test we create a regular point cloud of a slightly tilted plane with a gap in the middle. The elevation
+  // surface is computed once for every cell and once hierarchical. As the plane is flat, most of the blocks are
+  // interpolated, while the gap has to stay empty in both cases. Points are shifted by half a cell to the grid, so no
+  // point is located exactly on a cell.
+  cv::Mat points;
+  for (int y = 0; y <= 100; ++y)
+    for (int x = 0; x <= 100; ++x)
+    {
+      if (x > 40 && x < 60 && y > 40 && y < 60)
+        continue;
+      cv::Mat pt = (cv::Mat_<double>(1, 3) << 600000.5 + x, 5700000.5 + y, 100.0 + 0.01*x);
+      points.push_back(pt);
+    }
+
+  cv::Rect2d roi(600000.0, 5700000.0, 100.0, 100.0);
+  DigitalSurfaceModel dsm_full(roi, points, DigitalSurfaceModel::SurfaceNormalMode::NONE, 5, 0, 1, 0.0);
+  DigitalSurfaceModel dsm_hierarchical(roi, points, DigitalSurfaceModel::SurfaceNormalMode::NONE, 5, 0, 4, 0.1);
+
+  const cv::Mat &elevation_full = (*dsm_full.getSurfaceGrid())["elevation"];
+  const cv::Mat &elevation_hierarchical = (*dsm_hierarchical.getSurfaceGrid())["elevation"];
+
+  ASSERT_EQ(elevation_full.size(), elevation_hierarchical.size());
+
+  int nrof_nan = 0;
+  int nrof_valid = 0;
+  for (int r = 0; r < elevation_full.rows; ++r)
+    for (int c = 0; c < elevation_full.cols; ++c)
+    {
+      float e_full = elevation_full.at<float>(r, c);
+      float e_hierarchical = elevation_hierarchical.at<float>(r, c);
+      if (e_full != e_full)
+      {
+        EXPECT_NE(e_hierarchical, e_hierarchical);
+        nrof_nan++;
+      }
+      else
+      {
+        EXPECT_NEAR(e_full, e_hierarchical, 0.05);
+        nrof_valid++;
+      }
+    }
+
+  EXPECT_GT(nrof_nan, 0);
+  EXPECT_GT(nrof_valid, nrof_nan);
+}
+
+TEST(DigitalSurfaceModel, RasterizedDepthmap)
+{
+  // For this test we create the depth map of a nadir camera at 100m above a flat ground at 50m with a block of 10m
+  // height in the center of the image. The rasterized surface must be at the ground and the block elevation, with a
+  // resolution of the pixel footprint and flat normals on the ground.
+  camera::Pinhole cam(500.0, 500.0, 200.0, 200.0, 400, 400);
+  cv::Mat pose = cv::Mat::zeros(3, 4, CV_64F);
+  pose.at<double>(0, 0) = 1.0;
+  pose.at<double>(1, 1) = -1.0;
+  pose.at<double>(2, 2) = -1.0;
+  pose.at<double>(0, 3) = 600000.0;
+  pose.at<double>(1, 3) = 5700000.0;
+  pose.at<double>(2, 3) = 150.0;
+  cam.setPose(pose);
+
+  cv::Mat depth(400, 400, CV_32F, cv::Scalar(100.0f));
+  depth(cv::Rect(150, 150, 100, 100)).setTo(90.0f);
+  auto depthmap = std::make_shared<Depthmap>(depth, cam);
+
+  cv::Rect2d roi(600000.0 - 40.0, 5700000.0 - 40.0, 80.0, 80.0);
+  DigitalSurfaceModel dsm(roi, depthmap, DigitalSurfaceModel::SurfaceNormalMode::BEST_FIT, 0);
+
+  CvGridMap::Ptr surface = dsm.getSurfaceGrid();
+  EXPECT_NEAR(surface->resolution(), 0.2, 1e-6);
+  ASSERT_TRUE(surface->exists("elevation_normal"));
+
+  cv::Point2i idx_ground = surface->atIndex(cv::Point2d(600000.0 - 30.0, 5700000.0 + 30.0));
+  cv::Point2i idx_block = surface->atIndex(cv::Point2d(600000.0, 5700000.0));
+  const cv::Mat &elevation = (*surface)["elevation"];
+  const cv::Mat &normals = (*surface)["elevation_normal"];
+  EXPECT_NEAR(elevation.at<float>(idx_ground.y, idx_ground.x), 50.0f, 1e-3);
+  EXPECT_NEAR(elevation.at<float>(idx_block.y, idx_block.x), 60.0f, 1e-3);
+  EXPECT_NEAR(normals.at<cv::Vec3f>(idx_ground.y, idx_ground.x)[2], 1.0f, 1e-5);
+
+  // Ground is seen with a pixel footprint of 0.2m, so only the cells occluded next to the block may stay unobserved
+  EXPECT_GT(cv::countNonZero(elevation == elevation), static_cast<int>(0.95 * elevation.total()));
+}
+
+TEST(DigitalSurfaceModel, PointsOutsideRoiCulled)
+{
+  // For this test we create a regular point cloud of a plane inside the region of interest and add a much sparser
+  // cluster with a different elevation 5km away, like map points tracked far outside the footprint. Without culling
+  // the cluster would distort the estimated resolution, with culling both surfaces must be identical.
+  cv::Mat points;
+  for (int y = 0; y <= 50; ++y)
+    for (int x = 0; x <= 50; ++x)
+    {
+      cv::Mat pt = (cv::Mat_<double>(1, 3) << 600000.5 + x, 5700000.5 + y, 100.0);
+      points.push_back(pt);
+    }
+  cv::Mat points_with_outliers = points.clone();
+  for (int y = 0; y < 50; ++y)
+    for (int x = 0; x < 50; ++x)
+    {
+      cv::Mat pt = (cv::Mat_<double>(1, 3) << 605000.0 + 20.0*x, 5700000.0 + 20.0*y, 300.0);
+      points_with_outliers.push_back(pt);
+    }
+
+  cv::Rect2d roi(600000.0, 5700000.0, 50.0, 50.0);
+  DigitalSurfaceModel dsm(roi, points, DigitalSurfaceModel::SurfaceNormalMode::NONE, 5);
+  DigitalSurfaceModel dsm_with_outliers(roi, points_with_outliers, DigitalSurfaceModel::SurfaceNormalMode::NONE, 5);
+
+  CvGridMap::Ptr surface = dsm.getSurfaceGrid();
+  CvGridMap::Ptr surface_with_outliers = dsm_with_outliers.getSurfaceGrid();
+  EXPECT_DOUBLE_EQ(surface->resolution(), surface_with_outliers->resolution());
+
+  const cv::Mat &elevation = (*surface)["elevation"];
+  const cv::Mat &elevation_with_outliers = (*surface_with_outliers)["elevation"];
+  ASSERT_EQ(elevation.size(), elevation_with_outliers.size());
+  EXPECT_EQ(cv::countNonZero(elevation == elevation), cv::countNonZero(elevation_with_outliers == elevation_with_outliers));
+
+  double max_diff = 0.0;
+  cv::Mat valid = (elevation == elevation);
+  cv::minMaxLoc(cv::abs(elevation - elevation_with_outliers), nullptr, &max_diff, nullptr, nullptr, valid);
+  EXPECT_LT(max_diff, 1e-5);
+}
@@ -0,0 +1,102 @@
+
+
+#include <cmath>
+#include <realm_ortho/map_tiler.h>
+
+// gtest
+#include <gtest/gtest.h>
+
+using namespace realm;
+
+TEST(MapTiler, CreateTilesLeavesInputUntouched)
+{
+  // For this test we tile a map with the exact resolution of a zoom level. The input map must not be changed, all tiles
+  // must be views into one buffer per layer, that holds the resampled data.
+  MapTiler tiler(false);
+  int zoom_level = 18;
+  double resolution = tiler.getResolution(zoom_level);
+
+  auto map = std::make_shared<CvGridMap>(cv::Rect2d(1000.0, 2000.0, 150.0*resolution, 90.0*resolution), resolution);
+  map->add("elevation", cv::Mat(map->size(), CV_32F, cv::Scalar(42.0f)));
+  map->add("color_rgb", cv::Mat(map->size(), CV_8UC3, cv::Scalar(10, 20, 30)));
+  cv::Rect2d roi = map->roi();
+  cv::Size2i size = map->size();
+  const uchar* data_before = map->get("elevation").data;
+
+  std::map<int, MapTiler::TiledMap> tiles = tiler.createTiles(map, zoom_level, zoom_level);
+
+  EXPECT_EQ(map->roi(), roi);
+  EXPECT_EQ(map->size(), size);
+  EXPECT_EQ(map->get("elevation").data, data_before);
+
+  ASSERT_EQ(tiles.size(), 1u);
+  const MapTiler::TiledMap &tiled_map = tiles.at(zoom_level);
+  ASSERT_EQ(tiled_map.tiles.size(), static_cast<size_t>(tiled_map.roi.area()));
+
+  int nrof_valid = 0;
+  const uchar* datastart = tiled_map.tiles.front()->data()->get("elevation").datastart;
+  for (const auto &tile : tiled_map.tiles)
+  {
+    const cv::Mat &elevation = tile->data()->get("elevation");
+    ASSERT_EQ(elevation.size(), cv::Size(Tile::kSize, Tile::kSize));
+    EXPECT_EQ(elevation.datastart, datastart);
+    nrof_valid += cv::countNonZero(elevation == elevation);
+  }
+  EXPECT_GT(nrof_valid, 0);
+}
+
+TEST(MapTiler, LowerZoomLevelsFromParentTiles)
+{
+  // Here we tile a map on three zoom levels in parallel. Every lower zoom level must consist of the parents of the
+  // next higher one, each equal to the parent tile created serially from its children.
+  MapTiler tiler(false);
+  int zoom_level_max = 18;
+  double resolution = tiler.getResolution(zoom_level_max);
+
+  auto map = std::make_shared<CvGridMap>(cv::Rect2d(-3000.0, 5000.0, 700.0*resolution, 500.0*resolution), resolution);
+  cv::Mat elevation(map->size(), CV_32F);
+  cv::randu(elevation, 0.0f, 100.0f);
+  map->add("elevation", elevation);
+
+  std::map<int, MapTiler::TiledMap> tiles = tiler.createTiles(map, zoom_level_max - 2, zoom_level_max, nullptr, 4);
+  ASSERT_EQ(tiles.size(), 3u);
+
+  for (int zoom_level = zoom_level_max - 1; zoom_level >= zoom_level_max - 2; --zoom_level)
+  {
+    const MapTiler::TiledMap &children = tiles.at(zoom_level + 1);
+    const MapTiler::TiledMap &parents = tiles.at(zoom_level);
+    ASSERT_EQ(parents.tiles.size(), static_cast<size_t>(parents.roi.area()));
+
+    for (const auto &parent : parents.tiles)
+    {
+      std::vector<Tile::Ptr> tiles_child;
+      for (const auto &child : children.tiles)
+        if (child->x() / 2 == parent->x() && child->y() / 2 == parent->y())
+          tiles_child.push_back(child);
+      ASSERT_FALSE(tiles_child.empty());
+
+      Tile::Ptr expected = tiler.createParentTile(zoom_level, parent->x(), parent->y(), tiles_child, {"elevation"});
+      const cv::Mat &data = parent->data()->get("elevation");
+      const cv::Mat &data_expected = expected->data()->get("elevation");
+      ASSERT_EQ(data.size(), data_expected.size());
+      EXPECT_EQ(cv::countNonZero((data == data) != (data_expected == data_expected)), 0);
+      EXPECT_EQ(cv::countNonZero((data != data_expected) & (data_expected == data_expected)), 0);
+    }
+  }
+}
+
+TEST(MapTiler, TileBoundsOfZoomRange)
+{
+  // For this test the tile bounds of a footprint are computed for a range of zoom levels at once and must be equal to
+  // the ones computed per zoom level. Invalid zoom levels must be rejected.
+  MapTiler tiler(false);
+  cv::Rect2d roi(1281234.5, 6123456.7, 815.3, 402.9);
+
+  std::vector<cv::Rect2i> tile_bounds = tiler.computeTileBounds(roi, 11, 22);
+  ASSERT_EQ(tile_bounds.size(), 12u);
+  for (int zoom_level = 11; zoom_level <= 22; ++zoom_level)
+    EXPECT_EQ(tile_bounds[zoom_level - 11], tiler.computeTileBounds(roi, zoom_level));
+
+  EXPECT_THROW(tiler.getResolution(MapTiler::kNrofZoomLevels), std::invalid_argument);
+  EXPECT_THROW(tiler.computeTileBounds(roi, -1, 5), std::invalid_argument);
+}
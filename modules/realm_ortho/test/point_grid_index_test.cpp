@@ -0,0 +1,144 @@
+
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <realm_ortho/point_grid_index.h>
+
+// gtest
+#include <gtest/gtest.h>
+
+using namespace realm;
+using namespace realm::ortho;
+
+namespace
+{
+
+cv::Mat createRandomPoints(int n, double x0, double y0, double extent, uint64_t seed)
+{
+  cv::RNG rng(seed);
+  cv::Mat points(n, 3, CV_64F);
+  for (int i = 0; i < n; ++i)
+  {
+    points.at<double>(i, 0) = x0 + rng.uniform(0.0, extent);
+    points.at<double>(i, 1) = y0 + rng.uniform(0.0, extent);
+    points.at<double>(i, 2) = rng.uniform(0.0, 10.0);
+  }
+  return points;
+}
+
+std::vector<std::pair<int, double>> bruteForceRadius(const cv::Mat &points, double x, double y, double radius_sq)
+{
+  std::vector<std::pair<int, double>> result;
+  for (int i = 0; i < points.rows; ++i)
+  {
+    double dx = points.at<double>(i, 0) - x;
+    double dy = points.at<double>(i, 1) - y;
+    if (dx*dx + dy*dy < radius_sq)
+      result.emplace_back(i, dx*dx + dy*dy);
+  }
+  return result;
+}
+
+} // namespace
+
+TEST(PointGridIndex, RadiusSearchEqualsBruteForce)
+{
+  // For this test we create a random cloud with a few far outliers and a row of zeros, like invalid depths of a
+  // reprojected depth map. The radius search must find exactly the same points as a brute force search.
+  cv::Mat points = createRandomPoints(5000, 600000.0, 5700000.0, 100.0, 42);
+  points.at<double>(10, 0) = 0.0; points.at<double>(10, 1) = 0.0;
+  points.at<double>(20, 0) = 601000.0;
+  points.at<double>(30, 1) = std::numeric_limits<double>::quiet_NaN();
+
+  PointGridIndex index;
+  index.build(points);
+  EXPECT_EQ(index.size(), 4999u);
+
+  cv::RNG rng(7);
+  std::vector<std::pair<int, double>> result;
+  for (int i = 0; i < 200; ++i)
+  {
+    double x = 600000.0 + rng.uniform(-5.0, 105.0);
+    double y = 5700000.0 + rng.uniform(-5.0, 105.0);
+    double radius_sq = rng.uniform(0.0, 25.0);
+    index.radiusSearch(x, y, radius_sq, result);
+
+    auto expected = bruteForceRadius(points, x, y, radius_sq);
+    std::sort(result.begin(), result.end());
+    ASSERT_EQ(result.size(), expected.size());
+    for (size_t j = 0; j < result.size(); ++j)
+    {
+      EXPECT_EQ(result[j].first, expected[j].first);
+      EXPECT_DOUBLE_EQ(result[j].second, expected[j].second);
+    }
+  }
+}
+
+TEST(PointGridIndex, KnnSearchEqualsBruteForce)
+{
+  // Here we compare the k nearest neighbours with a brute force search, also for queries far outside the cloud.
+  // Afterwards the index is rebuilt for a second, smaller cloud at another location to verify that nothing of the
+  // first one is left in the reused buffers.
+  PointGridIndex index;
+  for (int run = 0; run < 2; ++run)
+  {
+    cv::Mat points = (run == 0 ? createRandomPoints(3000, 1000.0, 2000.0, 50.0, 1)
+                               : createRandomPoints(500, -300.0, 40.0, 10.0, 2));
+    index.build(points, nullptr, 1);
+    ASSERT_EQ(index.size(), static_cast<size_t>(points.rows));
+
+    cv::RNG rng(11);
+    for (int i = 0; i < 100; ++i)
+    {
+      double x = points.at<double>(0, 0) + rng.uniform(-200.0, 200.0);
+      double y = points.at<double>(0, 1) + rng.uniform(-200.0, 200.0);
+
+      size_t indices[3];
+      double dists_sq[3];
+      ASSERT_EQ(index.knnSearch(x, y, 3u, &indices[0], &dists_sq[0]), 3u);
+
+      auto expected = bruteForceRadius(points, x, y, std::numeric_limits<double>::max());
+      std::sort(expected.begin(), expected.end(), [](const std::pair<int, double> &a, const std::pair<int, double> &b)
+      {
+        return a.second < b.second;
+      });
+      for (size_t j = 0; j < 3; ++j)
+        EXPECT_DOUBLE_EQ(dists_sq[j], expected[j].second);
+
+      double dist_nearest = std::sqrt(expected[0].second);
+      EXPECT_TRUE(index.hasNeighbour(x, y, dist_nearest + 1e-6));
+      EXPECT_FALSE(index.hasNeighbour(x, y, dist_nearest * 0.99));
+    }
+  }
+}
+
+TEST(PointGridIndex, GridEqualsKdTree)
+{
+  // For this test both indices of the surface generation are built for the same cloud. Radius searches of a raster scan
+  // over the cloud must return the same points, only their order may differ.
+  cv::Mat points = createRandomPoints(4000, 350000.0, 4100000.0, 60.0, 3);
+
+  NeighbourIndex2D::Ptr grid = NeighbourIndex2D::create(NeighbourIndex2D::Type::GRID);
+  NeighbourIndex2D::Ptr kd_tree = NeighbourIndex2D::create(NeighbourIndex2D::Type::KD_TREE);
+  grid->build(points, nullptr, 0);
+  kd_tree->build(points, nullptr, 0);
+  ASSERT_EQ(grid->size(), kd_tree->size());
+
+  std::vector<std::pair<int, double>> result_grid, result_kd_tree;
+  for (double y = 4100000.0; y < 4100060.0; y += 1.5)
+    for (double x = 350000.0; x < 350060.0; x += 1.5)
+    {
+      grid->radiusSearch(x, y, 2.0, result_grid);
+      kd_tree->radiusSearch(x, y, 2.0, result_kd_tree);
+      std::sort(result_grid.begin(), result_grid.end());
+      std::sort(result_kd_tree.begin(), result_kd_tree.end());
+      ASSERT_EQ(result_grid, result_kd_tree);
+
+      size_t idx_grid, idx_kd_tree;
+      double dist_grid, dist_kd_tree;
+      grid->knnSearch(x, y, 1u, &idx_grid, &dist_grid);
+      kd_tree->knnSearch(x, y, 1u, &idx_kd_tree, &dist_kd_tree);
+      EXPECT_DOUBLE_EQ(dist_grid, dist_kd_tree);
+    }
+}
@@ -0,0 +1,284 @@
+
+
+#include <iostream>
+#include <realm_ortho/cuda_backend.h>
+#include <realm_ortho/rectification.h>
+
+// gtest
+#include <gtest/gtest.h>
+
+using namespace realm;
+
+namespace
+{
+
+camera::Pinhole createNadirCamera()
+{
+  camera::Pinhole cam(1200.0, 1200.0, 600.0, 500.0, 1200, 1000);
+
+  // Camera is looking straight down at an altitude of 1200m. Position is a real UTM coordinate, because single precision
+  // computations must not suffer from the large magnitudes of geographic coordinates
+  cv::Mat pose = cv::Mat::zeros(3, 4, CV_64F);
+  pose.at<double>(0, 1) = 1.0;
+  pose.at<double>(1, 0) = 1.0;
+  pose.at<double>(2, 2) = -1.0;
+  pose.at<double>(0, 3) = 603976.0;
+  pose.at<double>(1, 3) = 5791569.0;
+  pose.at<double>(2, 3) = 1200.0;
+  cam.setPose(pose);
+
+  return cam;
+}
+
+cv::Mat createPatternImage(int rows, int cols)
+{
+  cv::Mat img(rows, cols, CV_8UC4);
+  for (int r = 0; r < rows; ++r)
+    for (int c = 0; c < cols; ++c)
+      img.at<cv::Vec4b>(r, c) = cv::Vec4b(static_cast<uchar>(c % 256), static_cast<uchar>(r % 256), static_cast<uchar>((r+c) % 256), 255);
+  return img;
+}
+
+} // namespace
+
+TEST(Rectification, ElevationAngleFast)
+{
+  // The fast elevation angle is a polynomial approximation of the exact computation. We sample camera positions all
+  // around the surface point and check, that the approximation stays within tolerance.
+  double p[3]{0.0, 0.0, 0.0};
+  for (int i = 1; i < 100; ++i)
+    for (int j = 1; j < 100; ++j)
+    {
+      double t[3]{static_cast<double>(i)*10.0, static_cast<double>(j)*5.0, static_cast<double>(i*j)};
+      double angle = ortho::internal::computeElevationAngle(t, p);
+      auto dh = static_cast<float>(sqrt(t[0]*t[0] + t[1]*t[1]));
+      auto dz = static_cast<float>(t[2]);
+      EXPECT_NEAR(ortho::internal::computeElevationAngleFast(dz, dh), angle, 0.05);
+    }
+}
+
+TEST(Rectification, VectorizedEqualsScalar)
+{
+  // For this test we rectify an artificial image onto a slightly tilted surface once with the scalar double precision
+  // kernel and once with the vectorized single precision kernel. Results must be identical within tolerance.
+  camera::Pinhole cam = createNadirCamera();
+  cv::Mat img = createPatternImage(cam.height(), cam.width());
+
+  // Roi is partially outside the camera footprint, so cells get invalidated. The number of columns is no multiple of
+  // the register width, so the remainder of each row is tested as well
+  cv::Rect2d roi(603976.0 - 700.0, 5791569.0 - 400.0, 1250.0, 800.0);
+  double GSD = 2.0;
+  CvGridMap grid(roi, GSD);
+
+  cv::Mat surface(grid.size(), CV_32F);
+  for (int r = 0; r < surface.rows; ++r)
+    for (int c = 0; c < surface.cols; ++c)
+      surface.at<float>(r, c) = 100.0f + 0.05f*static_cast<float>(c) - 0.02f*static_cast<float>(r);
+  surface.at<float>(10, 10) = std::numeric_limits<float>::quiet_NaN();
+
+  cv::Mat surface_scalar = surface.clone();
+  cv::Mat surface_simd = surface.clone();
+
+  CvGridMap::Ptr result_scalar = ortho::backprojectFromGrid(img, cam, surface_scalar, grid.roi(), GSD, true, false, 1, false);
+  CvGridMap::Ptr result_simd = ortho::backprojectFromGrid(img, cam, surface_simd, grid.roi(), GSD, true, false, 0, true);
+
+  const cv::Mat &nobs_scalar = (*result_scalar)["num_observations"];
+  const cv::Mat &nobs_simd = (*result_simd)["num_observations"];
+
+  // Cells exactly on a pixel border might be sampled differently due to rounding, so allow for a small fraction of
+  // mismatching cells
+  int nrof_cells = surface.rows*surface.cols;
+  int nrof_invalid = 0;
+  int nrof_mismatch = 0;
+  for (int r = 0; r < surface.rows; ++r)
+    for (int c = 0; c < surface.cols; ++c)
+    {
+      if (nobs_scalar.at<uint16_t>(r, c) != nobs_simd.at<uint16_t>(r, c))
+      {
+        nrof_mismatch++;
+        continue;
+      }
+      if (nobs_scalar.at<uint16_t>(r, c) == 0)
+      {
+        nrof_invalid++;
+        continue;
+      }
+      if ((*result_scalar)["color_rgb"].at<cv::Vec4b>(r, c) != (*result_simd)["color_rgb"].at<cv::Vec4b>(r, c))
+        nrof_mismatch++;
+
+      EXPECT_NEAR((*result_scalar)["elevation_angle"].at<float>(r, c), (*result_simd)["elevation_angle"].at<float>(r, c), 0.05);
+    }
+
+  EXPECT_GT(nrof_invalid, 0);
+  EXPECT_LT(nrof_invalid, nrof_cells);
+  EXPECT_LT(static_cast<double>(nrof_mismatch)/nrof_cells, 0.01);
+  EXPECT_NE(surface_simd.at<float>(10, 10), surface_simd.at<float>(10, 10));
+}
+
+TEST(Rectification, BilinearSampling)
+{
+  // Bilinear sampling is done with a remap of the projected coordinates. The validity of the cells must not depend on
+  // the sampling and for an image of uniform color both sampling methods have to result in the same orthophoto. Cells
+  // at the boundary of the image footprint must not be blended with black.
+  camera::Pinhole cam = createNadirCamera();
+  cv::Mat img(cam.height(), cam.width(), CV_8UC4, cv::Scalar(50, 100, 150, 255));
+
+  cv::Rect2d roi(603976.0 - 700.0, 5791569.0 - 400.0, 1250.0, 800.0);
+  double GSD = 2.0;
+  CvGridMap grid(roi, GSD);
+
+  cv::Mat surface_nearest(grid.size(), CV_32F, cv::Scalar(100.0));
+  cv::Mat surface_linear = surface_nearest.clone();
+
+  CvGridMap::Ptr result_nearest = ortho::backprojectFromGrid(img, cam, surface_nearest, grid.roi(), GSD, false, false, 0, true, cv::INTER_NEAREST);
+  CvGridMap::Ptr result_linear = ortho::backprojectFromGrid(img, cam, surface_linear, grid.roi(), GSD, false, false, 0, true, cv::INTER_LINEAR);
+
+  cv::Mat diff_nobs = ((*result_nearest)["num_observations"] != (*result_linear)["num_observations"]);
+  EXPECT_EQ(cv::countNonZero(diff_nobs), 0);
+
+  cv::Mat diff_color;
+  cv::absdiff((*result_nearest)["color_rgb"], (*result_linear)["color_rgb"], diff_color);
+  EXPECT_EQ(cv::countNonZero(diff_color.reshape(1)), 0);
+}
+
+TEST(Rectification, PooledAllocation)
+{
+  // Here we rectify the same data twice with matrices from a pool. The second run reuses the buffers of the first one,
+  // which must not leak into the result. Both have to be equal to the rectification with regular allocations.
+  camera::Pinhole cam = createNadirCamera();
+  cv::Mat img = createPatternImage(cam.height(), cam.width());
+
+  cv::Rect2d roi(603976.0 - 700.0, 5791569.0 - 400.0, 1250.0, 800.0);
+  double GSD = 2.0;
+  CvGridMap grid(roi, GSD);
+  cv::Mat surface(grid.size(), CV_32F, cv::Scalar(100.0));
+
+  MatPool* pool = MatPool::get("test_rectification");
+  pool->clear();
+
+  cv::Mat surface_reference = surface.clone();
+  CvGridMap::Ptr reference = ortho::backprojectFromGrid(img, cam, surface_reference, grid.roi(), GSD, false, false, 0, true, cv::INTER_LINEAR);
+
+  for (int i = 0; i < 2; ++i)
+  {
+    cv::Mat surface_pooled = surface.clone();
+    CvGridMap::Ptr pooled = ortho::backprojectFromGrid(img, cam, surface_pooled, grid.roi(), GSD, false, false, 0, true, cv::INTER_LINEAR, nullptr, pool);
+    for (const auto &layer_name : reference->getAllLayerNames())
+    {
+      EXPECT_EQ((*pooled)[layer_name].allocator, pool);
+      EXPECT_EQ(cv::norm((*reference)[layer_name].reshape(1), (*pooled)[layer_name].reshape(1), cv::NORM_INF), 0.0) << layer_name;
+    }
+  }
+  EXPECT_GT(pool->getNrofReused(), 0u);
+}
+
+TEST(Rectification, PlanarEqualsBackprojection)
+{
+  // For this test a plane is rectified once with the homography of the planar path and once cell by cell. Roi is
+  // partially outside the camera footprint. Observed cells, color and surface have to be equal except for cells exactly
+  // on a pixel border, where the rounding of the warp might differ from the truncation of the backprojection.
+  camera::Pinhole cam = createNadirCamera();
+  cv::Mat img = createPatternImage(cam.height(), cam.width());
+
+  cv::Rect2d roi(603976.0 - 700.0, 5791569.0 - 400.0, 1250.0, 800.0);
+  double GSD = 2.0;
+  CvGridMap grid(roi, GSD);
+
+  cv::Mat surface_grid(grid.size(), CV_32F, cv::Scalar(100.0));
+  cv::Mat surface_planar = surface_grid.clone();
+
+  CvGridMap::Ptr result_grid = ortho::backprojectFromGrid(img, cam, surface_grid, grid.roi(), GSD, false, false, 0, true);
+  CvGridMap::Ptr result_planar = ortho::rectifyPlanar(img, cam, surface_planar, grid.roi(), GSD, 100.0, false);
+  ASSERT_EQ(result_grid->getAllLayerNames(), result_planar->getAllLayerNames());
+
+  const cv::Mat &nobs_grid = (*result_grid)["num_observations"];
+  const cv::Mat &nobs_planar = (*result_planar)["num_observations"];
+
+  int nrof_cells = nobs_grid.rows*nobs_grid.cols;
+  int nrof_invalid = 0;
+  int nrof_mismatch = 0;
+  for (int r = 0; r < nobs_grid.rows; ++r)
+    for (int c = 0; c < nobs_grid.cols; ++c)
+    {
+      if (nobs_grid.at<uint16_t>(r, c) != nobs_planar.at<uint16_t>(r, c))
+      {
+        nrof_mismatch++;
+        continue;
+      }
+      EXPECT_EQ((*result_grid)["elevated"].at<uchar>(r, c), (*result_planar)["elevated"].at<uchar>(r, c));
+      if (nobs_grid.at<uint16_t>(r, c) == 0)
+      {
+        EXPECT_NE(surface_planar.at<float>(r, c), surface_planar.at<float>(r, c));
+        nrof_invalid++;
+        continue;
+      }
+      if ((*result_grid)["color_rgb"].at<cv::Vec4b>(r, c) != (*result_planar)["color_rgb"].at<cv::Vec4b>(r, c))
+        nrof_mismatch++;
+
+      EXPECT_FLOAT_EQ(surface_planar.at<float>(r, c), 100.0f);
+      EXPECT_NEAR((*result_grid)["elevation_angle"].at<float>(r, c), (*result_planar)["elevation_angle"].at<float>(r, c), 0.05);
+    }
+
+  EXPECT_GT(nrof_invalid, 0);
+  EXPECT_LT(nrof_invalid, nrof_cells);
+  EXPECT_LT(static_cast<double>(nrof_mismatch)/nrof_cells, 0.01);
+}
+
+TEST(Rectification, CudaEqualsVectorized)
+{
+  // Here we rectify the same tilted surface with the vectorized kernel on the CPU and on the GPU. Both compute in single
+  // precision in the local frame, so results have to be equal except for cells exactly on a pixel border. Without CUDA
+  // device there is nothing to compare.
+  if (!ortho::cuda::isAvailable())
+    return;
+
+  camera::Pinhole cam = createNadirCamera();
+  cv::Mat img = createPatternImage(cam.height(), cam.width());
+
+  cv::Rect2d roi(603976.0 - 700.0, 5791569.0 - 400.0, 1250.0, 800.0);
+  double GSD = 2.0;
+  CvGridMap grid(roi, GSD);
+
+  cv::Mat surface(grid.size(), CV_32F);
+  for (int r = 0; r < surface.rows; ++r)
+    for (int c = 0; c < surface.cols; ++c)
+      surface.at<float>(r, c) = 100.0f + 0.05f*static_cast<float>(c) - 0.02f*static_cast<float>(r);
+  surface.at<float>(10, 10) = std::numeric_limits<float>::quiet_NaN();
+
+  for (int interpolation : {cv::INTER_NEAREST, cv::INTER_LINEAR})
+  {
+    cv::Mat surface_cpu = surface.clone();
+    cv::Mat surface_gpu = surface.clone();
+    CvGridMap::Ptr result_cpu = ortho::backprojectFromGrid(img, cam, surface_cpu, grid.roi(), GSD, true, false, 0, true, interpolation);
+    CvGridMap::Ptr result_gpu = ortho::cuda::backprojectFromGrid(img, cam, surface_gpu, grid.roi(), GSD, true, false, interpolation);
+    ASSERT_EQ(result_cpu->getAllLayerNames(), result_gpu->getAllLayerNames());
+
+    const cv::Mat &nobs_cpu = (*result_cpu)["num_observations"];
+    const cv::Mat &nobs_gpu = (*result_gpu)["num_observations"];
+
+    int nrof_cells = surface.rows*surface.cols;
+    int nrof_mismatch = 0;
+    for (int r = 0; r < surface.rows; ++r)
+      for (int c = 0; c < surface.cols; ++c)
+      {
+        if (nobs_cpu.at<uint16_t>(r, c) != nobs_gpu.at<uint16_t>(r, c))
+        {
+          nrof_mismatch++;
+          continue;
+        }
+        if (nobs_cpu.at<uint16_t>(r, c) == 0)
+          continue;
+
+        // Bilinear weights of the remap are quantized, so colors may differ by one
+        cv::Vec4b color_cpu = (*result_cpu)["color_rgb"].at<cv::Vec4b>(r, c);
+        cv::Vec4b color_gpu = (*result_gpu)["color_rgb"].at<cv::Vec4b>(r, c);
+        if (cv::norm(color_cpu, color_gpu, cv::NORM_INF) > (interpolation == cv::INTER_NEAREST ? 0.0 : 1.0))
+          nrof_mismatch++;
+
+        EXPECT_NEAR((*result_cpu)["elevation_angle"].at<float>(r, c), (*result_gpu)["elevation_angle"].at<float>(r, c), 0.05);
+      }
+
+    EXPECT_LT(static_cast<double>(nrof_mismatch)/nrof_cells, 0.01);
+    EXPECT_NE(surface_gpu.at<float>(10, 10), surface_gpu.at<float>(10, 10));
+  }
+}
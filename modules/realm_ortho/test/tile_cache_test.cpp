@@ -0,0 +1,87 @@
+#include <realm_io/utilities.h>
+#include <realm_ortho/tile_cache.h>
+
+// gtest
+#include <gtest/gtest.h>
+
+using namespace realm;
+
+TEST(TileCache, SaveAndLoadIndex)
+{
+  // Here we write a tile to disk, save the index of the cache and restore it into a second cache. The restored tile
+  // must be loaded from disk on demand with its data, version and extent.
+  std::string directory = io::getTempDirectoryPath() + "/tile_cache_test";
+  if (!io::dirExists(directory))
+    io::createDir(directory);
+  std::string filepath_index = directory + "/tile_index.bin";
+
+  CvGridMap map(cv::Rect2d(10.0, 20.0, Tile::kSize - 1, Tile::kSize - 1), 1.0);
+  map.add("color_rgb", cv::Mat(map.size(), CV_8UC4, cv::Scalar(10, 20, 30, 255)));
+  auto tile = std::make_shared<Tile>(18, 5, 7, map);
+
+  {
+    TileCache tile_cache("test", 100, directory, false, 1);
+    tile_cache.add(18, {tile}, cv::Rect2i(5, 7, 1, 1));
+    tile_cache.add(18, {tile}, cv::Rect2i(5, 7, 1, 1));
+    tile_cache.flushAll();
+    tile_cache.saveIndex(filepath_index);
+  }
+
+  TileCache tile_cache("test", 100, "", false, 1);
+  EXPECT_EQ(tile_cache.loadIndex(filepath_index), 1u);
+  EXPECT_EQ(tile_cache.get(6, 7, 18), nullptr);
+
+  Tile::Ptr tile_restored = tile_cache.get(5, 7, 18);
+  ASSERT_NE(tile_restored, nullptr);
+  EXPECT_EQ(tile_restored->data()->roi(), map.roi());
+  cv::Mat color = tile_restored->data()->get("color_rgb");
+  tile_restored->unlock();
+  EXPECT_EQ(cv::countNonZero(color.reshape(1) != map["color_rgb"].reshape(1)), 0);
+
+  std::vector<uint8_t> data;
+  uint64_t version;
+  EXPECT_TRUE(tile_cache.readEncoded(18, 5, 7, "color_rgb", data, version));
+  EXPECT_EQ(version, 2u);
+
+  io::removeFileOrDirectory(directory);
+}
+
+TEST(TileCache, LoadAllFromIndex)
+{
+  // Here we check that flushing writes the index next to the tiles. Reopening the tile set from it and loading all
+  // tiles concurrently must restore the data of every tile.
+  std::string directory = io::getTempDirectoryPath() + "/tile_cache_load_all_test";
+  if (!io::dirExists(directory))
+    io::createDir(directory);
+
+  std::vector<Tile::Ptr> tiles;
+  for (int tx = 0; tx < 4; ++tx)
+    for (int ty = 0; ty < 4; ++ty)
+    {
+      CvGridMap map(cv::Rect2d(tx * Tile::kSize, ty * Tile::kSize, Tile::kSize - 1, Tile::kSize - 1), 1.0);
+      map.add("color_rgb", cv::Mat(map.size(), CV_8UC4, cv::Scalar(tx, ty, 0, 255)));
+      tiles.push_back(std::make_shared<Tile>(16, tx, ty, map));
+    }
+
+  size_t bytes;
+  {
+    TileCache tile_cache("test", 100, directory, false, 4);
+    tile_cache.add(16, tiles, cv::Rect2i(0, 0, 4, 4));
+    bytes = tile_cache.getByteSize();
+    tile_cache.flushAll();
+    EXPECT_EQ(tile_cache.getByteSize(), 0u);
+  }
+  ASSERT_TRUE(io::fileExists(directory + "/tile_index.bin"));
+
+  TileCache tile_cache("test", 100, "", false, 4);
+  EXPECT_EQ(tile_cache.loadIndex(directory + "/tile_index.bin"), tiles.size());
+  tile_cache.loadAll();
+  EXPECT_EQ(tile_cache.getByteSize(), bytes);
+
+  Tile::Ptr tile = tile_cache.getShared(2, 3, 16);
+  ASSERT_NE(tile, nullptr);
+  EXPECT_EQ(tile->data()->get("color_rgb").at<cv::Vec4b>(10, 10), cv::Vec4b(2, 3, 0, 255));
+  tile->unlockShared();
+
+  io::removeFileOrDirectory(directory);
+}
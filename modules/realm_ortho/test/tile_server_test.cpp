@@ -0,0 +1,70 @@
+
+
+#include <realm_io/utilities.h>
+#include <realm_ortho/tile_server.h>
+
+// gtest
+#include <gtest/gtest.h>
+
+using namespace realm;
+
+namespace
+{
+
+Tile::Ptr createTile(int zoom_level, int tx, int ty, uchar value)
+{
+  CvGridMap map(cv::Rect2d(0.0, 0.0, Tile::kSize - 1, Tile::kSize - 1), 1.0);
+  map.add("color_rgb", cv::Mat(map.size(), CV_8UC4, cv::Scalar::all(value)));
+  return std::make_shared<Tile>(zoom_level, tx, ty, map);
+}
+
+} // namespace
+
+TEST(TileServer, ParsePath)
+{
+  // Here we check that only paths of the directory tree of the tile cache are accepted as tile requests
+  TileServer::Request request;
+  ASSERT_TRUE(TileServer::parsePath("/color_rgb/18/140123/91234.png", request));
+  EXPECT_EQ(request.layer_name, "color_rgb");
+  EXPECT_EQ(request.zoom_level, 18);
+  EXPECT_EQ(request.tx, 140123);
+  EXPECT_EQ(request.ty, 91234);
+
+  EXPECT_TRUE(TileServer::parsePath("/elevation/12/3/4.bin?t=12345", request));
+  EXPECT_FALSE(TileServer::parsePath("/elevation/12/3/4.jpg", request));
+  EXPECT_FALSE(TileServer::parsePath("/elevation/12/3/4.png/more", request));
+  EXPECT_FALSE(TileServer::parsePath("/../12/3/4.png", request));
+  EXPECT_FALSE(TileServer::parsePath("/elevation/12/-3/4.png", request));
+  EXPECT_FALSE(TileServer::parsePath("/metrics", request));
+}
+
+TEST(TileServer, ServesTilesFromMemory)
+{
+  // For this test a tile is added to a cache without writing it to disk. It must be served from memory right away,
+  // revalidation with its entity tag must succeed until the tile is updated.
+  std::string directory = io::getTempDirectoryPath() + "/tile_server_test";
+  if (!io::dirExists(directory))
+    io::createDir(directory);
+
+  auto tile_cache = std::make_shared<TileCache>("test", 100, directory, false, 1);
+  TileServer server(tile_cache, 18080);
+
+  tile_cache->add(18, {createTile(18, 5, 7, 100)}, cv::Rect2i(5, 7, 1, 1));
+
+  std::string response = server.createResponse("GET /color_rgb/18/5/7.png HTTP/1.1\r\nHost: localhost\r\n\r\n");
+  EXPECT_EQ(response.find("HTTP/1.1 200 OK"), 0u);
+  EXPECT_NE(response.find("Content-Type: image/png"), std::string::npos);
+  EXPECT_NE(response.find("ETag: \"18-5-7-1\""), std::string::npos);
+
+  response = server.createResponse("GET /color_rgb/18/5/7.png HTTP/1.1\r\nIf-None-Match: \"18-5-7-1\"\r\n\r\n");
+  EXPECT_EQ(response.find("HTTP/1.1 304 Not Modified"), 0u);
+
+  tile_cache->add(18, {createTile(18, 5, 7, 200)}, cv::Rect2i(5, 7, 1, 1));
+  response = server.createResponse("GET /color_rgb/18/5/7.png HTTP/1.1\r\nIf-None-Match: \"18-5-7-1\"\r\n\r\n");
+  EXPECT_EQ(response.find("HTTP/1.1 200 OK"), 0u);
+  EXPECT_NE(response.find("ETag: \"18-5-7-2\""), std::string::npos);
+
+  EXPECT_EQ(server.createResponse("GET /color_rgb/18/6/7.png HTTP/1.1\r\n\r\n").find("HTTP/1.1 404"), 0u);
+  EXPECT_EQ(server.createResponse("GET /elevation/18/5/7.bin HTTP/1.1\r\n\r\n").find("HTTP/1.1 404"), 0u);
+  EXPECT_EQ(server.createResponse("POST /color_rgb/18/5/7.png HTTP/1.1\r\n\r\n").find("HTTP/1.1 400"), 0u);
+}
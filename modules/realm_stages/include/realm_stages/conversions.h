@@ -5,6 +5,7 @@
 
 #include <realm_core/cv_grid_map.h>
 #include <realm_core/structs.h>
+#include <realm_core/thread_pool.h>
 
 namespace realm
 {
@@ -14,10 +15,17 @@ namespace realm
  * @param img3d Matrix with 3 channel double precision data (accessed by cv::Vec3d) for 3d points
  * @param color Color informations
  * @param normals Matrix with 3 channel single precision normal map
- * @param mask Mask for valid elements
+ * @param mask Mask for valid elements, all elements are valid if empty
+ * @param thread_pool Shared thread pool to fill bands of rows on, can be nullptr
+ * @param nrof_threads Number of threads, <= 0 uses all available, 1 runs serially in the calling thread
  * @return cv::Mat with row() = x,y,z,b,g,r,nx,ny,nz
  */
-cv::Mat cvtToPointCloud(const cv::Mat &img3d, const cv::Mat &color, const cv::Mat &normals, const cv::Mat &mask);
+cv::Mat cvtToPointCloud(const cv::Mat &img3d,
+                        const cv::Mat &color,
+                        const cv::Mat &normals,
+                        const cv::Mat &mask,
+                        const ThreadPool::Ptr &thread_pool = nullptr,
+                        int nrof_threads = 1);
 
 /*!
  * @brief Function for converting a grid map to a point cloud as cv::Mat with row() = x,y,z,b,g,r,nx,ny,nz
@@ -25,13 +33,18 @@ cv::Mat cvtToPointCloud(const cv::Mat &img3d, const cv::Mat &color, const cv::Ma
  * @param layer_elevation Elevation layer: Grid map gives x,y coordinates, layer the elevation/z data.
  * @param layer_color Color layer (optional)
  * @param layer_normals Surface normal corresponding to elevation layer (optional
+ * @param layer_mask Mask layer of the valid elements (optional)
+ * @param thread_pool Shared thread pool to fill bands of rows on, can be nullptr
+ * @param nrof_threads Number of threads, <= 0 uses all available, 1 runs serially in the calling thread
  * @return cv::Mat with row() = x,y,z,b,g,r,nx,ny,nz
  */
 cv::Mat cvtToPointCloud(const CvGridMap &map,
                         const std::string &layer_elevation,
                         const std::string &layer_color,
                         const std::string &layer_normals,
-                        const std::string &layer_mask);
+                        const std::string &layer_mask,
+                        const ThreadPool::Ptr &thread_pool = nullptr,
+                        int nrof_threads = 1);
 
 /*!
  * @brief Function for converting a grid map to a mesh using triangle vertex ids
@@ -40,12 +53,16 @@ cv::Mat cvtToPointCloud(const CvGridMap &map,
  * @param layer_color Color layer to be used for vertices
  * @param vertex_ids Ids of the mesh triangles, 3 ids always form one triangle. Must have been build BEFORE call of this
  *                   function, e.g. with delaunay's "buildMesh"
+ * @param thread_pool Shared thread pool to create the faces on, can be nullptr
+ * @param nrof_threads Number of threads, <= 0 uses all available, 1 runs serially in the calling thread
  * @return Vector of faces
  */
 std::vector<Face> cvtToMesh(const CvGridMap &map,
                             const std::string &layer_elevation,
                             const std::string &layer_color,
-                            const std::vector<cv::Point2i> &vertex_ids);
+                            const std::vector<cv::Point2i> &vertex_ids,
+                            const ThreadPool::Ptr &thread_pool = nullptr,
+                            int nrof_threads = 1);
 
 } // namespace realm
 
@@ -4,6 +4,7 @@
 #define PROJECT_DENSIFICATION_STAGE_H
 
 #include <deque>
+#include <future>
 #include <map>
 #include <memory>
 #include <chrono>
@@ -68,6 +69,15 @@ class Densification : public StageBase
      */
     void addFrame(const Frame::Ptr &frame) override;
 
+    /*!
+     * @brief Changes parameters at runtime. All parameters are passed on to the densifier framework, e.g. "nrof_planes"
+     *        and "scale" of the plane sweep.
+     * @param name Name of the parameter
+     * @param val Value of the parameter
+     * @return True if the parameter was changed
+     */
+    bool changeParam(const std::string &name, const std::string &val) override;
+
     /*!
      * @brief Overriden function for processing. Is looped as part of the densification thread and will process,
      *        if new data can be processed inside the buffers.
@@ -88,12 +98,30 @@ class Densification : public StageBase
     //! Flag for surface normal computation
     bool m_compute_normals;
 
+    //! Flag to post-process frames asynchronously while the next frame is reconstructed
+    bool m_use_async_postprocessing;
+
+    //! Single thread for post-processing, so frames are filtered and published in order of their reconstruction
+    ThreadPool::Ptr m_pool_postprocessing;
+
+    //! Post-processing of the previously reconstructed frame, invalid if none is running
+    std::future<void> m_future_postprocessing;
+
     //! Files and data to be saved in the stage
     SaveSettings m_settings_save;
 
     //! Number of frames used for stereo reconstruction
     uint8_t  m_n_frames;
 
+    //! Number of buffered frames the stereo partners of the reference frame are selected from, at least m_n_frames
+    size_t m_nrof_candidates;
+
+    //! Thresholds a stereo partner has to pass: Ratio of baseline to scene depth, angle of the optical axes in [rad]
+    //! and overlap of the footprints. 0 disables the threshold.
+    double m_partner_min_baseline_ratio;
+    double m_partner_max_view_angle;
+    double m_partner_min_overlap;
+
     //! Number of frames received for densification
     uint64_t m_rcvd_frames;
 
@@ -110,17 +138,38 @@ class Densification : public StageBase
     std::deque<Frame::Ptr> m_buffer_reco;
     std::mutex m_mutex_buffer_reco;
 
-    //! Buffer for consistency filter
-    std::deque<std::pair<Frame::Ptr, cv::Mat>> m_buffer_consistency;
+    //! Buffer for consistency filter, frames with their unfiltered depth map
+    std::deque<std::pair<Frame::Ptr, Depthmap::Ptr>> m_buffer_consistency;
+    std::mutex m_mutex_buffer_consistency;
 
     //! Densifier handle for surface reconstruction. Mostly external frameworks to generate dense depth maps
     DensifierIF::Ptr m_densifier;
 
+    /*!
+     * @brief Stereo reconstruction started by the densifier, together with the reference frame it was started for
+     */
+    struct Reconstruction
+    {
+      Frame::Ptr frame;
+      std::future<Depthmap::Ptr> depthmap;
+    };
+
+    //! Number of reconstructions the densifier processes concurrently, e.g. on several GPUs
+    size_t m_nrof_jobs;
+
+    //! Reconstructions in the order they were started, results are collected in this order
+    std::deque<Reconstruction> m_reconstructions;
+
     /*!
      * @brief Function to call for reset of densification stage
      */
     void reset() override;
 
+    /*!
+     * @brief Waits for the post-processing of the last reconstructed frame before the stage finishes
+     */
+    void finishCallback() override;
+
     /*!
      * @brief Callback function after the stage received the current output folder
      */
@@ -136,6 +185,11 @@ class Densification : public StageBase
      */
     uint32_t getQueueDepth() override;
 
+    /*!
+     * @brief Returns the memory of the frames in the reconstruction and consistency buffers
+     */
+    size_t getMemoryUsage() override;
+
     /*!
      * @brief Publish function that is called on every iteration of the processing thread
      * @param frame Current frame to be processed
@@ -164,11 +218,14 @@ class Densification : public StageBase
     void popFromBufferReco();
 
     /*!
-     * @brief Function to apply depth map filtering to current input depth map
+     * @brief Function to apply depth map filtering to current input depth map. Filtering, clamping to the depth range
+     * and masking of invalid depths are done in one multi-threaded pass.
      * @param depthmap Depth map to be filtered
-     * @return Filtered depth map
+     * @param min_depth Minimum depth value that is allowed
+     * @param max_depth Maximum depth value that is allowed
+     * @return Filtered depth map, input depth map if no filter is activated
      */
-    cv::Mat applyDepthMapPostProcessing(const cv::Mat &depthmap);
+    cv::Mat applyDepthMapPostProcessing(const cv::Mat &depthmap, double min_depth, double max_depth);
 
     /*!
      * @brief Sets all depth values outside the given range to -1.0, so invalid.
@@ -180,11 +237,12 @@ class Densification : public StageBase
     Depthmap::Ptr forceInRange(const Depthmap::Ptr &depthmap, double min_depth, double max_depth);
 
     /*!
-     * @brief
-     * @param buffer_denoise
-     * @return
+     * @brief Filters the depth map of the frame in the middle of the buffer. Cells are kept, if at least two of the
+     * unfiltered neighbouring depth maps agree with them, once projected into the frame.
+     * @param buffer_denoise Frames with their unfiltered depth maps
+     * @return Filtered frame, its depth map is removed if too little coverage is left
      */
-    Frame::Ptr consistencyFilter(std::deque<std::pair<Frame::Ptr, cv::Mat>>* buffer_denoise);
+    Frame::Ptr consistencyFilter(std::deque<std::pair<Frame::Ptr, Depthmap::Ptr>>* buffer_denoise);
 
     /*!
      * @brief Function to compute a mask for the current depth map for valid elements.
@@ -196,12 +254,47 @@ class Densification : public StageBase
     cv::Mat computeDepthMapMask(const cv::Mat &depth_map, bool use_sparse_mask);
 
     /*!
-     * @brief Process function to compute 3d surface reconstruction from input frame.
+     * @brief Post-processing of a reconstructed frame. The depth map is cleaned from outliers and filtered for
+     * consistency with its neighbours, before the frame is saved and published. Runs in the post-processing thread
+     * if asynchronous post-processing is enabled.
+     * @param frame_processed Frame that was reconstructed
+     * @param depthmap Reconstructed depth map of the frame
+     */
+    void postProcess(Frame::Ptr frame_processed, Depthmap::Ptr depthmap);
+
+    /*!
+     * @brief Blocks until the post-processing of the previous frame is finished. Exceptions thrown while post-processing
+     * are rethrown.
+     */
+    void waitForPostProcessing();
+
+    /*!
+     * @brief Waits for the oldest running reconstruction and hands its depth map over to the post-processing
+     */
+    void collectReconstruction();
+
+    /*!
+     * @brief Collects all running reconstructions in the order they were started
+     */
+    void waitForReconstructions();
+
+    /*!
+     * @brief Process function to start the 3d surface reconstruction of the reference frame of the buffer.
      * @param buffer The buffer of frames for which the depth map should be reconstructed.
-     * @param depthmap Output dense depth map
-     * @return True if successful
+     * @param frame_processed Output reference frame that is reconstructed
+     * @return Future of the dense depth map, invalid if the reconstruction was not started
+     */
+    std::future<Depthmap::Ptr> processStereoReconstruction(const std::deque<Frame::Ptr> &buffer, Frame::Ptr &frame_processed);
+
+    /*!
+     * @brief Selects the stereo partners of the reference frame from the candidates. Partners have to pass the
+     * thresholds of baseline, viewing angle and footprint overlap. The best of them are kept, scored by their overlap
+     * and a baseline close to the optimal ratio to the scene depth.
+     * @param candidates Candidate frames in order of their arrival
+     * @param ref_idx Index of the reference frame, is set to its index in the selection
+     * @return Reference frame and its partners in order of their arrival, empty if not enough partners passed
      */
-    Depthmap::Ptr processStereoReconstruction(const std::deque<Frame::Ptr> &buffer, Frame::Ptr &frame_processed);
+    std::deque<Frame::Ptr> selectStereoPartners(const std::deque<Frame::Ptr> &candidates, int &ref_idx) const;
 };
 
 } // namespace stages
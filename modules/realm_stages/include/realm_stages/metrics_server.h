@@ -0,0 +1,126 @@
+
+
+#ifndef PROJECT_METRICS_SERVER_H
+#define PROJECT_METRICS_SERVER_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <realm_stages/stage_base.h>
+
+namespace realm
+{
+namespace stages
+{
+
+/*!
+ * @brief Memory counters of the running process in bytes, read from /proc/self/status
+ */
+struct MemoryStatistics
+{
+  uint64_t resident{};       // Resident set size
+  uint64_t resident_peak{};  // Peak resident set size since process start
+  uint64_t virtual_size{};   // Virtual memory size
+};
+
+/*!
+ * @brief Pull based metrics endpoint for monitoring the pipeline in real time. The statistics of all added stages
+ * together with the memory counters of the process are served in the Prometheus text exposition format on every HTTP
+ * request to the configured port, e.g. "curl http://127.0.0.1:9101/metrics". Statistics are only computed when being
+ * pulled, so there is no cost for the stages as long as nobody scrapes the endpoint.
+ */
+class MetricsServer
+{
+  public:
+    using Ptr = std::shared_ptr<MetricsServer>;
+    using ConstPtr = std::shared_ptr<const MetricsServer>;
+
+  public:
+    /*!
+     * @brief Constructor, the server is not listening before start() was called
+     * @param port Port to listen on for scrapes
+     * @param address IPv4 address to bind to. Defaults to localhost, use "0.0.0.0" to make the metrics available for
+     * remote monitoring
+     */
+    explicit MetricsServer(int port, const std::string &address = "127.0.0.1");
+
+    /*!
+     * @brief Destructor stops the server if still running
+     */
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer &other) = delete;
+    MetricsServer& operator=(const MetricsServer &other) = delete;
+
+    /*!
+     * @brief Adds a stage, which statistics should be exported. Can be called while the server is running.
+     * @param stage Stage of the pipeline
+     */
+    void addStage(const StageBase::Ptr &stage);
+
+    /*!
+     * @brief Binds the socket and starts answering requests in a separate thread
+     * @throws std::runtime_error if the socket could not be bound, e.g. because the port is already in use
+     */
+    void start();
+
+    /*!
+     * @brief Stops answering requests and closes the socket
+     */
+    void stop();
+
+    /*!
+     * @brief Creates the current metrics of all stages and the process in the Prometheus text exposition format
+     * @return Metrics as text
+     */
+    std::string createReport();
+
+    /*!
+     * @brief Reads the memory counters of the running process. All values are zero on systems without procfs.
+     * @return Memory counters in bytes
+     */
+    static MemoryStatistics getMemoryStatistics();
+
+  private:
+
+    //! Port to listen on
+    int m_port;
+
+    //! IPv4 address to bind to
+    std::string m_address;
+
+    //! File descriptor of the listening socket, -1 if not bound
+    int m_socket;
+
+    //! Flag to stop the serving thread
+    std::atomic<bool> m_is_running;
+
+    //! Thread answering the requests
+    std::thread m_thread;
+
+    //! Mutex for the stages, which may be added while serving
+    std::mutex m_mutex_stages;
+
+    //! All stages, which statistics are exported
+    std::vector<StageBase::Ptr> m_stages;
+
+    /*!
+     * @brief Loop of the serving thread, accepts connections until the server is stopped
+     */
+    void serve();
+
+    /*!
+     * @brief Reads the request of an accepted connection and answers it with the current report
+     * @param connection File descriptor of the accepted connection
+     */
+    void respond(int connection);
+};
+
+} // namespace stages
+} // namespace realm
+
+#endif //PROJECT_METRICS_SERVER_H
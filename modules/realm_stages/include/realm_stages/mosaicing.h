@@ -5,19 +5,29 @@
 
 #include <deque>
 #include <chrono>
+#include <unordered_map>
 
 #include <realm_stages/stage_base.h>
 #include <realm_stages/conversions.h>
 #include <realm_stages/stage_settings.h>
 #include <realm_core/frame.h>
+#include <realm_core/spsc_ring_buffer.h>
+#include <realm_core/frame_merger.h>
 #include <realm_core/cv_grid_map.h>
+#include <realm_core/chunked_grid_map.h>
+#include <realm_core/packed_grid_map.h>
 #include <realm_core/analysis.h>
+#include <realm_io/checkpoint_store.h>
+#include <realm_io/frame_store.h>
 #include <realm_io/cv_export.h>
 #include <realm_io/gis_export.h>
 #include <realm_io/gdal_continuous_writer.h>
 #include <realm_io/mvs_export.h>
+#include <realm_io/realm_export.h>
+#include <realm_io/realm_import.h>
 #include <realm_io/utilities.h>
-//#include <realm_ortho/delaunay_2d.h>
+#include <realm_ortho/grid_triangulation.h>
+#include <realm_ortho/tiled_mesher.h>
 
 namespace realm
 {
@@ -47,6 +57,7 @@ class Mosaicing : public StageBase
         bool save_num_obs_one;
         bool save_num_obs_all;
         bool save_dense_ply;
+        bool update_ortho_gtiff_all;
 
         bool save_required()
         {
@@ -96,46 +107,259 @@ class Mosaicing : public StageBase
     ~Mosaicing();
     void addFrame(const Frame::Ptr &frame) override;
     bool process() override;
+
+    /*!
+     * @brief Post processing at the finish. If set, the global map is rebuilt by replaying all kept frames, see
+     * replayFrames().
+     */
     void runPostProcessing();
     void saveAll();
 
+    /*!
+     * @brief Blends the overlap of the global map and the observed map: The data observed under the steeper elevation
+     * angle is kept and the number of observations is incremented. If elevation fusion is set, the elevation is instead
+     * updated with the running mean and variance of all observations (Welford), counted by the number of observations.
+     * If the overlap is a view into the global map, it is blended in place.
+     * @param overlap Overlap of the global map (first) and the observed map (second)
+     * @param is_parallel Flag to blend the rows on the thread pool, false if the caller already runs in parallel
+     * @return Blended overlap, sharing the layers of the first map
+     */
+    CvGridMap blend(CvGridMap::Overlap *overlap, bool is_parallel = true);
+
   private:
-    std::deque<Frame::Ptr> m_buffer;
-    std::mutex m_mutex_buffer;
+    SpscRingBuffer<Frame::Ptr> m_buffer;
+
+    //! Maximum time in [ms] a frame is held back waiting for the frames of other cameras
+    int m_merge_max_delay;
+
+    //! Merges the frames of all upstream chains in order of their timestamps before they are pushed into the buffer,
+    //! so the buffer has only one producer at a time
+    FrameMerger m_frame_merger;
 
     //! Publish of mesh is optional. Set >0 if should be published. Additionally it can be downsampled.
     int m_publish_mesh_nth_iter;
     int m_publish_mesh_every_nth_kf;
     bool m_do_publish_mesh_at_finish;
+
+    //! If only map updates are published, the full map is additionally published every n updates. 0 to disable
+    int m_publish_full_every_nth;
+
+    //! Version of the global map, incremented with every publish
+    uint64_t m_map_version;
     double m_downsample_publish_mesh; // [m/pix]
 
+    //! Edge length of the mesh tiles, only tiles touching the map updates are re-triangulated
+    double m_mesh_tile_size; // [m]
+
+    //! Region of the global map updated since the last mesh publish
+    cv::Rect2d m_roi_mesh_update;
+
     bool m_use_surface_normals;
 
     int m_th_elevation_min_nobs;
     float m_th_elevation_var;
 
+    //! Flag to fuse the elevation of all observations into mean and variance, cells first observed by the current frame
+    //! are marked by a NaN variance until they were blended
+    bool m_fuse_elevation;
+
+    //! Size of the chunks of the global map in grid cells, 0 for a monolithic global map
+    int m_chunk_size;
+
+    //! Flag to store the global map as one packed record per cell, ignored if chunk size > 0
+    bool m_use_packed_layout;
+
+    //! Number of threads used for blending, <= 0 uses all available cores
+    int m_nrof_threads;
+
+    //! Flag to blend on the GPU, not used by the packed layout
+    bool m_use_cuda;
+
     SaveSettings m_settings_save;
 
     UTMPose::Ptr m_utm_reference;
     CvGridMap::Ptr m_global_map;
-    //Delaunay2D::Ptr m_mesher;
+
+    //! Chunked storage of the global map, only used if chunk size > 0. m_global_map is then assembled from it
+    ChunkedGridMap::Ptr m_global_map_chunked;
+
+    //! Revision of the chunked global map, that m_global_map was last assembled from. 0 to assemble it completely
+    uint64_t m_revision_assembled;
+
+    //! Packed storage of the global map, only used if the packed layout is set. m_global_map is then assembled from it
+    PackedGridMap::Ptr m_global_map_packed;
+    TiledMesher::Ptr m_mesher;
     io::GDALContinuousWriter::Ptr m_gdal_writer;
 
-    std::vector<Frame::Ptr> m_frames;
+    //! Processed frames kept for post processing, nullptr if not kept. Older frames are moved to cold storage.
+    io::FrameStore::Ptr m_frames;
+    bool m_do_keep_frames;
+    int m_nrof_frames_resident;
+    io::FrameColdStorage m_frames_cold_storage;
+
+    //! Colour mapped previews of the layers saved every iteration ("<layer>_colored") and the valid mask ("valid") with
+    //! the geometry of the global map, nullptr until the first update
+    CvGridMap::Ptr m_previews;
+
+    //! Value range every preview is colour mapped with
+    std::unordered_map<std::string, std::pair<double, double>> m_preview_ranges;
+
+    //! Flag to rebuild the global map from the kept frames at the finish
+    bool m_do_post_process_replay;
+
+    //! Edge length of the regions of the global map replayed in parallel in grid cells
+    int m_post_process_region_size;
+
+    //! Flag to forward frames with the blended region of the global map instead of their own observations
+    bool m_do_forward_blended;
+
+    //! Checkpoints of the global map, nullptr if disabled
+    io::CheckpointStore::Ptr m_checkpoint_store;
+
+    //! Number of frames between two checkpoints and frames processed since the last one
+    int m_checkpoint_every_nth;
+    int m_nrof_frames_checkpoint;
+
+    //! Flag to restore the global map from the checkpoint before the first frame is processed
+    bool m_do_resume_from_checkpoint;
+
+    //! Region of the global map changed since the last checkpoint
+    cv::Rect2d m_roi_checkpoint;
+
+    //! Generation of the checkpoint. Every generation is one base map, followed by the deltas written since
+    uint32_t m_checkpoint_generation;
+    uint32_t m_nrof_checkpoint_deltas;
+
+    //! Number of cells written in deltas of the current generation, a new base map is written once they exceed the map
+    double m_checkpoint_delta_cells;
 
     void finishCallback() override;
     void printSettingsToLog() override;
     uint32_t getQueueDepth() override;
+    size_t getMemoryUsage() override;
+
+    /*!
+     * @brief Adds new map data to the chunked global map, including blending of the overlap.
+     * @param map Observed map of the current frame
+     * @return Incremental map update
+     */
+    CvGridMap::Ptr addToChunkedMap(const CvGridMap::Ptr &map);
+
+    /*!
+     * @brief Creates the observed map of a frame from its surface model and orthophoto, as it is added to the global map
+     * @param frame Frame with surface model and orthophoto
+     * @param resolution_global Resolution the map is resampled to, 0.0 to keep the resolution of the frame
+     * @param is_initialization Flag whether the global map is initialized with the map, see createElevationVariance
+     * @return Observed map referencing the data of the frame, unless it had to be resampled
+     */
+    CvGridMap::Ptr createObservedMap(const Frame::Ptr &frame, double resolution_global, bool is_initialization) const;
+
+    /*!
+     * @brief Rebuilds the monolithic global map by replaying all kept frames. The map is partitioned into regions, which
+     * are independent, so they are processed in parallel. Frames are restored in batches of the number of resident
+     * frames and blended into every region in their original order, so the result equals the serial blending.
+     * @return Rebuilt global map with the geometry and layers of the current one
+     */
+    CvGridMap::Ptr replayFrames();
+
+    /*!
+     * @brief Adds new map data to the packed global map, merging and blending are done in one pass over the cells.
+     * @param map Observed map of the current frame
+     * @return Incremental map update
+     */
+    CvGridMap::Ptr addToPackedMap(const CvGridMap::Ptr &map);
 
-    CvGridMap blend(CvGridMap::Overlap *overlap);
+    /*!
+     * @brief Assembles the global map from the chunked or packed storage. Only layers necessary for publishing and
+     * saving are assembled. From the chunked storage only regions changed since the last assembly are copied.
+     * @param do_all_layers Flag to assemble all layers, e.g. for the final save
+     */
+    void assembleGlobalMap(bool do_all_layers);
+
+    /*!
+     * @brief Creates the variance layer of the observed map for the elevation fusion. On initialization of the global
+     * map all observed cells start with zero variance, otherwise the variance is NaN, so cells that are merged into the
+     * global map are recognized as first observation while blending.
+     * @param map Observed map of the current frame
+     * @param is_initialization Flag whether the global map is initialized with the map
+     * @return Variance layer as CV_32F matrix
+     */
+    cv::Mat createElevationVariance(const CvGridMap &map, bool is_initialization) const;
+
+    /*!
+     * @brief Forwards the frame with the blended global map in its footprint, e.g. to the tileing stage, so it does not
+     * have to blend the frame against its tiles again. The forwarded frame is a new one with the raw data of the frame,
+     * its surface model and orthophoto hold the same layers taken from the global map. The frame itself is not
+     * modified, as it might be kept for post processing.
+     * @param frame Frame, that was added to the global map
+     * @param roi Footprint of the frame in the global map
+     */
+    void forwardBlended(const Frame::Ptr &frame, const cv::Rect2d &roi);
+
+    /*!
+     * @brief Extracts a region of the global map with all layers as deep copy, independent of its storage
+     * @param roi Region of interest, must be inside the global map
+     * @return Submap with all layers
+     */
+    CvGridMap getGlobalMapRegion(const cv::Rect2d &roi) const;
+
+    /*!
+     * @brief Writes a checkpoint of the global map. Only the region changed since the last checkpoint is written as a
+     * delta to the base map. Once the deltas become larger than the map itself, a new base map is written instead and
+     * the previous generation is removed. The state file is written last, so a checkpoint interrupted by a crash is
+     * never referenced.
+     */
+    void saveCheckpoint();
+
+    /*!
+     * @brief Restores the global map from the checkpoint by applying its deltas to the base map
+     * @return True if a checkpoint was restored
+     */
+    bool loadCheckpoint();
+
+    /*!
+     * @brief Creates the name of a checkpoint file of the global map
+     * @param generation Generation of the checkpoint
+     * @param delta Index of the delta inside the generation, negative for the base map
+     * @return Name of the file inside the checkpoint directory
+     */
+    static std::string createCheckpointFilename(uint32_t generation, int delta);
+
+    /*!
+     * @brief Getter for the resolution of the global map in the layout currently used
+     * @return Resolution in [m/px], 0.0 if the global map is not initialized yet
+     */
+    double getGlobalResolution() const;
 
     void reset() override;
     void initStageCallback() override;
+
+    /*!
+     * @brief Selects the map the mesh is sampled from. If the mesh is downsampled, this is the overview of the map
+     * closest to the mesh resolution, so vertices are filtered instead of picked from single cells.
+     * @param map Map with elevation and color, typically the global map
+     * @return Map or one of its overviews
+     */
+    const CvGridMap& getMeshMap(const CvGridMap::Ptr &map);
+
+    /*!
+     * @brief Updates the mesh with the complete map and returns all of its faces
+     * @param map Map with elevation and color, typically the global map
+     * @return Faces of the complete mesh
+     */
     std::vector<Face> createMeshFaces(const CvGridMap::Ptr &map);
 
     void publish(const Frame::Ptr &frame, const CvGridMap::Ptr &global_map, const CvGridMap::Ptr &update, uint64_t timestamp);
 
-    void saveIter(uint32_t id, const CvGridMap::Ptr &map_update);
+    void saveIter(uint32_t id, const CvGridMap::Ptr &map_update, const cv::Rect2d &roi_update);
+
+    /*!
+     * @brief Updates the valid mask and the colour mapped previews of layers of the global map, which follow its
+     * geometry. Only the region of the update is colour mapped, unless the values exceed the range of a layer.
+     * @param layer_names Names of the layers to be colour mapped
+     * @param roi_update Region of the global map changed since the last update
+     */
+    void updatePreviews(const std::vector<std::string> &layer_names, const cv::Rect2d &roi_update);
     Frame::Ptr getNewFrame();
 };
 
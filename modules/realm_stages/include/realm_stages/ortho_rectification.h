@@ -1,6 +1,7 @@
 #ifndef PROJECT_ORTHO_RECTIFICATION_H
 #define PROJECT_ORTHO_RECTIFICATION_H
 
+#include <atomic>
 #include <deque>
 #include <chrono>
 
@@ -11,6 +12,8 @@
 #include <realm_stages/conversions.h>
 #include <realm_stages/stage_settings.h>
 #include <realm_core/frame.h>
+#include <realm_core/spsc_ring_buffer.h>
+#include <realm_ortho/map_tiler.h>
 #include <realm_ortho/rectification.h>
 
 namespace realm
@@ -42,23 +45,88 @@ class OrthoRectification : public StageBase
     explicit OrthoRectification(const StageSettings::Ptr &stage_set, double rate);
     void addFrame(const Frame::Ptr &frame) override;
     bool process() override;
+
+    /*!
+     * @brief Changes parameters at runtime. Supported is "gsd_factor", the factor >= 1.0 by which the GSD is coarsened
+     * for rectification. The result is resampled to the GSD, so it trades detail for processing time only.
+     * @param name Name of the parameter
+     * @param val Value of the parameter
+     * @return True if the parameter was changed
+     */
+    bool changeParam(const std::string &name, const std::string &val) override;
   private:
 
     bool m_do_publish_pointcloud;
 
+    //! Level of detail of the published point cloud: Stride on the grid and maximum number of points, 0 for no limit
+    int m_pointcloud_stride;
+    int m_pointcloud_max_points;
+
+    int m_nrof_threads;
+
+    int m_interpolation;
+
+    //! Flag to rectify elevated surfaces on the GPU
+    bool m_use_cuda;
+
+    //! Flag to allocate the frame images and the rectified layers in pinned memory for the GPU
+    bool m_use_pinned_memory;
+
+    int m_frames_in_flight;
+
     double m_GSD;
+
+    //! Factor the GSD is coarsened by for rectification, changed at runtime so it is atomic and read without locking
+    std::atomic<double> m_gsd_factor;
+
+    //! Flag to derive the GSD of every frame from its scene depth, m_GSD is then the lower bound
+    bool m_use_gsd_auto;
+
+    //! Upper bound of the automatic GSD, 0.0 for none
+    double m_gsd_auto_max;
+
+    //! Zoom levels of the tile pyramid, the automatic GSD is quantised to their resolutions
+    MapTiler::Ptr m_map_tiler;
+
     SaveSettings m_settings_save;
 
-    std::deque<Frame::Ptr> m_buffer;
-    std::mutex m_mutex_buffer;
+    //! Pool of the per frame matrices of the rectification, shared by all frames in flight
+    MatPool* m_mat_pool;
+
+    SpscRingBuffer<Frame::Ptr> m_buffer;
 
     void reset() override;
+    void finishCallback() override;
     void initStageCallback() override;
     void printSettingsToLog() override;
     uint32_t getQueueDepth() override;
 
+    /*!
+     * @brief Rectifies a single frame and sets the orthophoto. Frames are independent, so it can be called concurrently.
+     * @param frame Frame with surface model to be rectified
+     */
+    void rectifyFrame(const Frame::Ptr &frame);
+
+    /*!
+     * @brief Computes the GSD a frame is rectified with. In automatic mode this is the ground sampling of the camera at
+     * the median scene depth, rounded to the next finer resolution of the zoom levels of the tile pyramid. Otherwise the
+     * configured GSD.
+     * @param frame Frame to be rectified
+     * @return GSD in [m/px]
+     */
+    double computeGSD(const Frame::Ptr &frame) const;
+
     void saveIter(const CvGridMap& surface_model, const CvGridMap& orthophoto, uint8_t zone, char band, uint32_t id);
     void publish(const Frame::Ptr &frame);
+
+    /*!
+     * @brief Creates the published point cloud of a frame from its surface model and orthophoto. Only valid elements on
+     * a regular grid with the configured stride are converted, which thins the cloud evenly like a voxel grid with an
+     * edge length of stride * GSD. The stride is increased, until the cloud fits the maximum number of points.
+     * @param frame Frame with surface model and orthophoto
+     * @return Point cloud with colors and, if available, surface normals
+     */
+    PointCloud::Ptr createPointCloud(const Frame::Ptr &frame) const;
     Frame::Ptr getNewFrame();
 };
 
@@ -0,0 +1,168 @@
+
+
+#ifndef PROJECT_PIPELINE_REPLAY_H
+#define PROJECT_PIPELINE_REPLAY_H
+
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include <realm_core/frame.h>
+#include <realm_core/thread_pool.h>
+#include <realm_stages/stage_base.h>
+
+namespace realm
+{
+namespace stages
+{
+
+/*!
+ * @brief Offline driver of a complete pipeline for reproducible end-to-end benchmarks. Without ROS the stages are
+ * chained in-process: the output frames of every stage are handed directly to the next one, all other transports are
+ * discarded. Frames are taken from a source, e.g. an io::Exiv2DatasetReader of a recorded mission, and optionally
+ * get their poses from a recorded trajectory, so the stages after the pose estimation can be replayed without it. The
+ * replay runs either at maximum speed, throttled only by the backpressure of the pipeline, or at the pace of the frame
+ * timestamps. Afterwards the throughput and latency percentiles of every stage are reported.
+ */
+class PipelineReplay
+{
+  public:
+    using Ptr = std::shared_ptr<PipelineReplay>;
+    using ConstPtr = std::shared_ptr<const PipelineReplay>;
+
+    /*!
+     * @brief Function returning the next frame to be replayed, nullptr if the dataset is finished
+     */
+    using FrameSource = std::function<Frame::Ptr()>;
+
+    enum class Pace
+    {
+      MAX_SPEED,  // Next frame is added as soon as the pipeline is not saturated
+      REAL_TIME   // Frames are added at the intervals of their timestamps in nanoseconds
+    };
+
+    struct StageReport
+    {
+      std::string name;
+      uint32_t frames_in{};      // Frames handed to the stage
+      uint32_t frames_out{};     // Frames published by the stage
+      double fps_out{};          // [Hz] Published frames over the duration of the replay
+      StageStatistics statistics{};
+    };
+
+    struct Report
+    {
+      uint32_t frames_replayed{};
+      uint32_t frames_without_pose{};
+      double duration{};         // [s] From the first frame added to the pipeline being drained
+      bool is_drained{};         // False if the drain timeout was hit
+      std::vector<StageReport> stages;
+    };
+
+  public:
+    /*!
+     * @brief Constructor chains the stages in the given order, e.g. densification -> surface generation -> ortho
+     * rectification -> mosaicing. The stages must not be started yet.
+     * @param stages Stages of the pipeline in processing order
+     * @param output_dir Directory the stages write their output to, same as the stage path of the ROS nodes
+     * @param thread_pool Thread pool shared by all stages, nullptr to use OpenCV's parallel framework
+     */
+    PipelineReplay(const std::vector<StageBase::Ptr> &stages,
+                   const std::string &output_dir,
+                   const ThreadPool::Ptr &thread_pool = nullptr);
+
+    PipelineReplay(const PipelineReplay &) = delete;
+    PipelineReplay& operator=(const PipelineReplay &) = delete;
+
+    /*!
+     * @brief Sets the recorded trajectory, e.g. from io::loadTrajectoryFromTxtTUM. Frames with a timestamp in it are
+     * added as georeferenced keyframes with accurate pose, frames without are skipped.
+     * @param trajectory Geographic poses (3x4) of the frames by their timestamp
+     */
+    void setTrajectory(const std::unordered_map<uint64_t, cv::Mat> &trajectory);
+
+    /*!
+     * @brief Sets the pace the frames are added to the pipeline with. Default is maximum speed.
+     * @param pace Maximum speed or real-time
+     * @param speedup Factor the real-time pace is accelerated with, e.g. 2.0 adds frames twice as fast as recorded
+     */
+    void setPace(Pace pace, double speedup = 1.0);
+
+    /*!
+     * @brief Sets how long the pipeline has to be idle after the last frame to be considered drained and the maximum
+     * time waited for it. Stages may keep frames without a queue, e.g. the mosaicing, so idle means all queues are empty
+     * and no stage counted a frame for the settle time.
+     * @param settle_time [s] Time without activity of all stages
+     * @param timeout [s] Maximum time waited after the last frame
+     */
+    void setDrainTime(double settle_time, double timeout);
+
+    /*!
+     * @brief Replays all frames of the source through the pipeline, waits for it to drain and finishes the stages.
+     * Blocks until done, can only be called once.
+     * @param source Source of the frames in the order of their timestamps
+     * @return Throughput and latency of every stage
+     */
+    Report run(const FrameSource &source);
+
+    /*!
+     * @brief Prints a report as table of per stage fps and latency percentiles in milliseconds
+     * @param report Report of a replay
+     * @param out Stream to print to
+     */
+    static void printReport(const Report &report, std::ostream &out = std::cout);
+
+  private:
+
+    bool m_is_finished;
+
+    Pace m_pace;
+    double m_speedup;
+
+    double m_settle_time;   // [s]
+    double m_drain_timeout; // [s]
+
+    std::vector<StageBase::Ptr> m_stages;
+
+    //! Geographic poses of the frames by timestamp, empty to keep the poses of the source
+    std::unordered_map<uint64_t, cv::Mat> m_trajectory;
+
+    //! Frames handed to and published by each stage, counted in the transports of the replay
+    std::unique_ptr<std::atomic<uint32_t>[]> m_frames_in;
+    std::unique_ptr<std::atomic<uint32_t>[]> m_frames_out;
+
+    /*!
+     * @brief Chains the frame transports and backpressure of the stages and discards all other outputs
+     */
+    void connectStages();
+
+    /*!
+     * @brief Applies the recorded pose of the trajectory to a frame
+     * @param frame Frame to be replayed
+     * @return False if the trajectory has no pose for the frame
+     */
+    bool applyTrajectory(const Frame::Ptr &frame) const;
+
+    /*!
+     * @brief Waits until the pipeline is idle or the drain timeout is hit
+     * @return True if the pipeline is drained
+     */
+    bool waitForDrain() const;
+
+    /*!
+     * @brief Sum of all frame counters of the stages, changes as long as frames move through the pipeline
+     * @return Activity counter
+     */
+    uint64_t getActivity() const;
+};
+
+} // namespace stages
+} // namespace realm
+
+#endif //PROJECT_PIPELINE_REPLAY_H
@@ -0,0 +1,127 @@
+
+
+#ifndef PROJECT_PIPELINE_STARTUP_H
+#define PROJECT_PIPELINE_STARTUP_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <realm_core/frame.h>
+#include <realm_stages/stage_base.h>
+
+namespace realm
+{
+namespace stages
+{
+
+/*!
+ * @brief Asynchronous startup of a pipeline. Constructing the stages is expensive, e.g. loading the vocabulary of the
+ * visual SLAM, initializing CUDA for the densification or registering the GDAL drivers. Instead of constructing them
+ * one after another before any frame is accepted, all stages are constructed concurrently on their own threads. Frames
+ * arriving meanwhile are buffered with a bounded memory and handed to the first stage as soon as the pipeline is ready,
+ * so the startup costs only as long as the slowest stage.
+ *
+ * Factories run concurrently, so they must not depend on each other. Connecting the stages, e.g. registering the
+ * transports, and starting them is left to the ready function, which is called once all stages were constructed.
+ */
+class PipelineStartup
+{
+  public:
+    using Ptr = std::shared_ptr<PipelineStartup>;
+    using ConstPtr = std::shared_ptr<const PipelineStartup>;
+
+    //! Creates a stage, e.g. by the stage settings factory and the constructor of the stage
+    using StageFactory = std::function<StageBase::Ptr()>;
+
+    //! Called with the constructed stages in order of their factories, must connect and start them
+    using ReadyFunc = std::function<void(const std::vector<StageBase::Ptr> &)>;
+
+  public:
+    /*!
+     * @brief Constructor
+     * @param factories Factories of the stages in processing order, the first stage receives the frames
+     * @param on_ready Function connecting and starting the stages once all were constructed
+     * @param max_buffered_bytes Maximum memory of the frames buffered during startup. If exceeded, the oldest frames
+     * are dropped, the newest frame is always kept.
+     */
+    PipelineStartup(const std::vector<StageFactory> &factories, const ReadyFunc &on_ready, size_t max_buffered_bytes);
+
+    /*!
+     * @brief Destructor waits for the construction of all stages to finish
+     */
+    ~PipelineStartup();
+
+    PipelineStartup(const PipelineStartup &) = delete;
+    PipelineStartup& operator=(const PipelineStartup &) = delete;
+
+    /*!
+     * @brief Starts constructing all stages concurrently and returns immediately
+     */
+    void start();
+
+    /*!
+     * @brief Adds a frame to the pipeline. During startup it is buffered, afterwards it is directly handed to the first
+     * stage.
+     * @param frame Frame to be processed
+     */
+    void addFrame(const Frame::Ptr &frame);
+
+    /*!
+     * @brief Checks if all stages were constructed and the buffered frames were handed to the first stage
+     * @return True if the pipeline is ready
+     */
+    bool isReady() const;
+
+    /*!
+     * @brief Blocks until the startup finished
+     * @return Constructed stages in order of their factories
+     * @throws Exception of the first factory that failed
+     */
+    std::vector<StageBase::Ptr> waitForStages();
+
+    /*!
+     * @brief Getter for the number of frames dropped during startup, because the buffer was full
+     * @return Number of dropped frames
+     */
+    uint32_t getNrofDroppedFrames() const;
+
+  private:
+
+    std::vector<StageFactory> m_factories;
+    ReadyFunc m_on_ready;
+
+    //! Thread constructing the stages and finishing the startup
+    std::thread m_thread;
+
+    mutable std::mutex m_mutex_startup;
+    std::condition_variable m_condition_startup;
+    bool m_is_finished;
+    std::exception_ptr m_exception;
+    std::vector<StageBase::Ptr> m_stages;
+
+    //! Frames buffered until the pipeline is ready, guarded by m_mutex_startup
+    size_t m_max_buffered_bytes;
+    size_t m_buffered_bytes;
+    std::deque<std::pair<Frame::Ptr, size_t>> m_buffer;
+
+    std::atomic<bool> m_is_ready;
+    std::atomic<uint32_t> m_nrof_dropped_frames;
+
+    /*!
+     * @brief Constructs all stages concurrently, calls the ready function and hands the buffered frames to the first
+     * stage. Runs in its own thread.
+     */
+    void initialize();
+};
+
+} // namespace stages
+} // namespace realm
+
+#endif //PROJECT_PIPELINE_STARTUP_H
@@ -3,18 +3,27 @@
 #ifndef PROJECT_POSE_ESTIMATION_STAGE_H
 #define PROJECT_POSE_ESTIMATION_STAGE_H
 
+#include <atomic>
 #include <iostream>
+#include <functional>
+#include <future>
+#include <memory>
 
 #include <realm_stages/stage_base.h>
 #include <realm_stages/stage_settings.h>
+#include <realm_core/footprint_index.h>
 #include <realm_core/frame.h>
+#include <realm_core/georeference.h>
 #include <realm_core/camera_settings.h>
 #include <realm_core/imu_settings.h>
 #include <realm_core/structs.h>
+#include <realm_io/checkpoint_store.h>
 #include <realm_io/cv_export.h>
 #include <realm_io/realm_export.h>
+#include <realm_io/realm_import.h>
 #include <realm_vslam_base/dummy_referencer.h>
 #include <realm_vslam_base/geometric_referencer.h>
+#include <realm_vslam_base/imu_motion_prior.h>
 #include <realm_vslam_base/visual_slam_factory.h>
 
 #ifdef WITH_EXIV2
@@ -67,6 +76,28 @@ class PoseEstimation : public StageBase
         }
     };
 
+    /*!
+     * @brief Everything the publisher thread publishes in a single wakeup, see registerPublishBatchTransport
+     */
+    struct PublishBatch
+    {
+        // Frames whose pose is published, in order of publishing
+        std::vector<Frame::Ptr> poses;
+
+        // Sparse clouds due for publishing. Only the newest one, if the publish rate of sparse clouds is limited
+        std::vector<PointCloud::Ptr> sparse_clouds;
+
+        // Frames published to the following stages, in order of publishing
+        std::vector<Frame::Ptr> frames;
+
+        bool empty() const
+        {
+          return poses.empty() && sparse_clouds.empty() && frames.empty();
+        }
+    };
+
+    using PublishBatchTransportFunc = std::function<void(const PublishBatch &)>;
+
   public:
     PoseEstimation(const StageSettings::Ptr &stage_set,
                    const VisualSlamSettings::Ptr &vslam_set,
@@ -81,23 +112,42 @@ class PoseEstimation : public StageBase
 
     void queueImuData(const VisualSlamIF::ImuData &imu) const;
 
+    /*!
+     * @brief Alternative to the separate pose, point cloud and frame transports. All poses, sparse clouds and frames due
+     * in a wakeup of the publisher thread are grouped into a single transport event. If set, the separate transports
+     * are not used by the publisher thread anymore.
+     * @param func This function consists of the batch of data published in one wakeup
+     */
+    void registerPublishBatchTransport(const PublishBatchTransportFunc &func);
+
   private:
     // Flag for initialization of georeference
     bool m_is_georef_initialized;
 
     // Flag to disable usage of visual slam. If Flag is set to 'false', then this stage
-    // only works as image throttle according to the max overlap defined in the settings
-    bool m_use_vslam;
+    // only works as image throttle according to the max overlap defined in the settings. Can be changed at runtime by
+    // changeParam, so it is atomic and read without locking.
+    std::atomic<bool> m_use_vslam;
 
     // Flag to enable usage of IMU. Note, that a IMU settings file must be provided.
     bool m_use_imu;
 
+    // Resize factor of the visual SLAM. Images are resized and converted to grayscale with it already on input, so
+    // tracking only has to hand them over
+    double m_resizing_vslam;
+
     // Flag to set all tracked frames as keyframes, consequently they are published in higher frequency for the next stage
     bool m_set_all_frames_keyframes;
 
     // Flag to disable fallback solution based on lat/lon/alt/heading completely
     bool m_use_fallback;
 
+    // Set while the visual SLAM is lost. Frames queued meanwhile are published GNSS only by the fallback worker, the
+    // tracking thread only tries to reinitialize on the newest one.
+    std::atomic<bool> m_is_tracking_lost;
+    ThreadPool::Ptr m_pool_fallback;
+    std::future<void> m_future_fallback;
+
     // The maximum number of lost frames when initializing before attempting a reset
     int m_init_lost_frames_reset_count;
     int m_init_lost_frames;
@@ -105,6 +155,18 @@ class PoseEstimation : public StageBase
     // Flag to disable using an initial guess of the camera pose to make tracking more stable in the visual SLAM
     bool m_use_initial_guess;
 
+    // Prediction of the next pose from IMU and last tracked motion as initial guess, nullptr if disabled
+    ImuMotionPrior::Ptr m_imu_prior;
+
+    // Adaptive tracking: Frames still overlapping more than the threshold with the last frame tracked by the visual SLAM
+    // are dropped. The overlap is estimated from the features of that frame propagated with optical flow.
+    bool m_use_adaptive_tracking;
+    double m_th_overlap_adaptive;
+    int m_max_skipped_frames_adaptive;
+    int m_nrof_skipped_frames_adaptive;
+    cv::Mat m_img_ref_adaptive;
+    std::vector<cv::Point2f> m_features_ref_adaptive;
+
     // Flag to disable georeferencing updates after initialization. Might result in a more consistent map, but worse
     // georeferencing results
     bool m_do_update_georef;
@@ -121,6 +183,11 @@ class PoseEstimation : public StageBase
     double m_th_error_georef;
     int m_min_nrof_frames_georef;
 
+    // Number of most recent measurements the georeference is refined with (0 for all) and maximum distance of a new
+    // measurement to its predicted position to be used for refinement (0 to disable)
+    int m_window_size_georef;
+    double m_th_outlier_georef;
+
     // Scale changes are constantly checked to identify divergence. Flag can be set to auto reset on divergence.
     bool m_do_auto_reset;
     double m_th_scale_change;
@@ -129,12 +196,44 @@ class PoseEstimation : public StageBase
     FallbackStrategy m_strategy_fallback;
     double m_overlap_max;          // [%] Maxmimum overlap for every publish to be checked, even keyframes
     double m_overlap_max_fallback; // [%] Maximum overlap for fallback publishes, e.g. GNSS only
+    double m_overlap_max_saturated; // [%] Maximum overlap for all publishes while following stages are saturated
+    double m_publish_sparse_cloud_rate; // [Hz] Maximum rate of sparse cloud publishes, 0 for every frame
+
+    // Transport of all data published in one wakeup at once, the separate transports are used if not set
+    PublishBatchTransportFunc m_transport_publish_batch;
 
     SaveSettings m_settings_save;
 
-    // Transformation from visual world to geo coordinate frame
-    std::mutex m_mutex_t_w2g;
-    cv::Mat m_T_w2g;
+    // Writer of the geotagged images, separate from the exports of the stages, so recording does not wait for tiles
+    io::ExportService::Ptr m_image_writer;
+
+    // Epoch of the last applied batch of pose updates from the visual SLAM, older batches are dropped
+    std::mutex m_mutex_pose_update_epoch;
+    uint64_t m_pose_update_epoch;
+
+    // Transformation from visual world to geo coordinate frame, uninitialized until the georeference is computed.
+    // Updated by the georeference workers in constant time, frames attached to it resolve the latest transformation
+    // when they are published. Replaced on reset, so frames of the previous visual world keep theirs, and therefore
+    // always accessed with std::atomic_load/std::atomic_store.
+    Georeference::Ptr m_georeference;
+
+    // Checkpoints of the georeference and the map of the visual SLAM, nullptr if disabled
+    io::CheckpointStore::Ptr m_checkpoint_store;
+
+    // Number of tracked frames between two checkpoints and frames tracked since the last one
+    int m_checkpoint_every_nth;
+    int m_nrof_frames_checkpoint;
+
+    // Flag to restore the georeference and the map from the checkpoint before the first frame is tracked
+    bool m_do_resume_from_checkpoint;
+
+    // Worker for the buffer management and georeferencing of tracked frames
+    ThreadPool::Ptr m_pool_georef;
+    std::future<void> m_future_georef;
+
+    // Worker for the initialization and refinement of the georeference
+    ThreadPool::Ptr m_pool_georef_refine;
+    std::future<void> m_future_georef_refine;
 
     // Current debug image, gets published by PoseEstimationIO
     // Warning: As soon as published, it will get released
@@ -144,7 +243,10 @@ class PoseEstimation : public StageBase
 
     // Overlap estimation
     Plane m_plane_ref;       // Reference plane for projection, normally (0,0,0), (0,0,1)
-    cv::Rect2d m_roi_prev;   // Previous published roi, used for overlap calculation
+    // Footprints of the last published frames, used for overlap calculation. Accessed by the publisher and the fallback
+    // worker, so always lock the mutex.
+    std::mutex m_mutex_footprints_published;
+    FootprintIndex m_footprints_published;
 
     // Buffer for all frames added
     std::deque<Frame::Ptr> m_buffer_no_pose;
@@ -175,8 +277,65 @@ class PoseEstimation : public StageBase
     void initStageCallback() override;
     void printSettingsToLog() override;
     uint32_t getQueueDepth() override;
+    size_t getMemoryUsage() override;
 
     void applyGeoreferenceToBuffer();
+
+    /*!
+     * @brief Sorts a tracked frame into the buffers, triggers initialization or refinement of the georeference and
+     * georeferences the buffered frames once possible. Runs on the georeference worker.
+     * @param frame Frame after tracking
+     */
+    void processGeoreference(const Frame::Ptr &frame);
+
+    /*!
+     * @brief Runs an initialization or refinement of the georeference on its worker, if it is not busy with the
+     * previous one. Otherwise the request is dropped.
+     * @param task Task calling the georeferencer
+     */
+    void dispatchGeoreferenceRefinement(const std::function<void()> &task);
+
+    /*!
+     * @brief Publishes the current transformation of the georeferencer in m_georeference, if it is initialized
+     */
+    void publishGeoreference();
+
+    /*!
+     * @brief Blocks until all dispatched georeferencing tasks have finished
+     */
+    void waitForGeoreferencing();
+
+#ifdef WITH_EXIV2
+    /*!
+     * @brief Queues a frame to be saved as geotagged image by the image writer
+     * @param frame Frame to be saved
+     * @param folder Folder inside the stage path
+     * @param name Name of the file, completed by the frame id
+     * @param use_resized Flag to save the resized image instead of the full one
+     */
+    void saveExifImageAsync(const Frame::Ptr &frame, const std::string &folder, const std::string &name, bool use_resized);
+#endif
+
+    /*!
+     * @brief Writes the georeference and, if supported by the framework, the map of the visual SLAM as checkpoint.
+     * Nothing is written until the georeference is initialized.
+     */
+    void saveCheckpoint();
+
+    /*!
+     * @brief Restores the map of the visual SLAM and the georeference from the checkpoint. The georeference is only
+     * valid in the visual frame of the saved map, so it is not restored without it. The restored georeference is kept
+     * fixed, as the frames it was computed from are not part of the checkpoint.
+     * @return True if a checkpoint was restored
+     */
+    bool loadCheckpoint();
+    /*!
+     * @brief Hands a frame without visual pose to the fallback worker, which queues it for a GNSS only publish if its
+     * overlap allows it. Frames are handled in order of submission.
+     * @param frame Frame without accurate pose
+     */
+    void dispatchFallback(const Frame::Ptr &frame);
+
     void printGeoReferenceInfo(const Frame::Ptr &frame);
     void pushToBufferNoPose(const Frame::Ptr &frame);
     void pushToBufferInit(const Frame::Ptr &frame);
@@ -184,11 +343,33 @@ class PoseEstimation : public StageBase
     void pushToBufferPublish(const Frame::Ptr &frame);
     void updatePreviousRoi(const Frame::Ptr &frame);
     void updateKeyframeCb(int id, const cv::Mat& pose, const cv::Mat &points);
+
+    /*!
+     * @brief Applies a batch of corrected visual poses, e.g. after a loop closure. Every buffer is locked and searched
+     * only once for the whole batch instead of once per keyframe.
+     * @param epoch Increasing number of the batch, batches older than the last applied one are dropped
+     * @param updates Corrected visual poses with the ids of their frames
+     */
+    void updateKeyframesBatchCb(uint64_t epoch, const std::vector<VisualSlamIF::PoseUpdate> &updates);
     bool changeParam(const std::string& name, const std::string &val);
     double estimatePercOverlap(const Frame::Ptr &frame);
     Frame::Ptr getNewFrameTracking();
     Frame::Ptr getNewFramePublish();
     cv::Mat computeInitialPoseGuess(const Frame::Ptr &frame);
+
+    /*!
+     * @brief Estimates the image overlap of a frame to the last frame tracked by the visual SLAM. Features of that frame
+     * are propagated with pyramidal Lucas-Kanade optical flow and a homography between both is fitted to them.
+     * @param frame Frame to be tracked
+     * @return Overlap in [%], 0 if it could not be estimated
+     */
+    double estimateOverlapAdaptive(const Frame::Ptr &frame) const;
+
+    /*!
+     * @brief Sets a frame tracked by the visual SLAM as reference of the adaptive tracking
+     * @param frame Successfully tracked frame
+     */
+    void updateReferenceAdaptive(const Frame::Ptr &frame);
     void updateOrientationCorrection(const Frame::Ptr &frame);
 };
 
@@ -217,6 +398,13 @@ class PoseEstimationIO : public WorkerThreadBase
     TimeReference m_t_ref;
     std::deque<Task> m_schedule;
 
+    // Data collected for publishing in the current wakeup
+    PoseEstimation::PublishBatch m_batch;
+
+    // Sparse clouds waiting for the publish interval to elapse and time of the last sparse cloud publish
+    std::vector<PointCloud::Ptr> m_sparse_clouds_pending;
+    long m_t_last_sparse_cloud;
+
     // online processing
     void reset() override;
     void publishPose(const Frame::Ptr &frame);
@@ -225,6 +413,12 @@ class PoseEstimationIO : public WorkerThreadBase
     void scheduleFrame(const Frame::Ptr &frame);
     void publishScheduled();
     void publishAll();
+
+    /*!
+     * @brief Transports the data collected in the current wakeup, either as a single batch or through the separate
+     * transports of the stage. Pending sparse clouds are only added, once their publish interval elapsed.
+     */
+    void flushBatch();
 };
 
 } // namespace stages
@@ -0,0 +1,156 @@
+
+
+#ifndef PROJECT_QUALITY_CONTROLLER_H
+#define PROJECT_QUALITY_CONTROLLER_H
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <realm_core/timer.h>
+#include <realm_stages/stage_base.h>
+
+namespace realm
+{
+namespace stages
+{
+
+/*!
+ * @brief Holds the pipeline at real time by degrading the quality of the processing instead of dropping frames, which
+ * leaves gaps in the map. The controller watches the statistics of the stages and moves between quality levels, from
+ * 0 (full quality) to the maximum level (lowest quality). Every registered knob, e.g. the number of planes of the plane
+ * sweep, the GSD factor of the ortho rectification or the iterations of the DSM, is interpolated between its full and
+ * its degraded value according to the level and changed on the stage through StageBase::changeParam.
+ *
+ * A stage is overloaded, if it dropped frames since the last update, it is saturated (see StageBase::isSaturated) or,
+ * if enabled, it publishes noticeably fewer frames than it receives. Then the level is raised by one step. Once no stage
+ * was overloaded for a number of updates and the queues are nearly empty, the level is lowered again. The hysteresis keeps the quality from oscillating.
+ */
+class QualityController
+{
+  public:
+    using Ptr = std::shared_ptr<QualityController>;
+    using ConstPtr = std::shared_ptr<const QualityController>;
+
+    struct Knob
+    {
+      StageBase::Ptr stage;
+      std::string name;     // Name of the parameter passed to changeParam
+      double value_full;    // Value at full quality, level 0
+      double value_lowest;  // Value at lowest quality, maximum level
+      bool is_integer;      // Value is rounded, e.g. for the number of planes
+    };
+
+  public:
+    /*!
+     * @brief Constructor
+     * @param nrof_levels Number of quality levels below full quality, must be > 0
+     * @param nrof_updates_recover Number of consecutive updates without overload before the quality is raised again
+     * @param th_fps_ratio Ratio fps_out / fps_in below which a stage is considered to fall behind, in range [0, 1]. Set
+     * 0 to disable, e.g. if watched stages publish fewer frames than they receive by design like the pose estimation
+     */
+    explicit QualityController(int nrof_levels = 4, int nrof_updates_recover = 5, double th_fps_ratio = 0.0);
+
+    /*!
+     * @brief Destructor stops the periodic updates
+     */
+    ~QualityController();
+
+    QualityController(const QualityController &) = delete;
+    QualityController& operator=(const QualityController &) = delete;
+
+    /*!
+     * @brief Adds a stage, whose statistics are watched to detect an overload. Stages with knobs are watched anyway.
+     * @param stage Stage of the pipeline
+     */
+    void watch(const StageBase::Ptr &stage);
+
+    /*!
+     * @brief Adds a knob and sets it to the value of the current level
+     * @param knob Parameter of a stage to be degraded under load
+     */
+    void addKnob(const Knob &knob);
+
+    /*!
+     * @brief Starts updating the level periodically on the shared timer thread
+     * @param period Time between two updates, should be in the range of seconds
+     */
+    void start(const std::chrono::milliseconds &period);
+
+    /*!
+     * @brief Stops the periodic updates, the knobs keep their current values
+     */
+    void stop();
+
+    /*!
+     * @brief Evaluates the statistics of the stages once and changes the level if necessary. Called periodically after
+     * start(), but may also be called by the owner, e.g. after every frame of a replay.
+     * @return Current level after the update
+     */
+    int update();
+
+    /*!
+     * @brief Getter for the current quality level
+     * @return Level in range [0, nrof_levels], 0 is full quality
+     */
+    int getLevel() const;
+
+    /*!
+     * @brief Computes the value of a knob at a level
+     * @param knob Knob to be evaluated
+     * @param level Quality level in range [0, nrof_levels]
+     * @param nrof_levels Number of quality levels below full quality
+     * @return Value, rounded for integer knobs
+     */
+    static double computeValue(const Knob &knob, int level, int nrof_levels);
+
+  private:
+
+    struct WatchedStage
+    {
+      StageBase::Ptr stage;
+      uint32_t frames_dropped{};
+    };
+
+    int m_nrof_levels;
+    int m_nrof_updates_recover;
+    double m_th_fps_ratio;
+
+    int m_level;
+
+    //! Number of consecutive updates without any stage being overloaded
+    int m_nrof_updates_calm;
+
+    std::vector<WatchedStage> m_stages;
+    std::vector<Knob> m_knobs;
+
+    mutable std::mutex m_mutex;
+
+    Timer::Ptr m_timer;
+
+    /*!
+     * @brief Checks if a stage is overloaded since the last update. Expects the lock to be held.
+     * @param watched Stage with the statistics of the last update, which are updated
+     * @param is_idle Output; True if the queue of the stage holds at most one frame
+     * @return True if overloaded
+     */
+    bool isOverloaded(WatchedStage &watched, bool &is_idle) const;
+
+    /*!
+     * @brief Sets all knobs to the values of the current level. Expects the lock to be held.
+     */
+    void applyLevel() const;
+
+    /*!
+     * @brief Sets a knob to the value of the current level. Expects the lock to be held.
+     * @param knob Knob to be set
+     */
+    void applyKnob(const Knob &knob) const;
+};
+
+} // namespace stages
+} // namespace realm
+
+#endif //PROJECT_QUALITY_CONTROLLER_H
@@ -5,6 +5,7 @@
 
 #include <iostream>
 #include <functional>
+#include <map>
 #include <thread>
 #include <chrono>
 #include <mutex>
@@ -12,11 +13,18 @@
 
 #include <opencv2/core.hpp>
 
+#include <realm_core/async_log_sink.h>
 #include <realm_core/frame.h>
 #include <realm_core/timer.h>
+#include <realm_core/latency_histogram.h>
+#include <realm_core/memory_budget.h>
 #include <realm_core/structs.h>
 #include <realm_core/worker_thread_base.h>
+#include <realm_core/thread_pool.h>
 #include <realm_core/settings_base.h>
+#include <realm_io/export_service.h>
+#include <realm_io/frame_snapshot.h>
+#include <realm_io/trace_export.h>
 
 namespace realm
 {
@@ -35,6 +43,10 @@ struct StageStatistics {
   uint32_t frames_processed{};
   Statistics queue_statistics{};
   Statistics process_statistics{};
+  LatencyPercentiles queue_latency{};   // [ms] Time between adding a frame and taking it out of the queue
+  LatencyPercentiles process_latency{}; // [ms] Time of the processing steps
+  LatencyPercentiles frame_age{};       // [ms] Age of outgoing frames relative to their capture timestamp
+  uint64_t memory_usage{};              // [bytes] Data held by the stage, e.g. buffered frames and maps
 };
 
 /*!
@@ -60,8 +72,12 @@ class StageBase : public WorkerThreadBase
     using DepthMapTransportFunc = std::function<void(const cv::Mat &, const std::string &)>;
     using PointCloudTransportFunc = std::function<void(const PointCloud::Ptr &, const std::string &)>;
     using ImageTransportFunc = std::function<void(const cv::Mat &, const std::string &)>;
+    using CompressedImageTransportFunc = std::function<void(const std::vector<uint8_t> &, const std::string &, const std::string &)>;
     using MeshTransportFunc = std::function<void(const std::vector<Face> &, const std::string &)>;
+    using MeshTileTransportFunc = std::function<void(const std::vector<MeshTile> &, const std::string &)>;
     using CvGridMapTransportFunc = std::function<void(const CvGridMap &, uint8_t zone, char band, const std::string &)>;
+    using CvGridMapDeltaTransportFunc = std::function<void(const CvGridMap &, uint64_t version, uint8_t zone, char band, const std::string &)>;
+    using FrameScoreFunc = std::function<double(const Frame::Ptr &)>;
   public:
     /*!
      * @brief Basic constructor for stage class
@@ -110,6 +126,12 @@ class StageBase : public WorkerThreadBase
      */
     StageStatistics getStageStatistics();
 
+    /*!
+     * @brief Getter for the name of the stage, e.g. to label exported statistics
+     * @return Name of the stage
+     */
+    std::string getStageName() const;
+
 
     /*!
      * @brief Because REALM is independent from the communication infrastructure (e.g. ROS), a transport to the
@@ -156,6 +178,17 @@ class StageBase : public WorkerThreadBase
      * "output/result_img". Timestamp may or may not be set inside the stag      */
     void registerImageTransport(const ImageTransportFunc &func);
 
+    /*!
+     * @brief Alternative to the image transport for receivers on low bandwidth links, e.g. ground stations. Images are
+     * downscaled and encoded inside the stage before they are transported, see io::encodeImageCompressed. Replaces a
+     * previously registered image transport and vice versa. Images that can not be encoded are dropped.
+     * @param func This function consists of the encoded img, its format ("jpeg" or "png") and a defined topic as
+     * description for the data (for example: "output/result_img").
+     * @param scale Factor images are resized with before encoding in range (0, 1]
+     * @param quality Jpeg quality in range [0, 100]
+     */
+    void registerCompressedImageTransport(const CompressedImageTransportFunc &func, double scale = 1.0, int quality = 80);
+
     /*!
      * @brief Because REALM is independent from the communication infrastructure (e.g. ROS), a transport to the
      * corresponding communication interface has to be defined. We chose to use callback functions, that can be
@@ -165,6 +198,15 @@ class StageBase : public WorkerThreadBase
      * "output/result_frame". Timestamp may or may not be set inside the stage     */
     void registerMeshTransport(const MeshTransportFunc &func);
 
+    /*!
+     * @brief Because REALM is independent from the communication infrastructure (e.g. ROS), a transport to the
+     * corresponding communication interface has to be defined. Other than the mesh transport, this one only transports
+     * the tiles of a mesh that changed, so receivers have to replace the faces of every tile they receive.
+     * @param func This function consists of a vector of changed mesh tiles, a defined topic as description for the data
+     * (for example: "output/mesh/update").
+     */
+    void registerMeshTileTransport(const MeshTileTransportFunc &func);
+
     /*!
      * @brief Because REALM is independent from the communication infrastructure (e.g. ROS), a transport to the
      * corresponding communication interface has to be defined. We chose to use callback functions, that can be
@@ -174,6 +216,99 @@ class StageBase : public WorkerThreadBase
      * "output/result_gridmap". Timestamp may or may not be set inside the stage fo  */
     void registerCvGridMapTransport(const CvGridMapTransportFunc &func);
 
+    /*!
+     * @brief Because REALM is independent from the communication infrastructure (e.g. ROS), a transport to the
+     * corresponding communication interface has to be defined. Other than the grid map transport, this one is meant for
+     * publishing only the changed regions of a growing map together with a version, which is incremented with every
+     * update. Receivers reconstruct the map from them, e.g. with a MapDeltaAssembler. If set, stages use it instead of
+     * transporting the whole map every time.
+     * @param func This function consists of a CvGridMap type, the version of the update, the UTM zone and band and a
+     * defined topic as description for the data (for example: "output/update/ortho").
+     */
+    void registerCvGridMapDeltaTransport(const CvGridMapDeltaTransportFunc &func);
+
+    /*!
+     * @brief Sets the thread pool for data-parallel sub-tasks of the stage. The pool should be created once per pipeline
+     * and shared by all stages, so idle stages leave their cores to busy ones. Must be set before the stage is started.
+     * If no pool is set, stages use OpenCV's parallel framework.
+     * @param thread_pool Thread pool shared by all stages of the pipeline
+     */
+    void setThreadPool(const ThreadPool::Ptr &thread_pool);
+
+    /*!
+     * @brief Same as the transports, the connection to the following stage is set from the outside. Through this
+     * function the stage gets to know if the following stage can keep up. Typically it is set to the isSaturated()
+     * function of the next stage, e.g. densification->registerBackpressure([=]{ return surface->isSaturated(); });
+     * Because isSaturated() includes the stages further down, the backpressure propagates through the whole pipeline.
+     * @param func Function that returns true, if the following stages are saturated and would drop new frames
+     */
+    void registerBackpressure(const std::function<bool()> &func);
+
+    /*!
+     * @brief Checks if this stage or any of its following stages can not keep up at the moment. Previous stages should
+     * then reduce the frames they hand over, because those would only be dropped.
+     * @return true if the queue of this stage is full or the following stages are saturated
+     */
+    bool isSaturated();
+
+    /*!
+     * @brief Sets the policy which frames are kept, when the input queue of the stage is full. Every incoming frame is
+     * scored and if the queue is full, the frame with the lower score of the incoming and the oldest one is dropped.
+     * Without a score function, the oldest frame is always dropped. Must be set before frames are added.
+     * @param func Function that returns the score of a frame, higher values are more valuable
+     */
+    void registerFrameScore(const FrameScoreFunc &func);
+
+    /*!
+     * @brief Creates a score function for registerFrameScore(), that prefers frames extending the map coverage. The score
+     * is the fraction of the projected image bounds, that does not overlap with the previously scored frame. Every
+     * created function keeps its own previous frame, so a separate one should be created for every stage.
+     * @return Score function in the range of [0, 1]
+     */
+    static FrameScoreFunc createCoverageScore();
+
+    /*!
+     * @brief Reads the scheduling of a thread from the stage settings, e.g. "thread_cpus", "thread_nice" and
+     * "thread_realtime_priority" for prefix "thread". Parameters missing in the settings keep the default scheduling.
+     * @param settings Stage settings
+     * @param prefix Prefix of the parameter names, e.g. "thread" for the processing thread of the stage
+     * @return Scheduling for WorkerThreadBase::setThreadScheduling()
+     */
+    static ThreadScheduling readThreadScheduling(const SettingsBase &settings, const std::string &prefix);
+
+    /*!
+     * @brief Sets the exporter for the end-to-end traces of frames. Stages always record when frames are enqueued,
+     * dequeued, processed and published. With an exporter set, the trace of every outgoing frame is added to it. The
+     * exporter should be shared by all stages of the pipeline and saved by its owner, e.g. after the mission.
+     * @param exporter Trace exporter shared by all stages of the pipeline
+     */
+    void setTraceExporter(const io::TraceExporter::Ptr &exporter);
+
+    /*!
+     * @brief Enables the capture mode of the stage. Every incoming frame is written to the snapshot, before it is
+     * queued, with all data of the previous stages. Replaying the snapshot into a single stage, e.g. with
+     * io::FrameSnapshotReader and stages::PipelineReplay, allows to benchmark and optimise it in isolation with
+     * identical inputs. Writing is synchronous, so capturing slows down the stage feeding this one.
+     * @param writer Snapshot the incoming frames are appended to, nullptr to stop capturing
+     */
+    void setInputCapture(const io::FrameSnapshotWriter::Ptr &writer);
+
+    /*!
+     * @brief Sets the memory budget of the pipeline. The stage reports the memory of its data to the budget with every
+     * processed frame. Once the budget is exceeded, stages degrade gracefully by releasing optional data, e.g. images
+     * of rectified frames or map regions far from the current frame.
+     * @param budget Memory budget shared by all stages of the pipeline
+     */
+    void setMemoryBudget(const MemoryBudget::Ptr &budget);
+
+    /*!
+     * @brief Sets the service for the exports of the stage, e.g. the results saved every iteration. The service should
+     * be shared by all stages of the pipeline and must be set before the stage is started. If no service is set, the
+     * stage creates its own single threaded one on the first export.
+     * @param service Export service shared by all stages of the pipeline
+     */
+    void setExportService(const io::ExportService::Ptr &service);
+
   protected:
 
     bool m_is_output_dir_initialized;
@@ -198,6 +333,14 @@ class StageBase : public WorkerThreadBase
     StageStatistics m_stage_statistics{};
     mutable std::mutex m_mutex_statistics;
 
+    /*!
+     * @brief Latency histograms for the percentiles in the stage statistics. The time a frame was queued is stored with
+     * its id until the frame is taken out of the queue.
+     */
+    std::map<uint32_t, long> m_t_frames_queued;
+    LatencyHistogram m_histogram_queue_latency;
+    LatencyHistogram m_histogram_frame_age;
+
     /*!
      * @brief Short name of the implemented stage. Should be written by derived classes
      */
@@ -213,6 +356,11 @@ class StageBase : public WorkerThreadBase
      */
     bool m_log_to_file;
 
+    /*!
+     * @brief Sink writing the log file of the stage in the background, nullptr if logging to file is disabled
+     */
+    AsyncLogSink::Ptr m_log_sink;
+
     /*!
      * @brief This function consists of a result frame, a defined topic as description for the data (for example:
      * "output/result_frame". ll be set through "registerFrameTransport".
@@ -250,12 +398,61 @@ class StageBase : public WorkerThreadBase
      */
     MeshTransportFunc m_transport_mesh;
 
+    /*!
+     * @brief This function consists of a vector of changed mesh tiles, a defined topic as description for the data (for
+     * example: "output/mesh/update"). Will be set through "registerMeshTileTransport".
+     */
+    MeshTileTransportFunc m_transport_mesh_tiles;
+
+    /*!
+     * @brief Returns true, if the following stages are saturated. Will be set through "registerBackpressure".
+     */
+    std::function<bool()> m_is_downstream_saturated;
+
+    /*!
+     * @brief Returns the score of an incoming frame for the queue policy. Will be set through "registerFrameScore".
+     */
+    FrameScoreFunc m_frame_score;
+
+    /*!
+     * @brief Collects the traces of outgoing frames. Will be set through "setTraceExporter".
+     */
+    io::TraceExporter::Ptr m_trace_exporter;
+
+    /*!
+     * @brief Records the incoming frames in capture mode, can be nullptr. Will be set through "setInputCapture".
+     */
+    io::FrameSnapshotWriter::Ptr m_input_capture;
+
+    /*!
+     * @brief Memory budget of the pipeline, can be nullptr. Will be set through "setMemoryBudget".
+     */
+    MemoryBudget::Ptr m_memory_budget;
+
+    /*!
+     * @brief Runs the exports of the stage asynchronously. Will be set through "setExportService" or created on the
+     * first export.
+     */
+    io::ExportService::Ptr m_export_service;
+
     /*!
      * @brief This function consists of a CvGridMap, a defined topic as description for the data (for example:
      * "output/result_gridmap".  be set through "registerCvGridMapTransport".
      */
     CvGridMapTransportFunc m_transport_cvgridmap;
 
+    /*!
+     * @brief This function consists of the changed region of a CvGridMap, its version and a defined topic as description
+     * for the data (for example: "output/update/ortho"). Will be set through "registerCvGridMapDeltaTransport".
+     */
+    CvGridMapDeltaTransportFunc m_transport_cvgridmap_delta;
+
+    /*!
+     * @brief Thread pool shared by all stages of the pipeline for data-parallel sub-tasks. Can be nullptr. Will be set
+     * through "setThreadPool".
+     */
+    ThreadPool::Ptr m_thread_pool;
+
     /*!
      * @brief Setting an async data ready functor allows the thread to wake up from sleep outside the sleep time. It
      * will only sleep as long as the data ready functor returns falls. It  could therefore be provided with a function
@@ -264,6 +461,32 @@ class StageBase : public WorkerThreadBase
      */
     void registerAsyncDataReadyFunctor(const std::function<bool()> &func);
 
+    /*!
+     * @brief Processes several independent frames concurrently, while the results leave the stage in the order of the
+     * input. The compute step of all frames is run on the shared thread pool (or on separate threads, if no pool is
+     * set). The finalize step, e.g. publishing and saving, is run in the stage thread for every frame as soon as it and
+     * all its predecessors are computed.
+     * @param frames Frames to be processed, ordered as they should be published
+     * @param compute Thread-safe processing of a single frame
+     * @param finalize Step for a single frame that must be run sequentially in order
+     */
+    void processFramesInFlight(const std::vector<Frame::Ptr> &frames,
+                               const std::function<void(const Frame::Ptr&)> &compute,
+                               const std::function<void(const Frame::Ptr&)> &finalize);
+
+    /*!
+     * @brief Submits the exports of one iteration to the export service, so encoding and writing is not done in the
+     * stage thread. The job must only hold copies of the data, as the stage continues to modify its own.
+     * @param job Exports to be run, e.g. saving images of the current frame
+     */
+    void submitExport(const io::ExportService::Job &job);
+
+    /*!
+     * @brief Blocks until all exports submitted by any stage sharing the service are finished. Should be called in the
+     * finish callback of stages, that submit exports.
+     */
+    void waitForExports();
+
     /*!
      * @brief Function for creation of all neccessary output directories of the derived stage. Will be called whenever
      * "initStagePath" was triggered.
@@ -288,9 +511,40 @@ class StageBase : public WorkerThreadBase
     virtual uint32_t getQueueDepth() = 0;
 
     /*!
-     * @brief Update function to be called by the derived class to update the incoming statistics
+     * @brief Computes the memory of all data held by the stage beyond its input queue, e.g. buffered frames or the
+     * global map. Will be called from the processing thread whenever a new frame is taken from the queue, so it should
+     * be cheap to compute. Default is no data held.
+     * @return Memory usage in bytes
+     */
+    virtual size_t getMemoryUsage();
+
+    /*!
+     * @brief Function for the derived stage to check if work on new frames is wasted, because the following stages
+     * would drop them. Is false, if no backpressure was registered.
+     * @return true if the following stages are saturated
+     */
+    bool isDownstreamSaturated() const;
+
+    /*!
+     * @brief Function for the derived stage to check if optional data should be released to reduce the memory of the
+     * pipeline. Is false, if no memory budget was set.
+     * @return true if the memory budget of the pipeline is exceeded
+     */
+    bool isMemoryBudgetExceeded() const;
+
+    /*!
+     * @brief Function for the derived stage to score an incoming frame before it is pushed to the queue
+     * @param frame Incoming frame
+     * @return Score of the registered score function, 0.0 if none was registered
+     */
+    double scoreFrame(const Frame::Ptr &frame) const;
+
+    /*!
+     * @brief Update function to be called by the derived class to update the incoming statistics. Also starts the
+     * measurement of the queue latency of the frame.
+     * @param frame Incoming frame
      */
-    void updateStatisticsIncoming();
+    void updateStatisticsIncoming(const Frame::Ptr &frame);
 
     /*!
      * @brief Update function to be called by the derived class to update statistics when a frame is skipped due to
@@ -305,14 +559,17 @@ class StageBase : public WorkerThreadBase
 
     /*!
      * @brief Update function to be called by derived class to update number of processed frames in the statistic.
-     * Information might be redundant with total and dropped frames.
+     * Information might be redundant with total and dropped frames. Also stops the measurement of the queue latency.
+     * @param frame Frame that was taken out of the queue for processing, may be nullptr
      */
-    void updateStatisticsProcessedFrame();
+    void updateStatisticsProcessedFrame(const Frame::Ptr &frame);
 
     /*!
-     * @brief Update function to be called by the derived class to update the outgoing frame rate statistic.
+     * @brief Update function to be called by the derived class to update the outgoing frame rate statistic. Also
+     * records the end-to-end age of the frame, which assumes the capture timestamps and system clock are synchronized.
+     * @param frame Outgoing frame
      */
-    void updateStatisticsOutgoing();
+    void updateStatisticsOutgoing(const Frame::Ptr &frame);
 
     /*
      * brief Gets triggered by _timer_statistics_fps every X seconds to read the incoming and outgoing number of frame
@@ -20,6 +20,9 @@ class StageSettings : public SettingsBase
       add("queue_size", Parameter_t<int>{5, "Size of the measurement input queue, implemented as ringbuffer"});
       add("path_output", Parameter_t<std::string>{"", "Path to output folder."});
       add("log_to_file", Parameter_t<int>{1, "Write log to stage directory"});
+      add("thread_cpus", Parameter_t<std::string>{"", "Cores the processing thread of the stage may run on, e.g. '2,3' or '2-5'. Leave empty to allow all cores"});
+      add("thread_nice", Parameter_t<int>{0, "Nice value in range [-20, 19] of the processing thread, lower values get more processing time. Negative values require elevated privileges"});
+      add("thread_realtime_priority", Parameter_t<int>{0, "Priority in range [1, 99] of the processing thread with real time policy SCHED_FIFO, requires elevated privileges. Set 0 to keep the default policy"});
     }
 };
 
@@ -33,6 +36,10 @@ class PoseEstimationSettings : public StageSettings
       add("set_all_frames_keyframes", Parameter_t<int>{0, "Flag to set all tracked frames to being keyframes."});
       add("fallback_strategy", Parameter_t<int>{0, "Strategy when to use the projection only fallback: 1 - Always, 2 - once orientation is calibrated, 3 - never"});
       add("use_initial_guess", Parameter_t<int>{0, "Flag can be set to 'false', then the initial guess of the pose is not being considered in the visual SLAM."});
+      add("use_imu_prior", Parameter_t<int>{0, "Flag to predict the pose of each frame from the gyroscope and the last tracked motion and pass it to the visual SLAM as initial guess. Takes precedence over 'use_initial_guess'."});
+      add("use_adaptive_tracking", Parameter_t<int>{0, "Flag to propagate the features of the last tracked frame with optical flow and drop frames that are still overlapping strongly with it instead of tracking them with the visual SLAM."});
+      add("th_overlap_adaptive", Parameter_t<double>{90.0, "Overlap in [%] to the last tracked frame, below which a frame is tracked by the visual SLAM in adaptive tracking."});
+      add("max_skipped_frames_adaptive", Parameter_t<int>{4, "Maximum number of consecutive frames dropped by adaptive tracking."});
       add("update_georef", Parameter_t<int>{0, "Flag can be set to 'false', then georeference will only be computed at initialization."});
       add("do_delay_keyframes", Parameter_t<int>{0, "Flag to delay publishing of keyframes by the duration it takes for the georeference to initialize."
                                                                            "This ensures higher pose and map point quality, as the frames are refined with consecutive frames."});
@@ -40,8 +47,16 @@ class PoseEstimationSettings : public StageSettings
       add("th_error_georef", Parameter_t<double>{1.0, "Threshold of error for georeference until initialization is performed."});
       add("init_lost_frames_reset_count", Parameter_t<int>{15, "The number of lost frames allowed during georeferencing before a VSLAM reset is issued."});
       add("min_nrof_frames_georef", Parameter_t<int>{5, "Minimum number of unique frames required before georeference is initialized."});
+      add("window_size_georef", Parameter_t<int>{0, "Number of most recent frames the georeference is refined with. Set 0 to use all frames."});
+      add("th_outlier_georef", Parameter_t<double>{0.0, "Maximum distance in [m] between the GNSS position of a frame and its georeferenced visual position to be used for refinement. Set 0 to disable."});
       add("overlap_max", Parameter_t<double>{0.0, "Maximum overlap for all publishes, even keyframes"});
       add("overlap_max_fallback", Parameter_t<double>{0.0, "Maximum overlap for fallback publishes, e.g. GNSS only imgs"});
+      add("overlap_max_saturated", Parameter_t<double>{30.0, "Maximum overlap for all publishes while the following stages are saturated"});
+      add("nrof_footprints_overlap", Parameter_t<int>{1, "Number of last published footprints the overlap of a frame is checked against. Set 0 to check all."});
+      add("publish_sparse_cloud_rate", Parameter_t<double>{0.0, "Maximum rate in [Hz] of sparse cloud publishes, only the newest cloud is published once the interval elapsed. Set 0 to publish the cloud of every frame."});
+      add("checkpoint_directory", Parameter_t<std::string>{"", "Absolute path of the directory the georeference and the map of the visual SLAM are checkpointed to. Leave empty to disable checkpoints"});
+      add("checkpoint_every_nth", Parameter_t<int>{50, "Number of tracked frames between two checkpoints"});
+      add("resume_from_checkpoint", Parameter_t<int>{0, "Flag to restore the georeference and the map of the visual SLAM from the checkpoint directory before the first frame"});
       add("save_trajectory_gnss", Parameter_t<int>{0, "Save gnss trajectory of receiver"});
       add("save_trajectory_visual", Parameter_t<int>{0, "Save visual camera trajectory"});
       add("save_frames", Parameter_t<int>{0, "Save all processed frames"});
@@ -59,6 +74,11 @@ class DensificationSettings : public StageSettings
       add("use_filter_bilat", Parameter_t<int>{0, "Flag to use bilateral filter for disparity map."});
       add("use_filter_guided", Parameter_t<int>{0, "Flag to use guided filter. Only possible with stereo reconstruction."});
       add("compute_normals", Parameter_t<int>{0, "Flag to compute surface normals from disparity map."});
+      add("use_async_postprocessing", Parameter_t<int>{1, "Flag to filter and publish a frame in a separate thread, while the next frame is reconstructed."});
+      add("nrof_candidates", Parameter_t<int>{0, "Number of buffered frames the stereo partners of the frame in their middle are selected from. At least the number of input frames of the densifier is used"});
+      add("partner_min_baseline_ratio", Parameter_t<double>{0.0, "Minimum ratio of the baseline to the median scene depth of a stereo partner. Set 0 to accept any"});
+      add("partner_max_view_angle", Parameter_t<double>{0.0, "Maximum angle between the optical axes of a stereo partner and the reference frame in [deg]. Set 0 for no limit"});
+      add("partner_min_overlap", Parameter_t<double>{0.0, "Minimum overlap of the footprint of a stereo partner with the one of the reference frame in [0.0, 1.0]. Set 0 to accept any"});
       add("save_bilat", Parameter_t<int>{0, "Save disparity map after bilateral filtering (if processed)"});
       add("save_dense", Parameter_t<int>{0, "Save map produced by stereo reconstruction (if processed)"});
       add("save_guided", Parameter_t<int>{0, "Save disparity map after guided filtering (if processed)"});
@@ -78,6 +98,13 @@ class SurfaceGenerationSettings : public StageSettings
       add("compute_all_frames", Parameter_t<int>{0, "When in PLANAR mode, estimate the elevation of every frame using sparse data rather than locking on the first"});
       add("knn_max_iter", Parameter_t<int>{5, "Maximum number of iterations for each cell to find the closest 3D point in the dense cloud"});
       add("mode_surface_normals", Parameter_t<int>{0, "0 - None, 1 - Random neighbours, 2 - Furthest neighbours, 3 - Best-fit"});
+      add("nrof_threads", Parameter_t<int>{0, "Number of threads used for elevation surface generation, <= 0 uses all available cores"});
+      add("dsm_rasterize_depthmap", Parameter_t<int>{0, "Flag for rasterizing the depth map into the elevation surface instead of interpolating every cell from the dense cloud"});
+      add("dsm_coarse_step", Parameter_t<int>{1, "Step size in cells of the coarse grid for hierarchical elevation surface generation, <= 1 evaluates every cell"});
+      add("dsm_neighbour_index", Parameter_t<int>{0, "Spatial index for the neighbour search in the dense cloud: 0 - Uniform grid, 1 - K-d tree"});
+      add("dsm_th_flatness", Parameter_t<double>{0.1, "Max. elevation difference in [m] within a coarse block to interpolate it instead of evaluating every cell"});
+      add("frames_in_flight", Parameter_t<int>{1, "Maximum number of frames processed concurrently, output stays in order of the input"});
+      add("th_relief_planar", Parameter_t<double>{0.0, "Relief in [m] of the terrain estimated from the sparse clouds, below half of which elevation surfaces are replaced by planar ones until it exceeds it. Set 0 to disable"});
       add("save_valid", Parameter_t<int>{0, "Save valid elevation grid element mask"});
       add("save_elevation", Parameter_t<int>{0, "Save elevation map as colored PNG image file"});
       add("save_normals", Parameter_t<int>{0, "Save surface normals as colored PNG image file"});
@@ -89,8 +116,17 @@ class OrthoRectificationSettings : public StageSettings
   public:
     OrthoRectificationSettings()
     {
-      add("GSD", Parameter_t<double>{0.0, "Ground sampling distance in [m/px]"});
+      add("GSD", Parameter_t<double>{0.0, "Ground sampling distance in [m/px]. Lower bound of the GSD with gsd_auto"});
+      add("gsd_auto", Parameter_t<int>{0, "Flag to derive the GSD of every frame from the focal length and the median scene depth, rounded to the next finer zoom level of the tile pyramid"});
+      add("gsd_auto_max", Parameter_t<double>{0.0, "Upper bound of the GSD in [m/px] with gsd_auto. Set 0 for none"});
       add("publish_pointcloud", Parameter_t<int>{0, "Publishing the point cloud requires additional resources for data conversion."});
+      add("pointcloud_stride", Parameter_t<int>{1, "Only every n-th grid element in both directions is published as point of the point cloud"});
+      add("pointcloud_max_points", Parameter_t<int>{0, "Maximum number of points per published point cloud, the stride is increased until it fits. Set 0 for no limit"});
+      add("nrof_threads", Parameter_t<int>{0, "Number of threads used for rectification, <= 0 uses all available cores"});
+      add("interpolation", Parameter_t<std::string>{"NEAREST", "Image sampling during rectification: NEAREST, LINEAR or CUBIC"});
+      add("use_cuda", Parameter_t<int>{0, "Rectify elevated surfaces on the GPU, if built with CUDA. Planar surfaces and CUBIC interpolation stay on the CPU"});
+      add("use_pinned_memory", Parameter_t<int>{0, "Allocate frame images and rectified layers in pinned memory, so an integrated GPU (e.g. Jetson) accesses them without copies. Only with use_cuda"});
+      add("frames_in_flight", Parameter_t<int>{1, "Maximum number of frames processed concurrently, output stays in order of the input"});
       add("save_valid", Parameter_t<int>{0, "Save valid incremental map grid elements"});
       add("save_ortho_rgb", Parameter_t<int>{0, "Save incremental map ortho foto as PNG image file"});
       add("save_ortho_gtiff", Parameter_t<int>{0, "Save global map ortho foto as one GeoTIFF image file"});
@@ -106,15 +142,35 @@ class MosaicingSettings : public StageSettings
     {
       add("th_elevation_min_nobs", Parameter_t<int>{0, "Threshold for minimum number of observations for elevation point"});
       add("th_elevation_variance", Parameter_t<double>{0.0, "Threshold for elevation variance marking outlier"});
+      add("fuse_elevation", Parameter_t<int>{0, "Fuse the elevation of all observations of a cell into a running mean and variance instead of keeping the steepest observation. Not supported with use_packed_layout"});
       add("publish_mesh_every_nth_kf", Parameter_t<int>{0, "Activate global map publish every n keyframes as mesh"});
+      add("publish_full_every_nth", Parameter_t<int>{0, "If only map updates are published, additionally publish the full map every n updates for late subscribers. 0 to disable"});
       add("publish_mesh_at_finish", Parameter_t<int>{0, "Activate global map publish as mesh at finishCallback call"});
       add("downsample_publish_mesh", Parameter_t<double>{0.0, "Downsample published mesh to lower GSD for performance. Unit: [m/pix]"});
+      add("mesh_tile_size", Parameter_t<double>{50.0, "Edge length of the mesh tiles, only tiles with changed elevation are published. Unit: [m]"});
+      add("chunk_size", Parameter_t<int>{0, "Size of the chunks of the global map in grid cells. Set 0 to use one monolithic map"});
+      add("use_packed_layout", Parameter_t<int>{0, "Store the global map as one record per cell for faster blending. Only color, elevation, angle, observations and elevated are kept. Ignored if chunk_size > 0"});
+      add("nrof_threads", Parameter_t<int>{0, "Number of threads used for blending, <= 0 uses all available cores"});
+      add("use_cuda", Parameter_t<int>{0, "Blend on the GPU, if built with CUDA. Ignored with use_packed_layout"});
+      add("merge_max_delay", Parameter_t<int>{1000, "Maximum time in [ms] a frame is held back to merge the frames of several cameras in order of their timestamps, e.g. of a multi camera rig with one chain per camera"});
+      add("checkpoint_directory", Parameter_t<std::string>{"", "Absolute path of the directory the global map is checkpointed to. Leave empty to disable checkpoints"});
+      add("checkpoint_every_nth", Parameter_t<int>{10, "Number of frames between two checkpoints, only the regions changed since the last one are written"});
+      add("resume_from_checkpoint", Parameter_t<int>{0, "Flag to restore the global map from the checkpoint directory before the first frame"});
+      add("keep_frames", Parameter_t<int>{0, "Keep all processed frames for post processing at the finish. Only the most recent ones are kept in memory, see frames_resident"});
+      add("frames_resident", Parameter_t<int>{10, "Number of most recent frames kept in memory if keep_frames is set, older ones are moved to cold storage"});
+      add("frames_cold_storage", Parameter_t<std::string>{"memory", "Cold storage of older frames: 'memory' keeps them compressed in memory, 'file' spills them to 'frames_cold.bin' in the stage directory"});
+      add("post_process_replay", Parameter_t<int>{0, "Rebuild the global map at the finish by replaying all kept frames, regions of the map are processed in parallel. Requires keep_frames, not supported with chunk_size or use_packed_layout"});
+      add("post_process_region_size", Parameter_t<int>{512, "Edge length of the regions of the global map replayed in parallel in grid cells"});
+      add("forward_blended", Parameter_t<int>{0, "Forward every frame with the blended region of the global map as its surface model and orthophoto, so a following tileing stage with use_blended_input does not blend it again"});
+      add("io_thread_cpus", Parameter_t<std::string>{"", "Cores the thread writing GeoTIFFs may run on, e.g. '4,5'. Leave empty to allow all cores"});
+      add("io_thread_nice", Parameter_t<int>{0, "Nice value in range [-20, 19] of the thread writing GeoTIFFs, e.g. 10 so it yields to the processing"});
       add("split_gtiff_channels", Parameter_t<int>{0, "Splits all channels of an OpenCV matrix into separate tif files while saving"});
       add("save_valid", Parameter_t<int>{0, "Save valid global map grid elements"});
       add("save_ortho_rgb_one", Parameter_t<int>{0, "Save global map ortho foto as one PNG image file"});
       add("save_ortho_rgb_all", Parameter_t<int>{0, "Save global map ortho foto as incremental PNG image files"});
       add("save_ortho_gtiff_one", Parameter_t<int>{0, "Save global map ortho foto as one GeoTIFF image file"});
       add("save_ortho_gtiff_all", Parameter_t<int>{0, "Save global map ortho foto as incremental GeoTIFF image files"});
+      add("update_ortho_gtiff_all", Parameter_t<int>{0, "Update the incremental GeoTIFF in place, only the blocks of the latest map update are written. Not supported with split_gtiff_channels"});
       add("save_elevation_one", Parameter_t<int>{0, "Save global elevation map as one PNG image file"});
       add("save_elevation_all", Parameter_t<int>{0, "Save global elevation map as incremental PNG image files"});
       add("save_elevation_var_one", Parameter_t<int>{0, "Save global standard deviation map as one PNG image file"});
@@ -133,7 +189,25 @@ class TileingSettings : public StageSettings
 public:
   TileingSettings()
   {
-
+    add("nrof_threads", Parameter_t<int>{0, "Number of threads used for blending tiles, <= 0 uses all available cores"});
+    add("merge_max_delay", Parameter_t<int>{1000, "Maximum time in [ms] a frame is held back to merge the frames of several cameras in order of their timestamps, e.g. of a multi camera rig with one chain per camera"});
+    add("tile_cache_capacity", Parameter_t<int>{0, "Maximum memory of the tiles held in the cache in [MB], least recently used tiles are written to disk. Set 0 for unlimited"});
+    add("prefetch_frames", Parameter_t<int>{0, "Number of future frames, for which the footprint is predicted from the ground velocity to prefetch tiles from disk. Set 0 to disable"});
+    add("nrof_writer_threads", Parameter_t<int>{2, "Number of threads encoding and writing tiles to disk, <= 0 uses all available cores"});
+    add("spill_raw_tiles", Parameter_t<int>{1, "Flag to keep flushed tiles uncompressed in 'tiles_spill' for fast reloading. Published tiles are not affected"});
+    add("native_warp_max_cells", Parameter_t<int>{1000000, "Maximum number of cells of a map update to be warped to Web Mercator with closed-form projections instead of GDAL. Set 0 to always use GDAL"});
+    add("use_blended_input", Parameter_t<int>{0, "Flag for frames already blended by the mosaicing stage (see forward_blended). Their tiles replace the cached ones where they have data instead of being blended by elevation angle"});
+    add("use_mbtiles", Parameter_t<int>{0, "Flag to write the tiles into one MBTiles file per layer instead of a directory tree. Requires SQLite support"});
+    add("tile_server_port", Parameter_t<int>{0, "Port of the HTTP server, that serves the tiles from memory as soon as they are updated. Set 0 to disable"});
+    add("tile_server_address", Parameter_t<std::string>{"127.0.0.1", "IPv4 address the tile server binds to, e.g. 0.0.0.0 to serve a remote ground station"});
+    add("nrof_shards", Parameter_t<int>{1, "Number of tileing processes the tile pyramid is partitioned across, e.g. for reprocessing large datasets. Every process receives all frames, but only generates the tiles of its shard"});
+    add("shard_index", Parameter_t<int>{0, "Index of the shard generated by this process in range [0, nrof_shards)"});
+    add("shard_zoom_level", Parameter_t<int>{11, "Zoom level of the tiles the pyramid is partitioned by, all tiles below one of them belong to the same shard. Levels above are not generated, if there is more than one shard"});
+    add("checkpoint_directory", Parameter_t<std::string>{"", "Absolute path of the directory the index of the tile cache is checkpointed to. Leave empty to disable checkpoints"});
+    add("checkpoint_every_nth", Parameter_t<int>{10, "Number of frames between two checkpoints"});
+    add("resume_from_checkpoint", Parameter_t<int>{0, "Flag to restore the tile cache from the checkpoint directory before the first frame. Tiles are then loaded from the output directory of the interrupted run"});
+    add("io_thread_cpus", Parameter_t<std::string>{"", "Cores the thread of the tile cache may run on, e.g. '4,5'. Leave empty to allow all cores"});
+    add("io_thread_nice", Parameter_t<int>{0, "Nice value in range [-20, 19] of the thread of the tile cache, e.g. 10 so it yields to the processing"});
   }
 };
 
@@ -9,6 +9,7 @@
 #include <realm_stages/stage_base.h>
 #include <realm_stages/stage_settings.h>
 #include <realm_core/frame.h>
+#include <realm_core/spsc_ring_buffer.h>
 #include <realm_core/stereo.h>
 #include <realm_io/cv_export.h>
 #include <realm_ortho/dsm.h>
@@ -32,6 +33,17 @@ class SurfaceGeneration : public StageBase
       }
     };
 
+    /*!
+     * @brief Parameters, that can be changed at runtime by changeParam. They are never modified in place, instead a
+     * changed copy replaces the current one, so processing reads a consistent snapshot without locking.
+     */
+    struct RuntimeParams
+    {
+        bool try_use_elevation;
+        bool compute_all_frames;
+        int knn_max_iter;
+    };
+
   public:
     explicit SurfaceGeneration(const StageSettings::Ptr &settings, double rate);
     void addFrame(const Frame::Ptr &frame) override;
@@ -39,25 +51,57 @@ class SurfaceGeneration : public StageBase
     bool changeParam(const std::string& name, const std::string &val) override;
   private:
 
+    //! Serializes changeParam only, readers take a snapshot with std::atomic_load and never wait
     std::mutex m_mutex_params;
-    bool m_try_use_elevation;
-    bool m_compute_all_frames;
 
-    int m_knn_max_iter;
+    //! Always accessed with std::atomic_load/std::atomic_store, see RuntimeParams
+    std::shared_ptr<const RuntimeParams> m_params;
+
+    int m_nrof_threads;
+
+    bool m_dsm_rasterize_depthmap;
+
+    int m_dsm_coarse_step;
+    double m_dsm_th_flatness;
+
+    ortho::NeighbourIndex2D::Type m_dsm_neighbour_index;
+
+    int m_frames_in_flight;
 
     bool m_is_projection_plane_offset_computed;
     double m_projection_plane_offset;
 
+    //! Relief in [m] below half of which the terrain is considered flat until it exceeds it again, 0 disables it
+    double m_th_relief_planar;
+
+    /*!
+     * @brief Running estimate of the terrain below the frames. Every frame with a sparse cloud updates it from a
+     * subsample of its points, so the cost per frame is constant and single frames with few or noisy points do not
+     * flip the surface assumption.
+     */
+    struct TerrainModel
+    {
+        bool has_estimate;
+        double elevation;  // [m] Median elevation of the points
+        double relief;     // [m] Difference of the 90th and 10th percentile of the point elevations
+        bool is_flat;
+    } m_terrain;
+
     ortho::DigitalSurfaceModel::SurfaceNormalMode m_mode_surface_normals;
 
     SaveSettings m_settings_save;
 
     Plane m_plane_reference;
 
-    std::deque<Frame::Ptr> m_buffer;
-    std::mutex m_mutex_buffer;
+    SpscRingBuffer<Frame::Ptr> m_buffer;
+
+    //! Spatial indices of the elevation surfaces, which are not in use. Kept between frames, so their buffers are only
+    //! allocated once per frame in flight.
+    std::mutex m_mutex_dsm_indices;
+    std::vector<ortho::NeighbourIndex2D::Ptr> m_dsm_indices;
 
     void reset() override;
+    void finishCallback() override;
     void initStageCallback() override;
     void printSettingsToLog() override;
     uint32_t getQueueDepth() override;
@@ -68,15 +112,44 @@ class SurfaceGeneration : public StageBase
     Frame::Ptr getNewFrame();
 
     /*!
-     * @brief Computes the offset of the projection plane by analyzing the sparse cloud of a frame.
+     * @brief Computes the surface model of a frame depending on its surface assumption and adds it to the frame. Elevation
+     * surfaces only depend on the frame, so they can be generated concurrently. Planar surfaces depend on the projection
+     * plane offset of the stage and must be generated in order.
+     * @param frame Frame with surface assumption set
+     */
+    void generateSurface(const Frame::Ptr &frame);
+
+    /*!
+     * @brief Computes the offset of the projection plane from the running terrain estimate, which the sparse cloud of
+     * the frame was added to before.
      * @param frame Frame for which the plane offset should be computed
      * @return Offset of the projection plane from the x-y-plane. No rotations allowed
      */
     double computeProjectionPlaneOffset(const Frame::Ptr &frame);
 
-    SurfaceAssumption computeSurfaceAssumption(const Frame::Ptr &frame);
+    /*!
+     * @brief Updates the running terrain estimate from a subsample of the sparse cloud of a frame. Frames without
+     * sparse cloud leave it unchanged.
+     * @param frame Frame in processing order
+     */
+    void updateTerrainModel(const Frame::Ptr &frame);
+
+    SurfaceAssumption computeSurfaceAssumption(const Frame::Ptr &frame, const RuntimeParams &params);
     ortho::DigitalSurfaceModel::Ptr createPlanarSurface(const Frame::Ptr &frame);
     ortho::DigitalSurfaceModel::Ptr createElevationSurface(const Frame::Ptr &frame);
+
+    /*!
+     * @brief Takes a spatial index for an elevation surface from the unused ones, creates a new one if all are in use,
+     * e.g. by other frames in flight
+     * @return Index, that is not used by anyone else
+     */
+    ortho::NeighbourIndex2D::Ptr acquireDsmIndex();
+
+    /*!
+     * @brief Returns a spatial index after the elevation surface was computed, so the next frame can reuse it
+     * @param index Index acquired before
+     */
+    void releaseDsmIndex(const ortho::NeighbourIndex2D::Ptr &index);
 };
 
 } // namespace stages
@@ -28,12 +28,17 @@
 #include <realm_stages/conversions.h>
 #include <realm_stages/stage_settings.h>
 #include <realm_core/frame.h>
+#include <realm_core/spsc_ring_buffer.h>
+#include <realm_core/frame_merger.h>
 #include <realm_core/cv_grid_map.h>
 #include <realm_core/analysis.h>
+#include <realm_io/checkpoint_store.h>
 #include <realm_io/cv_export.h>
 #include <realm_io/gis_export.h>
 #include <realm_io/utilities.h>
 #include <realm_ortho/map_tiler.h>
+#include <realm_ortho/mercator_warper.h>
+#include <realm_ortho/tile_server.h>
 
 namespace realm
 {
@@ -59,8 +64,14 @@ class Tileing : public StageBase
     void saveAll();
 
   private:
-    std::deque<Frame::Ptr> m_buffer;
-    std::mutex m_mutex_buffer;
+    SpscRingBuffer<Frame::Ptr> m_buffer;
+
+    //! Maximum time in [ms] a frame is held back waiting for the frames of other cameras
+    int m_merge_max_delay;
+
+    //! Merges the frames of all upstream chains in order of their timestamps before they are pushed into the buffer,
+    //! so the buffer has only one producer at a time
+    FrameMerger m_frame_merger;
 
     SaveSettings m_settings_save;
 
@@ -69,22 +80,126 @@ class Tileing : public StageBase
     /// Warper to transform incoming grid maps from UTM coordinates to Web Mercator (EPSG:3857)
     gis::GdalWarper m_warper;
 
+    /// Closed-form warper for small map updates, for which the setup of GDAL is more expensive than the warp itself
+    gis::MercatorWarper m_warper_native;
+
+    /// Maximum number of cells of a map update to be warped by the closed-form warper, 0 to always use GDAL
+    int m_native_warp_max_cells;
+
+    /// Flag for input frames already blended by the mosaicing stage, their tiles replace the cached ones
+    bool m_use_blended_input;
+
+    /// Number of threads blending the tiles of a frame
+    int m_nrof_threads;
+
+    /// Number of threads of the tile cache writing tiles to disk
+    int m_nrof_writer_threads;
+
+    /// Scheduling of the thread of the tile cache, so bulk I/O can be confined to other cores than the tracking
+    ThreadScheduling m_io_thread_scheduling;
+
+    /// Maximum memory of the tiles held in the tile cache in [MB], 0 for unlimited
+    int m_tile_cache_capacity;
+
+    /// Flag to keep uncompressed copies of flushed tiles for fast reloading
+    bool m_spill_raw_tiles;
+
+    /// Flag to write the tiles into one MBTiles file per layer instead of a directory tree
+    bool m_use_mbtiles;
+
+    /// Number of future frame footprints for which tiles are prefetched from disk, 0 to disable
+    int m_prefetch_frames;
+
+    /// Port and address of the tile server, port 0 to disable it
+    int m_tile_server_port;
+    std::string m_tile_server_address;
+
+    /// Number of shards the tile pyramid is partitioned across and the one generated by this stage
+    int m_nrof_shards;
+    int m_shard_index;
+
+    /// Zoom level of the tiles the pyramid is partitioned by
+    int m_shard_zoom_level;
+
+    /// Minimum zoom level generated by this stage
+    int m_zoom_level_min;
+
+    /// Position of the previous frame in Web Mercator (EPSG:3857) and its timestamp to estimate the ground velocity
+    cv::Point2d m_position_prev;
+    uint64_t m_timestamp_prev;
+
     MapTiler::Ptr m_map_tiler;
     TileCache::Ptr m_tile_cache;
 
-    Tile::Ptr merge(const Tile::Ptr &t1, const Tile::Ptr &t2);
+    /// Serves the tiles of the cache to clients, nullptr if disabled
+    TileServer::Ptr m_tile_server;
+
+    /// Checkpoints of the tile cache index, nullptr if disabled
+    io::CheckpointStore::Ptr m_checkpoint_store;
+
+    /// Number of frames between two checkpoints and frames processed since the last one
+    int m_checkpoint_every_nth;
+    int m_nrof_frames_checkpoint;
+
+    /// Flag to restore the tile cache from the checkpoint before the first frame is processed
+    bool m_do_resume_from_checkpoint;
+
     Tile::Ptr blend(const Tile::Ptr &t1, const Tile::Ptr &t2);
 
+    /*!
+     * @brief Merges a tile of an already blended input into the cached tile. The new tile replaces the cached one where
+     * it has an elevation, all other cells are taken from the cached tile. Used instead of blend(), if the mosaicing
+     * stage forwards its blended global map, so the elevation angles are not compared twice.
+     * @param t1 New tile, the result is written into
+     * @param t2 Cached tile
+     * @return New tile with the merged data
+     */
+    Tile::Ptr merge(const Tile::Ptr &t1, const Tile::Ptr &t2);
+
+    /*!
+     * @brief Checks if a tile belongs to the shard of this stage. Shards are assigned by the ancestor of the tile on the
+     * shard zoom level, so the parents of all tiles of a shard can be computed from the tiles of the same shard.
+     * @param x Tile index in x-direction
+     * @param y Tile index in y-direction
+     * @param zoom_level Zoom level of the tile, not lower than the shard zoom level
+     * @return True, if the tile is generated by this stage
+     */
+    bool isTileInShard(int x, int y, int zoom_level) const;
+
+    /*!
+     * @brief Writes the index of the tile cache and the UTM reference as checkpoint. The tiles themselves are already
+     * on disk, tiles not yet written by the cache are missing in the index.
+     */
+    void saveCheckpoint();
+
+    /*!
+     * @brief Restores the tile cache from the checkpoint. Tiles are loaded from the output directory of the interrupted
+     * run on demand, new tiles are added to it.
+     * @return True if a checkpoint was restored
+     */
+    bool loadCheckpoint();
+
     void finishCallback() override;
     void printSettingsToLog() override;
 
     void reset() override;
     void initStageCallback() override;
     uint32_t getQueueDepth() override;
+    size_t getMemoryUsage() override;
 
     void publish(const Frame::Ptr &frame, const CvGridMap::Ptr &global_map, const CvGridMap::Ptr &update, uint64_t timestamp);
 
     void saveIter(uint32_t id, const CvGridMap::Ptr &map_update);
+
+    /*!
+     * @brief Predicts the footprints of the next frames from the ground velocity of the trajectory and prefetches the
+     * tiles already existing in these regions from disk, so revisited areas can be blended without waiting for I/O.
+     * @param frame Currently processed frame
+     * @param footprint Footprint of the frame in Web Mercator (EPSG:3857)
+     * @param zoom_level_min Minimum zoom level to prefetch
+     * @param zoom_level_max Maximum zoom level to prefetch
+     */
+    void prefetchTiles(const Frame::Ptr &frame, const cv::Rect2d &footprint, int zoom_level_min, int zoom_level_max);
     Frame::Ptr getNewFrame();
 };
 
@@ -1,79 +1,173 @@
-
-
 #include <realm_stages/conversions.h>
 
 namespace realm
 {
 
-cv::Mat cvtToPointCloud(const cv::Mat &img3d, const cv::Mat &color, const cv::Mat &normals, const cv::Mat &mask)
+namespace
 {
-  if (img3d.empty())
-    throw(std::invalid_argument("Error: Depth map empty. Conversion to point cloud failed."));
-
-  size_t n = (size_t)img3d.cols*img3d.rows;
 
-  cv::Mat points = img3d.reshape(1, n);
-
-  if (!color.empty())
+/*!
+ * @brief Fills a point cloud with row() = x,y,z,b,g,r,nx,ny,nz from the valid elements of a grid. The valid elements
+ * are counted per row first, so every row knows its offset in the preallocated output and rows are filled in parallel
+ * without reallocation. The order of the points is the same as filling them serially.
+ * @param get_position Accessor with signature cv::Point3d(int r, int c)
+ * @param color Color of CV_8U with 1, 3 or 4 channels, optional. Only the first three channels are used.
+ * @param normals Normals of CV_32FC3, optional
+ * @param mask Mask of CV_8UC1, elements with 255 are valid. All elements are valid if empty.
+ */
+template<typename PositionAccessor>
+cv::Mat fillPointCloud(const cv::Size2i &size,
+                       const PositionAccessor &get_position,
+                       const cv::Mat &color,
+                       const cv::Mat &normals,
+                       const cv::Mat &mask,
+                       const ThreadPool::Ptr &thread_pool,
+                       int nrof_threads)
+{
+  if (!mask.empty() && (mask.type() != CV_8UC1 || mask.size() != size))
+    throw(std::invalid_argument("Error converting to point cloud: Mask invalid."));
+  if (!color.empty() && (color.depth() != CV_8U || color.channels() == 2 || color.channels() > 4 || color.size() != size))
+    throw(std::invalid_argument("Error converting depth map to point cloud: Color depth invalid."));
+  if (!normals.empty() && (normals.type() != CV_32FC3 || normals.size() != size))
+    throw(std::invalid_argument("Error converting to point cloud: Normals invalid."));
+
+  const int nrof_channels_color = (color.empty() ? 0 : std::min(color.channels(), 3));
+  const int nrof_cols = 3 + nrof_channels_color + (normals.empty() ? 0 : 3);
+
+  // First pass: Number of valid elements per row, prefix summed to the offsets of the rows in the output
+  std::vector<int> offsets(static_cast<size_t>(size.height + 1), 0);
+  parallelFor(thread_pool, cv::Range(0, size.height), [&](const cv::Range &range)
   {
-    cv::Mat color_reshaped = color.reshape(1, n);
-    color_reshaped.convertTo(color_reshaped, CV_64FC1);
-
-    if(color.channels() < 4)
-    {
-      cv::hconcat(points, color_reshaped, points);
-    }
-    else if (color.channels() == 4)
+    for (int r = range.start; r < range.end; ++r)
     {
-      cv::hconcat(points, color_reshaped.colRange(0, 3), points);
+      if (mask.empty())
+      {
+        offsets[r + 1] = size.width;
+        continue;
+      }
+      const uchar* mask_row = mask.ptr<uchar>(r);
+      int count = 0;
+      for (int c = 0; c < size.width; ++c)
+        count += (mask_row[c] == 255);
+      offsets[r + 1] = count;
     }
-    else
+  }, nrof_threads);
+  for (int r = 0; r < size.height; ++r)
+    offsets[r + 1] += offsets[r];
+
+  // Second pass: Every row writes only to its own range of the output
+  cv::Mat points(offsets[size.height], nrof_cols, CV_64F);
+  parallelFor(thread_pool, cv::Range(0, size.height), [&](const cv::Range &range)
+  {
+    for (int r = range.start; r < range.end; ++r)
     {
-      throw(std::invalid_argument("Error converting depth map to point cloud: Color depth invalid."));
+      const uchar* mask_row = (mask.empty() ? nullptr : mask.ptr<uchar>(r));
+      const uchar* color_row = (color.empty() ? nullptr : color.ptr<uchar>(r));
+      const cv::Vec3f* normals_row = (normals.empty() ? nullptr : normals.ptr<cv::Vec3f>(r));
+
+      int idx = offsets[r];
+      for (int c = 0; c < size.width; ++c)
+      {
+        if (mask_row != nullptr && mask_row[c] != 255)
+          continue;
+
+        auto point = points.ptr<double>(idx++);
+        cv::Point3d pos = get_position(r, c);
+        point[0] = pos.x;
+        point[1] = pos.y;
+        point[2] = pos.z;
+
+        int col = 3;
+        for (int ch = 0; ch < nrof_channels_color; ++ch)
+          point[col++] = static_cast<double>(color_row[c*color.channels() + ch]);
+
+        if (normals_row != nullptr)
+        {
+          point[col++] = static_cast<double>(normals_row[c][0]);
+          point[col++] = static_cast<double>(normals_row[c][1]);
+          point[col] = static_cast<double>(normals_row[c][2]);
+        }
+      }
     }
-  }
+  }, nrof_threads);
+  return points;
+}
 
-  if (!normals.empty())
+/*!
+ * @brief Converts an elevation layer to CV_64F, so cells can be read without dispatching on the type per cell
+ */
+cv::Mat convertElevation(const cv::Mat &elevation)
+{
+  if (elevation.empty())
+    throw(std::runtime_error("Error: Layer data empty! Requesting data failed."));
+  if (elevation.type() == CV_64F)
+    return elevation;
+
+  cv::Mat elevation_64f;
+  if (elevation.type() == CV_32F)
+    elevation.convertTo(elevation_64f, CV_64F);
+#ifdef CV_16F
+  else if (elevation.type() == CV_16F)
   {
-    cv::Mat normals_reshaped = normals.reshape(1, n);
-    normals_reshaped.convertTo(normals_reshaped, CV_64FC1);
-
-    cv::hconcat(points, normals_reshaped, points);
+    cv::Mat elevation_32f;
+    elevation.convertTo(elevation_32f, CV_32F);
+    elevation_32f.convertTo(elevation_64f, CV_64F);
   }
+#endif
+  else
+    throw(std::out_of_range("Error accessing 3d position in CvGridMap: z-coordinate data type not supported."));
+  return elevation_64f;
+}
 
-  // Masking out undesired elements
-  cv::Mat mask_reshaped = mask.reshape(1, n);
-
-  cv::Mat points_masked;
-  points_masked.reserve(n);
+/*!
+ * @brief Converts normals to CV_32FC3, as they are read by fillPointCloud
+ */
+cv::Mat convertNormals(const cv::Mat &normals)
+{
+  if (normals.empty() || normals.type() == CV_32FC3)
+    return normals;
+  if (normals.channels() != 3)
+    throw(std::invalid_argument("Error converting to point cloud: Normals invalid."));
+
+  cv::Mat normals_32f;
+  normals.convertTo(normals_32f, CV_32FC3);
+  return normals_32f;
+}
 
-  for (int r = 0; r < mask_reshaped.rows; ++r)
-  {
-    if (mask.at<uchar>(r) == 255)
-      points_masked.push_back(points.row(r));
-  }
+} // namespace
 
-  return cv::Mat(points_masked);
+cv::Mat cvtToPointCloud(const cv::Mat &img3d,
+                        const cv::Mat &color,
+                        const cv::Mat &normals,
+                        const cv::Mat &mask,
+                        const ThreadPool::Ptr &thread_pool,
+                        int nrof_threads)
+{
+  if (img3d.empty())
+    throw(std::invalid_argument("Error: Depth map empty. Conversion to point cloud failed."));
+  if (img3d.type() != CV_64FC3)
+    throw(std::invalid_argument("Error converting depth map to point cloud: Points must be of type CV_64FC3."));
 
+  return fillPointCloud(img3d.size(), [&](int r, int c)
+  {
+    const cv::Vec3d &pt = img3d.at<cv::Vec3d>(r, c);
+    return cv::Point3d(pt[0], pt[1], pt[2]);
+  }, color, convertNormals(normals), mask, thread_pool, nrof_threads);
 }
 
 cv::Mat cvtToPointCloud(const CvGridMap &map,
                         const std::string &layer_elevation,
                         const std::string &layer_color,
                         const std::string &layer_normals,
-                        const std::string &layer_mask)
+                        const std::string &layer_mask,
+                        const ThreadPool::Ptr &thread_pool,
+                        int nrof_threads)
 {
   assert(map.exists(layer_elevation));
   assert(!layer_color.empty() ? map.exists(layer_color) : true);
   assert(!layer_normals.empty() ? map.exists(layer_normals) : true);
   assert(!layer_mask.empty() ? map.exists(layer_mask) : true);
 
-  cv::Size2i size = map.size();
-  size_t n = (size_t)size.width*size.height;
-
-  cv::Mat points;
-  points.reserve(n);
-
   // OPTIONAL
   cv::Mat color;
   if (map.exists(layer_color))
@@ -87,19 +181,26 @@ cv::Mat cvtToPointCloud(const CvGridMap &map,
   if (map.exists(layer_mask))
     mask = map[layer_mask];
 
-  // Create one point per grid element
-  cv::Mat img3d(size, CV_64FC3);
-  for (int r = 0; r < size.height; ++r)
-    for (int c = 0; c < size.width; ++c)
-      img3d.at<cv::Point3d>(r, c) = map.atPosition3d(r, c, layer_elevation);
+  // One point per grid element, positions are computed directly instead of creating an intermediate 3D image
+  const cv::Mat elevation = convertElevation(map[layer_elevation]);
+  const cv::Rect2d roi = map.roi();
+  const double resolution = map.resolution();
 
-  return cvtToPointCloud(img3d, color, elevation_normal, mask);
+  return fillPointCloud(map.size(), [&](int r, int c)
+  {
+    // ENU world frame, see CvGridMap::atPosition3d
+    return cv::Point3d(roi.x + static_cast<double>(c) * resolution,
+                       roi.y + roi.height - static_cast<double>(r) * resolution,
+                       elevation.at<double>(r, c));
+  }, color, convertNormals(elevation_normal), mask, thread_pool, nrof_threads);
 }
 
 std::vector<Face> cvtToMesh(const CvGridMap &map,
                             const std::string &layer_elevation,
                             const std::string &layer_color,
-                            const std::vector<cv::Point2i> &vertex_ids)
+                            const std::vector<cv::Point2i> &vertex_ids,
+                            const ThreadPool::Ptr &thread_pool,
+                            int nrof_threads)
 {
   assert(!layer_elevation.empty() && map.exists(layer_elevation));
   assert(!layer_color.empty() ? map.exists(layer_color) : true);
@@ -109,20 +210,33 @@ std::vector<Face> cvtToMesh(const CvGridMap &map,
   if (map.exists(layer_color))
     color = map[layer_color];
 
-  // Create output vector of faces
-  size_t count = 0;
+  const cv::Mat elevation = convertElevation(map[layer_elevation]);
+  const cv::Size2i size = map.size();
+  const cv::Rect2d roi = map.roi();
+  const double resolution = map.resolution();
+
+  // Create output vector of faces, every face is written by exactly one thread
   std::vector<Face> faces(vertex_ids.size()/3);
 
-  for (size_t i = 0; i < vertex_ids.size(); i+=3, ++count)
-    for (size_t j = 0; j < 3; ++j)
-    {
-      faces[count].vertices[j] = map.atPosition3d(vertex_ids[i+j].y, vertex_ids[i+j].x, layer_elevation);
-      if (!color.empty())
-        faces[count].color[j] = color.at<cv::Vec4b>(vertex_ids[i+j].y, vertex_ids[i+j].x);
-      else
-        faces[count].color[j] = cv::Vec4b(0, 0, 0, 255);
-    }
+  parallelFor(thread_pool, cv::Range(0, static_cast<int>(faces.size())), [&](const cv::Range &range)
+  {
+    for (int i = range.start; i < range.end; ++i)
+      for (size_t j = 0; j < 3; ++j)
+      {
+        const cv::Point2i &id = vertex_ids[3*static_cast<size_t>(i) + j];
+        if (id.y < 0 || id.y >= size.height || id.x < 0 || id.x >= size.width)
+          throw(std::invalid_argument("Error: Requested position outside matrix boundaries!"));
+
+        faces[i].vertices[j] = cv::Point3d(roi.x + static_cast<double>(id.x) * resolution,
+                                           roi.y + roi.height - static_cast<double>(id.y) * resolution,
+                                           elevation.at<double>(id.y, id.x));
+        if (!color.empty())
+          faces[i].color[j] = color.at<cv::Vec4b>(id.y, id.x);
+        else
+          faces[i].color[j] = cv::Vec4b(0, 0, 0, 255);
+      }
+  }, nrof_threads);
   return faces;
 }
 
-} // namespace realm
\ No newline at end of file
+} // namespace realm
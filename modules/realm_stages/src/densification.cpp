@@ -1,10 +1,37 @@
 
 
+#include <algorithm>
+#include <cmath>
+
+#include <realm_core/cpu_dispatch.h>
+#include <realm_core/log_macros.h>
+#include <realm_core/scoped_timer.h>
+
 #include <realm_stages/densification.h>
 
 using namespace realm;
 using namespace stages;
 
+namespace
+{
+
+// Ratio of baseline to scene depth, above which a stereo partner is not preferred anymore. Wider baselines are limited
+// by the overlap of the footprints.
+const double g_baseline_ratio_optimal = 0.1;
+
+/*!
+ * @brief Votes for the cells of one row of the reference depth map, whose depth is confirmed by a neighbour. The
+ * comparison is branch-free, so every clone of the kernel is vectorized with the register width of its target.
+ */
+REALM_CPU_DISPATCH
+void voteRow(int cols, const float* d_ii, const float* d_ij, float th_depth, uchar* votes)
+{
+  for (int c = 0; c < cols; ++c)
+    votes[c] = static_cast<uchar>(d_ii[c] > 0 && d_ij[c] > 0 && fabsf(d_ij[c] - d_ii[c]) < th_depth * d_ii[c]);
+}
+
+} // namespace
+
 Densification::Densification(const StageSettings::Ptr &stage_set,
                              const DensifierSettings::Ptr &densifier_set,
                              double rate)
@@ -15,7 +42,12 @@ Densification::Densification(const StageSettings::Ptr &stage_set,
   m_depth_max_current(0.0),
   m_do_drop_planar((*stage_set)["compute_normals"].toInt() > 0),
   m_compute_normals((*stage_set)["compute_normals"].toInt() > 0),
+  m_use_async_postprocessing((*stage_set)["use_async_postprocessing"].toInt() > 0),
   m_rcvd_frames(0),
+  m_nrof_candidates(static_cast<size_t>(std::max((*stage_set)["nrof_candidates"].toInt(), 0))),
+  m_partner_min_baseline_ratio((*stage_set)["partner_min_baseline_ratio"].toDouble()),
+  m_partner_max_view_angle((*stage_set)["partner_max_view_angle"].toDouble() * M_PI / 180.0),
+  m_partner_min_overlap((*stage_set)["partner_min_overlap"].toDouble()),
   m_settings_save({(*stage_set)["save_bilat"].toInt() > 0,
                   (*stage_set)["save_dense"].toInt() > 0,
                   (*stage_set)["save_guided"].toInt() > 0,
@@ -24,10 +56,21 @@ Densification::Densification(const StageSettings::Ptr &stage_set,
                   (*stage_set)["save_thumb"].toInt() > 0,
                   (*stage_set)["save_normals"].toInt() > 0})
 {
+  setThreadScheduling(readThreadScheduling(*stage_set, "thread"));
   registerAsyncDataReadyFunctor([=]{ return !m_buffer_reco.empty(); });
 
+  if (m_use_async_postprocessing)
+    m_pool_postprocessing = std::make_shared<ThreadPool>(1);
+
   m_densifier = densifier::DensifierFactory::create(densifier_set);
   m_n_frames = m_densifier->getNrofInputFrames();
+  m_nrof_jobs = static_cast<size_t>(std::max(m_densifier->getNrofConcurrentJobs(), 1));
+  m_nrof_candidates = std::max(m_nrof_candidates, static_cast<size_t>(m_n_frames));
+  if (m_queue_size > 0 && m_nrof_candidates > static_cast<size_t>(m_queue_size))
+  {
+    LOG_F(WARNING, "Number of candidates for stereo partners exceeds the queue size, it is limited to %i.", m_queue_size);
+    m_nrof_candidates = std::max(static_cast<size_t>(m_queue_size), static_cast<size_t>(m_n_frames));
+  }
 
   // Creation of reference plane, currently only the one below is supported
   m_plane_ref.pt = (cv::Mat_<double>(3, 1) << 0.0, 0.0, 0.0);
@@ -37,7 +80,7 @@ Densification::Densification(const StageSettings::Ptr &stage_set,
 void Densification::addFrame(const Frame::Ptr &frame)
 {
   // First update statistics about incoming frame rate
-  updateStatisticsIncoming();
+  updateStatisticsIncoming(frame);
 
   // Increment received valid frames
   m_rcvd_frames++;
@@ -48,10 +91,10 @@ void Densification::addFrame(const Frame::Ptr &frame)
       || !frame->hasAccuratePose()
       || !frame->isDepthComputed())
   {
-    LOG_F(INFO, "Frame #%u:", frame->getFrameId());
-    LOG_F(INFO, "Keyframe? %s", frame->isKeyframe() ? "Yes" : "No");
-    LOG_F(INFO, "Accurate Pose? %s", frame->hasAccuratePose() ? "Yes" : "No");
-    LOG_F(INFO, "Surface? %i Points", frame->getSparseCloud() != nullptr ? frame->getSparseCloud()->size() : 0);
+    LOG_FRAME_F(INFO, "Frame #%u:", frame->getFrameId());
+    LOG_FRAME_F(INFO, "Keyframe? %s", frame->isKeyframe() ? "Yes" : "No");
+    LOG_FRAME_F(INFO, "Accurate Pose? %s", frame->hasAccuratePose() ? "Yes" : "No");
+    LOG_FRAME_F(INFO, "Surface? %i Points", frame->getSparseCloud() != nullptr ? frame->getSparseCloud()->size() : 0);
 
     LOG_F(INFO, "Frame #%u not suited for dense reconstruction. Passing through...", frame->getFrameId());
     if (!m_do_drop_planar)
@@ -68,29 +111,96 @@ bool Densification::process()
 {
   // NOTE: All depthmap maps are CV_32F except they are explicitly casted
 
+  // Reconstructions are collected in the order they were started, even if a later one finishes first. The oldest one
+  // is waited for once no further one can be started.
+  if (!m_reconstructions.empty())
+  {
+    bool is_full = m_reconstructions.size() >= m_nrof_jobs;
+    bool is_idle = m_buffer_reco.size() < m_nrof_candidates;
+    bool is_ready = m_reconstructions.front().depthmap.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    if (is_full || is_idle || is_ready)
+    {
+      collectReconstruction();
+      return true;
+    }
+  }
+
   // First check if buffer has enough frames already, else don't do anything
-  if (m_buffer_reco.size() < m_n_frames)
+  if (m_buffer_reco.size() < m_nrof_candidates)
   {
     return false;
   }
 
+  // Reconstruction results would only be dropped by the following stages, so the frame is skipped right away
+  if (isDownstreamSaturated())
+  {
+    LOG_F(INFO, "Following stages are saturated. Skipping dense reconstruction of frame #%u...", m_buffer_reco.front()->getFrameId());
+    popFromBufferReco();
+    updateStatisticsSkippedFrame();
+    return true;
+  }
+
   // Densification step using stereo
-  long t = getCurrentTimeMilliseconds();
   Frame::Ptr frame_processed;
-  Depthmap::Ptr depthmap = processStereoReconstruction(m_buffer_reco, frame_processed);
+  std::deque<Frame::Ptr> candidates;
+  {
+    // Candidates are copied, so frames can be added while reconstructing
+    std::unique_lock<std::mutex> lock(m_mutex_buffer_reco);
+    candidates.assign(m_buffer_reco.begin(), m_buffer_reco.begin() + static_cast<std::ptrdiff_t>(m_nrof_candidates));
+  }
+  std::future<Depthmap::Ptr> depthmap = processStereoReconstruction(candidates, frame_processed);
   popFromBufferReco();
-  updateStatisticsProcessedFrame();
 
-  LOG_IF_F(INFO, m_verbose, "Timing [Dense Reconstruction]: %lu ms", getCurrentTimeMilliseconds() - t);
+  if (depthmap.valid())
+    m_reconstructions.push_back(Reconstruction{frame_processed, std::move(depthmap)});
+  else
+    updateStatisticsProcessedFrame(frame_processed);
+
+  return true;
+}
+
+void Densification::collectReconstruction()
+{
+  ScopedTimer timer_dense_reconstruction("Dense Reconstruction");
+  Reconstruction reconstruction = std::move(m_reconstructions.front());
+  m_reconstructions.pop_front();
+
+  Frame::Ptr frame_processed = reconstruction.frame;
+  Depthmap::Ptr depthmap = reconstruction.depthmap.get();
+  updateStatisticsProcessedFrame(frame_processed);
+  timer_dense_reconstruction.stop();
+
+  LOG_IF_F(INFO, depthmap != nullptr, "Successfully reconstructed frame #%u!", frame_processed->getFrameId());
+  LOG_IF_F(WARNING, depthmap == nullptr, "Reconstruction of frame #%u failed!", frame_processed->getFrameId());
   if (!depthmap)
-    return true;
+    return;
+
+  // The previous frame was post-processed while this one was reconstructed. Only one frame is post-processed at a
+  // time, so the consistency buffer is extended in order and the pipeline can not run ahead of the filtering.
+  waitForPostProcessing();
 
+  if (m_pool_postprocessing)
+    m_future_postprocessing = m_pool_postprocessing->submit([this, frame_processed, depthmap]{
+      postProcess(frame_processed, depthmap);
+    });
+  else
+    postProcess(frame_processed, depthmap);
+}
+
+void Densification::waitForReconstructions()
+{
+  while (!m_reconstructions.empty())
+    collectReconstruction();
+}
+
+void Densification::postProcess(Frame::Ptr frame_processed, Depthmap::Ptr depthmap)
+{
   // Compute normals if desired
-  t = getCurrentTimeMilliseconds();
+  ScopedTimer timer_computing_normals("Computing Normals");
   cv::Mat normals;
   if (m_compute_normals)
-    normals = stereo::computeNormalsFromDepthMap(depthmap->data());
-  LOG_IF_F(INFO, m_verbose, "Timing [Computing Normals]: %lu ms", getCurrentTimeMilliseconds() - t);
+    normals = stereo::computeNormalsFromDepthMap(depthmap->data(), m_thread_pool, 0);
+  timer_computing_normals.stop();
 
   // Remove outliers
   double depth_min = frame_processed->getMedianSceneDepth()*0.25;
@@ -99,53 +209,62 @@ bool Densification::process()
   LOG_F(INFO, "Scene depthmap forced in range %4.2f ... %4.2f", depth_min, depth_max);
 
   // Set data in the frame
-  t = getCurrentTimeMilliseconds();
+  ScopedTimer timer_setting("Setting");
   frame_processed->setDepthmap(depthmap);
-  LOG_IF_F(INFO, m_verbose, "Timing [Setting]: %lu ms", getCurrentTimeMilliseconds() - t);
+  timer_setting.stop();
 
-  // Creating dense cloud
-  cv::Mat img3d = stereo::reprojectDepthMap(depthmap->getCamera(), depthmap->data());
-  cv::Mat dense_cloud = img3d.reshape(1, img3d.rows*img3d.cols);
+  // Depth of the frame before filtering, which is how its neighbours see it. It is a fraction of the dense cloud.
+  auto depthmap_unfiltered = std::make_shared<Depthmap>(depthmap->data().clone(), *depthmap->getCamera());
 
   // Denoising
-  t = getCurrentTimeMilliseconds();
-  m_buffer_consistency.emplace_back(std::make_pair(frame_processed, dense_cloud));
-  if (m_buffer_consistency.size() >= 4)
+  ScopedTimer timer_denoising("Denoising");
   {
-    frame_processed = consistencyFilter(&m_buffer_consistency);
-    m_buffer_consistency.pop_front();
-  }
-  else
-  {
-    LOG_IF_F(INFO, m_verbose, "Consistency filter is activated. Waiting for more frames for denoising...");
-    return true;
+    std::unique_lock<std::mutex> lock(m_mutex_buffer_consistency);
+    m_buffer_consistency.emplace_back(std::make_pair(frame_processed, depthmap_unfiltered));
+    if (m_buffer_consistency.size() >= 4)
+    {
+      frame_processed = consistencyFilter(&m_buffer_consistency);
+      m_buffer_consistency.pop_front();
+    }
+    else
+    {
+      LOG_IF_F(INFO, m_verbose, "Consistency filter is activated. Waiting for more frames for denoising...");
+      return;
+    }
   }
-  LOG_IF_F(INFO, m_verbose, "Timing [Denoising]: %lu ms", getCurrentTimeMilliseconds() - t);
+  timer_denoising.stop();
 
   // Last check if frame still has valid depthmap
   if (!frame_processed->getDepthmap())
   {
     //_transport_frame(frame_processed, "output/frame");
-    return true;
+    return;
   }
 
-  // Post processing
-  depthmap->data() = applyDepthMapPostProcessing(depthmap->data());
+  // Post processing of the frame released by the consistency filter, which is not the one just added
+  depthmap = frame_processed->getDepthmap();
+  depth_min = frame_processed->getMedianSceneDepth()*0.25;
+  depth_max = frame_processed->getMedianSceneDepth()*1.75;
+  depthmap->data() = applyDepthMapPostProcessing(depthmap->data(), depth_min, depth_max);
 
   // Savings
-  t = getCurrentTimeMilliseconds();
+  ScopedTimer timer_saving("Saving");
   saveIter(frame_processed, normals);
-  LOG_IF_F(INFO, m_verbose, "Timing [Saving]: %lu ms", getCurrentTimeMilliseconds() - t);
+  timer_saving.stop();
 
   // Republish frame to next stage
-  t = getCurrentTimeMilliseconds();
+  ScopedTimer timer_publish("Publish");
   publish(frame_processed, depthmap->data());
-  LOG_IF_F(INFO, m_verbose, "Timing [Publish]: %lu ms", getCurrentTimeMilliseconds() - t);
+  timer_publish.stop();
+}
 
-  return true;
+void Densification::waitForPostProcessing()
+{
+  if (m_future_postprocessing.valid())
+    m_future_postprocessing.get();
 }
 
-Frame::Ptr Densification::consistencyFilter(std::deque<std::pair<Frame::Ptr, cv::Mat>>* buffer_denoise)
+Frame::Ptr Densification::consistencyFilter(std::deque<std::pair<Frame::Ptr, Depthmap::Ptr>>* buffer_denoise)
 {
   Frame::Ptr frame = (*buffer_denoise)[buffer_denoise->size()/2].first;
 
@@ -155,31 +274,34 @@ Frame::Ptr Densification::consistencyFilter(std::deque<std::pair<Frame::Ptr, cv:
   int rows = depthmap_ii_data.rows;
   int cols = depthmap_ii_data.cols;
 
-  cv::Mat votes = cv::Mat::zeros(rows, cols, CV_8UC1);
-
-  float th_depth = 0.1;
+  const float th_depth = 0.1f;
 
+  // Every frame is the reference of exactly one window, so each neighbour is projected into it only once
+  std::vector<Depthmap::Ptr> neighbours;
   for (const auto &f : *buffer_denoise)
-  {
-    if (f.first == frame)
-      continue;
+    if (f.first != frame)
+      neighbours.push_back(f.second);
 
-    cv::Mat dense_cloud = f.second;
-    cv::Mat depthmap_ij_data = stereo::computeDepthMapFromPointCloud(depthmap_ii->getCamera(), dense_cloud);
-
-    for (int r = 0; r < rows; ++r)
-      for (int c =0; c < cols; ++c)
-      {
-        float d_ii = depthmap_ii_data.at<float>(r, c);
-        float d_ij = depthmap_ij_data.at<float>(r, c);
-
-        if (d_ii <= 0 || d_ij <= 0)
-          continue;
+  // Every neighbour votes independently for the cells of the reference depth map, so the neighbours are reprojected
+  // and compared in parallel.
+  std::vector<cv::Mat> votes_neighbours(neighbours.size());
+  parallelFor(m_thread_pool, cv::Range(0, static_cast<int>(neighbours.size())), [&](const cv::Range &range)
+  {
+    for (int i = range.start; i < range.end; ++i)
+    {
+      cv::Mat depthmap_ij_data = stereo::computeDepthMapFromDepthMap(depthmap_ii->getCamera(), neighbours[i]->getCamera(),
+                                                                     neighbours[i]->data(), m_thread_pool, 0);
+      cv::Mat votes_ij(rows, cols, CV_8UC1);
+
+      for (int r = 0; r < rows; ++r)
+        voteRow(cols, depthmap_ii_data.ptr<float>(r), depthmap_ij_data.ptr<float>(r), th_depth, votes_ij.ptr<uchar>(r));
+      votes_neighbours[i] = votes_ij;
+    }
+  }, 0);
 
-        if (fabsf(d_ij-d_ii)/d_ii < th_depth)
-          votes.at<uchar>(r, c) = votes.at<uchar>(r, c) + 1;
-      }
-  }
+  cv::Mat votes = cv::Mat::zeros(rows, cols, CV_8UC1);
+  for (const auto &votes_ij : votes_neighbours)
+    votes += votes_ij;
 
   cv::Mat mask = (votes < 2);
   depthmap_ii_data.setTo(-1.0, mask);
@@ -209,7 +331,7 @@ Frame::Ptr Densification::consistencyFilter(std::deque<std::pair<Frame::Ptr, cv:
   return frame;
 }
 
-Depthmap::Ptr Densification::processStereoReconstruction(const std::deque<Frame::Ptr> &buffer, Frame::Ptr &frame_processed)
+std::future<Depthmap::Ptr> Densification::processStereoReconstruction(const std::deque<Frame::Ptr> &buffer, Frame::Ptr &frame_processed)
 {
   LOG_F(INFO, "Performing stereo reconstruction...");
 
@@ -217,12 +339,22 @@ Depthmap::Ptr Densification::processStereoReconstruction(const std::deque<Frame:
   int ref_idx = (int)buffer.size()/2;
   frame_processed = buffer[ref_idx];
 
+  // Only partners with a useful geometry are reconstructed with, a sweep without them would be wasted
+  std::deque<Frame::Ptr> frames = selectStereoPartners(buffer, ref_idx);
+  if (frames.empty())
+  {
+    LOG_F(INFO, "No suitable stereo partners for frame #%u. Skipping dense reconstruction...", frame_processed->getFrameId());
+    if (!m_do_drop_planar)
+      m_transport_frame(frame_processed, "output/frame");
+    return std::future<Depthmap::Ptr>();
+  }
+
   // Compute baseline information for all frames
   std::vector<double> baselines;
-  baselines.reserve(buffer.size());
+  baselines.reserve(frames.size());
 
   std::string stringbuffer;
-  for (auto &f : buffer)
+  for (auto &f : frames)
   {
     if (f == frame_processed)
       continue;
@@ -232,33 +364,145 @@ Depthmap::Ptr Densification::processStereoReconstruction(const std::deque<Frame:
   }
   LOG_F(INFO, "Baselines to reference frame: %s", stringbuffer.c_str());
 
-  LOG_F(INFO, "Reconstructing frame #%u...", frame_processed->getFrameId());
-  Depthmap::Ptr depthmap = m_densifier->densify(buffer, (uint8_t)ref_idx);
+  LOG_FRAME_F(INFO, "Reconstructing frame #%u...", frame_processed->getFrameId());
+  return m_densifier->densifyAsync(frames, (uint8_t)ref_idx);
+}
 
-  LOG_IF_F(INFO, depthmap != nullptr, "Successfully reconstructed frame!");
-  LOG_IF_F(WARNING, depthmap == nullptr, "Reconstruction failed!");
+std::deque<Frame::Ptr> Densification::selectStereoPartners(const std::deque<Frame::Ptr> &candidates, int &ref_idx) const
+{
+  const Frame::Ptr &frame_ref = candidates[ref_idx];
+  cv::Mat pose_ref = frame_ref->getPose();
+  cv::Mat axis_ref = pose_ref.col(2);
+  double depth_ref = frame_ref->getMedianSceneDepth();
+  cv::Rect2d roi_ref = frame_ref->getCamera()->projectImageBoundsToPlaneRoi(m_plane_ref.pt, m_plane_ref.n);
+
+  // Score of every candidate passing the thresholds, negative if it is rejected
+  std::vector<std::pair<double, int>> scores;
+  for (int i = 0; i < static_cast<int>(candidates.size()); ++i)
+  {
+    if (i == ref_idx)
+      continue;
 
-  return depthmap;
+    const Frame::Ptr &frame = candidates[i];
+    cv::Mat pose = frame->getPose();
+
+    double ratio = stereo::computeBaselineFromPose(pose_ref, pose) / std::max(depth_ref, 10e-6);
+    double angle = std::acos(std::min(std::max(axis_ref.dot(pose.col(2)) / (cv::norm(axis_ref) * cv::norm(pose.col(2))), -1.0), 1.0));
+    cv::Rect2d roi = frame->getCamera()->projectImageBoundsToPlaneRoi(m_plane_ref.pt, m_plane_ref.n);
+    double overlap = (roi_ref.area() > 0.0 ? (roi_ref & roi).area() / roi_ref.area() : 0.0);
+
+    if (ratio <= 0.0
+        || ratio < m_partner_min_baseline_ratio
+        || (m_partner_max_view_angle > 0.0 && angle > m_partner_max_view_angle)
+        || overlap < m_partner_min_overlap)
+    {
+      LOG_IF_F(INFO, m_verbose, "Rejected stereo partner #%u: Baseline ratio %4.3f, angle %4.2f deg, overlap %3.2f",
+               frame->getFrameId(), ratio, angle * 180.0 / M_PI, overlap);
+      continue;
+    }
+    scores.emplace_back(overlap * std::min(ratio / g_baseline_ratio_optimal, 1.0), i);
+  }
+
+  auto nrof_partners = static_cast<size_t>(m_n_frames) - 1;
+  if (scores.size() < nrof_partners)
+    return std::deque<Frame::Ptr>();
+
+  // Best partners are kept, then restored to the order of arrival the densifier expects
+  std::partial_sort(scores.begin(), scores.begin() + static_cast<std::ptrdiff_t>(nrof_partners), scores.end(),
+                    [](const std::pair<double, int> &lhs, const std::pair<double, int> &rhs){ return lhs.first > rhs.first; });
+  std::vector<int> indices{ref_idx};
+  for (size_t i = 0; i < nrof_partners; ++i)
+    indices.push_back(scores[i].second);
+  std::sort(indices.begin(), indices.end());
+
+  std::deque<Frame::Ptr> frames;
+  for (int idx : indices)
+  {
+    if (idx == ref_idx)
+      ref_idx = static_cast<int>(frames.size());
+    frames.push_back(candidates[idx]);
+  }
+  return frames;
 }
 
 Depthmap::Ptr Densification::forceInRange(const Depthmap::Ptr &depthmap, double min_depth, double max_depth)
 {
-  cv::Mat mask;
   cv::Mat data = depthmap->data();
+  auto depth_lo = static_cast<float>(min_depth);
+  auto depth_hi = static_cast<float>(max_depth);
 
-  cv::inRange(data, min_depth, max_depth, mask);
-
-  cv::bitwise_not(mask, mask);
-  data.setTo(-1.0f, mask);
+  // Single pass in place, instead of computing and inverting a mask first
+  parallelFor(m_thread_pool, cv::Range(0, data.rows), [&](const cv::Range &range)
+  {
+    for (int r = range.start; r < range.end; ++r)
+    {
+      auto d = data.ptr<float>(r);
+      for (int c = 0; c < data.cols; ++c)
+        d[c] = (d[c] >= depth_lo && d[c] <= depth_hi) ? d[c] : -1.0f;
+    }
+  }, 0);
 
   return depthmap;
 }
 
-cv::Mat Densification::applyDepthMapPostProcessing(const cv::Mat &depthmap)
+cv::Mat Densification::applyDepthMapPostProcessing(const cv::Mat &depthmap, double min_depth, double max_depth)
 {
-  cv::Mat depthmap_filtered;
-  if (m_use_filter_bilat)
-      cv::bilateralFilter(depthmap, depthmap_filtered, 5, 25, 25);
+  if (!m_use_filter_bilat)
+    return depthmap;
+
+  // Edge-aware smoothing with the parameters of the former cv::bilateralFilter(depthmap, out, 5, 25, 25). Invalid
+  // depths neither contribute to their neighbours nor get filled, and the result is clamped to the depth range.
+  const int radius = 2;
+  const float sigma_space = 25.0f;
+  const float sigma_range = 25.0f;
+  const float k_range = -1.0f / (2.0f * sigma_range * sigma_range);
+
+  float w_space[2*radius+1][2*radius+1];
+  for (int dy = -radius; dy <= radius; ++dy)
+    for (int dx = -radius; dx <= radius; ++dx)
+      w_space[dy+radius][dx+radius] = std::exp(-static_cast<float>(dx*dx + dy*dy) / (2.0f * sigma_space * sigma_space));
+
+  auto depth_lo = static_cast<float>(min_depth);
+  auto depth_hi = static_cast<float>(max_depth);
+  int rows = depthmap.rows;
+  int cols = depthmap.cols;
+
+  cv::Mat depthmap_filtered(rows, cols, CV_32F);
+  parallelFor(m_thread_pool, cv::Range(0, rows), [&](const cv::Range &range)
+  {
+    for (int r = range.start; r < range.end; ++r)
+    {
+      auto d_center = depthmap.ptr<float>(r);
+      auto d_out = depthmap_filtered.ptr<float>(r);
+
+      for (int c = 0; c < cols; ++c)
+      {
+        float d0 = d_center[c];
+        if (!(d0 >= depth_lo && d0 <= depth_hi))
+        {
+          d_out[c] = -1.0f;
+          continue;
+        }
+
+        float sum_w = 0.0f;
+        float sum_d = 0.0f;
+        for (int dy = std::max(-radius, -r); dy <= std::min(radius, rows - 1 - r); ++dy)
+        {
+          auto d_row = depthmap.ptr<float>(r + dy);
+          for (int dx = std::max(-radius, -c); dx <= std::min(radius, cols - 1 - c); ++dx)
+          {
+            float d = d_row[c + dx];
+            if (d <= 0.0f)
+              continue;
+            float w = w_space[dy+radius][dx+radius] * std::exp(k_range * (d - d0) * (d - d0));
+            sum_w += w;
+            sum_d += w * d;
+          }
+        }
+        d_out[c] = std::min(std::max(sum_d / sum_w, depth_lo), depth_hi);
+      }
+    }
+  }, 0);
 
   /*if (_settings_save.save_bilat)
     io::saveImageColorMap(depthmap_filtered, _depth_min_current, _depth_max_current, _stage_path + "/bilat", "bilat",
@@ -284,7 +528,7 @@ cv::Mat Densification::computeDepthMapMask(const cv::Mat &depth_map, bool use_sp
 void Densification::publish(const Frame::Ptr &frame, const cv::Mat &depthmap)
 {
   // First update statistics about outgoing frame rate
-  updateStatisticsOutgoing();
+  updateStatisticsOutgoing(frame);
 
   m_transport_frame(frame, "output/frame");
   m_transport_pose(frame->getPose(), frame->getGnssUtm().zone, frame->getGnssUtm().band, "output/pose");
@@ -299,19 +543,34 @@ void Densification::publish(const Frame::Ptr &frame, const cv::Mat &depthmap)
 
 void Densification::saveIter(const Frame::Ptr &frame, const cv::Mat &normals)
 {
-  cv::Mat depthmap_data = frame->getDepthmap()->data();
+  bool do_save_normals = m_settings_save.save_normals && m_compute_normals && !normals.empty();
+  if (!(m_settings_save.save_imgs || do_save_normals || m_settings_save.save_dense))
+    return;
 
-  if (m_settings_save.save_imgs)
-    io::saveImage(frame->getResizedImageUndistorted(), io::createFilename(m_stage_path + "/imgs/imgs_", frame->getFrameId(), ".png"));
-  if (m_settings_save.save_normals && m_compute_normals && !normals.empty())
-    io::saveImageColorMap(normals, (depthmap_data > 0), m_stage_path + "/normals", "normals", frame->getFrameId(), io::ColormapType::NORMALS);
-  if (m_settings_save.save_sparse)
+  // The frame is handed over to the next stage, which may modify or release its data, so the export service gets a
+  // snapshot
+  Depthmap::Ptr depthmap = frame->getDepthmap();
+  auto depthmap_snapshot = std::make_shared<Depthmap>(depthmap->data().clone(), *depthmap->getCamera());
+  cv::Mat img = (m_settings_save.save_imgs ? frame->getResizedImageUndistorted() : cv::Mat());
+  cv::Mat normals_snapshot = (do_save_normals ? normals.clone() : cv::Mat());
+
+  SaveSettings settings_save = m_settings_save;
+  std::string stage_path = m_stage_path;
+  uint32_t id = frame->getFrameId();
+  submitExport([depthmap_snapshot, img, normals_snapshot, settings_save, stage_path, id]()
   {
-    //cv::Mat depthmap_sparse = stereo::computeDepthMapFromPointCloud(frame->getResizedCamera(), frame->getSparseCloud()->data().colRange(0, 3));
-    //io::saveDepthMap(depthmap_sparse, m_stage_path + "/sparse/sparse_%06i.tif", frame->getFrameId());
-  }
-  if (m_settings_save.save_dense)
-    io::saveDepthMap(frame->getDepthmap(), m_stage_path + "/dense/dense_%06i.tif", frame->getFrameId());
+    if (settings_save.save_imgs)
+      io::saveImage(img, io::createFilename(stage_path + "/imgs/imgs_", id, ".png"));
+    if (!normals_snapshot.empty())
+      io::saveImageColorMap(normals_snapshot, (depthmap_snapshot->data() > 0), stage_path + "/normals", "normals", id, io::ColormapType::NORMALS);
+    if (settings_save.save_sparse)
+    {
+      //cv::Mat depthmap_sparse = stereo::computeDepthMapFromPointCloud(frame->getResizedCamera(), *frame->getSparseCloud());
+      //io::saveDepthMap(depthmap_sparse, m_stage_path + "/sparse/sparse_%06i.tif", frame->getFrameId());
+    }
+    if (settings_save.save_dense)
+      io::saveDepthMap(depthmap_snapshot, stage_path + "/dense/dense_%06i.tif", id);
+  });
 }
 
 void Densification::pushToBufferReco(const Frame::Ptr &frame)
@@ -333,13 +592,29 @@ void Densification::popFromBufferReco()
   m_buffer_reco.pop_front();
 }
 
+bool Densification::changeParam(const std::string &name, const std::string &val)
+{
+  return m_densifier->changeParam(name, val);
+}
+
 void Densification::reset()
 {
   // TODO: Reset in _densifier
+  // Running reconstructions belong to the frames before the reset, so their results are discarded
+  for (auto &reconstruction : m_reconstructions)
+    reconstruction.depthmap.wait();
+  m_reconstructions.clear();
   m_rcvd_frames = 0;
   LOG_F(INFO, "Densification Stage: RESETED!");
 }
 
+void Densification::finishCallback()
+{
+  waitForReconstructions();
+  waitForPostProcessing();
+  waitForExports();
+}
+
 void Densification::initStageCallback()
 {
   // If we aren't saving any information, skip directory creation
@@ -375,6 +650,11 @@ void Densification::printSettingsToLog()
   LOG_F(INFO, "- use_filter_bilat: %i", m_use_filter_bilat);
   LOG_F(INFO, "- use_filter_guided: %i", m_use_filter_guided);
   LOG_F(INFO, "- compute_normals: %i", m_compute_normals);
+  LOG_F(INFO, "- nrof_candidates: %lu", m_nrof_candidates);
+  LOG_F(INFO, "- nrof_jobs: %lu", m_nrof_jobs);
+  LOG_F(INFO, "- partner_min_baseline_ratio: %4.3f", m_partner_min_baseline_ratio);
+  LOG_F(INFO, "- partner_max_view_angle: %4.2f", m_partner_max_view_angle * 180.0 / M_PI);
+  LOG_F(INFO, "- partner_min_overlap: %4.2f", m_partner_min_overlap);
 
   LOG_F(INFO, "### Stage save settings ###");
   LOG_F(INFO, "- save_bilat: %i", m_settings_save.save_bilat);
@@ -391,3 +671,19 @@ void Densification::printSettingsToLog()
 uint32_t Densification::getQueueDepth() {
   return m_buffer_reco.size();
 }
+
+size_t Densification::getMemoryUsage()
+{
+  size_t bytes = 0;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex_buffer_reco);
+    for (const auto &frame : m_buffer_reco)
+      bytes += frame->getByteSize();
+  }
+  {
+    std::unique_lock<std::mutex> lock(m_mutex_buffer_consistency);
+    for (const auto &buffered : m_buffer_consistency)
+      bytes += buffered.first->getByteSize() + buffered.second->data().total() * buffered.second->data().elemSize();
+  }
+  return bytes;
+}
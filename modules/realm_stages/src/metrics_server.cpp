@@ -0,0 +1,249 @@
+
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <realm_core/loguru.h>
+
+#include <realm_stages/metrics_server.h>
+
+using namespace realm;
+using namespace stages;
+
+namespace
+{
+
+void writeMetric(std::ostringstream &report, const std::string &name, const std::string &labels, double value)
+{
+  report << name << "{" << labels << "} " << value << "\n";
+}
+
+void writeHeader(std::ostringstream &report, const std::string &name, const std::string &type, const std::string &help)
+{
+  report << "# HELP " << name << " " << help << "\n";
+  report << "# TYPE " << name << " " << type << "\n";
+}
+
+void writeSummary(std::ostringstream &report, const std::string &name, const std::string &labels,
+                  const LatencyPercentiles &percentiles)
+{
+  writeMetric(report, name, labels + ",quantile=\"0.5\"", percentiles.p50);
+  writeMetric(report, name, labels + ",quantile=\"0.9\"", percentiles.p90);
+  writeMetric(report, name, labels + ",quantile=\"0.99\"", percentiles.p99);
+  writeMetric(report, name, labels + ",quantile=\"0.999\"", percentiles.p999);
+  writeMetric(report, name, labels + ",quantile=\"1\"", percentiles.max);
+  report << name << "_count{" << labels << "} " << percentiles.count << "\n";
+}
+
+} // namespace
+
+MetricsServer::MetricsServer(int port, const std::string &address)
+    : m_port(port),
+      m_address(address),
+      m_socket(-1),
+      m_is_running(false)
+{
+  if (port <= 0 || port > 65535)
+    throw(std::invalid_argument("Error: Port of metrics server out of range: " + std::to_string(port)));
+}
+
+MetricsServer::~MetricsServer()
+{
+  stop();
+}
+
+void MetricsServer::addStage(const StageBase::Ptr &stage)
+{
+  std::unique_lock<std::mutex> lock(m_mutex_stages);
+  m_stages.push_back(stage);
+}
+
+void MetricsServer::start()
+{
+  if (m_is_running)
+    return;
+
+  m_socket = socket(AF_INET, SOCK_STREAM, 0);
+  if (m_socket < 0)
+    throw(std::runtime_error("Error: Could not create socket for metrics server."));
+
+  int reuse = 1;
+  setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(static_cast<uint16_t>(m_port));
+  if (inet_pton(AF_INET, m_address.c_str(), &addr.sin_addr) != 1
+      || bind(m_socket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0
+      || listen(m_socket, 4) < 0)
+  {
+    close(m_socket);
+    m_socket = -1;
+    throw(std::runtime_error("Error: Could not bind metrics server to " + m_address + ":" + std::to_string(m_port)));
+  }
+
+  m_is_running = true;
+  m_thread = std::thread(&MetricsServer::serve, this);
+  LOG_F(INFO, "Serving metrics on %s:%i", m_address.c_str(), m_port);
+}
+
+void MetricsServer::stop()
+{
+  if (!m_is_running)
+    return;
+
+  m_is_running = false;
+  if (m_thread.joinable())
+    m_thread.join();
+  close(m_socket);
+  m_socket = -1;
+}
+
+std::string MetricsServer::createReport()
+{
+  std::vector<StageBase::Ptr> stages;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex_stages);
+    stages = m_stages;
+  }
+
+  std::vector<std::pair<std::string, StageStatistics>> statistics;
+  for (const auto &stage : stages)
+    statistics.emplace_back("stage=\"" + stage->getStageName() + "\"", stage->getStageStatistics());
+
+  std::ostringstream report;
+
+  writeHeader(report, "realm_stage_fps_in", "gauge", "Rate of incoming frames in the last statistics period.");
+  for (const auto &s : statistics)
+    writeMetric(report, "realm_stage_fps_in", s.first, s.second.fps_in);
+
+  writeHeader(report, "realm_stage_fps_out", "gauge", "Rate of outgoing frames in the last statistics period.");
+  for (const auto &s : statistics)
+    writeMetric(report, "realm_stage_fps_out", s.first, s.second.fps_out);
+
+  writeHeader(report, "realm_stage_queue_depth", "gauge", "Number of frames waiting for processing.");
+  for (const auto &s : statistics)
+    writeMetric(report, "realm_stage_queue_depth", s.first, s.second.queue_depth);
+
+  writeHeader(report, "realm_stage_frames_total", "counter", "Number of frames added to the stage.");
+  for (const auto &s : statistics)
+    writeMetric(report, "realm_stage_frames_total", s.first, s.second.frames_total);
+
+  writeHeader(report, "realm_stage_frames_processed_total", "counter", "Number of processed frames.");
+  for (const auto &s : statistics)
+    writeMetric(report, "realm_stage_frames_processed_total", s.first, s.second.frames_processed);
+
+  writeHeader(report, "realm_stage_frames_dropped_total", "counter", "Number of frames dropped from a full queue.");
+  for (const auto &s : statistics)
+    writeMetric(report, "realm_stage_frames_dropped_total", s.first, s.second.frames_dropped);
+
+  writeHeader(report, "realm_stage_frames_bad_total", "counter", "Number of frames rejected as invalid.");
+  for (const auto &s : statistics)
+    writeMetric(report, "realm_stage_frames_bad_total", s.first, s.second.frames_bad);
+
+  writeHeader(report, "realm_stage_memory_bytes", "gauge", "Memory of the data held by the stage.");
+  for (const auto &s : statistics)
+    writeMetric(report, "realm_stage_memory_bytes", s.first, static_cast<double>(s.second.memory_usage));
+
+  writeHeader(report, "realm_stage_queue_latency_ms", "summary", "Time frames waited in the queue.");
+  for (const auto &s : statistics)
+    writeSummary(report, "realm_stage_queue_latency_ms", s.first, s.second.queue_latency);
+
+  writeHeader(report, "realm_stage_process_latency_ms", "summary", "Time of the processing steps.");
+  for (const auto &s : statistics)
+    writeSummary(report, "realm_stage_process_latency_ms", s.first, s.second.process_latency);
+
+  writeHeader(report, "realm_stage_frame_age_ms", "summary", "Age of outgoing frames relative to their capture time.");
+  for (const auto &s : statistics)
+    writeSummary(report, "realm_stage_frame_age_ms", s.first, s.second.frame_age);
+
+  MemoryStatistics memory = getMemoryStatistics();
+  writeHeader(report, "realm_process_resident_memory_bytes", "gauge", "Resident memory of the process.");
+  report << "realm_process_resident_memory_bytes " << memory.resident << "\n";
+  writeHeader(report, "realm_process_resident_memory_peak_bytes", "gauge", "Peak resident memory of the process.");
+  report << "realm_process_resident_memory_peak_bytes " << memory.resident_peak << "\n";
+  writeHeader(report, "realm_process_virtual_memory_bytes", "gauge", "Virtual memory of the process.");
+  report << "realm_process_virtual_memory_bytes " << memory.virtual_size << "\n";
+
+  return report.str();
+}
+
+MemoryStatistics MetricsServer::getMemoryStatistics()
+{
+  MemoryStatistics memory;
+
+  // Lines are of the form "VmRSS:     1234 kB"
+  std::ifstream file("/proc/self/status");
+  std::string line;
+  while (std::getline(file, line))
+  {
+    std::istringstream stream(line);
+    std::string key;
+    uint64_t value_kb = 0;
+    if (!(stream >> key >> value_kb))
+      continue;
+
+    if (key == "VmRSS:")
+      memory.resident = value_kb * 1024;
+    else if (key == "VmHWM:")
+      memory.resident_peak = value_kb * 1024;
+    else if (key == "VmSize:")
+      memory.virtual_size = value_kb * 1024;
+  }
+  return memory;
+}
+
+void MetricsServer::serve()
+{
+  while (m_is_running)
+  {
+    // Wake up regularly to check for stop requests
+    pollfd fd{m_socket, POLLIN, 0};
+    if (poll(&fd, 1, 200) <= 0)
+      continue;
+
+    int connection = accept(m_socket, nullptr, nullptr);
+    if (connection < 0)
+      continue;
+
+    respond(connection);
+    close(connection);
+  }
+}
+
+void MetricsServer::respond(int connection)
+{
+  // The request itself is not evaluated, every path returns the metrics. It is read anyway to not reset the
+  // connection before the client sent its request.
+  char request[1024];
+  pollfd fd{connection, POLLIN, 0};
+  if (poll(&fd, 1, 1000) > 0)
+    recv(connection, request, sizeof(request), 0);
+
+  std::string body = createReport();
+  std::string response = "HTTP/1.1 200 OK\r\n"
+                         "Content-Type: text/plain; version=0.0.4\r\n"
+                         "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                         "Connection: close\r\n\r\n" + body;
+
+  size_t nrof_sent = 0;
+  while (nrof_sent < response.size())
+  {
+    ssize_t n = send(connection, response.data() + nrof_sent, response.size() - nrof_sent, MSG_NOSIGNAL);
+    if (n <= 0)
+    {
+      LOG_F(WARNING, "Sending metrics failed: %s", std::strerror(errno));
+      return;
+    }
+    nrof_sent += static_cast<size_t>(n);
+  }
+}
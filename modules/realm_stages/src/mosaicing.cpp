@@ -1,7 +1,17 @@
 
 
+#include <cmath>
+#include <functional>
+#include <future>
+#include <limits>
+#include <thread>
+
+#include <realm_core/cpu_dispatch.h>
+#include <realm_core/log_macros.h>
 #include <realm_core/loguru.h>
+#include <realm_core/scoped_timer.h>
 #include <realm_core/tree_node.h>
+#include <realm_ortho/cuda_backend.h>
 #include <realm_stages/mosaicing.h>
 
 #ifdef WITH_PCL
@@ -11,19 +21,99 @@
 using namespace realm;
 using namespace stages;
 
+namespace
+{
+
+// If an update exceeds the value range of a preview, the range is widened by this fraction of its span, so the preview
+// does not have to be colour mapped completely with every slightly higher value
+const double g_preview_range_margin = 0.1;
+
+/*!
+ * @brief Blends one row of the observed map into the global map, see Mosaicing::blend. Cells are independent of each
+ * other, so every clone of the kernel is vectorized with the register width of its target.
+ */
+REALM_CPU_DISPATCH
+void blendRow(int cols, cv::Vec4b* ref_color_row, float* ref_elevation_row, float* ref_angle_row, uint16_t* ref_nobs_row,
+              float* ref_var_row, const cv::Vec4b* src_color_row, const float* src_elevation_row, const float* src_angle_row)
+{
+  for (int c = 0; c < cols; ++c)
+  {
+    float angle_ref = ref_angle_row[c];
+    if (std::isnan(angle_ref))
+      angle_ref = 0.0f;
+
+    if (src_angle_row[c] > angle_ref)
+    {
+      ref_color_row[c] = src_color_row[c];
+      ref_angle_row[c] = src_angle_row[c];
+      if (ref_var_row == nullptr)
+      {
+        ref_elevation_row[c] = src_elevation_row[c];
+        ref_nobs_row[c] = cv::saturate_cast<uint16_t>(ref_nobs_row[c] + 1);
+      }
+    }
+    else
+      ref_angle_row[c] = angle_ref;
+
+    // Welford update of mean and variance with the new elevation. Cells merged from this frame already hold its
+    // elevation, only their variance is initialized.
+    float elevation = src_elevation_row[c];
+    if (ref_var_row == nullptr || std::isnan(elevation))
+      continue;
+    if (std::isnan(ref_var_row[c]))
+    {
+      ref_var_row[c] = 0.0f;
+      continue;
+    }
+    auto n = static_cast<float>(ref_nobs_row[c]);
+    float delta = elevation - ref_elevation_row[c];
+    ref_elevation_row[c] += delta / (n + 1.0f);
+    ref_var_row[c] = (ref_var_row[c]*n + delta*(elevation - ref_elevation_row[c])) / (n + 1.0f);
+    ref_nobs_row[c] = cv::saturate_cast<uint16_t>(ref_nobs_row[c] + 1);
+  }
+}
+
+} // namespace
+
 Mosaicing::Mosaicing(const StageSettings::Ptr &stage_set, double rate)
     : StageBase("mosaicing", (*stage_set)["path_output"].toString(), rate, (*stage_set)["queue_size"].toInt(), bool((*stage_set)["log_to_file"].toInt())),
+      m_buffer(static_cast<size_t>(std::max(m_queue_size, 1))),
+      m_merge_max_delay((*stage_set)["merge_max_delay"].toInt()),
+      m_frame_merger(m_merge_max_delay, [this](const Frame::Ptr &frame)
+      {
+        // Ringbuffer drops the oldest or the incoming frame if full, depending on their score
+        if (!m_buffer.push(frame, scoreFrame(frame)))
+          updateStatisticsSkippedFrame();
+      }),
       m_utm_reference(nullptr),
       m_global_map(nullptr),
-      //m_mesher(nullptr),
+      m_global_map_chunked(nullptr),
+      m_revision_assembled(0),
+      m_global_map_packed(nullptr),
+      m_mesher(nullptr),
       m_gdal_writer(nullptr),
+      m_frames(nullptr),
+      m_do_keep_frames((*stage_set)["keep_frames"].toInt() > 0),
+      m_nrof_frames_resident(std::max((*stage_set)["frames_resident"].toInt(), 0)),
+      m_frames_cold_storage(io::FrameColdStorage::MEMORY),
+      m_do_post_process_replay((*stage_set)["post_process_replay"].toInt() > 0),
+      m_post_process_region_size(std::max((*stage_set)["post_process_region_size"].toInt(), 1)),
+      m_do_forward_blended((*stage_set)["forward_blended"].toInt() > 0),
       m_publish_mesh_nth_iter(0),
       m_publish_mesh_every_nth_kf((*stage_set)["publish_mesh_every_nth_kf"].toInt()),
       m_do_publish_mesh_at_finish((*stage_set)["publish_mesh_at_finish"].toInt() > 0),
+      m_publish_full_every_nth((*stage_set)["publish_full_every_nth"].toInt()),
+      m_map_version(0),
       m_downsample_publish_mesh((*stage_set)["downsample_publish_mesh"].toDouble()),
+      m_mesh_tile_size((*stage_set)["mesh_tile_size"].toDouble()),
       m_use_surface_normals(true),
       m_th_elevation_min_nobs((*stage_set)["th_elevation_min_nobs"].toInt()),
       m_th_elevation_var((*stage_set)["th_elevation_variance"].toFloat()),
+      m_fuse_elevation((*stage_set)["fuse_elevation"].toInt() > 0),
+      m_chunk_size((*stage_set)["chunk_size"].toInt()),
+      m_use_packed_layout((*stage_set)["chunk_size"].toInt() <= 0 && (*stage_set)["use_packed_layout"].toInt() > 0),
+      m_nrof_threads((*stage_set)["nrof_threads"].toInt()),
+      m_use_cuda((*stage_set)["use_cuda"].toInt() > 0),
       m_settings_save({(*stage_set)["split_gtiff_channels"].toInt() > 0,
                       (*stage_set)["save_ortho_rgb_one"].toInt() > 0,
                       (*stage_set)["save_ortho_rgb_all"].toInt() > 0,
@@ -38,17 +128,86 @@ Mosaicing::Mosaicing(const StageSettings::Ptr &stage_set, double rate)
                        (*stage_set)["save_elevation_mesh_one"].toInt() > 0,
                        (*stage_set)["save_num_obs_one"].toInt() > 0,
                        (*stage_set)["save_num_obs_all"].toInt() > 0,
-                       (*stage_set)["save_dense_ply"].toInt() > 0})
+                       (*stage_set)["save_dense_ply"].toInt() > 0,
+                       (*stage_set)["update_ortho_gtiff_all"].toInt() > 0}),
+      m_checkpoint_store(nullptr),
+      m_checkpoint_every_nth(std::max((*stage_set)["checkpoint_every_nth"].toInt(), 1)),
+      m_nrof_frames_checkpoint(0),
+      m_do_resume_from_checkpoint((*stage_set)["resume_from_checkpoint"].toInt() > 0),
+      m_checkpoint_generation(0),
+      m_nrof_checkpoint_deltas(0),
+      m_checkpoint_delta_cells(0.0)
 {
   std::cout << "Stage [" << m_stage_name << "]: Created Stage with Settings: " << std::endl;
   stage_set->print();
+  setThreadScheduling(readThreadScheduling(*stage_set, "thread"));
 
   if (m_settings_save.save_ortho_gtiff_all)
   {
     m_gdal_writer.reset(new io::GDALContinuousWriter("mosaicing_gtiff_writer", 100, true));
+    m_gdal_writer->setThreadScheduling(readThreadScheduling(*stage_set, "io_thread"));
     m_gdal_writer->start();
+
+    if (m_settings_save.update_ortho_gtiff_all && m_settings_save.split_gtiff_channels)
+      LOG_F(WARNING, "In place update of GeoTIFF is not supported with split channels, the full map is saved instead.");
+  }
+
+  // The packed record holds only the layers needed for blending, everything else is dropped from the global map
+  if (m_use_packed_layout)
+  {
+    m_use_surface_normals = false;
+    if (m_settings_save.save_elevation_var_one || m_settings_save.save_elevation_var_all)
+    {
+      LOG_F(WARNING, "Elevation variance is not kept in the packed layout of the global map and will not be saved.");
+      m_settings_save.save_elevation_var_one = false;
+      m_settings_save.save_elevation_var_all = false;
+    }
+    if (m_fuse_elevation)
+    {
+      LOG_F(WARNING, "Elevation fusion is not supported by the packed layout of the global map, steepest observations are kept.");
+      m_fuse_elevation = false;
+    }
+  }
+
+  if (m_use_cuda && !ortho::cuda::isAvailable())
+  {
+    LOG_F(WARNING, "CUDA is not available, blending is processed on the CPU.");
+    m_use_cuda = false;
+  }
+
+  std::string checkpoint_directory = (*stage_set)["checkpoint_directory"].toString();
+  if (!checkpoint_directory.empty())
+    m_checkpoint_store = std::make_shared<io::CheckpointStore>(checkpoint_directory);
+  else if (m_do_resume_from_checkpoint)
+  {
+    LOG_F(WARNING, "Resume from checkpoint requested, but no checkpoint directory set.");
+    m_do_resume_from_checkpoint = false;
+  }
+
+  std::string frames_cold_storage = (*stage_set)["frames_cold_storage"].toString();
+  if (frames_cold_storage == "file")
+    m_frames_cold_storage = io::FrameColdStorage::FILE;
+  else if (frames_cold_storage != "memory")
+    throw(std::invalid_argument("Error creating mosaicing stage: Unknown cold storage '" + frames_cold_storage + "' for frames."));
+
+  if (m_do_post_process_replay && (!m_do_keep_frames || m_chunk_size > 0 || m_use_packed_layout))
+  {
+    LOG_F(WARNING, "Replaying frames in post processing requires keep_frames and the monolithic global map, it is disabled.");
+    m_do_post_process_replay = false;
+  }
+  if (m_do_post_process_replay && m_do_resume_from_checkpoint)
+  {
+    LOG_F(WARNING, "Frames of the interrupted run are not kept, replaying frames in post processing is disabled.");
+    m_do_post_process_replay = false;
   }
 
+  // Spill file is located in the stage directory, which is only known when the stage path is initialized
+  if (m_do_keep_frames && m_frames_cold_storage == io::FrameColdStorage::MEMORY)
+    m_frames = std::make_shared<io::FrameStore>(static_cast<size_t>(m_nrof_frames_resident));
+
+  // Vertices of the mesh are sampled with the downsampled resolution, or the one of the global map if not set
+  m_mesher = std::make_shared<TiledMesher>(m_mesh_tile_size, (m_downsample_publish_mesh > 10e-6 ? m_downsample_publish_mesh : 0.0));
+
   registerAsyncDataReadyFunctor([=]{ return !m_buffer.empty(); });
 }
 
@@ -59,55 +218,67 @@ Mosaicing::~Mosaicing()
 void Mosaicing::addFrame(const Frame::Ptr &frame)
 {
   // First update statistics about incoming frame rate
-  updateStatisticsIncoming();
+  updateStatisticsIncoming(frame);
 
   if (!frame->getSurfaceModel() || !frame->getOrthophoto())
   {
     LOG_F(INFO, "Input frame missing observed map. Dropping!");
     return;
   }
-  std::unique_lock<std::mutex> lock(m_mutex_buffer);
-  m_buffer.push_back(frame);
-
-  // Ringbuffer implementation for buffer with no pose
-  if (m_buffer.size() > m_queue_size)
-  {
-    m_buffer.pop_front();
-    updateStatisticsSkippedFrame();
-  }
+  // Frames of several cameras might arrive concurrently and out of order, they are pushed once merged
+  m_frame_merger.add(frame);
   notify();
 }
 
 bool Mosaicing::process()
 {
+  m_frame_merger.update();
+
   bool has_processed = false;
   if (!m_buffer.empty())
   {
-    // Prepare timing
-    long t;
+    // Restored before the first frame, so it is blended into the global map of the interrupted run
+    if (m_do_resume_from_checkpoint)
+    {
+      m_do_resume_from_checkpoint = false;
+      loadCheckpoint();
+    }
 
     // Prepare output of incremental map update
     CvGridMap::Ptr map_update;
 
     Frame::Ptr frame = getNewFrame();
-    CvGridMap::Ptr surface_model = frame->getSurfaceModel();
-    CvGridMap::Ptr orthophoto = frame->getOrthophoto();
 
-    CvGridMap::Ptr map = std::make_shared<CvGridMap>(orthophoto->roi(), orthophoto->resolution());
-    map->add(*surface_model, REALM_OVERWRITE_ALL, false);
-    map->add(*orthophoto, REALM_OVERWRITE_ALL, false);
+    LOG_FRAME_F(INFO, "Processing frame #%u...", frame->getFrameId());
 
-    LOG_F(INFO, "Processing frame #%u...", frame->getFrameId());
+    bool is_initialization = (m_chunk_size > 0 ? m_global_map_chunked == nullptr : m_global_map == nullptr);
+    CvGridMap::Ptr map = createObservedMap(frame, getGlobalResolution(), is_initialization);
 
     // Use surface normals only if setting was set to true AND actual data has normals
     m_use_surface_normals = (m_use_surface_normals && map->exists("elevation_normal"));
 
     if (m_utm_reference == nullptr)
       m_utm_reference = std::make_shared<UTMPose>(frame->getGnssUtm());
-    if (m_global_map == nullptr)
+    if (m_chunk_size > 0)
+    {
+      map_update = addToChunkedMap(map);
+
+      ScopedTimer timer_assemble_global_map("Assemble Global Map");
+      assembleGlobalMap(false);
+      timer_assemble_global_map.stop();
+    }
+    else if (m_use_packed_layout)
+    {
+      map_update = addToPackedMap(map);
+
+      ScopedTimer timer_assemble_global_map("Assemble Global Map");
+      assembleGlobalMap(false);
+      timer_assemble_global_map.stop();
+    }
+    else if (m_global_map == nullptr)
     {
       LOG_F(INFO, "Initializing global map...");
-      m_global_map = map;
+      m_global_map = std::make_shared<CvGridMap>(map->clone());
 
       // Incremental update is equal to global map on initialization
       map_update = m_global_map;
@@ -116,13 +287,13 @@ bool Mosaicing::process()
     {
       LOG_F(INFO, "Adding new map data to global map...");
 
-      t = getCurrentTimeMilliseconds();
-      (*m_global_map).add(*map, REALM_OVERWRITE_ZERO, true);
-      LOG_F(INFO, "Timing [Add New Map]: %lu ms", getCurrentTimeMilliseconds()-t);
+      ScopedTimer timer_add_new_map("Add New Map");
+      (*m_global_map).add(*map, REALM_OVERWRITE_ZERO, true, m_thread_pool, m_nrof_threads);
+      timer_add_new_map.stop();
 
-      t = getCurrentTimeMilliseconds();
-      CvGridMap::Overlap overlap = m_global_map->getOverlap(*map);
-      LOG_F(INFO, "Timing [Compute Overlap]: %lu ms", getCurrentTimeMilliseconds()-t);
+      ScopedTimer timer_compute_overlap("Compute Overlap");
+      CvGridMap::Overlap overlap = m_global_map->getOverlapView(*map);
+      timer_compute_overlap.stop();
 
       if (overlap.first == nullptr && overlap.second == nullptr)
       {
@@ -132,10 +303,10 @@ bool Mosaicing::process()
       {
         LOG_F(INFO, "Overlap detected. Add with blending...");
 
-        t = getCurrentTimeMilliseconds();
+        // Overlap is a view into the global map, so blending writes the result in place
+        ScopedTimer timer_blending("Blending");
         CvGridMap overlap_blended = blend(&overlap);
-        (*m_global_map).add(overlap_blended, REALM_OVERWRITE_ALL, false);
-        LOG_F(INFO, "Timing [Blending]: %lu ms", getCurrentTimeMilliseconds()-t);
+        timer_blending.stop();
 
         cv::Rect2d roi = overlap_blended.roi();
         LOG_F(INFO, "Overlap region: [%4.2f, %4.2f] [%4.2f x %4.2f]", roi.x, roi.y, roi.width, roi.height);
@@ -147,69 +318,591 @@ bool Mosaicing::process()
     }
 
     // Publishings every iteration
-    LOG_F(INFO, "Publishing...");
+    LOG_FRAME_F(INFO, "Publishing...");
 
-    t = getCurrentTimeMilliseconds();
+    ScopedTimer timer_publish("Publish");
     publish(frame, m_global_map, map_update, frame->getTimestamp());
-    LOG_F(INFO, "Timing [Publish]: %lu ms", getCurrentTimeMilliseconds()-t);
+    if (m_do_forward_blended)
+      forwardBlended(frame, map->roi());
+    timer_publish.stop();
 
 
     // Savings every iteration
-    t = getCurrentTimeMilliseconds();
-    saveIter(frame->getFrameId(), map_update);
-    LOG_F(INFO, "Timing [Saving]: %lu ms", getCurrentTimeMilliseconds()-t);
+    ScopedTimer timer_saving("Saving");
+    saveIter(frame->getFrameId(), map_update, map->roi());
+    timer_saving.stop();
+
+    if (m_checkpoint_store != nullptr)
+    {
+      m_roi_checkpoint = (m_roi_checkpoint.area() > 0.0 ? (m_roi_checkpoint | map->roi()) : map->roi());
+      if (++m_nrof_frames_checkpoint >= m_checkpoint_every_nth)
+      {
+        ScopedTimer timer_checkpoint("Checkpoint");
+        saveCheckpoint();
+        timer_checkpoint.stop();
+        m_nrof_frames_checkpoint = 0;
+      }
+    }
 
-    // MVS export
-    //m_frames.push_back(frame);
+    // Frames are only kept for post processing, the oldest resident one is compressed here if necessary
+    if (m_frames)
+      m_frames->add(frame);
 
     has_processed = true;
   }
   return has_processed;
 }
 
-CvGridMap Mosaicing::blend(CvGridMap::Overlap *overlap)
+CvGridMap::Ptr Mosaicing::createObservedMap(const Frame::Ptr &frame, double resolution_global, bool is_initialization) const
 {
-  // Overlap between global mosaic (ref) and new data (inp)
+  CvGridMap::Ptr surface_model = frame->getSurfaceModel();
+  CvGridMap::Ptr orthophoto = frame->getOrthophoto();
+
+  // Both usually share the grid, so the combined map only references their data. It is not modified afterwards, except
+  // when it becomes the global map.
+  CvGridMap::Ptr map = std::make_shared<CvGridMap>(orthophoto->roi(), orthophoto->resolution());
+  map->addView(*surface_model);
+  map->addView(*orthophoto);
+
+  // The GSD may differ per frame, e.g. with gsd_auto of the ortho rectification. Blending requires one resolution, so
+  // maps are resampled to the resolution of the global map, which is set by the first frame.
+  if (resolution_global > 0.0 && std::fabs(map->resolution() - resolution_global) > 10e-6)
+  {
+    ScopedTimer timer_resampling("Resampling");
+    map->changeResolution(resolution_global);
+  }
+
+  if (m_fuse_elevation)
+    map->add("elevation_var", createElevationVariance(*map, is_initialization));
+  return map;
+}
+
+CvGridMap Mosaicing::blend(CvGridMap::Overlap *overlap, bool is_parallel)
+{
+  // Overlap between global mosaic (ref) and new data (inp). Layers are shared with the overlap, so if it is a view into
+  // the global map, it is blended in place
   CvGridMap ref = *overlap->first;
   CvGridMap src = *overlap->second;
 
-  cv::Mat ref_not_elevated;
-  cv::bitwise_not(ref["elevated"], ref_not_elevated);
+  // Layer names are resolved once for all frames
+  static const CvGridMap::LayerId layer_color("color_rgb");
+  static const CvGridMap::LayerId layer_elevation("elevation");
+  static const CvGridMap::LayerId layer_angle("elevation_angle");
+  static const CvGridMap::LayerId layer_nobs("num_observations");
+
+  cv::Mat &ref_color = ref[layer_color];
+  cv::Mat &ref_elevation = ref[layer_elevation];
+  cv::Mat &ref_angle = ref[layer_angle];
+  cv::Mat &ref_nobs = ref[layer_nobs];
+  const cv::Mat &src_color = src[layer_color];
+  const cv::Mat &src_elevation = src[layer_elevation];
+  const cv::Mat &src_angle = src[layer_angle];
+
+  if (ref_color.type() != CV_8UC4 || src_color.type() != CV_8UC4
+      || ref_elevation.type() != CV_32F || src_elevation.type() != CV_32F
+      || ref_angle.type() != CV_32F || src_angle.type() != CV_32F
+      || ref_nobs.type() != CV_16UC1)
+    throw(std::invalid_argument("Error blending: Unexpected layer types!"));
+
+  cv::Mat ref_var;
+  if (m_fuse_elevation)
+  {
+    static const CvGridMap::LayerId layer_var("elevation_var");
+    ref_var = ref[layer_var];
+    if (ref_var.type() != CV_32F)
+      throw(std::invalid_argument("Error blending: Unexpected layer types!"));
+  }
+
+  if (m_use_cuda)
+  {
+    ortho::cuda::blend(ref_color, ref_elevation, ref_angle, ref_nobs, ref_var, src_color, src_elevation, src_angle);
+    return ref;
+  }
 
-  // There are aparently a number of issues with NaN comparisons breaking in various ways.  See:
-  // https://github.com/opencv/opencv/issues/16465
-  // To avoid these, use patchNaNs before using boolean comparisons
-  cv::patchNaNs(ref["elevation_angle"],0);
-  cv::Mat mask = (src["elevation_angle"] > ref["elevation_angle"]);
+  // Single pass over all layers. New data is taken if it was observed under a steeper elevation angle. NaN angles of
+  // the reference are set to zero, so they are replaced by every valid observation (NaN comparisons are not reliable,
+  // see https://github.com/opencv/opencv/issues/16465). Rows are independent, so they are blended in parallel.
+  auto blend_rows = [&](const cv::Range &range)
+  {
+    for (int r = range.start; r < range.end; ++r)
+    {
+      blendRow(ref_color.cols,
+               ref_color.ptr<cv::Vec4b>(r),
+               ref_elevation.ptr<float>(r),
+               ref_angle.ptr<float>(r),
+               ref_nobs.ptr<uint16_t>(r),
+               (m_fuse_elevation ? ref_var.ptr<float>(r) : nullptr),
+               src_color.ptr<cv::Vec4b>(r),
+               src_elevation.ptr<float>(r),
+               src_angle.ptr<float>(r));
+    }
+  };
 
-  src["color_rgb"].copyTo(ref["color_rgb"], mask);
-  src["elevation"].copyTo(ref["elevation"], mask);
-  src["elevation_angle"].copyTo(ref["elevation_angle"], mask);
-  cv::add(ref["num_observations"], cv::Mat::ones(ref.size().height, ref.size().width, CV_16UC1),
-          ref["num_observations"], mask);
+  if (is_parallel)
+    parallelFor(m_thread_pool, cv::Range(0, ref_color.rows), blend_rows, m_nrof_threads);
+  else
+    blend_rows(cv::Range(0, ref_color.rows));
 
   return ref;
 }
 
-void Mosaicing::saveIter(uint32_t id, const CvGridMap::Ptr &map_update)
+CvGridMap::Ptr Mosaicing::addToChunkedMap(const CvGridMap::Ptr &map)
 {
-  // Check NaN
-  cv::Mat valid = ((*m_global_map)["elevation"] == (*m_global_map)["elevation"]);
+  if (m_global_map_chunked == nullptr)
+  {
+    LOG_F(INFO, "Initializing chunked global map...");
+    m_global_map_chunked = std::make_shared<ChunkedGridMap>(map->resolution(), m_chunk_size);
+    m_global_map_chunked->add(*map, REALM_OVERWRITE_ALL);
 
-  if (m_settings_save.save_ortho_rgb_all)
-    io::saveImage((*m_global_map)["color_rgb"], io::createFilename(m_stage_path + "/ortho/ortho_", id, ".png"));
+    // Incremental update is equal to the observed map on initialization
+    return map;
+  }
+
+  LOG_F(INFO, "Adding new map data to chunked global map...");
+
+  ScopedTimer timer_add_new_map("Add New Map");
+  m_global_map_chunked->add(*map, REALM_OVERWRITE_ZERO);
+  timer_add_new_map.stop();
+
+  // The global map already contains the new data, so the overlap is always the full footprint of the observed map.
+  // Cells that were empty before are equal in both and are therefore not touched by blending.
+  ScopedTimer timer_compute_overlap("Compute Overlap");
+  CvGridMap::Overlap overlap;
+  overlap.first = std::make_shared<CvGridMap>(m_global_map_chunked->getSubmap(map->getAllLayerNames(), map->roi()));
+  overlap.second = map;
+  timer_compute_overlap.stop();
+
+  ScopedTimer timer_blending("Blending");
+  CvGridMap overlap_blended = blend(&overlap);
+  m_global_map_chunked->add(overlap_blended, REALM_OVERWRITE_ALL);
+  timer_blending.stop();
+  LOG_F(INFO, "Number of chunks: %lu", m_global_map_chunked->getNumberOfChunks());
+
+  // Regions not observed by the current frame are moved to disk, if the pipeline is short on memory
+  if (isMemoryBudgetExceeded() && m_is_output_dir_initialized)
+  {
+    ScopedTimer timer_spill("Spill");
+    io::createDir(m_stage_path);
+    io::createDir(m_stage_path + "/spill");
+    m_global_map_chunked->setSpillDirectory(m_stage_path + "/spill");
+    size_t bytes = m_global_map_chunked->spill(map->roi());
+    LOG_F(INFO, "Memory budget exceeded, spilled %4.2f MB of the global map to disk.",
+          static_cast<double>(bytes) / (1024.0 * 1024.0));
+  }
+
+  LOG_F(INFO, "Extracting updated map...");
+  return std::make_shared<CvGridMap>(overlap_blended.getSubmap({"color_rgb", "elevation"}));
+}
+
+CvGridMap::Ptr Mosaicing::addToPackedMap(const CvGridMap::Ptr &map)
+{
+  bool is_initialization = (m_global_map_packed == nullptr);
+  if (is_initialization)
+  {
+    LOG_F(INFO, "Initializing packed global map...");
+    m_global_map_packed = std::make_shared<PackedGridMap>();
+  }
+  else
+    LOG_F(INFO, "Adding new map data to packed global map...");
+
+  ScopedTimer timer_blending("Blending");
+  m_global_map_packed->blend(*map, m_thread_pool, m_nrof_threads);
+  timer_blending.stop();
+
+  // Incremental update is equal to the observed map on initialization
+  if (is_initialization)
+    return map;
+
+  LOG_F(INFO, "Extracting updated map...");
+  return std::make_shared<CvGridMap>(m_global_map_packed->getSubmap({"color_rgb", "elevation"}, map->roi()));
+}
+
+cv::Mat Mosaicing::createElevationVariance(const CvGridMap &map, bool is_initialization) const
+{
+  cv::Mat variance(map.size(), CV_32F, cv::Scalar(std::numeric_limits<float>::quiet_NaN()));
+  if (is_initialization)
+  {
+    const cv::Mat &elevation = map["elevation"];
+    variance.setTo(cv::Scalar(0.0), elevation == elevation);
+  }
+  return variance;
+}
+
+void Mosaicing::assembleGlobalMap(bool do_all_layers)
+{
+  if (m_global_map_packed != nullptr && !m_global_map_packed->empty())
+  {
+    if (do_all_layers)
+    {
+      m_global_map = std::make_shared<CvGridMap>(m_global_map_packed->getGridMap());
+      return;
+    }
+
+    std::vector<std::string> layer_names{"color_rgb", "elevation"};
+    if (m_settings_save.save_elevation_obs_angle_all)
+      layer_names.emplace_back("elevation_angle");
+    if (m_settings_save.save_num_obs_all)
+      layer_names.emplace_back("num_observations");
+    m_global_map = std::make_shared<CvGridMap>(m_global_map_packed->getGridMap(layer_names));
+    return;
+  }
+
+  if (m_global_map_chunked == nullptr || m_global_map_chunked->empty())
+    return;
+
+  if (do_all_layers)
+  {
+    m_global_map = std::make_shared<CvGridMap>(m_global_map_chunked->getGridMap());
+    m_revision_assembled = 0;
+    return;
+  }
+
+  // Publishing requires color and elevation, saving extracts its layers from the chunks itself. The revision is taken
+  // first, as only this thread adds data to the chunked map.
+  std::vector<std::string> layer_names{"color_rgb", "elevation"};
+  uint64_t revision = m_global_map_chunked->getRevision();
+  if (m_global_map == nullptr || m_revision_assembled == 0)
+    m_global_map = std::make_shared<CvGridMap>(m_global_map_chunked->getGridMap(layer_names));
+  else
+  {
+    // The global map is extended to the new regions while they are copied, regions of other chunks stay untouched
+    for (const cv::Rect2d &region : m_global_map_chunked->getChangedRegions(m_revision_assembled))
+      m_global_map->add(m_global_map_chunked->getSubmap(layer_names, region), REALM_OVERWRITE_ALL, true, m_thread_pool, m_nrof_threads);
+  }
+  m_revision_assembled = revision;
+}
+
+void Mosaicing::forwardBlended(const Frame::Ptr &frame, const cv::Rect2d &roi)
+{
+  if (!m_transport_frame)
+    return;
+
+  // Blended layers are extracted once for the whole footprint, it is always inside the global map after adding it
+  CvGridMap region = getGlobalMapRegion(roi);
+
+  CvGridMap::Ptr orthophoto = std::make_shared<CvGridMap>(region.roi(), region.resolution());
+  for (const auto &layer_name : frame->getOrthophoto()->getAllLayerNames())
+    if (region.exists(layer_name))
+      orthophoto->add(region.getLayer(layer_name), false);
+
+  CvGridMap::Ptr surface_model = std::make_shared<CvGridMap>(region.roi(), region.resolution());
+  for (const auto &layer_name : frame->getSurfaceModel()->getAllLayerNames())
+    if (region.exists(layer_name))
+      surface_model->add(region.getLayer(layer_name), false);
+
+  auto frame_blended = std::make_shared<Frame>(frame->getCameraId(), frame->getFrameId(), frame->getTimestamp(),
+                                               frame->getImageRaw(), frame->getGnssUtm(),
+                                               std::make_shared<camera::Pinhole>(*frame->getCamera()),
+                                               frame->getOrientationView());
+  frame_blended->setSurfaceModel(surface_model);
+  frame_blended->setOrthophoto(orthophoto);
+  m_transport_frame(frame_blended, "output/frame");
+}
+
+CvGridMap Mosaicing::getGlobalMapRegion(const cv::Rect2d &roi) const
+{
+  if (m_global_map_chunked != nullptr)
+    return m_global_map_chunked->getSubmap(m_global_map_chunked->getAllLayerNames(), roi);
+  if (m_global_map_packed != nullptr)
+    return m_global_map_packed->getSubmap(PackedGridMap::getLayerNames(), roi);
+  return m_global_map->getSubmap(m_global_map->getAllLayerNames(), roi);
+}
+
+void Mosaicing::saveCheckpoint()
+{
+  if (m_global_map == nullptr || m_roi_checkpoint.area() <= 0.0)
+    return;
+
+  try
+  {
+    // The assembled global map always has the full extent, even if it does not hold all layers
+    double resolution = m_global_map->resolution();
+    cv::Rect2d roi_map = m_global_map->roi();
+    cv::Rect2d roi_delta = m_roi_checkpoint & roi_map;
+    double cells_map = roi_map.area() / (resolution * resolution);
+    double cells_delta = roi_delta.area() / (resolution * resolution);
+
+    // Deltas are cheaper to write, until restoring them costs more than restoring one complete map
+    bool is_base = (m_checkpoint_generation == 0 || m_checkpoint_delta_cells + cells_delta > cells_map);
+    uint32_t generation = (is_base ? m_checkpoint_generation + 1 : m_checkpoint_generation);
+    uint32_t nrof_deltas = (is_base ? 0 : m_nrof_checkpoint_deltas + 1);
+    double delta_cells = (is_base ? 0.0 : m_checkpoint_delta_cells + cells_delta);
+
+    CvGridMap region = getGlobalMapRegion(is_base ? roi_map : roi_delta);
+    m_checkpoint_store->write(createCheckpointFilename(generation, is_base ? -1 : static_cast<int>(m_nrof_checkpoint_deltas)),
+                              [&](const std::string &filepath) { io::saveCvGridMap(region, filepath); });
+
+    // Commit point of the checkpoint, files of an interrupted write are never referenced
+    m_checkpoint_store->write("mosaicing_state.yaml", [&](const std::string &filepath)
+    {
+      cv::FileStorage fs(filepath, cv::FileStorage::WRITE);
+      fs << "generation" << static_cast<int>(generation);
+      fs << "nrof_deltas" << static_cast<int>(nrof_deltas);
+      fs << "delta_cells" << delta_cells;
+      fs << "map_version" << static_cast<int>(m_map_version);
+      fs << "utm_easting" << m_utm_reference->easting;
+      fs << "utm_northing" << m_utm_reference->northing;
+      fs << "utm_altitude" << m_utm_reference->altitude;
+      fs << "utm_heading" << m_utm_reference->heading;
+      fs << "utm_zone" << static_cast<int>(m_utm_reference->zone);
+      fs << "utm_band" << std::string(1, m_utm_reference->band);
+      fs.release();
+    });
+
+    if (is_base && m_checkpoint_generation > 0)
+    {
+      m_checkpoint_store->remove(createCheckpointFilename(m_checkpoint_generation, -1));
+      for (uint32_t i = 0; i < m_nrof_checkpoint_deltas; ++i)
+        m_checkpoint_store->remove(createCheckpointFilename(m_checkpoint_generation, static_cast<int>(i)));
+    }
+
+    m_checkpoint_generation = generation;
+    m_nrof_checkpoint_deltas = nrof_deltas;
+    m_checkpoint_delta_cells = delta_cells;
+    m_roi_checkpoint = cv::Rect2d();
+
+    LOG_F(INFO, "Checkpoint of global map written, generation: %u, deltas: %u", generation, nrof_deltas);
+  }
+  catch (const std::exception &e)
+  {
+    // Changed region is kept, so it is part of the next checkpoint
+    LOG_F(WARNING, "Writing checkpoint of global map failed: %s", e.what());
+  }
+}
+
+bool Mosaicing::loadCheckpoint()
+{
+  if (!m_checkpoint_store->exists("mosaicing_state.yaml"))
+  {
+    LOG_F(WARNING, "No checkpoint of the global map found in '%s', starting with an empty map.",
+          m_checkpoint_store->getDirectory().c_str());
+    return false;
+  }
+
+  ScopedTimer timer_restore("Restore Checkpoint");
+
+  try
+  {
+    cv::FileStorage fs(m_checkpoint_store->getFilepath("mosaicing_state.yaml"), cv::FileStorage::READ);
+    auto generation = static_cast<uint32_t>((int)fs["generation"]);
+    auto nrof_deltas = static_cast<uint32_t>((int)fs["nrof_deltas"]);
+    double delta_cells = (double)fs["delta_cells"];
+    auto map_version = static_cast<uint64_t>((int)fs["map_version"]);
+    std::string band = (std::string)fs["utm_band"];
+    auto utm_reference = std::make_shared<UTMPose>((double)fs["utm_easting"], (double)fs["utm_northing"],
+                                                   (double)fs["utm_altitude"], (double)fs["utm_heading"],
+                                                   static_cast<uint8_t>((int)fs["utm_zone"]), band.empty() ? ' ' : band[0]);
+    fs.release();
+
+    // Deltas were written in order, so later ones overwrite the regions of earlier ones
+    CvGridMap::Ptr map = io::loadCvGridMap(m_checkpoint_store->getFilepath(createCheckpointFilename(generation, -1)));
+    for (uint32_t i = 0; i < nrof_deltas; ++i)
+    {
+      CvGridMap::Ptr delta = io::loadCvGridMap(m_checkpoint_store->getFilepath(createCheckpointFilename(generation, static_cast<int>(i))));
+      map->add(*delta, REALM_OVERWRITE_ALL, true, m_thread_pool, m_nrof_threads);
+    }
+
+    // Checkpoints of the packed layout do not hold the variance
+    if (m_fuse_elevation && !map->exists("elevation_var"))
+      map->add("elevation_var", createElevationVariance(*map, true));
+
+    if (m_chunk_size > 0)
+    {
+      m_global_map_chunked = std::make_shared<ChunkedGridMap>(map->resolution(), m_chunk_size);
+      m_global_map_chunked->add(*map, REALM_OVERWRITE_ALL);
+      m_revision_assembled = 0;
+      assembleGlobalMap(false);
+    }
+    else if (m_use_packed_layout)
+    {
+      m_global_map_packed = std::make_shared<PackedGridMap>();
+      m_global_map_packed->blend(*map, m_thread_pool, m_nrof_threads);
+      assembleGlobalMap(false);
+    }
+    else
+      m_global_map = map;
+
+    m_utm_reference = utm_reference;
+    m_map_version = map_version;
+    m_checkpoint_generation = generation;
+    m_nrof_checkpoint_deltas = nrof_deltas;
+    m_checkpoint_delta_cells = delta_cells;
+
+    // Mesh has to be built for the complete restored map with the next publish
+    m_roi_mesh_update = m_global_map->roi();
+
+    cv::Rect2d roi = m_global_map->roi();
+    LOG_F(INFO, "Restored global map from checkpoint: [%4.2f, %4.2f] [%4.2f x %4.2f]", roi.x, roi.y, roi.width, roi.height);
+  }
+  catch (const std::exception &e)
+  {
+    LOG_F(WARNING, "Restoring checkpoint of global map failed, starting with an empty map: %s", e.what());
+    m_global_map = nullptr;
+    m_global_map_chunked = nullptr;
+    m_global_map_packed = nullptr;
+    m_utm_reference = nullptr;
+    return false;
+  }
+  timer_restore.stop();
+  return true;
+}
+
+std::string Mosaicing::createCheckpointFilename(uint32_t generation, int delta)
+{
+  if (delta < 0)
+    return "mosaicing_base_" + std::to_string(generation) + ".grid.bin";
+  return "mosaicing_delta_" + std::to_string(generation) + "_" + std::to_string(delta) + ".grid.bin";
+}
+
+void Mosaicing::saveIter(uint32_t id, const CvGridMap::Ptr &map_update, const cv::Rect2d &roi_update)
+{
+  if (m_settings_save.save_ortho_gtiff_all && m_gdal_writer != nullptr)
+  {
+    // The new frame may change the global map anywhere in its footprint, not only in the blended overlap
+    if (m_settings_save.update_ortho_gtiff_all && !m_settings_save.split_gtiff_channels)
+      m_gdal_writer->requestUpdateGeoTIFF(std::make_shared<CvGridMap>(m_global_map->getSubmap({"color_rgb"}, roi_update)), m_utm_reference->zone, m_stage_path + "/ortho/ortho_iter.tif", true);
+    else
+      m_gdal_writer->requestSaveGeoTIFF(std::make_shared<CvGridMap>(m_global_map->getSubmap({"color_rgb"})), m_utm_reference->zone, m_stage_path + "/ortho/ortho_iter.tif", true, m_settings_save.split_gtiff_channels);
+  }
+
+  // Colour mapped layers with the file prefix of their previews
+  std::vector<std::string> layer_names;
+  std::vector<std::string> prefixes;
   if (m_settings_save.save_elevation_all)
-    io::saveImageColorMap((*m_global_map)["elevation"], valid, m_stage_path + "/elevation/color_map", "elevation", id, io::ColormapType::ELEVATION);
+  {
+    layer_names.emplace_back("elevation");
+    prefixes.emplace_back(m_stage_path + "/elevation/color_map/elevation_");
+  }
   if (m_settings_save.save_elevation_var_all)
-    io::saveImageColorMap((*m_global_map)["elevation_var"], valid, m_stage_path + "/variance", "variance", id, io::ColormapType::ELEVATION);
+  {
+    layer_names.emplace_back("elevation_var");
+    prefixes.emplace_back(m_stage_path + "/variance/variance_");
+  }
   if (m_settings_save.save_elevation_obs_angle_all)
-    io::saveImageColorMap((*m_global_map)["elevation_angle"], valid, m_stage_path + "/obs_angle", "angle", id, io::ColormapType::ELEVATION);
+  {
+    layer_names.emplace_back("elevation_angle");
+    prefixes.emplace_back(m_stage_path + "/obs_angle/angle_");
+  }
   if (m_settings_save.save_num_obs_all)
-    io::saveImageColorMap((*m_global_map)["num_observations"], valid, m_stage_path + "/nobs", "nobs", id, io::ColormapType::NUM_OBS);
-  if (m_settings_save.save_ortho_gtiff_all && m_gdal_writer != nullptr)
-    m_gdal_writer->requestSaveGeoTIFF(std::make_shared<CvGridMap>(m_global_map->getSubmap({"color_rgb"})), m_utm_reference->zone, m_stage_path + "/ortho/ortho_iter.tif", true, m_settings_save.split_gtiff_channels);
+  {
+    layer_names.emplace_back("num_observations");
+    prefixes.emplace_back(m_stage_path + "/nobs/nobs_");
+  }
+  if (layer_names.empty() && !m_settings_save.save_ortho_rgb_all)
+    return;
+
+  // Previews are maintained here, so the cost of colour mapping is proportional to the update. Images are encoded by
+  // the export service, which gets a copy of them, as they are updated with the next frame.
+  std::vector<cv::Mat> previews;
+  if (!layer_names.empty())
+  {
+    updatePreviews(layer_names, roi_update);
+    for (const auto &layer_name : layer_names)
+      previews.push_back((*m_previews)[layer_name + "_colored"].clone());
+  }
+
+  // The chunked global map is locked per chunk, so the export extracts the orthophoto itself while the next frames are
+  // blended. Regions blended meanwhile may then already contain data of the following frames. All other layouts are
+  // copied here, as the global map changes with the next frame.
+  ChunkedGridMap::Ptr global_map_chunked;
+  cv::Mat ortho_copied;
+  if (m_settings_save.save_ortho_rgb_all)
+  {
+    if (m_global_map_chunked != nullptr)
+      global_map_chunked = m_global_map_chunked;
+    else
+      ortho_copied = (*m_global_map)["color_rgb"].clone();
+  }
 
-    //io::saveGeoTIFF(*map_update, "color_rgb", _utm_reference->zone, io::createFilename(_stage_path + "/ortho/ortho_", id, ".tif"));
+  std::string stage_path = m_stage_path;
+  submitExport([previews, prefixes, ortho_copied, global_map_chunked, stage_path, id]()
+  {
+    if (global_map_chunked != nullptr)
+      io::saveImage(global_map_chunked->getGridMap({"color_rgb"})["color_rgb"], io::createFilename(stage_path + "/ortho/ortho_", id, ".png"));
+    else if (!ortho_copied.empty())
+      io::saveImage(ortho_copied, io::createFilename(stage_path + "/ortho/ortho_", id, ".png"));
+
+    for (size_t i = 0; i < previews.size(); ++i)
+      io::saveImage(previews[i], io::createFilename(prefixes[i], id, ".png"));
+  });
+}
+
+void Mosaicing::updatePreviews(const std::vector<std::string> &layer_names, const cv::Rect2d &roi_update)
+{
+  cv::Rect2d roi_global = (m_global_map_chunked != nullptr ? m_global_map_chunked->roi() : m_global_map->roi());
+  double resolution = getGlobalResolution();
+
+  // Previews follow the geometry of the global map, cells added by its extension are black and invalid until updated
+  if (m_previews == nullptr || std::fabs(m_previews->resolution() - resolution) > 10e-6)
+    m_previews = std::make_shared<CvGridMap>(roi_global, resolution);
+  else if (m_previews->roi() != roi_global)
+    m_previews->extendToInclude(roi_global);
+
+  cv::Size2i size_global(static_cast<int>(std::round(roi_global.width / resolution)) + 1,
+                         static_cast<int>(std::round(roi_global.height / resolution)) + 1);
+  if (m_previews->size() != size_global)
+  {
+    LOG_F(WARNING, "Previews do not match the geometry of the global map, they are recreated.");
+    m_previews = std::make_shared<CvGridMap>(roi_global, resolution);
+  }
+  if (!m_previews->exists("valid"))
+    m_previews->add("valid", cv::Mat::zeros(m_previews->size(), CV_8UC1), cv::INTER_NEAREST);
+
+  cv::Rect2d roi = (roi_update & roi_global);
+  if (roi.area() < 10e-6)
+    return;
+
+  // Only the region of the update is extracted from the global map. The value range of every layer is checked first,
+  // layers that exceed it or are new are colour mapped completely afterwards.
+  CvGridMap region = getGlobalMapRegion(roi);
+  cv::Rect2i roi_idx = m_previews->atIndexROI(region.roi());
+  if (roi_idx.size() != region.size())
+    throw(std::runtime_error("Error updating previews: Region of the update does not match the previews."));
+
+  const cv::Mat &elevation = region["elevation"];
+  cv::Mat valid = (elevation == elevation);
+  valid.copyTo((*m_previews)["valid"](roi_idx));
+
+  std::vector<std::string> layer_names_complete;
+  for (const auto &layer_name : layer_names)
+  {
+    if (!region.exists(layer_name))
+      continue;
+
+    double value_min, value_max;
+    cv::minMaxLoc(region[layer_name], &value_min, &value_max, nullptr, nullptr, valid);
+
+    auto it = m_preview_ranges.find(layer_name);
+    bool is_new = !m_previews->exists(layer_name + "_colored") || it == m_preview_ranges.end();
+    if (!is_new && value_min >= it->second.first && value_max <= it->second.second)
+    {
+      cv::Mat colored = analysis::convertToColorMapFromCVC1(region[layer_name], valid, it->second.first, it->second.second, cv::COLORMAP_JET);
+      colored.copyTo((*m_previews)[layer_name + "_colored"](roi_idx));
+      continue;
+    }
+    layer_names_complete.push_back(layer_name);
+  }
+
+  if (layer_names_complete.empty())
+    return;
+
+  CvGridMap global_map = getGlobalMapRegion(roi_global);
+  const cv::Mat &elevation_global = global_map["elevation"];
+  cv::Mat valid_global = (elevation_global == elevation_global);
+  valid_global.copyTo((*m_previews)["valid"]);
+
+  for (const auto &layer_name : layer_names_complete)
+  {
+    const cv::Mat &data = global_map[layer_name];
+
+    double value_min, value_max;
+    cv::minMaxLoc(data, &value_min, &value_max, nullptr, nullptr, valid_global);
+    double margin = g_preview_range_margin * (value_max - value_min);
+    m_preview_ranges[layer_name] = std::make_pair(value_min - margin, value_max + margin);
+
+    cv::Mat colored = analysis::convertToColorMapFromCVC1(data, valid_global, value_min - margin, value_max + margin, cv::COLORMAP_JET);
+    m_previews->add(layer_name + "_colored", colored, cv::INTER_NEAREST);
+  }
 }
 
 void Mosaicing::saveAll()
@@ -223,6 +916,12 @@ void Mosaicing::saveAll()
   // Check NaN
   cv::Mat valid = ((*m_global_map)["elevation"] == (*m_global_map)["elevation"]);
 
+  // Fused elevation is only trusted, if it was observed often enough and the observations agree
+  if (m_fuse_elevation && m_th_elevation_min_nobs > 0)
+    valid &= ((*m_global_map)["num_observations"] >= m_th_elevation_min_nobs);
+  if (m_fuse_elevation && m_th_elevation_var > 0.0f && m_global_map->exists("elevation_var"))
+    valid &= ((*m_global_map)["elevation_var"] <= m_th_elevation_var);
+
   // 2D map output
   if (m_settings_save.save_ortho_rgb_one)
     io::saveCvGridMapLayer(*m_global_map, m_utm_reference->zone, m_utm_reference->band, "color_rgb", m_stage_path + "/ortho/ortho.png");
@@ -234,14 +933,41 @@ void Mosaicing::saveAll()
     io::saveImageColorMap((*m_global_map)["elevation_angle"], valid, m_stage_path + "/obs_angle", "angle", io::ColormapType::ELEVATION);
   if (m_settings_save.save_num_obs_one)
     io::saveImageColorMap((*m_global_map)["num_observations"], valid, m_stage_path + "/nobs", "nobs", io::ColormapType::ELEVATION);
+
+  // GeoTIFF output, layers are independent files and saved in parallel. Threads for compression are divided between them.
+  std::vector<std::function<void(int)>> exports_gtiff;
   if (m_settings_save.save_num_obs_one)
-    io::saveGeoTIFF(m_global_map->getSubmap({"num_observations"}), m_utm_reference->zone, m_stage_path + "/nobs/nobs.tif");
+    exports_gtiff.emplace_back([this](int nrof_threads){
+      io::saveGeoTIFF(m_global_map->getSubmap({"num_observations"}), m_utm_reference->zone, m_stage_path + "/nobs/nobs.tif", false, false, io::GDALProfile::COG, nrof_threads);
+    });
   if (m_settings_save.save_ortho_gtiff_one)
-    io::saveGeoTIFF(m_global_map->getSubmap({"color_rgb"}), m_utm_reference->zone, m_stage_path + "/ortho/ortho.tif", true, m_settings_save.split_gtiff_channels);
+    exports_gtiff.emplace_back([this](int nrof_threads){
+      io::saveGeoTIFF(m_global_map->getSubmap({"color_rgb"}), m_utm_reference->zone, m_stage_path + "/ortho/ortho.tif", true, m_settings_save.split_gtiff_channels, io::GDALProfile::COG, nrof_threads);
+    });
   if (m_settings_save.save_elevation_one)
-    io::saveGeoTIFF(m_global_map->getSubmap({"elevation"}), m_utm_reference->zone, m_stage_path + "/elevation/gtiff/elevation.tif");
+    exports_gtiff.emplace_back([this](int nrof_threads){
+      io::saveGeoTIFF(m_global_map->getSubmap({"elevation"}), m_utm_reference->zone, m_stage_path + "/elevation/gtiff/elevation.tif", false, false, io::GDALProfile::COG, nrof_threads);
+    });
   if (m_settings_save.save_elevation_obs_angle_one)
-    io::saveGeoTIFF(m_global_map->getSubmap({"elevation_angle"}), m_utm_reference->zone, m_stage_path + "/obs_angle/angle.tif");
+    exports_gtiff.emplace_back([this](int nrof_threads){
+      io::saveGeoTIFF(m_global_map->getSubmap({"elevation_angle"}), m_utm_reference->zone, m_stage_path + "/obs_angle/angle.tif", false, false, io::GDALProfile::COG, nrof_threads);
+    });
+
+  if (!exports_gtiff.empty())
+  {
+    int nrof_threads = (m_nrof_threads > 0 ? m_nrof_threads : static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u)));
+    int nrof_threads_export = std::max(nrof_threads / static_cast<int>(exports_gtiff.size()), 1);
+
+    std::vector<std::future<void>> futures;
+    for (const auto &export_gtiff : exports_gtiff)
+      futures.push_back(std::async(std::launch::async, export_gtiff, nrof_threads_export));
+
+    // Exports reference the global map, so all of them have to be finished before an error is rethrown
+    for (auto &future : futures)
+      future.wait();
+    for (auto &future : futures)
+      future.get();
+  }
 
   //io::MvsExport::saveFrames(m_frames, m_stage_path + "/mvs");
 
@@ -256,24 +982,42 @@ void Mosaicing::saveAll()
   }
 #endif
 
-  // 3D Mesh output
+  // 3D Mesh output, the global map is a regular raster, so no Delaunay triangulation is needed
+#if WITH_PCL
   if (m_settings_save.save_elevation_mesh_one)
   {
-    //std::vector<cv::Point2i> vertex_ids = _mesher->buildMesh(*_global_map, "valid");
-    //if (_global_map->exists("elevation_normal"))
-    //  io::saveElevationMeshToPLY(*_global_map, vertex_ids, "elevation", "elevation_normal", "color_rgb", "valid", _stage_path + "/elevation/mesh", "elevation");
-    //else
-    //  io::saveElevationMeshToPLY(*_global_map, vertex_ids, "elevation", "", "color_rgb", "valid", _stage_path + "/elevation/mesh", "elevation");
+    GridTriangulation triangulation(0, 0.0, m_nrof_threads, m_thread_pool);
+    std::vector<cv::Point2i> vertex_ids = triangulation.buildMesh(*m_global_map, "", "elevation");
+    if (m_global_map->exists("elevation_normal"))
+      io::saveElevationMeshToPLY(*m_global_map, vertex_ids, "elevation", "elevation_normal", "color_rgb", "valid", m_stage_path + "/elevation/mesh", "elevation");
+    else
+      io::saveElevationMeshToPLY(*m_global_map, vertex_ids, "elevation", "", "color_rgb", "valid", m_stage_path + "/elevation/mesh", "elevation");
   }
+#endif
+}
+
+double Mosaicing::getGlobalResolution() const
+{
+  if (m_global_map_chunked != nullptr)
+    return m_global_map_chunked->resolution();
+  if (m_global_map_packed != nullptr)
+    return m_global_map_packed->resolution();
+  if (m_global_map != nullptr)
+    return m_global_map->resolution();
+  return 0.0;
 }
 
 void Mosaicing::reset()
 {
+  m_frame_merger.clear();
   LOG_F(INFO, "Reseted!");
 }
 
 void Mosaicing::finishCallback()
 {
+  // Exports of the last iterations must not write to the files after the final results
+  waitForExports();
+
   // First polish results
   runPostProcessing();
 
@@ -283,30 +1027,115 @@ void Mosaicing::finishCallback()
     m_gdal_writer->join();
   }
 
-  // Trigger savings
+  // Trigger savings, chunked or packed global map was assembled only partially during processing
+  if (m_chunk_size > 0 || m_use_packed_layout)
+    assembleGlobalMap(true);
   saveAll();
 
   // Publish final mesh at the end
-  //if (m_do_publish_mesh_at_finish)
-  //  m_transport_mesh(createMeshFaces(m_global_map), "output/mesh");
+  if (m_do_publish_mesh_at_finish && m_transport_mesh)
+    m_transport_mesh(createMeshFaces(m_global_map), "output/mesh");
 }
 
 void Mosaicing::runPostProcessing()
 {
+  if (!m_do_post_process_replay || !m_frames || m_frames->size() == 0 || m_global_map == nullptr)
+    return;
+
+  LOG_F(INFO, "Post processing %lu frames, %lu of them restored from cold storage.", m_frames->size(), m_frames->getNrofCold());
+
+  ScopedTimer timer_replay("Replay Frames");
+  m_global_map = replayFrames();
+  timer_replay.stop();
+}
+
+CvGridMap::Ptr Mosaicing::replayFrames()
+{
+  // Rebuilt map starts empty with the geometry and layers of the current one
+  auto global_map = std::make_shared<CvGridMap>(m_global_map->roi(), m_global_map->resolution());
+  if (global_map->size() != m_global_map->size())
+    throw(std::runtime_error("Error replaying frames: Geometry of the global map could not be reproduced."));
+
+  std::vector<std::string> layer_names = m_global_map->getAllLayerNames();
+  for (const auto &layer_name : layer_names)
+  {
+    CvGridMap::Layer layer = m_global_map->getLayer(layer_name);
+    global_map->add(layer_name, CvGridMap::createEmptyData(global_map->size(), layer.data.type()), layer.interpolation);
+  }
+
+  // Regions are views into the rebuilt map, that do not share any cell, so they can be written concurrently
+  const cv::Size2i size = global_map->size();
+  const double resolution = global_map->resolution();
+  const cv::Rect2d roi = global_map->roi();
+  std::vector<CvGridMap> regions;
+  for (int r = 0; r < size.height; r += m_post_process_region_size)
+    for (int c = 0; c < size.width; c += m_post_process_region_size)
+    {
+      int width = std::min(m_post_process_region_size, size.width - c);
+      int height = std::min(m_post_process_region_size, size.height - r);
+      cv::Rect2d roi_region(roi.x + c * resolution,
+                            roi.y + roi.height - (r + height - 1) * resolution,
+                            (width - 1) * resolution,
+                            (height - 1) * resolution);
+      regions.push_back(global_map->getSubmapView(layer_names, roi_region));
+    }
+
+  // The CUDA backend blends one region at a time, the rows of every region are then blended on the device
+  int nrof_threads = (m_use_cuda ? 1 : m_nrof_threads);
 
+  const size_t nrof_frames = m_frames->size();
+  const size_t batch_size = static_cast<size_t>(std::max(m_nrof_frames_resident, 1));
+  for (size_t idx_batch = 0; idx_batch < nrof_frames; idx_batch += batch_size)
+  {
+    std::vector<CvGridMap::Ptr> maps;
+    for (size_t i = idx_batch; i < std::min(idx_batch + batch_size, nrof_frames); ++i)
+      maps.push_back(createObservedMap(m_frames->get(i), resolution, i == 0));
+
+    parallelFor(m_thread_pool, cv::Range(0, static_cast<int>(regions.size())), [&](const cv::Range &range)
+    {
+      for (int k = range.start; k < range.end; ++k)
+      {
+        CvGridMap &region = regions[k];
+        for (size_t i = 0; i < maps.size(); ++i)
+        {
+          const CvGridMap &map = *maps[i];
+          if ((region.roi() & map.roi()).area() < 10e-6)
+            continue;
+
+          // Same as the processing of the monolithic global map, which is initialized by the first frame without blending
+          region.add(map, REALM_OVERWRITE_ZERO, false);
+          if (idx_batch + i == 0)
+            continue;
+
+          CvGridMap::Overlap overlap = region.getOverlapView(map);
+          if (overlap.first != nullptr && overlap.second != nullptr)
+            blend(&overlap, false);
+        }
+      }
+    }, nrof_threads);
+  }
+
+  return global_map;
 }
 
 Frame::Ptr Mosaicing::getNewFrame()
 {
-  std::unique_lock<std::mutex> lock(m_mutex_buffer);
-  Frame::Ptr frame = m_buffer.front();
-  m_buffer.pop_front();
-  updateStatisticsProcessedFrame();
+  Frame::Ptr frame;
+  m_buffer.pop(frame);
+  updateStatisticsProcessedFrame(frame);
   return std::move(frame);
 }
 
 void Mosaicing::initStageCallback()
 {
+  if (m_do_keep_frames && m_frames_cold_storage == io::FrameColdStorage::FILE)
+  {
+    if (!io::dirExists(m_stage_path))
+      io::createDir(m_stage_path);
+    m_frames = std::make_shared<io::FrameStore>(static_cast<size_t>(m_nrof_frames_resident), io::FrameColdStorage::FILE,
+                                                m_stage_path + "/frames_cold.bin");
+  }
+
   // If we aren't saving any information, skip directory creation
   if (!(m_log_to_file || m_settings_save.save_required()))
   {
@@ -347,16 +1176,34 @@ void Mosaicing::printSettingsToLog()
   LOG_F(INFO, "- publish_mesh_nth_iter: %i", m_publish_mesh_nth_iter);
   LOG_F(INFO, "- publish_mesh_every_nth_kf: %i", m_publish_mesh_every_nth_kf);
   LOG_F(INFO, "- do_publish_mesh_at_finish: %i", m_do_publish_mesh_at_finish);
+  LOG_F(INFO, "- publish_full_every_nth: %i", m_publish_full_every_nth);
   LOG_F(INFO, "- downsample_publish_mesh: %4.2f", m_downsample_publish_mesh);
+  LOG_F(INFO, "- mesh_tile_size: %4.2f", m_mesh_tile_size);
   LOG_F(INFO, "- use_surface_normals: %i", m_use_surface_normals);
   LOG_F(INFO, "- th_elevation_min_nobs: %i", m_th_elevation_min_nobs);
   LOG_F(INFO, "- th_elevation_var: %4.2f", m_th_elevation_var);
+  LOG_F(INFO, "- fuse_elevation: %i", m_fuse_elevation);
+  LOG_F(INFO, "- chunk_size: %i", m_chunk_size);
+  LOG_F(INFO, "- use_packed_layout: %i", m_use_packed_layout);
+  LOG_F(INFO, "- use_cuda: %i", m_use_cuda);
+  LOG_F(INFO, "- merge_max_delay: %i", m_merge_max_delay);
+  LOG_F(INFO, "- nrof_threads: %i", m_nrof_threads);
+  LOG_F(INFO, "- checkpoint_directory: %s", (m_checkpoint_store ? m_checkpoint_store->getDirectory().c_str() : ""));
+  LOG_F(INFO, "- checkpoint_every_nth: %i", m_checkpoint_every_nth);
+  LOG_F(INFO, "- resume_from_checkpoint: %i", m_do_resume_from_checkpoint);
+  LOG_F(INFO, "- keep_frames: %i", m_do_keep_frames);
+  LOG_F(INFO, "- frames_resident: %i", m_nrof_frames_resident);
+  LOG_F(INFO, "- frames_cold_storage: %s", (m_frames_cold_storage == io::FrameColdStorage::FILE ? "file" : "memory"));
+  LOG_F(INFO, "- post_process_replay: %i", m_do_post_process_replay);
+  LOG_F(INFO, "- post_process_region_size: %i", m_post_process_region_size);
+  LOG_F(INFO, "- forward_blended: %i", m_do_forward_blended);
 
   LOG_F(INFO, "### Stage save settings ###");
   LOG_F(INFO, "- save_ortho_rgb_one: %i", m_settings_save.save_ortho_rgb_one);
   LOG_F(INFO, "- save_ortho_rgb_all: %i", m_settings_save.save_ortho_rgb_all);
   LOG_F(INFO, "- save_ortho_gtiff_one: %i", m_settings_save.save_ortho_gtiff_one);
   LOG_F(INFO, "- save_ortho_gtiff_all: %i", m_settings_save.save_ortho_gtiff_all);
+  LOG_F(INFO, "- update_ortho_gtiff_all: %i", m_settings_save.update_ortho_gtiff_all);
   LOG_F(INFO, "- save_elevation_one: %i", m_settings_save.save_elevation_one);
   LOG_F(INFO, "- save_elevation_all: %i", m_settings_save.save_elevation_all);
   LOG_F(INFO, "- save_elevation_var_one: %i", m_settings_save.save_elevation_var_one);
@@ -373,72 +1220,101 @@ uint32_t Mosaicing::getQueueDepth() {
   return m_buffer.size();
 }
 
+size_t Mosaicing::getMemoryUsage()
+{
+  size_t bytes = 0;
+  if (m_global_map)
+    bytes += m_global_map->getByteSize();
+  if (m_global_map_chunked)
+    bytes += m_global_map_chunked->getByteSize();
+  if (m_global_map_packed)
+    bytes += m_global_map_packed->getByteSize();
+  if (m_frames)
+    bytes += m_frames->getByteSize();
+  return bytes;
+}
+
 std::vector<Face> Mosaicing::createMeshFaces(const CvGridMap::Ptr &map)
 {
-  CvGridMap::Ptr mesh_sampled;
-  if (m_downsample_publish_mesh > 10e-6)
+  if (!map || !map->exists("elevation") || !map->exists("color_rgb"))
   {
-    if (map && map->exists("elevation") && map->exists("color_rgb")) {
-
-      // Downsampling was set by the user in settings
-      LOG_F(INFO, "Downsampling mesh publish to %4.2f [m/gridcell]...", m_downsample_publish_mesh);
-      mesh_sampled = std::make_shared<CvGridMap>(map->cloneSubmap({"elevation", "color_rgb"}));
-
-      cv::Mat valid = ((*mesh_sampled)["elevation"] == (*mesh_sampled)["elevation"]);
-
-      // TODO: Change resolution correction is not cool -> same in ortho rectification
-      // Check ranges of input elevation, this is necessary to correct resizing interpolation errors
-      double ele_min, ele_max;
-      cv::Point2i min_loc, max_loc;
-      cv::minMaxLoc((*mesh_sampled)["elevation"], &ele_min, &ele_max, &min_loc, &max_loc, valid);
+    LOG_F(WARNING, "Could not create mesh, no global map existed.");
+    return std::vector<Face>();
+  }
 
-      mesh_sampled->changeResolution(m_downsample_publish_mesh);
+  // Tiles that did not change since the last publish are taken from the cache
+  m_mesher->update(getMeshMap(map), "elevation", "color_rgb", map->roi());
+  return m_mesher->getFaces();
+}
 
-      // After resizing through bilinear interpolation there can occure bad elevation values at the border
-      cv::Mat mask_low = ((*mesh_sampled)["elevation"] < ele_min);
-      cv::Mat mask_high = ((*mesh_sampled)["elevation"] > ele_max);
-      (*mesh_sampled)["elevation"].setTo(std::numeric_limits<float>::quiet_NaN(), mask_low);
-      (*mesh_sampled)["elevation"].setTo(std::numeric_limits<float>::quiet_NaN(), mask_high);
-    }
-    else
-    {
-      LOG_F(WARNING, "Could not publish downsampled mesh, no global map existed.");
-    }
-  }
-  else
-  {
-    LOG_F(INFO, "No downsampling of mesh publish...");
-    // No downsampling was set
-    mesh_sampled = map;
-  }
+const CvGridMap& Mosaicing::getMeshMap(const CvGridMap::Ptr &map)
+{
+  if (m_downsample_publish_mesh < 10e-6 || m_downsample_publish_mesh <= map->resolution())
+    return *map;
 
-  //std::vector<cv::Point2i> vertex_ids = _mesher->buildMesh(*mesh_sampled, "valid");
-  //std::vector<Face> faces = cvtToMesh((*mesh_sampled), "elevation", "color_rgb", vertex_ids);
-  //return faces;
-  // Placeholder return, there are a few calls that try to use this
-  return std::vector<Face>();
+  // The monolithic global map keeps its overviews between publishes, so only regions changed since are resampled
+  auto nrof_levels = static_cast<int>(std::floor(std::log2(m_downsample_publish_mesh / map->resolution()) + 10e-6));
+  map->setNumberOfOverviews(nrof_levels);
+  return map->getOverview(map->findOverviewLevel(m_downsample_publish_mesh));
 }
 
 void Mosaicing::publish(const Frame::Ptr &frame, const CvGridMap::Ptr &map, const CvGridMap::Ptr &update, uint64_t timestamp)
 {
-  cv::Mat valid = ((*m_global_map)["elevation"] == (*m_global_map)["elevation"]);
-
   // First update statistics about outgoing frame rate
-  updateStatisticsOutgoing();
-
-  m_transport_img((*m_global_map)["color_rgb"], "output/rgb");
-  m_transport_img(analysis::convertToColorMapFromCVC1((*m_global_map)["elevation"],
-                                                      valid,
-                                                      cv::COLORMAP_JET), "output/elevation");
-  m_transport_cvgridmap(m_global_map->getSubmap({"color_rgb"}), m_utm_reference->zone, m_utm_reference->band, "output/full/ortho");
-  m_transport_cvgridmap(update->getSubmap({"color_rgb"}), m_utm_reference->zone, m_utm_reference->band, "output/update/ortho");
+  updateStatisticsOutgoing(frame);
+
+  m_map_version++;
+
+  // With a delta transport only the updated region is published, receivers reconstruct the global map from it. The
+  // full map is only published occasionally for receivers that subscribed late or missed an update.
+  const bool is_delta = static_cast<bool>(m_transport_cvgridmap_delta);
+  const bool is_full = !is_delta || (m_publish_full_every_nth > 0 && m_map_version % m_publish_full_every_nth == 0);
+
+  if (is_full)
+  {
+    cv::Mat valid = ((*m_global_map)["elevation"] == (*m_global_map)["elevation"]);
+
+    m_transport_img((*m_global_map)["color_rgb"], "output/rgb");
+    m_transport_img(analysis::convertToColorMapFromCVC1((*m_global_map)["elevation"],
+                                                        valid,
+                                                        cv::COLORMAP_JET), "output/elevation");
+    if (is_delta)
+      m_transport_cvgridmap_delta(m_global_map->getSubmap({"color_rgb"}), m_map_version, m_utm_reference->zone, m_utm_reference->band, "output/full/ortho");
+    else
+      m_transport_cvgridmap(m_global_map->getSubmap({"color_rgb"}), m_utm_reference->zone, m_utm_reference->band, "output/full/ortho");
+  }
+
+  if (is_delta)
+    m_transport_cvgridmap_delta(update->getSubmap({"color_rgb"}), m_map_version, m_utm_reference->zone, m_utm_reference->band, "output/update/ortho");
+  else
+    m_transport_cvgridmap(update->getSubmap({"color_rgb"}), m_utm_reference->zone, m_utm_reference->band, "output/update/ortho");
   //_transport_cvgridmap(update->getSubmap({"elevation", "valid"}), _utm_reference->zone, _utm_reference->band, "output/update/elevation");
 
+  if (m_publish_mesh_every_nth_kf > 0)
+    m_roi_mesh_update = (m_roi_mesh_update.area() > 0.0 ? (m_roi_mesh_update | update->roi()) : update->roi());
+
   if (m_publish_mesh_every_nth_kf > 0 && m_publish_mesh_every_nth_kf == m_publish_mesh_nth_iter)
   {
-    std::vector<Face> faces = createMeshFaces(map);
-    std::thread t(m_transport_mesh, faces, "output/mesh");
-    t.detach();
+    // Only tiles touching the map updates since the last publish are re-triangulated
+    ScopedTimer timer_mesh("Mesh Update");
+    std::vector<MeshTile> tiles = m_mesher->update(getMeshMap(map), "elevation", "color_rgb", m_roi_mesh_update);
+    timer_mesh.stop();
+    m_roi_mesh_update = cv::Rect2d();
+
+    // Receivers of the tiles replace the changed ones, all others get the complete mesh from the cache
+    if (m_transport_mesh_tiles)
+    {
+      if (!tiles.empty())
+      {
+        std::thread t(m_transport_mesh_tiles, tiles, "output/mesh/update");
+        t.detach();
+      }
+    }
+    else
+    {
+      std::thread t(m_transport_mesh, m_mesher->getFaces(), "output/mesh");
+      t.detach();
+    }
     m_publish_mesh_nth_iter = 0;
   }
   else if (m_publish_mesh_every_nth_kf > 0)
@@ -1,6 +1,12 @@
 
 
+#include <cmath>
+#include <numeric>
+
+#include <realm_core/log_macros.h>
 #include <realm_core/loguru.h>
+#include <realm_core/scoped_timer.h>
+#include <realm_ortho/cuda_backend.h>
 
 #include <realm_stages/ortho_rectification.h>
 
@@ -10,14 +16,57 @@ using namespace stages;
 OrthoRectification::OrthoRectification(const StageSettings::Ptr &stage_set, double rate)
     : StageBase("ortho_rectification", (*stage_set)["path_output"].toString(), rate, (*stage_set)["queue_size"].toInt(), bool((*stage_set)["log_to_file"].toInt())),
       m_do_publish_pointcloud((*stage_set)["publish_pointcloud"].toInt() > 0),
+      m_pointcloud_stride(std::max((*stage_set)["pointcloud_stride"].toInt(), 1)),
+      m_pointcloud_max_points(std::max((*stage_set)["pointcloud_max_points"].toInt(), 0)),
+      m_nrof_threads((*stage_set)["nrof_threads"].toInt()),
+      m_interpolation(cv::INTER_NEAREST),
+      m_use_cuda((*stage_set)["use_cuda"].toInt() > 0),
+      m_use_pinned_memory((*stage_set)["use_pinned_memory"].toInt() > 0),
+      m_frames_in_flight((*stage_set)["frames_in_flight"].toInt()),
       m_GSD((*stage_set)["GSD"].toDouble()),
+      m_gsd_factor(1.0),
+      m_use_gsd_auto((*stage_set)["gsd_auto"].toInt() > 0),
+      m_gsd_auto_max((*stage_set)["gsd_auto_max"].toDouble()),
+      m_map_tiler(std::make_shared<MapTiler>(false)),
       m_settings_save({(*stage_set)["save_ortho_rgb"].toInt() > 0,
                   (*stage_set)["save_ortho_gtiff"].toInt() > 0,
                   (*stage_set)["save_elevation"].toInt() > 0,
-                  (*stage_set)["save_elevation_angle"].toInt() > 0})
+                  (*stage_set)["save_elevation_angle"].toInt() > 0}),
+      m_mat_pool(MatPool::get("ortho_rectification")),
+      m_buffer(static_cast<size_t>(std::max(m_queue_size, 1)))
 {
   std::cout << "Stage [" << m_stage_name << "]: Created Stage with Settings: " << std::endl;
   stage_set->print();
+  setThreadScheduling(readThreadScheduling(*stage_set, "thread"));
+
+  std::string interpolation = (*stage_set)["interpolation"].toString();
+  if (interpolation == "NEAREST")
+    m_interpolation = cv::INTER_NEAREST;
+  else if (interpolation == "LINEAR")
+    m_interpolation = cv::INTER_LINEAR;
+  else if (interpolation == "CUBIC")
+    m_interpolation = cv::INTER_CUBIC;
+  else
+    throw(std::invalid_argument("Error: Interpolation '" + interpolation + "' for rectification not supported."));
+
+  if (m_use_cuda && !ortho::cuda::isAvailable())
+  {
+    LOG_F(WARNING, "CUDA is not available, rectification is processed on the CPU.");
+    m_use_cuda = false;
+  }
+  if (m_use_cuda && !ortho::cuda::isInterpolationSupported(m_interpolation))
+    LOG_F(WARNING, "Interpolation '%s' is not supported on the GPU, rectification is processed on the CPU.", interpolation.c_str());
+
+  // Frame images are allocated by the loaders from the pool of the frames, so this has to be set before the first frame
+  // arrives. The images already allocated stay in pageable memory.
+  m_use_pinned_memory = m_use_pinned_memory && m_use_cuda;
+  if (m_use_pinned_memory && !(Frame::getImagePool()->setMemory(MatPool::Memory::PINNED)
+                               && m_mat_pool->setMemory(MatPool::Memory::PINNED)))
+  {
+    LOG_F(WARNING, "Pinned memory is not available, frame images and rectified layers are allocated regularly.");
+    Frame::getImagePool()->setMemory(MatPool::Memory::PAGEABLE);
+    m_use_pinned_memory = false;
+  }
 
   registerAsyncDataReadyFunctor([=]{ return !m_buffer.empty(); });
 }
@@ -25,7 +74,7 @@ OrthoRectification::OrthoRectification(const StageSettings::Ptr &stage_set, doub
 void OrthoRectification::addFrame(const Frame::Ptr &frame)
 {
   // First update statistics about incoming frame rate
-  updateStatisticsIncoming();
+  updateStatisticsIncoming(frame);
 
   if (!frame->getSurfaceModel())
   {
@@ -39,14 +88,9 @@ void OrthoRectification::addFrame(const Frame::Ptr &frame)
     updateStatisticsBadFrame();
     return;
   }
-  std::unique_lock<std::mutex> lock(m_mutex_buffer);
-  m_buffer.push_back(frame);
-  // Ringbuffer implementation for buffer with no pose
-  if (m_buffer.size() > m_queue_size)
-  {
-    m_buffer.pop_front();
+  // Ringbuffer drops the oldest or the incoming frame if full, depending on their score
+  if (!m_buffer.push(frame, scoreFrame(frame)))
     updateStatisticsSkippedFrame();
-  }
   notify();
 }
 
@@ -55,57 +99,125 @@ bool OrthoRectification::process()
   bool has_processed = false;
   if (!m_buffer.empty())
   {
-    // Prepare timing
-    long t;
+    // Frames are independent of each other, so several of them can be rectified at the same time
+    std::vector<Frame::Ptr> frames;
+    while (!m_buffer.empty() && frames.size() < static_cast<size_t>(std::max(m_frames_in_flight, 1)))
+      frames.push_back(getNewFrame());
+
+    processFramesInFlight(frames,
+        [this](const Frame::Ptr &frame){ rectifyFrame(frame); },
+        [this](const Frame::Ptr &frame)
+        {
+          // Following stages only need the surface model and orthophoto
+          if (isMemoryBudgetExceeded())
+            frame->releaseImage();
+
+          // Transport results
+          ScopedTimer timer_publish("Publish");
+          publish(frame);
+          timer_publish.stop();
+
+          // Savings every iteration
+          ScopedTimer timer_saving("Saving");
+          saveIter(*frame->getSurfaceModel(), *frame->getOrthophoto(), frame->getGnssUtm().zone, frame->getGnssUtm().band, frame->getFrameId());
+          timer_saving.stop();
+        });
 
-    Frame::Ptr frame = getNewFrame();
-    LOG_F(INFO, "Processing frame #%u...", frame->getFrameId());
+    has_processed = true;
+  }
+  return has_processed;
+}
 
-    // Make deep copy of the surface model, so we can resize it later on
-    CvGridMap::Ptr surface_model = frame->getSurfaceModel();
+void OrthoRectification::rectifyFrame(const Frame::Ptr &frame)
+{
+  LOG_FRAME_F(INFO, "Processing frame #%u...", frame->getFrameId());
 
-    double resize_quotient = surface_model->resolution() / m_GSD;
-    LOG_F(INFO, "Resize quotient rq = (elevation.resolution() / GSD) = %4.2f", resize_quotient);
-    LOG_IF_F(INFO, resize_quotient < 0.9, "Loss of resolution! Consider downsizing depth map or increase GSD.");
-    LOG_IF_F(INFO, resize_quotient > 1.1, "Large resizing of elevation map detected. Keep in mind that ortho resolution is now >> spatial resolution");
+  // Make deep copy of the surface model, so we can resize it later on
+  CvGridMap::Ptr surface_model = frame->getSurfaceModel();
 
-    // First change resolution of observed map to desired GSD
-    t = getCurrentTimeMilliseconds();
-    surface_model->changeResolution(m_GSD);
-    LOG_F(INFO, "Timing [Resizing]: %lu ms", getCurrentTimeMilliseconds()-t);
+  // Rectifying at a coarser GSD is cheaper, the result is resampled to the GSD of the frame afterwards
+  double gsd_frame = computeGSD(frame);
+  double gsd_factor = m_gsd_factor;
+  double gsd = gsd_frame * gsd_factor;
 
-    // Rectification needs img data, surface map and camera pose -> All contained in frame
-    // Output, therefore the new additional data is written into rectified map
-    t = getCurrentTimeMilliseconds();
-    CvGridMap::Ptr map_rectified = ortho::rectify(frame);
-    LOG_F(INFO, "Timing [Rectify]: %lu ms", getCurrentTimeMilliseconds()-t);
+  double resize_quotient = surface_model->resolution() / gsd;
+  LOG_F(INFO, "Resize quotient rq = (elevation.resolution() / GSD) = %4.2f", resize_quotient);
+  LOG_IF_F(INFO, resize_quotient < 0.9, "Loss of resolution! Consider downsizing depth map or increase GSD.");
+  LOG_IF_F(INFO, resize_quotient > 1.1, "Large resizing of elevation map detected. Keep in mind that ortho resolution is now >> spatial resolution");
 
-    // The orthophoto is contained in the rectified output. However, there is plenty of other data that is better stored
-    // inside the digital surface model
-    t = getCurrentTimeMilliseconds();
+  // First change resolution of observed map to desired GSD
+  ScopedTimer timer_resizing("Resizing");
+  surface_model->changeResolution(gsd);
+  timer_resizing.stop();
 
-    CvGridMap::Ptr orthophoto = std::make_shared<CvGridMap>(map_rectified->getSubmap({"color_rgb"}));
-    frame->setOrthophoto(orthophoto);
+  // Rectification needs img data, surface map and camera pose -> All contained in frame
+  // Output, therefore the new additional data is written into rectified map
+  ScopedTimer timer_rectify("Rectify");
+  CvGridMap::Ptr map_rectified = ortho::rectify(frame, m_nrof_threads, m_interpolation, m_thread_pool, m_mat_pool, m_use_cuda);
+  timer_rectify.stop();
 
-    surface_model->add("elevation_angle", (*map_rectified)["elevation_angle"]);
-    surface_model->add("elevated", (*map_rectified)["elevated"]);
-    surface_model->add("num_observations", (*map_rectified)["num_observations"]);
+  if (gsd_factor > 1.0)
+  {
+    ScopedTimer timer_resampling("Resampling");
+    surface_model->changeResolution(gsd_frame);
+    map_rectified->changeResolution(gsd_frame);
+  }
 
-    LOG_F(INFO, "Timing [Adding]: %lu ms", getCurrentTimeMilliseconds()-t);
+  // The orthophoto is contained in the rectified output. However, there is plenty of other data that is better stored
+  // inside the digital surface model
+  ScopedTimer timer_adding("Adding");
 
-    // Transport results
-    t = getCurrentTimeMilliseconds();
-    publish(frame);
-    LOG_F(INFO, "Timing [Publish]: %lu ms", getCurrentTimeMilliseconds()-t);
+  CvGridMap::Ptr orthophoto = std::make_shared<CvGridMap>(map_rectified->getSubmap({"color_rgb"}));
+  frame->setOrthophoto(orthophoto);
 
-    // Savings every iteration
-    t = getCurrentTimeMilliseconds();
-    saveIter(*surface_model, *orthophoto, frame->getGnssUtm().zone, frame->getGnssUtm().band, frame->getFrameId());
-    LOG_F(INFO, "Timing [Saving]: %lu ms", getCurrentTimeMilliseconds()-t);
+  surface_model->add("elevation_angle", (*map_rectified)["elevation_angle"]);
+  surface_model->add("elevated", (*map_rectified)["elevated"]);
+  surface_model->add("num_observations", (*map_rectified)["num_observations"]);
 
-    has_processed = true;
+  timer_adding.stop();
+}
+
+double OrthoRectification::computeGSD(const Frame::Ptr &frame) const
+{
+  if (!m_use_gsd_auto)
+    return m_GSD;
+
+  if (!frame->isDepthComputed())
+  {
+    LOG_F(WARNING, "Scene depth of frame #%u is unknown, using the fixed GSD.", frame->getFrameId());
+    return (m_GSD > 0.0 ? m_GSD : frame->getSurfaceModel()->resolution());
   }
-  return has_processed;
+
+  // Footprint of one pixel at the median scene depth, the image is rectified in full resolution
+  double gsd = frame->getMedianSceneDepth() / frame->getCamera()->fx();
+  gsd = std::max(gsd, m_GSD);
+  if (m_gsd_auto_max > 0.0)
+    gsd = std::min(gsd, m_gsd_auto_max);
+
+  // The next finer resolution of the pyramid is the zoom level the tiles are resampled to anyway, so no detail is lost
+  int zoom_level = m_map_tiler->computeZoomForPixelSize(gsd, true);
+  double gsd_zoom = m_map_tiler->getResolution(zoom_level);
+  LOG_F(INFO, "Ground sampling of frame #%u is %4.3f m/px, using GSD %4.3f m/px of zoom level %i.",
+        frame->getFrameId(), gsd, gsd_zoom, zoom_level);
+  return gsd_zoom;
+}
+
+bool OrthoRectification::changeParam(const std::string &name, const std::string &val)
+{
+  if (name == "gsd_factor")
+  {
+    try
+    {
+      m_gsd_factor = std::max(std::stod(val), 1.0);
+    }
+    catch (const std::logic_error &)
+    {
+      return false;
+    }
+    LOG_F(INFO, "Rectifying with %4.2f times the GSD.", m_gsd_factor.load());
+    return true;
+  }
+  return false;
 }
 
 void OrthoRectification::reset()
@@ -115,58 +227,131 @@ void OrthoRectification::reset()
 
 void OrthoRectification::saveIter(const CvGridMap& surface_model, const CvGridMap &orthophoto, uint8_t zone, char band, uint32_t id)
 {
-  // check for NaN
-  cv::Mat valid = (surface_model["elevation"] == surface_model["elevation"]);
+  if (!(m_settings_save.save_ortho_rgb || m_settings_save.save_elevation_angle || m_settings_save.save_ortho_gtiff
+        || m_settings_save.save_elevation))
+    return;
 
-  if (m_settings_save.save_ortho_rgb)
-    io::saveCvGridMapLayer(orthophoto, zone, band, "color_rgb", io::createFilename(m_stage_path + "/ortho/ortho_", id, ".png"));
+  // Following stages may modify the maps of the frame, so the export service gets a snapshot
+  std::vector<std::string> layer_names{"elevation"};
   if (m_settings_save.save_elevation_angle)
-    io::saveImageColorMap(surface_model["elevation_angle"], valid, m_stage_path + "/angle", "angle", id, io::ColormapType::ELEVATION);
-  if (m_settings_save.save_ortho_gtiff)
-    io::saveGeoTIFF(orthophoto.getSubmap({"color_rgb"}), zone, io::createFilename(m_stage_path + "/gtiff/gtiff_", id, ".tif"));
-  if (m_settings_save.save_elevation)
-    io::saveGeoTIFF(surface_model.getSubmap({"elevation"}), zone, io::createFilename(m_stage_path + "/elevation/elevation_", id, ".tif"));
+    layer_names.emplace_back("elevation_angle");
+  auto surface_snapshot = std::make_shared<CvGridMap>(surface_model.getSubmap(layer_names).clone());
+  auto ortho_snapshot = std::make_shared<CvGridMap>(orthophoto.getSubmap({"color_rgb"}).clone());
+
+  SaveSettings settings_save = m_settings_save;
+  std::string stage_path = m_stage_path;
+  submitExport([surface_snapshot, ortho_snapshot, settings_save, stage_path, zone, band, id]()
+  {
+    // check for NaN
+    cv::Mat valid = ((*surface_snapshot)["elevation"] == (*surface_snapshot)["elevation"]);
+
+    if (settings_save.save_ortho_rgb)
+      io::saveCvGridMapLayer(*ortho_snapshot, zone, band, "color_rgb", io::createFilename(stage_path + "/ortho/ortho_", id, ".png"));
+    if (settings_save.save_elevation_angle)
+      io::saveImageColorMap((*surface_snapshot)["elevation_angle"], valid, stage_path + "/angle", "angle", id, io::ColormapType::ELEVATION);
+    if (settings_save.save_ortho_gtiff)
+      io::saveGeoTIFF(*ortho_snapshot, zone, io::createFilename(stage_path + "/gtiff/gtiff_", id, ".tif"));
+    if (settings_save.save_elevation)
+      io::saveGeoTIFF(surface_snapshot->getSubmap({"elevation"}), zone, io::createFilename(stage_path + "/elevation/elevation_", id, ".tif"));
+  });
 }
 
 void OrthoRectification::publish(const Frame::Ptr &frame)
 {
   // First update statistics about outgoing frame rate
-  updateStatisticsOutgoing();
+  updateStatisticsOutgoing(frame);
 
   m_transport_frame(frame, "output/frame");
   m_transport_img((*frame->getOrthophoto())["color_rgb"], "output/rectified");
 
-  if (m_do_publish_pointcloud)
+  if (m_do_publish_pointcloud && m_transport_pointcloud)
+  {
+    ScopedTimer timer_pointcloud("Point Cloud");
+    PointCloud::Ptr point_cloud = createPointCloud(frame);
+    timer_pointcloud.stop();
+
+    if (!point_cloud->empty())
+      m_transport_pointcloud(point_cloud, "output/pointcloud");
+  }
+}
+
+PointCloud::Ptr OrthoRectification::createPointCloud(const Frame::Ptr &frame) const
+{
+  CvGridMap::Ptr surface_model = frame->getSurfaceModel();
+  CvGridMap::Ptr orthophoto = frame->getOrthophoto();
+
+  CvGridMap map(orthophoto->roi(), orthophoto->resolution());
+  map.addView(*surface_model);
+  map.addView(*orthophoto);
+
+  // Check for NaN
+  const cv::Mat &elevation = (*surface_model)["elevation"];
+  cv::Mat valid = (elevation == elevation);
+
+  // Valid elements on the grid of a stride, the stride is coarsened until the budget of points is met
+  auto count_sampled = [&](int stride)
+  {
+    int count = 0;
+    for (int r = 0; r < valid.rows; r += stride)
+    {
+      auto row = valid.ptr<uchar>(r);
+      for (int c = 0; c < valid.cols; c += stride)
+        count += (row[c] > 0);
+    }
+    return count;
+  };
+
+  int stride = m_pointcloud_stride;
+  if (m_pointcloud_max_points > 0)
+  {
+    // Number of points shrinks roughly with the square of the stride, which gives the first guess
+    int nrof_valid = cv::countNonZero(valid);
+    if (nrof_valid > m_pointcloud_max_points)
+      stride = std::max(stride, static_cast<int>(std::ceil(std::sqrt(static_cast<double>(nrof_valid) / m_pointcloud_max_points))));
+    while (stride < std::max(valid.rows, valid.cols) && count_sampled(stride) > m_pointcloud_max_points)
+      stride++;
+  }
+
+  cv::Mat mask = cv::Mat::zeros(valid.size(), CV_8UC1);
+  for (int r = 0; r < valid.rows; r += stride)
   {
-    CvGridMap::Ptr surface_model = frame->getSurfaceModel();
-    CvGridMap::Ptr orthophoto = frame->getOrthophoto();
-
-    CvGridMap map(orthophoto->roi(), orthophoto->resolution());
-    map.add(*surface_model, REALM_OVERWRITE_ALL, false);
-    map.add(*orthophoto, REALM_OVERWRITE_ALL, false);
-
-    // Check for NaN
-    cv::Mat valid = ((*surface_model)["elevation"] == (*surface_model)["elevation"]);
-
-    /*cv::Mat point_cloud;
-    if (frame->getSurfaceModel()->exists("elevation_normal"))
-      point_cloud = cvtToPointCloud(map, "elevation", "color_rgb", "elevation_normal", "valid");
-    else
-      point_cloud = cvtToPointCloud(map, "elevation", "color_rgb", "", "valid");
-    _transport_pointcloud(point_cloud, "output/pointcloud");*/
+    auto row_valid = valid.ptr<uchar>(r);
+    auto row_mask = mask.ptr<uchar>(r);
+    for (int c = 0; c < valid.cols; c += stride)
+      row_mask[c] = (row_valid[c] > 0 ? 255 : 0);
   }
+  map.add("valid", mask);
+
+  cv::Mat data;
+  if (map.exists("elevation_normal"))
+    data = cvtToPointCloud(map, "elevation", "color_rgb", "elevation_normal", "valid", m_thread_pool, m_nrof_threads);
+  else
+    data = cvtToPointCloud(map, "elevation", "color_rgb", "", "valid", m_thread_pool, m_nrof_threads);
+
+  if (data.empty())
+    return std::make_shared<PointCloud>();
+
+  std::vector<uint32_t> point_ids(static_cast<size_t>(data.rows));
+  std::iota(point_ids.begin(), point_ids.end(), 0u);
+  LOG_IF_F(INFO, stride > 1, "Point cloud published with stride %i, %i points.", stride, data.rows);
+  return std::make_shared<PointCloud>(point_ids, data);
 }
 
 
 Frame::Ptr OrthoRectification::getNewFrame()
 {
-  std::unique_lock<std::mutex> lock(m_mutex_buffer);
-  Frame::Ptr frame = m_buffer.front();
-  m_buffer.pop_front();
-  updateStatisticsProcessedFrame();
+  Frame::Ptr frame;
+  m_buffer.pop(frame);
+  updateStatisticsProcessedFrame(frame);
   return (std::move(frame));
 }
 
+void OrthoRectification::finishCallback()
+{
+  // Exports of the last iterations are finished, before the stage reports to be done
+  waitForExports();
+}
+
 void OrthoRectification::initStageCallback()
 {
   // If we aren't saving any information, skip directory creation
@@ -194,7 +379,17 @@ void OrthoRectification::printSettingsToLog()
 {
   LOG_F(INFO, "### Stage process settings ###");
   LOG_F(INFO, "- GSD: %4.2f", m_GSD);
+  LOG_F(INFO, "- gsd_factor: %4.2f", m_gsd_factor.load());
+  LOG_F(INFO, "- gsd_auto: %i", m_use_gsd_auto);
+  LOG_F(INFO, "- gsd_auto_max: %4.2f", m_gsd_auto_max);
   LOG_F(INFO, "- publish_pointcloud: %i", m_do_publish_pointcloud);
+  LOG_F(INFO, "- pointcloud_stride: %i", m_pointcloud_stride);
+  LOG_F(INFO, "- pointcloud_max_points: %i", m_pointcloud_max_points);
+  LOG_F(INFO, "- nrof_threads: %i", m_nrof_threads);
+  LOG_F(INFO, "- interpolation: %i", m_interpolation);
+  LOG_F(INFO, "- use_cuda: %i", m_use_cuda);
+  LOG_F(INFO, "- use_pinned_memory: %i", m_use_pinned_memory);
+  LOG_F(INFO, "- frames_in_flight: %i", m_frames_in_flight);
 
   LOG_F(INFO, "### Stage save settings ###");
   LOG_F(INFO, "- save_ortho_rgb: %i", m_settings_save.save_ortho_rgb);
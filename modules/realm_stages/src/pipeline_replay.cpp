@@ -0,0 +1,255 @@
+
+
+#include <chrono>
+#include <iomanip>
+#include <thread>
+
+#include <realm_core/loguru.h>
+#include <realm_core/timer.h>
+
+#include <realm_stages/pipeline_replay.h>
+
+using namespace realm;
+using namespace stages;
+
+PipelineReplay::PipelineReplay(const std::vector<StageBase::Ptr> &stages,
+                               const std::string &output_dir,
+                               const ThreadPool::Ptr &thread_pool)
+    : m_is_finished(false),
+      m_pace(Pace::MAX_SPEED),
+      m_speedup(1.0),
+      m_settle_time(2.0),
+      m_drain_timeout(600.0),
+      m_stages(stages),
+      m_frames_in(new std::atomic<uint32_t>[stages.size()]),
+      m_frames_out(new std::atomic<uint32_t>[stages.size()])
+{
+  if (m_stages.empty())
+    throw(std::invalid_argument("Error creating pipeline replay: No stages provided!"));
+
+  for (size_t i = 0; i < m_stages.size(); ++i)
+  {
+    if (m_stages[i] == nullptr)
+      throw(std::invalid_argument("Error creating pipeline replay: Stage is nullptr!"));
+    m_frames_in[i] = 0;
+    m_frames_out[i] = 0;
+
+    if (thread_pool)
+      m_stages[i]->setThreadPool(thread_pool);
+    m_stages[i]->initStagePath(output_dir);
+  }
+
+  connectStages();
+}
+
+void PipelineReplay::setTrajectory(const std::unordered_map<uint64_t, cv::Mat> &trajectory)
+{
+  m_trajectory = trajectory;
+}
+
+void PipelineReplay::setPace(Pace pace, double speedup)
+{
+  if (speedup <= 0.0)
+    throw(std::invalid_argument("Error setting replay pace: Speedup must be positive!"));
+  m_pace = pace;
+  m_speedup = speedup;
+}
+
+void PipelineReplay::setDrainTime(double settle_time, double timeout)
+{
+  m_settle_time = settle_time;
+  m_drain_timeout = timeout;
+}
+
+void PipelineReplay::connectStages()
+{
+  for (size_t i = 0; i < m_stages.size(); ++i)
+  {
+    StageBase::Ptr next = (i + 1 < m_stages.size() ? m_stages[i + 1] : nullptr);
+
+    // Only the frames are passed on, all other outputs would be published for visualization
+    std::atomic<uint32_t>* frames_out = &m_frames_out[i];
+    std::atomic<uint32_t>* frames_in_next = (next ? &m_frames_in[i + 1] : nullptr);
+    m_stages[i]->registerFrameTransport([=](const Frame::Ptr &frame, const std::string &topic)
+    {
+      if (topic != "output/frame")
+        return;
+      (*frames_out)++;
+      if (next)
+      {
+        (*frames_in_next)++;
+        next->addFrame(frame);
+      }
+    });
+    m_stages[i]->registerPoseTransport([](const cv::Mat &, uint8_t, char, const std::string &){});
+    m_stages[i]->registerPointCloudTransport([](const PointCloud::Ptr &, const std::string &){});
+    m_stages[i]->registerDepthMapTransport([](const cv::Mat &, const std::string &){});
+    m_stages[i]->registerImageTransport([](const cv::Mat &, const std::string &){});
+    m_stages[i]->registerMeshTransport([](const std::vector<Face> &, const std::string &){});
+    m_stages[i]->registerMeshTileTransport([](const std::vector<MeshTile> &, const std::string &){});
+    m_stages[i]->registerCvGridMapTransport([](const CvGridMap &, uint8_t, char, const std::string &){});
+
+    if (next)
+      m_stages[i]->registerBackpressure([next]{ return next->isSaturated(); });
+  }
+}
+
+PipelineReplay::Report PipelineReplay::run(const FrameSource &source)
+{
+  if (m_is_finished)
+    throw(std::runtime_error("Error running pipeline replay: Replay was already run!"));
+
+  Report report;
+
+  for (auto &stage : m_stages)
+    stage->start();
+
+  auto t_start = std::chrono::steady_clock::now();
+  uint64_t timestamp_first = 0;
+
+  Frame::Ptr frame;
+  while ((frame = source()) != nullptr)
+  {
+    if (!m_trajectory.empty() && !applyTrajectory(frame))
+    {
+      LOG_F(WARNING, "Frame #%u has no pose in the trajectory, skipping it.", frame->getFrameId());
+      report.frames_without_pose++;
+      continue;
+    }
+
+    if (report.frames_replayed == 0)
+    {
+      t_start = std::chrono::steady_clock::now();
+      timestamp_first = frame->getTimestamp();
+    }
+
+    if (m_pace == Pace::REAL_TIME)
+    {
+      // Timestamps before the first frame are added immediately, the source is expected to be sorted
+      uint64_t dt = (frame->getTimestamp() > timestamp_first ? frame->getTimestamp() - timestamp_first : 0);
+      std::this_thread::sleep_until(t_start + std::chrono::nanoseconds(static_cast<int64_t>(dt / m_speedup)));
+    }
+    else
+    {
+      // At maximum speed the first stage would otherwise drop frames as soon as the slowest stage falls behind
+      while (m_stages.front()->isSaturated())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    m_frames_in[0]++;
+    m_stages.front()->addFrame(frame);
+    report.frames_replayed++;
+  }
+
+  report.is_drained = waitForDrain();
+  if (!report.is_drained)
+    LOG_F(WARNING, "Pipeline was not drained within %4.1f s after the last frame.", m_drain_timeout);
+
+  report.duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
+  // Stages are finished in processing order, so frames published while finishing still reach the following stages
+  for (auto &stage : m_stages)
+  {
+    stage->requestFinish();
+    stage->join();
+  }
+  m_is_finished = true;
+
+  for (size_t i = 0; i < m_stages.size(); ++i)
+  {
+    StageReport stage_report;
+    stage_report.name = m_stages[i]->getStageName();
+    stage_report.frames_in = m_frames_in[i];
+    stage_report.frames_out = m_frames_out[i];
+    stage_report.fps_out = (report.duration > 0.0 ? stage_report.frames_out / report.duration : 0.0);
+    stage_report.statistics = m_stages[i]->getStageStatistics();
+    report.stages.push_back(stage_report);
+  }
+  return report;
+}
+
+bool PipelineReplay::applyTrajectory(const Frame::Ptr &frame) const
+{
+  auto it = m_trajectory.find(frame->getTimestamp());
+  if (it == m_trajectory.end())
+    return false;
+
+  // Trajectories are saved in the geographic frame, so the visual world and the geographic frame are the same
+  frame->setVisualPose(it->second);
+  frame->initGeoreference(cv::Mat::eye(4, 4, CV_64F));
+  frame->setKeyframe(true);
+  return true;
+}
+
+bool PipelineReplay::waitForDrain() const
+{
+  auto t_last_frame = std::chrono::steady_clock::now();
+  auto t_last_activity = t_last_frame;
+  uint64_t activity = getActivity();
+
+  while (true)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    auto t_now = std::chrono::steady_clock::now();
+
+    bool is_queue_empty = true;
+    for (const auto &stage : m_stages)
+      if (stage->getStageStatistics().queue_depth > 0)
+        is_queue_empty = false;
+
+    uint64_t activity_now = getActivity();
+    if (activity_now != activity || !is_queue_empty)
+    {
+      activity = activity_now;
+      t_last_activity = t_now;
+    }
+    else if (std::chrono::duration<double>(t_now - t_last_activity).count() >= m_settle_time)
+      return true;
+
+    if (std::chrono::duration<double>(t_now - t_last_frame).count() >= m_drain_timeout)
+      return false;
+  }
+}
+
+uint64_t PipelineReplay::getActivity() const
+{
+  uint64_t activity = 0;
+  for (size_t i = 0; i < m_stages.size(); ++i)
+  {
+    StageStatistics statistics = m_stages[i]->getStageStatistics();
+    activity += statistics.frames_total + statistics.frames_processed + statistics.frames_dropped
+                + statistics.frames_bad + m_frames_out[i];
+  }
+  return activity;
+}
+
+void PipelineReplay::printReport(const Report &report, std::ostream &out)
+{
+  out << "Replayed " << report.frames_replayed << " frames in " << std::fixed << std::setprecision(2)
+      << report.duration << " s";
+  if (report.frames_without_pose > 0)
+    out << ", skipped " << report.frames_without_pose << " frames without pose";
+  if (!report.is_drained)
+    out << ", pipeline NOT drained";
+  out << "\n\n";
+
+  out << std::left << std::setw(22) << "stage"
+      << std::right << std::setw(8) << "in" << std::setw(8) << "out" << std::setw(8) << "drop" << std::setw(8) << "fps"
+      << std::setw(10) << "queue p50" << std::setw(10) << "p99"
+      << std::setw(10) << "proc p50" << std::setw(10) << "p90" << std::setw(10) << "p99" << std::setw(10) << "max"
+      << "\n";
+
+  for (const auto &stage : report.stages)
+  {
+    const StageStatistics &s = stage.statistics;
+    out << std::left << std::setw(22) << stage.name
+        << std::right << std::setw(8) << stage.frames_in << std::setw(8) << stage.frames_out
+        << std::setw(8) << s.frames_dropped << std::setw(8) << std::setprecision(2) << stage.fps_out
+        << std::setprecision(1)
+        << std::setw(10) << s.queue_latency.p50 << std::setw(10) << s.queue_latency.p99
+        << std::setw(10) << s.process_latency.p50 << std::setw(10) << s.process_latency.p90
+        << std::setw(10) << s.process_latency.p99 << std::setw(10) << s.process_latency.max
+        << "\n";
+  }
+  out << std::flush;
+}
@@ -0,0 +1,152 @@
+
+
+#include <future>
+
+#include <realm_core/loguru.h>
+#include <realm_core/timer.h>
+
+#include <realm_stages/pipeline_startup.h>
+
+using namespace realm;
+using namespace stages;
+
+PipelineStartup::PipelineStartup(const std::vector<StageFactory> &factories, const ReadyFunc &on_ready, size_t max_buffered_bytes)
+    : m_factories(factories),
+      m_on_ready(on_ready),
+      m_is_finished(false),
+      m_max_buffered_bytes(max_buffered_bytes),
+      m_buffered_bytes(0),
+      m_is_ready(false),
+      m_nrof_dropped_frames(0)
+{
+  if (m_factories.empty())
+    throw(std::invalid_argument("Error creating pipeline startup: No stage factories provided!"));
+  if (!m_on_ready)
+    throw(std::invalid_argument("Error creating pipeline startup: Ready function is not set!"));
+}
+
+PipelineStartup::~PipelineStartup()
+{
+  if (m_thread.joinable())
+    m_thread.join();
+}
+
+void PipelineStartup::start()
+{
+  if (m_thread.joinable() || m_is_finished)
+    throw(std::runtime_error("Error starting pipeline startup: Startup was already started!"));
+  m_thread = std::thread(&PipelineStartup::initialize, this);
+}
+
+void PipelineStartup::addFrame(const Frame::Ptr &frame)
+{
+  if (m_is_ready)
+  {
+    m_stages.front()->addFrame(frame);
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(m_mutex_startup);
+
+  // Startup might have finished while waiting for the lock
+  if (m_is_ready)
+  {
+    lock.unlock();
+    m_stages.front()->addFrame(frame);
+    return;
+  }
+
+  size_t bytes = frame->getByteSize();
+  m_buffer.emplace_back(frame, bytes);
+  m_buffered_bytes += bytes;
+
+  while (m_buffered_bytes > m_max_buffered_bytes && m_buffer.size() > 1)
+  {
+    LOG_F(WARNING, "Pipeline startup buffer is full. Dropping frame #%u.", m_buffer.front().first->getFrameId());
+    m_buffered_bytes -= m_buffer.front().second;
+    m_buffer.pop_front();
+    m_nrof_dropped_frames++;
+  }
+}
+
+bool PipelineStartup::isReady() const
+{
+  return m_is_ready;
+}
+
+std::vector<StageBase::Ptr> PipelineStartup::waitForStages()
+{
+  std::unique_lock<std::mutex> lock(m_mutex_startup);
+  m_condition_startup.wait(lock, [this]{ return m_is_finished; });
+  if (m_exception)
+    std::rethrow_exception(m_exception);
+  return m_stages;
+}
+
+uint32_t PipelineStartup::getNrofDroppedFrames() const
+{
+  return m_nrof_dropped_frames;
+}
+
+void PipelineStartup::initialize()
+{
+  long t = Timer::getCurrentTimeMilliseconds();
+
+  std::vector<std::future<StageBase::Ptr>> futures;
+  futures.reserve(m_factories.size());
+  for (const auto &factory : m_factories)
+    futures.push_back(std::async(std::launch::async, factory));
+
+  // All futures are waited for, even if one failed, so no factory outlives the startup
+  std::vector<StageBase::Ptr> stages;
+  std::exception_ptr exception;
+  for (auto &future : futures)
+  {
+    try
+    {
+      stages.push_back(future.get());
+      if (stages.back() == nullptr)
+        throw(std::runtime_error("Error starting pipeline: Stage factory returned nullptr!"));
+    }
+    catch (...)
+    {
+      if (!exception)
+        exception = std::current_exception();
+    }
+  }
+
+  if (!exception)
+  {
+    LOG_F(INFO, "Constructed %lu stages in %4.2fs.", stages.size(), static_cast<double>(Timer::getCurrentTimeMilliseconds() - t) / 1000.0);
+    try
+    {
+      m_on_ready(stages);
+    }
+    catch (...)
+    {
+      exception = std::current_exception();
+    }
+  }
+
+  std::unique_lock<std::mutex> lock(m_mutex_startup);
+  if (exception)
+  {
+    LOG_F(ERROR, "Pipeline startup failed, dropping %lu buffered frames.", m_buffer.size());
+    m_buffer.clear();
+    m_buffered_bytes = 0;
+    m_exception = exception;
+  }
+  else
+  {
+    // Buffered frames are handed over while holding the lock, so frames are added to the first stage in order
+    m_stages = stages;
+    LOG_F(INFO, "Pipeline is ready, handing %lu buffered frames to stage [%s].", m_buffer.size(), m_stages.front()->getStageName().c_str());
+    for (const auto &element : m_buffer)
+      m_stages.front()->addFrame(element.first);
+    m_buffer.clear();
+    m_buffered_bytes = 0;
+    m_is_ready = true;
+  }
+  m_is_finished = true;
+  m_condition_startup.notify_all();
+}
@@ -2,6 +2,14 @@
 
 #define LOGURU_WITH_STREAMS 1
 
+#include <set>
+#include <unordered_map>
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/video/tracking.hpp>
+
+#include <realm_core/log_macros.h>
+#include <realm_core/scoped_timer.h>
 #include <realm_stages/pose_estimation.h>
 
 using namespace realm;
@@ -16,29 +24,47 @@ PoseEstimation::PoseEstimation(const StageSettings::Ptr &stage_set,
       m_is_georef_initialized(false),
       m_use_vslam((*stage_set)["use_vslam"].toInt() > 0),
       m_use_imu((*stage_set)["use_imu"].toInt() > 0),
+      m_resizing_vslam(vslam_set != nullptr ? (*vslam_set)["resizing"].toDouble() : 0.0),
       m_set_all_frames_keyframes((*stage_set)["set_all_frames_keyframes"].toInt() > 0),
       m_strategy_fallback(PoseEstimation::FallbackStrategy((*stage_set)["fallback_strategy"].toInt())),
       m_use_fallback(false),
+      m_is_tracking_lost(false),
       m_init_lost_frames_reset_count((*stage_set)["init_lost_frames_reset_count"].toInt()),
       m_init_lost_frames(0),
       m_use_initial_guess((*stage_set)["use_initial_guess"].toInt() > 0),
+      m_use_adaptive_tracking((*stage_set)["use_adaptive_tracking"].toInt() > 0),
+      m_th_overlap_adaptive((*stage_set)["th_overlap_adaptive"].toDouble()),
+      m_max_skipped_frames_adaptive((*stage_set)["max_skipped_frames_adaptive"].toInt()),
+      m_nrof_skipped_frames_adaptive(0),
       m_do_update_georef((*stage_set)["update_georef"].toInt() > 0),
       m_do_delay_keyframes((*stage_set)["do_delay_keyframes"].toInt() > 0),
       m_do_suppress_outdated_pose_pub((*stage_set)["suppress_outdated_pose_pub"].toInt() > 0),
       m_th_error_georef((*stage_set)["th_error_georef"].toDouble()),
       m_min_nrof_frames_georef((*stage_set)["min_nrof_frames_georef"].toInt()),
+      m_window_size_georef((*stage_set)["window_size_georef"].toInt()),
+      m_th_outlier_georef((*stage_set)["th_outlier_georef"].toDouble()),
       m_do_auto_reset(false),
       m_th_scale_change(20.0),
       m_overlap_max((*stage_set)["overlap_max"].toDouble()),
       m_overlap_max_fallback((*stage_set)["overlap_max_fallback"].toDouble()),
+      m_overlap_max_saturated((*stage_set)["overlap_max_saturated"].toDouble()),
+      m_publish_sparse_cloud_rate((*stage_set)["publish_sparse_cloud_rate"].toDouble()),
       m_settings_save({(*stage_set)["save_trajectory_gnss"].toInt() > 0,
                       (*stage_set)["save_trajectory_visual"].toInt() > 0,
                       (*stage_set)["save_frames"].toInt() > 0,
                       (*stage_set)["save_keyframes"].toInt() > 0,
-                      (*stage_set)["save_keyframes_full"].toInt() > 0})
+                      (*stage_set)["save_keyframes_full"].toInt() > 0}),
+      m_pose_update_epoch(0),
+      m_georeference(std::make_shared<Georeference>()),
+      m_checkpoint_store(nullptr),
+      m_checkpoint_every_nth(std::max((*stage_set)["checkpoint_every_nth"].toInt(), 1)),
+      m_nrof_frames_checkpoint(0),
+      m_do_resume_from_checkpoint((*stage_set)["resume_from_checkpoint"].toInt() > 0),
+      m_footprints_published(static_cast<size_t>(std::max((*stage_set)["nrof_footprints_overlap"].toInt(), 0)))
 {
   LOG_S(INFO) << "Stage [" << m_stage_name << "]: Created Stage with Settings:\n";
   stage_set->print();
+  setThreadScheduling(readThreadScheduling(*stage_set, "thread"));
 
   registerAsyncDataReadyFunctor([=]{ return !m_buffer_no_pose.empty(); });
 
@@ -61,13 +87,38 @@ PoseEstimation::PoseEstimation(const StageSettings::Ptr &stage_set,
     namespace ph = std::placeholders;
     VisualSlamIF::PoseUpdateFuncCb update_func = std::bind(&PoseEstimation::updateKeyframeCb, this, ph::_1, ph::_2, ph::_3);
     m_vslam->registerUpdateTransport(update_func);
+    VisualSlamIF::PoseUpdateBatchFuncCb update_batch_func = std::bind(&PoseEstimation::updateKeyframesBatchCb, this, ph::_1, ph::_2);
+    m_vslam->registerUpdateBatchTransport(update_batch_func);
+
+    if ((*stage_set)["use_imu_prior"].toInt() > 0)
+      m_imu_prior = std::make_shared<ImuMotionPrior>(imu_set != nullptr ? (*imu_set)["T_cam_imu"].toMat() : cv::Mat());
 
     // Create geo reference initializer
-    m_georeferencer = std::make_shared<GeometricReferencer>(m_th_error_georef, m_min_nrof_frames_georef);
+    m_georeferencer = std::make_shared<GeometricReferencer>(m_th_error_georef, m_min_nrof_frames_georef,
+                                                            m_window_size_georef, m_th_outlier_georef);
+
+    // Georeferencing runs on its own workers, so tracking a frame only costs the visual SLAM
+    m_pool_georef = std::make_shared<ThreadPool>(1);
+    m_pool_georef_refine = std::make_shared<ThreadPool>(1);
+    m_pool_fallback = std::make_shared<ThreadPool>(1);
+  }
+
+  // Without visual SLAM there is no state worth restoring, frames are georeferenced by GNSS only
+  std::string checkpoint_directory = (*stage_set)["checkpoint_directory"].toString();
+  if (!checkpoint_directory.empty() && m_use_vslam)
+    m_checkpoint_store = std::make_shared<io::CheckpointStore>(checkpoint_directory);
+  else if (m_do_resume_from_checkpoint)
+  {
+    LOG_F(WARNING, "Resume from checkpoint requested, but no checkpoint directory set or visual SLAM disabled.");
+    m_do_resume_from_checkpoint = false;
   }
 
   evaluateFallbackStrategy(m_strategy_fallback);
 
+  // Recorded images are not dropped, a full queue slows down the publisher instead
+  if (m_settings_save.save_frames || m_settings_save.save_keyframes || m_settings_save.save_keyframes_full)
+    m_image_writer = std::make_shared<io::ExportService>(1, 16, false);
+
   // Create Pose Estimation publisher
   m_stage_publisher.reset(new PoseEstimationIO(this, 2*rate, m_do_delay_keyframes));
   m_stage_publisher->start();
@@ -75,9 +126,6 @@ PoseEstimation::PoseEstimation(const StageSettings::Ptr &stage_set,
   // Creation of reference plane, currently only the one below is supported
   m_plane_ref.pt = (cv::Mat_<double>(3, 1) << 0.0, 0.0, 0.0);
   m_plane_ref.n = (cv::Mat_<double>(3, 1) << 0.0, 0.0, 1.0);
-
-  // Previous roi initialization
-  m_roi_prev = cv::Rect2d(0.0, 0.0, 0.0, 0.0);
 }
 
 PoseEstimation::~PoseEstimation()
@@ -87,13 +135,30 @@ PoseEstimation::~PoseEstimation()
 void PoseEstimation::finishCallback()
 {
   if (m_use_vslam) {
+    waitForGeoreferencing();
+    if (m_future_fallback.valid())
+      m_future_fallback.wait();
     m_vslam->close();
   }
 
   m_stage_publisher->requestFinish();
   m_stage_publisher->join();
+
+  if (m_image_writer)
+    m_image_writer->flush();
 }
 
+#ifdef WITH_EXIV2
+void PoseEstimation::saveExifImageAsync(const Frame::Ptr &frame, const std::string &folder, const std::string &name, bool use_resized)
+{
+  // The output path may change while the image is queued, so it is resolved now
+  std::string directory = m_stage_path + "/" + folder;
+  m_image_writer->submit(m_stage_name + "::saveExifImage", [frame, directory, name, use_resized]{
+    io::saveExifImage(frame, directory, name, frame->getFrameId(), use_resized);
+  });
+}
+#endif
+
 void PoseEstimation::evaluateFallbackStrategy(PoseEstimation::FallbackStrategy strategy)
 {
   LOG_F(INFO, "Evaluating fallback strategy...");
@@ -116,7 +181,7 @@ void PoseEstimation::evaluateFallbackStrategy(PoseEstimation::FallbackStrategy s
 void PoseEstimation::addFrame(const Frame::Ptr &frame)
 {
   // First update statistics about incoming frame rate
-  updateStatisticsIncoming();
+  updateStatisticsIncoming(frame);
 
   // The user can provide a-priori georeferencing. Check if this is the case
   if (!m_is_georef_initialized && frame->isGeoreferenced())
@@ -127,7 +192,15 @@ void PoseEstimation::addFrame(const Frame::Ptr &frame)
 
   // Push to buffer for visual tracking
   if (m_use_vslam)
+  {
+    // Prepare the tracking image here on the input thread, the visual SLAM reuses it without resizing or converting
+    if (m_resizing_vslam > 0.0)
+    {
+      frame->setImageResizeFactor(m_resizing_vslam);
+      frame->getResizedImageGray();
+    }
     pushToBufferNoPose(frame);
+  }
   else
     pushToBufferPublish(frame);
   notify();
@@ -143,6 +216,37 @@ void PoseEstimation::addFrame(const Frame::Ptr &frame)
   m_transport_pose(frame->getDefaultPose(), frame->getGnssUtm().zone, frame->getGnssUtm().band, "output/pose/gnss");
 }
 
+size_t PoseEstimation::getMemoryUsage()
+{
+  // Frames can be contained in several buffers at the same time, so they are counted only once
+  std::set<Frame*> frames;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex_buffer_no_pose);
+    for (const auto &frame : m_buffer_no_pose)
+      frames.insert(frame.get());
+  }
+  {
+    std::unique_lock<std::mutex> lock(m_mutex_buffer_pose_all);
+    for (const auto &frame : m_buffer_pose_all)
+      frames.insert(frame.get());
+  }
+  {
+    std::unique_lock<std::mutex> lock(m_mutex_buffer_pose_init);
+    for (const auto &frame : m_buffer_pose_init)
+      frames.insert(frame.get());
+  }
+  {
+    std::unique_lock<std::mutex> lock(m_mutex_buffer_do_publish);
+    for (const auto &frame : m_buffer_do_publish)
+      frames.insert(frame.get());
+  }
+
+  size_t bytes = 0;
+  for (const Frame* frame : frames)
+    bytes += frame->getByteSize();
+  return bytes;
+}
+
 uint32_t PoseEstimation::getQueueDepth() {
   // If no vslam is used, only the publish buffer has elements
   // If vslam is in use, then frames can be added to no_pose as well as do_publish
@@ -157,102 +261,275 @@ bool PoseEstimation::process()
 
   // Grab georeference flag once at the beginning, to avoid multithreading problems
   if (m_use_vslam)
-    m_is_georef_initialized = m_georeferencer->isInitialized();
+    m_is_georef_initialized = std::atomic_load(&m_georeference)->isInitialized();
 
   // Process new frames without a visual pose currently
   if (!m_buffer_no_pose.empty())
   {
+    // Restored before the first frame, so tracking relocalizes in the map of the interrupted run
+    if (m_do_resume_from_checkpoint)
+    {
+      m_do_resume_from_checkpoint = false;
+      m_is_georef_initialized = loadCheckpoint();
+    }
+
     // Grab frame from buffer with no poses
     Frame::Ptr frame = getNewFrameTracking();
 
+    // While the visual SLAM is lost, reinitialization can take longer than the camera rate. Instead of letting the
+    // queue stall the output, only the newest frame is tracked and all older ones take the GNSS only path.
+    if (m_use_fallback && m_is_tracking_lost)
+    {
+      std::unique_lock<std::mutex> lock(m_mutex_buffer_no_pose);
+      std::vector<Frame::Ptr> frames_fallback;
+      while (!m_buffer_no_pose.empty())
+      {
+        frames_fallback.push_back(frame);
+        frame = m_buffer_no_pose.front();
+        m_buffer_no_pose.pop_front();
+      }
+      lock.unlock();
+
+      for (const auto &f : frames_fallback)
+      {
+        updateStatisticsProcessedFrame(f);
+        dispatchFallback(f);
+      }
+      LOG_IF_F(INFO, !frames_fallback.empty(), "Tracking lost, %lu frames handed to GNSS fallback.", frames_fallback.size());
+    }
+
     LOG_IF_F(INFO, m_stage_statistics.frames_processed % 10 == 0, "Buffer [all, init, publish]: %lu, %lu, %lu",
              m_buffer_pose_all.size(), m_buffer_pose_init.size(), m_buffer_do_publish.size());
 
-    // Track current frame -> compute visual accurate pose
-    track(frame);
-
-    // Identify buffer for push
-    if (frame->hasAccuratePose())
+    // Frames that are nearly identical to the last tracked one are dropped, as long as the gap stays small enough
+    // for the visual SLAM to continue tracking
+    if (m_use_adaptive_tracking && m_nrof_skipped_frames_adaptive < m_max_skipped_frames_adaptive)
     {
-      // Branch accurate pose and georef initialized
-      if (m_is_georef_initialized)
+      double overlap = estimateOverlapAdaptive(frame);
+      if (overlap > m_th_overlap_adaptive)
       {
-        double scale_change = m_georeferencer->computeScaleChange(frame);
-        LOG_F(INFO, "Info [Scale Drift]: Scale change of current frame: %4.2f%%", scale_change);
-
-        bool is_scale_consistent = (scale_change < m_th_scale_change);
-        if (!is_scale_consistent)
-        {
-          LOG_F(WARNING, "Detected scale divergence.");
-
-          // For now, just warn that our scale may be off until we resolve the issues discussed here:
-          // https://github.com/laxnpander/OpenREALM/pull/59
-
-          // frame->setPoseAccurate(false);
-          // frame->setKeyframe(false);
-          //
-          // if (m_do_auto_reset)
-          // {
-          //   LOG_F(WARNING, "Resetting.");
-          //   m_reset_requested = true;
-          // reset();
-          // }
-        }
-
-        // if (is_scale_consistent && m_do_update_georef && !m_georeferencer->isBuisy())
-        if (m_do_update_georef && !m_georeferencer->isBuisy())
-        {
-          std::thread th(std::bind(&GeospatialReferencerIF::update, m_georeferencer, frame));
-          th.detach();
-        }
-        pushToBufferAll(frame);
+        LOG_F(INFO, "Dropping frame #%u, overlap to last tracked frame: %4.2f%%", frame->getFrameId(), overlap);
+        m_nrof_skipped_frames_adaptive++;
+        updateStatisticsSkippedFrame();
+        return true;
       }
     }
-    if (frame->isKeyframe() && !m_is_georef_initialized)
+
+    // Track current frame -> compute visual accurate pose
+    track(frame);
+
+    // Buffer management and georeferencing of the tracked frame are handed off to the georeference worker. Its tasks
+    // run in order of submission, so waiting for the latest one waits for all.
+    m_future_georef = m_pool_georef->submit([this, frame]{ processGeoreference(frame); });
+
+    if (m_checkpoint_store != nullptr && ++m_nrof_frames_checkpoint >= m_checkpoint_every_nth)
     {
-      pushToBufferAll(frame);
-      pushToBufferInit(frame);
+      ScopedTimer timer_checkpoint("Checkpoint");
+      saveCheckpoint();
+      timer_checkpoint.stop();
+      m_nrof_frames_checkpoint = 0;
     }
 
     // Data was processed during this loop
     has_processed = true;
   }
+  return has_processed;
+}
+
+void PoseEstimation::processGeoreference(const Frame::Ptr &frame)
+{
+  // The georeferencer might have been initialized a-priori or by the refinement worker in the meantime
+  if (!std::atomic_load(&m_georeference)->isInitialized())
+    publishGeoreference();
+  bool is_georef_initialized = std::atomic_load(&m_georeference)->isInitialized();
+
+  // Identify buffer for push
+  if (frame->hasAccuratePose())
+  {
+    // Branch accurate pose and georef initialized
+    if (is_georef_initialized)
+    {
+      double scale_change = m_georeferencer->computeScaleChange(frame);
+      LOG_F(INFO, "Info [Scale Drift]: Scale change of current frame: %4.2f%%", scale_change);
+
+      bool is_scale_consistent = (scale_change < m_th_scale_change);
+      if (!is_scale_consistent)
+      {
+        LOG_F(WARNING, "Detected scale divergence.");
+
+        // For now, just warn that our scale may be off until we resolve the issues discussed here:
+        // https://github.com/laxnpander/OpenREALM/pull/59
+
+        // frame->setPoseAccurate(false);
+        // frame->setKeyframe(false);
+        //
+        // if (m_do_auto_reset)
+        // {
+        //   LOG_F(WARNING, "Resetting.");
+        //   m_reset_requested = true;
+        // reset();
+        // }
+      }
+
+      // if (is_scale_consistent && m_do_update_georef)
+      if (m_do_update_georef)
+        dispatchGeoreferenceRefinement([this, frame]{
+          m_georeferencer->update(frame);
+          publishGeoreference();
+        });
+      pushToBufferAll(frame);
+    }
+  }
+  if (frame->isKeyframe() && !is_georef_initialized)
+  {
+    pushToBufferAll(frame);
+    pushToBufferInit(frame);
+  }
 
   // Handles georeference initialization and georeferencing of frame poses
-  // but only starts, if a new frame was processed during this loop
-  if (m_use_vslam && has_processed)
+  if (!is_georef_initialized)
   {
-    if (!m_is_georef_initialized && !m_buffer_pose_init.empty() && !m_georeferencer->isBuisy())
+    // Branch: Georef is not calculated yet
+    std::vector<Frame::Ptr> frames_init;
     {
-      // Branch: Georef is not calculated yet
-      LOG_F(INFO, "Size of init buffer: %lu", m_buffer_pose_init.size());
-      std::thread th(std::bind(&GeospatialReferencerIF::init, m_georeferencer, m_buffer_pose_init));
-      th.detach();
-      has_processed = true;
+      std::unique_lock<std::mutex> lock(m_mutex_buffer_pose_init);
+      frames_init = m_buffer_pose_init;
     }
-    else if (m_is_georef_initialized && !m_buffer_pose_all.empty())
+    if (!frames_init.empty())
     {
-      // Branch: Georef was successfully initialized and data waits to be georeferenced
-      // Process all measurements in seperate thread
-      if (!m_buffer_pose_init.empty())
-        m_buffer_pose_init.clear();
-
-      std::thread th(std::bind(&PoseEstimation::applyGeoreferenceToBuffer, this));
-      th.detach();
-      has_processed = true;
+      LOG_F(INFO, "Size of init buffer: %lu", frames_init.size());
+      dispatchGeoreferenceRefinement([this, frames_init]{
+        m_georeferencer->init(frames_init);
+        publishGeoreference();
+      });
     }
   }
-  return has_processed;
+  else if (!m_buffer_pose_all.empty())
+  {
+    // Branch: Georef was successfully initialized and data waits to be georeferenced
+    {
+      std::unique_lock<std::mutex> lock(m_mutex_buffer_pose_init);
+      m_buffer_pose_init.clear();
+    }
+    applyGeoreferenceToBuffer();
+  }
+}
+
+void PoseEstimation::dispatchGeoreferenceRefinement(const std::function<void()> &task)
+{
+  // Like before, requests are dropped while the georeferencer is still busy with the previous one
+  if (m_future_georef_refine.valid() && m_future_georef_refine.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    return;
+  m_future_georef_refine = m_pool_georef_refine->submit(task);
+}
+
+void PoseEstimation::publishGeoreference()
+{
+  if (m_georeferencer->isInitialized())
+    std::atomic_load(&m_georeference)->update(m_georeferencer->getTransformation());
+}
+
+void PoseEstimation::waitForGeoreferencing()
+{
+  // The refinement is dispatched from the georeference worker, so that one has to finish first
+  if (m_future_georef.valid())
+    m_future_georef.wait();
+  if (m_future_georef_refine.valid())
+    m_future_georef_refine.wait();
+}
+
+void PoseEstimation::saveCheckpoint()
+{
+  std::shared_ptr<const cv::Mat> T_w2g = std::atomic_load(&m_georeference)->getTransformation();
+  if (T_w2g == nullptr)
+    return;
+
+  try
+  {
+    // Saving the map blocks tracking, so it is the dominating cost of a checkpoint
+    bool has_map = false;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex_vslam);
+      has_map = m_checkpoint_store->write("pose_estimation_vslam_map.msg", [&](const std::string &filepath)
+      {
+        m_vslam->saveMap(filepath);
+      });
+    }
+
+    // Commit point of the checkpoint, written last so it never references an incomplete map
+    m_checkpoint_store->write("pose_estimation_state.yaml", [&](const std::string &filepath)
+    {
+      cv::FileStorage fs(filepath, cv::FileStorage::WRITE);
+      fs << "transformation_w2g" << *T_w2g;
+      fs << "has_vslam_map" << static_cast<int>(has_map);
+      fs.release();
+    });
+  }
+  catch (const std::exception &e)
+  {
+    LOG_F(WARNING, "Writing checkpoint of pose estimation failed: %s", e.what());
+  }
+}
+
+bool PoseEstimation::loadCheckpoint()
+{
+  if (!m_checkpoint_store->exists("pose_estimation_state.yaml"))
+  {
+    LOG_F(WARNING, "No checkpoint of the pose estimation found in '%s', georeference is initialized from scratch.",
+          m_checkpoint_store->getDirectory().c_str());
+    return false;
+  }
+
+  try
+  {
+    std::string filepath_state = m_checkpoint_store->getFilepath("pose_estimation_state.yaml");
+    cv::Mat T_w2g = io::loadGeoreferenceFromYaml(filepath_state);
+
+    cv::FileStorage fs(filepath_state, cv::FileStorage::READ);
+    bool has_map = ((int)fs["has_vslam_map"] > 0);
+    fs.release();
+
+    if (T_w2g.empty() || !has_map)
+    {
+      LOG_F(WARNING, "Checkpoint holds no map of the visual SLAM, georeference is initialized from scratch.");
+      return false;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex_vslam);
+      if (!m_vslam->loadMap(m_checkpoint_store->getFilepath("pose_estimation_vslam_map.msg")))
+      {
+        LOG_F(WARNING, "Visual SLAM can not load maps, georeference is initialized from scratch.");
+        return false;
+      }
+    }
+
+    m_georeferencer = std::make_shared<DummyReferencer>(T_w2g);
+    publishGeoreference();
+  }
+  catch (const std::exception &e)
+  {
+    LOG_F(WARNING, "Restoring checkpoint of pose estimation failed, georeference is initialized from scratch: %s", e.what());
+    return false;
+  }
+
+  LOG_F(INFO, "Restored georeference and map of the visual SLAM from checkpoint.");
+  return true;
 }
 
 void PoseEstimation::track(Frame::Ptr &frame)
 {
   LOG_SCOPE_FUNCTION(INFO);
-  LOG_F(INFO, "Frame id: #%i, timestamp: %lu", frame->getFrameId(), frame->getTimestamp());
+  LOG_FRAME_F(INFO, "Frame id: #%i, timestamp: %lu", frame->getFrameId(), frame->getTimestamp());
 
   // Check if initial guess should be computed
   cv::Mat T_c2w_initial;
-  if (m_use_initial_guess && m_georeferencer->isInitialized())
+  if (m_imu_prior)
+  {
+    T_c2w_initial = m_imu_prior->predict(frame->getTimestamp());
+    LOG_IF_F(INFO, !T_c2w_initial.empty(), "Predicted initial guess of current pose from IMU.");
+  }
+  if (T_c2w_initial.empty() && m_use_initial_guess && m_is_georef_initialized)
   {
     LOG_F(INFO, "Computing initial guess of current pose...");
     T_c2w_initial = computeInitialPoseGuess(frame);
@@ -286,21 +563,36 @@ void PoseEstimation::track(Frame::Ptr &frame)
         }
       }
 
-      if (estimatePercOverlap(frame) < m_overlap_max_fallback)
-        pushToBufferPublish(frame);
+      m_is_tracking_lost = true;
+      dispatchFallback(frame);
       LOG_F(WARNING, "No tracking.");
       break;
     case VisualSlamIF::State::INITIALIZED:
       LOG_F(INFO, "Visual SLAM initialized.");
       break;
     case VisualSlamIF::State::FRAME_INSERT:
-      LOG_F(INFO, "Frame insertion.");
+      LOG_FRAME_F(INFO, "Frame insertion.");
       break;
     case VisualSlamIF::State::KEYFRAME_INSERT:
       frame->setKeyframe(true);
-      LOG_F(INFO, "Key frame insertion.");
+      LOG_FRAME_F(INFO, "Key frame insertion.");
       break;
   }
+
+  if (state != VisualSlamIF::State::LOST)
+    m_is_tracking_lost = false;
+
+  // Tracked poses are the anchors of the next prediction
+  if (m_imu_prior && state != VisualSlamIF::State::LOST)
+    m_imu_prior->update(frame->getTimestamp(), frame->getVisualPoseView());
+
+  if (m_use_adaptive_tracking)
+  {
+    if (state != VisualSlamIF::State::LOST)
+      updateReferenceAdaptive(frame);
+    else
+      m_img_ref_adaptive.release();
+  }
   // Save tracked img with features in member
   std::unique_lock<std::mutex> lock(m_mutex_img_debug);
   m_vslam->drawTrackedImage(m_img_debug);
@@ -308,6 +600,14 @@ void PoseEstimation::track(Frame::Ptr &frame)
 
 void PoseEstimation::reset()
 {
+  // Georeference workers use the buffers and the georeferencer, so they have to finish before both are reset
+  if (m_use_vslam)
+  {
+    waitForGeoreferencing();
+    if (m_future_fallback.valid())
+      m_future_fallback.wait();
+  }
+
   std::unique_lock<std::mutex> lock(m_mutex_reset_requested);
   std::unique_lock<std::mutex> lock1(m_mutex_buffer_no_pose);
   std::unique_lock<std::mutex> lock2(m_mutex_buffer_pose_init);
@@ -339,9 +639,17 @@ void PoseEstimation::reset()
 
   m_init_lost_frames = 0;
 
+  // World frame of the visual SLAM starts from scratch
+  if (m_imu_prior)
+    m_imu_prior->reset();
+  m_img_ref_adaptive.release();
+  m_nrof_skipped_frames_adaptive = 0;
+
   // Reset georeferencing
   if (m_use_vslam)
-    m_georeferencer.reset(new GeometricReferencer(m_th_error_georef, m_min_nrof_frames_georef));
+    m_georeferencer.reset(new GeometricReferencer(m_th_error_georef, m_min_nrof_frames_georef,
+                                                 m_window_size_georef, m_th_outlier_georef));
+  std::atomic_store(&m_georeference, std::make_shared<Georeference>());
   m_stage_publisher->requestReset();
   m_is_georef_initialized = false;
   m_reset_requested = false;
@@ -349,12 +657,13 @@ void PoseEstimation::reset()
 
 void PoseEstimation::queueImuData(const VisualSlamIF::ImuData &imu) const
 {
+  if (m_imu_prior)
+    m_imu_prior->addImuData(imu);
   m_vslam->queueImuData(imu);
 }
 
 bool PoseEstimation::changeParam(const std::string& name, const std::string &val)
 {
-  std::unique_lock<std::mutex> lock;
   if (name == "use_vslam")
   {
     m_use_vslam = (val == "true" || val == "1");
@@ -394,15 +703,22 @@ void PoseEstimation::initStageCallback()
 void PoseEstimation::printSettingsToLog()
 {
   LOG_F(INFO, "### Stage process settings ###");
-  LOG_F(INFO, "- use_vslam: %i", m_use_vslam);
+  LOG_F(INFO, "- use_vslam: %i", m_use_vslam.load());
   LOG_F(INFO, "- use_fallback: %i", m_use_fallback);
   LOG_F(INFO, "- do_update_georef: %i", m_do_update_georef);
   LOG_F(INFO, "- do_suppress_outdated_pose_pub: %i", m_do_suppress_outdated_pose_pub);
   LOG_F(INFO, "- th_error_georef: %4.2f", m_th_error_georef);
   LOG_F(INFO, "- min_nrof_frames_georef: %d", m_min_nrof_frames_georef);
+  LOG_F(INFO, "- window_size_georef: %d", m_window_size_georef);
+  LOG_F(INFO, "- th_outlier_georef: %4.2f", m_th_outlier_georef);
   LOG_F(INFO, "- init_lost_frames_reset_count: %df", m_init_lost_frames_reset_count);
   LOG_F(INFO, "- overlap_max: %4.2f", m_overlap_max);
   LOG_F(INFO, "- overlap_max_fallback: %4.2f", m_overlap_max_fallback);
+  LOG_F(INFO, "- overlap_max_saturated: %4.2f", m_overlap_max_saturated);
+  LOG_F(INFO, "- publish_sparse_cloud_rate: %4.2f", m_publish_sparse_cloud_rate);
+  LOG_F(INFO, "- checkpoint_directory: %s", (m_checkpoint_store ? m_checkpoint_store->getDirectory().c_str() : ""));
+  LOG_F(INFO, "- checkpoint_every_nth: %i", m_checkpoint_every_nth);
+  LOG_F(INFO, "- resume_from_checkpoint: %i", m_do_resume_from_checkpoint);
 
   LOG_F(INFO, "### Stage save settings ###");
   LOG_F(INFO, "- save_trajectory_gnss: %i", m_settings_save.save_trajectory_gnss);
@@ -441,7 +757,9 @@ void PoseEstimation::pushToBufferPublish(const Frame::Ptr &frame)
 
 void PoseEstimation::updatePreviousRoi(const Frame::Ptr &frame)
 {
-  m_roi_prev = frame->getCamera()->projectImageBoundsToPlaneRoi(m_plane_ref.pt, m_plane_ref.n);
+  cv::Rect2d roi = frame->getCamera()->projectImageBoundsToPlaneRoi(m_plane_ref.pt, m_plane_ref.n);
+  std::unique_lock<std::mutex> lock(m_mutex_footprints_published);
+  m_footprints_published.add(roi);
 }
 
 void PoseEstimation::updateKeyframeCb(int id, const cv::Mat &pose, const cv::Mat &points)
@@ -470,10 +788,56 @@ void PoseEstimation::updateKeyframeCb(int id, const cv::Mat &pose, const cv::Mat
 //    }
 }
 
+void PoseEstimation::updateKeyframesBatchCb(uint64_t epoch, const std::vector<VisualSlamIF::PoseUpdate> &updates)
+{
+  std::unique_lock<std::mutex> lock_epoch(m_mutex_pose_update_epoch);
+  if (epoch <= m_pose_update_epoch)
+  {
+    LOG_F(WARNING, "Dropping outdated pose updates of epoch %lu (current: %lu)", epoch, m_pose_update_epoch);
+    return;
+  }
+  m_pose_update_epoch = epoch;
+
+  std::unordered_map<uint32_t, const cv::Mat*> poses;
+  poses.reserve(updates.size());
+  for (const auto &update : updates)
+    if (!update.pose.empty())
+      poses[update.frame_id] = &update.pose;
+
+  // Frames are shared with the following stages, so they see the corrected poses as well. Frames that are in both
+  // buffers are only updated once.
+  size_t nrof_updated = 0;
+  auto apply_updates = [&](std::deque<Frame::Ptr> &buffer)
+  {
+    for (auto &frame : buffer)
+    {
+      auto it = poses.find(frame->getFrameId());
+      if (it != poses.end())
+      {
+        frame->setVisualPose(*it->second);
+        poses.erase(it);
+        nrof_updated++;
+      }
+    }
+  };
+
+  {
+    std::unique_lock<std::mutex> lock(m_mutex_buffer_pose_all);
+    apply_updates(m_buffer_pose_all);
+  }
+  {
+    std::unique_lock<std::mutex> lock(m_mutex_buffer_do_publish);
+    apply_updates(m_buffer_do_publish);
+  }
+
+  LOG_F(INFO, "Applied %lu of %lu pose updates of epoch %lu", nrof_updated, updates.size(), epoch);
+}
+
 double PoseEstimation::estimatePercOverlap(const Frame::Ptr &frame)
 {
   cv::Rect2d roi_curr = frame->getCamera()->projectImageBoundsToPlaneRoi(m_plane_ref.pt, m_plane_ref.n);
-  return ((roi_curr & m_roi_prev).area() / roi_curr.area()) * 100;
+  std::unique_lock<std::mutex> lock(m_mutex_footprints_published);
+  return m_footprints_published.computeMaxOverlap(roi_curr);
 }
 
 Frame::Ptr PoseEstimation::getNewFrameTracking()
@@ -485,12 +849,19 @@ Frame::Ptr PoseEstimation::getNewFrameTracking()
   std::unique_lock<std::mutex> lock(m_mutex_buffer_no_pose);
   Frame::Ptr frame = m_buffer_no_pose.front();
   m_buffer_no_pose.pop_front();
+  lock.unlock();
 
-  updateStatisticsProcessedFrame();
+  // Statistics include the memory of all buffers, so the lock must be released before
+  updateStatisticsProcessedFrame(frame);
 
   return std::move(frame);
 }
 
+void PoseEstimation::registerPublishBatchTransport(const PublishBatchTransportFunc &func)
+{
+  m_transport_publish_batch = func;
+}
+
 Frame::Ptr PoseEstimation::getNewFramePublish()
 {
   std::unique_lock<std::mutex> lock(m_mutex_buffer_do_publish);
@@ -501,10 +872,8 @@ Frame::Ptr PoseEstimation::getNewFramePublish()
 
 void PoseEstimation::applyGeoreferenceToBuffer()
 {
-  // Grab estimated georeference
-  m_mutex_t_w2g.lock();
-  m_T_w2g = m_georeferencer->getTransformation();
-  m_mutex_t_w2g.unlock();
+  // Grab latest published georeference, frames are attached to it and resolve later updates on publish
+  Georeference::Ptr georeference = std::atomic_load(&m_georeference);
 
   // Apply estimated georeference to all measurements in the buffer
   while(!m_buffer_pose_all.empty())
@@ -518,7 +887,8 @@ void PoseEstimation::applyGeoreferenceToBuffer()
     // In case of default GNSS pose generated from lat/lon/alt/heading, pose is already in world frame
     if (frame->hasAccuratePose())
     {
-      frame->initGeoreference(m_T_w2g);
+      frame->setSharedGeoreference(georeference);
+      frame->resolveGeoreference();
     }
 
     pushToBufferPublish(frame);
@@ -528,7 +898,7 @@ void PoseEstimation::applyGeoreferenceToBuffer()
 cv::Mat PoseEstimation::computeInitialPoseGuess(const Frame::Ptr &frame)
 {
   cv::Mat default_pose = frame->getDefaultPose();
-  cv::Mat T_w2g = m_georeferencer->getTransformation();
+  cv::Mat T_w2g = std::atomic_load(&m_georeference)->getTransformation()->clone();
   T_w2g.pop_back();
 
   // Compute scale of georeference
@@ -563,6 +933,68 @@ cv::Mat PoseEstimation::computeInitialPoseGuess(const Frame::Ptr &frame)
   return default_pose_in_world.rowRange(0, 3);
 }
 
+double PoseEstimation::estimateOverlapAdaptive(const Frame::Ptr &frame) const
+{
+  if (m_img_ref_adaptive.empty() || m_features_ref_adaptive.size() < 20 || !frame->isImageResizeSet())
+    return 0.0;
+
+  cv::Mat img = frame->getResizedImageGray();
+  if (img.size() != m_img_ref_adaptive.size())
+    return 0.0;
+
+  std::vector<cv::Point2f> features;
+  std::vector<uchar> status;
+  std::vector<float> error;
+  cv::calcOpticalFlowPyrLK(m_img_ref_adaptive, img, m_features_ref_adaptive, features, status, error, cv::Size(21, 21), 3);
+
+  std::vector<cv::Point2f> pts_ref, pts_curr;
+  for (size_t i = 0; i < features.size(); ++i)
+    if (status[i])
+    {
+      pts_ref.push_back(m_features_ref_adaptive[i]);
+      pts_curr.push_back(features[i]);
+    }
+
+  // Too few features survived, the motion is too large or the scene changed
+  if (pts_ref.size() < m_features_ref_adaptive.size() / 2 || pts_ref.size() < 20)
+    return 0.0;
+
+  cv::Mat H = cv::findHomography(pts_ref, pts_curr, cv::RANSAC, 3.0);
+  if (H.empty())
+    return 0.0;
+
+  // Overlap is the area of the reference image bounds mapped into the current image and clipped by it
+  auto w = static_cast<float>(img.cols);
+  auto h = static_cast<float>(img.rows);
+  std::vector<cv::Point2f> bounds{{0.0f, 0.0f}, {w, 0.0f}, {w, h}, {0.0f, h}};
+  std::vector<cv::Point2f> bounds_warped;
+  cv::perspectiveTransform(bounds, bounds_warped, H);
+  if (!cv::isContourConvex(bounds_warped))
+    return 0.0;
+
+  std::vector<cv::Point2f> intersection;
+  float area = cv::intersectConvexConvex(bounds_warped, bounds, intersection);
+  return area / (w * h) * 100.0;
+}
+
+void PoseEstimation::updateReferenceAdaptive(const Frame::Ptr &frame)
+{
+  m_nrof_skipped_frames_adaptive = 0;
+  if (!frame->isImageResizeSet())
+    return;
+
+  m_img_ref_adaptive = frame->getResizedImageGray();
+  cv::goodFeaturesToTrack(m_img_ref_adaptive, m_features_ref_adaptive, 200, 0.01, 10.0);
+}
+
+void PoseEstimation::dispatchFallback(const Frame::Ptr &frame)
+{
+  m_future_fallback = m_pool_fallback->submit([this, frame]{
+    if (estimatePercOverlap(frame) < m_overlap_max_fallback)
+      pushToBufferPublish(frame);
+  });
+}
+
 void PoseEstimation::printGeoReferenceInfo(const Frame::Ptr &frame)
 {
   UTMPose utm = frame->getGnssUtm();
@@ -580,7 +1012,8 @@ PoseEstimationIO::PoseEstimationIO(PoseEstimation* stage, double rate, bool do_d
       m_is_new_output_path_set(false),
       m_do_delay_keyframes(do_delay_keyframes),
       m_t_ref({0, 0}),
-      m_stage_handle(stage)
+      m_stage_handle(stage),
+      m_t_last_sparse_cloud(0)
 {
   if (!m_stage_handle)
     throw(std::invalid_argument("Error: Could not create PoseEstimationIO. Stage handle points to NULL."));
@@ -599,20 +1032,33 @@ bool PoseEstimationIO::process()
     m_is_new_output_path_set = false;
   }
 
-  if (!m_stage_handle->m_buffer_do_publish.empty())
+  // All frames georeferenced since the last wakeup are published at once
+  while (!m_stage_handle->m_buffer_do_publish.empty())
   {
     // Grab frame from pose estimation geoereferenced mmts
     Frame::Ptr frame = m_stage_handle->getNewFramePublish();
 
+    // Refinements of the georeference while the frame was waiting are applied now, only if there were any
+    frame->resolveGeoreference();
+
     // Data to be published for every georeferenced frame (usually small data packages).
     // Poses get only published, if suppress flag was not set (old poses might crash state estimate filter)
     if (!(m_stage_handle->m_do_suppress_outdated_pose_pub && m_stage_handle->m_buffer_do_publish.size() > 1))
       publishPose(frame);
 
+    // While the following stages can not keep up, only frames with less overlap are published
+    double overlap_max = m_stage_handle->m_overlap_max;
+    double overlap_max_fallback = m_stage_handle->m_overlap_max_fallback;
+    if (m_stage_handle->isDownstreamSaturated())
+    {
+      overlap_max = std::min(overlap_max, m_stage_handle->m_overlap_max_saturated);
+      overlap_max_fallback = std::min(overlap_max_fallback, m_stage_handle->m_overlap_max_saturated);
+    }
+
     // Check what type of frame
-    bool is_gnss_frame = !m_stage_handle->m_use_vslam && m_stage_handle->estimatePercOverlap(frame) < m_stage_handle->m_overlap_max_fallback;
-    bool is_vslam_frame = frame->isKeyframe() && m_stage_handle->estimatePercOverlap(frame) < m_stage_handle->m_overlap_max;
-    bool is_vslam_fallback_frame = m_stage_handle->m_use_fallback && !frame->hasAccuratePose() && m_stage_handle->estimatePercOverlap(frame) < m_stage_handle->m_overlap_max_fallback;
+    bool is_gnss_frame = !m_stage_handle->m_use_vslam && m_stage_handle->estimatePercOverlap(frame) < overlap_max_fallback;
+    bool is_vslam_frame = frame->isKeyframe() && m_stage_handle->estimatePercOverlap(frame) < overlap_max;
+    bool is_vslam_fallback_frame = m_stage_handle->m_use_fallback && !frame->hasAccuratePose() && m_stage_handle->estimatePercOverlap(frame) < overlap_max_fallback;
 
     // Keyframes to be published (big data packages -> publish only if needed)
     if (is_gnss_frame || is_vslam_frame || is_vslam_fallback_frame)
@@ -635,6 +1081,7 @@ bool PoseEstimationIO::process()
     m_stage_handle->m_img_debug.release();
   }
   publishScheduled();
+  flushBatch();
   return false;
 }
 
@@ -643,12 +1090,15 @@ void PoseEstimationIO::reset()
   std::unique_lock<std::mutex> lock(m_mutex_reset_requested);
   m_is_time_ref_set = false;
   m_t_ref = TimeReference{0, 0};
+  m_batch = PoseEstimation::PublishBatch();
+  m_sparse_clouds_pending.clear();
+  m_t_last_sparse_cloud = 0;
   m_reset_requested = false;
 }
 
 void PoseEstimationIO::publishPose(const Frame::Ptr &frame)
 {
-  LOG_F(INFO, "Publishing pose of frame #%u...", frame->getFrameId());
+  LOG_FRAME_F(INFO, "Publishing pose of frame #%u...", frame->getFrameId());
 
   // Save trajectories
   if (m_stage_handle->m_settings_save.save_trajectory_gnss || m_stage_handle->m_settings_save.save_trajectory_visual)
@@ -660,7 +1110,7 @@ void PoseEstimationIO::publishPose(const Frame::Ptr &frame)
   if (m_stage_handle->m_settings_save.save_trajectory_visual && frame->isKeyframe())
     io::saveTrajectory(frame->getTimestamp(), frame->getPose(), m_stage_handle->m_stage_path + "/trajectory/kf_traj_TUM.txt");
 
-  m_stage_handle->m_transport_pose(frame->getPose(), frame->getGnssUtm().zone, frame->getGnssUtm().band, "output/pose/visual");
+  m_batch.poses.push_back(frame);
 }
 
 void PoseEstimationIO::publishSparseCloud(const Frame::Ptr &frame)
@@ -669,13 +1119,16 @@ void PoseEstimationIO::publishSparseCloud(const Frame::Ptr &frame)
   if (!sparse_cloud || sparse_cloud->empty())
     return;
 
-  m_stage_handle->m_transport_pointcloud(sparse_cloud, "output/pointcloud");
+  // With a limited publish rate only the newest cloud is kept until the interval elapsed
+  if (m_stage_handle->m_publish_sparse_cloud_rate > 0.0)
+    m_sparse_clouds_pending.clear();
+  m_sparse_clouds_pending.push_back(sparse_cloud);
 }
 
 void PoseEstimationIO::publishFrame(const Frame::Ptr &frame)
 {
   // First update statistics about outgoing frame rate
-  m_stage_handle->updateStatisticsOutgoing();
+  m_stage_handle->updateStatisticsOutgoing(frame);
 
   // Two situation can occure, when publishing a frame is triggered
   // 1) Frame is marked as keyframe by the SLAM -> publish directly
@@ -685,17 +1138,17 @@ void PoseEstimationIO::publishFrame(const Frame::Ptr &frame)
 
   publishSparseCloud(frame);
 
-  m_stage_handle->m_transport_frame(frame, "output/frame");
+  m_batch.frames.push_back(frame);
   m_stage_handle->printGeoReferenceInfo(frame);
 
 #ifdef WITH_EXIV2
   // Save image related data only if Exiv2 is enabled
   if (m_stage_handle->m_settings_save.save_frames && !frame->isKeyframe())
-    io::saveExifImage(frame, m_stage_handle->m_stage_path + "/frames", "frames", frame->getFrameId(), true);
+    m_stage_handle->saveExifImageAsync(frame, "frames", "frames", true);
   if (m_stage_handle->m_settings_save.save_keyframes && frame->isKeyframe())
-    io::saveExifImage(frame, m_stage_handle->m_stage_path + "/keyframes", "keyframe", frame->getFrameId(), true);
+    m_stage_handle->saveExifImageAsync(frame, "keyframes", "keyframe", true);
   if (m_stage_handle->m_settings_save.save_keyframes_full && frame->isKeyframe())
-    io::saveExifImage(frame, m_stage_handle->m_stage_path + "/keyframes_full", "keyframe_full", frame->getFrameId(), false);
+    m_stage_handle->saveExifImageAsync(frame, "keyframes_full", "keyframe_full", false);
 #else
   if (m_stage_handle->m_settings_save.save_frames && !frame->isKeyframe())
     LOG_F(WARNING, "Exiv2 Library required for save frames from pose_estimation!");
@@ -730,16 +1183,18 @@ void PoseEstimationIO::scheduleFrame(const Frame::Ptr &frame)
   // Time until schedule
   long t_remain = ((long)dt) - (getCurrentTimeMilliseconds() - m_t_ref.first);
 
-  LOG_F(INFO, "Scheduled publish frame #%u in %4.2fs", frame->getFrameId(), (double)t_remain/10e3);
+  LOG_FRAME_F(INFO, "Scheduled publish frame #%u in %4.2fs", frame->getFrameId(), (double)t_remain/10e3);
 }
 
 void PoseEstimationIO::publishScheduled()
 {
-  if (m_schedule.empty())
-    return;
-  Task task = m_schedule.front();
-  if (task.first < (getCurrentTimeMilliseconds() - m_t_ref.first))
+  // All tasks that are due are published in the same wakeup
+  while (!m_schedule.empty())
   {
+    Task task = m_schedule.front();
+    if (task.first >= (getCurrentTimeMilliseconds() - m_t_ref.first))
+      break;
+
     m_mutex_schedule.lock();
     m_schedule.pop_front();
     m_mutex_schedule.unlock();
@@ -756,4 +1211,38 @@ void PoseEstimationIO::publishAll()
   }
   m_schedule.clear();
   m_mutex_schedule.unlock();
+
+  flushBatch();
+}
+
+void PoseEstimationIO::flushBatch()
+{
+  double rate = m_stage_handle->m_publish_sparse_cloud_rate;
+  long t_now = getCurrentTimeMilliseconds();
+  if (!m_sparse_clouds_pending.empty()
+      && (rate <= 0.0 || static_cast<double>(t_now - m_t_last_sparse_cloud) >= 1000.0 / rate))
+  {
+    m_batch.sparse_clouds.swap(m_sparse_clouds_pending);
+    m_sparse_clouds_pending.clear();
+    m_t_last_sparse_cloud = t_now;
+  }
+
+  if (m_batch.empty())
+    return;
+
+  if (m_stage_handle->m_transport_publish_batch)
+  {
+    m_stage_handle->m_transport_publish_batch(m_batch);
+  }
+  else
+  {
+    for (const auto &frame : m_batch.poses)
+      m_stage_handle->m_transport_pose(frame->getPose(), frame->getGnssUtm().zone, frame->getGnssUtm().band, "output/pose/visual");
+    for (const auto &sparse_cloud : m_batch.sparse_clouds)
+      m_stage_handle->m_transport_pointcloud(sparse_cloud, "output/pointcloud");
+    for (const auto &frame : m_batch.frames)
+      m_stage_handle->m_transport_frame(frame, "output/frame");
+  }
+
+  m_batch = PoseEstimation::PublishBatch();
 }
@@ -0,0 +1,156 @@
+
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+#include <realm_core/loguru.h>
+#include <realm_stages/quality_controller.h>
+
+using namespace realm;
+using namespace stages;
+
+QualityController::QualityController(int nrof_levels, int nrof_updates_recover, double th_fps_ratio)
+: m_nrof_levels(nrof_levels),
+  m_nrof_updates_recover(nrof_updates_recover),
+  m_th_fps_ratio(th_fps_ratio),
+  m_level(0),
+  m_nrof_updates_calm(0)
+{
+  if (m_nrof_levels < 1)
+    throw(std::invalid_argument("Error creating quality controller: Number of levels must be > 0!"));
+  if (m_nrof_updates_recover < 1)
+    throw(std::invalid_argument("Error creating quality controller: Number of updates to recover must be > 0!"));
+  if (m_th_fps_ratio < 0.0 || m_th_fps_ratio > 1.0)
+    throw(std::invalid_argument("Error creating quality controller: Fps ratio must be in range [0, 1]!"));
+}
+
+QualityController::~QualityController()
+{
+  stop();
+}
+
+void QualityController::watch(const StageBase::Ptr &stage)
+{
+  if (!stage)
+    throw(std::invalid_argument("Error watching stage: Stage is not set!"));
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (const auto &watched : m_stages)
+    if (watched.stage == stage)
+      return;
+
+  // Only frames dropped from now on count as overload
+  m_stages.push_back(WatchedStage{stage, stage->getStageStatistics().frames_dropped});
+}
+
+void QualityController::addKnob(const Knob &knob)
+{
+  if (!knob.stage)
+    throw(std::invalid_argument("Error adding knob '" + knob.name + "': Stage is not set!"));
+
+  watch(knob.stage);
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_knobs.push_back(knob);
+  applyKnob(knob);
+}
+
+void QualityController::start(const std::chrono::milliseconds &period)
+{
+  m_timer = std::make_shared<Timer>(period, [this]{ update(); });
+}
+
+void QualityController::stop()
+{
+  // Blocks until a running update returned, so the lock must not be held here
+  m_timer = nullptr;
+}
+
+int QualityController::update()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  bool is_overloaded = false;
+  bool is_idle = true;
+  for (auto &watched : m_stages)
+  {
+    bool is_stage_idle;
+    if (isOverloaded(watched, is_stage_idle))
+    {
+      LOG_IF_F(INFO, m_level < m_nrof_levels, "Stage '%s' is overloaded.", watched.stage->getStageName().c_str());
+      is_overloaded = true;
+    }
+    is_idle = is_idle && is_stage_idle;
+  }
+
+  int level = m_level;
+  if (is_overloaded)
+  {
+    m_nrof_updates_calm = 0;
+    level = std::min(m_level + 1, m_nrof_levels);
+  }
+  else if (is_idle && ++m_nrof_updates_calm >= m_nrof_updates_recover)
+  {
+    m_nrof_updates_calm = 0;
+    level = std::max(m_level - 1, 0);
+  }
+  else if (!is_idle)
+    m_nrof_updates_calm = 0;
+
+  if (level != m_level)
+  {
+    LOG_F(INFO, "Changing quality level from %i to %i of %i.", m_level, level, m_nrof_levels);
+    m_level = level;
+    applyLevel();
+  }
+  return m_level;
+}
+
+int QualityController::getLevel() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_level;
+}
+
+double QualityController::computeValue(const Knob &knob, int level, int nrof_levels)
+{
+  double t = static_cast<double>(std::min(std::max(level, 0), nrof_levels)) / nrof_levels;
+  double value = knob.value_full + (knob.value_lowest - knob.value_full) * t;
+  return (knob.is_integer ? std::round(value) : value);
+}
+
+bool QualityController::isOverloaded(WatchedStage &watched, bool &is_idle) const
+{
+  StageStatistics statistics = watched.stage->getStageStatistics();
+  is_idle = (statistics.queue_depth <= 1);
+
+  bool has_dropped = (statistics.frames_dropped > watched.frames_dropped);
+  watched.frames_dropped = statistics.frames_dropped;
+
+  bool is_behind = (m_th_fps_ratio > 0.0 && statistics.fps_in > 0.0f
+                    && statistics.fps_out < statistics.fps_in * m_th_fps_ratio);
+
+  return has_dropped || is_behind || watched.stage->isSaturated();
+}
+
+void QualityController::applyLevel() const
+{
+  for (const auto &knob : m_knobs)
+    applyKnob(knob);
+}
+
+void QualityController::applyKnob(const Knob &knob) const
+{
+  double value = computeValue(knob, m_level, m_nrof_levels);
+
+  std::stringstream ss;
+  if (knob.is_integer)
+    ss << static_cast<long>(value);
+  else
+    ss << value;
+
+  if (!knob.stage->changeParam(knob.name, ss.str()))
+    LOG_F(WARNING, "Stage '%s' did not accept '%s' = %s.", knob.stage->getStageName().c_str(), knob.name.c_str(), ss.str().c_str());
+}
@@ -1,6 +1,11 @@
 
 
+#include <algorithm>
+#include <future>
+
 #include <realm_core/loguru.h>
+#include <realm_core/scoped_timer.h>
+#include <realm_io/cv_export.h>
 
 #include <realm_stages/stage_base.h>
 
@@ -36,9 +41,14 @@ void StageBase::initStagePath(const std::string &abs_path)
   // Init logging if enabled
   if (m_log_to_file)
   {
-    loguru::add_file((m_stage_path + "/stage.log").c_str(), loguru::Append, loguru::Verbosity_MAX);
+    // Written by a background thread, so slow storage does not stall the stages while logging
+    m_log_sink.reset();
+    m_log_sink = std::make_shared<AsyncLogSink>(m_stage_path + "/stage.log", loguru::Verbosity_MAX);
   }
 
+  // Timings of all stages are recorded into one common file, see tools/analyze/analyze_timing.py
+  TimingRecorder::instance().open(abs_path + "/timing.bin");
+
   LOG_F(INFO, "Successfully initialized!");
   LOG_F(INFO, "Stage path set to: %s", m_stage_path.c_str());
   printSettingsToLog();
@@ -48,9 +58,22 @@ StageStatistics StageBase::getStageStatistics()
 {
   std::unique_lock<std::mutex> lock(m_mutex_statistics);
   m_stage_statistics.queue_depth = getQueueDepth();
+  m_stage_statistics.queue_latency = m_histogram_queue_latency.getPercentiles();
+  m_stage_statistics.process_latency = getProcessingHistogram().getPercentiles();
+  m_stage_statistics.frame_age = m_histogram_frame_age.getPercentiles();
   return m_stage_statistics;
 }
 
+size_t StageBase::getMemoryUsage()
+{
+  return 0;
+}
+
+std::string StageBase::getStageName() const
+{
+  return m_stage_name;
+}
+
 void StageBase::registerAsyncDataReadyFunctor(const std::function<bool()> &func)
 {
   // Return true if either the functor evaluates to true, or when a finish is requested.
@@ -82,16 +105,190 @@ void StageBase::registerImageTransport(const std::function<void(const cv::Mat&,
   m_transport_img = func;
 }
 
+void StageBase::registerCompressedImageTransport(const CompressedImageTransportFunc &func, double scale, int quality)
+{
+  if (scale <= 0.0 || scale > 1.0)
+    throw(std::invalid_argument("Error registering compressed image transport: Scale must be in range (0, 1]"));
+
+  std::string stage_name = m_stage_name;
+  m_transport_img = [func, scale, quality, stage_name](const cv::Mat &img, const std::string &topic)
+  {
+    std::vector<uint8_t> data;
+    std::string format;
+    if (io::encodeImageCompressed(img, scale, quality, data, format))
+      func(data, format, topic);
+    else
+      LOG_F(WARNING, "[%s] Image on '%s' of type %i can not be compressed. Dropping it.", stage_name.c_str(), topic.c_str(), img.type());
+  };
+}
+
 void StageBase::registerMeshTransport(const std::function<void(const std::vector<Face>&, const std::string&)> &func)
 {
   m_transport_mesh = func;
 }
 
+void StageBase::registerMeshTileTransport(const MeshTileTransportFunc &func)
+{
+  m_transport_mesh_tiles = func;
+}
+
 void StageBase::registerCvGridMapTransport(const std::function<void(const CvGridMap &, uint8_t zone, char band, const std::string&)> &func)
 {
   m_transport_cvgridmap = func;
 }
 
+void StageBase::registerCvGridMapDeltaTransport(const CvGridMapDeltaTransportFunc &func)
+{
+  m_transport_cvgridmap_delta = func;
+}
+
+void StageBase::registerBackpressure(const std::function<bool()> &func)
+{
+  m_is_downstream_saturated = func;
+}
+
+bool StageBase::isSaturated()
+{
+  return getQueueDepth() >= static_cast<uint32_t>(std::max(m_queue_size, 1)) || isDownstreamSaturated();
+}
+
+bool StageBase::isDownstreamSaturated() const
+{
+  return m_is_downstream_saturated && m_is_downstream_saturated();
+}
+
+bool StageBase::isMemoryBudgetExceeded() const
+{
+  return m_memory_budget && m_memory_budget->isExceeded();
+}
+
+void StageBase::registerFrameScore(const FrameScoreFunc &func)
+{
+  m_frame_score = func;
+}
+
+double StageBase::scoreFrame(const Frame::Ptr &frame) const
+{
+  if (m_frame_score)
+    return m_frame_score(frame);
+  return 0.0;
+}
+
+ThreadScheduling StageBase::readThreadScheduling(const SettingsBase &settings, const std::string &prefix)
+{
+  ThreadScheduling scheduling;
+  if (settings.has(prefix + "_cpus"))
+    scheduling.cpus = parseCpuList(settings[prefix + "_cpus"].toString());
+  if (settings.has(prefix + "_nice"))
+    scheduling.nice = settings[prefix + "_nice"].toInt();
+  if (settings.has(prefix + "_realtime_priority"))
+    scheduling.realtime_priority = settings[prefix + "_realtime_priority"].toInt();
+  return scheduling;
+}
+
+StageBase::FrameScoreFunc StageBase::createCoverageScore()
+{
+  // Reference plane is the same as in the pose estimation
+  cv::Mat plane_pt = (cv::Mat_<double>(3, 1) << 0.0, 0.0, 0.0);
+  cv::Mat plane_n = (cv::Mat_<double>(3, 1) << 0.0, 0.0, 1.0);
+  auto roi_prev = std::make_shared<cv::Rect2d>(0.0, 0.0, 0.0, 0.0);
+
+  return [=](const Frame::Ptr &frame)
+  {
+    cv::Rect2d roi_curr = frame->getCamera()->projectImageBoundsToPlaneRoi(plane_pt, plane_n);
+    if (roi_curr.area() <= 0.0)
+      return 0.0;
+
+    double overlap = (roi_curr & *roi_prev).area() / roi_curr.area();
+    *roi_prev = roi_curr;
+    return 1.0 - overlap;
+  };
+}
+
+void StageBase::processFramesInFlight(const std::vector<Frame::Ptr> &frames,
+                                      const std::function<void(const Frame::Ptr&)> &compute,
+                                      const std::function<void(const Frame::Ptr&)> &finalize)
+{
+  if (frames.size() == 1)
+  {
+    frames.front()->addTraceEvent(m_stage_name, TraceEvent::PROCESS_START);
+    compute(frames.front());
+    finalize(frames.front());
+    return;
+  }
+
+  std::vector<std::future<void>> futures;
+  for (const auto &frame : frames)
+  {
+    if (m_thread_pool != nullptr)
+      futures.push_back(m_thread_pool->submit([this, &compute, frame]{
+        frame->addTraceEvent(m_stage_name, TraceEvent::PROCESS_START);
+        compute(frame);
+      }));
+    else
+      futures.push_back(std::async(std::launch::async, [this, &compute, frame]{
+        frame->addTraceEvent(m_stage_name, TraceEvent::PROCESS_START);
+        compute(frame);
+      }));
+  }
+
+  for (size_t i = 0; i < frames.size(); ++i)
+  {
+    try
+    {
+      futures[i].get();
+      finalize(frames[i]);
+    }
+    catch(...)
+    {
+      // Frames still in flight reference the processing functions, so they have to be finished before leaving
+      for (size_t j = i + 1; j < futures.size(); ++j)
+        futures[j].wait();
+      throw;
+    }
+  }
+}
+
+void StageBase::setThreadPool(const ThreadPool::Ptr &thread_pool)
+{
+  m_thread_pool = thread_pool;
+}
+
+void StageBase::setTraceExporter(const io::TraceExporter::Ptr &exporter)
+{
+  m_trace_exporter = exporter;
+}
+
+void StageBase::setInputCapture(const io::FrameSnapshotWriter::Ptr &writer)
+{
+  std::lock_guard<std::mutex> lock(m_mutex_statistics);
+  m_input_capture = writer;
+}
+
+void StageBase::setMemoryBudget(const MemoryBudget::Ptr &budget)
+{
+  m_memory_budget = budget;
+}
+
+void StageBase::setExportService(const io::ExportService::Ptr &service)
+{
+  m_export_service = service;
+}
+
+void StageBase::submitExport(const io::ExportService::Job &job)
+{
+  if (m_export_service == nullptr)
+    m_export_service = std::make_shared<io::ExportService>(1);
+  if (!m_export_service->submit(m_stage_name + "::saveIter", job))
+    LOG_F(WARNING, "Exports can not keep up, results of an earlier iteration were dropped.");
+}
+
+void StageBase::waitForExports()
+{
+  if (m_export_service != nullptr)
+    m_export_service->flush();
+}
+
 void StageBase::setStatisticsPeriod(uint32_t s)
 {
   std::unique_lock<std::mutex> lock(m_mutex_statistics);
@@ -107,13 +304,45 @@ void StageBase::logCurrentStatistics() const
   LOG_F(INFO, "Dropped frames: %i ", m_stage_statistics.frames_dropped);
   LOG_F(INFO, "Fps in: %4.2f ", m_stage_statistics.fps_in);
   LOG_F(INFO, "Fps out: %4.2f ", m_stage_statistics.fps_out);
+  LOG_F(INFO, "Memory usage: %4.2f MB", static_cast<double>(m_stage_statistics.memory_usage) / (1024.0 * 1024.0));
+
+  LatencyPercentiles queue_latency = m_histogram_queue_latency.getPercentiles();
+  LatencyPercentiles frame_age = m_histogram_frame_age.getPercentiles();
+  LOG_F(INFO, "Queue latency [p50, p90, p99, p99.9, max]: %4.2f, %4.2f, %4.2f, %4.2f, %4.2f ms",
+        queue_latency.p50, queue_latency.p90, queue_latency.p99, queue_latency.p999, queue_latency.max);
+  LOG_F(INFO, "Frame age [p50, p90, p99, p99.9, max]: %4.2f, %4.2f, %4.2f, %4.2f, %4.2f ms",
+        frame_age.p50, frame_age.p90, frame_age.p99, frame_age.p999, frame_age.max);
 }
 
-void StageBase::updateStatisticsIncoming()
+void StageBase::updateStatisticsIncoming(const Frame::Ptr &frame)
 {
+  frame->addTraceEvent(m_stage_name, TraceEvent::ENQUEUED);
+
+  io::FrameSnapshotWriter::Ptr input_capture;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex_statistics);
+    input_capture = m_input_capture;
+  }
+  if (input_capture)
+  {
+    try
+    {
+      input_capture->write(frame);
+    }
+    catch (std::exception &e)
+    {
+      LOG_F(ERROR, "Capturing frame #%u failed: %s", frame->getFrameId(), e.what());
+    }
+  }
+
   std::unique_lock<std::mutex> lock(m_mutex_statistics);
   m_counter_frames_in++;
   m_stage_statistics.frames_total++;
+
+  // Frames that are dropped later never get processed, so the oldest entries are removed in case of restarting ids
+  m_t_frames_queued[frame->getFrameId()] = Timer::getCurrentTimeMicroseconds();
+  while (m_t_frames_queued.size() > static_cast<size_t>(4*std::max(m_queue_size, 1)))
+    m_t_frames_queued.erase(m_t_frames_queued.begin());
 }
 
 void StageBase::updateStatisticsSkippedFrame()
@@ -128,18 +357,43 @@ void StageBase::updateStatisticsBadFrame()
   m_stage_statistics.frames_bad++;
 }
 
-void StageBase::updateStatisticsProcessedFrame()
+void StageBase::updateStatisticsProcessedFrame(const Frame::Ptr &frame)
 {
+  size_t memory_usage = getMemoryUsage();
+  if (m_memory_budget)
+    m_memory_budget->update(m_stage_name, memory_usage);
+
   std::unique_lock<std::mutex> lock(m_mutex_statistics);
   m_stage_statistics.frames_processed++;
+  m_stage_statistics.memory_usage = memory_usage;
+
+  if (frame == nullptr)
+    return;
+  frame->addTraceEvent(m_stage_name, TraceEvent::DEQUEUED);
+
+  auto it = m_t_frames_queued.find(frame->getFrameId());
+  if (it != m_t_frames_queued.end())
+    m_histogram_queue_latency.add(static_cast<double>(Timer::getCurrentTimeMicroseconds() - it->second) / 1000.0);
+
+  // Queues are processed in order, so all older entries belong to dropped frames
+  m_t_frames_queued.erase(m_t_frames_queued.begin(), m_t_frames_queued.upper_bound(frame->getFrameId()));
 }
 
-void StageBase::updateStatisticsOutgoing()
+void StageBase::updateStatisticsOutgoing(const Frame::Ptr &frame)
 {
+    frame->addTraceEvent(m_stage_name, TraceEvent::PROCESS_END);
+    if (m_trace_exporter)
+      m_trace_exporter->add(frame);
+
     std::unique_lock<std::mutex> lock(m_mutex_statistics);
     m_counter_frames_out++;
     m_stage_statistics.process_statistics = getProcessingStatistics();
 
+    // Frames without or with a future timestamp, e.g. from replayed datasets, have no meaningful age
+    auto t_now = static_cast<uint64_t>(Timer::getCurrentTimeNanoseconds());
+    if (frame->getTimestamp() > 0 && frame->getTimestamp() <= t_now)
+      m_histogram_frame_age.add(static_cast<double>(t_now - frame->getTimestamp()) / 1e6);
+
     uint32_t queue_depth = getQueueDepth();
     if (m_stage_statistics.queue_statistics.count == 0) {
       m_stage_statistics.queue_statistics.min = queue_depth;
@@ -167,4 +421,7 @@ void StageBase::evaluateStatistic()
 
   m_stage_statistics.fps_in = fps_in;
   m_stage_statistics.fps_out = fps_out;
+  lock.unlock();
+
+  TimingRecorder::instance().flush();
 }
\ No newline at end of file
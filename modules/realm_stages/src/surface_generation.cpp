@@ -1,6 +1,9 @@
 
 
+#include <algorithm>
+
 #include <realm_core/loguru.h>
+#include <realm_core/scoped_timer.h>
 
 #include <realm_stages/surface_generation.h>
 
@@ -8,34 +11,50 @@ using namespace realm;
 using namespace stages;
 using namespace realm::ortho;
 
+namespace
+{
+
+// Points of a sparse cloud sampled per frame for the terrain estimate
+const size_t g_nrof_terrain_samples = 256;
+
+// Weight of a new frame in the running terrain estimate
+const double g_terrain_smoothing = 0.2;
+
+} // namespace
+
 SurfaceGeneration::SurfaceGeneration(const StageSettings::Ptr &settings, double rate)
 : StageBase("surface_generation", (*settings)["path_output"].toString(), rate, (*settings)["queue_size"].toInt(), bool((*settings)["log_to_file"].toInt())),
-  m_try_use_elevation((*settings)["try_use_elevation"].toInt() > 0),
-  m_compute_all_frames((*settings)["compute_all_frames"].toInt() > 0),
-  m_knn_max_iter((*settings)["knn_max_iter"].toInt()),
+  m_params(std::make_shared<const RuntimeParams>(RuntimeParams{(*settings)["try_use_elevation"].toInt() > 0,
+                                                                (*settings)["compute_all_frames"].toInt() > 0,
+                                                                (*settings)["knn_max_iter"].toInt()})),
+  m_nrof_threads((*settings)["nrof_threads"].toInt()),
+  m_dsm_rasterize_depthmap((*settings)["dsm_rasterize_depthmap"].toInt() > 0),
+  m_dsm_coarse_step((*settings)["dsm_coarse_step"].toInt()),
+  m_dsm_th_flatness((*settings)["dsm_th_flatness"].toDouble()),
+  m_dsm_neighbour_index(static_cast<NeighbourIndex2D::Type>((*settings)["dsm_neighbour_index"].toInt())),
+  m_frames_in_flight((*settings)["frames_in_flight"].toInt()),
   m_is_projection_plane_offset_computed(false),
   m_projection_plane_offset(0.0),
+  m_th_relief_planar((*settings)["th_relief_planar"].toDouble()),
+  m_terrain(TerrainModel{false, 0.0, 0.0, false}),
   m_mode_surface_normals(static_cast<DigitalSurfaceModel::SurfaceNormalMode>((*settings)["mode_surface_normals"].toInt())),
   m_plane_reference(Plane{(cv::Mat_<double>(3, 1) << 0.0, 0.0, 0.0), (cv::Mat_<double>(3, 1) << 0.0, 0.0, 1.0)}),
   m_settings_save({(*settings)["save_elevation"].toInt() > 0,
-                  (*settings)["save_normals"].toInt() > 0})
+                  (*settings)["save_normals"].toInt() > 0}),
+  m_buffer(static_cast<size_t>(std::max(m_queue_size, 1)))
 {
+  setThreadScheduling(readThreadScheduling(*settings, "thread"));
   registerAsyncDataReadyFunctor([=]{ return !m_buffer.empty(); });
 }
 
 void SurfaceGeneration::addFrame(const Frame::Ptr &frame)
 {
   // First update statistics about incoming frame rate
-  updateStatisticsIncoming();
+  updateStatisticsIncoming(frame);
 
-  std::unique_lock<std::mutex> lock(m_mutex_buffer);
-  m_buffer.push_back(frame);
-  // Ringbuffer implementation
-  if (m_buffer.size() > m_queue_size)
-  {
+  // Ringbuffer drops the oldest or the incoming frame if full, depending on their score
+  if (!m_buffer.push(frame, scoreFrame(frame)))
     updateStatisticsSkippedFrame();
-    m_buffer.pop_front();
-  }
   notify();
 }
 
@@ -44,101 +63,164 @@ bool SurfaceGeneration::process()
   bool has_processed = false;
   if (!m_buffer.empty())
   {
-    // Prepare timing
-    long t;
+    std::vector<Frame::Ptr> frames;
+    while (!m_buffer.empty() && frames.size() < static_cast<size_t>(std::max(m_frames_in_flight, 1)))
+      frames.push_back(getNewFrame());
 
-    Frame::Ptr frame = getNewFrame();
-    LOG_F(INFO, "Processing frame #%u...", frame->getFrameId());
+    // One snapshot of the runtime parameters for all frames in flight, changes apply from the next iteration on
+    std::shared_ptr<const RuntimeParams> params = std::atomic_load(&m_params);
 
-    // Identify surface assumption for input frame and compute DSM
-    t = getCurrentTimeMilliseconds();
-    DigitalSurfaceModel::Ptr dsm;
-    SurfaceAssumption assumption = computeSurfaceAssumption(frame);
-    switch(assumption)
+    // Surface assumption and planar surfaces depend on the state of the stage, e.g. the projection plane offset. They
+    // are therefore computed in order. Only the expensive elevation surfaces are computed concurrently.
+    for (const auto &frame : frames)
     {
-      case SurfaceAssumption::PLANAR:
-        LOG_F(INFO, "Surface assumption: PLANAR.");
-        dsm = createPlanarSurface(frame);
-        break;
-      case SurfaceAssumption::ELEVATION:
-        LOG_F(INFO, "Surface assumption: ELEVATION.");
-        dsm = createElevationSurface(frame);
-        break;
+      LOG_F(INFO, "Processing frame #%u...", frame->getFrameId());
+      if (m_th_relief_planar > 0.0 || params->compute_all_frames || !m_is_projection_plane_offset_computed)
+        updateTerrainModel(frame);
+      frame->setSurfaceAssumption(computeSurfaceAssumption(frame, *params));
+      if (frame->getSurfaceAssumption() == SurfaceAssumption::PLANAR)
+        generateSurface(frame);
     }
-    CvGridMap::Ptr surface = dsm->getSurfaceGrid();
-    LOG_IF_F(INFO, m_verbose, "Timing [Compute DSM]: %lu ms", getCurrentTimeMilliseconds() - t);
-
-    // Observed map should be empty at this point, but check before set
-    t = getCurrentTimeMilliseconds();
-    if (!frame->getSurfaceModel())
-      frame->setSurfaceModel(surface);
-    else
-      frame->getSurfaceModel()->add(*surface, REALM_OVERWRITE_ALL, true);
-    frame->setSurfaceAssumption(assumption);
-    LOG_IF_F(INFO, m_verbose, "Timing [Container Add]: %lu ms", getCurrentTimeMilliseconds() - t);
-
-    LOG_F(INFO, "Publishing frame for next stage...");
-
-    // Publishes every iteration
-    t = getCurrentTimeMilliseconds();
-    publish(frame);
-    LOG_IF_F(INFO, m_verbose, "Timing [Publish]: %lu ms", getCurrentTimeMilliseconds() - t);
-
-    // Savings every iteration
-    t = getCurrentTimeMilliseconds();
-    saveIter(*surface, frame->getFrameId());
-    LOG_IF_F(INFO, m_verbose, "Timing [Saving]: %lu ms", getCurrentTimeMilliseconds() - t);
+
+    processFramesInFlight(frames,
+        [this](const Frame::Ptr &frame)
+        {
+          if (frame->getSurfaceAssumption() == SurfaceAssumption::ELEVATION)
+            generateSurface(frame);
+        },
+        [this](const Frame::Ptr &frame)
+        {
+          // Following stages only need the surface model
+          if (isMemoryBudgetExceeded())
+          {
+            frame->releaseDepthmap();
+            frame->releaseSparseCloud();
+          }
+
+          LOG_F(INFO, "Publishing frame for next stage...");
+
+          // Publishes every iteration
+          ScopedTimer timer_publish("Publish");
+          publish(frame);
+          timer_publish.stop();
+
+          // Savings every iteration
+          ScopedTimer timer_saving("Saving");
+          saveIter(*frame->getSurfaceModel(), frame->getFrameId());
+          timer_saving.stop();
+        });
 
     has_processed = true;
   }
   return has_processed;
 }
 
+void SurfaceGeneration::generateSurface(const Frame::Ptr &frame)
+{
+  // Compute DSM for the surface assumption of the frame
+  ScopedTimer timer_compute_dsm("Compute DSM");
+  DigitalSurfaceModel::Ptr dsm;
+  switch(frame->getSurfaceAssumption())
+  {
+    case SurfaceAssumption::PLANAR:
+      LOG_F(INFO, "Surface assumption: PLANAR.");
+      dsm = createPlanarSurface(frame);
+      break;
+    case SurfaceAssumption::ELEVATION:
+      LOG_F(INFO, "Surface assumption: ELEVATION.");
+      dsm = createElevationSurface(frame);
+      break;
+  }
+  CvGridMap::Ptr surface = dsm->getSurfaceGrid();
+  timer_compute_dsm.stop();
+
+  // Observed map should be empty at this point, but check before set
+  ScopedTimer timer_container_add("Container Add");
+  if (!frame->getSurfaceModel())
+    frame->setSurfaceModel(surface);
+  else
+    frame->getSurfaceModel()->add(std::move(*surface), REALM_OVERWRITE_ALL, true);
+  timer_container_add.stop();
+}
+
 bool SurfaceGeneration::changeParam(const std::string& name, const std::string &val)
 {
   std::unique_lock<std::mutex> lock(m_mutex_params);
+  RuntimeParams params = *std::atomic_load(&m_params);
   if (name == "try_use_elevation")
-  {
-    m_try_use_elevation = (val == "true" || val == "1");
-    return true;
-  }
+    params.try_use_elevation = (val == "true" || val == "1");
   else if (name == "compute_all_frames")
+    params.compute_all_frames = (val == "true" || val == "1");
+  else if (name == "knn_max_iter")
   {
-    m_compute_all_frames = (val == "true" || val == "1");
-    return true;
+    try
+    {
+      params.knn_max_iter = std::max(std::stoi(val), 1);
+    }
+    catch (const std::logic_error &)
+    {
+      return false;
+    }
   }
+  else
+    return false;
 
-  return false;
+  // Snapshots still in use by the processing stay valid until it releases them
+  std::atomic_store(&m_params, std::make_shared<const RuntimeParams>(params));
+  return true;
 }
 
 void SurfaceGeneration::reset()
 {
   m_projection_plane_offset = 0.0;
   m_is_projection_plane_offset_computed = false;
+  m_terrain = TerrainModel{false, 0.0, 0.0, false};
 }
 
 void SurfaceGeneration::publish(const Frame::Ptr &frame)
 {
   // First update statistics about outgoing frame rate
-  updateStatisticsOutgoing();
+  updateStatisticsOutgoing(frame);
   m_transport_frame(frame, "output/frame");
 }
 
 void SurfaceGeneration::saveIter(const CvGridMap &surface, uint32_t id)
 {
+  if (!(m_settings_save.save_elevation || m_settings_save.save_normals))
+    return;
+
   // Invalid points are marked with NaN
-  if (!surface["elevation"].empty()) {
-    cv::Mat valid = (surface["elevation"] == surface["elevation"]);
+  if (surface["elevation"].empty())
+  {
+    LOG_F(WARNING, "Elevation surface was empty, skipping saveIter()!");
+    return;
+  }
 
-    if (m_settings_save.save_elevation)
-      io::saveImageColorMap(surface["elevation"], valid, m_stage_path + "/elevation", "elevation", id,
+  // Following stages add to the surface model of the frame, so the export service gets a snapshot
+  std::vector<std::string> layer_names{"elevation"};
+  if (m_settings_save.save_normals && surface.exists("elevation_normal"))
+    layer_names.emplace_back("elevation_normal");
+  auto snapshot = std::make_shared<CvGridMap>(surface.getSubmap(layer_names).clone());
+
+  SaveSettings settings_save = m_settings_save;
+  std::string stage_path = m_stage_path;
+  submitExport([snapshot, settings_save, stage_path, id]()
+  {
+    cv::Mat valid = ((*snapshot)["elevation"] == (*snapshot)["elevation"]);
+
+    if (settings_save.save_elevation)
+      io::saveImageColorMap((*snapshot)["elevation"], valid, stage_path + "/elevation", "elevation", id,
                             io::ColormapType::ELEVATION);
-    if (m_settings_save.save_normals && surface.exists("elevation_normal"))
-      io::saveImageColorMap(surface["elevation_normal"], valid, m_stage_path + "/normals", "normal", id,
+    if (settings_save.save_normals && snapshot->exists("elevation_normal"))
+      io::saveImageColorMap((*snapshot)["elevation_normal"], valid, stage_path + "/normals", "normal", id,
                             io::ColormapType::NORMALS);
-  } else {
-    LOG_F(WARNING, "Elevation surface was empty, skipping saveIter()!");
-  }
+  });
+}
+
+void SurfaceGeneration::finishCallback()
+{
+  // Exports of the last iterations are finished, before the stage reports to be done
+  waitForExports();
 }
 
 void SurfaceGeneration::initStageCallback()
@@ -163,9 +245,18 @@ void SurfaceGeneration::initStageCallback()
 void SurfaceGeneration::printSettingsToLog()
 {
   LOG_F(INFO, "### Stage process settings ###");
-  LOG_F(INFO, "- try_use_elevation: %i", m_try_use_elevation);
-  LOG_F(INFO, "- compute_all_frames: %i", m_compute_all_frames);
+  std::shared_ptr<const RuntimeParams> params = std::atomic_load(&m_params);
+  LOG_F(INFO, "- try_use_elevation: %i", params->try_use_elevation);
+  LOG_F(INFO, "- compute_all_frames: %i", params->compute_all_frames);
+  LOG_F(INFO, "- knn_max_iter: %i", params->knn_max_iter);
   LOG_F(INFO, "- mode_surface_normals: %i", static_cast<int>(m_mode_surface_normals));
+  LOG_F(INFO, "- nrof_threads: %i", m_nrof_threads);
+  LOG_F(INFO, "- dsm_rasterize_depthmap: %i", m_dsm_rasterize_depthmap);
+  LOG_F(INFO, "- dsm_coarse_step: %i", m_dsm_coarse_step);
+  LOG_F(INFO, "- dsm_th_flatness: %4.2f", m_dsm_th_flatness);
+  LOG_F(INFO, "- dsm_neighbour_index: %i", static_cast<int>(m_dsm_neighbour_index));
+  LOG_F(INFO, "- frames_in_flight: %i", m_frames_in_flight);
+  LOG_F(INFO, "- th_relief_planar: %4.2f", m_th_relief_planar);
 
   LOG_F(INFO, "### Stage save settings ###");
   LOG_F(INFO, "- save_elevation: %i", m_settings_save.save_elevation);
@@ -179,20 +270,67 @@ uint32_t SurfaceGeneration::getQueueDepth() {
 
 Frame::Ptr SurfaceGeneration::getNewFrame()
 {
-  std::unique_lock<std::mutex> lock(m_mutex_buffer);
-  Frame::Ptr frame = m_buffer.front();
-  m_buffer.pop_front();
-  updateStatisticsProcessedFrame();
+  Frame::Ptr frame;
+  m_buffer.pop(frame);
+  updateStatisticsProcessedFrame(frame);
   return (std::move(frame));
 }
 
-SurfaceAssumption SurfaceGeneration::computeSurfaceAssumption(const Frame::Ptr &frame)
+void SurfaceGeneration::updateTerrainModel(const Frame::Ptr &frame)
 {
-  std::unique_lock<std::mutex> lock(m_mutex_params);
-  if (m_try_use_elevation && frame->isKeyframe() && frame->hasAccuratePose())
+  // If scene depth is computed, there is definitely enough sparse points
+  if (!frame->isDepthComputed())
+    return;
+
+  auto sparse_cloud = frame->getSparseCloud();
+  const std::vector<cv::Point3f> &positions = sparse_cloud->getPositions();
+  if (positions.empty())
+    return;
+
+  // Evenly strided subsample, so the cost does not grow with the size of the cloud
+  size_t stride = std::max(positions.size() / g_nrof_terrain_samples, static_cast<size_t>(1));
+  std::vector<double> z_coord;
+  z_coord.reserve(positions.size() / stride + 1);
+  for (size_t i = 0; i < positions.size(); i += stride)
+    z_coord.push_back(sparse_cloud->getOrigin().z + positions[i].z);
+
+  auto percentile = [&](double p)
+  {
+    auto it = z_coord.begin() + static_cast<long>(p * static_cast<double>(z_coord.size() - 1));
+    std::nth_element(z_coord.begin(), it, z_coord.end());
+    return *it;
+  };
+  double elevation = percentile(0.5);
+  double relief = percentile(0.9) - percentile(0.1);
+
+  if (m_terrain.has_estimate)
+  {
+    m_terrain.elevation += g_terrain_smoothing * (elevation - m_terrain.elevation);
+    m_terrain.relief += g_terrain_smoothing * (relief - m_terrain.relief);
+  }
+  else
+  {
+    m_terrain.elevation = elevation;
+    m_terrain.relief = relief;
+    m_terrain.has_estimate = true;
+  }
+
+  // Hysteresis, so the surface assumption does not toggle for terrain with a relief close to the threshold
+  if (m_th_relief_planar > 0.0)
+  {
+    bool is_flat = (m_terrain.is_flat ? m_terrain.relief <= m_th_relief_planar : m_terrain.relief < 0.5 * m_th_relief_planar);
+    LOG_IF_F(INFO, is_flat != m_terrain.is_flat, "Terrain relief is %4.2fm, switching to %s surfaces.",
+             m_terrain.relief, is_flat ? "planar" : "elevation");
+    m_terrain.is_flat = is_flat;
+  }
+}
+
+SurfaceAssumption SurfaceGeneration::computeSurfaceAssumption(const Frame::Ptr &frame, const RuntimeParams &params)
+{
+  if (params.try_use_elevation && frame->isKeyframe() && frame->hasAccuratePose())
   {
     LOG_F(INFO, "Frame is accurate and keyframe. Checking for dense information...");
-    if (frame->getDepthmap())
+    if (frame->getDepthmap() && !m_terrain.is_flat)
       return SurfaceAssumption::ELEVATION;
   }
   return SurfaceAssumption::PLANAR;
@@ -202,17 +340,10 @@ double SurfaceGeneration::computeProjectionPlaneOffset(const Frame::Ptr &frame)
 {
   double offset = 0.0;
 
-  // If scene depth is computed, there is definitely enough sparse points
-  if (frame->isDepthComputed())
+  // Sparse cloud of the frame was added to the terrain estimate before
+  if (frame->isDepthComputed() && m_terrain.has_estimate)
   {
-    std::vector<double> z_coord;
-
-    cv::Mat points = frame->getSparseCloud()->data();
-    for (int i = 0; i < points.rows; ++i)
-      z_coord.push_back(points.at<double>(i, 2));
-
-    sort(z_coord.begin(), z_coord.end());
-    offset = z_coord[(z_coord.size() - 1) / 2];
+    offset = m_terrain.elevation;
 
     LOG_F(INFO, "Sparse cloud was utilized to compute an initial projection plane at elevation = %4.2f.", offset);
 
@@ -229,7 +360,7 @@ double SurfaceGeneration::computeProjectionPlaneOffset(const Frame::Ptr &frame)
 
 DigitalSurfaceModel::Ptr SurfaceGeneration::createPlanarSurface(const Frame::Ptr &frame)
 {
-  if (!m_is_projection_plane_offset_computed || m_compute_all_frames)
+  if (!m_is_projection_plane_offset_computed || std::atomic_load(&m_params)->compute_all_frames)
   {
     m_projection_plane_offset = computeProjectionPlaneOffset(frame);
   }
@@ -248,13 +379,40 @@ DigitalSurfaceModel::Ptr SurfaceGeneration::createElevationSurface(const Frame::
   // Create elevated 2.5D surface in world frame
   cv::Rect2d roi = frame->getCamera()->projectImageBoundsToPlaneRoi(m_plane_reference.pt, m_plane_reference.n);
 
+  // Rasterization is linear in the number of depth pixels and needs no point cloud at all
+  if (m_dsm_rasterize_depthmap)
+    return std::make_shared<DigitalSurfaceModel>(roi, depthmap, m_mode_surface_normals, m_nrof_threads, m_thread_pool);
+
   // We reproject the depthmap into a 3D point cloud first, before creating the surface model
-  cv::Mat img3d = stereo::reprojectDepthMap(depthmap->getCamera(), depthmap->data());
+  cv::Mat img3d = stereo::reprojectDepthMap(depthmap->getCamera(), depthmap->data(), m_thread_pool, m_nrof_threads);
 
   // We want to organize the point cloud with row(i) = x, y, z. Therefore we have to reshape the matrix, which right
   // now is a 3 channel matrix with a point at every pixel. Reshaping the channel to 1 dimension results in a
   // 1x(cols*rows*3) matrix. But we want a new point in every row. Therefore the number of rows must be rows*cols.
   cv::Mat dense_cloud = img3d.reshape(1, img3d.rows*img3d.cols);
 
-  return std::make_shared<DigitalSurfaceModel>(roi, dense_cloud, m_mode_surface_normals, m_knn_max_iter);
+  // Index of the dense cloud is rebuilt in the buffers of a previous frame
+  NeighbourIndex2D::Ptr index = acquireDsmIndex();
+  int knn_max_iter = std::atomic_load(&m_params)->knn_max_iter;
+  auto dsm = std::make_shared<DigitalSurfaceModel>(roi, dense_cloud, m_mode_surface_normals, knn_max_iter,
+                                                   m_nrof_threads, m_dsm_coarse_step, m_dsm_th_flatness, m_thread_pool,
+                                                   index);
+  releaseDsmIndex(index);
+  return dsm;
+}
+
+NeighbourIndex2D::Ptr SurfaceGeneration::acquireDsmIndex()
+{
+  std::unique_lock<std::mutex> lock(m_mutex_dsm_indices);
+  if (m_dsm_indices.empty())
+    return NeighbourIndex2D::create(m_dsm_neighbour_index);
+  NeighbourIndex2D::Ptr index = m_dsm_indices.back();
+  m_dsm_indices.pop_back();
+  return index;
+}
+
+void SurfaceGeneration::releaseDsmIndex(const NeighbourIndex2D::Ptr &index)
+{
+  std::unique_lock<std::mutex> lock(m_mutex_dsm_indices);
+  m_dsm_indices.push_back(index);
 }
\ No newline at end of file
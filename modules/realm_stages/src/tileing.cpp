@@ -18,7 +18,12 @@
 * along with OpenREALM. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <set>
+
 #include <realm_core/loguru.h>
+#include <realm_core/projection.h>
+#include <realm_core/scoped_timer.h>
 
 #include <realm_stages/tileing.h>
 
@@ -27,13 +32,65 @@ using namespace stages;
 
 Tileing::Tileing(const StageSettings::Ptr &stage_set, double rate)
     : StageBase("tileing", (*stage_set)["path_output"].toString(), rate, (*stage_set)["queue_size"].toInt(), bool((*stage_set)["log_to_file"].toInt())),
+      m_buffer(static_cast<size_t>(std::max(m_queue_size, 1))),
+      m_merge_max_delay((*stage_set)["merge_max_delay"].toInt()),
+      m_frame_merger(m_merge_max_delay, [this](const Frame::Ptr &frame)
+      {
+        // Ringbuffer drops the oldest or the incoming frame if full, depending on their score
+        if (!m_buffer.push(frame, scoreFrame(frame)))
+          updateStatisticsSkippedFrame();
+      }),
       m_utm_reference(nullptr),
+      m_nrof_threads((*stage_set)["nrof_threads"].toInt()),
+      m_nrof_writer_threads((*stage_set)["nrof_writer_threads"].toInt()),
+      m_tile_cache_capacity((*stage_set)["tile_cache_capacity"].toInt()),
+      m_spill_raw_tiles((*stage_set)["spill_raw_tiles"].toInt() > 0),
+      m_use_mbtiles((*stage_set)["use_mbtiles"].toInt() > 0),
+      m_prefetch_frames((*stage_set)["prefetch_frames"].toInt()),
+      m_tile_server_port((*stage_set)["tile_server_port"].toInt()),
+      m_tile_server_address((*stage_set)["tile_server_address"].toString()),
+      m_native_warp_max_cells((*stage_set)["native_warp_max_cells"].toInt()),
+      m_use_blended_input((*stage_set)["use_blended_input"].toInt() > 0),
+      m_nrof_shards((*stage_set)["nrof_shards"].toInt()),
+      m_shard_index((*stage_set)["shard_index"].toInt()),
+      m_shard_zoom_level((*stage_set)["shard_zoom_level"].toInt()),
+      m_zoom_level_min(11),
+      m_timestamp_prev(0),
       m_map_tiler(nullptr),
       m_tile_cache(nullptr),
+      m_tile_server(nullptr),
+      m_checkpoint_store(nullptr),
+      m_checkpoint_every_nth(std::max((*stage_set)["checkpoint_every_nth"].toInt(), 1)),
+      m_nrof_frames_checkpoint(0),
+      m_do_resume_from_checkpoint((*stage_set)["resume_from_checkpoint"].toInt() > 0),
       m_settings_save({})
 {
   std::cout << "Stage [" << m_stage_name << "]: Created Stage with Settings: " << std::endl;
   stage_set->print();
+  setThreadScheduling(readThreadScheduling(*stage_set, "thread"));
+  m_io_thread_scheduling = readThreadScheduling(*stage_set, "io_thread");
+
+  if (m_nrof_shards < 1 || m_shard_index < 0 || m_shard_index >= m_nrof_shards)
+    throw(std::invalid_argument("Error creating tileing: Shard index must be in range [0, nrof_shards)!"));
+  if (m_shard_zoom_level < 11)
+    throw(std::invalid_argument("Error creating tileing: Shard zoom level must not be lower than 11!"));
+
+  // Tiles above the shard zoom level are composed of the tiles of several shards, so no shard can generate them
+  if (m_nrof_shards > 1)
+  {
+    m_zoom_level_min = m_shard_zoom_level;
+    LOG_IF_F(WARNING, m_zoom_level_min > 11, "Tileing generates shard %i of %i, zoom levels below %i are not generated.",
+             m_shard_index, m_nrof_shards, m_zoom_level_min);
+  }
+
+  std::string checkpoint_directory = (*stage_set)["checkpoint_directory"].toString();
+  if (!checkpoint_directory.empty())
+    m_checkpoint_store = std::make_shared<io::CheckpointStore>(checkpoint_directory);
+  else if (m_do_resume_from_checkpoint)
+  {
+    LOG_F(WARNING, "Resume from checkpoint requested, but no checkpoint directory set.");
+    m_do_resume_from_checkpoint = false;
+  }
 
   m_warper.setTargetEPSG(3857);
   m_warper.setNrofThreads(4);
@@ -43,6 +100,10 @@ Tileing::Tileing(const StageSettings::Ptr &stage_set, double rate)
 
 Tileing::~Tileing()
 {
+  // Server reads from the cache, so it is stopped first
+  if (m_tile_server)
+    m_tile_server->stop();
+
   if (m_tile_cache)
   {
     m_tile_cache->requestFinish();
@@ -53,7 +114,7 @@ Tileing::~Tileing()
 void Tileing::addFrame(const Frame::Ptr &frame)
 {
   // First update statistics about incoming frame rate
-  updateStatisticsIncoming();
+  updateStatisticsIncoming(frame);
 
   if (!frame->getSurfaceModel() || !frame->getOrthophoto())
   {
@@ -61,29 +122,28 @@ void Tileing::addFrame(const Frame::Ptr &frame)
     updateStatisticsBadFrame();
     return;
   }
-  std::unique_lock<std::mutex> lock(m_mutex_buffer);
-  m_buffer.push_back(frame);
-
-  // Ringbuffer implementation for buffer with no pose
-  if (m_buffer.size() > m_queue_size)
-  {
-    updateStatisticsSkippedFrame();
-    m_buffer.pop_front();
-  }
+  // Frames of several cameras might arrive concurrently and out of order, they are pushed once merged
+  m_frame_merger.add(frame);
   notify();
 }
 
 bool Tileing::process()
 {
+  m_frame_merger.update();
+
   bool has_processed = false;
   if (!m_buffer.empty() && m_map_tiler && m_tile_cache)
   {
-    // Prepare timing
-    long t;
-
     // Prepare output of incremental map update
     CvGridMap::Ptr map_update;
 
+    // Restored before the first frame, so its tiles are blended with the ones of the interrupted run
+    if (m_do_resume_from_checkpoint)
+    {
+      m_do_resume_from_checkpoint = false;
+      loadCheckpoint();
+    }
+
     Frame::Ptr frame = getNewFrame();
 
     LOG_F(INFO, "Processing frame #%u...", frame->getFrameId());
@@ -91,40 +151,37 @@ bool Tileing::process()
     if (m_utm_reference == nullptr)
       m_utm_reference = std::make_shared<UTMPose>(frame->getGnssUtm());
 
+    // Keep only tiles in memory, that are currently processed, if the pipeline is short on memory
+    m_tile_cache->setAggressiveFlush(isMemoryBudgetExceeded());
+
     //=======================================//
     //
     //   Step 1: Warp data to EPSG3857
     //
     //=======================================//
 
-    t = getCurrentTimeMilliseconds();
+    ScopedTimer timer_warping("Warping");
 
     CvGridMap::Ptr orthophoto = frame->getOrthophoto();
     CvGridMap::Ptr surface_model = frame->getSurfaceModel();
 
     // Create the tiles, that will be visualized and therefore need multiple zoom levels
     CvGridMap::Ptr map = std::make_shared<CvGridMap>(orthophoto->roi(), orthophoto->resolution());
-    map->add(*orthophoto, REALM_OVERWRITE_ALL, false);
-    map->add(*surface_model, REALM_OVERWRITE_ALL, false);
+    map->addView(*orthophoto);
+    map->addView(*surface_model);
     map->remove("num_observations"); // Currently not relevant for blending
 
-    // Transform each layer of the CvGridMap separately to Web Mercator (EPSG:3857)
-    std::vector<CvGridMap::Ptr> maps_3857;
-    for (const auto &layer_name : map->getAllLayerNames())
-    {
-      maps_3857.emplace_back(m_warper.warpRaster(map->getSubmap({layer_name}), m_utm_reference->zone));
-    }
+    // Transform all layers of the CvGridMap to Web Mercator (EPSG:3857) at once. Small updates are projected directly,
+    // because the setup of the GDAL datasets and transformers dominates their warp.
+    CvGridMap::Ptr map_3857;
+    if (map->size().area() <= m_native_warp_max_cells)
+      map_3857 = m_warper_native.warpRaster(*map, m_utm_reference->zone);
+    else
+      map_3857 = m_warper.warpRaster(*map, m_utm_reference->zone);
 
-    // Recombine to one single map
-    auto map_3857 = std::make_shared<CvGridMap>(maps_3857[0]->roi(), maps_3857[0]->resolution());
-    for (const auto &map_splitted : maps_3857)
-    {
-      // Each map only contains one layer, because we split them up before
-      CvGridMap::Layer layer = map_splitted->getLayer(map_splitted->getAllLayerNames()[0]);
-      map_3857->add(layer);
-    }
+    cv::Rect2d footprint_3857 = map_3857->roi();
 
-    LOG_F(INFO, "Timing [Warping]: %lu ms", getCurrentTimeMilliseconds()-t);
+    timer_warping.stop();
 
     //=======================================//
     //
@@ -133,11 +190,11 @@ bool Tileing::process()
     //
     //=======================================//
 
-    t = getCurrentTimeMilliseconds();
+    ScopedTimer timer_tileing("Tileing");
 
-    std::map<int, MapTiler::TiledMap> tiled_map_max_zoom = m_map_tiler->createTiles(map_3857);
+    std::map<int, MapTiler::TiledMap> tiled_map_max_zoom = m_map_tiler->createTiles(map_3857, -1, -1, m_thread_pool, m_nrof_threads);
 
-    LOG_F(INFO, "Timing [Tileing]: %lu ms", getCurrentTimeMilliseconds()-t);
+    timer_tileing.stop();
 
     //=======================================//
     //
@@ -146,79 +203,106 @@ bool Tileing::process()
     //
     //=======================================//
 
-    t = getCurrentTimeMilliseconds();
+    ScopedTimer timer_blending("Blending");
 
     int zoom_level_max = tiled_map_max_zoom.begin()->first;
 
     std::vector<Tile::Ptr> tiles_current = tiled_map_max_zoom.begin()->second.tiles;
-    std::vector<Tile::Ptr> tiles_blended;
+    if (m_nrof_shards > 1)
+    {
+      tiles_current.erase(std::remove_if(tiles_current.begin(), tiles_current.end(), [&](const Tile::Ptr &tile)
+      {
+        return !isTileInShard(tile->x(), tile->y(), zoom_level_max);
+      }), tiles_current.end());
+    }
 
-    for (const auto &tile : tiles_current)
+    if (tiles_current.empty())
     {
-      Tile::Ptr tile_cached = m_tile_cache->get(tile->x(), tile->y(), zoom_level_max);
+      LOG_F(INFO, "Frame #%u covers no tiles of shard %i, skipping it.", frame->getFrameId(), m_shard_index);
+      return true;
+    }
+    std::vector<Tile::Ptr> tiles_blended(tiles_current.size());
 
-      Tile::Ptr tile_blended;
-      if (tile_cached)
-      {
-        tile_blended = blend(tile, tile_cached);
-        tile_cached->unlock();
-      }
-      else
+    // Tiles are independent of each other and the cache is only modified by this thread, so they are blended in
+    // parallel. Every tile writes only to its own slot.
+    parallelFor(m_thread_pool, cv::Range(0, static_cast<int>(tiles_current.size())), [&](const cv::Range &range)
+    {
+      for (int i = range.start; i < range.end; ++i)
       {
-        tile_blended = tile;
-      }
+        const Tile::Ptr &tile = tiles_current[i];
+        // Cached tiles are only read, so the writer threads of the cache are not blocked while blending
+        Tile::Ptr tile_cached = m_tile_cache->getShared(tile->x(), tile->y(), zoom_level_max);
 
-      tiles_blended.push_back(tile_blended);
-    }
+        if (tile_cached)
+        {
+          tiles_blended[i] = (m_use_blended_input ? merge(tile, tile_cached) : blend(tile, tile_cached));
+          tile_cached->unlockShared();
+        }
+        else
+        {
+          tiles_blended[i] = tile;
+        }
+      }
+    }, m_nrof_threads);
 
-    LOG_F(INFO, "Timing [Blending]: %lu ms", getCurrentTimeMilliseconds()-t);
+    timer_blending.stop();
 
-    t = getCurrentTimeMilliseconds();
+    ScopedTimer timer_cache_push("Cache Push");
     m_tile_cache->add(zoom_level_max, tiles_blended, tiled_map_max_zoom.begin()->second.roi);
-    LOG_F(INFO, "Timing [Cache Push]: %lu ms", getCurrentTimeMilliseconds()-t);
+    timer_cache_push.stop();
 
     //=======================================//
     //
-    //   Step 4: Compute range of zoom levels
-    //           and push to cache
+    //   Step 4: Propagate the changes to
+    //           lower zoom levels
     //
     //=======================================//
 
-    t = getCurrentTimeMilliseconds();
+    ScopedTimer timer_downscaling("Downscaling");
 
-    // To save computational load we remove layers, that we are not interested in displaying as a whole.
-    // They can be required for the blending for example though, which is why we computed them on maximum resolution
-    map_3857->remove("elevated");
+    // Every tile on a lower zoom level is the downsampled composition of its four children. Therefore only parents of
+    // the changed tiles have to be recomputed, level by level, which touches less tiles on every level. Layers only
+    // needed for blending on maximum resolution are not propagated.
+    std::vector<std::string> layer_names = tiles_blended.front()->data()->getAllLayerNames();
+    layer_names.erase(std::remove(layer_names.begin(), layer_names.end(), "elevated"), layer_names.end());
 
-    std::map<int, MapTiler::TiledMap> tiled_map_range = m_map_tiler->createTiles(map_3857, 11, zoom_level_max - 1);
-
-    for (const auto& tiled_map : tiled_map_range)
+    std::vector<Tile::Ptr> tiles_changed = tiles_blended;
+    for (int zoom_level = zoom_level_max - 1; zoom_level >= m_zoom_level_min; --zoom_level)
     {
-      int zoom_level = tiled_map.first;
+      std::set<std::pair<int, int>> parents;
+      for (const auto &tile : tiles_changed)
+        parents.emplace(tile->x() / 2, tile->y() / 2);
 
-      std::vector<Tile::Ptr> tiles_merged;
-      for (const auto & tile : tiled_map.second.tiles)
+      std::vector<Tile::Ptr> tiles_parent;
+      cv::Rect2i roi_parent(parents.begin()->first, parents.begin()->second, 1, 1);
+      for (const auto &parent : parents)
       {
-        Tile::Ptr tile_cached = m_tile_cache->get(tile->x(), tile->y(), zoom_level);
-
-        Tile::Ptr tile_merged;
-        if (tile_cached)
-        {
-          tile_merged = merge(tile, tile_cached);
-          tile_cached->unlock();
-        }
-        else
-        {
-          tile_merged = tile;
-        }
-
-        tiles_merged.push_back(tile_merged);
+        // Children were added to the cache before, so they are all available through it
+        std::vector<Tile::Ptr> children;
+        for (int dx = 0; dx < 2; ++dx)
+          for (int dy = 0; dy < 2; ++dy)
+          {
+            Tile::Ptr child = m_tile_cache->getShared(2*parent.first + dx, 2*parent.second + dy, zoom_level + 1);
+            if (child)
+              children.push_back(child);
+          }
+
+        tiles_parent.push_back(m_map_tiler->createParentTile(zoom_level, parent.first, parent.second, children, layer_names));
+        for (const auto &child : children)
+          child->unlockShared();
+
+        roi_parent |= cv::Rect2i(parent.first, parent.second, 1, 1);
       }
 
-      m_tile_cache->add(zoom_level, tiles_merged, tiled_map.second.roi);
+      m_tile_cache->add(zoom_level, tiles_parent, roi_parent);
+      tiles_changed = tiles_parent;
     }
 
-    LOG_F(INFO, "Timing [Downscaling]: %lu ms", getCurrentTimeMilliseconds()-t);
+    timer_downscaling.stop();
+
+    ScopedTimer timer_prefetch("Prefetch");
+    prefetchTiles(frame, footprint_3857, std::min(m_zoom_level_min, zoom_level_max), zoom_level_max);
+    timer_prefetch.stop();
 
     //=======================================//
     //
@@ -229,56 +313,169 @@ bool Tileing::process()
     // Publishings every iteration
     LOG_F(INFO, "Publishing...");
 
-    t = getCurrentTimeMilliseconds();
+    ScopedTimer timer_publish("Publish");
     //publish(frame, _global_map, map_update, frame->getTimestamp());
-    LOG_F(INFO, "Timing [Publish]: %lu ms", getCurrentTimeMilliseconds()-t);
+    timer_publish.stop();
 
 
     // Savings every iteration
-    t = getCurrentTimeMilliseconds();
+    ScopedTimer timer_saving("Saving");
     saveIter(frame->getFrameId(), map_update);
-    LOG_F(INFO, "Timing [Saving]: %lu ms", getCurrentTimeMilliseconds()-t);
+    timer_saving.stop();
+
+    if (m_checkpoint_store != nullptr && ++m_nrof_frames_checkpoint >= m_checkpoint_every_nth)
+    {
+      ScopedTimer timer_checkpoint("Checkpoint");
+      saveCheckpoint();
+      timer_checkpoint.stop();
+      m_nrof_frames_checkpoint = 0;
+    }
 
     has_processed = true;
   }
   return has_processed;
 }
 
-Tile::Ptr Tileing::merge(const Tile::Ptr &t1, const Tile::Ptr &t2)
+Tile::Ptr Tileing::blend(const Tile::Ptr &t1, const Tile::Ptr &t2)
 {
-  if (t2->data()->empty())
-    throw(std::runtime_error("Error: Tile data is empty. Likely a multi threading problem!"));
+  CvGridMap::Ptr& src = t2->data();
+  CvGridMap::Ptr& dst = t1->data();
 
-  t1->data()->add(*t2->data(), REALM_OVERWRITE_ZERO, false);
+  const cv::Mat &src_color = (*src)["color_rgb"];
+  const cv::Mat &src_elevation = (*src)["elevation"];
+  const cv::Mat &src_angle = (*src)["elevation_angle"];
+  const cv::Mat &src_elevated = (*src)["elevated"];
+  cv::Mat &dst_color = (*dst)["color_rgb"];
+  cv::Mat &dst_elevation = (*dst)["elevation"];
+  cv::Mat &dst_angle = (*dst)["elevation_angle"];
+  const cv::Mat &dst_elevated = (*dst)["elevated"];
+
+  if (src_color.type() != CV_8UC4 || dst_color.type() != CV_8UC4
+      || src_elevation.type() != CV_32F || dst_elevation.type() != CV_32F
+      || src_angle.type() != CV_32F || dst_angle.type() != CV_32F
+      || src_elevated.type() != CV_8UC1 || dst_elevated.type() != CV_8UC1
+      || src_color.size() != dst_color.size())
+    throw(std::invalid_argument("Error blending tiles: Unexpected layer types!"));
+
+  // Single pass over all layers. A cell of the cached tile (src) is taken, if it has an elevation and was observed
+  // under a steeper or equal elevation angle than the new tile (dst), except if it is not elevated where the new tile
+  // is. Cells without elevation are marked as NaN, therefore v == v is false for those. The select is written
+  // branch-free per layer, so the compiler can vectorize the fixed size rows of the tiles.
+  for (int r = 0; r < dst_color.rows; ++r)
+  {
+    auto src_color_row = src_color.ptr<cv::Vec4b>(r);
+    auto src_elevation_row = src_elevation.ptr<float>(r);
+    auto src_angle_row = src_angle.ptr<float>(r);
+    auto src_elevated_row = src_elevated.ptr<uchar>(r);
+    auto dst_color_row = dst_color.ptr<cv::Vec4b>(r);
+    auto dst_elevation_row = dst_elevation.ptr<float>(r);
+    auto dst_angle_row = dst_angle.ptr<float>(r);
+    auto dst_elevated_row = dst_elevated.ptr<uchar>(r);
+
+    for (int c = 0; c < dst_color.cols; ++c)
+    {
+      bool is_dst_better = (src_angle_row[c] < dst_angle_row[c]) || (src_elevated_row[c] && !dst_elevated_row[c]);
+      bool is_src_taken = (src_elevation_row[c] == src_elevation_row[c]) && !is_dst_better;
+
+      dst_color_row[c] = (is_src_taken ? src_color_row[c] : dst_color_row[c]);
+      dst_elevation_row[c] = (is_src_taken ? src_elevation_row[c] : dst_elevation_row[c]);
+      dst_angle_row[c] = (is_src_taken ? src_angle_row[c] : dst_angle_row[c]);
+    }
+  }
 
   return t1;
 }
 
-Tile::Ptr Tileing::blend(const Tile::Ptr &t1, const Tile::Ptr &t2)
+Tile::Ptr Tileing::merge(const Tile::Ptr &t1, const Tile::Ptr &t2)
 {
   CvGridMap::Ptr& src = t2->data();
   CvGridMap::Ptr& dst = t1->data();
 
-  // Cells in the elevation, which have no value are marked as NaN. Therefore v == v returns false for those.
-  cv::Mat src_mask = ((*src)["elevation"] == (*src)["elevation"]);
+  const cv::Mat &dst_elevation = (*dst)["elevation"];
+  if (dst_elevation.type() != CV_32F || (*src)["elevation"].size() != dst_elevation.size())
+    throw(std::invalid_argument("Error merging tiles: Unexpected layer types!"));
+
+  // Cells without elevation are outside the footprint of the blended update, only those are taken from the cache.
+  // NaN != NaN, therefore the inverted comparison marks them.
+  cv::Mat mask_cached;
+  cv::compare(dst_elevation, dst_elevation, mask_cached, cv::CMP_NE);
 
-  // Find all the cells, that are better in the destination tile
-  // First get all elements in the destination tile, that are not elevated (have an elevation, but were not 3D reconstructed)
-  cv::Mat dst_not_elevated;
-  cv::bitwise_not((*dst)["elevated"], dst_not_elevated);
+  for (const auto &layer_name : dst->getAllLayerNames())
+    if (src->exists(layer_name))
+      (*src)[layer_name].copyTo((*dst)[layer_name], mask_cached);
 
-  // Now remove all cells from the source tile, that have a smaller elevation angle than the destination, except those
-  // that are elevated where the destination is not.
-  cv::Mat dst_mask = ((*src)["elevation_angle"] < (*dst)["elevation_angle"]) | ((*src)["elevated"] & dst_not_elevated);
+  return t1;
+}
 
-  // Now remove them
-  src_mask.setTo(0, dst_mask);
+bool Tileing::isTileInShard(int x, int y, int zoom_level) const
+{
+  if (m_nrof_shards <= 1)
+    return true;
+
+  // Ancestor on the shard zoom level, hashed so neighbouring blocks are spread across the shards
+  int shift = std::max(zoom_level - m_shard_zoom_level, 0);
+  auto block_x = static_cast<uint64_t>(x >> shift);
+  auto block_y = static_cast<uint64_t>(y >> shift);
+  uint64_t hash = (block_x * 73856093u) ^ (block_y * 19349663u);
+  return static_cast<int>(hash % static_cast<uint64_t>(m_nrof_shards)) == m_shard_index;
+}
 
-  (*src)["color_rgb"].copyTo((*dst)["color_rgb"], src_mask);
-  (*src)["elevation"].copyTo((*dst)["elevation"], src_mask);
-  (*src)["elevation_angle"].copyTo((*dst)["elevation_angle"], src_mask);
+void Tileing::saveCheckpoint()
+{
+  try
+  {
+    m_checkpoint_store->write("tileing_tile_index.bin", [this](const std::string &filepath)
+    {
+      m_tile_cache->saveIndex(filepath);
+    });
 
-  return t1;
+    // Commit point of the checkpoint, the index is only restored together with the reference of the warping
+    m_checkpoint_store->write("tileing_state.yaml", [this](const std::string &filepath)
+    {
+      cv::FileStorage fs(filepath, cv::FileStorage::WRITE);
+      fs << "utm_easting" << m_utm_reference->easting;
+      fs << "utm_northing" << m_utm_reference->northing;
+      fs << "utm_altitude" << m_utm_reference->altitude;
+      fs << "utm_heading" << m_utm_reference->heading;
+      fs << "utm_zone" << static_cast<int>(m_utm_reference->zone);
+      fs << "utm_band" << std::string(1, m_utm_reference->band);
+      fs.release();
+    });
+  }
+  catch (const std::exception &e)
+  {
+    LOG_F(WARNING, "Writing checkpoint of tile cache failed: %s", e.what());
+  }
+}
+
+bool Tileing::loadCheckpoint()
+{
+  if (!m_checkpoint_store->exists("tileing_state.yaml") || !m_checkpoint_store->exists("tileing_tile_index.bin"))
+  {
+    LOG_F(WARNING, "No checkpoint of the tile cache found in '%s', starting with an empty cache.",
+          m_checkpoint_store->getDirectory().c_str());
+    return false;
+  }
+
+  try
+  {
+    cv::FileStorage fs(m_checkpoint_store->getFilepath("tileing_state.yaml"), cv::FileStorage::READ);
+    std::string band = (std::string)fs["utm_band"];
+    auto utm_reference = std::make_shared<UTMPose>((double)fs["utm_easting"], (double)fs["utm_northing"],
+                                                   (double)fs["utm_altitude"], (double)fs["utm_heading"],
+                                                   static_cast<uint8_t>((int)fs["utm_zone"]), band.empty() ? ' ' : band[0]);
+    fs.release();
+
+    size_t nrof_tiles = m_tile_cache->loadIndex(m_checkpoint_store->getFilepath("tileing_tile_index.bin"));
+    m_utm_reference = utm_reference;
+    LOG_F(INFO, "Restored %lu tiles of the tile cache from checkpoint.", nrof_tiles);
+  }
+  catch (const std::exception &e)
+  {
+    LOG_F(WARNING, "Restoring checkpoint of tile cache failed, starting with an empty cache: %s", e.what());
+    return false;
+  }
+  return true;
 }
 
 void Tileing::saveIter(uint32_t id, const CvGridMap::Ptr &map_update)
@@ -343,6 +540,7 @@ void Tileing::saveAll()
 
 void Tileing::reset()
 {
+  m_frame_merger.clear();
   LOG_F(INFO, "Reseted!");
 }
 
@@ -355,10 +553,9 @@ void Tileing::finishCallback()
 
 Frame::Ptr Tileing::getNewFrame()
 {
-  std::unique_lock<std::mutex> lock(m_mutex_buffer);
-  Frame::Ptr frame = m_buffer.front();
-  m_buffer.pop_front();
-  updateStatisticsProcessedFrame();
+  Frame::Ptr frame;
+  m_buffer.pop(frame);
+  updateStatisticsProcessedFrame(frame);
   return (std::move(frame));
 }
 
@@ -378,21 +575,84 @@ void Tileing::initStageCallback()
   if (!m_map_tiler)
   {
     m_map_tiler = std::make_shared<MapTiler>(true);
-    m_tile_cache = std::make_shared<TileCache>("tile_cache", 500, m_stage_path + "/tiles", false);
+    m_tile_cache = std::make_shared<TileCache>("tile_cache", 500, m_stage_path + "/tiles", false, m_nrof_writer_threads);
+    m_tile_cache->setByteCapacity(static_cast<size_t>(std::max(m_tile_cache_capacity, 0)) * 1024 * 1024);
+    m_tile_cache->setMbtilesStorage(m_use_mbtiles);
+    if (m_spill_raw_tiles)
+      m_tile_cache->setSpillDirectory(m_stage_path + "/tiles_spill");
+    m_tile_cache->setThreadScheduling(m_io_thread_scheduling);
     m_tile_cache->start();
+
+    if (m_tile_server_port > 0)
+    {
+      m_tile_server = std::make_shared<TileServer>(m_tile_cache, m_tile_server_port, m_tile_server_address);
+      m_tile_server->start();
+    }
   }
 }
 
+void Tileing::prefetchTiles(const Frame::Ptr &frame, const cv::Rect2d &footprint, int zoom_level_min, int zoom_level_max)
+{
+  // UTM is interpreted as northern hemisphere, the same as for the warped maps
+  UTMPose utm = frame->getGnssUtm();
+  cv::Point2d position(utm.easting, utm.northing);
+  gis::projection::projectUTMToWebMercator(1, utm.zone, true, &position.x, &position.y);
+  uint64_t timestamp = frame->getTimestamp();
+
+  // Time between frames in [s] and ground velocity in [m/s]
+  double dt = 0.0;
+  cv::Point2d velocity;
+  if (m_timestamp_prev > 0 && timestamp > m_timestamp_prev)
+  {
+    dt = static_cast<double>(timestamp - m_timestamp_prev) * 1e-9;
+    velocity = (position - m_position_prev) / dt;
+  }
+
+  m_position_prev = position;
+  m_timestamp_prev = timestamp;
+
+  if (dt <= 0.0 || m_prefetch_frames <= 0)
+    return;
+
+  // Assume constant ground velocity and frame rate until the next frames arrive
+  cv::Rect2d footprint_predicted = footprint;
+  for (int i = 1; i <= m_prefetch_frames; ++i)
+    footprint_predicted |= (footprint + velocity * (dt * i));
+
+  LOG_F(INFO, "Prefetching tiles for ground velocity (%4.2f, %4.2f) m/s...", velocity.x, velocity.y);
+
+  std::vector<cv::Rect2i> tile_bounds = m_map_tiler->computeTileBounds(footprint_predicted, zoom_level_min, zoom_level_max);
+  for (int zoom_level = zoom_level_min; zoom_level <= zoom_level_max; ++zoom_level)
+    m_tile_cache->prefetch(zoom_level, tile_bounds[zoom_level - zoom_level_min]);
+}
+
 void Tileing::printSettingsToLog()
 {
   LOG_F(INFO, "### Stage process settings ###");
+  LOG_F(INFO, "- nrof_threads: %i", m_nrof_threads);
+  LOG_F(INFO, "- merge_max_delay: %i", m_merge_max_delay);
+  LOG_F(INFO, "- nrof_shards: %i", m_nrof_shards);
+  LOG_F(INFO, "- shard_index: %i", m_shard_index);
+  LOG_F(INFO, "- shard_zoom_level: %i", m_shard_zoom_level);
+  LOG_F(INFO, "- tile_cache_capacity: %i", m_tile_cache_capacity);
+  LOG_F(INFO, "- prefetch_frames: %i", m_prefetch_frames);
+  LOG_F(INFO, "- nrof_writer_threads: %i", m_nrof_writer_threads);
+  LOG_F(INFO, "- spill_raw_tiles: %i", m_spill_raw_tiles);
+  LOG_F(INFO, "- use_mbtiles: %i", m_use_mbtiles);
+  LOG_F(INFO, "- native_warp_max_cells: %i", m_native_warp_max_cells);
+  LOG_F(INFO, "- use_blended_input: %i", m_use_blended_input);
+  LOG_F(INFO, "- tile_server_port: %i", m_tile_server_port);
+  LOG_F(INFO, "- tile_server_address: %s", m_tile_server_address.c_str());
+  LOG_F(INFO, "- checkpoint_directory: %s", (m_checkpoint_store ? m_checkpoint_store->getDirectory().c_str() : ""));
+  LOG_F(INFO, "- checkpoint_every_nth: %i", m_checkpoint_every_nth);
+  LOG_F(INFO, "- resume_from_checkpoint: %i", m_do_resume_from_checkpoint);
   //LOG_F(INFO, "- publish_mesh_nth_iter: %i", _publish_mesh_nth_iter);
 }
 
 void Tileing::publish(const Frame::Ptr &frame, const CvGridMap::Ptr &map, const CvGridMap::Ptr &update, uint64_t timestamp)
 {
   // First update statistics about outgoing frame rate
-  updateStatisticsOutgoing();
+  updateStatisticsOutgoing(frame);
 
 //  _transport_img((*_global_map)["color_rgb"], "output/rgb");
 //  _transport_img(analysis::convertToColorMapFromCVC1((*_global_map)["elevation"],
@@ -417,4 +677,9 @@ void Tileing::publish(const Frame::Ptr &frame, const CvGridMap::Ptr &map, const
 uint32_t Tileing::getQueueDepth()
 {
   return m_buffer.size();
+}
+
+size_t Tileing::getMemoryUsage()
+{
+  return (m_tile_cache ? m_tile_cache->getByteSize() : 0);
 }
\ No newline at end of file
@@ -3,9 +3,12 @@
 #ifndef PROJECT_GEOMETRIC_REFERENCER_H
 #define PROJECT_GEOMETRIC_REFERENCER_H
 
+#include <deque>
 #include <memory>
 #include <numeric>
 
+#include <eigen3/Eigen/Eigen>
+
 #include <realm_core/loguru.h>
 
 #include <realm_vslam_base/geospatial_referencer_IF.h>
@@ -25,8 +28,33 @@ namespace realm
       cv::Mat second;
     };
 
+    /*!
+     * @brief Running sums of corresponding point pairs, from which the similarity transformation between them is
+     * computed in closed form according to [Umeyama1991]. Measurements can be added and removed in O(1).
+     */
+    struct PointSums
+    {
+      int n = 0;
+      Eigen::Vector3d sum_src = Eigen::Vector3d::Zero();
+      Eigen::Vector3d sum_dst = Eigen::Vector3d::Zero();
+      Eigen::Matrix3d sum_dst_src = Eigen::Matrix3d::Zero();
+      double sum_src_sq = 0.0;
+
+      void add(const Eigen::Vector3d &src, const Eigen::Vector3d &dst);
+      PointSums& operator+=(const PointSums &other);
+      PointSums& operator-=(const PointSums &other);
+    };
+
   public:
-    explicit GeometricReferencer(double th_error, int min_nrof_frames);
+    /*!
+     * @brief Constructor of the georeferencer
+     * @param th_error Maximum change of the scale between two initialization tries to accept the georeference
+     * @param min_nrof_frames Minimum number of unique frames for initialization
+     * @param window_size Number of most recent measurements the refinement is estimated from, 0 for all
+     * @param th_outlier Maximum distance in [m] between a measured and the predicted GNSS position of an update to
+     *        accept it, 0 to disable gating
+     */
+    explicit GeometricReferencer(double th_error, int min_nrof_frames, int window_size = 0, double th_outlier = 0.0);
 
     void init(const std::vector<Frame::Ptr> &frames) override;
 
@@ -55,10 +83,20 @@ namespace realm
 
     int m_min_nrof_frames;
 
+    int m_window_size;
+    double m_th_outlier;
+
     std::mutex m_mutex_t_c2g;
     cv::Mat m_transformation_w2g;
 
-    std::vector<SpatialMeasurement::Ptr> m_spatials;
+    // Measurements and their point sums within the window, the sums of all of them are kept in m_sums_window
+    std::mutex m_mutex_spatials;
+    std::deque<SpatialMeasurement::Ptr> m_spatials;
+    std::deque<PointSums> m_sums_spatials;
+    PointSums m_sums_window;
+
+    // GNSS position of the first measurement, subtracted from all GNSS points to keep the sums well conditioned
+    Eigen::Vector3d m_offset_dst;
 
     void setBuisy();
 
@@ -70,10 +108,48 @@ namespace realm
 
     static double computeTwoPointScale(const SpatialMeasurement::Ptr &f1, const SpatialMeasurement::Ptr &f2, double th_visual);
 
+    /*!
+     * @brief Selects the measurements that are far enough apart from each other to estimate scales from all their pairs.
+     * Measurements are tested in order against hash grids of the accepted ones, so selection is linear in their number.
+     * @param spatials Measurements in the order they were recorded
+     * @param th_visual Minimum distance of the visual positions
+     * @return Unique measurements, empty if the visual threshold is not positive
+     */
+    static std::vector<SpatialMeasurement::Ptr> selectUniqueSpatials(const std::vector<SpatialMeasurement::Ptr> &spatials, double th_visual);
+
+    /*!
+     * @brief Estimates the scale between visual and GNSS positions RANSAC-style. Scales of measurement pairs are minimal
+     * samples, the one most other pairs agree with is refined by averaging over them.
+     * @param spatials Unique measurements, see selectUniqueSpatials
+     * @param th_visual Minimum distance of the visual positions
+     * @param inliers Output measurements of the pairs agreeing with the scale
+     * @return Scale estimate, 0 if no pair could be formed
+     */
+    static double estimateScale(const std::vector<SpatialMeasurement::Ptr> &spatials,
+                                double th_visual,
+                                std::vector<SpatialMeasurement::Ptr> &inliers);
+
     static double computeAverageReferenceError(const std::vector<SpatialMeasurement::Ptr> &spatials, const cv::Mat &T_c2w);
 
     static cv::Mat refineReference(const std::vector<SpatialMeasurement::Ptr> &frames, const cv::Mat &T_c2w, double z_weight);
 
+    /*!
+     * @brief Computes the point sums of a measurement. Like in refineReference, the camera position and the ends of
+     * its axes are used as points. The axes of the visual pose are scaled with the initial scale, so the points do not
+     * depend on the current estimate and the sums stay valid when it changes.
+     * @param s Measurement of corresponding GNSS and visual pose
+     * @param z_weight Length of the z-axis relative to the other axes
+     * @return Point sums of the measurement
+     */
+    PointSums computePointSums(const SpatialMeasurement::Ptr &s, double z_weight) const;
+
+    /*!
+     * @brief Computes the similarity transformation from visual world to geographic frame from point sums
+     * @param sums Point sums of all measurements in the window
+     * @return 4x4 homogenous transformation, empty if the sums are degenerated
+     */
+    cv::Mat computeReferenceFromSums(const PointSums &sums) const;
+
     static cv::Mat applyTransformation(const cv::Mat &T, const cv::Mat &pt);
   };
 
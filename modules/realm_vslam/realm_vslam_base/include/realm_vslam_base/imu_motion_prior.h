@@ -0,0 +1,85 @@
+
+
+#ifndef OPENREALM_IMU_MOTION_PRIOR_H
+#define OPENREALM_IMU_MOTION_PRIOR_H
+
+#include <deque>
+#include <memory>
+#include <mutex>
+
+#include <opencv2/core.hpp>
+
+#include <realm_vslam_base/visual_slam_IF.h>
+
+namespace realm
+{
+
+/*!
+ * @brief Predicts the visual pose of the next frame from the last tracked pose, which can be passed as initial guess
+ *        to the visual SLAM. The rotation is preintegrated from the gyroscope measurements since the last tracked
+ *        frame. The visual world of a monocular SLAM has no metric scale, so the translation is extrapolated with the
+ *        velocity between the last two tracked frames instead of integrating the accelerometer.
+ *        Timestamps of frames and IMU measurements are expected in nanoseconds.
+ */
+class ImuMotionPrior
+{
+public:
+  using Ptr = std::shared_ptr<ImuMotionPrior>;
+
+public:
+  /*!
+   * @brief Constructor
+   * @param T_cam_imu (4x4) transformation from IMU to camera frame, identity if empty
+   * @param max_prediction_time Maximum time in [s] since the last tracked frame to predict a pose
+   */
+  explicit ImuMotionPrior(const cv::Mat &T_cam_imu, double max_prediction_time = 1.0);
+
+  /*!
+   * @brief Adds a measurement of the IMU. Can be called from any thread.
+   * @param imu Measurement with timestamp in nanoseconds
+   */
+  void addImuData(const VisualSlamIF::ImuData &imu);
+
+  /*!
+   * @brief Sets the tracked pose of a frame as new anchor of the prediction and drops all IMU measurements before it
+   * @param timestamp Timestamp of the frame in nanoseconds
+   * @param T_c2w (3x4) visual pose of the frame
+   */
+  void update(uint64_t timestamp, const cv::Mat &T_c2w);
+
+  /*!
+   * @brief Predicts the visual pose at the given time
+   * @param timestamp Timestamp of the frame to be tracked in nanoseconds
+   * @return (3x4) predicted visual pose, empty if no anchor exists or it is too old
+   */
+  cv::Mat predict(uint64_t timestamp) const;
+
+  /*!
+   * @brief Removes the anchors, e.g. after the visual SLAM was reset and its world frame changed
+   */
+  void reset();
+
+private:
+
+  //! Rotation from IMU to camera frame
+  cv::Mat m_R_cam_imu;
+
+  //! Maximum time in [s] since the last tracked frame to predict a pose
+  double m_max_prediction_time;
+
+  mutable std::mutex m_mutex;
+
+  //! Gyroscope measurements since the last anchor
+  std::deque<VisualSlamIF::ImuData> m_imu_data;
+
+  //! Last two tracked poses and their timestamps
+  bool m_has_anchor;
+  bool m_has_velocity;
+  uint64_t m_timestamp_anchor;
+  cv::Mat m_T_c2w_anchor;
+  cv::Mat m_velocity;
+};
+
+} // namespace realm
+
+#endif //OPENREALM_IMU_MOTION_PRIOR_H
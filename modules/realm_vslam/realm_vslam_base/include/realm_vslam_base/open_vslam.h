@@ -35,6 +35,9 @@ public:
 
   PointCloud::Ptr getTrackedMapPoints() override;
 
+  bool saveMap(const std::string &filepath) override;
+  bool loadMap(const std::string &filepath) override;
+
 private:
 
   //! We need to assign points a unique id, so they can be identified across several resets of the visual SLAM system.
@@ -67,6 +70,10 @@ private:
 
   VisualSlamIF::ResetFuncCb m_reset_callback;
 
+  //! Receiver of the corrected keyframe poses and the epoch of the latest batch sent to it
+  VisualSlamIF::PoseUpdateBatchFuncCb m_pose_update_batch_callback;
+  uint64_t m_pose_update_epoch;
+
   std::future<void> m_future_update_keyframes;
 
   uint32_t extractPointId(openvslam::data::landmark* lm);
@@ -79,6 +86,7 @@ private:
   void addKeyframeLink(Frame::Ptr &frame_realm, openvslam::data::keyframe* frame_ovslam);
   void updateKeyframes();
   void registerResetCallback(const ResetFuncCb &func) override;
+  void registerUpdateBatchTransport(const PoseUpdateBatchFuncCb &func) override;
 };
 
 } // namespace realm
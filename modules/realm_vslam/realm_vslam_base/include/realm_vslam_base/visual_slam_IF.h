@@ -4,6 +4,7 @@
 #define PROJECT_VISUAL_SLAM_IF_H
 
 #include <memory>
+#include <vector>
 #include <functional>
 #include "opencv2/core/core.hpp"
 
@@ -20,6 +21,21 @@ public:
   using ConstPtr = std::shared_ptr<const VisualSlamIF>;
   using ResetFuncCb = std::function<void(void)>;
   using PoseUpdateFuncCb = std::function<void(int, const cv::Mat &, const cv::Mat &)>;
+
+  /*!
+   * @brief Corrected visual pose of a single frame, e.g. after bundle adjustment or loop closure
+   */
+  struct PoseUpdate
+  {
+    uint32_t frame_id;
+    cv::Mat pose;         // 3x4 visual pose T_c2w
+  };
+
+  /*!
+   * @brief Callback for all pose corrections of one optimization at once. The epoch is increasing with every batch, so
+   * receivers can drop batches arriving out of order.
+   */
+  using PoseUpdateBatchFuncCb = std::function<void(uint64_t, const std::vector<PoseUpdate> &)>;
 public:
   enum class State
   {
@@ -88,9 +104,33 @@ public:
   virtual void registerUpdateTransport(const PoseUpdateFuncCb &func)
   {};
 
+  /*!
+   * @brief Registers a callback for batched pose updates. Frameworks correcting many keyframes at once, e.g. on loop
+   * closure, should prefer it over the single frame transport, so receivers only have to search their buffers once.
+   * @param func Callback receiving the epoch and all updated poses of one optimization
+   */
+  virtual void registerUpdateBatchTransport(const PoseUpdateBatchFuncCb &func)
+  {};
+
   virtual void registerResetCallback(const ResetFuncCb &func)
   {};
 
+  /*!
+   * @brief Saves the map of the framework, e.g. into a checkpoint to resume tracking after a restart
+   * @param filepath Absolute path of the map file
+   * @return True if saved, false if the framework does not support it
+   */
+  virtual bool saveMap(const std::string &filepath)
+  { return false; };
+
+  /*!
+   * @brief Replaces the current map with one saved by saveMap(). Tracking has to relocalize in it afterwards.
+   * @param filepath Absolute path of the map file
+   * @return True if loaded, false if the framework does not support it
+   */
+  virtual bool loadMap(const std::string &filepath)
+  { return false; };
+
 private:
 };
 
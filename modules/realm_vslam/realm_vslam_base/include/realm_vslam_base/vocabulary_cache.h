@@ -0,0 +1,55 @@
+
+
+#ifndef PROJECT_VOCABULARY_CACHE_H
+#define PROJECT_VOCABULARY_CACHE_H
+
+#include <string>
+
+namespace realm
+{
+
+/*!
+ * @brief Binary cache of bag of words vocabularies in the text format of DBoW2, e.g. "ORBvoc.txt" of ORB SLAM. Parsing
+ * the text file takes several seconds on embedded boards, while the binary cache is read almost instantly. It is
+ * created once next to the text file, e.g. "ORBvoc.bin" for "ORBvoc.txt", and recreated if the text file is newer.
+ *
+ * Binary layout as read by TemplatedVocabulary::loadFromBinaryFile of the ORB SLAM (binary vocabulary) forks, all
+ * values in native byte order:
+ *  - Header: number of nodes including the root, size of a node record, k, L, scoring and weighting type
+ *  - Node records in order of the node ids without the root: parent id, descriptor, weight and leaf flag
+ */
+class VocabularyCache
+{
+  public:
+    //! Length of the ORB descriptors of the vocabulary in bytes
+    static constexpr int kDescriptorSize = 32;
+
+    /*!
+     * @brief Resolves the vocabulary path to be passed to the visual SLAM. Text vocabularies are converted to the
+     * binary cache on first use, all others are returned unchanged.
+     * @param path_vocabulary Path to the vocabulary file as configured
+     * @return Path to the binary cache, or the configured path if it is no text vocabulary or conversion failed
+     */
+    static std::string resolve(const std::string &path_vocabulary);
+
+    /*!
+     * @brief Converts a text vocabulary into the binary format. The binary file is written to a temporary file first
+     * and renamed afterwards, so other processes never read a partially written cache.
+     * @param path_txt Path to the text vocabulary
+     * @param path_bin Path to the binary vocabulary to be written
+     * @throws std::invalid_argument if the text file can not be opened or is no valid vocabulary
+     * @throws std::runtime_error if the binary file can not be written
+     */
+    static void convertTextToBinary(const std::string &path_txt, const std::string &path_bin);
+
+    /*!
+     * @brief Creates the path of the binary cache for a text vocabulary
+     * @param path_txt Path to the text vocabulary with .txt suffix
+     * @return Path with .bin suffix, empty if the path has no .txt suffix
+     */
+    static std::string createCachePath(const std::string &path_txt);
+};
+
+} // namespace realm
+
+#endif //PROJECT_VOCABULARY_CACHE_H
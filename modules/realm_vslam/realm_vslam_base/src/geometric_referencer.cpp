@@ -1,22 +1,131 @@
 
 
 #include <realm_vslam_base/geometric_referencer.h>
+#include <algorithm>
+#include <cmath>
 #include <fstream>
+#include <limits>
+#include <random>
+#include <unordered_map>
 
 #include <eigen3/Eigen/Eigen>
 
 using namespace realm;
 
-GeometricReferencer::GeometricReferencer(double th_error, int min_nrof_frames)
+namespace
+{
+
+// Minimum GNSS distance in [m] between two measurements to estimate a scale from them
+const double g_min_gnss_distance = 10.0;
+
+// Number of minimal samples drawn for the initial scale and their maximum relative deviation to support a sample
+const int g_nrof_scale_samples = 100;
+const double g_th_scale_deviation = 0.1;
+
+/*!
+ * @brief Hash grid of 3D points, which answers if any point lies within the cell size of a query in O(1). Every point
+ * within that distance is inside the cell of the query or one of its 26 neighbours.
+ */
+class PointGrid
+{
+  public:
+    explicit PointGrid(double cell_size)
+    : m_cell_size(cell_size)
+    {
+    }
+
+    bool hasPointWithin(const Eigen::Vector3d &pt) const
+    {
+      Eigen::Vector3i cell = computeCell(pt);
+      for (int dx = -1; dx <= 1; ++dx)
+        for (int dy = -1; dy <= 1; ++dy)
+          for (int dz = -1; dz <= 1; ++dz)
+          {
+            auto it = m_cells.find(computeKey(cell + Eigen::Vector3i(dx, dy, dz)));
+            if (it == m_cells.end())
+              continue;
+            for (const auto &other : it->second)
+              if ((other - pt).norm() <= m_cell_size)
+                return true;
+          }
+      return false;
+    }
+
+    void insert(const Eigen::Vector3d &pt)
+    {
+      m_cells[computeKey(computeCell(pt))].push_back(pt);
+    }
+
+  private:
+    double m_cell_size;
+    std::unordered_map<uint64_t, std::vector<Eigen::Vector3d>> m_cells;
+
+    Eigen::Vector3i computeCell(const Eigen::Vector3d &pt) const
+    {
+      return Eigen::Vector3i(static_cast<int>(std::floor(pt.x() / m_cell_size)),
+                             static_cast<int>(std::floor(pt.y() / m_cell_size)),
+                             static_cast<int>(std::floor(pt.z() / m_cell_size)));
+    }
+
+    // 21 bits per axis. Cells wrapping around only share a bucket, the distance check of the query stays exact.
+    static uint64_t computeKey(const Eigen::Vector3i &cell)
+    {
+      return  (static_cast<uint64_t>(cell.x()) & 0x1FFFFF)
+           | ((static_cast<uint64_t>(cell.y()) & 0x1FFFFF) << 21)
+           | ((static_cast<uint64_t>(cell.z()) & 0x1FFFFF) << 42);
+    }
+};
+
+Eigen::Vector3d toPosition(const cv::Mat &pose)
+{
+  return Eigen::Vector3d(pose.at<double>(0, 3), pose.at<double>(1, 3), pose.at<double>(2, 3));
+}
+
+} // namespace
+
+void GeometricReferencer::PointSums::add(const Eigen::Vector3d &src, const Eigen::Vector3d &dst)
+{
+  n++;
+  sum_src += src;
+  sum_dst += dst;
+  sum_dst_src += dst * src.transpose();
+  sum_src_sq += src.squaredNorm();
+}
+
+GeometricReferencer::PointSums& GeometricReferencer::PointSums::operator+=(const PointSums &other)
+{
+  n += other.n;
+  sum_src += other.sum_src;
+  sum_dst += other.sum_dst;
+  sum_dst_src += other.sum_dst_src;
+  sum_src_sq += other.sum_src_sq;
+  return *this;
+}
+
+GeometricReferencer::PointSums& GeometricReferencer::PointSums::operator-=(const PointSums &other)
+{
+  n -= other.n;
+  sum_src -= other.sum_src;
+  sum_dst -= other.sum_dst;
+  sum_dst_src -= other.sum_dst_src;
+  sum_src_sq -= other.sum_src_sq;
+  return *this;
+}
+
+GeometricReferencer::GeometricReferencer(double th_error, int min_nrof_frames, int window_size, double th_outlier)
 : m_is_initialized(false),
   m_is_buisy(false),
   m_prev_nrof_unique(0),
   m_scale(0.0),
   m_th_error(th_error),
   m_error(0.0),
-  m_min_nrof_frames(min_nrof_frames)
+  m_min_nrof_frames(min_nrof_frames),
+  m_window_size(window_size),
+  m_th_outlier(th_outlier),
+  m_offset_dst(Eigen::Vector3d::Zero())
 {
-
+  if (m_window_size > 0 && m_window_size < 2)
+    throw(std::invalid_argument("Error: Window of the georeference refinement must contain at least two measurements."));
 }
 
 bool GeometricReferencer::isBuisy()
@@ -38,7 +147,9 @@ double GeometricReferencer::computeScaleChange(const Frame::Ptr &frame)
 
   SpatialMeasurement::Ptr s_curr = std::make_shared<SpatialMeasurement>();
   s_curr->first = frame->getDefaultPose();
-  s_curr->second = frame->getVisualPose();
+  s_curr->second = frame->getVisualPoseView();
+
+  std::unique_lock<std::mutex> lock(m_mutex_spatials);
 
   int dit = 1;
   if (m_spatials.size() > 3)
@@ -115,10 +226,6 @@ void GeometricReferencer::init(const std::vector<Frame::Ptr> &frames)
     return;
   }
 
-  // Compute initial scale
-  double vis_th = 0.02*valid_input[0]->getMedianSceneDepth();
-  std::vector<double> scales;
-
   // Extract spatial informations from frames
   std::vector<SpatialMeasurement::Ptr> spatials;
   for (const auto &f : valid_input)
@@ -130,26 +237,8 @@ void GeometricReferencer::init(const std::vector<Frame::Ptr> &frames)
   }
 
   // Extract measurements with unique GNSS and pose info
-  std::vector<SpatialMeasurement::Ptr> unique_spatials;
-  unique_spatials.push_back(spatials[0]);
-  for (size_t i = 1; i < spatials.size(); i++)
-  {
-    SpatialMeasurement::Ptr spatial = spatials[i];
-    bool is_unique = true;
-    for (size_t j = unique_spatials.size(); j > 0; --j)
-    {
-      double scale = computeTwoPointScale(spatial, unique_spatials[j-1], vis_th);
-      if (scale > 0.0)
-        scales.push_back(scale);
-      else
-      {
-        is_unique = false;
-        break;
-      }
-    }
-    if (is_unique)
-      unique_spatials.push_back(spatial);
-  }
+  double vis_th = 0.02*valid_input[0]->getMedianSceneDepth();
+  std::vector<SpatialMeasurement::Ptr> unique_spatials = selectUniqueSpatials(spatials, vis_th);
 
   // Check if enough measurements and if more scales estimates than in the iteration before were computed
   if (unique_spatials.size() < m_min_nrof_frames || unique_spatials.size() == m_prev_nrof_unique)
@@ -160,8 +249,17 @@ void GeometricReferencer::init(const std::vector<Frame::Ptr> &frames)
     return;
   }
 
-  // Average scale and update member
-  double scale_avr = std::accumulate(scales.begin(), scales.end(), 0.0)/scales.size();
+  // Estimate scale robustly and update member
+  std::vector<SpatialMeasurement::Ptr> inlier_spatials;
+  double scale_avr = estimateScale(unique_spatials, vis_th, inlier_spatials);
+  if (scale_avr <= 0.0)
+  {
+    LOG_F(INFO, "### GEOREFERENCE ABORTED ###");
+    LOG_F(INFO, "No scale estimate from %lu unique frames", unique_spatials.size());
+    setIdle();
+    return;
+  }
+
   double dscale = scale_avr - m_scale;
   m_scale = scale_avr;
   m_prev_nrof_unique = unique_spatials.size();
@@ -174,6 +272,10 @@ void GeometricReferencer::init(const std::vector<Frame::Ptr> &frames)
     return;
   }
 
+  // Measurements of rejected scale samples are left out, unless too few remain to reference reliably
+  if (inlier_spatials.size() >= static_cast<size_t>(m_min_nrof_frames))
+    unique_spatials = inlier_spatials;
+
   LOG_F(INFO, "Proceeding georeferencing initial guess...");
   LOG_F(INFO, "Scale: %4.2f", scale_avr);
 
@@ -184,7 +286,29 @@ void GeometricReferencer::init(const std::vector<Frame::Ptr> &frames)
   cv::Mat T_c2g = refineReference(unique_spatials, T_p2g, 5.0);
   setReference(T_c2g);
 
-  m_spatials = unique_spatials;
+  // Seed the running sums of the refinement with the initial measurements. The GNSS points are kept relative to the
+  // first measurement, UTM coordinates are too large to accumulate their products without cancellation.
+  {
+    std::unique_lock<std::mutex> lock(m_mutex_spatials);
+    m_offset_dst = Eigen::Vector3d(unique_spatials[0]->first.at<double>(0, 3),
+                                   unique_spatials[0]->first.at<double>(1, 3),
+                                   unique_spatials[0]->first.at<double>(2, 3));
+    m_spatials.clear();
+    m_sums_spatials.clear();
+    m_sums_window = PointSums();
+    for (const auto &s : unique_spatials)
+    {
+      m_spatials.push_back(s);
+      m_sums_spatials.push_back(computePointSums(s, 3.0));
+      m_sums_window += m_sums_spatials.back();
+    }
+    while (m_window_size > 0 && m_spatials.size() > static_cast<size_t>(m_window_size))
+    {
+      m_sums_window -= m_sums_spatials.front();
+      m_sums_spatials.pop_front();
+      m_spatials.pop_front();
+    }
+  }
 
   std::unique_lock<std::mutex> lock(m_mutex_is_initialized);
   m_is_initialized = true;
@@ -200,19 +324,51 @@ void GeometricReferencer::update(const Frame::Ptr &frame)
 
   SpatialMeasurement::Ptr s_curr = std::make_shared<SpatialMeasurement>();
   s_curr->first = frame->getDefaultPose();
-  s_curr->second = frame->getVisualPose();
-
-  SpatialMeasurement::Ptr s_prev = m_spatials.back();
+  s_curr->second = frame->getVisualPoseView();
 
   setBuisy();
 
+  std::unique_lock<std::mutex> lock(m_mutex_spatials);
+
+  SpatialMeasurement::Ptr s_prev = m_spatials.back();
   if (computeTwoPointScale(s_curr, s_prev, 0.02*frame->getMedianSceneDepth()) > 0.0)
   {
+    // Reject measurements that disagree with the current estimate, e.g. GNSS jumps or visual tracking drift
+    cv::Mat T_prev = getTransformation();
+    double error = cv::norm(applyTransformation(T_prev, s_curr->second.rowRange(0, 3).col(3)) - s_curr->first.rowRange(0, 3).col(3));
+    if (m_th_outlier > 0.0 && error > m_th_outlier)
+    {
+      LOG_F(INFO, "### GEOREFERENCE UPDATE REJECTED ###");
+      LOG_F(INFO, "Error: %4.2f > %4.2f", error, m_th_outlier);
+      lock.unlock();
+      setIdle();
+      return;
+    }
+
+    // Only the sums of the newest measurement are added and those leaving the window removed, so an update costs the
+    // same no matter how many frames have been referenced so far
+    PointSums sums_curr = computePointSums(s_curr, 3.0);
     m_spatials.push_back(s_curr);
-    cv::Mat T_c2g = refineReference(m_spatials, m_transformation_w2g.clone(), 3.0);
+    m_sums_spatials.push_back(sums_curr);
+    m_sums_window += sums_curr;
+    while (m_window_size > 0 && m_spatials.size() > static_cast<size_t>(m_window_size))
+    {
+      m_sums_window -= m_sums_spatials.front();
+      m_sums_spatials.pop_front();
+      m_spatials.pop_front();
+    }
+
+    cv::Mat T_c2g = computeReferenceFromSums(m_sums_window);
+    if (T_c2g.empty())
+    {
+      LOG_F(WARNING, "Georeference update failed: Refinement is degenerated.");
+      lock.unlock();
+      setIdle();
+      return;
+    }
     setReference(T_c2g);
 
-    double error = computeAverageReferenceError(m_spatials, T_c2g);
+    // Error of the newest measurement before it was included, as the average over all of them would be O(n) again
     double derror = fabs(error - m_error);
     m_error = error;
 
@@ -229,7 +385,9 @@ void GeometricReferencer::update(const Frame::Ptr &frame)
     LOG_F(INFO, "Error: %4.2f", error);
     LOG_F(INFO, "dError: %4.2f", derror);
     LOG_F(INFO, "Scale (sx, sy, sz): (%4.2f, %4.2f, %4.2f)", sx, sy, sz);
+    LOG_F(INFO, "Measurements in window: %lu", m_spatials.size());
   }
+  lock.unlock();
   setIdle();
 }
 
@@ -252,12 +410,95 @@ double GeometricReferencer::computeTwoPointScale(const SpatialMeasurement::Ptr &
   double dist_g = sqrt(pow(f2_gis[0]-f1_gis[0], 2)+pow(f2_gis[1]-f1_gis[1], 2)+pow(f2_gis[2]-f1_gis[2], 2));
 
   // Check if legit scale mmt
-  if (dist_g > 10.0 && dist_v > th_visual)
+  if (dist_g > g_min_gnss_distance && dist_v > th_visual)
     return dist_g/dist_v; // Scale
   else
     return -1.0;          // Invalid Value
 }
 
+std::vector<GeometricReferencer::SpatialMeasurement::Ptr> GeometricReferencer::selectUniqueSpatials(
+    const std::vector<SpatialMeasurement::Ptr> &spatials, double th_visual)
+{
+  std::vector<SpatialMeasurement::Ptr> unique_spatials;
+  if (spatials.empty() || th_visual <= 0.0)
+    return unique_spatials;
+
+  // A measurement is unique, if it is farther than the thresholds from all unique ones in both GNSS and visual position.
+  // This is exactly the condition for a valid scale of every pair, see computeTwoPointScale.
+  PointGrid grid_gis(g_min_gnss_distance);
+  PointGrid grid_vis(th_visual);
+  for (const auto &s : spatials)
+  {
+    Eigen::Vector3d pt_gis = toPosition(s->first);
+    Eigen::Vector3d pt_vis = toPosition(s->second);
+    if (grid_gis.hasPointWithin(pt_gis) || grid_vis.hasPointWithin(pt_vis))
+      continue;
+
+    grid_gis.insert(pt_gis);
+    grid_vis.insert(pt_vis);
+    unique_spatials.push_back(s);
+  }
+  return unique_spatials;
+}
+
+double GeometricReferencer::estimateScale(const std::vector<SpatialMeasurement::Ptr> &spatials,
+                                          double th_visual,
+                                          std::vector<SpatialMeasurement::Ptr> &inliers)
+{
+  inliers.clear();
+
+  // Pairs of measurements half the sequence apart, so every measurement is in one pair with a wide baseline. For unique
+  // measurements all scales are valid, the check is only kept for safety.
+  size_t n_half = spatials.size() / 2;
+  std::vector<std::pair<size_t, size_t>> pairs;
+  std::vector<double> scales;
+  for (size_t i = 0; i < n_half; ++i)
+  {
+    double scale = computeTwoPointScale(spatials[i], spatials[i + n_half], th_visual);
+    if (scale > 0.0)
+    {
+      pairs.emplace_back(i, i + n_half);
+      scales.push_back(scale);
+    }
+  }
+
+  if (scales.empty())
+    return 0.0;
+
+  // The scale of a single pair is a minimal sample. Every sample is scored by the pairs it agrees with, the seed is fixed
+  // to keep the initialization reproducible.
+  std::mt19937 generator(42);
+  std::uniform_int_distribution<size_t> distribution(0, scales.size() - 1);
+  int nrof_samples = std::min(g_nrof_scale_samples, static_cast<int>(scales.size()));
+
+  std::vector<size_t> best_support;
+  for (int k = 0; k < nrof_samples; ++k)
+  {
+    size_t idx = (nrof_samples == static_cast<int>(scales.size()) ? static_cast<size_t>(k) : distribution(generator));
+    std::vector<size_t> support;
+    for (size_t j = 0; j < scales.size(); ++j)
+      if (std::fabs(scales[j] / scales[idx] - 1.0) < g_th_scale_deviation)
+        support.push_back(j);
+    if (support.size() > best_support.size())
+      best_support = std::move(support);
+  }
+
+  // Refit scale from all supporting pairs, both measurements of a pair are kept as inliers
+  double scale = 0.0;
+  std::vector<bool> is_inlier(spatials.size(), false);
+  for (size_t j : best_support)
+  {
+    scale += scales[j];
+    is_inlier[pairs[j].first] = true;
+    is_inlier[pairs[j].second] = true;
+  }
+  for (size_t i = 0; i < spatials.size(); ++i)
+    if (is_inlier[i])
+      inliers.push_back(spatials[i]);
+
+  return scale / static_cast<double>(best_support.size());
+}
+
 cv::Mat GeometricReferencer::refineReference(const std::vector<SpatialMeasurement::Ptr> &spatials, const cv::Mat &T_c2w, double z_weight)
 {
   // First define basic eigen variables
@@ -330,6 +571,66 @@ cv::Mat GeometricReferencer::refineReference(const std::vector<SpatialMeasuremen
   return T_refine_cv * T_c2w;
 }
 
+GeometricReferencer::PointSums GeometricReferencer::computePointSums(const SpatialMeasurement::Ptr &s, double z_weight) const
+{
+  PointSums sums;
+
+  const cv::Mat &T_gis = s->first;
+  const cv::Mat &T_vis = s->second;
+
+  Eigen::Vector3d p_gis(T_gis.at<double>(0, 3), T_gis.at<double>(1, 3), T_gis.at<double>(2, 3));
+  Eigen::Vector3d p_vis(T_vis.at<double>(0, 3), T_vis.at<double>(1, 3), T_vis.at<double>(2, 3));
+  p_gis -= m_offset_dst;
+
+  // Axes of the visual pose are normalized and shrunk by the initial scale, so after referencing they have roughly the
+  // same length as the geographic ones
+  double axis_len_vis = 1.0 / m_scale;
+  double weights[3] = {1.0, 1.0, z_weight};
+
+  sums.add(p_vis, p_gis);
+  for (int k = 0; k < 3; ++k)
+  {
+    Eigen::Vector3d axis_gis(T_gis.at<double>(0, k), T_gis.at<double>(1, k), T_gis.at<double>(2, k));
+    Eigen::Vector3d axis_vis(T_vis.at<double>(0, k), T_vis.at<double>(1, k), T_vis.at<double>(2, k));
+    axis_vis.normalize();
+    sums.add(p_vis + weights[k] * axis_len_vis * axis_vis, p_gis + weights[k] * axis_gis);
+  }
+  return sums;
+}
+
+cv::Mat GeometricReferencer::computeReferenceFromSums(const PointSums &sums) const
+{
+  if (sums.n < 3)
+    return cv::Mat();
+
+  // Closed form of Eigen::umeyama, but computed from the sums instead of the points
+  double n = static_cast<double>(sums.n);
+  Eigen::Vector3d mean_src = sums.sum_src / n;
+  Eigen::Vector3d mean_dst = sums.sum_dst / n;
+  Eigen::Matrix3d sigma = sums.sum_dst_src / n - mean_dst * mean_src.transpose();
+  double var_src = sums.sum_src_sq / n - mean_src.squaredNorm();
+  if (var_src <= std::numeric_limits<double>::epsilon())
+    return cv::Mat();
+
+  Eigen::JacobiSVD<Eigen::Matrix3d> svd(sigma, Eigen::ComputeFullU | Eigen::ComputeFullV);
+  Eigen::Vector3d d = Eigen::Vector3d::Ones();
+  if (svd.matrixU().determinant() * svd.matrixV().determinant() < 0.0)
+    d(2) = -1.0;
+
+  Eigen::Matrix3d R = svd.matrixU() * d.asDiagonal() * svd.matrixV().transpose();
+  double c = svd.singularValues().dot(d) / var_src;
+  Eigen::Vector3d t = mean_dst + m_offset_dst - c * R * mean_src;
+
+  cv::Mat T = cv::Mat::eye(4, 4, CV_64F);
+  for (int r = 0; r < 3; ++r)
+  {
+    for (int col = 0; col < 3; ++col)
+      T.at<double>(r, col) = c * R(r, col);
+    T.at<double>(r, 3) = t(r);
+  }
+  return T;
+}
+
 double GeometricReferencer::computeAverageReferenceError(const std::vector<SpatialMeasurement::Ptr> &spatials, const cv::Mat &T_c2w)
 {
   double error = 0.0;
@@ -0,0 +1,119 @@
+
+
+#include <algorithm>
+
+#include <opencv2/calib3d.hpp>
+
+#include <realm_vslam_base/imu_motion_prior.h>
+
+using namespace realm;
+
+ImuMotionPrior::ImuMotionPrior(const cv::Mat &T_cam_imu, double max_prediction_time)
+: m_max_prediction_time(max_prediction_time),
+  m_has_anchor(false),
+  m_has_velocity(false),
+  m_timestamp_anchor(0)
+{
+  if (T_cam_imu.empty())
+    m_R_cam_imu = cv::Mat::eye(3, 3, CV_64F);
+  else if (T_cam_imu.rows >= 3 && T_cam_imu.cols >= 3)
+    T_cam_imu.rowRange(0, 3).colRange(0, 3).convertTo(m_R_cam_imu, CV_64F);
+  else
+    throw(std::invalid_argument("Error creating IMU motion prior: Transformation from IMU to camera has wrong dimensions."));
+}
+
+void ImuMotionPrior::addImuData(const VisualSlamIF::ImuData &imu)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  // Out of order measurements are ignored
+  if (!m_imu_data.empty() && imu.timestamp <= m_imu_data.back().timestamp)
+    return;
+  m_imu_data.push_back(imu);
+
+  // Predictions never reach back further than the maximum prediction time, which also bounds the buffer while tracking
+  // is lost and no anchor is set
+  auto max_prediction_time = static_cast<uint64_t>(m_max_prediction_time * 1e9);
+  while (m_imu_data.size() > 1 && m_imu_data[1].timestamp + max_prediction_time < imu.timestamp)
+    m_imu_data.pop_front();
+}
+
+void ImuMotionPrior::update(uint64_t timestamp, const cv::Mat &T_c2w)
+{
+  if (T_c2w.empty())
+    return;
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  if (m_has_anchor && timestamp > m_timestamp_anchor)
+  {
+    double dt = static_cast<double>(timestamp - m_timestamp_anchor) * 1e-9;
+    m_velocity = (T_c2w.rowRange(0, 3).col(3) - m_T_c2w_anchor.rowRange(0, 3).col(3)) / dt;
+    m_has_velocity = true;
+  }
+  else
+  {
+    m_has_velocity = false;
+  }
+
+  m_T_c2w_anchor = T_c2w.clone();
+  m_timestamp_anchor = timestamp;
+  m_has_anchor = true;
+
+  // Keep the last measurement before the anchor, it covers the interval up to the first one after
+  while (m_imu_data.size() > 1 && m_imu_data[1].timestamp <= timestamp)
+    m_imu_data.pop_front();
+}
+
+cv::Mat ImuMotionPrior::predict(uint64_t timestamp) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  if (!m_has_anchor || timestamp <= m_timestamp_anchor)
+    return cv::Mat();
+
+  double dt = static_cast<double>(timestamp - m_timestamp_anchor) * 1e-9;
+  if (dt > m_max_prediction_time)
+    return cv::Mat();
+
+  // Integrate the gyroscope with zero order hold between the measurements. Each rate is held from its timestamp until
+  // the next measurement, clipped to the interval between anchor and requested frame.
+  cv::Mat R_imu = cv::Mat::eye(3, 3, CV_64F);
+  for (size_t i = 0; i < m_imu_data.size(); ++i)
+  {
+    uint64_t t_begin = std::max(m_imu_data[i].timestamp, m_timestamp_anchor);
+    uint64_t t_end = (i + 1 < m_imu_data.size() ? std::min(m_imu_data[i + 1].timestamp, timestamp) : timestamp);
+    if (t_end <= t_begin)
+      continue;
+
+    double dt_i = static_cast<double>(t_end - t_begin) * 1e-9;
+    const cv::Point3d &w = m_imu_data[i].gyroscope;
+    cv::Mat rvec = (cv::Mat_<double>(3, 1) << w.x * dt_i, w.y * dt_i, w.z * dt_i);
+
+    cv::Mat dR;
+    cv::Rodrigues(rvec, dR);
+    R_imu = R_imu * dR;
+  }
+
+  // Rotate the increment of the IMU into the camera frame and apply it to the anchor
+  cv::Mat R_cam = m_R_cam_imu * R_imu * m_R_cam_imu.t();
+
+  cv::Mat T_c2w = cv::Mat(3, 4, CV_64F);
+  cv::Mat R_c2w = m_T_c2w_anchor.rowRange(0, 3).colRange(0, 3) * R_cam;
+  R_c2w.copyTo(T_c2w.colRange(0, 3));
+
+  cv::Mat t_c2w = m_T_c2w_anchor.rowRange(0, 3).col(3).clone();
+  if (m_has_velocity)
+    t_c2w += m_velocity * dt;
+  t_c2w.copyTo(T_c2w.col(3));
+
+  return T_c2w;
+}
+
+void ImuMotionPrior::reset()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_has_anchor = false;
+  m_has_velocity = false;
+  m_imu_data.clear();
+}
@@ -2,6 +2,7 @@
 
 #include <realm_vslam_base/open_vslam.h>
 #include <realm_core/timer.h>
+#include <realm_core/scoped_timer.h>
 
 #include <openvslam/config.h>
 #include <openvslam/data/landmark.h>
@@ -18,6 +19,7 @@ OpenVslam::OpenVslam(const VisualSlamSettings::Ptr &vslam_set, const CameraSetti
    m_previous_state(openvslam::tracker_state_t::NotInitialized),
    m_last_keyframe(nullptr),
    m_max_keyframe_links(10),
+   m_pose_update_epoch(0),
    m_resizing((*vslam_set)["resizing"].toDouble()),
    m_path_vocabulary((*vslam_set)["path_vocabulary"].toString())
 {
@@ -72,19 +74,12 @@ VisualSlamIF::State OpenVslam::track(Frame::Ptr &frame, const cv::Mat &T_c2w_ini
 
   // OpenVSLAM returns a transformation from the world to the camera frame (T_w2c). In case we provide an initial guess
   // of the current pose, we have to invert this before, because in OpenREALM the standard is defined as T_c2w.
+  // The frame is tracked without the guess, as prior poses are not yet implemented for OpenVSLAM. Skipping the frame
+  // instead would leave T_w2c empty while the tracker still reports its previous state.
   cv::Mat T_w2c;
-  std::shared_ptr<openvslam::Mat44_t> T_w2c_eigen;
-  if (T_c2w_initial.empty())
-  {
-    T_w2c_eigen = m_vslam->feed_monocular_frame(frame->getResizedImageRaw(), frame->getTimestamp() * 10e-9);
-
-    if (T_w2c_eigen != nullptr)
-      T_w2c = convertToCv(*T_w2c_eigen);
-  }
-  else
-  {
-    // prior not yet implemented
-  }
+  std::shared_ptr<openvslam::Mat44_t> T_w2c_eigen = m_vslam->feed_monocular_frame(frame->getResizedImageGray(), frame->getTimestamp() * 10e-9);
+  if (T_w2c_eigen != nullptr)
+    T_w2c = convertToCv(*T_w2c_eigen);
 
   openvslam::tracker_state_t tracker_state = m_vslam->get_tracker_state();
 
@@ -94,7 +89,7 @@ VisualSlamIF::State OpenVslam::track(Frame::Ptr &frame, const cv::Mat &T_c2w_ini
   m_mutex_last_drawn_frame.unlock();
 
   // In case tracking was successful and slam not lost
-  if (tracker_state == openvslam::tracker_state_t::Tracking)
+  if (tracker_state == openvslam::tracker_state_t::Tracking && !T_w2c.empty())
   {
     // Get list of keyframes
     std::vector<openvslam::data::keyframe*> keyframes;
@@ -186,6 +181,36 @@ void OpenVslam::reset()
   m_vslam->request_reset();
 }
 
+bool OpenVslam::saveMap(const std::string &filepath)
+{
+  m_vslam->save_map_database(filepath);
+  return true;
+}
+
+bool OpenVslam::loadMap(const std::string &filepath)
+{
+  // OpenVSLAM only loads maps before its threads are started, so the system is recreated around the loaded map
+  if (m_future_update_keyframes.valid())
+    m_future_update_keyframes.wait();
+
+  close();
+
+  m_vslam = std::make_shared<openvslam::system>(m_config, m_path_vocabulary);
+  m_vslam->load_map_database(filepath);
+  m_frame_publisher = m_vslam->get_frame_publisher();
+  m_map_publisher = m_vslam->get_map_publisher();
+
+  // Loaded keyframes are not linked to any frame of this run, tracking must relocalize before updates are sent again
+  m_vslam->startup(false);
+  internalReset();
+
+  std::vector<openvslam::data::keyframe*> keyframes;
+  m_nrof_keyframes = m_map_publisher->get_keyframes(keyframes);
+
+  LOG_F(INFO, "Loaded map of visual SLAM from '%s'", filepath.c_str());
+  return true;
+}
+
 void OpenVslam::internalReset()
 {
   std::lock_guard<std::mutex> lock(m_mutex_last_keyframe);
@@ -204,6 +229,11 @@ void OpenVslam::registerResetCallback(const VisualSlamIF::ResetFuncCb &func)
   m_reset_callback = func;
 }
 
+void OpenVslam::registerUpdateBatchTransport(const VisualSlamIF::PoseUpdateBatchFuncCb &func)
+{
+  m_pose_update_batch_callback = func;
+}
+
 PointCloud::Ptr OpenVslam::getTrackedMapPoints()
 {
   m_mutex_last_keyframe.lock();
@@ -301,7 +331,10 @@ void OpenVslam::addKeyframeLink(Frame::Ptr &frame_realm, openvslam::data::keyfra
 
 void OpenVslam::updateKeyframes()
 {
-  long t = Timer::getCurrentTimeMilliseconds();
+  ScopedTimer timer_update_kfs("Update KFs");
+
+  // Poses corrected by local bundle adjustment or loop closure are collected and sent in one batch
+  std::vector<VisualSlamIF::PoseUpdate> pose_updates;
 
   for (auto it = m_keyframe_links.begin(); it != m_keyframe_links.end(); it++)
   {
@@ -344,6 +377,15 @@ void OpenVslam::updateKeyframes()
         LOG_F(INFO, "Updating frame %u: %u --> %u", frame_realm->getFrameId(), sparse_cloud->size(), new_surface_points.rows);
         frame_realm->setSparseCloud(std::make_shared<PointCloud>(new_surface_point_ids, new_surface_points), true);
       }
+
+      if (m_pose_update_batch_callback)
+      {
+        // Same conversion as the tracked pose in track()
+        cv::Mat T_c2w = invertPose(convertToCv(frame_slam->get_cam_pose()));
+        T_c2w.pop_back();
+        if (cv::norm(T_c2w, frame_realm->getVisualPoseView(), cv::NORM_INF) > 1e-6)
+          pose_updates.push_back({frame_realm->getFrameId(), T_c2w});
+      }
     }
     else
     {
@@ -352,5 +394,11 @@ void OpenVslam::updateKeyframes()
       it = m_keyframe_links.erase(it);
     }
   }
-  LOG_F(INFO, "Timing [Update KFs]: %lu ms", Timer::getCurrentTimeMilliseconds()-t);
+  timer_update_kfs.stop();
+
+  if (!pose_updates.empty())
+  {
+    LOG_F(INFO, "Sending %lu keyframe pose updates (epoch %lu)", pose_updates.size(), m_pose_update_epoch + 1);
+    m_pose_update_batch_callback(++m_pose_update_epoch, pose_updates);
+  }
 }
\ No newline at end of file
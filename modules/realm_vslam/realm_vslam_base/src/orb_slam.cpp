@@ -94,11 +94,11 @@ VisualSlamIF::State OrbSlam::track(Frame::Ptr &frame, const cv::Mat &T_c2w_initi
 
   cv::Mat T_w2c;
 #ifdef USE_ORB_SLAM2
-  T_w2c = m_slam->TrackMonocular(frame->getResizedImageRaw(), timestamp);
+  T_w2c = m_slam->TrackMonocular(frame->getResizedImageGray(), timestamp);
 #endif
 
 #ifdef USE_ORB_SLAM3
-  T_w2c = m_slam->TrackMonocular(frame->getResizedImageRaw(), timestamp, m_imu_queue);
+  T_w2c = m_slam->TrackMonocular(frame->getResizedImageGray(), timestamp, m_imu_queue);
   m_imu_queue.clear();
 #endif
 
@@ -109,13 +109,9 @@ VisualSlamIF::State Ov2Slam::track(Frame::Ptr &frame, const cv::Mat &T_c2w_initi
   const double timestamp = static_cast<double>(frame->getTimestamp())/10e3;
   LOG_IF_F(INFO, true, "Time stamp of frame: %4.2f [s]", timestamp);
 
-  cv::Mat img = frame->getResizedImageRaw();
-
-  if (img.channels() == 3)
-    cv::cvtColor(img, img, cv::COLOR_BGR2GRAY);
-  else if(img.channels() == 4)
-    cv::cvtColor(img, img, cv::COLOR_BGRA2GRAY);
-
+  // Resized and converted once per frame, usually already on the input thread. OV2SLAM takes the image by non-const
+  // reference and may equalize it in place, so it gets its own copy instead of the cached one.
+  cv::Mat img = frame->getResizedImageGray().clone();
   m_slam->addNewMonoImage(timestamp, img);
   m_slam->spin();
 
@@ -1,6 +1,7 @@
 
 
 #include <realm_vslam_base/visual_slam_factory.h>
+#include <realm_vslam_base/vocabulary_cache.h>
 
 #if defined USE_ORB_SLAM2 || defined USE_ORB_SLAM3
   #include <realm_vslam_base/orb_slam.h>
@@ -32,6 +33,14 @@ VisualSlamIF::Ptr VisualSlamFactory::create(const VisualSlamSettings::Ptr &vslam
                                             const CameraSettings::Ptr &cam_set,
                                             const ImuSettings::Ptr &imu_set)
 {
+#if defined USE_ORB_SLAM2 || defined USE_ORB_SLAM3
+  // ORB SLAM loads the text vocabulary for several seconds, the binary cache of it almost instantly. The loader is
+  // chosen by ORB SLAM depending on the suffix of the path.
+  std::string type = (*vslam_set)["type"].toString();
+  if (type == "ORB_SLAM2" || type == "ORB_SLAM3")
+    vslam_set->set("path_vocabulary", VocabularyCache::resolve((*vslam_set)["path_vocabulary"].toString()));
+#endif
+
   // If compiled with ORB SLAM 2
 #ifdef USE_ORB_SLAM2
   if ((*vslam_set)["type"].toString() == "ORB_SLAM2")
@@ -0,0 +1,159 @@
+
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <realm_core/loguru.h>
+#include <realm_core/timer.h>
+#include <realm_vslam_base/vocabulary_cache.h>
+
+using namespace realm;
+
+constexpr int VocabularyCache::kDescriptorSize;
+
+namespace
+{
+
+//! Node record as stored in the binary file
+struct NodeRecord
+{
+  uint32_t parent;
+  uint8_t descriptor[VocabularyCache::kDescriptorSize];
+  float weight;
+  bool is_leaf;
+};
+
+const uint32_t g_size_node_record = sizeof(uint32_t) + VocabularyCache::kDescriptorSize + sizeof(float) + sizeof(bool);
+
+bool getModificationTime(const std::string &filepath, time_t &mtime)
+{
+  struct stat st{};
+  if (stat(filepath.c_str(), &st) != 0)
+    return false;
+  mtime = st.st_mtime;
+  return true;
+}
+
+} // namespace
+
+std::string VocabularyCache::resolve(const std::string &path_vocabulary)
+{
+  std::string path_bin = createCachePath(path_vocabulary);
+  if (path_bin.empty())
+    return path_vocabulary;
+
+  time_t mtime_txt = 0;
+  time_t mtime_bin = 0;
+  if (!getModificationTime(path_vocabulary, mtime_txt))
+    return path_vocabulary;
+  if (getModificationTime(path_bin, mtime_bin) && mtime_bin >= mtime_txt)
+    return path_bin;
+
+  LOG_F(INFO, "Creating binary cache '%s' of vocabulary '%s'. This is done only once...", path_bin.c_str(), path_vocabulary.c_str());
+  long t = Timer::getCurrentTimeMilliseconds();
+  try
+  {
+    convertTextToBinary(path_vocabulary, path_bin);
+  }
+  catch (const std::exception &e)
+  {
+    LOG_F(WARNING, "Creating binary vocabulary cache failed: %s. Using text vocabulary.", e.what());
+    return path_vocabulary;
+  }
+  LOG_F(INFO, "Created binary vocabulary cache in %4.2fs.", static_cast<double>(Timer::getCurrentTimeMilliseconds() - t) / 1000.0);
+
+  return path_bin;
+}
+
+void VocabularyCache::convertTextToBinary(const std::string &path_txt, const std::string &path_bin)
+{
+  std::ifstream file_txt(path_txt);
+  if (!file_txt.is_open())
+    throw(std::invalid_argument("Error converting vocabulary: Text file could not be opened!"));
+
+  // First line of the text format: branching factor k, depth L, scoring and weighting type
+  std::string line;
+  std::getline(file_txt, line);
+  std::stringstream ss_header(line);
+  int32_t k, L, scoring, weighting;
+  if (!(ss_header >> k >> L >> scoring >> weighting) || k < 0 || k > 20 || L < 1 || L > 10
+      || scoring < 0 || scoring > 5 || weighting < 0 || weighting > 3)
+    throw(std::invalid_argument("Error converting vocabulary: Header of text file is invalid!"));
+
+  // Every following line is one node: parent id, leaf flag, descriptor bytes and weight
+  std::vector<NodeRecord> nodes;
+  while (std::getline(file_txt, line))
+  {
+    if (line.find_first_not_of(" \t\r") == std::string::npos)
+      continue;
+
+    std::stringstream ss_node(line);
+    NodeRecord node{};
+    int is_leaf;
+    if (!(ss_node >> node.parent >> is_leaf))
+      throw(std::invalid_argument("Error converting vocabulary: Node " + std::to_string(nodes.size() + 1) + " is invalid!"));
+
+    for (int i = 0; i < kDescriptorSize; ++i)
+    {
+      int value;
+      if (!(ss_node >> value) || value < 0 || value > 255)
+        throw(std::invalid_argument("Error converting vocabulary: Descriptor of node " + std::to_string(nodes.size() + 1) + " is invalid!"));
+      node.descriptor[i] = static_cast<uint8_t>(value);
+    }
+
+    if (!(ss_node >> node.weight) || node.parent > nodes.size())
+      throw(std::invalid_argument("Error converting vocabulary: Node " + std::to_string(nodes.size() + 1) + " is invalid!"));
+
+    node.is_leaf = (is_leaf > 0);
+    nodes.push_back(node);
+  }
+
+  if (nodes.empty())
+    throw(std::invalid_argument("Error converting vocabulary: Text file contains no nodes!"));
+
+  // Written next to the target and renamed, so readers either see the complete cache or none
+  std::string path_tmp = path_bin + ".tmp" + std::to_string(getpid());
+  FILE* file_bin = fopen(path_tmp.c_str(), "wb");
+  if (file_bin == nullptr)
+    throw(std::runtime_error("Error converting vocabulary: Binary file could not be opened!"));
+
+  // Number of nodes includes the root, which is not stored
+  uint32_t nrof_nodes = static_cast<uint32_t>(nodes.size() + 1);
+  uint32_t size_node = g_size_node_record;
+  bool is_written = fwrite(&nrof_nodes, sizeof(nrof_nodes), 1, file_bin) == 1
+                    && fwrite(&size_node, sizeof(size_node), 1, file_bin) == 1
+                    && fwrite(&k, sizeof(k), 1, file_bin) == 1
+                    && fwrite(&L, sizeof(L), 1, file_bin) == 1
+                    && fwrite(&scoring, sizeof(scoring), 1, file_bin) == 1
+                    && fwrite(&weighting, sizeof(weighting), 1, file_bin) == 1;
+
+  // Records are packed, so every member is written separately
+  for (size_t i = 0; i < nodes.size() && is_written; ++i)
+  {
+    const NodeRecord &node = nodes[i];
+    is_written = fwrite(&node.parent, sizeof(node.parent), 1, file_bin) == 1
+                 && fwrite(node.descriptor, 1, kDescriptorSize, file_bin) == static_cast<size_t>(kDescriptorSize)
+                 && fwrite(&node.weight, sizeof(node.weight), 1, file_bin) == 1
+                 && fwrite(&node.is_leaf, sizeof(node.is_leaf), 1, file_bin) == 1;
+  }
+
+  if (fclose(file_bin) != 0 || !is_written || std::rename(path_tmp.c_str(), path_bin.c_str()) != 0)
+  {
+    std::remove(path_tmp.c_str());
+    throw(std::runtime_error("Error converting vocabulary: Writing binary file failed!"));
+  }
+}
+
+std::string VocabularyCache::createCachePath(const std::string &path_txt)
+{
+  const std::string suffix = ".txt";
+  if (path_txt.size() <= suffix.size() || path_txt.compare(path_txt.size() - suffix.size(), suffix.size(), suffix) != 0)
+    return std::string();
+  return path_txt.substr(0, path_txt.size() - suffix.size()) + ".bin";
+}
@@ -1,7 +1,38 @@
 import os
 import argparse
+import math
 import re
 import statistics
+import struct
+
+# Binary format written by realm::TimingRecorder
+TIMING_MAGIC = b'RTIM'
+TIMING_VERSION = 1
+TIMING_HEADER = struct.Struct('<4sI')
+TIMING_RECORD = struct.Struct('<32s32sQQ')
+
+def process_binary(timing_file):
+	# Create a dictionary with all timed operations, keyed by thread and operation name
+	timed_functions = {}
+
+	magic, version = TIMING_HEADER.unpack(timing_file.read(TIMING_HEADER.size))
+	if version != TIMING_VERSION:
+		print('Error: Unsupported timing file version %i' % version)
+		raise SystemExit
+
+	while True:
+		chunk = timing_file.read(TIMING_RECORD.size)
+		if len(chunk) < TIMING_RECORD.size:
+			break
+		thread, name, t_start, duration = TIMING_RECORD.unpack(chunk)
+		thread = thread.split(b'\0', 1)[0].decode('utf-8', 'replace')
+		name = name.split(b'\0', 1)[0].decode('utf-8', 'replace')
+
+		key = thread + ' / ' + name
+		# Durations are recorded in microseconds
+		timed_functions.setdefault(key, []).append(duration / 1000.0)
+
+	return timed_functions
 
 def process_log(log_file):
 	# Create a dictionary with all timed operations
@@ -23,41 +54,59 @@ def process_log(log_file):
 			else:
 				timed_functions[function_name] = [time]
 
-	for f in timed_functions:
+	return timed_functions
+
+def percentile(data, p):
+	data = sorted(data)
+	idx = min(len(data) - 1, max(0, int(math.ceil(p / 100.0 * len(data))) - 1))
+	return data[idx]
+
+def print_statistics(timed_functions):
+	for f in sorted(timed_functions):
 		data = timed_functions[f]
 		print(" ")
 		print("### Processing step [" + f + "] ###")
-		print("Average: " + str(statistics.mean(data)) + " ms")
-		print("StdDev: " + str(statistics.stdev(data)) + " ms")
-		print("Min: " + str(min(data)) + "ms")
-		print("Max: " + str(max(data)) + "ms")
+		print("Count: " + str(len(data)))
+		print("Average: %.3f ms" % statistics.mean(data))
+		print("StdDev: %.3f ms" % (statistics.stdev(data) if len(data) > 1 else 0.0))
+		print("Min: %.3f ms" % min(data))
+		print("p50: %.3f ms" % percentile(data, 50.0))
+		print("p99: %.3f ms" % percentile(data, 99.0))
+		print("Max: %.3f ms" % max(data))
 
 
 
 if __name__ == "__main__":
 	parser = argparse.ArgumentParser(
-		description="Script that extracts timing informations from a stage log.",
+		description="Script that extracts timing informations from a timing file or a stage log.",
 	)
 
 	# Add the arguments:
-	#   - log_file: full path to the log file to be processed.
+	#   - file: full path to the binary timing file (timing.bin) or the log file to be processed.
 
 	parser.add_argument(
-		'log_file',
-		help='The location of the log file '
+		'file',
+		help='The location of the timing file or the log file'
 	)
 
 	args = parser.parse_args()
 
-	log_file = args.log_file
-
-	# Read the log file
+	# Read the file
 	try:
-	  f = open(log_file, 'r')
-	except FileNotFoundException:
-	  print('Error: Could log file does not exist at %s', log_file)
+	  f = open(args.file, 'rb')
+	except IOError:
+	  print('Error: File does not exist at %s' % args.file)
 	  raise SystemExit
 
-	process_log(f)
+	# Binary timing files start with a magic, everything else is treated as a log file of older versions
+	if f.read(len(TIMING_MAGIC)) == TIMING_MAGIC:
+		f.seek(0)
+		timed_functions = process_binary(f)
+	else:
+		f.close()
+		f = open(args.file, 'r')
+		timed_functions = process_log(f)
+
+	print_statistics(timed_functions)
 
-	f.close()
\ No newline at end of file
+	f.close()
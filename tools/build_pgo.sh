@@ -0,0 +1,22 @@
+#!/bin/bash
+set -ex
+
+# Builds an optimised release of OpenREALM with profile-guided optimisation and link time optimisation:
+#   tools/build_pgo.sh [build_dir] [additional cmake arguments]
+# Both passes use the same build directory, because the profiles of GCC refer to the paths of the object files. The
+# optimised libraries are installed from it afterwards with e.g. 'cmake --install <build_dir>'.
+
+SOURCE_DIR="$(cd "$(dirname "$0")/.." && pwd)"
+BUILD_DIR="${1:-${SOURCE_DIR}/build_pgo}"
+shift || true
+
+mkdir -p "${BUILD_DIR}"
+
+# Pass 1: instrumented build and training
+cmake -S "${SOURCE_DIR}" -B "${BUILD_DIR}" -DCMAKE_BUILD_TYPE=Release -DBENCHMARKS_ENABLED=ON -DPGO_MODE=GENERATE "$@"
+cmake --build "${BUILD_DIR}" -j"$(nproc)"
+cmake --build "${BUILD_DIR}" --target pgo_train
+
+# Pass 2: optimised rebuild with the collected profiles
+cmake -S "${SOURCE_DIR}" -B "${BUILD_DIR}" -DPGO_MODE=USE "$@"
+cmake --build "${BUILD_DIR}" -j"$(nproc)"